@@ -0,0 +1,577 @@
+/*
+ * Host benchmark of the smell pipeline: change-point detection, FFT,
+ * feature extraction and every classifier, one stage at a time over the
+ * same windows. Prints a JSON report; see README.md.
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "changepoint.h"
+#include "classifier.h"
+#include "feature_extract.h"
+#include "fft.h"
+#include "nn_model.h"
+#include "nn_reference.h"
+#include "online_model.h"
+
+#include "measure.h"
+#include "trace.h"
+
+#define FEATURE_DIM (TRACE_CHANNELS * FEATURE_PER_CHANNEL)
+#define KNN_K 5
+
+typedef struct {
+    float rows[TRACE_CHANNELS][TRACE_FRAME_LEN];
+    float features[FEATURE_DIM];
+    uint16_t class_index;
+} window_t;
+
+typedef struct {
+    uint32_t windows;
+    uint32_t train;
+    uint16_t classes;
+    uint32_t seed;
+    const char *trace_path;
+    const char *nn_path;
+    const char *stages;
+    const char *label;
+    const char *output;
+} options_t;
+
+static options_t options = {
+    .windows = 10000,
+    .train = 512,
+    .classes = 8,
+    .seed = 1,
+};
+static trace_t trace;
+// Used outside the timed regions to give stages that classify their
+// input features
+static feature_plan_t input_plan;
+
+// Per-stage state, set up and torn down around each stage
+static changepoint_t detectors[TRACE_CHANNELS];
+static fft_config_t *fft_plan;
+static feature_plan_t stage_plan;
+static uint32_t *classifier_blob;
+static classifier_model_t classifier;
+static online_model_t online;
+static float standard_mean[FEATURE_DIM];
+static float standard_inv_std[FEATURE_DIM];
+static uint32_t *nn_blob;
+static nn_model_t nn;
+static int8_t nn_arena[64 * 1024];
+static nn_reference_t nn_float;
+static uint32_t correct;
+
+static void make_window(uint32_t index, window_t *w, int with_features) {
+    w->class_index = trace_window(&trace, index, w->rows);
+    if (with_features) {
+        for (int ch = 0; ch < TRACE_CHANNELS; ch++) {
+            feature_extract(&input_plan, w->rows[ch], &w->features[ch * FEATURE_PER_CHANNEL]);
+        }
+    }
+}
+
+// Training windows come from the top of the index range, so they are
+// never the ones measured
+static uint32_t train_index(uint32_t i) {
+    return 0x80000000u + i;
+}
+
+static int load_file(const char *path, uint32_t **blob, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    *blob = length > 0 ? malloc(((size_t)length + 3) & ~(size_t)3) : NULL;
+    int ok = *blob != NULL && fread(*blob, 1, (size_t)length, f) == (size_t)length;
+    fclose(f);
+    if (!ok) {
+        free(*blob);
+        *blob = NULL;
+        return -1;
+    }
+    *size = (size_t)length;
+    return 0;
+}
+
+// Standardisation of the training windows, as tools/smell_model.py
+// computes it
+static void standardise(const window_t *train, uint32_t count) {
+    for (int i = 0; i < FEATURE_DIM; i++) {
+        double sum = 0.0, sum_sq = 0.0;
+        for (uint32_t n = 0; n < count; n++) {
+            sum += train[n].features[i];
+        }
+        const double mean = sum / count;
+        for (uint32_t n = 0; n < count; n++) {
+            double d = train[n].features[i] - mean;
+            sum_sq += d * d;
+        }
+        const double var = sum_sq / count;
+        standard_mean[i] = (float)mean;
+        standard_inv_std[i] = var > 1e-12 ? (float)(1.0 / sqrt(var)) : 0.0f;
+    }
+}
+
+static window_t *make_training_set(void) {
+    window_t *train = malloc(options.train * sizeof(window_t));
+    if (train == NULL) {
+        return NULL;
+    }
+    for (uint32_t n = 0; n < options.train; n++) {
+        make_window(train_index(n), &train[n], 1);
+    }
+    standardise(train, options.train);
+    return train;
+}
+
+// Lays out a classifier blob the way tools/smell_model.py does
+static int build_classifier(classifier_kind_t kind) {
+    window_t *train = make_training_set();
+    if (train == NULL) {
+        return -1;
+    }
+    const uint16_t class_count = trace.class_count;
+    const uint16_t proto_count = kind == CLASSIFIER_CENTROID ? class_count : (uint16_t)options.train;
+    const size_t size = sizeof(classifier_header_t) + (size_t)class_count * CLASSIFIER_LABEL_LEN
+        + 2 * FEATURE_DIM * sizeof(float) + ((proto_count * sizeof(uint16_t) + 3) & ~(size_t)3)
+        + (size_t)proto_count * FEATURE_DIM * sizeof(float);
+    classifier_blob = calloc(1, size);
+    if (classifier_blob == NULL) {
+        free(train);
+        return -1;
+    }
+
+    uint8_t *p = (uint8_t *)classifier_blob;
+    classifier_header_t header = {
+        .magic = CLASSIFIER_MAGIC,
+        .version = CLASSIFIER_VERSION,
+        .kind = kind,
+        .dim = FEATURE_DIM,
+        .class_count = class_count,
+        .proto_count = proto_count,
+        .k = kind == CLASSIFIER_KNN ? KNN_K : 0,
+        .temperature = 1.0f,
+        .reject_distance = 0.0f,
+    };
+    memcpy(p, &header, sizeof(header));
+    p += sizeof(header);
+    for (uint16_t c = 0; c < class_count; c++) {
+        strncpy((char *)p, trace.labels[c], CLASSIFIER_LABEL_LEN - 1);
+        p += CLASSIFIER_LABEL_LEN;
+    }
+    memcpy(p, standard_mean, sizeof(standard_mean));
+    p += sizeof(standard_mean);
+    memcpy(p, standard_inv_std, sizeof(standard_inv_std));
+    p += sizeof(standard_inv_std);
+
+    uint16_t *proto_class = (uint16_t *)p;
+    p += (proto_count * sizeof(uint16_t) + 3) & ~(size_t)3;
+    float *protos = (float *)p;
+    if (kind == CLASSIFIER_CENTROID) {
+        uint32_t members[TRACE_MAX_CLASSES] = {0};
+        for (uint32_t n = 0; n < options.train; n++) {
+            float *proto = &protos[(size_t)train[n].class_index * FEATURE_DIM];
+            members[train[n].class_index]++;
+            for (int i = 0; i < FEATURE_DIM; i++) {
+                proto[i] += (train[n].features[i] - standard_mean[i]) * standard_inv_std[i];
+            }
+        }
+        for (uint16_t c = 0; c < class_count; c++) {
+            proto_class[c] = c;
+            for (int i = 0; i < FEATURE_DIM && members[c] > 0; i++) {
+                protos[(size_t)c * FEATURE_DIM + i] /= members[c];
+            }
+        }
+    } else {
+        for (uint32_t n = 0; n < options.train; n++) {
+            proto_class[n] = train[n].class_index;
+            for (int i = 0; i < FEATURE_DIM; i++) {
+                protos[(size_t)n * FEATURE_DIM + i] = (train[n].features[i] - standard_mean[i]) * standard_inv_std[i];
+            }
+        }
+    }
+    free(train);
+    return classifier_load(&classifier, classifier_blob, size);
+}
+
+static int setup_changepoint(void) {
+    // main/gas_array.c's noise floors
+    static const float floors[TRACE_CHANNELS] = {2.0f, 3.0f, 2.0f, 2.0f, 1.0f};
+    for (int ch = 0; ch < TRACE_CHANNELS; ch++) {
+        changepoint_config_t config = CHANGEPOINT_CONFIG_DEFAULT(floors[ch]);
+        changepoint_init(&detectors[ch], &config);
+    }
+    return 0;
+}
+
+static void run_changepoint(const window_t *w) {
+    for (int t = 0; t < TRACE_FRAME_LEN; t++) {
+        for (int ch = 0; ch < TRACE_CHANNELS; ch++) {
+            changepoint_update(&detectors[ch], w->rows[ch][t]);
+        }
+    }
+}
+
+static int setup_fft(void) {
+    fft_plan = fft_init(TRACE_FRAME_LEN, FFT_REAL, FFT_FORWARD, NULL, NULL);
+    return fft_plan != NULL ? 0 : -1;
+}
+
+static void run_fft(const window_t *w) {
+    for (int ch = 0; ch < TRACE_CHANNELS; ch++) {
+        memcpy(fft_plan->input, w->rows[ch], sizeof(w->rows[ch]));
+        fft_execute(fft_plan);
+    }
+}
+
+static void teardown_fft(void) {
+    fft_destroy(fft_plan);
+    fft_plan = NULL;
+}
+
+static int setup_features(void) {
+    return feature_plan_init(&stage_plan, TRACE_FRAME_LEN, TRACE_SAMPLE_PERIOD_S);
+}
+
+static void run_features(const window_t *w) {
+    float features[FEATURE_DIM];
+    for (int ch = 0; ch < TRACE_CHANNELS; ch++) {
+        feature_extract(&stage_plan, w->rows[ch], &features[ch * FEATURE_PER_CHANNEL]);
+    }
+}
+
+static void teardown_features(void) {
+    feature_plan_free(&stage_plan);
+}
+
+static int setup_centroid(void) {
+    return build_classifier(CLASSIFIER_CENTROID);
+}
+
+static int setup_knn(void) {
+    return build_classifier(CLASSIFIER_KNN);
+}
+
+static void run_classifier(const window_t *w) {
+    classifier_result_t result;
+    if (classifier_classify(&classifier, w->features, &result) == 0 && result.class_index == w->class_index) {
+        correct++;
+    }
+}
+
+static void teardown_classifier(void) {
+    free(classifier_blob);
+    classifier_blob = NULL;
+}
+
+static int setup_online(void) {
+    window_t *train = make_training_set();
+    if (train == NULL ||
+        online_model_init(&online, FEATURE_DIM, CLASSIFIER_MAX_CLASSES, standard_mean, standard_inv_std) != 0) {
+        free(train);
+        return -1;
+    }
+    for (uint32_t n = 0; n < options.train; n++) {
+        online_model_update(&online, trace.labels[train[n].class_index], train[n].features, NULL);
+    }
+    free(train);
+    return 0;
+}
+
+static void run_online(const window_t *w) {
+    classifier_result_t result;
+    if (online_model_classify(&online, w->features, &result) == 0 &&
+        strcmp(result.label, trace.labels[w->class_index]) == 0) {
+        correct++;
+    }
+}
+
+static void teardown_online(void) {
+    online_model_free(&online);
+}
+
+static int setup_nn_int8(void) {
+    size_t size;
+    if (options.nn_path == NULL || load_file(options.nn_path, &nn_blob, &size) != 0) {
+        return -1;
+    }
+    if (nn_model_load(&nn, nn_blob, size, nn_arena, sizeof(nn_arena)) != 0 ||
+        (size_t)nn.header->input_len * nn.header->input_channels != FEATURE_DIM) {
+        free(nn_blob);
+        nn_blob = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+static int setup_nn_float(void) {
+    if (setup_nn_int8() != 0) {
+        return -1;
+    }
+    return nn_reference_init(&nn_float, &nn);
+}
+
+static int nn_class(int best, const window_t *w) {
+    return strncmp(nn.labels[best], trace.labels[w->class_index], NN_LABEL_LEN - 1) == 0;
+}
+
+static void run_nn_int8(const window_t *w) {
+    correct += nn_class(nn_model_run(&nn, w->features, NULL), w);
+}
+
+static void run_nn_float(const window_t *w) {
+    correct += nn_class(nn_reference_run(&nn_float, w->features, NULL), w);
+}
+
+static void teardown_nn(void) {
+    nn_reference_free(&nn_float);
+    free(nn_blob);
+    nn_blob = NULL;
+}
+
+typedef struct {
+    const char *name;
+    int (*setup)(void);
+    void (*run)(const window_t *w);
+    void (*teardown)(void);
+    int needs_features;
+    int reports_accuracy;
+} stage_t;
+
+static const stage_t stages[] = {
+    {"changepoint", setup_changepoint, run_changepoint, NULL, 0, 0},
+    {"fft", setup_fft, run_fft, teardown_fft, 0, 0},
+    {"features", setup_features, run_features, teardown_features, 0, 0},
+    {"centroid", setup_centroid, run_classifier, teardown_classifier, 1, 1},
+    {"knn", setup_knn, run_classifier, teardown_classifier, 1, 1},
+    {"online", setup_online, run_online, teardown_online, 1, 1},
+    {"nn_int8", setup_nn_int8, run_nn_int8, teardown_nn, 1, 1},
+    {"nn_float", setup_nn_float, run_nn_float, teardown_nn, 1, 1},
+};
+
+typedef struct {
+    const stage_t *stage;
+    int skipped;
+    double seconds;
+    double p50_us;
+    double p99_us;
+    double max_us;
+    uint64_t peak_rss_kb;
+    alloc_count_t setup_allocs;
+    alloc_count_t run_allocs;
+    double accuracy;
+} result_t;
+
+static int stage_selected(const char *name) {
+    if (options.stages == NULL) {
+        return 1;
+    }
+    size_t len = strlen(name);
+    for (const char *p = options.stages; *p != '\0';) {
+        const char *end = strchr(p, ',');
+        size_t n = end != NULL ? (size_t)(end - p) : strlen(p);
+        if (n == len && strncmp(p, name, n) == 0) {
+            return 1;
+        }
+        p += n + (end != NULL);
+    }
+    return 0;
+}
+
+static void run_stage(const stage_t *stage, uint32_t *latency, result_t *result) {
+    memset(result, 0, sizeof(result_t));
+    result->stage = stage;
+    correct = 0;
+
+    measure_reset_peak_rss();
+    alloc_count_reset();
+    if (stage->setup() != 0) {
+        result->skipped = 1;
+        if (stage->teardown != NULL) {
+            stage->teardown();
+        }
+        return;
+    }
+    result->setup_allocs = alloc_count_read();
+
+    alloc_count_reset();
+    window_t w;
+    uint64_t total_ns = 0;
+    for (uint32_t i = 0; i < options.windows; i++) {
+        make_window(i, &w, stage->needs_features);
+        uint64_t start = measure_now_ns();
+        stage->run(&w);
+        uint64_t elapsed = measure_now_ns() - start;
+        latency[i] = elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed;
+        total_ns += elapsed;
+    }
+    result->run_allocs = alloc_count_read();
+    result->peak_rss_kb = measure_peak_rss_kb();
+    if (stage->teardown != NULL) {
+        stage->teardown();
+    }
+
+    result->seconds = total_ns / 1e9;
+    result->p50_us = measure_percentile(latency, options.windows, 50.0) / 1e3;
+    result->p99_us = measure_percentile(latency, options.windows, 99.0) / 1e3;
+    result->max_us = measure_percentile(latency, options.windows, 100.0) / 1e3;
+    result->accuracy = stage->reports_accuracy ? (double)correct / options.windows : NAN;
+}
+
+static void write_json(FILE *out, const result_t *results, size_t count) {
+    fprintf(out, "{\n");
+    fprintf(out, "  \"label\": \"%s\",\n", options.label != NULL ? options.label : "");
+    fprintf(out, "  \"windows\": %u,\n", options.windows);
+    fprintf(out, "  \"trace\": \"%s\",\n", options.trace_path != NULL ? options.trace_path : "synthetic");
+    fprintf(out, "  \"classes\": %u,\n", trace.class_count);
+    fprintf(out, "  \"seed\": %u,\n", options.seed);
+    fprintf(out, "  \"train\": %u,\n", options.train);
+    fprintf(out, "  \"channels\": %d,\n", TRACE_CHANNELS);
+    fprintf(out, "  \"frame_len\": %d,\n", TRACE_FRAME_LEN);
+    fprintf(out, "  \"stages\": [");
+    const char *separator = "\n";
+    double int8_s = 0.0, float_s = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        const result_t *r = &results[i];
+        if (r->skipped) {
+            continue;
+        }
+        fprintf(out, "%s    {\"name\": \"%s\", \"seconds\": %.6f, \"windows_per_s\": %.1f, "
+                "\"p50_us\": %.3f, \"p99_us\": %.3f, \"max_us\": %.3f, \"peak_rss_kb\": %llu, "
+                "\"setup_allocs\": %llu, \"setup_alloc_bytes\": %llu, \"allocs\": %llu, \"alloc_bytes\": %llu",
+                separator, r->stage->name, r->seconds, r->seconds > 0.0 ? options.windows / r->seconds : 0.0,
+                r->p50_us, r->p99_us, r->max_us, (unsigned long long)r->peak_rss_kb,
+                (unsigned long long)r->setup_allocs.calls, (unsigned long long)r->setup_allocs.bytes,
+                (unsigned long long)r->run_allocs.calls, (unsigned long long)r->run_allocs.bytes);
+        if (!isnan(r->accuracy)) {
+            fprintf(out, ", \"accuracy\": %.4f", r->accuracy);
+        }
+        fprintf(out, "}");
+        separator = ",\n";
+        if (strcmp(r->stage->name, "nn_int8") == 0) {
+            int8_s = r->seconds;
+        } else if (strcmp(r->stage->name, "nn_float") == 0) {
+            float_s = r->seconds;
+        }
+    }
+    fprintf(out, "\n  ]");
+    if (int8_s > 0.0 && float_s > 0.0) {
+        fprintf(out, ",\n  \"nn_int8_speedup\": %.3f", float_s / int8_s);
+    }
+    fprintf(out, "\n}\n");
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -n, --windows N    windows per stage, default %u\n"
+            "  -c, --classes K    synthetic smells, default %u\n"
+            "  -t, --train N      training windows for the classifiers, default %u\n"
+            "  -s, --seed S       synthetic trace seed, default %u\n"
+            "  -r, --trace FILE   replay a recorded CSV or binary trace instead\n"
+            "      --nn FILE      network blob from tools/smell_nn.py, enables nn_int8 and nn_float\n"
+            "      --stages LIST  comma-separated stages to run, default all\n"
+            "  -l, --label TEXT   recorded in the report, such as a commit\n"
+            "  -o, --output FILE  write the report there instead of stdout\n",
+            argv0, options.windows, options.classes, options.train, options.seed);
+}
+
+int main(int argc, char **argv) {
+    static const struct option long_options[] = {
+        {"windows", required_argument, NULL, 'n'},
+        {"classes", required_argument, NULL, 'c'},
+        {"train", required_argument, NULL, 't'},
+        {"seed", required_argument, NULL, 's'},
+        {"trace", required_argument, NULL, 'r'},
+        {"nn", required_argument, NULL, 'N'},
+        {"stages", required_argument, NULL, 'S'},
+        {"label", required_argument, NULL, 'l'},
+        {"output", required_argument, NULL, 'o'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:c:t:s:r:l:o:h", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'n': options.windows = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'c': options.classes = (uint16_t)strtoul(optarg, NULL, 0); break;
+        case 't': options.train = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 's': options.seed = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'r': options.trace_path = optarg; break;
+        case 'N': options.nn_path = optarg; break;
+        case 'S': options.stages = optarg; break;
+        case 'l': options.label = optarg; break;
+        case 'o': options.output = optarg; break;
+        default: usage(argv[0]); return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (options.windows == 0 || options.train == 0 || options.train > 0xFFFF) {
+        fprintf(stderr, "--windows must be positive and --train 1 to 65535\n");
+        return 2;
+    }
+
+    if (options.trace_path != NULL ? trace_replay(&trace, options.trace_path) != 0
+                                   : trace_synthetic(&trace, options.classes, options.seed) != 0) {
+        fprintf(stderr, "no trace: %s\n", options.trace_path != NULL ? options.trace_path : "bad --classes");
+        return 1;
+    }
+    if (feature_plan_init(&input_plan, TRACE_FRAME_LEN, TRACE_SAMPLE_PERIOD_S) != 0) {
+        fprintf(stderr, "feature plan failed\n");
+        return 1;
+    }
+
+    // Touched up front so it is part of the baseline every stage's peak
+    // RSS starts from
+    uint32_t *latency = malloc(options.windows * sizeof(uint32_t));
+    if (latency == NULL) {
+        fprintf(stderr, "no memory for %u latencies\n", options.windows);
+        return 1;
+    }
+    memset(latency, 0, options.windows * sizeof(uint32_t));
+    if (!measure_reset_peak_rss()) {
+        fprintf(stderr, "cannot reset peak RSS, peaks are for the whole run\n");
+    }
+
+    const size_t stage_count = sizeof(stages) / sizeof(stages[0]);
+    result_t results[sizeof(stages) / sizeof(stages[0])];
+    size_t count = 0;
+    for (size_t i = 0; i < stage_count; i++) {
+        if (!stage_selected(stages[i].name)) {
+            continue;
+        }
+        run_stage(&stages[i], latency, &results[count]);
+        const result_t *r = &results[count++];
+        if (r->skipped) {
+            fprintf(stderr, "%-12s skipped\n", stages[i].name);
+        } else {
+            fprintf(stderr, "%-12s %10.0f windows/s  p50 %8.2f us  p99 %8.2f us  %6llu KiB  %llu allocs\n",
+                    stages[i].name, options.windows / r->seconds, r->p50_us, r->p99_us,
+                    (unsigned long long)r->peak_rss_kb, (unsigned long long)r->run_allocs.calls);
+        }
+    }
+
+    FILE *out = options.output != NULL ? fopen(options.output, "w") : stdout;
+    if (out == NULL) {
+        fprintf(stderr, "cannot write %s\n", options.output);
+        return 1;
+    }
+    write_json(out, results, count);
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    free(latency);
+    feature_plan_free(&input_plan);
+    trace_free(&trace);
+    return 0;
+}
@@ -0,0 +1,315 @@
+/*
+ * Replays a session of gas samples through the change-point detectors
+ * the way main/gas_array.c runs them, one per channel with its noise
+ * floor, and scores the captures against the labels:
+ *
+ *   changepoint_replay --trace session.csv
+ *   changepoint_replay --hours 200
+ *
+ * A session is a CSV of one sample a second, as smell_session csv
+ * writes them: a label, then the five channel values. Labelled samples
+ * are a smell being presented and unlabelled ones the air in between,
+ * so each run of a label is one exposure starting at its first sample.
+ * Without --trace a synthetic session is replayed, see trace.h.
+ *
+ * An onset on any channel starts a capture, and the next one can only
+ * start once every channel is back at rest, as on the device. A capture
+ * during an exposure, or within --grace seconds after it while the
+ * response dies away, detects it; the first one scores the detection
+ * delay and how far the estimated onset is from the true one. A capture
+ * anywhere else is a false trigger, counted per hour of rest.
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "changepoint.h"
+
+#include "measure.h"
+#include "trace.h"
+
+typedef struct {
+    const char *trace_path;
+    const char *session_path;
+    double hours;
+    uint16_t classes;
+    uint32_t seed;
+    uint32_t grace;
+    float floors[TRACE_CHANNELS];
+    double min_detected;
+    double max_false_rate;
+} options_t;
+
+static options_t options = {
+    .hours = 200.0,
+    .classes = 8,
+    .seed = 1,
+    .grace = 180,
+    // main/gas_array.c's noise_floor: ppb, ppm, ticks, ticks, mV
+    .floors = {2.0f, 3.0f, 2.0f, 2.0f, 1.0f},
+    .min_detected = 0.0,
+    .max_false_rate = INFINITY,
+};
+
+static const char *const channel_names[TRACE_CHANNELS] = {"tvoc", "eco2", "raw_h2", "raw_ethanol", "port_b_adc"};
+
+typedef struct {
+    uint32_t start;
+    uint32_t end;           // one past its last labelled sample
+    bool detected;
+} exposure_t;
+
+// The runs of a label, each one exposure
+static uint32_t find_exposures(const trace_t *trace, uint32_t samples, exposure_t *exposures) {
+    uint32_t count = 0;
+    uint16_t previous = TRACE_REST;
+    for (uint32_t n = 0; n < samples; n++) {
+        const uint16_t c = trace->sample_class[n];
+        if (c != previous && c != TRACE_REST) {
+            exposures[count++] = (exposure_t){.start = n, .end = n + 1};
+        } else if (c != TRACE_REST) {
+            exposures[count - 1].end = n + 1;
+        }
+        previous = c;
+    }
+    return count;
+}
+
+static int replay(const trace_t *trace) {
+    const uint32_t samples = trace->window_count * TRACE_FRAME_LEN;
+    exposure_t *exposures = malloc(samples * sizeof(exposure_t));
+    uint32_t *delays = malloc(samples * sizeof(uint32_t));
+    uint32_t *onset_errors = malloc(samples * sizeof(uint32_t));
+    if (exposures == NULL || delays == NULL || onset_errors == NULL) {
+        fprintf(stderr, "no memory for %u samples\n", samples);
+        return 1;
+    }
+    const uint32_t exposure_count = find_exposures(trace, samples, exposures);
+
+    changepoint_t detectors[TRACE_CHANNELS];
+    for (int ch = 0; ch < TRACE_CHANNELS; ch++) {
+        changepoint_config_t config = CHANGEPOINT_CONFIG_DEFAULT(options.floors[ch]);
+        changepoint_init(&detectors[ch], &config);
+    }
+
+    uint32_t detected = 0, false_triggers = 0, retriggers = 0, rest_samples = 0, early_onsets = 0;
+    uint32_t first_channel[TRACE_CHANNELS] = {0};
+    uint32_t current = 0;           // the exposure now or last, by index
+    uint32_t capture_left = 0;
+    bool armed = true;
+    uint64_t busy_ns = 0;
+    alloc_count_reset();
+    for (uint32_t n = 0; n < samples; n++) {
+        float values[TRACE_CHANNELS];
+        trace_sample(trace, n, values);
+        while (current + 1 < exposure_count && exposures[current + 1].start <= n) {
+            current++;
+        }
+        const exposure_t *e = exposure_count > 0 && exposures[current].start <= n ? &exposures[current] : NULL;
+        const bool attributable = e != NULL && n < e->end + options.grace;
+
+        // gas_process_sample(), without the window
+        const uint64_t start_ns = measure_now_ns();
+        bool onset = false, resting = true;
+        uint32_t onset_at = n;
+        int channel = 0;
+        for (int ch = 0; ch < TRACE_CHANNELS; ch++) {
+            if (changepoint_update(&detectors[ch], values[ch]) == CHANGEPOINT_ONSET) {
+                if (!onset || detectors[ch].onset < onset_at) {
+                    channel = ch;
+                }
+                onset = true;
+                onset_at = detectors[ch].onset < onset_at ? detectors[ch].onset : onset_at;
+            }
+            resting = resting && !detectors[ch].exposed;
+        }
+        const bool capture = onset && armed && capture_left == 0;
+        if (capture) {
+            capture_left = TRACE_FRAME_LEN;
+            armed = false;
+        }
+        capture_left -= capture_left > 0;
+        if (resting && !armed && capture_left == 0) {
+            armed = true;
+        }
+        busy_ns += measure_now_ns() - start_ns;
+
+        rest_samples += !attributable;
+        if (!capture) {
+            continue;
+        }
+        if (!attributable) {
+            false_triggers++;
+        } else if (exposures[current].detected) {
+            retriggers++;
+        } else {
+            exposures[current].detected = true;
+            delays[detected] = n - e->start;
+            // Before the true onset if it jumped the gun on noise
+            early_onsets += onset_at < e->start;
+            onset_errors[detected] = onset_at > e->start ? onset_at - e->start : e->start - onset_at;
+            first_channel[channel]++;
+            detected++;
+        }
+    }
+    const uint64_t allocs = alloc_count_read().calls;
+
+    const double rest_hours = rest_samples * TRACE_SAMPLE_PERIOD_S / 3600.0;
+    const double false_rate = rest_hours > 0.0 ? false_triggers / rest_hours : 0.0;
+    const double detected_pct = exposure_count > 0 ? 100.0 * detected / exposure_count : 100.0;
+    printf("%u samples, %.1f h: %u exposures, %.1f h at rest\n", samples, samples * TRACE_SAMPLE_PERIOD_S / 3600.0,
+           exposure_count, rest_hours);
+    printf("noise floors:");
+    for (int ch = 0; ch < TRACE_CHANNELS; ch++) {
+        printf(" %s %g", channel_names[ch], options.floors[ch]);
+    }
+    printf("\n");
+    printf("detected %u of %u exposures (%.1f%%), %u captured again before rest\n", detected, exposure_count,
+           detected_pct, retriggers);
+    if (detected > 0) {
+        const double d50 = measure_percentile(delays, detected, 50.0);
+        const double d90 = measure_percentile(delays, detected, 90.0);
+        const double dmax = measure_percentile(delays, detected, 100.0);
+        const double e50 = measure_percentile(onset_errors, detected, 50.0);
+        const double emax = measure_percentile(onset_errors, detected, 100.0);
+        printf("detection delay p50 %.0f s, p90 %.0f s, max %.0f s; onset estimate off by p50 %.0f s, max %.0f s, %u early\n",
+               d50 * TRACE_SAMPLE_PERIOD_S, d90 * TRACE_SAMPLE_PERIOD_S, dmax * TRACE_SAMPLE_PERIOD_S,
+               e50 * TRACE_SAMPLE_PERIOD_S, emax * TRACE_SAMPLE_PERIOD_S, early_onsets);
+        printf("first to see it:");
+        for (int ch = 0; ch < TRACE_CHANNELS; ch++) {
+            printf(" %s %u", channel_names[ch], first_channel[ch]);
+        }
+        printf("\n");
+    }
+    printf("false triggers %u, %.3f per hour at rest\n", false_triggers, false_rate);
+    printf("%.0f ns a sample for %d channels, %llu allocations\n", samples > 0 ? (double)busy_ns / samples : 0.0,
+           TRACE_CHANNELS, (unsigned long long)allocs);
+    free(exposures);
+    free(delays);
+    free(onset_errors);
+
+    if (allocs != 0) {
+        fprintf(stderr, "changepoint_update() allocated\n");
+        return 1;
+    }
+    if (detected_pct < options.min_detected) {
+        fprintf(stderr, "detected %.1f%% is under --min-detected %.1f%%\n", detected_pct, options.min_detected);
+        return 1;
+    }
+    if (false_rate > options.max_false_rate) {
+        fprintf(stderr, "%.3f false triggers an hour is over --max-false-rate %.3f\n", false_rate, options.max_false_rate);
+        return 1;
+    }
+    return 0;
+}
+
+static int write_session(const char *path, const trace_t *trace) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        return -1;
+    }
+    const uint32_t samples = trace->window_count * TRACE_FRAME_LEN;
+    fprintf(f, "# %u s of synthetic session seed %u\n", samples, trace->seed);
+    fprintf(f, "label,%s,%s,%s,%s,%s\n", channel_names[0], channel_names[1], channel_names[2], channel_names[3],
+            channel_names[4]);
+    for (uint32_t n = 0; n < samples; n++) {
+        float values[TRACE_CHANNELS];
+        const uint16_t c = trace_sample(trace, n, values);
+        fputs(c != TRACE_REST ? trace->labels[c] : "", f);
+        for (int ch = 0; ch < TRACE_CHANNELS; ch++) {
+            fprintf(f, ",%.9g", values[ch]);
+        }
+        fputc('\n', f);
+    }
+    return fclose(f);
+}
+
+static int parse_floors(const char *text) {
+    char *end;
+    for (int ch = 0; ch < TRACE_CHANNELS; ch++) {
+        options.floors[ch] = strtof(text, &end);
+        if (end == text || options.floors[ch] <= 0.0f || (ch < TRACE_CHANNELS - 1 && *end != ',')) {
+            return -1;
+        }
+        text = end + 1;
+    }
+    return *end == '\0' ? 0 : -1;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -r, --trace FILE          replay a labelled CSV or binary session instead of a synthetic one\n"
+            "  -H, --hours H             length of the synthetic session, default %g\n"
+            "  -c, --classes K           synthetic smells, default %u\n"
+            "  -s, --seed S              synthetic session seed, default %u\n"
+            "  -w, --write-session FILE  write the synthetic session as a CSV and stop\n"
+            "  -f, --floors A,B,C,D,E    noise floor of each channel, default main/gas_array.c's\n"
+            "  -g, --grace S             seconds after an exposure a capture still counts for it, default %u\n"
+            "  -d, --min-detected P      exit 1 if under P percent of exposures are detected\n"
+            "  -F, --max-false-rate R    exit 1 over R false triggers an hour at rest\n",
+            argv0, options.hours, options.classes, options.seed, options.grace);
+}
+
+int main(int argc, char **argv) {
+    static const struct option long_options[] = {
+        {"trace", required_argument, NULL, 'r'},
+        {"hours", required_argument, NULL, 'H'},
+        {"classes", required_argument, NULL, 'c'},
+        {"seed", required_argument, NULL, 's'},
+        {"write-session", required_argument, NULL, 'w'},
+        {"floors", required_argument, NULL, 'f'},
+        {"grace", required_argument, NULL, 'g'},
+        {"min-detected", required_argument, NULL, 'd'},
+        {"max-false-rate", required_argument, NULL, 'F'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "r:H:c:s:w:f:g:d:F:h", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'r': options.trace_path = optarg; break;
+        case 'H': options.hours = strtod(optarg, NULL); break;
+        case 'c': options.classes = (uint16_t)strtoul(optarg, NULL, 0); break;
+        case 's': options.seed = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'w': options.session_path = optarg; break;
+        case 'f':
+            if (parse_floors(optarg) != 0) {
+                fprintf(stderr, "--floors takes %d positive values\n", TRACE_CHANNELS);
+                return 2;
+            }
+            break;
+        case 'g': options.grace = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'd': options.min_detected = strtod(optarg, NULL); break;
+        case 'F': options.max_false_rate = strtod(optarg, NULL); break;
+        default: usage(argv[0]); return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (optind != argc || options.hours <= 0.0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    trace_t trace;
+    const uint32_t samples = (uint32_t)(options.hours * 3600.0 / TRACE_SAMPLE_PERIOD_S);
+    if (options.trace_path != NULL ? trace_replay(&trace, options.trace_path) != 0
+                                   : trace_synthetic_session(&trace, options.classes, options.seed, samples) != 0) {
+        fprintf(stderr, "no session: %s\n", options.trace_path != NULL ? options.trace_path : "bad --classes");
+        return 1;
+    }
+    int ret;
+    if (options.session_path != NULL) {
+        ret = write_session(options.session_path, &trace) == 0 ? 0 : 1;
+        if (ret != 0) {
+            fprintf(stderr, "cannot write %s\n", options.session_path);
+        }
+    } else {
+        ret = replay(&trace);
+    }
+    trace_free(&trace);
+    return ret;
+}
@@ -0,0 +1,168 @@
+/*
+ * Host test of the CIC decimator in components/sensor_array/cic.c. A slow
+ * tone in white noise, quantised like the 12-bit ADC, goes through the
+ * filter the gas array streams Port B with, and the SNR after it must
+ * gain what averaging R samples promises. Also checks DC gain, that
+ * splitting the input into odd blocks changes nothing, and the limits
+ * of cic_init().
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cic.h"
+
+#include "host_test.h"
+#include "measure.h"
+
+// main/gas_array.c: 8 kHz decimated by 256, with 4 fractional bits
+#define RATE 8000
+#define ORDER 3
+#define DECIMATION_LOG2 8
+#define FRAC_BITS 4
+#define RATIO (1 << DECIMATION_LOG2)
+
+#define SECONDS 120
+#define INPUTS (RATE * SECONDS)
+#define TONE_HZ 0.2
+#define TONE_COUNTS 300.0
+#define NOISE_COUNTS 40.0
+
+static uint16_t input[INPUTS];
+static double clean[INPUTS];
+static int32_t output[INPUTS / RATIO + 1];
+
+static uint32_t rng_state = 12345;
+
+static double uniform(void) {
+    rng_state = rng_state * 1664525u + 1013904223u;
+    return (rng_state >> 8) / 16777216.0;
+}
+
+static double gaussian(void) {
+    double u = uniform() + 1e-12, v = uniform();
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+static void make_signal(void) {
+    for (int i = 0; i < INPUTS; i++) {
+        clean[i] = 2048.0 + TONE_COUNTS * sin(2.0 * M_PI * TONE_HZ * i / RATE);
+        double noisy = round(clean[i] + NOISE_COUNTS * gaussian());
+        input[i] = noisy < 0 ? 0 : noisy > 4095 ? 4095 : (uint16_t)noisy;
+    }
+}
+
+static double snr_db(double signal_power, double noise_power) {
+    return 10.0 * log10(signal_power / noise_power);
+}
+
+static void test_snr_gain(void) {
+    cic_t cic;
+    CHECK_EQ(cic_init(&cic, ORDER, DECIMATION_LOG2, FRAC_BITS), 0);
+
+    alloc_count_reset();
+    uint64_t start = measure_now_ns();
+    size_t outputs = cic_process(&cic, input, INPUTS, output);
+    uint64_t elapsed = measure_now_ns() - start;
+    CHECK_EQ(outputs, INPUTS / RATIO);
+    CHECK_EQ(alloc_count_read().calls, 0);
+
+    double signal_power = TONE_COUNTS * TONE_COUNTS / 2.0;
+    double in_noise = 0;
+    for (int i = 0; i < INPUTS; i++) {
+        double e = input[i] - clean[i];
+        in_noise += e * e;
+    }
+    in_noise /= INPUTS;
+
+    // Output k follows input (k + 1) * R - 1, late by the filter's group
+    // delay of order * (R - 1) / 2 inputs. The first `order` outputs are
+    // still filling the combs.
+    double out_noise = 0;
+    size_t counted = 0;
+    for (size_t k = ORDER; k < outputs; k++) {
+        double t = (double)(k + 1) * RATIO - 1 - ORDER * (RATIO - 1) / 2.0;
+        double expected = 2048.0 + TONE_COUNTS * sin(2.0 * M_PI * TONE_HZ * t / RATE);
+        double e = (double)output[k] / (1 << FRAC_BITS) - expected;
+        out_noise += e * e;
+        counted++;
+    }
+    out_noise /= counted;
+
+    double in_snr = snr_db(signal_power, in_noise);
+    double out_snr = snr_db(signal_power, out_noise);
+    // White noise averaged over R samples loses a factor R of its power.
+    // A third order CIC's noise bandwidth is 0.55 of an output bin, so it
+    // does a little better than a plain average.
+    double promised = 10.0 * log10(RATIO);
+    CHECK(out_snr - in_snr >= promised);
+    fprintf(stderr, "SNR %.1f dB in, %.1f dB out: %.1f dB gained, %.1f dB from averaging %d samples\n",
+            in_snr, out_snr, out_snr - in_snr, promised, RATIO);
+    fprintf(stderr, "%.1f ns per input sample on this host\n", (double)elapsed / INPUTS);
+}
+
+static void test_dc(void) {
+    static uint16_t dc[4 * RATIO];
+    int32_t out[8];
+    cic_t cic;
+    for (size_t i = 0; i < sizeof(dc) / sizeof(dc[0]); i++) {
+        dc[i] = 3001;
+    }
+    cic_init(&cic, ORDER, DECIMATION_LOG2, FRAC_BITS);
+    size_t n = cic_process(&cic, dc, 4 * RATIO, out);
+    CHECK_EQ(n, 4);
+    // Settled once the combs have seen `order` outputs
+    CHECK_EQ(out[ORDER], 3001 << FRAC_BITS);
+}
+
+static void test_blocks(void) {
+    static int32_t whole[INPUTS / RATIO + 1], split[INPUTS / RATIO + 1];
+    cic_t a, b;
+    cic_init(&a, ORDER, DECIMATION_LOG2, FRAC_BITS);
+    cic_init(&b, ORDER, DECIMATION_LOG2, FRAC_BITS);
+    size_t n = cic_process(&a, input, 100 * RATIO, whole);
+
+    // Blocks that are not a multiple of the ratio carry the phase over
+    size_t m = 0, pos = 0, block = 1;
+    while (pos < 100 * RATIO) {
+        size_t len = block < 100 * RATIO - pos ? block : 100 * RATIO - pos;
+        m += cic_process(&b, input + pos, len, split + m);
+        pos += len;
+        block = block * 3 + 1;
+        if (block > 1000) {
+            block = 7;
+        }
+    }
+    CHECK_EQ(m, n);
+    CHECK(memcmp(whole, split, n * sizeof(int32_t)) == 0);
+
+    // And a reset filter starts over
+    cic_reset(&a);
+    n = cic_process(&a, input, 100 * RATIO, split);
+    CHECK(memcmp(whole, split, n * sizeof(int32_t)) == 0);
+}
+
+static void test_limits(void) {
+    cic_t cic;
+    CHECK_EQ(cic_init(NULL, 3, 8, 4), -1);
+    CHECK_EQ(cic_init(&cic, 0, 8, 4), -1);
+    CHECK_EQ(cic_init(&cic, CIC_MAX_ORDER + 1, 8, 4), -1);
+    CHECK_EQ(cic_init(&cic, 3, 0, 0), -1);
+    CHECK_EQ(cic_init(&cic, 3, 17, 4), -1);
+    // 4 * 13 bits of growth is over the 48 the integrators have room for
+    CHECK_EQ(cic_init(&cic, 4, 13, 4), -1);
+    CHECK_EQ(cic_init(&cic, 4, 12, 4), 0);
+    CHECK_EQ(cic_init(&cic, 1, 4, 5), -1);
+    CHECK_EQ(cic_init(&cic, 1, 4, 4), 0);
+}
+
+int main(void) {
+    make_signal();
+    test_snr_gain();
+    test_dc();
+    test_blocks();
+    test_limits();
+    return host_test_result("cic_test");
+}
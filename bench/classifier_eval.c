@@ -0,0 +1,379 @@
+/*
+ * Accuracy and latency of the on-device classifier over a labelled
+ * feature corpus, with a model blob from tools/smell_model.py:
+ *
+ *   classifier_eval --write-corpus synth
+ *   tools/smell_model.py synth-train.csv -o model.bin --kind knn --k 5
+ *   classifier_eval --model model.bin synth-test.csv
+ *
+ * Corpus rows are read as smell_model.py reads them: a class name, then
+ * the feature vector. Every row is classified with classifier_classify()
+ * and timed on its own. The report gives the accuracy over the classes
+ * the model knows, how many of those were wrongly rejected as unknown,
+ * how many rows of classes it does not know were caught as unknown,
+ * recall per class, and the latency percentiles.
+ */
+
+#include <ctype.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "classifier.h"
+#include "feature_extract.h"
+
+#include "measure.h"
+#include "trace.h"
+
+#define LINE_MAX_LEN 8192
+#define NOVEL UINT16_MAX        // a row whose class the model does not have
+
+typedef struct {
+    const char *model_path;
+    const char *corpus_prefix;
+    uint32_t windows;
+    uint32_t train;
+    uint16_t classes;
+    uint32_t seed;
+    int hold_out;               // class left out of the training rows, -1 for none
+    uint32_t repeat;
+    double min_accuracy;
+} options_t;
+
+static options_t options = {
+    .windows = 2000,
+    .train = 240,
+    .classes = 8,
+    .seed = 1,
+    .hold_out = -1,
+    .repeat = 20,
+    .min_accuracy = 0.0,
+};
+
+typedef struct {
+    float *features;            // [count][dim]
+    uint16_t *class_index;      // into the model's labels, or NOVEL
+    uint32_t count;
+    uint32_t capacity;
+} corpus_t;
+
+static int load_file(const char *path, uint32_t **blob, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    *blob = length > 0 ? malloc(((size_t)length + 3) & ~(size_t)3) : NULL;
+    int ok = *blob != NULL && fread(*blob, 1, (size_t)length, f) == (size_t)length;
+    fclose(f);
+    if (!ok) {
+        free(*blob);
+        *blob = NULL;
+        return -1;
+    }
+    *size = (size_t)length;
+    return 0;
+}
+
+static uint16_t model_class(const classifier_model_t *model, const char *label) {
+    for (uint16_t c = 0; c < model->header->class_count; c++) {
+        if (strncmp(model->labels[c], label, CLASSIFIER_LABEL_LEN) == 0) {
+            return c;
+        }
+    }
+    return NOVEL;
+}
+
+static char *trim(char *s) {
+    while (isspace((unsigned char)*s)) {
+        s++;
+    }
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) {
+        *--end = '\0';
+    }
+    return s;
+}
+
+/*
+    Parses one row into `features`. Returns the number of features, 0 for
+    a row to skip (blank, a comment, or a header whose columns are not
+    numbers), and sets *label to the trimmed class name.
+*/
+static int parse_row(char *line, char **label, float *features, int max) {
+    if (line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0') {
+        return 0;
+    }
+    char *comma = strchr(line, ',');
+    if (comma == NULL) {
+        return 0;
+    }
+    *comma = '\0';
+    *label = trim(line);
+
+    int n = 0;
+    char *p = comma + 1;
+    for (;;) {
+        char *end;
+        float v = strtof(p, &end);
+        while (isspace((unsigned char)*end)) {
+            end++;
+        }
+        if (end == p || (*end != ',' && *end != '\0')) {
+            return 0;
+        }
+        if (n == max) {
+            return -1;
+        }
+        features[n++] = v;
+        if (*end == '\0') {
+            return n;
+        }
+        p = end + 1;
+    }
+}
+
+static int load_corpus(corpus_t *corpus, const char *path, const classifier_model_t *model) {
+    const int dim = model->header->dim;
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+    static char line[LINE_MAX_LEN];
+    float row[CLASSIFIER_MAX_DIM + 1];
+    int err = 0;
+    uint32_t line_number = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        line_number++;
+        char *label;
+        int n = parse_row(line, &label, row, CLASSIFIER_MAX_DIM + 1);
+        if (n == 0) {
+            continue;
+        }
+        if (n != dim) {
+            fprintf(stderr, "%s:%u: %d features, the model takes %d\n", path, line_number, n, dim);
+            err = -1;
+            break;
+        }
+        if (corpus->count == corpus->capacity) {
+            uint32_t capacity = corpus->capacity ? 2 * corpus->capacity : 1024;
+            float *features = realloc(corpus->features, (size_t)capacity * dim * sizeof(float));
+            uint16_t *class_index = realloc(corpus->class_index, capacity * sizeof(uint16_t));
+            if (features != NULL) {
+                corpus->features = features;
+            }
+            if (class_index != NULL) {
+                corpus->class_index = class_index;
+            }
+            if (features == NULL || class_index == NULL) {
+                err = -1;
+                break;
+            }
+            corpus->capacity = capacity;
+        }
+        memcpy(&corpus->features[(size_t)corpus->count * dim], row, dim * sizeof(float));
+        corpus->class_index[corpus->count++] = model_class(model, label);
+    }
+    fclose(f);
+    return err != 0 || corpus->count == 0 ? -1 : 0;
+}
+
+static int evaluate(const classifier_model_t *model, const corpus_t *corpus) {
+    const int dim = model->header->dim;
+    const uint16_t class_count = model->header->class_count;
+    uint32_t rows[CLASSIFIER_MAX_CLASSES] = {0}, hits[CLASSIFIER_MAX_CLASSES] = {0};
+    uint32_t known = 0, correct = 0, rejected = 0, novel = 0, caught = 0;
+
+    const size_t samples = (size_t)corpus->count * options.repeat;
+    uint32_t *latency = malloc(samples * sizeof(uint32_t));
+    if (latency == NULL) {
+        fprintf(stderr, "no memory for %zu latencies\n", samples);
+        return 1;
+    }
+
+    alloc_count_reset();
+    for (uint32_t r = 0; r < options.repeat; r++) {
+        for (uint32_t i = 0; i < corpus->count; i++) {
+            classifier_result_t result;
+            uint64_t start = measure_now_ns();
+            int err = classifier_classify(model, &corpus->features[(size_t)i * dim], &result);
+            latency[(size_t)r * corpus->count + i] = (uint32_t)(measure_now_ns() - start);
+            if (r > 0 || err != 0) {
+                continue;
+            }
+
+            uint16_t truth = corpus->class_index[i];
+            if (truth == NOVEL) {
+                novel++;
+                caught += !result.known;
+                continue;
+            }
+            known++;
+            rows[truth]++;
+            rejected += !result.known;
+            if (result.known && result.class_index == truth) {
+                correct++;
+                hits[truth]++;
+            }
+        }
+    }
+    uint64_t allocs = alloc_count_read().calls;
+
+    double accuracy = known ? 100.0 * correct / known : 0.0;
+    printf("%s model, %u prototypes of %d features, %u classes\n",
+           model->header->kind == CLASSIFIER_KNN ? "k-NN" : "centroid",
+           model->header->proto_count, dim, class_count);
+    printf("accuracy %.1f%% of %u rows of known classes, %u rejected as unknown\n", accuracy, known, rejected);
+    if (novel > 0) {
+        printf("unknown caught in %u of %u rows of classes the model lacks\n", caught, novel);
+    }
+    for (uint16_t c = 0; c < class_count; c++) {
+        if (rows[c] > 0) {
+            printf("  %-*s %5.1f%% of %u\n", CLASSIFIER_LABEL_LEN, model->labels[c], 100.0 * hits[c] / rows[c], rows[c]);
+        }
+    }
+    double p50 = measure_percentile(latency, samples, 50.0);
+    double p99 = measure_percentile(latency, samples, 99.0);
+    double max = measure_percentile(latency, samples, 100.0);
+    printf("latency p50 %.2f us, p99 %.2f us, max %.2f us over %zu inferences, %llu allocations\n",
+           p50 / 1e3, p99 / 1e3, max / 1e3, samples, (unsigned long long)allocs);
+    free(latency);
+
+    if (allocs != 0) {
+        fprintf(stderr, "classifier_classify() allocated\n");
+        return 1;
+    }
+    if (accuracy < options.min_accuracy) {
+        fprintf(stderr, "accuracy %.1f%% is under --min-accuracy %.1f%%\n", accuracy, options.min_accuracy);
+        return 1;
+    }
+    return 0;
+}
+
+static int write_rows(const char *path, const trace_t *trace, feature_plan_t *plan, uint32_t first, uint32_t count,
+                      int skip_class) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        return -1;
+    }
+    float rows[TRACE_CHANNELS][TRACE_FRAME_LEN];
+    float features[FEATURE_PER_CHANNEL];
+    fprintf(f, "# %u windows of synthetic trace seed %u, features per main/gas_array.c\n", count, trace->seed);
+    for (uint32_t n = 0; n < count; n++) {
+        uint16_t c = trace_window(trace, first + n, rows);
+        if (c == skip_class) {
+            continue;
+        }
+        fputs(trace->labels[c], f);
+        for (int ch = 0; ch < TRACE_CHANNELS; ch++) {
+            feature_extract(plan, rows[ch], features);
+            for (int i = 0; i < FEATURE_PER_CHANNEL; i++) {
+                fprintf(f, ",%.9g", features[i]);
+            }
+        }
+        fputc('\n', f);
+    }
+    return fclose(f);
+}
+
+// Training rows come from the top of the index range, so they are never
+// the ones tested
+static int write_corpus(const char *prefix) {
+    trace_t trace;
+    feature_plan_t plan;
+    if (trace_synthetic(&trace, options.classes, options.seed) != 0 ||
+        feature_plan_init(&plan, TRACE_FRAME_LEN, TRACE_SAMPLE_PERIOD_S) != 0) {
+        fprintf(stderr, "cannot synthesise %u classes\n", options.classes);
+        return 1;
+    }
+    char path[1024];
+    int err = 0;
+    snprintf(path, sizeof(path), "%s-train.csv", prefix);
+    err |= write_rows(path, &trace, &plan, 0x80000000u, options.train, options.hold_out);
+    snprintf(path, sizeof(path), "%s-test.csv", prefix);
+    err |= write_rows(path, &trace, &plan, 0, options.windows, -1);
+    feature_plan_free(&plan);
+    trace_free(&trace);
+    if (err != 0) {
+        fprintf(stderr, "cannot write %s\n", path);
+        return 1;
+    }
+    return 0;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s --model FILE [options] CORPUS.csv\n"
+            "       %s --write-corpus PREFIX [options]\n"
+            "  -m, --model FILE        model blob from tools/smell_model.py\n"
+            "  -r, --repeat N          passes over the corpus for the latency, default %u\n"
+            "  -a, --min-accuracy P    exit 1 below P percent\n"
+            "  -w, --write-corpus PREFIX\n"
+            "                          write PREFIX-train.csv and PREFIX-test.csv from a synthetic trace\n"
+            "  -n, --windows N         test rows to write, default %u\n"
+            "  -t, --train N           training rows to write, default %u\n"
+            "  -c, --classes K         synthetic smells, default %u\n"
+            "  -s, --seed S            synthetic trace seed, default %u\n"
+            "  -x, --hold-out C        leave synthetic class C out of the training rows\n",
+            argv0, argv0, options.repeat, options.windows, options.train, options.classes, options.seed);
+}
+
+int main(int argc, char **argv) {
+    static const struct option long_options[] = {
+        {"model", required_argument, NULL, 'm'},
+        {"repeat", required_argument, NULL, 'r'},
+        {"min-accuracy", required_argument, NULL, 'a'},
+        {"write-corpus", required_argument, NULL, 'w'},
+        {"windows", required_argument, NULL, 'n'},
+        {"train", required_argument, NULL, 't'},
+        {"classes", required_argument, NULL, 'c'},
+        {"seed", required_argument, NULL, 's'},
+        {"hold-out", required_argument, NULL, 'x'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "m:r:a:w:n:t:c:s:x:h", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'm': options.model_path = optarg; break;
+        case 'r': options.repeat = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'a': options.min_accuracy = strtod(optarg, NULL); break;
+        case 'w': options.corpus_prefix = optarg; break;
+        case 'n': options.windows = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 't': options.train = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'c': options.classes = (uint16_t)strtoul(optarg, NULL, 0); break;
+        case 's': options.seed = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'x': options.hold_out = atoi(optarg); break;
+        default: usage(argv[0]); return opt == 'h' ? 0 : 2;
+        }
+    }
+
+    if (options.corpus_prefix != NULL) {
+        return write_corpus(options.corpus_prefix);
+    }
+    if (options.model_path == NULL || optind != argc - 1 || options.repeat == 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    uint32_t *blob;
+    size_t size;
+    classifier_model_t model;
+    if (load_file(options.model_path, &blob, &size) != 0 || classifier_load(&model, blob, size) != 0) {
+        fprintf(stderr, "cannot load a model from %s\n", options.model_path);
+        return 1;
+    }
+    corpus_t corpus = {0};
+    if (load_corpus(&corpus, argv[optind], &model) != 0) {
+        fprintf(stderr, "no corpus in %s\n", argv[optind]);
+        return 1;
+    }
+    int ret = evaluate(&model, &corpus);
+    free(corpus.features);
+    free(corpus.class_index);
+    free(blob);
+    return ret;
+}
@@ -0,0 +1,206 @@
+/*
+ * Host test of components/timekeeping/clock_discipline.c on a fake clock.
+ * The monotonic counter runs fast or slow against true time by a known
+ * amount, and the reference is an RTC read once an hour, a few ms off
+ * like a read pinned to the seconds tick over I2C. The discipline has to
+ * learn the drift, keep its error small, never run backwards while it
+ * slews, and step when the reference jumps.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "clock_discipline.h"
+
+#include "host_test.h"
+#include "measure.h"
+
+#define HOUR_US 3600000000LL
+#define EPOCH_US 1700000000000000LL     // where true time starts
+#define JITTER_US 5000
+
+typedef struct {
+    int64_t true_us;        // since the fake boot
+    int64_t mono_us;        // esp_timer_get_time(), drifting
+    int32_t drift_ppb;      // how fast mono runs against true time
+    uint32_t rng;
+} fake_clock_t;
+
+static void advance(fake_clock_t *clock, int64_t true_us) {
+    clock->true_us += true_us;
+    clock->mono_us += true_us + true_us * clock->drift_ppb / 1000000000LL;
+}
+
+// An RTC read, up to JITTER_US either way
+static int64_t reference(fake_clock_t *clock) {
+    clock->rng = clock->rng * 1664525u + 1013904223u;
+    int64_t jitter = (int64_t)(clock->rng >> 8) % (2 * JITTER_US + 1) - JITTER_US;
+    return EPOCH_US + clock->true_us + jitter;
+}
+
+static int64_t abs64(int64_t v) {
+    return v < 0 ? -v : v;
+}
+
+/*
+    Runs `hours` of hourly updates, checking the output every second of
+    the last hour is never behind the second before it. Returns the
+    largest error over the last `check_hours`, sampled every minute.
+*/
+static int64_t track(clock_discipline_t *cd, fake_clock_t *clock, int hours, int check_hours, int64_t *backwards) {
+    int64_t worst = 0;
+    int64_t last = clock_discipline_now(cd, clock->mono_us);
+    for (int h = 0; h < hours; h++) {
+        for (int s = 0; s < 3600; s++) {
+            advance(clock, 1000000);
+            int64_t now = clock_discipline_now(cd, clock->mono_us);
+            if (now < last) {
+                (*backwards)++;
+            }
+            last = now;
+            if (h >= hours - check_hours && s % 60 == 0) {
+                int64_t error = abs64(now - (EPOCH_US + clock->true_us));
+                if (error > worst) {
+                    worst = error;
+                }
+            }
+        }
+        clock_discipline_update(cd, clock->mono_us, reference(clock), HOUR_US);
+        last = clock_discipline_now(cd, clock->mono_us);
+    }
+    return worst;
+}
+
+static void test_unsynced(void) {
+    clock_discipline_t cd;
+    clock_discipline_init(&cd);
+    CHECK(!cd.synced);
+    CHECK_EQ(clock_discipline_now(&cd, 12345), 12345);
+
+    // The first reading sets the time as it is
+    CHECK_EQ(clock_discipline_update(&cd, 1000, EPOCH_US, HOUR_US), 0);
+    CHECK(cd.synced);
+    CHECK_EQ(clock_discipline_now(&cd, 1000), EPOCH_US);
+    CHECK_EQ(clock_discipline_now(&cd, 1000 + HOUR_US), EPOCH_US + HOUR_US);
+}
+
+static void test_drift(int32_t drift_ppb, uint32_t seed) {
+    fake_clock_t clock = { .drift_ppb = drift_ppb, .rng = seed };
+    clock_discipline_t cd;
+    clock_discipline_init(&cd);
+    advance(&clock, 2500000);
+    clock_discipline_update(&cd, clock.mono_us, reference(&clock), HOUR_US);
+
+    int64_t backwards = 0;
+    int64_t worst = track(&cd, &clock, 48, 24, &backwards);
+    // The estimate undoes the drift, to within what hourly readings
+    // a few ms apart can tell: 5 ms in an hour is 1.4 ppm
+    int64_t exact_ppb = -(int64_t)drift_ppb * 1000000000LL / (1000000000LL + drift_ppb);
+    CHECK(abs64(cd.freq_ppb - exact_ppb) < 5000);
+    CHECK(worst < 4 * JITTER_US);
+    CHECK_EQ(backwards, 0);
+    CHECK_EQ(cd.steps, 0);
+
+    // Free-running, 40 ppm is 144 ms an hour
+    fprintf(stderr, "drift %+7d ppb: correction %+7d ppb for %+7lld, worst error over the second day %5.2f ms "
+            "(%.0f ms an hour undisciplined)\n",
+            drift_ppb, cd.freq_ppb, (long long)exact_ppb, worst / 1000.0, abs64(drift_ppb) * 3600.0 / 1e6);
+}
+
+// A warm afternoon: the crystal's drift changes by a few ppm over hours
+static void test_changing_drift(void) {
+    fake_clock_t clock = { .drift_ppb = 20000, .rng = 7 };
+    clock_discipline_t cd;
+    clock_discipline_init(&cd);
+    clock_discipline_update(&cd, clock.mono_us, reference(&clock), HOUR_US);
+
+    int64_t backwards = 0;
+    track(&cd, &clock, 12, 0, &backwards);
+    int64_t worst = 0;
+    for (int h = 0; h < 12; h++) {
+        clock.drift_ppb += h < 6 ? 500 : -500;
+        int64_t w = track(&cd, &clock, 1, 1, &backwards);
+        if (w > worst) {
+            worst = w;
+        }
+    }
+    CHECK(worst < 10 * JITTER_US);
+    CHECK_EQ(backwards, 0);
+    fprintf(stderr, "drift moving 0.5 ppm an hour: worst error %.2f ms\n", worst / 1000.0);
+}
+
+static void test_step(void) {
+    fake_clock_t clock = { .drift_ppb = -30000, .rng = 3 };
+    clock_discipline_t cd;
+    clock_discipline_init(&cd);
+    clock_discipline_update(&cd, clock.mono_us, reference(&clock), HOUR_US);
+    int64_t backwards = 0;
+    track(&cd, &clock, 6, 0, &backwards);
+    int32_t freq = cd.freq_ppb;
+
+    // Someone set the RTC 10 s back; the clock follows at once and keeps
+    // what it learnt about the crystal
+    advance(&clock, HOUR_US);
+    int64_t ref = reference(&clock) - 10000000;
+    int64_t error = clock_discipline_update(&cd, clock.mono_us, ref, HOUR_US);
+    CHECK(error < -CLOCK_DISCIPLINE_STEP_US);
+    CHECK_EQ(cd.steps, 1);
+    CHECK_EQ(clock_discipline_now(&cd, clock.mono_us), ref);
+    CHECK_EQ(cd.freq_ppb, freq);
+
+    // Just inside the step limit it slews instead, without going back
+    advance(&clock, HOUR_US);
+    int64_t behind = reference(&clock) - 10000000 - CLOCK_DISCIPLINE_STEP_US + 100000;
+    int64_t before = clock_discipline_now(&cd, clock.mono_us);
+    clock_discipline_update(&cd, clock.mono_us, behind, HOUR_US);
+    CHECK_EQ(cd.steps, 1);
+    CHECK_EQ(clock_discipline_now(&cd, clock.mono_us), before);
+    int64_t last = before;
+    for (int s = 0; s < 3600; s++) {
+        advance(&clock, 1000000);
+        int64_t now = clock_discipline_now(&cd, clock.mono_us);
+        CHECK(now >= last);
+        last = now;
+    }
+}
+
+static void test_clamp(void) {
+    // A counter 80% fast is broken, not drifting; the estimate stays bounded
+    fake_clock_t clock = { .drift_ppb = 800000000, .rng = 5 };
+    clock_discipline_t cd;
+    clock_discipline_init(&cd);
+    clock_discipline_update(&cd, clock.mono_us, reference(&clock), 1000000);
+    for (int i = 0; i < 20; i++) {
+        advance(&clock, 1000000);
+        clock_discipline_update(&cd, clock.mono_us, reference(&clock), 1000000);
+        CHECK(cd.freq_ppb >= -CLOCK_DISCIPLINE_MAX_PPB && cd.freq_ppb <= CLOCK_DISCIPLINE_MAX_PPB);
+        CHECK(cd.rate_ppb >= -CLOCK_DISCIPLINE_MAX_PPB && cd.rate_ppb <= CLOCK_DISCIPLINE_MAX_PPB);
+    }
+}
+
+static void bench_now(void) {
+    clock_discipline_t cd;
+    clock_discipline_init(&cd);
+    clock_discipline_update(&cd, 0, EPOCH_US, HOUR_US);
+    clock_discipline_update(&cd, HOUR_US, EPOCH_US + HOUR_US + 1234, HOUR_US);
+    const int iterations = 10000000;
+    volatile int64_t sink = 0;
+    uint64_t start = measure_now_ns();
+    for (int i = 0; i < iterations; i++) {
+        sink += clock_discipline_now(&cd, HOUR_US + i);
+    }
+    uint64_t elapsed = measure_now_ns() - start;
+    fprintf(stderr, "clock_discipline_now: %.1f ns on this host\n", (double)elapsed / iterations);
+}
+
+int main(void) {
+    test_unsynced();
+    test_drift(40000, 1);
+    test_drift(-40000, 2);
+    test_drift(3000, 3);
+    test_changing_drift();
+    test_step();
+    test_clamp();
+    bench_now();
+    return host_test_result("clock_discipline_test");
+}
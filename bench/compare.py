@@ -0,0 +1,53 @@
+#!/usr/bin/env python3
+"""Compares two smell_bench reports and flags stages that got slower.
+
+    bench/compare.py before.json after.json --threshold 10
+
+A stage regresses if its p50 or p99 latency grew by more than the
+threshold percentage, or if it now allocates while running. Exits with
+status 1 if any stage regressed, so it can gate a build.
+"""
+
+import argparse
+import json
+import sys
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("before")
+    parser.add_argument("after")
+    parser.add_argument("--threshold", type=float, default=10.0, help="percent slower that counts as a regression")
+    args = parser.parse_args()
+
+    with open(args.before) as f:
+        before = json.load(f)
+    with open(args.after) as f:
+        after = json.load(f)
+    old = {s["name"]: s for s in before["stages"]}
+
+    print("%-12s %12s %12s %9s %9s" % ("stage", "p50 us", "p99 us", "p50", "p99"))
+    regressed = []
+    for stage in after["stages"]:
+        name = stage["name"]
+        if name not in old:
+            print("%-12s %12.3f %12.3f %9s %9s" % (name, stage["p50_us"], stage["p99_us"], "new", "new"))
+            continue
+        o = old[name]
+        change = {key: 100.0 * (stage[key] - o[key]) / o[key] if o[key] > 0 else 0.0 for key in ("p50_us", "p99_us")}
+        print("%-12s %12.3f %12.3f %+8.1f%% %+8.1f%%"
+              % (name, stage["p50_us"], stage["p99_us"], change["p50_us"], change["p99_us"]))
+        if max(change.values()) > args.threshold:
+            regressed.append(name)
+        if stage["allocs"] > o["allocs"]:
+            print("%-12s allocates while running: %d calls, was %d" % (name, stage["allocs"], o["allocs"]))
+            regressed.append(name)
+
+    if regressed:
+        print("regressed (%s -> %s): %s" % (before.get("label") or args.before, after.get("label") or args.after,
+                                            ", ".join(sorted(set(regressed)))))
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
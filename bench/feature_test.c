@@ -0,0 +1,242 @@
+/*
+ * Host test and benchmark of components/features/feature_extract.c.
+ * Transients with known time constants must give back their shape:
+ * peak, peak time, rise time, slopes, area and both exponential fits,
+ * for a sensor that rises on exposure and for one that drops. The band
+ * energies are checked against a naive DFT at lengths the FFT handles
+ * in different ways. Then thousands of windows at each length must go
+ * through a plan without allocating, and the time per window is printed.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "feature_extract.h"
+
+#include "host_test.h"
+#include "measure.h"
+
+#define PI 3.14159265358979323846
+
+// A transient: flat, an exponential approach to A from ONSET, a peak at
+// PEAK, then an exponential decay
+#define N 256
+#define DT 0.1
+#define BASELINE 400.0
+#define AMPLITUDE 250.0
+#define ONSET 40
+#define PEAK 100
+#define TAU_RISE 0.8
+#define TAU_DECAY 3.0
+
+#define BENCH_WINDOWS 10000
+
+static uint32_t rng_state = 777;
+
+static double uniform(void) {
+    rng_state = rng_state * 1664525u + 1013904223u;
+    return (rng_state >> 8) / 16777216.0;
+}
+
+static double excursion(int i) {
+    const double peak = AMPLITUDE * (1.0 - exp(-(PEAK - ONSET) * DT / TAU_RISE));
+    if (i < ONSET) {
+        return 0.0;
+    }
+    if (i <= PEAK) {
+        return AMPLITUDE * (1.0 - exp(-(i - ONSET) * DT / TAU_RISE));
+    }
+    return peak * exp(-(i - PEAK) * DT / TAU_DECAY);
+}
+
+static int near(double value, double expected, double tolerance) {
+    int ok = fabs(value - expected) <= tolerance * fabs(expected);
+    if (!ok) {
+        fprintf(stderr, "  %g, expected %g within %.0f%%\n", value, expected, tolerance * 100);
+    }
+    return ok;
+}
+
+static void check_transient(double sign) {
+    feature_plan_t plan;
+    float x[N], f[FEATURE_PER_CHANNEL];
+    CHECK_EQ(feature_plan_init(&plan, N, (float)DT), 0);
+    for (int i = 0; i < N; i++) {
+        x[i] = (float)(BASELINE + sign * excursion(i));
+    }
+    feature_extract(&plan, x, f);
+
+    const double peak = excursion(PEAK);
+    // The rise and the decay integrated in closed form
+    const double rise_s = (PEAK - ONSET) * DT, decay_s = (N - PEAK) * DT;
+    const double area = AMPLITUDE * (rise_s - TAU_RISE * (1.0 - exp(-rise_s / TAU_RISE))) +
+                        peak * TAU_DECAY * (1.0 - exp(-decay_s / TAU_DECAY));
+
+    CHECK(near(f[FEATURE_BASELINE], BASELINE, 1e-6));
+    CHECK(near(f[FEATURE_PEAK], sign * peak, 1e-5));
+    CHECK(near(f[FEATURE_PEAK_TIME], PEAK * DT, 1e-5));
+    // 10 % to 90 % of an exponential approach is tau ln 9, to a sample
+    CHECK(fabs(f[FEATURE_RISE_TIME] - TAU_RISE * log(9.0)) <= DT);
+    CHECK(near(f[FEATURE_RISE_TAU], TAU_RISE, 0.05));
+    CHECK(near(f[FEATURE_DECAY_TAU], TAU_DECAY, 0.05));
+    CHECK(near(f[FEATURE_AREA], sign * area, 0.02));
+    // Central differences of the steepest parts: just after the onset,
+    // and just after the peak
+    const double onset_slope = AMPLITUDE / TAU_RISE, peak_slope = peak / TAU_DECAY;
+    CHECK(near(sign > 0 ? f[FEATURE_MAX_SLOPE] : -f[FEATURE_MIN_SLOPE], onset_slope, 0.15));
+    CHECK(near(sign > 0 ? -f[FEATURE_MIN_SLOPE] : f[FEATURE_MAX_SLOPE], peak_slope, 0.05));
+    CHECK(near(sign > 0 ? f[FEATURE_MAX] : f[FEATURE_MIN], BASELINE + sign * peak, 1e-6));
+    fprintf(stderr, "%s transient: rise tau %.3f s for %.3f, decay tau %.3f s for %.3f, rise time %.2f s, area %.1f for %.1f\n",
+            sign > 0 ? "rising " : "falling", f[FEATURE_RISE_TAU], TAU_RISE, f[FEATURE_DECAY_TAU], TAU_DECAY,
+            f[FEATURE_RISE_TIME], f[FEATURE_AREA], sign * area);
+    feature_plan_free(&plan);
+}
+
+static void test_flat_and_ramp(void) {
+    feature_plan_t plan;
+    float x[64], f[FEATURE_PER_CHANNEL];
+    CHECK_EQ(feature_plan_init(&plan, 64, 0.5f), 0);
+
+    // No response at all: nothing to fit, and the bands at their floor
+    for (int i = 0; i < 64; i++) {
+        x[i] = 123.0f;
+    }
+    feature_extract(&plan, x, f);
+    CHECK_EQ(f[FEATURE_STD], 0.0f);
+    CHECK_EQ(f[FEATURE_PEAK], 0.0f);
+    CHECK_EQ(f[FEATURE_RISE_TIME], 0.0f);
+    CHECK_EQ(f[FEATURE_RISE_TAU], 0.0f);
+    CHECK_EQ(f[FEATURE_DECAY_TAU], 0.0f);
+    CHECK_EQ(f[FEATURE_AREA], 0.0f);
+    CHECK_EQ(f[FEATURE_MAX_SLOPE], 0.0f);
+    for (int b = 0; b < FEATURE_BANDS; b++) {
+        CHECK(f[FEATURE_BAND_0 + b] < -11.9f);
+    }
+
+    // A ramp has the same slope everywhere and no decay
+    for (int i = 0; i < 64; i++) {
+        x[i] = 10.0f + 3.0f * i * 0.5f;
+    }
+    feature_extract(&plan, x, f);
+    CHECK(near(f[FEATURE_MAX_SLOPE], 3.0, 1e-5));
+    CHECK(near(f[FEATURE_MIN_SLOPE], 3.0, 1e-5));
+    CHECK(near(f[FEATURE_PEAK_TIME], 63 * 0.5, 1e-6));
+    CHECK_EQ(f[FEATURE_DECAY_TAU], 0.0f);
+    feature_plan_free(&plan);
+}
+
+/*
+    Band energies against a DFT of the same mean-removed, Hann-windowed
+    window in double precision. 32, 64 and 256 take the radix-2 real FFT,
+    48 and 100 the mixed-radix one, 33 the odd-length path that has no
+    Nyquist bin.
+*/
+static void test_bands(int n) {
+    feature_plan_t plan;
+    float x[N], f[FEATURE_PER_CHANNEL];
+    CHECK_EQ(feature_plan_init(&plan, (uint16_t)n, 1.0f), 0);
+    double mean = 0.0;
+    for (int i = 0; i < n; i++) {
+        x[i] = (float)(50.0 + 10.0 * sin(2.0 * PI * 3.0 * i / n) + 5.0 * (uniform() - 0.5));
+        mean += x[i];
+    }
+    mean /= n;
+    feature_extract(&plan, x, f);
+
+    double worst = 0.0;
+    for (int b = 0; b < FEATURE_BANDS; b++) {
+        double energy = 0.0;
+        for (int k = plan.band_edge[b]; k < plan.band_edge[b + 1]; k++) {
+            double re = 0.0, im = 0.0;
+            for (int i = 0; i < n; i++) {
+                double v = (x[i] - mean) * (0.5 - 0.5 * cos(2.0 * PI * i / n));
+                re += v * cos(2.0 * PI * k * i / n);
+                im -= v * sin(2.0 * PI * k * i / n);
+            }
+            energy += re * re + im * im;
+        }
+        double error = fabs(f[FEATURE_BAND_0 + b] - log10(energy / n + 1e-12));
+        worst = error > worst ? error : worst;
+    }
+    // 0.001 in log10 is 0.23 % of the energy
+    CHECK(worst < 1e-3);
+    fprintf(stderr, "bands at %3d samples: worst log10 error %.1e against a DFT\n", n, worst);
+    feature_plan_free(&plan);
+}
+
+static void test_limits(void) {
+    feature_plan_t plan;
+    CHECK_EQ(feature_plan_init(&plan, 2 * FEATURE_BANDS - 1, 1.0f), -1);
+    CHECK_EQ(feature_plan_init(&plan, 32, 0.0f), -1);
+    CHECK_EQ(feature_plan_init(&plan, 2 * FEATURE_BANDS, 1.0f), 0);
+    for (int b = 0; b < FEATURE_BANDS; b++) {
+        CHECK(plan.band_edge[b + 1] > plan.band_edge[b]);
+    }
+    feature_plan_free(&plan);
+    CHECK(plan.fft == NULL && plan.window == NULL);
+}
+
+// Random transients: any onset, amplitude and time constants, and noise
+static void make_window(float *x, int n) {
+    const int onset = (int)(uniform() * n / 2);
+    const double amplitude = 20.0 + 500.0 * uniform();
+    const double rise = (0.5 + 4.0 * uniform()) * n / 32, decay = (2.0 + 10.0 * uniform()) * n / 32;
+    const int peak = onset + (int)(rise * 3);
+    double level = 0.0;
+    for (int i = 0; i < n; i++) {
+        if (i >= onset && i <= peak) {
+            level = amplitude * (1.0 - exp(-(i - onset) / rise));
+        } else if (i > peak) {
+            level *= exp(-1.0 / decay);
+        }
+        x[i] = (float)(300.0 + level + 4.0 * (uniform() - 0.5));
+    }
+}
+
+static void bench_length(int n) {
+    static float windows[BENCH_WINDOWS][N];
+    static uint32_t ns[BENCH_WINDOWS];
+    float f[FEATURE_PER_CHANNEL];
+    feature_plan_t plan;
+    CHECK_EQ(feature_plan_init(&plan, (uint16_t)n, 1.0f), 0);
+    for (int w = 0; w < BENCH_WINDOWS; w++) {
+        make_window(windows[w], n);
+    }
+
+    alloc_count_reset();
+    int finite = 1;
+    for (int w = 0; w < BENCH_WINDOWS; w++) {
+        uint64_t start = measure_now_ns();
+        feature_extract(&plan, windows[w], f);
+        ns[w] = (uint32_t)(measure_now_ns() - start);
+        for (int i = 0; i < FEATURE_PER_CHANNEL; i++) {
+            finite &= isfinite(f[i]);
+        }
+    }
+    CHECK_EQ(alloc_count_read().calls, 0);
+    CHECK(finite);
+
+    double p50 = measure_percentile(ns, BENCH_WINDOWS, 50);
+    double p99 = measure_percentile(ns, BENCH_WINDOWS, 99);
+    fprintf(stderr, "%3d samples: p50 %6.2f us, p99 %6.2f us a window over %d windows, no allocations\n",
+            n, p50 / 1e3, p99 / 1e3, BENCH_WINDOWS);
+    feature_plan_free(&plan);
+}
+
+int main(void) {
+    check_transient(1.0);
+    check_transient(-1.0);
+    test_flat_and_ramp();
+    static const int band_lengths[] = { 32, 33, 48, 64, 100, 256 };
+    for (size_t i = 0; i < sizeof(band_lengths) / sizeof(band_lengths[0]); i++) {
+        test_bands(band_lengths[i]);
+    }
+    test_limits();
+    // The gas array's 32, and what longer windows would cost
+    static const int bench_lengths[] = { 32, 64, 100, 128, 256 };
+    for (size_t i = 0; i < sizeof(bench_lengths) / sizeof(bench_lengths[0]); i++) {
+        bench_length(bench_lengths[i]);
+    }
+    return host_test_result("feature_test");
+}
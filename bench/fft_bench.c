@@ -0,0 +1,541 @@
+/*
+ * Host benchmark of components/fft: checks every transform against a
+ * naive DFT in double precision, then times the recursive split-radix
+ * path (fft(), rfft()) against the iterative engine behind fft_execute()
+ * for each size, and the split-format engine with each kernel this CPU
+ * has. Sizes other than powers of two are timed against zero padding to
+ * the next one, and batches of fft_init_many() against a loop over one
+ * plan per channel. Prints a JSON report; see README.md.
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fft.h"
+
+#include "measure.h"
+
+// Sizes up to this get a full naive DFT, larger ones a sample of bins
+#define FULL_CHECK_MAX 4096
+#define CHECK_BINS 64
+// A float FFT of these sizes stays well inside this, relative to the
+// largest bin
+#define MAX_ERROR 1e-5
+#define ISA_COUNT (FFT_ISA_AVX2 + 1)
+#define MAX_SIZES 16
+#define MAX_CHANNELS 256
+
+typedef struct {
+    uint32_t min_size;
+    uint32_t max_size;
+    uint32_t min_ms;
+    const char *sizes;
+    const char *channels;
+    const char *batch_sizes;
+    const char *label;
+    const char *output;
+} options_t;
+
+static options_t options = {
+    .min_size = 64,
+    .max_size = 65536,
+    .min_ms = 50,
+    // Sensor windows, then primes for Bluestein's algorithm
+    .sizes = "60,120,300,1000,97,1009",
+    // Gas-sensor arrays, on the firmware's windows and a longer one
+    .channels = "8,16,64",
+    .batch_sizes = "64,256,1024,120",
+};
+
+typedef struct {
+    uint32_t size;
+    fft_type_t type;
+    double error;           // forward, relative to the largest bin
+    double roundtrip_error; // backward after forward, relative to the largest sample
+    double recursive_ns;    // 0 unless a power of two
+    double iterative_ns;
+    uint32_t padded_size;   // the next power of two, unless one already
+    double padded_ns;
+    uint64_t allocs;        // made by fft_execute() while timed
+    // FFT_COMPLEX_SPLIT, for complex sizes
+    double split_error;
+    double split_roundtrip_error;
+    double split_ns[ISA_COUNT];     // 0 for kernels this CPU lacks
+} result_t;
+
+// A batch of channels against a loop over one plan each, forward
+typedef struct {
+    uint32_t size;
+    uint32_t channels;
+    fft_type_t type;
+    double error;           // largest difference from the single plans', forward and back
+    double many_ns;
+    double loop_ns;
+    uint64_t allocs;        // made by the batch's fft_execute() while timed
+} batch_result_t;
+
+static uint64_t state = 1;
+
+static float noise(void) {
+    state = state * 6364136223846793005ull + 1442695040888963407ull;
+    return (float)((int64_t)(state >> 11) - (1ll << 52)) / (float)(1ll << 52);
+}
+
+// Bin k of the DFT of n complex samples, in double
+static void dft_bin(const float *x, uint32_t n, uint32_t k, double *re, double *im) {
+    double sr = 0.0, si = 0.0;
+    for (uint32_t t = 0; t < n; t++) {
+        const double angle = -2.0 * M_PI * (double)(((uint64_t)k * t) % n) / n;
+        const double c = cos(angle), s = sin(angle);
+        sr += x[2 * t] * c - x[2 * t + 1] * s;
+        si += x[2 * t] * s + x[2 * t + 1] * c;
+    }
+    *re = sr;
+    *im = si;
+}
+
+// Bin k of an FFT's output, in the component's layout
+static void output_bin(const float *y, uint32_t n, fft_type_t type, uint32_t k, double *re, double *im) {
+    if (type == FFT_COMPLEX_SPLIT) {
+        *re = y[k];
+        *im = y[n + k];
+    } else if (type == FFT_COMPLEX) {
+        *re = y[2 * k];
+        *im = y[2 * k + 1];
+    } else if (k == 0 || (k == n / 2 && n % 2 == 0)) {
+        *re = y[k == 0 ? 0 : 1];
+        *im = 0.0;
+    } else if (k == n / 2) {
+        // An odd size's last bin, its imaginary part where N / 2 would be
+        *re = y[n - 1];
+        *im = y[1];
+    } else {
+        *re = y[2 * k];
+        *im = y[2 * k + 1];
+    }
+}
+
+static double check_forward(const float *input, const float *output, uint32_t n, fft_type_t type) {
+    // The naive DFT always takes complex samples
+    float *x = malloc(2 * n * sizeof(float));
+    for (uint32_t t = 0; t < n; t++) {
+        if (type == FFT_COMPLEX_SPLIT) {
+            x[2 * t] = input[t];
+            x[2 * t + 1] = input[n + t];
+        } else {
+            x[2 * t] = type == FFT_COMPLEX ? input[2 * t] : input[t];
+            x[2 * t + 1] = type == FFT_COMPLEX ? input[2 * t + 1] : 0.0f;
+        }
+    }
+    // A real FFT only gives the bins up to n / 2
+    const uint32_t bins = type == FFT_REAL ? n / 2 + 1 : n;
+    const uint32_t step = n <= FULL_CHECK_MAX ? 1 : bins / CHECK_BINS;
+    double max_error = 0.0, max_bin = 0.0;
+    for (uint32_t k = 0; k < bins; k += step) {
+        double er, ei, gr, gi;
+        dft_bin(x, n, k, &er, &ei);
+        output_bin(output, n, type, k, &gr, &gi);
+        max_error = fmax(max_error, hypot(gr - er, gi - ei));
+        max_bin = fmax(max_bin, hypot(er, ei));
+    }
+    free(x);
+    return max_bin > 0.0 ? max_error / max_bin : max_error;
+}
+
+static double time_ns(void (*run)(fft_config_t *), fft_config_t *config) {
+    run(config);
+    uint64_t iterations = 0;
+    const uint64_t start = measure_now_ns();
+    uint64_t elapsed;
+    do {
+        for (int i = 0; i < 16; i++) {
+            run(config);
+        }
+        iterations += 16;
+        elapsed = measure_now_ns() - start;
+    } while (elapsed < (uint64_t)options.min_ms * 1000000u);
+    return (double)elapsed / iterations;
+}
+
+static void run_recursive(fft_config_t *config) {
+    if (config->type == FFT_REAL) {
+        rfft(config->input, config->output, config->twiddle_factors, config->size);
+    } else {
+        fft(config->input, config->output, config->twiddle_factors, config->size);
+    }
+}
+
+static void run_iterative(fft_config_t *config) {
+    fft_execute(config);
+}
+
+// Checks fft_execute() on a config of any type, forward then back
+static int check(uint32_t n, fft_type_t type, double *error, double *roundtrip_error, fft_config_t **kept) {
+    fft_config_t *forward = fft_init((int)n, type, FFT_FORWARD, NULL, NULL);
+    fft_config_t *backward = fft_init((int)n, type, FFT_BACKWARD, NULL, forward != NULL ? forward->input : NULL);
+    if (forward == NULL || backward == NULL) {
+        return -1;
+    }
+    const uint32_t floats = type == FFT_REAL ? n : 2 * n;
+    double max_input = 0.0;
+    for (uint32_t i = 0; i < floats; i++) {
+        forward->input[i] = noise();
+        max_input = fmax(max_input, fabsf(forward->input[i]));
+    }
+
+    // The backward transform writes its result over the forward input
+    float *saved = malloc(floats * sizeof(float));
+    memcpy(saved, forward->input, floats * sizeof(float));
+    fft_execute(forward);
+    *error = check_forward(saved, forward->output, n, type);
+    memcpy(backward->input, forward->output, floats * sizeof(float));
+    fft_execute(backward);
+    *roundtrip_error = 0.0;
+    for (uint32_t i = 0; i < floats; i++) {
+        *roundtrip_error = fmax(*roundtrip_error, fabs(backward->output[i] - saved[i]) / max_input);
+    }
+    memcpy(forward->input, saved, floats * sizeof(float));
+    free(saved);
+
+    fft_destroy(backward);
+    *kept = forward;
+    return 0;
+}
+
+static int measure_size(uint32_t n, fft_type_t type, result_t *result) {
+    memset(result, 0, sizeof(result_t));
+    result->size = n;
+    result->type = type;
+    fft_config_t *config;
+    if (check(n, type, &result->error, &result->roundtrip_error, &config) != 0) {
+        return -1;
+    }
+    if ((n & (n - 1)) == 0) {
+        result->recursive_ns = time_ns(run_recursive, config);
+    }
+    alloc_count_reset();
+    result->iterative_ns = time_ns(run_iterative, config);
+    result->allocs = alloc_count_read().calls;
+    fft_destroy(config);
+
+    if ((n & (n - 1)) != 0) {
+        for (result->padded_size = 1; result->padded_size < n; result->padded_size *= 2) {
+        }
+        config = fft_init((int)result->padded_size, type, FFT_FORWARD, NULL, NULL);
+        if (config == NULL) {
+            return -1;
+        }
+        memset(config->input, 0, (type == FFT_REAL ? 1 : 2) * result->padded_size * sizeof(float));
+        result->padded_ns = time_ns(run_iterative, config);
+        fft_destroy(config);
+        return 0;
+    }
+
+    if (type == FFT_COMPLEX) {
+        if (check(n, FFT_COMPLEX_SPLIT, &result->split_error, &result->split_roundtrip_error, &config) != 0) {
+            return -1;
+        }
+        // Every kernel runs the checked transform's twiddles, so the check
+        // above covers the best one; the others are checked by their
+        // agreeing with it
+        float *best = malloc(2 * n * sizeof(float));
+        memcpy(best, config->output, 2 * n * sizeof(float));
+        for (int isa = 0; isa < ISA_COUNT; isa++) {
+            if (fft_set_isa(config, (fft_isa_t)isa) != 0) {
+                continue;
+            }
+            fft_execute(config);
+            for (uint32_t i = 0; i < 2 * n; i++) {
+                result->split_error = fmax(result->split_error, fabs(config->output[i] - best[i]) / sqrt(n));
+            }
+            result->split_ns[isa] = time_ns(run_iterative, config);
+        }
+        free(best);
+        fft_destroy(config);
+    }
+    return 0;
+}
+
+// The single plans run_loop() times, one per channel
+static fft_config_t *loop_plans[MAX_CHANNELS];
+static uint32_t loop_count;
+
+static void run_loop(fft_config_t *config) {
+    (void)config;
+    for (uint32_t c = 0; c < loop_count; c++) {
+        fft_execute(loop_plans[c]);
+    }
+}
+
+// Largest difference of channel c of a batch's buffer from a single plan's
+static double channel_error(const float *many, const float *single, uint32_t floats, uint32_t channels,
+                            uint32_t c, double scale) {
+    double error = 0.0;
+    for (uint32_t j = 0; j < floats; j++) {
+        error = fmax(error, fabs(many[j * channels + c] - single[j]) / scale);
+    }
+    return error;
+}
+
+static int measure_batch(uint32_t n, uint32_t channels, fft_type_t type, batch_result_t *result) {
+    memset(result, 0, sizeof(batch_result_t));
+    result->size = n;
+    result->channels = channels;
+    result->type = type;
+    const uint32_t floats = type == FFT_REAL ? n : 2 * n;
+
+    fft_config_t *forward = fft_init_many((int)n, (int)channels, type, FFT_FORWARD, NULL, NULL);
+    fft_config_t *backward = fft_init_many((int)n, (int)channels, type, FFT_BACKWARD, NULL, NULL);
+    fft_config_t *single_forward = fft_init((int)n, type, FFT_FORWARD, NULL, NULL);
+    fft_config_t *single_backward = fft_init((int)n, type, FFT_BACKWARD, NULL, NULL);
+    if (forward == NULL || backward == NULL || single_forward == NULL || single_backward == NULL) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < floats * channels; i++) {
+        forward->input[i] = noise();
+    }
+
+    // Each channel through single plans, forward and back, against the
+    // batch; the backward transforms take the forward ones' outputs
+    fft_execute(forward);
+    memcpy(backward->input, forward->output, floats * channels * sizeof(float));
+    fft_execute(backward);
+    for (uint32_t c = 0; c < channels; c++) {
+        double max_bin = 0.0;
+        for (uint32_t j = 0; j < floats; j++) {
+            single_forward->input[j] = forward->input[j * channels + c];
+        }
+        fft_execute(single_forward);
+        for (uint32_t j = 0; j < floats; j++) {
+            max_bin = fmax(max_bin, fabsf(single_forward->output[j]));
+        }
+        result->error = fmax(result->error, channel_error(forward->output, single_forward->output, floats,
+                                                          channels, c, max_bin));
+        memcpy(single_backward->input, single_forward->output, floats * sizeof(float));
+        fft_execute(single_backward);
+        result->error = fmax(result->error, channel_error(backward->output, single_backward->output, floats,
+                                                          channels, c, 1.0));
+    }
+    fft_destroy(backward);
+    fft_destroy(single_backward);
+    fft_destroy(single_forward);
+
+    alloc_count_reset();
+    result->many_ns = time_ns(run_iterative, forward);
+    result->allocs = alloc_count_read().calls;
+
+    for (loop_count = 0; loop_count < channels; loop_count++) {
+        loop_plans[loop_count] = fft_init((int)n, type, FFT_FORWARD, NULL, NULL);
+        if (loop_plans[loop_count] == NULL) {
+            return -1;
+        }
+        for (uint32_t j = 0; j < floats; j++) {
+            loop_plans[loop_count]->input[j] = forward->input[j * channels + loop_count];
+        }
+    }
+    result->loop_ns = time_ns(run_loop, NULL);
+    for (uint32_t c = 0; c < loop_count; c++) {
+        fft_destroy(loop_plans[c]);
+    }
+    fft_destroy(forward);
+    return 0;
+}
+
+static void write_json(FILE *out, const result_t *results, size_t count,
+                       const batch_result_t *batches, size_t batch_count) {
+    fprintf(out, "{\n  \"label\": \"%s\",\n  \"best_isa\": \"%s\",\n  \"results\": [\n",
+            options.label != NULL ? options.label : "", fft_isa_name(fft_best_isa()));
+    for (size_t i = 0; i < count; i++) {
+        const result_t *r = &results[i];
+        fprintf(out, "    {\"size\": %u, \"type\": \"%s\", \"error\": %.3g, \"roundtrip_error\": %.3g, ",
+                r->size, r->type == FFT_REAL ? "real" : "complex", r->error, r->roundtrip_error);
+        if (r->padded_size > 0) {
+            fprintf(out, "\"iterative_ns\": %.1f, \"padded_size\": %u, \"padded_ns\": %.1f, \"speedup\": %.3f, ",
+                    r->iterative_ns, r->padded_size, r->padded_ns, r->padded_ns / r->iterative_ns);
+        } else {
+            fprintf(out, "\"recursive_ns\": %.1f, \"iterative_ns\": %.1f, \"speedup\": %.3f, ",
+                    r->recursive_ns, r->iterative_ns, r->recursive_ns / r->iterative_ns);
+        }
+        fprintf(out, "\"allocs\": %llu", (unsigned long long)r->allocs);
+        if (r->type == FFT_COMPLEX && r->padded_size == 0) {
+            fprintf(out, ",\n     \"split\": {\"error\": %.3g, \"roundtrip_error\": %.3g",
+                    r->split_error, r->split_roundtrip_error);
+            for (int isa = 0; isa < ISA_COUNT; isa++) {
+                if (r->split_ns[isa] > 0.0) {
+                    fprintf(out, ", \"%s_ns\": %.1f", fft_isa_name((fft_isa_t)isa), r->split_ns[isa]);
+                }
+            }
+            fprintf(out, "}");
+        }
+        fprintf(out, "}%s\n", i + 1 < count ? "," : "");
+    }
+    fprintf(out, "  ],\n  \"batches\": [\n");
+    for (size_t i = 0; i < batch_count; i++) {
+        const batch_result_t *b = &batches[i];
+        fprintf(out, "    {\"size\": %u, \"channels\": %u, \"type\": \"%s\", \"error\": %.3g, "
+                "\"many_ns\": %.1f, \"loop_ns\": %.1f, \"speedup\": %.3f, \"allocs\": %llu}%s\n",
+                b->size, b->channels, b->type == FFT_REAL ? "real" : "complex", b->error, b->many_ns,
+                b->loop_ns, b->loop_ns / b->many_ns, (unsigned long long)b->allocs, i + 1 < batch_count ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "      --min N        smallest size, a power of two, default %u\n"
+            "      --max N        largest size, default %u\n"
+            "  -s, --sizes LIST   other sizes, comma separated, default %s\n"
+            "  -c, --channels LIST  channels of the batches, comma separated, default %s\n"
+            "  -b, --batch-sizes LIST  sizes of the batches, comma separated, default %s\n"
+            "  -m, --min-ms MS    time each path for at least this long, default %u\n"
+            "  -l, --label TEXT   recorded in the report, such as a commit\n"
+            "  -o, --output FILE  write the report there instead of stdout\n",
+            argv0, options.min_size, options.max_size, options.sizes, options.channels, options.batch_sizes,
+            options.min_ms);
+}
+
+int main(int argc, char **argv) {
+    static const struct option long_options[] = {
+        {"min", required_argument, NULL, 'a'},
+        {"max", required_argument, NULL, 'B'},
+        {"sizes", required_argument, NULL, 's'},
+        {"channels", required_argument, NULL, 'c'},
+        {"batch-sizes", required_argument, NULL, 'b'},
+        {"min-ms", required_argument, NULL, 'm'},
+        {"label", required_argument, NULL, 'l'},
+        {"output", required_argument, NULL, 'o'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s:c:b:m:l:o:h", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'a': options.min_size = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'B': options.max_size = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 's': options.sizes = optarg; break;
+        case 'c': options.channels = optarg; break;
+        case 'b': options.batch_sizes = optarg; break;
+        case 'm': options.min_ms = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'l': options.label = optarg; break;
+        case 'o': options.output = optarg; break;
+        default: usage(argv[0]); return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (options.min_size < 16 || (options.min_size & (options.min_size - 1)) != 0 ||
+        options.max_size < options.min_size || options.max_size > (1u << 24)) {
+        fprintf(stderr, "--min must be a power of two of at least 16, and --max at least --min\n");
+        return 2;
+    }
+
+    uint32_t sizes[24 + MAX_SIZES];
+    size_t size_count = 0;
+    for (uint32_t n = options.min_size; n <= options.max_size; n *= 2) {
+        sizes[size_count++] = n;
+    }
+    for (const char *p = options.sizes; *p != '\0' && size_count < 24 + MAX_SIZES;) {
+        char *end;
+        const unsigned long n = strtoul(p, &end, 0);
+        if (end == p || n < 3 || n > (1u << 24) || (n & (n - 1)) == 0) {
+            fprintf(stderr, "--sizes takes sizes up to %u that are not powers of two, comma separated\n", 1u << 24);
+            return 2;
+        }
+        sizes[size_count++] = (uint32_t)n;
+        p = *end == ',' ? end + 1 : end;
+    }
+
+    uint32_t channels[MAX_SIZES], batch_sizes[MAX_SIZES];
+    size_t channel_count = 0, batch_size_count = 0;
+    for (const char *p = options.channels; *p != '\0' && channel_count < MAX_SIZES;) {
+        char *end;
+        const unsigned long c = strtoul(p, &end, 0);
+        if (end == p || c < 2 || c > MAX_CHANNELS) {
+            fprintf(stderr, "--channels takes counts from 2 to %u, comma separated\n", MAX_CHANNELS);
+            return 2;
+        }
+        channels[channel_count++] = (uint32_t)c;
+        p = *end == ',' ? end + 1 : end;
+    }
+    for (const char *p = options.batch_sizes; *p != '\0' && batch_size_count < MAX_SIZES;) {
+        char *end;
+        const unsigned long n = strtoul(p, &end, 0);
+        if (end == p || n < 16 || n > (1u << 16)) {
+            fprintf(stderr, "--batch-sizes takes sizes from 16 to %u, comma separated\n", 1u << 16);
+            return 2;
+        }
+        batch_sizes[batch_size_count++] = (uint32_t)n;
+        p = *end == ',' ? end + 1 : end;
+    }
+
+    result_t results[2 * (24 + MAX_SIZES)];
+    size_t count = 0;
+    int failed = 0;
+    for (size_t i = 0; i < size_count; i++) {
+        const uint32_t n = sizes[i];
+        for (int t = 0; t < 2; t++) {
+            const fft_type_t type = t == 0 ? FFT_REAL : FFT_COMPLEX;
+            result_t *r = &results[count];
+            if (measure_size(n, type, r) != 0) {
+                fprintf(stderr, "no memory for size %u\n", n);
+                return 1;
+            }
+            count++;
+            const int bad = r->error > MAX_ERROR || r->roundtrip_error > MAX_ERROR ||
+                r->split_error > MAX_ERROR || r->split_roundtrip_error > MAX_ERROR;
+            failed |= bad;
+            if (r->padded_size > 0) {
+                fprintf(stderr, "%-7s %6u  error %8.2g  roundtrip %8.2g  padded to %-5u %7.1f ns  exact %10.1f ns  x%.2f%s\n",
+                        type == FFT_REAL ? "real" : "complex", n, r->error, r->roundtrip_error, r->padded_size,
+                        r->padded_ns, r->iterative_ns, r->padded_ns / r->iterative_ns, bad ? "  WRONG" : "");
+                continue;
+            }
+            fprintf(stderr, "%-7s %6u  error %8.2g  roundtrip %8.2g  recursive %10.1f ns  iterative %10.1f ns  x%.2f%s\n",
+                    type == FFT_REAL ? "real" : "complex", n, r->error, r->roundtrip_error,
+                    r->recursive_ns, r->iterative_ns, r->recursive_ns / r->iterative_ns, bad ? "  WRONG" : "");
+            if (type == FFT_COMPLEX) {
+                fprintf(stderr, "  split         error %8.2g  roundtrip %8.2g ", r->split_error, r->split_roundtrip_error);
+                for (int isa = 0; isa < ISA_COUNT; isa++) {
+                    if (r->split_ns[isa] > 0.0) {
+                        fprintf(stderr, " %s %10.1f ns", fft_isa_name((fft_isa_t)isa), r->split_ns[isa]);
+                    }
+                }
+                fprintf(stderr, "\n");
+            }
+        }
+    }
+
+    static batch_result_t batches[2 * MAX_SIZES * MAX_SIZES];
+    size_t batch_count = 0;
+    for (size_t i = 0; i < batch_size_count; i++) {
+        for (size_t j = 0; j < channel_count; j++) {
+            for (int t = 0; t < 2; t++) {
+                const fft_type_t type = t == 0 ? FFT_REAL : FFT_COMPLEX;
+                batch_result_t *b = &batches[batch_count];
+                if (measure_batch(batch_sizes[i], channels[j], type, b) != 0) {
+                    fprintf(stderr, "no memory for %u channels of size %u\n", channels[j], batch_sizes[i]);
+                    return 1;
+                }
+                batch_count++;
+                const int bad = b->error > MAX_ERROR;
+                failed |= bad;
+                fprintf(stderr, "%-7s %6u  %3u channels  error %8.2g  loop %10.1f ns  batch %10.1f ns  x%.2f%s\n",
+                        type == FFT_REAL ? "real" : "complex", b->size, b->channels, b->error, b->loop_ns,
+                        b->many_ns, b->loop_ns / b->many_ns, bad ? "  WRONG" : "");
+            }
+        }
+    }
+
+    FILE *out = options.output != NULL ? fopen(options.output, "w") : stdout;
+    if (out == NULL) {
+        fprintf(stderr, "cannot write %s\n", options.output);
+        return 1;
+    }
+    write_json(out, results, count, batches, batch_count);
+    if (out != stdout) {
+        fclose(out);
+    }
+    return failed;
+}
@@ -0,0 +1,281 @@
+/*
+ * Host benchmark of the fixed-point FFTs of components/fft: for every
+ * power of two size, real and complex, Q15 and Q31, the signal to noise
+ * ratio of fft_fixed_execute() against fft_execute() on the same
+ * samples, forward and back, and the time of each. Prints a JSON report;
+ * see README.md.
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fft.h"
+
+#include "measure.h"
+
+// A Q15 transform of full scale noise keeps about 67 dB at 4096 points,
+// a Q31 one more than the float reference's own accuracy, about 140 dB.
+// A tone grows by 2 at every stage, so every stage shifts out a bit and
+// adds its rounding: a Q15 tone loses 3 dB each time the size doubles,
+// from about 76 dB at 16 points to 50 dB at 4096
+#define MIN_SNR_Q15 60.0
+#define MIN_SNR_Q15_TONE(n) (81.0 - 3.0 * log2((double)(n)))
+#define MIN_SNR_Q31 120.0
+#define SIGNAL_COUNT 3
+
+typedef struct {
+    uint32_t min_size;
+    uint32_t max_size;
+    uint32_t min_ms;
+    const char *label;
+    const char *output;
+} options_t;
+
+static options_t options = {
+    .min_size = 16,
+    .max_size = 4096,
+    .min_ms = 50,
+};
+
+// Full scale noise, a 12-bit ADC's range, and a tone over faint noise
+static const char *const signal_names[SIGNAL_COUNT] = {"noise", "adc12", "tone"};
+
+typedef struct {
+    uint32_t size;
+    fft_type_t type;
+    fft_format_t format;
+    double snr_db[SIGNAL_COUNT];            // forward, against fft_execute()
+    double roundtrip_snr_db[SIGNAL_COUNT];  // backward after forward, against the input
+    double float_ns;
+    double fixed_ns;
+    uint64_t allocs;                        // made by fft_fixed_execute() while timed
+} result_t;
+
+static uint64_t state = 1;
+
+static double noise(void) {
+    state = state * 6364136223846793005ull + 1442695040888963407ull;
+    return (double)((int64_t)(state >> 11) - (1ll << 52)) / (double)(1ll << 52);
+}
+
+// Sample i of a signal, in [-1, 1)
+static double signal(int kind, uint32_t i, uint32_t n) {
+    switch (kind) {
+    case 0: return noise();
+    case 1: return floor(noise() * 2048.0) / 32768.0;
+    default: return 0.9 * sin(2.0 * M_PI * 5.3 * i / n) + 1e-3 * noise();
+    }
+}
+
+static double snr_db(double signal_power, double noise_power) {
+    if (noise_power == 0.0) {
+        return 300.0;
+    }
+    return 10.0 * log10(signal_power / noise_power);
+}
+
+static double sample(const fft_fixed_config_t *config, const void *buffer, uint32_t i) {
+    return config->format == FFT_Q15 ? ((const int16_t *)buffer)[i] : ((const int32_t *)buffer)[i];
+}
+
+static void set_sample(fft_fixed_config_t *config, void *buffer, uint32_t i, double value) {
+    if (config->format == FFT_Q15) {
+        ((int16_t *)buffer)[i] = (int16_t)lrint(fmax(fmin(value * 32768.0, 32767.0), -32768.0));
+    } else {
+        ((int32_t *)buffer)[i] = (int32_t)llrint(fmax(fmin(value * 2147483648.0, 2147483647.0), -2147483648.0));
+    }
+}
+
+static double time_ns(void (*run)(void *), void *plan) {
+    run(plan);
+    uint64_t iterations = 0;
+    const uint64_t start = measure_now_ns();
+    uint64_t elapsed;
+    do {
+        for (int i = 0; i < 16; i++) {
+            run(plan);
+        }
+        iterations += 16;
+        elapsed = measure_now_ns() - start;
+    } while (elapsed < (uint64_t)options.min_ms * 1000000u);
+    return (double)elapsed / iterations;
+}
+
+static void run_float(void *plan) {
+    fft_execute(plan);
+}
+
+static void run_fixed(void *plan) {
+    fft_fixed_execute(plan);
+}
+
+// The floor each signal's SNR, forward and back, must stay above
+static double min_snr(uint32_t n, fft_format_t format, int kind) {
+    if (format == FFT_Q31) {
+        return MIN_SNR_Q31;
+    }
+    return kind == 2 ? MIN_SNR_Q15_TONE(n) : MIN_SNR_Q15;
+}
+
+static int measure(uint32_t n, fft_type_t type, fft_format_t format, result_t *result) {
+    memset(result, 0, sizeof(result_t));
+    result->size = n;
+    result->type = type;
+    result->format = format;
+    const uint32_t floats = type == FFT_REAL ? n : 2 * n;
+
+    fft_config_t *reference = fft_init((int)n, type, FFT_FORWARD, NULL, NULL);
+    fft_fixed_config_t *forward = fft_fixed_init((int)n, format, type, FFT_FORWARD, NULL, NULL);
+    fft_fixed_config_t *backward = fft_fixed_init((int)n, format, type, FFT_BACKWARD, NULL, NULL);
+    if (reference == NULL || forward == NULL || backward == NULL) {
+        return -1;
+    }
+
+    for (int kind = 0; kind < SIGNAL_COUNT; kind++) {
+        // Both paths take the same quantised samples, the float one as
+        // fractions of full scale
+        const double full_scale = format == FFT_Q15 ? 32768.0 : 2147483648.0;
+        for (uint32_t i = 0; i < floats; i++) {
+            set_sample(forward, forward->input, i, signal(kind, i / (type == FFT_REAL ? 1 : 2), n));
+            reference->input[i] = (float)(sample(forward, forward->input, i) / full_scale);
+        }
+        fft_execute(reference);
+        fft_fixed_execute(forward);
+
+        double signal_power = 0.0, noise_power = 0.0;
+        const double scale = ldexp(1.0, forward->exponent) / full_scale;
+        for (uint32_t i = 0; i < floats; i++) {
+            const double expected = reference->output[i];
+            const double error = sample(forward, forward->output, i) * scale - expected;
+            signal_power += expected * expected;
+            noise_power += error * error;
+        }
+        result->snr_db[kind] = snr_db(signal_power, noise_power);
+
+        // The backward transform of the forward one's output, as the
+        // same integers, gives the input times 2^-exponent
+        memcpy(backward->input, forward->output, floats * (format == FFT_Q15 ? sizeof(int16_t) : sizeof(int32_t)));
+        fft_fixed_execute(backward);
+        signal_power = 0.0;
+        noise_power = 0.0;
+        const double back_scale = ldexp(1.0, forward->exponent + backward->exponent);
+        for (uint32_t i = 0; i < floats; i++) {
+            const double expected = sample(forward, forward->input, i);
+            const double error = sample(backward, backward->output, i) * back_scale - expected;
+            signal_power += expected * expected;
+            noise_power += error * error;
+        }
+        result->roundtrip_snr_db[kind] = snr_db(signal_power, noise_power);
+    }
+
+    result->float_ns = time_ns(run_float, reference);
+    alloc_count_reset();
+    result->fixed_ns = time_ns(run_fixed, forward);
+    result->allocs = alloc_count_read().calls;
+
+    fft_destroy(reference);
+    fft_fixed_destroy(forward);
+    fft_fixed_destroy(backward);
+    return 0;
+}
+
+static void write_json(FILE *out, const result_t *results, size_t count) {
+    fprintf(out, "{\n  \"label\": \"%s\",\n  \"results\": [\n", options.label != NULL ? options.label : "");
+    for (size_t i = 0; i < count; i++) {
+        const result_t *r = &results[i];
+        fprintf(out, "    {\"size\": %u, \"type\": \"%s\", \"format\": \"%s\", ", r->size,
+                r->type == FFT_REAL ? "real" : "complex", r->format == FFT_Q15 ? "q15" : "q31");
+        for (int kind = 0; kind < SIGNAL_COUNT; kind++) {
+            fprintf(out, "\"%s_snr_db\": %.1f, \"%s_roundtrip_snr_db\": %.1f, ", signal_names[kind],
+                    r->snr_db[kind], signal_names[kind], r->roundtrip_snr_db[kind]);
+        }
+        fprintf(out, "\"float_ns\": %.1f, \"fixed_ns\": %.1f, \"msamples_per_s\": %.2f, \"allocs\": %llu}%s\n",
+                r->float_ns, r->fixed_ns, r->size * 1e3 / r->fixed_ns, (unsigned long long)r->allocs,
+                i + 1 < count ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "      --min N        smallest size, a power of two, default %u\n"
+            "      --max N        largest size, default %u\n"
+            "  -m, --min-ms MS    time each path for at least this long, default %u\n"
+            "  -l, --label TEXT   recorded in the report, such as a commit\n"
+            "  -o, --output FILE  write the report there instead of stdout\n",
+            argv0, options.min_size, options.max_size, options.min_ms);
+}
+
+int main(int argc, char **argv) {
+    static const struct option long_options[] = {
+        {"min", required_argument, NULL, 'a'},
+        {"max", required_argument, NULL, 'b'},
+        {"min-ms", required_argument, NULL, 'm'},
+        {"label", required_argument, NULL, 'l'},
+        {"output", required_argument, NULL, 'o'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "m:l:o:h", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'a': options.min_size = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'b': options.max_size = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'm': options.min_ms = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'l': options.label = optarg; break;
+        case 'o': options.output = optarg; break;
+        default: usage(argv[0]); return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (options.min_size < 16 || (options.min_size & (options.min_size - 1)) != 0 ||
+        options.max_size < options.min_size || options.max_size > (1u << 20)) {
+        fprintf(stderr, "--min must be a power of two of at least 16, and --max at least --min\n");
+        return 2;
+    }
+
+    result_t results[4 * 21];
+    size_t count = 0;
+    int failed = 0;
+    for (uint32_t n = options.min_size; n <= options.max_size; n *= 2) {
+        for (int t = 0; t < 2; t++) {
+            for (int f = 0; f < 2; f++) {
+                const fft_type_t type = t == 0 ? FFT_REAL : FFT_COMPLEX;
+                const fft_format_t format = f == 0 ? FFT_Q15 : FFT_Q31;
+                result_t *r = &results[count];
+                if (measure(n, type, format, r) != 0) {
+                    fprintf(stderr, "no memory for size %u\n", n);
+                    return 1;
+                }
+                count++;
+                int bad = 0;
+                for (int kind = 0; kind < SIGNAL_COUNT && n <= 4096; kind++) {
+                    const double floor_db = min_snr(n, format, kind);
+                    bad |= r->snr_db[kind] < floor_db || r->roundtrip_snr_db[kind] < floor_db;
+                }
+                failed |= bad;
+                fprintf(stderr, "%-7s %3s %6u  snr", type == FFT_REAL ? "real" : "complex",
+                        format == FFT_Q15 ? "q15" : "q31", n);
+                for (int kind = 0; kind < SIGNAL_COUNT; kind++) {
+                    fprintf(stderr, " %s %5.1f/%5.1f", signal_names[kind], r->snr_db[kind], r->roundtrip_snr_db[kind]);
+                }
+                fprintf(stderr, " dB  float %9.1f ns  fixed %9.1f ns  x%.2f%s\n", r->float_ns, r->fixed_ns,
+                        r->float_ns / r->fixed_ns, bad ? "  WRONG" : "");
+            }
+        }
+    }
+
+    FILE *out = options.output != NULL ? fopen(options.output, "w") : stdout;
+    if (out == NULL) {
+        fprintf(stderr, "cannot write %s\n", options.output);
+        return 1;
+    }
+    write_json(out, results, count);
+    if (out != stdout) {
+        fclose(out);
+    }
+    return failed;
+}
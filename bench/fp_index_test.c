@@ -0,0 +1,293 @@
+/*
+ * Host test and benchmark of components/fingerprint/fp_index.c. Builds
+ * a 10000-fingerprint collection the way the device grows one: a single
+ * list as fp_store.c formats it, then rebuilt into inverted lists with
+ * fp_index_train_lists() and fp_index_layout() as fp_store_add() does.
+ * Search over both must find the same nearest neighbours, the lists at
+ * a fraction of the flash read per query, and neither may allocate.
+ * Also checks torn records, bucket fills and image validation.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fp_index.h"
+
+#include "host_test.h"
+#include "measure.h"
+
+#define DIM 105                 // main/gas_array.c's GAS_FEATURE_DIM
+#define DIM_PAD 108
+#define LABELS 32
+#define RECORDS 10000
+#define QUERIES 1000
+#define K 5
+#define NPROBE 8                // main/identify.h's IDENTIFY_NPROBE
+// Spread of a label's fingerprints against the spread of the labels
+#define NOISE 1.2f
+#define IMAGE_SIZE (2 * 1024 * 1024)    // FP_STORE_MAP_SIZE
+#define BUCKETS_OFFSET (FP_INDEX_HEADER_SIZE + FP_INDEX_LABEL_LOG_SIZE)
+
+static int8_t vectors[RECORDS][DIM_PAD];
+static uint16_t labels[RECORDS];
+static int8_t queries[QUERIES][DIM_PAD];
+static float mean[DIM], inv_std[DIM];
+
+static uint32_t rng_state = 99;
+
+static double uniform(void) {
+    rng_state = rng_state * 1664525u + 1013904223u;
+    return (rng_state >> 8) / 16777216.0;
+}
+
+static double gaussian(void) {
+    double u = uniform() + 1e-12, v = uniform();
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+// Standardised fingerprints around a centre per label, quantised the
+// way fp_index_quantize() does
+static void make_vector(const float *centre, int8_t *q) {
+    for (int i = 0; i < DIM; i++) {
+        float z = (centre[i] + NOISE * (float)gaussian()) * FP_INDEX_QUANT_SCALE;
+        z = z > 127.0f ? 127.0f : z < -127.0f ? -127.0f : z;
+        q[i] = (int8_t)lrintf(z);
+    }
+    memset(q + DIM, 0, DIM_PAD - DIM);
+}
+
+static void make_data(void) {
+    static float centres[LABELS][DIM];
+    for (int l = 0; l < LABELS; l++) {
+        for (int i = 0; i < DIM; i++) {
+            centres[l][i] = (float)gaussian();
+        }
+    }
+    for (int n = 0; n < RECORDS; n++) {
+        labels[n] = (uint16_t)(uniform() * LABELS);
+        make_vector(centres[labels[n]], vectors[n]);
+    }
+    for (int q = 0; q < QUERIES; q++) {
+        make_vector(centres[(int)(uniform() * LABELS)], queries[q]);
+    }
+    for (int i = 0; i < DIM; i++) {
+        mean[i] = 0.0f;
+        inv_std[i] = 1.0f;
+    }
+}
+
+/*
+    An image of `count` records in `list_count` lists, laid out and
+    filled in the order fp_store.c writes one: records, label log, then
+    the header section.
+*/
+static uint8_t *build_image(uint16_t list_count, const int8_t *centroids, uint32_t count, fp_index_t *index) {
+    uint8_t *image = aligned_alloc(4, IMAGE_SIZE);
+    static uint16_t assign[RECORDS];
+    uint32_t members[FP_INDEX_MAX_LISTS + 1] = { 0 };
+    for (uint32_t n = 0; n < count; n++) {
+        assign[n] = fp_index_nearest_centroid(centroids, list_count, DIM_PAD, vectors[n]);
+        members[assign[n]]++;
+    }
+    fp_header_t header;
+    uint32_t bucket_start[FP_INDEX_MAX_LISTS + 2];
+    CHECK_EQ(fp_index_layout(&header, bucket_start, DIM, list_count, members, IMAGE_SIZE), 0);
+
+    memset(image, 0xFF, IMAGE_SIZE);
+    uint32_t cursor[FP_INDEX_MAX_LISTS + 1] = { 0 };
+    for (uint32_t n = 0; n < count; n++) {
+        uint8_t *record = image + BUCKETS_OFFSET + (size_t)(bucket_start[assign[n]] + cursor[assign[n]]++) * header.record_size;
+        fp_record_t head = { .label = labels[n], .commit = 0 };
+        memcpy(record, &head, sizeof(head));
+        memcpy(record + sizeof(head), vectors[n], DIM_PAD);
+    }
+    fp_label_record_t *log = (fp_label_record_t *)(image + FP_INDEX_HEADER_SIZE);
+    for (uint16_t l = 0; l < LABELS; l++) {
+        log[l] = (fp_label_record_t){ .id = l, .commit = 0 };
+        snprintf(log[l].name, FP_INDEX_LABEL_LEN, "smell_%u", l);
+    }
+    size_t section = fp_index_pack_header(image, &header, mean, inv_std, bucket_start, centroids);
+    CHECK(section <= FP_INDEX_HEADER_SIZE);
+    CHECK_EQ(fp_index_open(index, image, IMAGE_SIZE), 0);
+    return image;
+}
+
+// Records a search reads: the probed lists and the overflow bucket
+static uint32_t scanned(const fp_index_t *index, const int8_t *q, uint16_t nprobe) {
+    const uint16_t lists = index->header->list_count;
+    if (nprobe >= lists) {
+        uint32_t all = 0;
+        for (uint16_t b = 0; b <= lists; b++) {
+            all += index->fill[b];
+        }
+        return all;
+    }
+    uint32_t dist[FP_INDEX_MAX_LISTS];
+    bool taken[FP_INDEX_MAX_LISTS] = { false };
+    for (uint16_t l = 0; l < lists; l++) {
+        dist[l] = 0;
+        for (int i = 0; i < DIM_PAD; i++) {
+            int d = q[i] - index->centroids[(size_t)l * DIM_PAD + i];
+            dist[l] += d * d;
+        }
+    }
+    uint32_t records = index->fill[lists];
+    for (uint16_t p = 0; p < nprobe; p++) {
+        int best = -1;
+        for (uint16_t l = 0; l < lists; l++) {
+            if (!taken[l] && (best < 0 || dist[l] < dist[best])) {
+                best = l;
+            }
+        }
+        taken[best] = true;
+        records += index->fill[best];
+    }
+    return records;
+}
+
+typedef struct {
+    double p50_us;
+    double p99_us;
+    double records;         // scanned per query, on average
+} search_cost_t;
+
+static search_cost_t run_queries(const fp_index_t *index, uint16_t nprobe, fp_match_t (*results)[K]) {
+    static uint32_t ns[QUERIES];
+    search_cost_t cost = { 0 };
+    alloc_count_reset();
+    for (int q = 0; q < QUERIES; q++) {
+        uint64_t start = measure_now_ns();
+        int found = fp_index_search(index, queries[q], nprobe, results[q], K);
+        ns[q] = (uint32_t)(measure_now_ns() - start);
+        CHECK_EQ(found, K);
+    }
+    CHECK_EQ(alloc_count_read().calls, 0);
+    for (int q = 0; q < QUERIES; q++) {
+        cost.records += scanned(index, queries[q], nprobe);
+    }
+    cost.records /= QUERIES;
+    cost.p50_us = measure_percentile(ns, QUERIES, 50) / 1e3;
+    cost.p99_us = measure_percentile(ns, QUERIES, 99) / 1e3;
+    return cost;
+}
+
+// Share of the results within the exact k-th nearest distance; equal
+// distances may come back in either order, so records are not compared
+static double recall(fp_match_t (*exact)[K], fp_match_t (*found)[K]) {
+    uint32_t hits = 0;
+    for (int q = 0; q < QUERIES; q++) {
+        for (int i = 0; i < K; i++) {
+            hits += found[q][i].distance <= exact[q][K - 1].distance;
+        }
+    }
+    return (double)hits / (QUERIES * K);
+}
+
+static void test_single_list_and_rebuild(void) {
+    static fp_match_t exact[QUERIES][K], probed[QUERIES][K], all[QUERIES][K];
+    const int8_t origin[DIM_PAD] = { 0 };
+    fp_index_t flat, ivf;
+    uint8_t *flat_image = build_image(1, origin, RECORDS, &flat);
+    CHECK_EQ(flat.header->list_count, 1);
+    CHECK_EQ(fp_index_committed(&flat), RECORDS);
+    search_cost_t flat_cost = run_queries(&flat, 1, exact);
+
+    // What fp_store_add() does once the collection outgrows one list
+    const uint16_t lists = fp_index_list_count_for(RECORDS);
+    CHECK_EQ(lists, 64);
+    static int32_t scratch[FP_INDEX_TRAIN_SCRATCH(FP_INDEX_MAX_LISTS, DIM_PAD)];
+    static int8_t centroids[FP_INDEX_MAX_LISTS * DIM_PAD];
+    alloc_count_reset();
+    uint64_t start = measure_now_ns();
+    CHECK_EQ(fp_index_train_lists(&flat, lists, centroids, scratch), 0);
+    double train_ms = (measure_now_ns() - start) / 1e6;
+    CHECK_EQ(alloc_count_read().calls, 0);
+    uint8_t *ivf_image = build_image(lists, centroids, RECORDS, &ivf);
+    CHECK_EQ(fp_index_committed(&ivf), RECORDS);
+
+    search_cost_t ivf_cost = run_queries(&ivf, NPROBE, probed);
+    search_cost_t all_cost = run_queries(&ivf, lists, all);
+    double probed_recall = recall(exact, probed), all_recall = recall(exact, all);
+    // Scanning every list is an exact search
+    CHECK_EQ(all_recall, 1.0);
+    CHECK(probed_recall >= 0.95);
+    CHECK(ivf_cost.records * 4 < flat_cost.records);
+
+    const int record_size = sizeof(fp_record_t) + DIM_PAD;
+    fprintf(stderr, "%d fingerprints of %d features, top %d:\n", RECORDS, DIM, K);
+    fprintf(stderr, "  1 list:           p50 %6.1f us, p99 %6.1f us, %5.0f records (%4.0f KB of flash) a query\n",
+            flat_cost.p50_us, flat_cost.p99_us, flat_cost.records, flat_cost.records * record_size / 1024);
+    fprintf(stderr, "  %d lists, nprobe %d: p50 %6.1f us, p99 %6.1f us, %5.0f records (%4.0f KB of flash) a query, recall %.3f\n",
+            lists, NPROBE, ivf_cost.p50_us, ivf_cost.p99_us, ivf_cost.records, ivf_cost.records * record_size / 1024,
+            probed_recall);
+    fprintf(stderr, "  %d lists, all:      p50 %6.1f us, recall %.3f; k-means over %d samples %.1f ms\n",
+            lists, all_cost.p50_us, all_recall, FP_INDEX_TRAIN_SAMPLES, train_ms);
+    free(flat_image);
+    free(ivf_image);
+}
+
+static void test_torn_and_fill(void) {
+    const int8_t origin[DIM_PAD] = { 0 };
+    fp_index_t index;
+    uint8_t *image = build_image(1, origin, 100, &index);
+    CHECK_EQ(index.fill[0], 100);
+    CHECK_EQ(index.fill[1], 0);
+
+    // A record whose commit word was never cleared is skipped, and its
+    // slot still counts as used
+    fp_record_t *torn = (fp_record_t *)fp_index_record(&index, 0, 10);
+    torn->commit = 0xFFFF;
+    CHECK_EQ(fp_index_open(&index, image, IMAGE_SIZE), 0);
+    CHECK_EQ(index.fill[0], 100);
+    CHECK_EQ(fp_index_committed(&index), 99);
+    fp_match_t match[1];
+    CHECK_EQ(fp_index_search(&index, vectors[10], 1, match, 1), 1);
+    CHECK(match[0].distance > 0);
+    CHECK_EQ(fp_index_search(&index, vectors[11], 1, match, 1), 1);
+    CHECK_EQ(match[0].distance, 0);
+
+    // Damaged images are refused
+    fp_header_t *header = (fp_header_t *)image;
+    header->magic ^= 1;
+    CHECK_EQ(fp_index_open(&index, image, IMAGE_SIZE), -1);
+    header->magic ^= 1;
+    CHECK_EQ(fp_index_open(&index, image, IMAGE_SIZE / 2), -1);
+    uint32_t *bucket_start = (uint32_t *)(image + sizeof(fp_header_t) + 2 * DIM * sizeof(float));
+    bucket_start[1] = header->record_count + 1;
+    CHECK_EQ(fp_index_open(&index, image, IMAGE_SIZE), -1);
+    free(image);
+}
+
+static void test_layout(void) {
+    fp_header_t header;
+    uint32_t bucket_start[FP_INDEX_MAX_LISTS + 2];
+    uint32_t members[4] = { 10, 0, 30, 0 };
+    CHECK_EQ(fp_index_layout(&header, bucket_start, DIM, 3, members, IMAGE_SIZE), 0);
+    const uint32_t spare = (header.record_count - 40) / 4;
+    CHECK_EQ(bucket_start[1], 10 + spare);
+    CHECK_EQ(bucket_start[2], 10 + 2 * spare);
+    CHECK_EQ(bucket_start[4], header.record_count);
+    CHECK(bucket_start[4] - bucket_start[3] >= spare);
+    CHECK_EQ(header.generation, 0);
+    CHECK_EQ(header.image_size, fp_index_image_size(DIM, 3, header.record_count));
+
+    members[0] = header.record_count;
+    CHECK_EQ(fp_index_layout(&header, bucket_start, DIM, 3, members, IMAGE_SIZE), -1);
+    CHECK_EQ(fp_index_layout(&header, bucket_start, DIM, FP_INDEX_MAX_LISTS + 1, members, IMAGE_SIZE), -1);
+    CHECK_EQ(fp_index_layout(&header, bucket_start, DIM, 1, members, BUCKETS_OFFSET), -1);
+
+    CHECK_EQ(fp_index_list_count_for(999), 1);
+    CHECK_EQ(fp_index_list_count_for(1000), 32);
+    CHECK_EQ(fp_index_list_count_for(4096), 64);
+    CHECK_EQ(fp_index_list_count_for(100000), FP_INDEX_MAX_LISTS);
+}
+
+int main(void) {
+    make_data();
+    test_single_list_and_rebuild();
+    test_torn_and_fill();
+    test_layout();
+    return host_test_result("fp_index_test");
+}
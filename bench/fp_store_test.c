@@ -0,0 +1,288 @@
+/*
+ * Host test of components/fingerprint/fp_store.c on a flash model
+ * (host/flash_model.c) the size of the device's spiffs partition. A
+ * collection is grown past the point where fp_store_add() rebuilds it
+ * into inverted lists in the second slot, and must keep every
+ * fingerprint, find them, and open again the same. Then the power is
+ * cut at each flash operation of a rebuild, and of the add that started
+ * it, in turn: every reopen must find one complete image holding all
+ * the committed fingerprints, and be able to go on growing. Also checks
+ * that a SPIFFS file system in the partition is left alone.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_spiffs.h"
+
+#include "fp_store.h"
+
+#include "flash_model.h"
+#include "host_test.h"
+#include "measure.h"
+
+#define PARTITION "spiffs"
+#define PARTITION_SIZE 0x4C4C00     // partitions_16MB.csv
+#define DIM 105                     // main/gas_array.c's GAS_FEATURE_DIM
+#define LABELS 16
+#define NOISE 0.4f
+#define FIRST_REBUILD 1000          // where fp_index_list_count_for() leaves 1 list
+#define GROW 1500
+#define NPROBE 8                    // main/identify.h's IDENTIFY_NPROBE
+// Raw units, as the features come from the gas array
+#define MEAN 300.0f
+#define STD 40.0f
+
+static float centres[LABELS][DIM];
+static float mean[DIM], inv_std[DIM];
+static char names[LABELS][FP_INDEX_LABEL_LEN];
+static uint32_t added[LABELS];
+
+static uint32_t rng_state = 4242;
+
+static double uniform(void) {
+    rng_state = rng_state * 1664525u + 1013904223u;
+    return (rng_state >> 8) / 16777216.0;
+}
+
+static double gaussian(void) {
+    double u = uniform() + 1e-12, v = uniform();
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+static void make_data(void) {
+    for (int l = 0; l < LABELS; l++) {
+        for (int i = 0; i < DIM; i++) {
+            centres[l][i] = MEAN + STD * (float)gaussian();
+        }
+        snprintf(names[l], sizeof(names[l]), "smell_%d", l);
+    }
+    for (int i = 0; i < DIM; i++) {
+        mean[i] = MEAN;
+        inv_std[i] = 1.0f / STD;
+    }
+}
+
+static void make_features(int label, float *features) {
+    for (int i = 0; i < DIM; i++) {
+        features[i] = centres[label][i] + NOISE * STD * (float)gaussian();
+    }
+}
+
+// What a reset does to an open store: the mapping, the mutexes and the
+// sums go, and nothing is written
+static void drop(fp_store_t *store) {
+    if (store->index.header != NULL) {
+        spi_flash_munmap(store->handle);
+    }
+    vSemaphoreDelete(store->lock);
+    vSemaphoreDelete(store->writer);
+    free(store->sums);
+    memset(store, 0, sizeof(fp_store_t));
+}
+
+static uint32_t label_total(fp_store_t *store) {
+    uint32_t total = 0;
+    for (int l = 0; l < LABELS; l++) {
+        total += fp_store_label_count(store, names[l]);
+    }
+    return total;
+}
+
+// Each label's centre must find that label first
+static int centres_found(fp_store_t *store) {
+    int found = 0;
+    for (int l = 0; l < LABELS; l++) {
+        fp_store_match_t match;
+        found += fp_store_search(store, centres[l], NPROBE, &match, 1) == 1 && strcmp(match.label, names[l]) == 0;
+    }
+    return found;
+}
+
+static void count_one(const char *label, const float *features, void *arg) {
+    (*(uint32_t *)arg)++;
+}
+
+static void test_spiffs_left_alone(void) {
+    const esp_partition_t *partition = flash_model_add(PARTITION, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, PARTITION_SIZE);
+    uint8_t *data = flash_model_data(partition);
+    memset(data, 0x5A, 3 * FLASH_MODEL_SECTOR_SIZE);
+    fp_store_t store;
+
+    // Files in the partition: nothing is erased
+    flash_model_set_spiffs(partition, true);
+    CHECK_EQ(fp_store_open(&store, PARTITION, DIM, mean, inv_std), ESP_ERR_INVALID_STATE);
+    CHECK_EQ(data[0], 0x5A);
+    CHECK_EQ(data[3 * FLASH_MODEL_SECTOR_SIZE - 1], 0x5A);
+    CHECK_EQ(flash_model_stats().erased_sectors, 0);
+    CHECK_EQ(flash_model_stats().live_maps, 0);
+    CHECK(!esp_spiffs_mounted(PARTITION));
+
+    // Nothing that mounts: the old data is erased for a new collection
+    flash_model_set_spiffs(partition, false);
+    CHECK_EQ(fp_store_open(&store, PARTITION, DIM, mean, inv_std), ESP_OK);
+    CHECK_EQ(flash_model_stats().erased_sectors, 3);
+    CHECK_EQ(store.index.header->list_count, 1);
+    CHECK_EQ(store.total, 0);
+    // Opening only an existing one needs none of the standardisation
+    drop(&store);
+    CHECK_EQ(fp_store_open(&store, PARTITION, DIM, NULL, NULL), ESP_OK);
+    drop(&store);
+    CHECK_EQ(fp_store_open(&store, PARTITION, DIM + 1, NULL, NULL), ESP_ERR_INVALID_SIZE);
+    CHECK_EQ(flash_model_stats().overwrites, 0);
+    flash_model_clear();
+}
+
+static void test_grow(void) {
+    static uint32_t ns[GROW];
+    const esp_partition_t *partition = flash_model_add(PARTITION, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, PARTITION_SIZE);
+    fp_store_t store;
+    float features[DIM];
+    memset(added, 0, sizeof(added));
+    CHECK_EQ(fp_store_open(&store, PARTITION, DIM, mean, inv_std), ESP_OK);
+    CHECK(store.can_rebuild);
+
+    for (int n = 0; n < GROW; n++) {
+        const int label = (int)(uniform() * LABELS);
+        make_features(label, features);
+        uint64_t start = measure_now_ns();
+        esp_err_t err = fp_store_add(&store, names[label], features);
+        ns[n] = (uint32_t)(measure_now_ns() - start);
+        CHECK_EQ(err, ESP_OK);
+        added[label] += err == ESP_OK;
+        if (n == FIRST_REBUILD - 2) {
+            CHECK_EQ(store.index.header->list_count, 1);
+            CHECK_EQ(store.slot_offset, 0);
+        }
+    }
+    const uint32_t rebuild_ns = ns[FIRST_REBUILD - 1];
+    CHECK_EQ(store.index.header->list_count, fp_index_list_count_for(FIRST_REBUILD));
+    CHECK_EQ(store.index.header->generation, 1);
+    CHECK_EQ(store.slot_offset, FP_STORE_SECOND_SLOT);
+    CHECK_EQ(store.total, GROW);
+    CHECK_EQ(label_total(&store), GROW);
+    CHECK_EQ(centres_found(&store), LABELS);
+    uint32_t each = 0;
+    fp_store_for_each(&store, count_one, &each);
+    CHECK_EQ(each, GROW);
+
+    // A label's centroid comes back in raw units, within its noise
+    float centroid[DIM];
+    CHECK(fp_store_label_centroid(&store, names[0], centroid));
+    double worst = 0.0;
+    for (int i = 0; i < DIM; i++) {
+        worst = fmax(worst, fabs(centroid[i] - centres[0][i]) / STD);
+    }
+    CHECK(worst < 5.0 * NOISE / sqrt(added[0]) + 1.0 / FP_INDEX_QUANT_SCALE);
+
+    // The old image's header is gone, so only the new one opens
+    CHECK_EQ(flash_model_data(partition)[0], 0xFF);
+    CHECK_EQ(flash_model_stats().overwrites, 0);
+    CHECK_EQ(flash_model_stats().live_maps, 1);
+    drop(&store);
+    CHECK_EQ(fp_store_open(&store, PARTITION, DIM, NULL, NULL), ESP_OK);
+    CHECK_EQ(store.slot_offset, FP_STORE_SECOND_SLOT);
+    CHECK_EQ(store.total, GROW);
+    for (int l = 0; l < LABELS; l++) {
+        CHECK_EQ(fp_store_label_count(&store, names[l]), added[l]);
+    }
+    CHECK_EQ(centres_found(&store), LABELS);
+
+    double p50 = measure_percentile(ns, GROW, 50);
+    fprintf(stderr, "%d adds: p50 %.1f us; the one that rebuilt %u fingerprints into %u lists %.1f ms\n",
+            GROW, p50 / 1e3, FIRST_REBUILD - 1, store.index.header->list_count, rebuild_ns / 1e6);
+    drop(&store);
+    flash_model_clear();
+}
+
+/*
+    A collection one fingerprint short of its first rebuild, with the
+    second slot dirty the way an earlier cut rebuild leaves it, so the
+    rebuild has sectors to erase as well as records to copy.
+*/
+static const esp_partition_t *make_full_single_list(void) {
+    const esp_partition_t *partition = flash_model_add(PARTITION, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, PARTITION_SIZE);
+    fp_store_t store;
+    float features[DIM];
+    memset(added, 0, sizeof(added));
+    CHECK_EQ(fp_store_open(&store, PARTITION, DIM, mean, inv_std), ESP_OK);
+    for (int n = 0; n < FIRST_REBUILD - 1; n++) {
+        const int label = n % LABELS;
+        make_features(label, features);
+        CHECK_EQ(fp_store_add(&store, names[label], features), ESP_OK);
+        added[label]++;
+    }
+    CHECK_EQ(store.index.header->list_count, 1);
+    drop(&store);
+    uint8_t *data = flash_model_data(partition);
+    memset(data + FP_STORE_SECOND_SLOT + FP_INDEX_HEADER_SIZE, 0x00, 8 * FLASH_MODEL_SECTOR_SIZE);
+    memset(data + FP_STORE_SECOND_SLOT + 64 * FLASH_MODEL_SECTOR_SIZE, 0x00, 4 * FLASH_MODEL_SECTOR_SIZE);
+    return partition;
+}
+
+static void test_power_cut(void) {
+    const esp_partition_t *partition = make_full_single_list();
+    uint8_t *data = flash_model_data(partition);
+    uint8_t *before = malloc(PARTITION_SIZE);
+    memcpy(before, data, PARTITION_SIZE);
+    float features[DIM];
+    make_features(3, features);
+
+    int cuts = 0, old_image = 0, new_image = 0;
+    for (int32_t ops = 0;; ops++) {
+        memcpy(data, before, PARTITION_SIZE);
+        fp_store_t store;
+        CHECK_EQ(fp_store_open(&store, PARTITION, DIM, NULL, NULL), ESP_OK);
+        CHECK_EQ(store.total, FIRST_REBUILD - 1);
+        flash_model_cut_after(ops);
+        esp_err_t err = fp_store_add(&store, names[3], features);
+        drop(&store);
+        if (!flash_model_cut()) {
+            // Every operation of the rebuild and the append has been cut
+            CHECK_EQ(err, ESP_OK);
+            break;
+        }
+        cuts++;
+        flash_model_cut_after(-1);
+
+        // After the reset: one whole image, the new one if its header
+        // made it, with the 999. The last operation is the one that
+        // commits the new fingerprint, so no cut leaves it counted.
+        CHECK_EQ(fp_store_open(&store, PARTITION, DIM, NULL, NULL), ESP_OK);
+        CHECK_EQ(store.total, FIRST_REBUILD - 1);
+        CHECK_EQ(label_total(&store), FIRST_REBUILD - 1);
+        CHECK_EQ(fp_store_label_count(&store, names[3]), added[3]);
+        CHECK_EQ(centres_found(&store), LABELS);
+        if (store.slot_offset == 0) {
+            CHECK_EQ(store.index.header->list_count, 1);
+            old_image++;
+        } else {
+            CHECK_EQ(store.index.header->list_count, fp_index_list_count_for(FIRST_REBUILD));
+            new_image++;
+        }
+
+        // And it goes on: the next add rebuilds over whatever was left
+        CHECK_EQ(fp_store_add(&store, names[5], features), ESP_OK);
+        CHECK_EQ(store.slot_offset, FP_STORE_SECOND_SLOT);
+        CHECK_EQ(store.total, FIRST_REBUILD);
+        drop(&store);
+    }
+    CHECK(cuts > 20 && old_image > 0 && new_image > 0);
+    CHECK_EQ(flash_model_stats().live_maps, 0);
+    fprintf(stderr, "power cut at each of %d flash operations of a rebuild and add: %d reopened the old image, %d the new one\n",
+            cuts, old_image, new_image);
+    free(before);
+    flash_model_clear();
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+    make_data();
+    test_spiffs_left_alone();
+    test_grow();
+    test_power_cut();
+    return host_test_result("fp_store_test");
+}
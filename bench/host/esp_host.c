@@ -0,0 +1,170 @@
+/*
+ * Host versions of the small ESP-IDF services the components call:
+ * logging to stderr, error names, and NVS kept in memory.
+ */
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+#define NVS_MAX_ENTRIES 32
+#define NVS_MAX_VALUE 64
+#define NVS_MAX_NAMESPACES 8
+
+typedef struct {
+    char name[16];
+    char key[16];
+    uint8_t value[NVS_MAX_VALUE];
+    size_t length;
+    bool used;
+} nvs_entry_t;
+
+static esp_log_level_t log_level = ESP_LOG_WARN;
+static nvs_entry_t nvs_entries[NVS_MAX_ENTRIES];
+static char nvs_namespaces[NVS_MAX_NAMESPACES][16];
+
+const char *esp_err_to_name(esp_err_t code) {
+    switch (code) {
+    case ESP_OK: return "ESP_OK";
+    case ESP_FAIL: return "ESP_FAIL";
+    case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_RESPONSE: return "ESP_ERR_INVALID_RESPONSE";
+    case ESP_ERR_INVALID_CRC: return "ESP_ERR_INVALID_CRC";
+    case ESP_ERR_INVALID_VERSION: return "ESP_ERR_INVALID_VERSION";
+    case ESP_ERR_NVS_NOT_FOUND: return "ESP_ERR_NVS_NOT_FOUND";
+    default: return "UNKNOWN ERROR";
+    }
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level) {
+    log_level = level;
+}
+
+void host_log(esp_log_level_t level, const char *tag, const char *format, ...) {
+    static const char letters[] = "NEWIDV";
+    if (level > log_level) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "%c (%lld) %s: ", letters[level], (long long)(esp_timer_get_time() / 1000), tag);
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+    va_end(args);
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle) {
+    for (nvs_handle_t i = 0; i < NVS_MAX_NAMESPACES; i++) {
+        if (strcmp(nvs_namespaces[i], name) == 0) {
+            *out_handle = i + 1;
+            return ESP_OK;
+        }
+    }
+    // As on the device, a namespace only comes into being when opened for writing
+    if (open_mode == NVS_READONLY) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    for (nvs_handle_t i = 0; i < NVS_MAX_NAMESPACES; i++) {
+        if (nvs_namespaces[i][0] == '\0') {
+            strncpy(nvs_namespaces[i], name, sizeof(nvs_namespaces[i]) - 1);
+            *out_handle = i + 1;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+void nvs_close(nvs_handle_t handle) {
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    return handle >= 1 && handle <= NVS_MAX_NAMESPACES ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+static nvs_entry_t *nvs_find(nvs_handle_t handle, const char *key, bool create) {
+    if (handle < 1 || handle > NVS_MAX_NAMESPACES) {
+        return NULL;
+    }
+    const char *name = nvs_namespaces[handle - 1];
+    nvs_entry_t *free_entry = NULL;
+    for (int i = 0; i < NVS_MAX_ENTRIES; i++) {
+        nvs_entry_t *entry = &nvs_entries[i];
+        if (!entry->used) {
+            free_entry = free_entry != NULL ? free_entry : entry;
+        } else if (strcmp(entry->name, name) == 0 && strcmp(entry->key, key) == 0) {
+            return entry;
+        }
+    }
+    if (!create || free_entry == NULL) {
+        return NULL;
+    }
+    memset(free_entry, 0, sizeof(nvs_entry_t));
+    strncpy(free_entry->name, name, sizeof(free_entry->name) - 1);
+    strncpy(free_entry->key, key, sizeof(free_entry->key) - 1);
+    free_entry->used = true;
+    return free_entry;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+    if (length > NVS_MAX_VALUE) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    nvs_entry_t *entry = nvs_find(handle, key, true);
+    if (entry == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(entry->value, value, length);
+    entry->length = length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length) {
+    nvs_entry_t *entry = nvs_find(handle, key, false);
+    if (entry == NULL) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (out_value == NULL) {
+        *length = entry->length;
+        return ESP_OK;
+    }
+    if (*length < entry->length) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(out_value, entry->value, entry->length);
+    *length = entry->length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value) {
+    return nvs_set_blob(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out_value) {
+    size_t length = sizeof(uint32_t);
+    return nvs_get_blob(handle, key, out_value, &length);
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    nvs_entry_t *entry = nvs_find(handle, key, false);
+    if (entry == NULL) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    entry->used = false;
+    return ESP_OK;
+}
+
+void host_nvs_clear(void) {
+    memset(nvs_entries, 0, sizeof(nvs_entries));
+    memset(nvs_namespaces, 0, sizeof(nvs_namespaces));
+}
@@ -0,0 +1,248 @@
+/*
+ * Data partitions in RAM behind the host esp_partition, spi_flash and
+ * SPIFFS calls, see flash_model.h.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_spiffs.h"
+
+#include "flash_model.h"
+
+#define MAX_PARTITIONS 4
+#define MAX_MAPS 8
+
+typedef struct {
+    esp_partition_t partition;
+    uint8_t *data;
+    bool spiffs;
+    bool mounted;
+} model_partition_t;
+
+static model_partition_t partitions[MAX_PARTITIONS];
+static int partition_count;
+static bool maps[MAX_MAPS];
+static flash_model_stats_t stats;
+// Writes and erases until the power goes, negative for never
+static int32_t ops_left = -1;
+static bool cut;
+
+static model_partition_t *find(const esp_partition_t *partition) {
+    for (int i = 0; i < partition_count; i++) {
+        if (&partitions[i].partition == partition) {
+            return &partitions[i];
+        }
+    }
+    return NULL;
+}
+
+static model_partition_t *find_label(const char *label) {
+    for (int i = 0; i < partition_count; i++) {
+        if (label != NULL && strcmp(partitions[i].partition.label, label) == 0) {
+            return &partitions[i];
+        }
+    }
+    return NULL;
+}
+
+static bool in_range(const esp_partition_t *partition, size_t offset, size_t size) {
+    return offset <= partition->size && size <= partition->size - offset;
+}
+
+// Counts an operation against the power cut. Returns how much of it
+// happens: all, half, or none.
+static size_t powered(size_t size) {
+    if (cut) {
+        return 0;
+    }
+    if (ops_left > 0) {
+        ops_left--;
+    } else if (ops_left == 0) {
+        cut = true;
+        return size / 2;
+    }
+    return size;
+}
+
+const esp_partition_t *flash_model_add(const char *label, esp_partition_subtype_t subtype, uint32_t size) {
+    if (partition_count == MAX_PARTITIONS) {
+        return NULL;
+    }
+    model_partition_t *p = &partitions[partition_count];
+    size = (size + FLASH_MODEL_SECTOR_SIZE - 1) & ~(uint32_t)(FLASH_MODEL_SECTOR_SIZE - 1);
+    p->data = (uint8_t *)malloc(size);
+    if (p->data == NULL) {
+        return NULL;
+    }
+    memset(p->data, 0xFF, size);
+    memset(&p->partition, 0, sizeof(esp_partition_t));
+    p->partition.type = ESP_PARTITION_TYPE_DATA;
+    p->partition.subtype = subtype;
+    p->partition.address = partition_count == 0 ? 0x10000 : partitions[partition_count - 1].partition.address
+        + partitions[partition_count - 1].partition.size;
+    p->partition.size = size;
+    strncpy(p->partition.label, label, sizeof(p->partition.label) - 1);
+    p->spiffs = false;
+    p->mounted = false;
+    partition_count++;
+    return &p->partition;
+}
+
+uint8_t *flash_model_data(const esp_partition_t *partition) {
+    model_partition_t *p = find(partition);
+    return p != NULL ? p->data : NULL;
+}
+
+void flash_model_set_spiffs(const esp_partition_t *partition, bool holds) {
+    model_partition_t *p = find(partition);
+    if (p != NULL) {
+        p->spiffs = holds;
+    }
+}
+
+void flash_model_cut_after(int32_t ops) {
+    ops_left = ops;
+    cut = false;
+}
+
+bool flash_model_cut(void) {
+    return cut;
+}
+
+flash_model_stats_t flash_model_stats(void) {
+    return stats;
+}
+
+void flash_model_reset_stats(void) {
+    int32_t live = stats.live_maps;
+    memset(&stats, 0, sizeof(stats));
+    stats.live_maps = live;
+}
+
+void flash_model_clear(void) {
+    for (int i = 0; i < partition_count; i++) {
+        free(partitions[i].data);
+    }
+    memset(partitions, 0, sizeof(partitions));
+    memset(maps, 0, sizeof(maps));
+    memset(&stats, 0, sizeof(stats));
+    partition_count = 0;
+    flash_model_cut_after(-1);
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label) {
+    for (int i = 0; i < partition_count; i++) {
+        const esp_partition_t *partition = &partitions[i].partition;
+        if (partition->type == type && (subtype == ESP_PARTITION_SUBTYPE_ANY || partition->subtype == subtype) &&
+            (label == NULL || strcmp(partition->label, label) == 0)) {
+            return partition;
+        }
+    }
+    return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size) {
+    model_partition_t *p = find(partition);
+    if (p == NULL || dst == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!in_range(partition, src_offset, size)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(dst, p->data + src_offset, size);
+    stats.bytes_read += size;
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size) {
+    model_partition_t *p = find(partition);
+    if (p == NULL || src == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!in_range(partition, dst_offset, size)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    const size_t done = powered(size);
+    const uint8_t *from = (const uint8_t *)src;
+    bool overwrite = false;
+    for (size_t i = 0; i < done; i++) {
+        overwrite |= (p->data[dst_offset + i] & from[i]) != from[i];
+        p->data[dst_offset + i] &= from[i];
+    }
+    stats.overwrites += overwrite;
+    stats.writes++;
+    stats.bytes_written += done;
+    return done == size ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size) {
+    model_partition_t *p = find(partition);
+    if (p == NULL || offset % FLASH_MODEL_SECTOR_SIZE != 0 || size % FLASH_MODEL_SECTOR_SIZE != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!in_range(partition, offset, size)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    // A cut erase leaves its first sectors erased and the rest as they were
+    const size_t done = powered(size) & ~(size_t)(FLASH_MODEL_SECTOR_SIZE - 1);
+    memset(p->data + offset, 0xFF, done);
+    stats.erased_sectors += done / FLASH_MODEL_SECTOR_SIZE;
+    return done == size ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t *partition, size_t offset, size_t size,
+                             spi_flash_mmap_memory_t memory, const void **out_ptr, spi_flash_mmap_handle_t *out_handle) {
+    model_partition_t *p = find(partition);
+    if (p == NULL || out_ptr == NULL || out_handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!in_range(partition, offset, size)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    for (int i = 0; i < MAX_MAPS; i++) {
+        if (!maps[i]) {
+            maps[i] = true;
+            stats.live_maps++;
+            *out_ptr = p->data + offset;
+            *out_handle = i + 1;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+void spi_flash_munmap(spi_flash_mmap_handle_t handle) {
+    if (handle >= 1 && handle <= MAX_MAPS && maps[handle - 1]) {
+        maps[handle - 1] = false;
+        stats.live_maps--;
+    }
+}
+
+esp_err_t esp_vfs_spiffs_register(const esp_vfs_spiffs_conf_t *conf) {
+    model_partition_t *p = find_label(conf->partition_label);
+    if (p == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (p->mounted) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!p->spiffs) {
+        return ESP_FAIL;
+    }
+    p->mounted = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_vfs_spiffs_unregister(const char *partition_label) {
+    model_partition_t *p = find_label(partition_label);
+    if (p == NULL || !p->mounted) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    p->mounted = false;
+    return ESP_OK;
+}
+
+bool esp_spiffs_mounted(const char *partition_label) {
+    model_partition_t *p = find_label(partition_label);
+    return p != NULL && p->mounted;
+}
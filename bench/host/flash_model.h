@@ -0,0 +1,67 @@
+/**
+ * @file flash_model.h
+ * @brief Data partitions in RAM behind the host esp_partition API.
+ *
+ * Flash behaves as NOR flash does: erasing sets whole 4 KB sectors to
+ * 0xFF, and writing can only clear bits, so a write over data that is
+ * not erased ANDs into it and is counted. Mappings point straight at
+ * the partition's bytes, so writes show through them, as they do
+ * through the flash cache.
+ *
+ * A power cut can be set for after a number of writes and erases: the
+ * one it falls on is cut short half way, and every later one fails with
+ * ESP_FAIL and changes nothing.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_partition.h"
+
+#define FLASH_MODEL_SECTOR_SIZE 4096
+
+typedef struct {
+    uint32_t writes;
+    uint32_t erased_sectors;
+    uint32_t bytes_written;
+    uint32_t bytes_read;
+    uint32_t overwrites;        // writes that needed a bit set that was clear
+    int32_t live_maps;          // mapped and not yet unmapped
+} flash_model_stats_t;
+
+/**
+ * @brief Adds an erased partition. Its size is rounded up to a sector.
+ */
+const esp_partition_t *flash_model_add(const char *label, esp_partition_subtype_t subtype, uint32_t size);
+
+/**
+ * @brief The partition's bytes, to fill or damage behind its back.
+ */
+uint8_t *flash_model_data(const esp_partition_t *partition);
+
+/**
+ * @brief Makes the partition mount as SPIFFS, as if it held files.
+ */
+void flash_model_set_spiffs(const esp_partition_t *partition, bool holds);
+
+/**
+ * @brief Cuts the power after `ops` more writes and erases, or never
+ * for a negative `ops`, which also brings it back.
+ */
+void flash_model_cut_after(int32_t ops);
+
+/**
+ * @brief Whether a cut set by flash_model_cut_after() has happened.
+ */
+bool flash_model_cut(void);
+
+flash_model_stats_t flash_model_stats(void);
+
+void flash_model_reset_stats(void);
+
+/**
+ * @brief Frees every partition.
+ */
+void flash_model_clear(void);
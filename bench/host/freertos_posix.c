@@ -0,0 +1,668 @@
+/*
+ * FreeRTOS on POSIX threads, enough of it for the firmware's drivers,
+ * scheduler and pipeline to run unchanged in a host test. A task is a
+ * thread, queues and semaphores are a mutex and two condition variables,
+ * and a tick is real time. Delays end on a tick boundary, as vTaskDelay
+ * does on the device, so a delay of one tick lasts anything from zero to
+ * one tick period. A single-task simulation can switch to a simulated
+ * clock instead, where delays return at once and move the clock on.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#include "esp_timer.h"
+
+#define TICK_NS ((int64_t)portTICK_PERIOD_MS * 1000000)
+// Tasks come from a static pool, so the allocation counters of a test
+// see only what the code under test allocates
+#define MAX_TASKS 32
+
+struct host_task {
+    pthread_t thread;
+    TaskFunction_t fn;
+    void *arg;
+    const char *name;
+    UBaseType_t priority;
+    BaseType_t core;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify_value;
+    bool notify_pending;
+};
+
+typedef enum {
+    KIND_QUEUE,
+    KIND_MUTEX,
+    KIND_RECURSIVE_MUTEX,
+    KIND_SEMAPHORE,
+} queue_kind_t;
+
+struct host_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    queue_kind_t kind;
+    uint8_t *items;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    TaskHandle_t owner;
+    UBaseType_t depth;
+    bool is_static;
+};
+
+_Static_assert(sizeof(struct host_queue) <= sizeof(StaticSemaphore_t), "StaticSemaphore_t too small");
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int64_t deadline;           // CLOCK_MONOTONIC ns, -1 when stopped
+    bool deleted;
+};
+
+static struct host_task tasks[MAX_TASKS];
+static int task_count;
+static pthread_mutex_t tasks_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct host_task *current_task;
+static pthread_mutex_t critical_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+static int64_t start_ns;
+// Since start_ns, used instead of CLOCK_MONOTONIC once simulated
+static bool clock_simulated;
+static int64_t simulated_ns;
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+__attribute__((constructor)) static void host_clock_start(void) {
+    start_ns = now_ns();
+}
+
+static int64_t clock_ns(void) {
+    return clock_simulated ? simulated_ns : now_ns() - start_ns;
+}
+
+void host_clock_simulate(void) {
+    simulated_ns = now_ns() - start_ns;
+    clock_simulated = true;
+}
+
+void host_clock_advance_us(int64_t us) {
+    simulated_ns += us * 1000;
+}
+
+int64_t esp_timer_get_time(void) {
+    return clock_ns() / 1000;
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(clock_ns() / TICK_NS);
+}
+
+static struct timespec to_timespec(int64_t ns) {
+    struct timespec ts = { .tv_sec = ns / 1000000000, .tv_nsec = ns % 1000000000 };
+    return ts;
+}
+
+// Absolute CLOCK_MONOTONIC time after `ticks`, or -1 for portMAX_DELAY
+static int64_t deadline_after(TickType_t ticks) {
+    if (ticks == portMAX_DELAY) {
+        return -1;
+    }
+    return now_ns() + (int64_t)ticks * TICK_NS;
+}
+
+static void init_cond(pthread_cond_t *cond) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+// false once the deadline has passed
+static bool wait_until(pthread_cond_t *cond, pthread_mutex_t *lock, int64_t deadline) {
+    if (deadline < 0) {
+        pthread_cond_wait(cond, lock);
+        return true;
+    }
+    struct timespec ts = to_timespec(deadline);
+    return pthread_cond_timedwait(cond, lock, &ts) != ETIMEDOUT;
+}
+
+static void sleep_until(int64_t deadline) {
+    struct timespec ts = to_timespec(deadline);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+// Until `tick` ticks after the start
+static void sleep_until_tick(TickType_t tick) {
+    if (clock_simulated) {
+        if ((int64_t)tick * TICK_NS > simulated_ns) {
+            simulated_ns = (int64_t)tick * TICK_NS;
+        }
+        return;
+    }
+    sleep_until(start_ns + (int64_t)tick * TICK_NS);
+}
+
+void host_enter_critical(void) {
+    pthread_mutex_lock(&critical_lock);
+}
+
+void host_exit_critical(void) {
+    pthread_mutex_unlock(&critical_lock);
+}
+
+static struct host_task *task_alloc(const char *name) {
+    pthread_mutex_lock(&tasks_lock);
+    struct host_task *task = task_count < MAX_TASKS ? &tasks[task_count++] : NULL;
+    pthread_mutex_unlock(&tasks_lock);
+    if (task == NULL) {
+        fprintf(stderr, "host FreeRTOS: more than %d tasks\n", MAX_TASKS);
+        abort();
+    }
+    memset(task, 0, sizeof(*task));
+    task->name = name;
+    task->core = tskNO_AFFINITY;
+    pthread_mutex_init(&task->lock, NULL);
+    init_cond(&task->cond);
+    return task;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    // Threads the test starts itself, main included, become tasks on first use
+    if (current_task == NULL) {
+        current_task = task_alloc("host");
+        current_task->thread = pthread_self();
+    }
+    return current_task;
+}
+
+const char *pcTaskGetTaskName(TaskHandle_t task) {
+    return (task != NULL ? task : xTaskGetCurrentTaskHandle())->name;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task) {
+    return (task != NULL ? task : xTaskGetCurrentTaskHandle())->priority;
+}
+
+static void *task_entry(void *arg) {
+    struct host_task *task = arg;
+    current_task = task;
+    task->fn(task->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *created, BaseType_t core) {
+    struct host_task *task = task_alloc(name);
+    task->fn = fn;
+    task->arg = arg;
+    task->priority = priority;
+    task->core = core;
+    if (created != NULL) {
+        *created = task;
+    }
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int err = pthread_create(&task->thread, &attr, task_entry, task);
+    pthread_attr_destroy(&attr);
+    return err == 0 ? pdPASS : pdFAIL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                       UBaseType_t priority, TaskHandle_t *created) {
+    return xTaskCreatePinnedToCore(fn, name, stack_depth, arg, priority, created, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task == NULL || task == current_task) {
+        pthread_exit(NULL);
+    }
+    pthread_cancel(task->thread);
+}
+
+BaseType_t xPortGetCoreID(void) {
+    BaseType_t core = xTaskGetCurrentTaskHandle()->core;
+    return core == tskNO_AFFINITY ? 0 : core;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    if (ticks == 0) {
+        sched_yield();
+        return;
+    }
+    // Until the ticks'th tick interrupt from now
+    sleep_until_tick(xTaskGetTickCount() + ticks);
+}
+
+void vTaskDelayUntil(TickType_t *previous_wake, TickType_t period) {
+    *previous_wake += period;
+    sleep_until_tick(*previous_wake);
+}
+
+void taskYIELD(void) {
+    sched_yield();
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action) {
+    BaseType_t ret = pdPASS;
+    pthread_mutex_lock(&task->lock);
+    switch (action) {
+    case eSetBits: task->notify_value |= value; break;
+    case eIncrement: task->notify_value++; break;
+    case eSetValueWithOverwrite: task->notify_value = value; break;
+    case eSetValueWithoutOverwrite:
+        if (task->notify_pending) {
+            ret = pdFAIL;
+        } else {
+            task->notify_value = value;
+        }
+        break;
+    default: break;
+    }
+    task->notify_pending = true;
+    pthread_cond_broadcast(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+    return ret;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t *task_woken) {
+    if (task_woken != NULL) {
+        *task_woken = pdTRUE;
+    }
+    return xTaskNotify(task, value, action);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    return xTaskNotify(task, 0, eIncrement);
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *task_woken) {
+    xTaskNotifyFromISR(task, 0, eIncrement, task_woken);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks) {
+    struct host_task *task = xTaskGetCurrentTaskHandle();
+    int64_t deadline = deadline_after(ticks);
+    pthread_mutex_lock(&task->lock);
+    while (task->notify_value == 0 && ticks != 0) {
+        if (!wait_until(&task->cond, &task->lock, deadline)) {
+            break;
+        }
+    }
+    uint32_t value = task->notify_value;
+    if (value != 0) {
+        task->notify_value = clear_on_exit ? 0 : value - 1;
+    }
+    task->notify_pending = false;
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t *value, TickType_t ticks) {
+    struct host_task *task = xTaskGetCurrentTaskHandle();
+    int64_t deadline = deadline_after(ticks);
+    pthread_mutex_lock(&task->lock);
+    if (!task->notify_pending) {
+        task->notify_value &= ~clear_on_entry;
+    }
+    while (!task->notify_pending && ticks != 0) {
+        if (!wait_until(&task->cond, &task->lock, deadline)) {
+            break;
+        }
+    }
+    BaseType_t received = task->notify_pending ? pdTRUE : pdFALSE;
+    if (value != NULL) {
+        *value = task->notify_value;
+    }
+    if (received) {
+        task->notify_value &= ~clear_on_exit;
+        task->notify_pending = false;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return received;
+}
+
+static void queue_init(struct host_queue *queue, queue_kind_t kind, UBaseType_t length, UBaseType_t item_size) {
+    queue->kind = kind;
+    queue->length = length;
+    queue->item_size = item_size;
+    pthread_mutex_init(&queue->lock, NULL);
+    init_cond(&queue->not_empty);
+    init_cond(&queue->not_full);
+}
+
+static struct host_queue *queue_create(queue_kind_t kind, UBaseType_t length, UBaseType_t item_size) {
+    struct host_queue *queue = calloc(1, sizeof(struct host_queue));
+    if (queue == NULL) {
+        return NULL;
+    }
+    if (item_size > 0) {
+        queue->items = malloc((size_t)length * item_size);
+        if (queue->items == NULL) {
+            free(queue);
+            return NULL;
+        }
+    }
+    queue_init(queue, kind, length, item_size);
+    return queue;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    return queue_create(KIND_QUEUE, length, item_size);
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    if (queue == NULL) {
+        return;
+    }
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+    if (!queue->is_static) {
+        free(queue->items);
+        free(queue);
+    }
+}
+
+static BaseType_t queue_send(QueueHandle_t queue, const void *item, TickType_t ticks, bool front, bool overwrite) {
+    int64_t deadline = deadline_after(ticks);
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->length && !overwrite) {
+        if (ticks == 0 || !wait_until(&queue->not_full, &queue->lock, deadline)) {
+            pthread_mutex_unlock(&queue->lock);
+            return pdFAIL;
+        }
+    }
+    if (queue->item_size > 0) {
+        UBaseType_t slot;
+        if (overwrite && queue->count == queue->length) {
+            slot = (queue->head + queue->count - 1) % queue->length;
+        } else if (front) {
+            queue->head = (queue->head + queue->length - 1) % queue->length;
+            slot = queue->head;
+            queue->count++;
+        } else {
+            slot = (queue->head + queue->count) % queue->length;
+            queue->count++;
+        }
+        memcpy(queue->items + (size_t)slot * queue->item_size, item, queue->item_size);
+    } else if (queue->count < queue->length) {
+        queue->count++;
+    }
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+static BaseType_t queue_receive(QueueHandle_t queue, void *item, TickType_t ticks, bool peek) {
+    int64_t deadline = deadline_after(ticks);
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0) {
+        if (ticks == 0 || !wait_until(&queue->not_empty, &queue->lock, deadline)) {
+            pthread_mutex_unlock(&queue->lock);
+            return pdFAIL;
+        }
+    }
+    if (queue->item_size > 0) {
+        memcpy(item, queue->items + (size_t)queue->head * queue->item_size, queue->item_size);
+    }
+    if (!peek) {
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        pthread_cond_signal(&queue->not_full);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks) {
+    return queue_send(queue, item, ticks, false, false);
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t ticks) {
+    return queue_send(queue, item, ticks, false, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void *item, TickType_t ticks) {
+    return queue_send(queue, item, ticks, true, false);
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *task_woken) {
+    BaseType_t ret = queue_send(queue, item, 0, false, false);
+    if (task_woken != NULL && ret == pdPASS) {
+        *task_woken = pdTRUE;
+    }
+    return ret;
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item) {
+    return queue_send(queue, item, 0, false, true);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks) {
+    return queue_receive(queue, item, ticks, false);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void *item, TickType_t ticks) {
+    return queue_receive(queue, item, ticks, true);
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t spaces = queue->length - queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return spaces;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->head = 0;
+    queue->count = 0;
+    pthread_cond_broadcast(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    struct host_queue *mutex = queue_create(KIND_MUTEX, 1, 0);
+    if (mutex != NULL) {
+        mutex->count = 1;
+    }
+    return mutex;
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void) {
+    struct host_queue *mutex = xSemaphoreCreateMutex();
+    if (mutex != NULL) {
+        mutex->kind = KIND_RECURSIVE_MUTEX;
+    }
+    return mutex;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return queue_create(KIND_SEMAPHORE, 1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buffer) {
+    struct host_queue *semaphore = (struct host_queue *)buffer;
+    memset(semaphore, 0, sizeof(struct host_queue));
+    queue_init(semaphore, KIND_SEMAPHORE, 1, 0);
+    semaphore->is_static = true;
+    return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count) {
+    struct host_queue *semaphore = queue_create(KIND_SEMAPHORE, max_count, 0);
+    if (semaphore != NULL) {
+        semaphore->count = initial_count;
+    }
+    return semaphore;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+    vQueueDelete(semaphore);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+    if (queue_receive(semaphore, NULL, ticks, false) != pdPASS) {
+        return pdFAIL;
+    }
+    if (semaphore->kind != KIND_SEMAPHORE) {
+        semaphore->owner = xTaskGetCurrentTaskHandle();
+    }
+    return pdPASS;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    if (semaphore->kind != KIND_SEMAPHORE) {
+        if (semaphore->owner != xTaskGetCurrentTaskHandle()) {
+            return pdFAIL;
+        }
+        semaphore->owner = NULL;
+    }
+    pthread_mutex_lock(&semaphore->lock);
+    if (semaphore->count == semaphore->length) {
+        pthread_mutex_unlock(&semaphore->lock);
+        return pdFAIL;
+    }
+    semaphore->count++;
+    pthread_cond_signal(&semaphore->not_empty);
+    pthread_mutex_unlock(&semaphore->lock);
+    return pdPASS;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t *task_woken) {
+    if (task_woken != NULL) {
+        *task_woken = pdTRUE;
+    }
+    return xSemaphoreGive(semaphore);
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t semaphore, TickType_t ticks) {
+    // Only the owner reads or writes depth, and only while it owns the mutex
+    if (semaphore->owner == xTaskGetCurrentTaskHandle()) {
+        semaphore->depth++;
+        return pdPASS;
+    }
+    if (xSemaphoreTake(semaphore, ticks) != pdPASS) {
+        return pdFAIL;
+    }
+    semaphore->depth = 1;
+    return pdPASS;
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t semaphore) {
+    if (semaphore->owner != xTaskGetCurrentTaskHandle()) {
+        return pdFAIL;
+    }
+    if (--semaphore->depth > 0) {
+        return pdPASS;
+    }
+    return xSemaphoreGive(semaphore);
+}
+
+// Each esp_timer gets a thread that sleeps until it is due, where the
+// device runs every callback on one esp_timer task
+static void *timer_thread(void *arg) {
+    struct esp_timer *timer = arg;
+    pthread_mutex_lock(&timer->lock);
+    while (!timer->deleted) {
+        if (timer->deadline < 0) {
+            pthread_cond_wait(&timer->cond, &timer->lock);
+            continue;
+        }
+        int64_t deadline = timer->deadline;
+        if (wait_until(&timer->cond, &timer->lock, deadline) || timer->deadline != deadline) {
+            continue;
+        }
+        timer->deadline = -1;
+        pthread_mutex_unlock(&timer->lock);
+        timer->callback(timer->arg);
+        pthread_mutex_lock(&timer->lock);
+    }
+    pthread_mutex_unlock(&timer->lock);
+    return NULL;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out_handle) {
+    if (args == NULL || args->callback == NULL || out_handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct esp_timer *timer = calloc(1, sizeof(struct esp_timer));
+    if (timer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    timer->callback = args->callback;
+    timer->arg = args->arg;
+    timer->deadline = -1;
+    pthread_mutex_init(&timer->lock, NULL);
+    init_cond(&timer->cond);
+    pthread_create(&timer->thread, NULL, timer_thread, timer);
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    pthread_mutex_lock(&timer->lock);
+    if (timer->deadline >= 0) {
+        pthread_mutex_unlock(&timer->lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->deadline = now_ns() + (int64_t)timeout_us * 1000;
+    pthread_cond_signal(&timer->cond);
+    pthread_mutex_unlock(&timer->lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    pthread_mutex_lock(&timer->lock);
+    esp_err_t err = timer->deadline >= 0 ? ESP_OK : ESP_ERR_INVALID_STATE;
+    timer->deadline = -1;
+    pthread_cond_signal(&timer->cond);
+    pthread_mutex_unlock(&timer->lock);
+    return err;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&timer->lock);
+    timer->deleted = true;
+    pthread_cond_signal(&timer->cond);
+    pthread_mutex_unlock(&timer->lock);
+    pthread_join(timer->thread, NULL);
+    pthread_mutex_destroy(&timer->lock);
+    pthread_cond_destroy(&timer->cond);
+    free(timer);
+    return ESP_OK;
+}
@@ -0,0 +1,37 @@
+/**
+ * @file host_test.h
+ * @brief Checks for the host tests. Each failed check prints where and
+ * what, and the test exits with host_test_result().
+ */
+
+#pragma once
+
+#include <stdio.h>
+
+static int host_test_failures;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            host_test_failures++; \
+        } \
+    } while (0)
+
+#define CHECK_EQ(actual, expected) \
+    do { \
+        long long actual_ = (long long)(actual), expected_ = (long long)(expected); \
+        if (actual_ != expected_) { \
+            fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, actual_, expected_); \
+            host_test_failures++; \
+        } \
+    } while (0)
+
+static inline int host_test_result(const char *name) {
+    if (host_test_failures != 0) {
+        fprintf(stderr, "%s: %d checks failed\n", name, host_test_failures);
+        return 1;
+    }
+    fprintf(stderr, "%s: all checks passed\n", name);
+    return 0;
+}
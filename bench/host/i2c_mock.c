@@ -0,0 +1,374 @@
+/*
+ * The ESP-IDF I2C master driver API against device models. Links are
+ * lists of commands like the driver's own: a heap link allocates its
+ * descriptor and then one node per command, as ESP-IDF 4.2 does, and a
+ * static link carves them out of the caller's buffer, as 4.4 does.
+ */
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+// Both link APIs, whichever version the code under test is built for
+#undef ESP_IDF_VERSION_MINOR
+#define ESP_IDF_VERSION_MINOR 4
+
+#include "driver/i2c.h"
+
+#include "i2c_mock.h"
+
+#define MAX_WRITE 256
+
+typedef enum {
+    CMD_START,
+    CMD_STOP,
+    CMD_WRITE,
+    CMD_WRITE_BYTE,
+    CMD_READ,
+} cmd_op_t;
+
+typedef struct cmd_node {
+    struct cmd_node *next;
+    uint8_t *data;
+    uint32_t length;
+    uint8_t op;
+    uint8_t byte;
+} cmd_node_t;
+
+typedef struct {
+    cmd_node_t *head;
+    cmd_node_t *tail;
+    uint8_t *free;          // static links: what is left of the buffer
+    uint32_t free_size;
+    bool is_static;
+} cmd_link_t;
+
+_Static_assert(sizeof(cmd_node_t) <= I2C_INTERNAL_STRUCT_SIZE, "command node larger than the static link slot");
+_Static_assert(sizeof(cmd_link_t) <= I2C_INTERNAL_STRUCT_SIZE, "link larger than the static link slot");
+
+typedef struct {
+    pthread_mutex_t lock;
+    i2c_mock_device_t *devices;
+    i2c_mock_stats_t stats;
+    uint32_t byte_ns;
+    bool busy;
+} mock_port_t;
+
+static mock_port_t ports[I2C_NUM_MAX] = {
+    { .lock = PTHREAD_MUTEX_INITIALIZER },
+    { .lock = PTHREAD_MUTEX_INITIALIZER },
+};
+static int32_t live_links;
+
+i2c_cmd_handle_t i2c_cmd_link_create(void) {
+    cmd_link_t *link = calloc(1, sizeof(cmd_link_t));
+    if (link != NULL) {
+        __atomic_fetch_add(&ports[0].stats.heap_links, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&live_links, 1, __ATOMIC_RELAXED);
+    }
+    return link;
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create_static(uint8_t *buffer, uint32_t size) {
+    if (buffer == NULL || size < I2C_INTERNAL_STRUCT_SIZE) {
+        return NULL;
+    }
+    memset(buffer, 0, size);
+    cmd_link_t *link = (cmd_link_t *)buffer;
+    link->is_static = true;
+    link->free = buffer + I2C_INTERNAL_STRUCT_SIZE;
+    link->free_size = size - I2C_INTERNAL_STRUCT_SIZE;
+    __atomic_fetch_add(&ports[0].stats.static_links, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&live_links, 1, __ATOMIC_RELAXED);
+    return link;
+}
+
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd_handle) {
+    cmd_link_t *link = cmd_handle;
+    if (link == NULL) {
+        return;
+    }
+    for (cmd_node_t *node = link->head; node != NULL; ) {
+        cmd_node_t *next = node->next;
+        free(node);
+        node = next;
+    }
+    free(link);
+    __atomic_fetch_sub(&live_links, 1, __ATOMIC_RELAXED);
+}
+
+void i2c_cmd_link_delete_static(i2c_cmd_handle_t cmd_handle) {
+    if (cmd_handle != NULL) {
+        __atomic_fetch_sub(&live_links, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static esp_err_t link_append(i2c_cmd_handle_t cmd_handle, cmd_op_t op, uint8_t *data, uint32_t length, uint8_t byte) {
+    cmd_link_t *link = cmd_handle;
+    if (link == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    cmd_node_t *node;
+    if (link->is_static) {
+        if (link->free_size < I2C_INTERNAL_STRUCT_SIZE) {
+            return ESP_ERR_NO_MEM;
+        }
+        node = (cmd_node_t *)link->free;
+        link->free += I2C_INTERNAL_STRUCT_SIZE;
+        link->free_size -= I2C_INTERNAL_STRUCT_SIZE;
+    } else {
+        node = calloc(1, sizeof(cmd_node_t));
+        if (node == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        __atomic_fetch_add(&ports[0].stats.heap_commands, 1, __ATOMIC_RELAXED);
+    }
+    node->next = NULL;
+    node->op = op;
+    node->data = data;
+    node->length = length;
+    node->byte = byte;
+    if (link->tail == NULL) {
+        link->head = node;
+    } else {
+        link->tail->next = node;
+    }
+    link->tail = node;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd_handle) {
+    return link_append(cmd_handle, CMD_START, NULL, 0, 0);
+}
+
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd_handle) {
+    return link_append(cmd_handle, CMD_STOP, NULL, 0, 0);
+}
+
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd_handle, uint8_t data, bool ack_en) {
+    return link_append(cmd_handle, CMD_WRITE_BYTE, NULL, 1, data);
+}
+
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd_handle, const uint8_t *data, size_t data_len, bool ack_en) {
+    if (data == NULL || data_len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return link_append(cmd_handle, CMD_WRITE, (uint8_t *)data, data_len, 0);
+}
+
+esp_err_t i2c_master_read_byte(i2c_cmd_handle_t cmd_handle, uint8_t *data, i2c_ack_type_t ack) {
+    return i2c_master_read(cmd_handle, data, 1, ack);
+}
+
+esp_err_t i2c_master_read(i2c_cmd_handle_t cmd_handle, uint8_t *data, size_t data_len, i2c_ack_type_t ack) {
+    if (data == NULL || data_len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return link_append(cmd_handle, CMD_READ, data, data_len, 0);
+}
+
+static i2c_mock_device_t *find_device(mock_port_t *port, uint8_t addr) {
+    for (i2c_mock_device_t *device = port->devices; device != NULL; device = device->next) {
+        if (device->addr == addr) {
+            return device;
+        }
+    }
+    return NULL;
+}
+
+// Runs a link with the port lock held, counts what crossed the bus
+static esp_err_t run_link(mock_port_t *port, cmd_link_t *link) {
+    uint8_t pending[MAX_WRITE];
+    size_t pending_length = 0;
+    i2c_mock_device_t *device = NULL;
+    bool expect_addr = false, writing = false;
+
+    for (cmd_node_t *node = link->head; node != NULL; node = node->next) {
+        const uint8_t *bytes = node->op == CMD_WRITE_BYTE ? &node->byte : node->data;
+        switch (node->op) {
+        case CMD_START:
+        case CMD_STOP:
+            if (device != NULL && writing && device->write != NULL &&
+                device->write(device, pending, pending_length) != ESP_OK) {
+                return ESP_FAIL;
+            }
+            pending_length = 0;
+            device = NULL;
+            expect_addr = node->op == CMD_START;
+            if (node->op == CMD_STOP) {
+                return ESP_OK;
+            }
+            break;
+        case CMD_WRITE:
+        case CMD_WRITE_BYTE:
+            port->stats.bytes_written += node->length;
+            for (uint32_t i = 0; i < node->length; i++) {
+                if (expect_addr) {
+                    expect_addr = false;
+                    device = find_device(port, bytes[i] >> 1);
+                    writing = (bytes[i] & 1) == I2C_MASTER_WRITE;
+                    if (device == NULL) {
+                        return ESP_FAIL;
+                    }
+                } else if (device == NULL || !writing || pending_length == MAX_WRITE) {
+                    return ESP_FAIL;
+                } else {
+                    pending[pending_length++] = bytes[i];
+                }
+            }
+            break;
+        case CMD_READ:
+            if (device == NULL || writing || device->read == NULL) {
+                return ESP_FAIL;
+            }
+            port->stats.bytes_read += node->length;
+            if (device->read(device, node->data, node->length) != ESP_OK) {
+                return ESP_FAIL;
+            }
+            break;
+        }
+    }
+    // The controller hangs without a STOP, the driver times out
+    return ESP_ERR_TIMEOUT;
+}
+
+esp_err_t i2c_master_cmd_begin(i2c_port_t i2c_num, i2c_cmd_handle_t cmd_handle, TickType_t ticks_to_wait) {
+    if (i2c_num < 0 || i2c_num >= I2C_NUM_MAX || cmd_handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    mock_port_t *port = &ports[i2c_num];
+
+    // The driver serialises callers on its own lock. Count when it has to,
+    // i2c_device's port mutex should have done so already.
+    if (__atomic_exchange_n(&port->busy, true, __ATOMIC_ACQUIRE)) {
+        __atomic_fetch_add(&port->stats.overlaps, 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_lock(&port->lock);
+    uint32_t bytes_before = port->stats.bytes_written + port->stats.bytes_read;
+    esp_err_t err = run_link(port, cmd_handle);
+    port->stats.transactions++;
+    if (err != ESP_OK) {
+        port->stats.nacks++;
+    }
+    uint64_t wire_ns = (uint64_t)(port->stats.bytes_written + port->stats.bytes_read - bytes_before) * port->byte_ns;
+    pthread_mutex_unlock(&port->lock);
+
+    if (wire_ns > 0) {
+        // Sleep rather than spin, the host may have a single CPU
+        struct timespec ts = { .tv_sec = wire_ns / 1000000000, .tv_nsec = wire_ns % 1000000000 };
+        nanosleep(&ts, NULL);
+    }
+    __atomic_store_n(&port->busy, false, __ATOMIC_RELEASE);
+    return err;
+}
+
+esp_err_t i2c_param_config(i2c_port_t i2c_num, const i2c_config_t *i2c_conf) {
+    return i2c_num >= 0 && i2c_num < I2C_NUM_MAX && i2c_conf != NULL ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t i2c_driver_install(i2c_port_t i2c_num, i2c_mode_t mode, size_t slv_rx_buf_len, size_t slv_tx_buf_len,
+                             int intr_alloc_flags) {
+    if (i2c_num < 0 || i2c_num >= I2C_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    __atomic_fetch_add(&ports[i2c_num].stats.driver_installs, 1, __ATOMIC_RELAXED);
+    return ESP_OK;
+}
+
+esp_err_t i2c_driver_delete(i2c_port_t i2c_num) {
+    return ESP_OK;
+}
+
+esp_err_t i2c_set_period(i2c_port_t i2c_num, int high_period, int low_period) {
+    __atomic_fetch_add(&ports[i2c_num].stats.clock_changes, 1, __ATOMIC_RELAXED);
+    return ESP_OK;
+}
+
+esp_err_t i2c_set_start_timing(i2c_port_t i2c_num, int setup_time, int hold_time) {
+    return ESP_OK;
+}
+
+esp_err_t i2c_set_stop_timing(i2c_port_t i2c_num, int setup_time, int hold_time) {
+    return ESP_OK;
+}
+
+esp_err_t i2c_set_data_timing(i2c_port_t i2c_num, int sample_time, int hold_time) {
+    return ESP_OK;
+}
+
+esp_err_t i2c_set_timeout(i2c_port_t i2c_num, int timeout) {
+    return ESP_OK;
+}
+
+esp_err_t gpio_reset_pin(gpio_num_t gpio_num) {
+    return ESP_OK;
+}
+
+static struct {
+    gpio_isr_t handler;
+    void *arg;
+} gpio_isrs[40];
+
+esp_err_t gpio_config(const gpio_config_t *config) {
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags) {
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args) {
+    if (gpio_num < 0 || gpio_num >= (gpio_num_t)(sizeof(gpio_isrs) / sizeof(gpio_isrs[0]))) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    gpio_isrs[gpio_num].handler = isr_handler;
+    gpio_isrs[gpio_num].arg = args;
+    return ESP_OK;
+}
+
+void host_gpio_interrupt(gpio_num_t gpio_num) {
+    if (gpio_num >= 0 && gpio_num < (gpio_num_t)(sizeof(gpio_isrs) / sizeof(gpio_isrs[0])) &&
+        gpio_isrs[gpio_num].handler != NULL) {
+        gpio_isrs[gpio_num].handler(gpio_isrs[gpio_num].arg);
+    }
+}
+
+void i2c_mock_attach(i2c_port_t port, i2c_mock_device_t *device) {
+    pthread_mutex_lock(&ports[port].lock);
+    device->next = ports[port].devices;
+    ports[port].devices = device;
+    pthread_mutex_unlock(&ports[port].lock);
+}
+
+void i2c_mock_detach_all(void) {
+    for (int i = 0; i < I2C_NUM_MAX; i++) {
+        pthread_mutex_lock(&ports[i].lock);
+        ports[i].devices = NULL;
+        pthread_mutex_unlock(&ports[i].lock);
+    }
+}
+
+void i2c_mock_set_byte_time(i2c_port_t port, uint32_t byte_ns) {
+    ports[port].byte_ns = byte_ns;
+}
+
+void i2c_mock_get_stats(i2c_port_t port, i2c_mock_stats_t *stats) {
+    pthread_mutex_lock(&ports[port].lock);
+    *stats = ports[port].stats;
+    pthread_mutex_unlock(&ports[port].lock);
+    // Links are created before they are bound to a port, so the link
+    // counters of every port are kept on port 0
+    if (port != 0) {
+        stats->heap_links = 0;
+        stats->heap_commands = 0;
+        stats->static_links = 0;
+    }
+    stats->live_links = __atomic_load_n(&live_links, __ATOMIC_RELAXED);
+}
+
+void i2c_mock_reset_stats(void) {
+    for (int i = 0; i < I2C_NUM_MAX; i++) {
+        pthread_mutex_lock(&ports[i].lock);
+        memset(&ports[i].stats, 0, sizeof(i2c_mock_stats_t));
+        pthread_mutex_unlock(&ports[i].lock);
+    }
+}
@@ -0,0 +1,68 @@
+/**
+ * @file i2c_mock.h
+ * @brief Device models behind the host I2C driver.
+ *
+ * i2c_master_cmd_begin() walks a command link the way the controller
+ * would. The address byte after each START picks the attached model
+ * with that address; a missing one NACKs. The bytes written after the
+ * address reach write() when the next START or the STOP ends them, and
+ * every read command calls read() for its bytes. Either callback can
+ * return an error to NACK, which fails the whole transaction with
+ * ESP_FAIL, as the real driver does.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "driver/i2c.h"
+
+typedef struct i2c_mock_device i2c_mock_device_t;
+
+struct i2c_mock_device {
+    uint8_t addr;
+    esp_err_t (*write)(i2c_mock_device_t *device, const uint8_t *data, size_t length);
+    esp_err_t (*read)(i2c_mock_device_t *device, uint8_t *data, size_t length);
+    void *ctx;
+    i2c_mock_device_t *next;
+};
+
+/**
+ * @brief What the driver saw on one port since the last reset.
+ *
+ * A link is not bound to a port until it runs, so the link counters
+ * cover every port and are only reported for port 0.
+ */
+typedef struct {
+    uint32_t transactions;      // i2c_master_cmd_begin calls
+    uint32_t nacks;
+    uint32_t bytes_written;     // address bytes included
+    uint32_t bytes_read;
+    uint32_t heap_links;        // i2c_cmd_link_create calls
+    uint32_t heap_commands;     // commands appended to heap links, one allocation each
+    uint32_t static_links;      // i2c_cmd_link_create_static calls
+    int32_t live_links;         // created and not yet deleted, on every port
+    uint32_t driver_installs;
+    uint32_t clock_changes;     // i2c_set_period calls
+    uint32_t overlaps;          // transactions started while another ran on the port
+} i2c_mock_stats_t;
+
+/**
+ * @brief Puts a model on a port's bus. It must stay valid until
+ * i2c_mock_detach_all().
+ */
+void i2c_mock_attach(i2c_port_t port, i2c_mock_device_t *device);
+
+void i2c_mock_detach_all(void);
+
+/**
+ * @brief Makes every transaction on the port sleep for this long per
+ * byte on the wire, 0 by default. At 400 kHz a byte and its ACK take
+ * 22.5 us.
+ */
+void i2c_mock_set_byte_time(i2c_port_t port, uint32_t byte_ns);
+
+void i2c_mock_get_stats(i2c_port_t port, i2c_mock_stats_t *stats);
+
+void i2c_mock_reset_stats(void);
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef struct esp_timer *esp_timer_handle_t;
+
+typedef void (*esp_timer_cb_t)(void *arg);
+
+typedef enum {
+    ESP_TIMER_TASK,
+} esp_timer_dispatch_t;
+
+typedef struct {
+    esp_timer_cb_t callback;
+    void *arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char *name;
+} esp_timer_create_args_t;
+
+// Microseconds since the process started, CLOCK_MONOTONIC
+int64_t esp_timer_get_time(void);
+
+// One-shot timers only, with a thread each in host/freertos_posix.c
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out_handle);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+esp_err_t esp_timer_delete(esp_timer_handle_t timer);
+
+/*
+ * From here on esp_timer_get_time() and the tick count follow a simulated
+ * clock. Delays return at once and move it to where they would end, and
+ * host_clock_advance_us() moves it on. Only for a simulation that runs in
+ * one task and never waits on a queue or notification with a timeout.
+ */
+void host_clock_simulate(void);
+void host_clock_advance_us(int64_t us);
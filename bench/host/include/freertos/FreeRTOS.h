@@ -0,0 +1,57 @@
+/*
+ * Host stand-in for the parts of FreeRTOS the firmware components use,
+ * implemented on POSIX threads in host/freertos_posix.c. Ticks are
+ * CONFIG_FREERTOS_HZ from sdkconfig, 100 Hz, of real time. Priorities
+ * and core affinity are recorded and otherwise ignored: every task is a
+ * thread the host kernel schedules.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+typedef struct host_task *TaskHandle_t;
+typedef struct host_queue *QueueHandle_t;
+typedef struct host_queue *SemaphoreHandle_t;
+
+// Room for a host queue, checked in freertos_posix.c
+typedef struct {
+    _Alignas(16) uint8_t storage[256];
+} StaticSemaphore_t;
+
+typedef struct {
+    int unused;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {0}
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+
+#define configTICK_RATE_HZ 100
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+#define portMAX_DELAY ((TickType_t)0xffffffffu)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((TickType_t)(ms) * configTICK_RATE_HZ) / 1000))
+
+#define tskNO_AFFINITY 0x7fffffff
+
+#define IRAM_ATTR
+
+// One lock for every critical section, as on a single core
+void host_enter_critical(void);
+void host_exit_critical(void);
+
+#define portENTER_CRITICAL(mux) ((void)(mux), host_enter_critical())
+#define portEXIT_CRITICAL(mux) ((void)(mux), host_exit_critical())
+#define portENTER_CRITICAL_ISR(mux) ((void)(mux), host_enter_critical())
+#define portEXIT_CRITICAL_ISR(mux) ((void)(mux), host_exit_critical())
+#define portYIELD_FROM_ISR() do {} while (0)
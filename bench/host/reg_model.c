@@ -0,0 +1,40 @@
+#include <string.h>
+
+#include "reg_model.h"
+
+static esp_err_t reg_write(i2c_mock_device_t *device, const uint8_t *data, size_t length) {
+    reg_model_t *model = device->ctx;
+    if (length == 0) {
+        return ESP_OK;
+    }
+    if (data[0] == model->nack_reg) {
+        return ESP_FAIL;
+    }
+    model->pointer = data[0];
+    for (size_t i = 1; i < length; i++) {
+        model->writes[model->pointer]++;
+        model->regs[model->pointer++] = data[i];
+    }
+    return ESP_OK;
+}
+
+static esp_err_t reg_read(i2c_mock_device_t *device, uint8_t *data, size_t length) {
+    reg_model_t *model = device->ctx;
+    for (size_t i = 0; i < length; i++) {
+        if (model->pointer == model->nack_reg) {
+            return ESP_FAIL;
+        }
+        model->reads[model->pointer]++;
+        data[i] = model->regs[model->pointer++];
+    }
+    return ESP_OK;
+}
+
+void reg_model_init(reg_model_t *model, uint8_t addr) {
+    memset(model, 0, sizeof(reg_model_t));
+    model->device.addr = addr;
+    model->device.write = reg_write;
+    model->device.read = reg_read;
+    model->device.ctx = model;
+    model->nack_reg = -1;
+}
@@ -0,0 +1,26 @@
+/**
+ * @file reg_model.h
+ * @brief A generic I2C register file on the host bus.
+ *
+ * The first byte written sets the register pointer, the rest are
+ * written from there on, and reads continue from the pointer. Both
+ * advance it, as on the MPU6886, AXP192, BM8563 and FT6336U.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "i2c_mock.h"
+
+typedef struct {
+    i2c_mock_device_t device;
+    uint8_t regs[256];
+    uint8_t pointer;
+    int nack_reg;               // a register that NACKs, -1 for none
+    uint32_t writes[256];       // bytes written to each register
+    uint32_t reads[256];        // bytes read from each register
+} reg_model_t;
+
+void reg_model_init(reg_model_t *model, uint8_t addr);
@@ -0,0 +1,195 @@
+#include <math.h>
+#include <string.h>
+
+#include "esp_timer.h"
+
+#include "sgp30.h"
+#include "sgp30_model.h"
+
+// Maximum execution times from the datasheet, in us
+static int64_t duration_us(uint16_t command) {
+    switch (command) {
+    case SGP30_CMD_IAQ_INIT: return 10000;
+    case SGP30_CMD_MEASURE_IAQ: return 12000;
+    case SGP30_CMD_GET_IAQ_BASELINE: return 10000;
+    case SGP30_CMD_SET_IAQ_BASELINE: return 10000;
+    case SGP30_CMD_SET_ABSOLUTE_HUMIDITY: return 10000;
+    case SGP30_CMD_GET_FEATURE_SET: return 10000;
+    case SGP30_CMD_MEASURE_RAW: return 25000;
+    case SGP30_CMD_GET_SERIAL_ID: return 500;
+    default: return 0;
+    }
+}
+
+static void respond(sgp30_model_t *model, const uint16_t *words, uint8_t count) {
+    for (uint8_t i = 0; i < count; i++) {
+        uint8_t *word = &model->response[3 * i];
+        word[0] = words[i] >> 8;
+        word[1] = words[i] & 0xff;
+        word[2] = SGP30_CRC8(word, 2);
+    }
+    if (model->corrupt_responses > 0 && count > 0) {
+        model->corrupt_responses--;
+        model->response[2] ^= 0x01;
+    }
+    model->response_length = 3 * count;
+    model->response_pos = 0;
+}
+
+static bool read_words(sgp30_model_t *model, const uint8_t *data, size_t length, uint16_t *words, uint8_t count) {
+    if (length != 3u * count) {
+        return false;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        if (SGP30_CRC8(&data[3 * i], 2) != data[3 * i + 2]) {
+            model->bad_crcs++;
+            return false;
+        }
+        words[i] = (data[3 * i] << 8) | data[3 * i + 1];
+    }
+    return true;
+}
+
+static void set_baseline(sgp30_model_t *model, double baseline) {
+    model->baseline = baseline;
+    model->baseline_tvoc = (uint16_t)lround(baseline);
+    model->baseline_eco2 = model->baseline_tvoc;
+}
+
+// One second of the IAQ algorithm
+static void algorithm_step(sgp30_model_t *model) {
+    double compensation = model->humidity != 0 ? model->humidity / 256.0 : SGP30_MODEL_REF_HUMIDITY;
+    double signal = SGP30_MODEL_CLEAN_SIGNAL + model->air_tvoc_ppb
+        + SGP30_MODEL_HUMIDITY_PPB * (model->air_humidity_g_m3 - compensation);
+
+    // The baseline follows the clean-air signal. The sensor tells a smell
+    // from drift by how fast it comes, the model just leaves it out.
+    double tau = model->iaq_seconds < SGP30_MODEL_LEARN_S ? SGP30_MODEL_LEARN_TAU_S : SGP30_MODEL_TRACK_TAU_S;
+    double clean = signal - model->air_tvoc_ppb;
+    set_baseline(model, model->baseline + (clean - model->baseline) / tau);
+    model->iaq_seconds++;
+
+    double tvoc = signal - model->baseline;
+    // Fixed values for the first 15 s after iaq_init
+    if (model->iaq_seconds <= 15) {
+        tvoc = 0;
+    }
+    model->tvoc = tvoc <= 0 ? 0 : tvoc >= 60000 ? 60000 : (uint16_t)lround(tvoc);
+    model->eco2 = 400 + model->tvoc / 4;
+}
+
+static esp_err_t model_write(i2c_mock_device_t *device, const uint8_t *data, size_t length) {
+    sgp30_model_t *model = device->ctx;
+    int64_t now_us = esp_timer_get_time();
+    if (model->absent || length < 2 || now_us < model->ready_us) {
+        return ESP_FAIL;
+    }
+
+    uint16_t command = (data[0] << 8) | data[1];
+    uint16_t words[3];
+    model->commands++;
+    model->last_command = command;
+    model->ready_us = now_us + duration_us(command);
+    model->response_length = 0;
+
+    switch (command) {
+    case SGP30_CMD_IAQ_INIT:
+        model->iaq_started = true;
+        model->iaq_inits++;
+        if (model->algorithm) {
+            model->iaq_seconds = 0;
+            set_baseline(model, SGP30_MODEL_FACTORY_BASELINE);
+        }
+        break;
+    case SGP30_CMD_MEASURE_IAQ:
+        model->measure_iaqs++;
+        if (model->algorithm) {
+            algorithm_step(model);
+        }
+        words[0] = model->eco2;
+        words[1] = model->tvoc;
+        respond(model, words, 2);
+        break;
+    case SGP30_CMD_MEASURE_RAW:
+        words[0] = model->raw_h2;
+        words[1] = model->raw_ethanol;
+        respond(model, words, 2);
+        break;
+    case SGP30_CMD_GET_IAQ_BASELINE:
+        words[0] = model->baseline_eco2;
+        words[1] = model->baseline_tvoc;
+        respond(model, words, 2);
+        break;
+    case SGP30_CMD_SET_IAQ_BASELINE:
+        // TVOC first, the reverse of get_iaq_baseline
+        if (!read_words(model, data + 2, length - 2, words, 2)) {
+            return ESP_FAIL;
+        }
+        model->baseline_tvoc = words[0];
+        model->baseline_eco2 = words[1];
+        model->baseline_sets++;
+        if (model->algorithm) {
+            model->baseline = words[0];
+            model->iaq_seconds = SGP30_MODEL_LEARN_S;
+        }
+        break;
+    case SGP30_CMD_SET_ABSOLUTE_HUMIDITY:
+        if (!read_words(model, data + 2, length - 2, words, 1)) {
+            return ESP_FAIL;
+        }
+        model->humidity = words[0];
+        model->humidity_sets++;
+        break;
+    case SGP30_CMD_GET_FEATURE_SET:
+        words[0] = 0x0020;
+        respond(model, words, 1);
+        break;
+    case SGP30_CMD_GET_SERIAL_ID:
+        words[0] = model->serial >> 32;
+        words[1] = model->serial >> 16;
+        words[2] = model->serial;
+        respond(model, words, 3);
+        break;
+    default:
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t model_read(i2c_mock_device_t *device, uint8_t *data, size_t length) {
+    sgp30_model_t *model = device->ctx;
+    if (model->absent) {
+        return ESP_FAIL;
+    }
+    if (esp_timer_get_time() < model->ready_us) {
+        model->early_reads++;
+        return ESP_FAIL;
+    }
+    for (size_t i = 0; i < length; i++) {
+        // Past the result the sensor clocks out ones
+        data[i] = model->response_pos < model->response_length ? model->response[model->response_pos++] : 0xff;
+    }
+    return ESP_OK;
+}
+
+void sgp30_model_init(sgp30_model_t *model) {
+    memset(model, 0, sizeof(sgp30_model_t));
+    model->device.addr = SGP30_ADDR;
+    model->device.write = model_write;
+    model->device.read = model_read;
+    model->device.ctx = model;
+    model->serial = 0x0000012345678ull;
+    model->eco2 = 400;
+    model->tvoc = 0;
+    model->raw_h2 = 13000;
+    model->raw_ethanol = 18000;
+}
+
+void sgp30_model_power_cycle(sgp30_model_t *model) {
+    model->iaq_started = false;
+    model->humidity = 0;
+    model->iaq_seconds = 0;
+    model->ready_us = 0;
+    model->response_length = 0;
+    set_baseline(model, SGP30_MODEL_FACTORY_BASELINE);
+}
@@ -0,0 +1,89 @@
+/**
+ * @file sgp30_model.h
+ * @brief An SGP30 on the host I2C bus, as the datasheet describes it.
+ *
+ * Commands take their datasheet maximum time, and reading a result
+ * before it is ready NACKs, as the sensor does while it measures. Every
+ * word it returns carries its CRC, and every word written to it must.
+ *
+ * With `algorithm` set, measure_iaq runs a model of the on-chip IAQ
+ * algorithm instead of returning fixed values. Each call is one second
+ * of it. The sensing signal is the air's TVOC plus a humidity error
+ * proportional to how far the air's absolute humidity is from the
+ * compensation the driver set, or from SGP30_MODEL_REF_HUMIDITY without
+ * one. TVOC is the signal over a baseline. After iaq_init the baseline
+ * starts from a factory value and learns the clean-air signal with
+ * SGP30_MODEL_LEARN_TAU_S for 12 hours, then follows slow drift with
+ * SGP30_MODEL_TRACK_TAU_S. A baseline set with set_iaq_baseline ends
+ * the learning phase, as it does on the sensor.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "i2c_mock.h"
+
+// The humidity the algorithm assumes without compensation, g/m^3
+#define SGP30_MODEL_REF_HUMIDITY 11.57f
+// Clean-air signal, and the baseline after iaq_init
+#define SGP30_MODEL_CLEAN_SIGNAL 20000.0f
+#define SGP30_MODEL_FACTORY_BASELINE 19700.0f
+#define SGP30_MODEL_LEARN_S (12 * 3600)
+#define SGP30_MODEL_LEARN_TAU_S (2.5f * 3600)
+#define SGP30_MODEL_TRACK_TAU_S (24.0f * 3600)
+// The sensitivity to humidity, ppb per g/m^3 off the compensation
+#define SGP30_MODEL_HUMIDITY_PPB 40.0f
+
+typedef struct {
+    i2c_mock_device_t device;
+
+    // What the next measurements return
+    uint16_t eco2;
+    uint16_t tvoc;
+    uint16_t raw_h2;
+    uint16_t raw_ethanol;
+    uint64_t serial;
+
+    // State the driver has set
+    uint16_t baseline_eco2;
+    uint16_t baseline_tvoc;
+    uint16_t humidity;              // set_absolute_humidity word, 8.8 g/m^3
+    bool iaq_started;
+
+    // The IAQ algorithm, when set, and the air it measures
+    bool algorithm;
+    float air_tvoc_ppb;
+    float air_humidity_g_m3;
+    double baseline;                // a float's steps are too coarse for it
+    uint32_t iaq_seconds;
+
+    // Fault injection
+    uint32_t corrupt_responses;     // next responses get a bad CRC
+    bool absent;                    // NACKs everything
+
+    // Seen by the sensor
+    uint32_t commands;
+    uint32_t measure_iaqs;
+    uint32_t iaq_inits;
+    uint32_t baseline_sets;
+    uint32_t humidity_sets;
+    uint32_t early_reads;           // NACKed, the result was not ready
+    uint32_t bad_crcs;              // written words with a wrong CRC
+    uint16_t last_command;
+
+    // The result being read out
+    int64_t ready_us;
+    uint8_t response[9];
+    uint8_t response_length;
+    uint8_t response_pos;
+} sgp30_model_t;
+
+void sgp30_model_init(sgp30_model_t *model);
+
+/**
+ * @brief Forgets what the sensor keeps only in RAM: the algorithm's
+ * state, its baseline and the humidity compensation.
+ */
+void sgp30_model_power_cycle(sgp30_model_t *model);
@@ -0,0 +1,324 @@
+/*
+ * Host simulation of the I2C bus task. With the simulated backend it
+ * measures queue throughput and per-priority latency, and checks that
+ * the bus task sleeps through its transfers. With the mock bus it runs
+ * the synchronous drivers' transfers through the same queues and checks
+ * that a touch read waits for at most the transfer in flight.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+#include "i2c_device.h"
+#include "i2c_async.h"
+
+#include "host_test.h"
+#include "measure.h"
+#include "reg_model.h"
+
+#define PORT I2C_NUM_1
+#define TOUCH_ADDR 0x38
+#define IMU_ADDR 0x68
+#define PMU_ADDR 0x34
+#define OTHER_PORT I2C_NUM_0
+#define RTC_ADDR 0x51
+// A byte and its ACK at 400 kHz
+#define BYTE_NS 22500
+
+#define SIM_REQUESTS 2000
+#define SIM_TOUCH_EVERY 20
+#define LOAD_MS 1000
+#define TOUCH_PERIOD_MS 10
+
+static reg_model_t touch_chip, imu_chip, pmu_chip, rtc_chip;
+static I2CDevice_t touch, imu, pmu, rtc;
+
+// Addresses in the order their transfers reached the bus, logged when
+// the register pointer is written
+static uint8_t bus_order[32];
+static volatile int bus_order_len;
+
+static esp_err_t (*reg_write)(i2c_mock_device_t *device, const uint8_t *data, size_t length);
+
+static esp_err_t logged_write(i2c_mock_device_t *device, const uint8_t *data, size_t length) {
+    int n = __atomic_fetch_add(&bus_order_len, 1, __ATOMIC_RELAXED);
+    if (n < (int)sizeof(bus_order)) {
+        bus_order[n] = device->addr;
+    }
+    return reg_write(device, data, length);
+}
+
+static int64_t cpu_time_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void print_stats(const char *what) {
+    static const char *names[I2C_ASYNC_PRIO_MAX] = { "low", "normal", "high" };
+    for (int prio = I2C_ASYNC_PRIO_MAX - 1; prio >= 0; prio--) {
+        i2c_async_stats_t stats;
+        i2c_async_get_stats(prio, &stats);
+        if (stats.completed == 0) {
+            continue;
+        }
+        fprintf(stderr, "%s %-6s: %5u done, %3u rejected, latency mean %6.1f us, max %6u us\n",
+                what, names[prio], stats.completed, stats.rejected,
+                (double)stats.latency_sum_us / stats.completed, stats.latency_max_us);
+    }
+}
+
+static volatile uint32_t sim_done;
+
+static void sim_callback(i2c_async_req_t *req) {
+    __atomic_fetch_add(&sim_done, 1, __ATOMIC_RELAXED);
+}
+
+// Slow polls keep every queue full while a touch read comes in now and then
+static void test_sim_backend(void) {
+    static i2c_async_req_t reqs[SIM_REQUESTS];
+    static uint8_t buf[SIM_REQUESTS][16];
+    static i2c_async_sim_t sim = { .base_us = 100, .byte_us = 25 };
+    i2c_async_backend_t backend;
+    CHECK_EQ(i2c_async_sim_backend(&backend, &sim), ESP_OK);
+    i2c_async_set_backend(&backend);
+    i2c_async_reset_stats();
+    sim_done = 0;
+
+    int64_t start_us = esp_timer_get_time();
+    int64_t start_cpu_us = cpu_time_us();
+    for (int i = 0; i < SIM_REQUESTS; i++) {
+        bool is_touch = (i % SIM_TOUCH_EVERY) == 0;
+        reqs[i] = (i2c_async_req_t){
+            .device = is_touch ? touch : pmu,
+            .data = buf[i],
+            .length = is_touch ? 5 : 16,
+            .is_read = true,
+            .priority = is_touch ? I2C_ASYNC_PRIO_HIGH : (i & 1 ? I2C_ASYNC_PRIO_LOW : I2C_ASYNC_PRIO_NORMAL),
+            .callback = sim_callback,
+        };
+        // Retry when the queue is full, each retry counts as rejected.
+        // The touch reads still find their own queue empty.
+        while (i2c_async_submit(&reqs[i]) == ESP_ERR_NO_MEM) {
+            usleep(200);
+        }
+    }
+    while (sim_done < SIM_REQUESTS) {
+        usleep(1000);
+    }
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+    int64_t cpu_us = cpu_time_us() - start_cpu_us;
+
+    i2c_async_stats_t high, low;
+    i2c_async_get_stats(I2C_ASYNC_PRIO_HIGH, &high);
+    i2c_async_get_stats(I2C_ASYNC_PRIO_LOW, &low);
+    CHECK_EQ(high.completed, SIM_REQUESTS / SIM_TOUCH_EVERY);
+    CHECK_EQ(high.rejected, 0);
+    CHECK_EQ(high.errors + low.errors, 0);
+    // Queued behind at most the transfer in flight, 500 us with 16 bytes.
+    // A host thread can still lose a tick or two now and then, so the
+    // bound on the mean is the tight one.
+    CHECK(high.latency_sum_us / high.completed < 2000);
+    CHECK(high.latency_max_us < 500 + 2 * portTICK_PERIOD_MS * 1000);
+    CHECK(high.latency_sum_us / high.completed < low.latency_sum_us / low.completed);
+    // The bus task blocks through each transfer instead of spinning
+    CHECK(cpu_us < elapsed_us / 2);
+
+    print_stats("sim");
+    fprintf(stderr, "sim: %.0f requests/s, %.0f%% of a core while the bus was busy\n",
+            SIM_REQUESTS * 1e6 / elapsed_us, 100.0 * cpu_us / elapsed_us);
+    i2c_async_set_backend(NULL);
+}
+
+typedef struct {
+    I2CDevice_t device;
+    uint16_t length;
+} waiter_t;
+
+static void *read_once(void *arg) {
+    waiter_t *waiter = arg;
+    uint8_t data[16];
+    CHECK_EQ(i2c_read_bytes(waiter->device, 0x00, data, waiter->length), ESP_OK);
+    return NULL;
+}
+
+// Synchronous transfers queue for the bus by their device's priority
+static void test_sync_order(void) {
+    waiter_t waiters[7] = {
+        { pmu, 4 }, { imu, 6 }, { pmu, 4 }, { imu, 6 }, { pmu, 4 }, { imu, 6 }, { touch, 5 },
+    };
+    pthread_t threads[7];
+    uint8_t data[2];
+
+    CHECK(i2c_take_port(PORT, portMAX_DELAY) == pdTRUE);
+    // Nested transfers of the holder go straight to the bus
+    CHECK_EQ(i2c_read_bytes(imu, 0x75, data, 1), ESP_OK);
+    bus_order_len = 0;
+    for (int i = 0; i < 7; i++) {
+        pthread_create(&threads[i], NULL, read_once, &waiters[i]);
+        usleep(5000);
+    }
+    usleep(20000);
+    CHECK_EQ(bus_order_len, 0);
+    i2c_free_port(PORT);
+    for (int i = 0; i < 7; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    // Touch came last and goes first, then the IMU, then the power chip
+    CHECK_EQ(bus_order_len, 7);
+    CHECK_EQ(bus_order[0], TOUCH_ADDR);
+    for (int i = 1; i < 4; i++) {
+        CHECK_EQ(bus_order[i], IMU_ADDR);
+    }
+    for (int i = 4; i < 7; i++) {
+        CHECK_EQ(bus_order[i], PMU_ADDR);
+    }
+}
+
+// A task that holds one port takes the other without queueing behind
+// its own lease, and frees them in any order
+static void test_second_port(void) {
+    uint8_t data[2];
+
+    CHECK(i2c_take_port(PORT, portMAX_DELAY) == pdTRUE);
+    CHECK(i2c_take_port(OTHER_PORT, pdMS_TO_TICKS(100)) == pdTRUE);
+    CHECK_EQ(i2c_read_bytes(rtc, 0x02, data, 2), ESP_OK);
+    i2c_free_port(PORT);
+    CHECK_EQ(i2c_read_bytes(imu, 0x75, data, 1), ESP_OK);
+    i2c_free_port(OTHER_PORT);
+    CHECK_EQ(i2c_read_bytes(imu, 0x75, data, 1), ESP_OK);
+}
+
+static void *hold_port(void *arg) {
+    CHECK(i2c_take_port(PORT, portMAX_DELAY) == pdTRUE);
+    usleep(100000);
+    i2c_free_port(PORT);
+    return NULL;
+}
+
+// The wait for the bus task counts towards i2c_take_port()'s timeout,
+// and the lease left behind does not hold up the next one
+static void test_take_timeout(void) {
+    pthread_t holder;
+    pthread_create(&holder, NULL, hold_port, NULL);
+    usleep(20000);
+    int64_t start_us = esp_timer_get_time();
+    CHECK(i2c_take_port(PORT, pdMS_TO_TICKS(30)) == pdFAIL);
+    int64_t waited_us = esp_timer_get_time() - start_us;
+    CHECK(waited_us >= 20000 && waited_us < 70000);
+    pthread_join(holder, NULL);
+
+    CHECK(i2c_take_port(PORT, pdMS_TO_TICKS(100)) == pdTRUE);
+    i2c_free_port(PORT);
+}
+
+static volatile bool load_done;
+
+static void *load_task(void *arg) {
+    I2CDevice_t device = arg;
+    uint8_t data[16];
+    while (!load_done) {
+        i2c_read_bytes(device, 0x00, data, sizeof(data));
+    }
+    return NULL;
+}
+
+static void *touch_task(void *arg) {
+    uint32_t *waits = arg;
+    uint8_t data[5];
+    for (int i = 0; i < LOAD_MS / TOUCH_PERIOD_MS; i++) {
+        usleep(TOUCH_PERIOD_MS * 1000);
+        int64_t start_us = esp_timer_get_time();
+        i2c_read_bytes(touch, 0x02, data, sizeof(data));
+        waits[i] = esp_timer_get_time() - start_us;
+    }
+    return NULL;
+}
+
+/*
+    Four tasks read 16 bytes from the IMU back to back, and a touch read
+    comes every 10 ms. Returns the touch read p99 in us.
+*/
+static double run_touch_under_load(void) {
+    uint32_t waits[LOAD_MS / TOUCH_PERIOD_MS];
+    pthread_t loaders[4], toucher;
+
+    load_done = false;
+    for (int i = 0; i < 4; i++) {
+        pthread_create(&loaders[i], NULL, load_task, imu);
+    }
+    pthread_create(&toucher, NULL, touch_task, waits);
+    pthread_join(toucher, NULL);
+    load_done = true;
+    for (int i = 0; i < 4; i++) {
+        pthread_join(loaders[i], NULL);
+    }
+    return measure_percentile(waits, LOAD_MS / TOUCH_PERIOD_MS, 99);
+}
+
+// Before i2c_async_init the port mutex alone decides who goes next
+static double mutex_p99;
+
+static void test_touch_under_load(bool queued) {
+    i2c_mock_set_byte_time(PORT, BYTE_NS);
+    i2c_async_reset_stats();
+    double p99 = run_touch_under_load();
+    i2c_mock_set_byte_time(PORT, 0);
+
+    i2c_mock_stats_t wire;
+    i2c_mock_get_stats(PORT, &wire);
+    CHECK_EQ(wire.overlaps, 0);
+    if (!queued) {
+        mutex_p99 = p99;
+        return;
+    }
+
+    print_stats("bus");
+    // One 16 byte read in flight is 19 bytes, 430 us on the wire, and the
+    // touch read itself another 8 bytes. The rest is host thread wakeups,
+    // which can take most of a tick; behind the mutex alone it waits for
+    // whole bursts of other reads.
+    CHECK(p99 < portTICK_PERIOD_MS * 1000);
+    fprintf(stderr, "touch read under load: p99 %.0f us through the queue, %.0f us on the port mutex alone\n",
+            p99, mutex_p99);
+}
+
+int main(void) {
+    reg_model_init(&touch_chip, TOUCH_ADDR);
+    reg_model_init(&imu_chip, IMU_ADDR);
+    reg_model_init(&pmu_chip, PMU_ADDR);
+    reg_write = touch_chip.device.write;
+    touch_chip.device.write = logged_write;
+    imu_chip.device.write = logged_write;
+    pmu_chip.device.write = logged_write;
+    i2c_mock_attach(PORT, &touch_chip.device);
+    i2c_mock_attach(PORT, &imu_chip.device);
+    i2c_mock_attach(PORT, &pmu_chip.device);
+    reg_model_init(&rtc_chip, RTC_ADDR);
+    i2c_mock_attach(OTHER_PORT, &rtc_chip.device);
+
+    touch = i2c_malloc_device(PORT, GPIO_NUM_21, GPIO_NUM_22, 400000, TOUCH_ADDR);
+    imu = i2c_malloc_device(PORT, GPIO_NUM_21, GPIO_NUM_22, 400000, IMU_ADDR);
+    pmu = i2c_malloc_device(PORT, GPIO_NUM_21, GPIO_NUM_22, 400000, PMU_ADDR);
+    rtc = i2c_malloc_device(OTHER_PORT, GPIO_NUM_32, GPIO_NUM_33, 100000, RTC_ADDR);
+    i2c_device_set_priority(touch, I2C_ASYNC_PRIO_HIGH);
+    i2c_device_set_priority(pmu, I2C_ASYNC_PRIO_LOW);
+
+    test_touch_under_load(false);
+    CHECK_EQ(i2c_async_init(6, 0), ESP_OK);
+    test_sim_backend();
+    test_sync_order();
+    test_second_port();
+    test_take_timeout();
+    test_touch_under_load(true);
+
+    return host_test_result("i2c_async_test");
+}
@@ -0,0 +1,236 @@
+/*
+ * Host test of the batched register operations of i2c_device.c. The
+ * mock bus counts what reaches the wire, i2c_get_stats() what the
+ * driver thinks it did, and the two must agree. Batches must read and
+ * write the same bytes as the single calls with one bus acquisition,
+ * and a failing batch must replay to the operation that NACKed.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "i2c_device.h"
+#include "axp192.h"
+#include "axp192_i2c.h"
+#include "mpu6886.h"
+
+#include "host_test.h"
+#include "reg_model.h"
+
+#define PORT I2C_NUM_1
+#define AXP192_ADDR 0x34
+
+static reg_model_t imu;
+static reg_model_t pmu;
+
+static void reset_counters(void) {
+    i2c_reset_stats(PORT);
+    i2c_mock_reset_stats();
+}
+
+// The driver's byte counts against the mock's, which saw the wire
+static void check_counts_agree(void) {
+    i2c_bus_stats_t stats;
+    i2c_mock_stats_t wire;
+    i2c_get_stats(PORT, &stats);
+    i2c_mock_get_stats(PORT, &wire);
+    CHECK_EQ(stats.transactions, wire.transactions);
+    CHECK_EQ(stats.bytes_written, wire.bytes_written);
+    CHECK_EQ(stats.bytes_read, wire.bytes_read);
+    CHECK_EQ(stats.errors, wire.nacks);
+    CHECK_EQ(wire.overlaps, 0);
+}
+
+static void test_reads(I2CDevice_t device) {
+    static const uint8_t regs[4] = { 0x3b, 0x41, 0x43, 0x75 };
+    uint8_t single[4][6], batched[4][6];
+
+    for (int i = 0; i < 256; i++) {
+        imu.regs[i] = (uint8_t)(i * 37 + 11);
+    }
+
+    reset_counters();
+    for (int i = 0; i < 4; i++) {
+        CHECK_EQ(i2c_read_bytes(device, regs[i], single[i], 6), ESP_OK);
+    }
+    i2c_bus_stats_t singles;
+    i2c_get_stats(PORT, &singles);
+    check_counts_agree();
+
+    reset_counters();
+    i2c_batch_t batch;
+    CHECK_EQ(i2c_batch_begin(&batch, device), ESP_OK);
+    for (int i = 0; i < 4; i++) {
+        CHECK_EQ(i2c_batch_add_read(&batch, regs[i], batched[i], 6), ESP_OK);
+    }
+    CHECK_EQ(i2c_batch_commit(&batch), ESP_OK);
+    i2c_bus_stats_t batched_stats;
+    i2c_get_stats(PORT, &batched_stats);
+    check_counts_agree();
+
+    CHECK(memcmp(single, batched, sizeof(single)) == 0);
+    CHECK_EQ(singles.bus_acquisitions, 4);
+    CHECK_EQ(singles.transactions, 4);
+    CHECK_EQ(batched_stats.bus_acquisitions, 1);
+    CHECK_EQ(batched_stats.transactions, 1);
+    // Every operation still sends its address and register
+    CHECK_EQ(batched_stats.bytes_written, singles.bytes_written);
+    CHECK_EQ(batched_stats.bytes_read, singles.bytes_read);
+    for (int i = 0; i < 4; i++) {
+        CHECK_EQ(i2c_batch_op_status(&batch, i), ESP_OK);
+    }
+}
+
+static void test_writes(I2CDevice_t device) {
+    reset_counters();
+    i2c_batch_t batch;
+    i2c_batch_begin(&batch, device);
+    for (int i = 0; i < 10; i++) {
+        uint8_t value = 0xa0 + i;
+        // Queued writes are copies, the temporary can go
+        CHECK_EQ(i2c_batch_add_write(&batch, 0x10 + i, &value, 1), ESP_OK);
+    }
+    uint8_t pair[2] = { 0x5a, 0xa5 };
+    CHECK_EQ(i2c_batch_add_write(&batch, 0x30, pair, 2), ESP_OK);
+    CHECK_EQ(i2c_batch_commit(&batch), ESP_OK);
+    for (int i = 0; i < 10; i++) {
+        CHECK_EQ(imu.regs[0x10 + i], 0xa0 + i);
+    }
+    CHECK_EQ(imu.regs[0x30], 0x5a);
+    CHECK_EQ(imu.regs[0x31], 0xa5);
+
+    i2c_bus_stats_t stats;
+    i2c_get_stats(PORT, &stats);
+    CHECK_EQ(stats.bus_acquisitions, 1);
+    CHECK_EQ(stats.transactions, 1);
+    // Address, register and data for each
+    CHECK_EQ(stats.bytes_written, 10 * 3 + 4);
+    check_counts_agree();
+}
+
+static void test_replay(I2CDevice_t device) {
+    uint8_t data[5][2];
+    reset_counters();
+    imu.nack_reg = 0x44;
+
+    i2c_batch_t batch;
+    i2c_batch_begin(&batch, device);
+    i2c_batch_add_read(&batch, 0x3b, data[0], 2);
+    i2c_batch_add_write_byte(&batch, 0x20, 0x77);
+    i2c_batch_add_read(&batch, 0x41, data[2], 2);
+    i2c_batch_add_read(&batch, 0x44, data[3], 2);
+    i2c_batch_add_read(&batch, 0x47, data[4], 2);
+    CHECK(i2c_batch_commit(&batch) != ESP_OK);
+
+    // Replayed one by one up to the one that NACKed, the rest never ran
+    CHECK_EQ(i2c_batch_op_status(&batch, 0), ESP_OK);
+    CHECK_EQ(i2c_batch_op_status(&batch, 1), ESP_OK);
+    CHECK_EQ(i2c_batch_op_status(&batch, 2), ESP_OK);
+    CHECK(i2c_batch_op_status(&batch, 3) != ESP_OK);
+    CHECK_EQ(i2c_batch_op_status(&batch, 4), ESP_ERR_INVALID_STATE);
+    CHECK_EQ(i2c_batch_op_status(&batch, 5), ESP_ERR_INVALID_ARG);
+    CHECK_EQ(imu.regs[0x20], 0x77);
+
+    i2c_bus_stats_t stats;
+    i2c_get_stats(PORT, &stats);
+    CHECK_EQ(stats.bus_acquisitions, 1);
+    CHECK_EQ(stats.transactions, 1 + 4);
+    CHECK_EQ(stats.errors, 2);
+    // The driver counts the bytes it queued, the wire stops at the NACK,
+    // so only the transactions have to agree here
+    i2c_mock_stats_t wire;
+    i2c_mock_get_stats(PORT, &wire);
+    CHECK_EQ(wire.transactions, stats.transactions);
+    CHECK_EQ(wire.nacks, stats.errors);
+    imu.nack_reg = -1;
+}
+
+static void test_limits(I2CDevice_t device) {
+    uint8_t data[I2C_BATCH_WRITE_BUF_SIZE + 1] = {0};
+    i2c_batch_t batch;
+
+    i2c_batch_begin(&batch, device);
+    for (int i = 0; i < I2C_BATCH_MAX_OPS; i++) {
+        CHECK_EQ(i2c_batch_add_read(&batch, i, data, 1), ESP_OK);
+    }
+    CHECK_EQ(i2c_batch_add_read(&batch, 0, data, 1), ESP_ERR_NO_MEM);
+
+    i2c_batch_begin(&batch, device);
+    CHECK_EQ(i2c_batch_add_write(&batch, 0, data, I2C_BATCH_WRITE_BUF_SIZE + 1), ESP_ERR_NO_MEM);
+    CHECK_EQ(i2c_batch_add_write(&batch, 0, data, I2C_BATCH_WRITE_BUF_SIZE), ESP_OK);
+    CHECK_EQ(i2c_batch_add_write_byte(&batch, 0, 1), ESP_ERR_NO_MEM);
+
+    // An empty batch does not touch the bus
+    reset_counters();
+    i2c_batch_begin(&batch, device);
+    CHECK_EQ(i2c_batch_commit(&batch), ESP_OK);
+    i2c_bus_stats_t stats;
+    i2c_get_stats(PORT, &stats);
+    CHECK_EQ(stats.bus_acquisitions, 0);
+    CHECK_EQ(i2c_batch_begin(NULL, device), ESP_ERR_INVALID_ARG);
+}
+
+static void test_mpu6886_init(void) {
+    memset(imu.regs, 0, sizeof(imu.regs));
+    imu.regs[MPU6886_WHOAMI] = 0x19;
+    reset_counters();
+
+    CHECK_EQ(MPU6886_Init(), 0);
+    CHECK_EQ(imu.regs[MPU6886_ACCEL_CONFIG], 0x10);
+    CHECK_EQ(imu.regs[MPU6886_GYRO_CONFIG], 0x18);
+    CHECK_EQ(imu.regs[MPU6886_CONFIG], 0x01);
+    CHECK_EQ(imu.regs[MPU6886_SMPLRT_DIV], 0x05);
+    CHECK_EQ(imu.regs[MPU6886_INT_PIN_CFG], 0x22);
+    CHECK_EQ(imu.regs[MPU6886_INT_ENABLE], 0x01);
+    CHECK_EQ(imu.writes[MPU6886_INT_ENABLE], 2);
+    CHECK_EQ(imu.regs[MPU6886_PWR_MGMT_1], 0x01);
+
+    // WHOAMI, three power steps with settle times, then one batch for
+    // the ten config writes that used to take a transaction each
+    i2c_bus_stats_t stats;
+    i2c_get_stats(PORT, &stats);
+    CHECK_EQ(stats.bus_acquisitions, 5);
+    CHECK_EQ(stats.transactions, 5);
+    check_counts_agree();
+    fprintf(stderr, "MPU6886_Init: %u bus acquisitions, %u transactions, %u bytes written (14 of each unbatched)\n",
+            stats.bus_acquisitions, stats.transactions, stats.bytes_written);
+}
+
+static void test_axp192_current(void) {
+    // 0x7a/0x7b charge current, 0x7c/0x7d discharge current, 13 bits
+    pmu.regs[0x7a] = 0x12;
+    pmu.regs[0x7b] = 0x05;
+    pmu.regs[0x7c] = 0x02;
+    pmu.regs[0x7d] = 0x01;
+    reset_counters();
+    float current = Axp192_GetBatCurrent();
+    float expected = 0.5f * (float)(((0x12 << 5) | 0x05) - ((0x02 << 5) | 0x01));
+    CHECK(current == expected);
+
+    i2c_bus_stats_t stats;
+    i2c_get_stats(PORT, &stats);
+    CHECK_EQ(stats.bus_acquisitions, 1);
+    CHECK_EQ(stats.transactions, 1);
+    check_counts_agree();
+}
+
+int main(void) {
+    reg_model_init(&imu, MPU6886_ADDRESS);
+    reg_model_init(&pmu, AXP192_ADDR);
+    i2c_mock_attach(PORT, &imu.device);
+    i2c_mock_attach(PORT, &pmu.device);
+    Axp192_I2CInit();
+
+    I2CDevice_t device = i2c_malloc_device(PORT, GPIO_NUM_21, GPIO_NUM_22, 400000, MPU6886_ADDRESS);
+    CHECK(device != NULL);
+
+    test_reads(device);
+    test_writes(device);
+    test_replay(device);
+    test_limits(device);
+    test_mpu6886_init();
+    test_axp192_current();
+
+    i2c_free_device(device);
+    return host_test_result("i2c_batch_test");
+}
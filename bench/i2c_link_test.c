@@ -0,0 +1,141 @@
+/*
+ * Host test of how i2c_device.c builds its command links, compiled once
+ * against the ESP-IDF 4.2 driver API the project pins and once against
+ * 4.4, which added static links. The heap counters from measure.c show
+ * what each transfer allocates.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_idf_version.h"
+
+#include "i2c_device.h"
+
+#include "host_test.h"
+#include "measure.h"
+#include "reg_model.h"
+
+#define PORT I2C_NUM_0
+#define ADDR 0x52
+#define TRANSFERS 100
+
+static reg_model_t chip;
+
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 4, 0)
+#define STATIC_LINKS 1
+#else
+#define STATIC_LINKS 0
+#endif
+
+static void test_single_transfers(I2CDevice_t device) {
+    uint8_t data[4] = { 1, 2, 3, 4 };
+    i2c_reset_stats(PORT);
+    i2c_mock_reset_stats();
+
+    alloc_count_reset();
+    for (int i = 0; i < TRANSFERS; i++) {
+        CHECK_EQ(i2c_read_bytes(device, 0x10, data, 4), ESP_OK);
+        CHECK_EQ(i2c_write_bytes(device, 0x20, data, 2), ESP_OK);
+    }
+    alloc_count_t allocs = alloc_count_read();
+
+    i2c_bus_stats_t stats;
+    i2c_mock_stats_t wire;
+    i2c_get_stats(PORT, &stats);
+    i2c_mock_get_stats(0, &wire);
+    CHECK_EQ(stats.transactions, 2 * TRANSFERS);
+    CHECK_EQ(wire.live_links, 0);
+#if STATIC_LINKS
+    CHECK_EQ(allocs.calls, 0);
+    CHECK_EQ(stats.static_links, 2 * TRANSFERS);
+    CHECK_EQ(stats.link_allocs, 0);
+#else
+    // A descriptor and a node per command: START, address, register,
+    // START, address, two reads, STOP for the read, five for the write
+    CHECK_EQ(allocs.calls, wire.heap_links + wire.heap_commands);
+    CHECK_EQ(allocs.calls, TRANSFERS * (1 + 8 + 1 + 5));
+    CHECK_EQ(stats.static_links, 0);
+    CHECK_EQ(stats.link_allocs, 2 * TRANSFERS);
+#endif
+    fprintf(stderr, "ESP-IDF %d.%d: %.1f heap allocations per single transfer\n",
+            ESP_IDF_VERSION_MAJOR, ESP_IDF_VERSION_MINOR, (double)allocs.calls / (2 * TRANSFERS));
+}
+
+static void test_batch(I2CDevice_t device) {
+    uint8_t a[2], b[2];
+    i2c_reset_stats(PORT);
+    i2c_batch_t batch;
+    i2c_batch_begin(&batch, device);
+    i2c_batch_add_read(&batch, 0x10, a, 2);
+    i2c_batch_add_read(&batch, 0x12, b, 2);
+
+    alloc_count_reset();
+    CHECK_EQ(i2c_batch_commit(&batch), ESP_OK);
+    i2c_bus_stats_t stats;
+    i2c_get_stats(PORT, &stats);
+    // Batches are built on the heap with either driver
+    CHECK(alloc_count_read().calls > 0);
+    CHECK_EQ(stats.link_allocs, 1);
+    CHECK_EQ(stats.static_links, 0);
+}
+
+typedef struct {
+    I2CDevice_t device;
+    volatile bool done;
+} reader_t;
+
+static void *read_once(void *arg) {
+    reader_t *reader = arg;
+    uint8_t data[4];
+    CHECK_EQ(i2c_read_bytes(reader->device, 0x10, data, 4), ESP_OK);
+    reader->done = true;
+    return NULL;
+}
+
+// The link is built before the port mutex is taken, so a transfer that
+// has to wait for the bus has already done its allocating
+static void test_built_outside_lock(I2CDevice_t device) {
+    reader_t reader = { .device = device };
+    pthread_t thread;
+    i2c_mock_reset_stats();
+    CHECK(i2c_take_port(PORT, portMAX_DELAY) == pdTRUE);
+
+    alloc_count_reset();
+    pthread_create(&thread, NULL, read_once, &reader);
+    usleep(20000);
+    CHECK(!reader.done);
+    i2c_mock_stats_t wire;
+    i2c_mock_get_stats(0, &wire);
+    CHECK_EQ(wire.live_links, 1);
+    CHECK_EQ(wire.transactions, 0);
+#if !STATIC_LINKS
+    CHECK(alloc_count_read().calls > 0);
+#endif
+
+    i2c_free_port(PORT);
+    pthread_join(thread, NULL);
+    CHECK(reader.done);
+    i2c_mock_get_stats(0, &wire);
+    CHECK_EQ(wire.live_links, 0);
+}
+
+int main(void) {
+    reg_model_init(&chip, ADDR);
+    i2c_mock_attach(PORT, &chip.device);
+    I2CDevice_t device = i2c_malloc_device(PORT, GPIO_NUM_32, GPIO_NUM_33, 100000, ADDR);
+    CHECK(device != NULL);
+
+    test_single_transfers(device);
+    test_batch(device);
+    test_built_outside_lock(device);
+
+    i2c_free_device(device);
+#if STATIC_LINKS
+    return host_test_result("i2c_link_test (ESP-IDF 4.4)");
+#else
+    return host_test_result("i2c_link_test (ESP-IDF 4.2)");
+#endif
+}
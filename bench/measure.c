@@ -0,0 +1,120 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "measure.h"
+
+// Atomic, as the pipeline simulation allocates from several threads
+static alloc_count_t counts;
+
+static void tally(size_t bytes) {
+    __atomic_fetch_add(&counts.calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&counts.bytes, bytes, __ATOMIC_RELAXED);
+}
+
+// The real allocator, reached through the linker's --wrap
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+void *__wrap_malloc(size_t size) {
+    tally(size);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    tally(count * size);
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    tally(size);
+    return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr) {
+    __real_free(ptr);
+}
+
+void alloc_count_reset(void) {
+    memset(&counts, 0, sizeof(counts));
+}
+
+alloc_count_t alloc_count_read(void) {
+    return counts;
+}
+
+uint64_t measure_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+bool measure_reset_peak_rss(void) {
+    // Writing 5 resets VmHWM to the current RSS, since Linux 4.0
+    FILE *f = fopen("/proc/self/clear_refs", "w");
+    if (f == NULL) {
+        return false;
+    }
+    bool ok = fputs("5", f) >= 0;
+    return fclose(f) == 0 && ok;
+}
+
+uint64_t measure_peak_rss_kb(void) {
+    FILE *f = fopen("/proc/self/status", "r");
+    if (f == NULL) {
+        return 0;
+    }
+    char line[128];
+    unsigned long long kb = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "VmHWM: %llu kB", &kb) == 1) {
+            break;
+        }
+    }
+    fclose(f);
+    return kb;
+}
+
+// Quickselect rather than qsort(), which takes a scratch buffer as large
+// as the samples from the heap and would leave it in the next stage's RSS
+double measure_percentile(uint32_t *ns, size_t count, double p) {
+    if (count == 0) {
+        return 0.0;
+    }
+    const size_t rank = (size_t)(p / 100.0 * (double)(count - 1) + 0.5);
+    size_t lo = 0, hi = count - 1;
+    while (lo < hi) {
+        const uint32_t pivot = ns[lo + (hi - lo) / 2];
+        size_t i = lo, j = hi;
+        while (i <= j) {
+            while (ns[i] < pivot) {
+                i++;
+            }
+            while (ns[j] > pivot) {
+                j--;
+            }
+            if (i <= j) {
+                uint32_t t = ns[i];
+                ns[i] = ns[j];
+                ns[j] = t;
+                i++;
+                if (j == 0) {
+                    break;
+                }
+                j--;
+            }
+        }
+        if (rank <= j) {
+            hi = j;
+        } else if (rank >= i) {
+            lo = i;
+        } else {
+            break;
+        }
+    }
+    return ns[rank];
+}
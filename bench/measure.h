@@ -0,0 +1,60 @@
+/**
+ * @file measure.h
+ * @brief Timing, memory and allocation counters for the host benchmark.
+ *
+ * Allocations are counted by wrapping malloc() and friends at link time
+ * (`-Wl,--wrap=malloc`), so calls made by the code under test are seen
+ * without changing it. Peak RSS comes from /proc/self/status and is
+ * reset before each stage where the kernel allows it.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Allocation calls and bytes requested since the last reset.
+ */
+typedef struct {
+    uint64_t calls;
+    uint64_t bytes;
+} alloc_count_t;
+
+/**
+ * @brief Zeroes the allocation counters.
+ */
+void alloc_count_reset(void);
+
+/**
+ * @brief Reads the allocation counters.
+ */
+alloc_count_t alloc_count_read(void);
+
+/**
+ * @brief Monotonic time in nanoseconds.
+ */
+uint64_t measure_now_ns(void);
+
+/**
+ * @brief Resets the peak RSS to the current RSS.
+ *
+ * @return false if the kernel does not allow it, in which case
+ * measure_peak_rss_kb() reports the peak of the whole process.
+ */
+bool measure_reset_peak_rss(void);
+
+/**
+ * @brief Peak resident set size in KiB since the last reset, 0 if it
+ * cannot be read.
+ */
+uint64_t measure_peak_rss_kb(void);
+
+/**
+ * @brief Latency percentile of `count` samples, reordering them in
+ * place. Does not allocate.
+ *
+ * @param[in] p 0 to 100.
+ */
+double measure_percentile(uint32_t *ns, size_t count, double p);
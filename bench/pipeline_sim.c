@@ -0,0 +1,627 @@
+/*
+ * Host simulation of the device's analytics pipeline, with one thread
+ * per stage and the threads pinned to two CPUs standing in for PRO_CPU
+ * and APP_CPU. Stages are joined by the same spsc_queue_t the firmware
+ * uses and count themselves with pipeline_stage_t. Prints a JSON report;
+ * see README.md.
+ *
+ *   APP_CPU  sensing ----> features -----> classify ---> GUI
+ *                          (PRO_CPU)       (PRO_CPU) <-- GUI labels
+ *   APP_CPU                                   |
+ *            store <--------------------------+
+ *            save <---------------------------'
+ */
+
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "changepoint.h"
+#include "feature_extract.h"
+#include "online_model.h"
+#include "pipeline_stage.h"
+#include "spsc_queue.h"
+
+#include "measure.h"
+#include "trace.h"
+
+#define FEATURE_DIM (TRACE_CHANNELS * FEATURE_PER_CHANNEL)
+
+// The cores the firmware pins each stage to
+#define PRO_CPU 0
+#define APP_CPU 1
+
+// Queue lengths as in main/includes/gas_array.h and identify.h
+#define SAMPLE_QUEUE_LEN 32
+#define QUEUE_LEN 4
+#define HISTORY_LEN 4
+
+// A consumer with nothing to do sleeps this long before looking again,
+// where the firmware's tasks wait on a notification
+#define IDLE_NS 20000
+
+typedef struct {
+    float values[TRACE_CHANNELS];
+    uint32_t window;
+    uint16_t class_index;
+    uint64_t queued_ns;
+} sample_t;
+
+typedef struct {
+    float features[FEATURE_DIM];
+    uint16_t class_index;
+    uint64_t sensed_ns;     // when its last sample was queued
+    uint64_t queued_ns;
+} window_msg_t;
+
+typedef struct {
+    const char *label;      // NULL if unclassified
+    uint16_t truth;
+    uint32_t window_id;
+    uint64_t sensed_ns;
+} event_t;
+
+typedef struct {
+    char label[CLASSIFIER_LABEL_LEN];
+    uint32_t window_id;
+    uint64_t queued_ns;
+} record_t;
+
+typedef struct {
+    uint32_t windows;
+    uint32_t train;
+    uint16_t classes;
+    uint32_t seed;
+    uint32_t rate;
+    uint32_t store_us;
+    uint32_t save_us;
+    uint32_t learn_every;
+    uint32_t gui_period_us;
+    const char *trace_path;
+    const char *label;
+    const char *output;
+} options_t;
+
+static options_t options = {
+    .windows = 2000,
+    .train = 512,
+    .classes = 8,
+    .seed = 1,
+    .rate = 3200,
+    .store_us = 3000,
+    .save_us = 2000,
+    .learn_every = 8,
+    .gui_period_us = 10000,
+};
+static trace_t trace;
+static float standard_mean[FEATURE_DIM];
+static float standard_inv_std[FEATURE_DIM];
+
+static sample_t sample_slots[SAMPLE_QUEUE_LEN];
+static spsc_queue_t sample_queue;
+static window_msg_t window_slots[QUEUE_LEN];
+static spsc_queue_t window_queue;
+static record_t learn_slots[QUEUE_LEN];
+static spsc_queue_t learn_queue;
+static event_t event_slots[QUEUE_LEN];
+static spsc_queue_t event_queue;
+static record_t store_slots[QUEUE_LEN];
+static spsc_queue_t store_queue;
+static record_t save_slots[QUEUE_LEN];
+static spsc_queue_t save_queue;
+
+static pipeline_stage_t feature_stage;
+static pipeline_stage_t classify_stage;
+static pipeline_stage_t store_stage;
+static pipeline_stage_t save_stage;
+
+// How the threads know nothing more is coming: each finishes once the
+// ones before it have and its input is empty. The GUI is done once it has
+// the result of every window that was cut, and classification, which
+// takes its labels, only stops after that.
+static atomic_bool sensing_done, features_done, gui_done, classify_done;
+static atomic_uint windows_cut, windows_classified, events_pushed;
+// Labels that came after HISTORY_LEN newer windows, so were not learnt
+static atomic_uint labels_not_held;
+
+// Owned by the GUI thread
+static uint32_t *end_to_end_ns;
+static uint32_t *gui_late_ns;
+static uint32_t results, correct, gui_ticks;
+
+static void pin(int core) {
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpus > 0 ? core % cpus : 0, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static void sleep_ns(uint64_t ns) {
+    struct timespec ts = {.tv_sec = (time_t)(ns / 1000000000u), .tv_nsec = (long)(ns % 1000000000u)};
+    nanosleep(&ts, NULL);
+}
+
+static void sleep_until(uint64_t deadline_ns) {
+    const uint64_t now = measure_now_ns();
+    if (deadline_ns > now) {
+        sleep_ns(deadline_ns - now);
+    }
+}
+
+static uint32_t us_between(uint64_t from_ns, uint64_t to_ns) {
+    const uint64_t us = to_ns > from_ns ? (to_ns - from_ns) / 1000 : 0;
+    return us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+}
+
+// Sensing, on APP_CPU: one sample of every channel at a time, as the
+// scheduler job reads them. At a --rate, samples and windows that find
+// their queue full are dropped like on the device. At --rate 0 sensing
+// and features wait for room instead, so the run measures how fast the
+// pipeline goes; results the GUI has no room for are still dropped, as
+// it only ever wants the newest.
+static void *sensing_thread(void *arg) {
+    pin(APP_CPU);
+    float rows[TRACE_CHANNELS][TRACE_FRAME_LEN];
+    const uint64_t start_ns = measure_now_ns();
+    uint64_t n = 0;
+    for (uint32_t w = 0; w < options.windows; w++) {
+        const uint16_t c = trace_window(&trace, w, rows);
+        for (int t = 0; t < TRACE_FRAME_LEN; t++, n++) {
+            sample_t sample = {.window = w, .class_index = c};
+            for (int ch = 0; ch < TRACE_CHANNELS; ch++) {
+                sample.values[ch] = rows[ch][t];
+            }
+            if (options.rate > 0) {
+                sleep_until(start_ns + n * 1000000000u / options.rate);
+                sample.queued_ns = measure_now_ns();
+                spsc_queue_push(&sample_queue, &sample);
+                continue;
+            }
+            sample.queued_ns = measure_now_ns();
+            while (spsc_queue_depth(&sample_queue) == SAMPLE_QUEUE_LEN) {
+                sleep_ns(IDLE_NS);
+            }
+            spsc_queue_push(&sample_queue, &sample);
+        }
+    }
+    atomic_store(&sensing_done, true);
+    return NULL;
+}
+
+// Features, on PRO_CPU: change-point detection on every sample, and the
+// features of each window once its last sample is in. The synthetic
+// windows are already aligned to the onset, so every window is cut.
+static void *feature_thread(void *arg) {
+    pin(PRO_CPU);
+    changepoint_t detectors[TRACE_CHANNELS];
+    for (int ch = 0; ch < TRACE_CHANNELS; ch++) {
+        changepoint_config_t config = CHANGEPOINT_CONFIG_DEFAULT(2.0f);
+        changepoint_init(&detectors[ch], &config);
+    }
+    feature_plan_t plan;
+    if (feature_plan_init(&plan, TRACE_FRAME_LEN, TRACE_SAMPLE_PERIOD_S) != 0) {
+        atomic_store(&features_done, true);
+        return NULL;
+    }
+    float rows[TRACE_CHANNELS][TRACE_FRAME_LEN];
+    uint32_t current = UINT32_MAX;
+    int filled = 0;
+
+    for (;;) {
+        sample_t sample;
+        if (!spsc_queue_pop(&sample_queue, &sample)) {
+            if (atomic_load(&sensing_done) && spsc_queue_depth(&sample_queue) == 0) {
+                break;
+            }
+            sleep_ns(IDLE_NS);
+            continue;
+        }
+        const uint64_t start_ns = measure_now_ns();
+        if (sample.window != current) {
+            current = sample.window;
+            filled = 0;
+        }
+        for (int ch = 0; ch < TRACE_CHANNELS; ch++) {
+            changepoint_update(&detectors[ch], sample.values[ch]);
+            rows[ch][filled] = sample.values[ch];
+        }
+        if (++filled == TRACE_FRAME_LEN) {
+            window_msg_t window = {.class_index = sample.class_index, .sensed_ns = sample.queued_ns};
+            for (int ch = 0; ch < TRACE_CHANNELS; ch++) {
+                feature_extract(&plan, rows[ch], &window.features[ch * FEATURE_PER_CHANNEL]);
+            }
+            window.queued_ns = measure_now_ns();
+            while (options.rate == 0 && spsc_queue_depth(&window_queue) == QUEUE_LEN) {
+                sleep_ns(IDLE_NS);
+            }
+            if (spsc_queue_push(&window_queue, &window)) {
+                atomic_fetch_add(&windows_cut, 1);
+            }
+        }
+        pipeline_stage_record(&feature_stage, us_between(sample.queued_ns, start_ns),
+                              us_between(start_ns, measure_now_ns()));
+    }
+    feature_plan_free(&plan);
+    atomic_store(&features_done, true);
+    return NULL;
+}
+
+// Classification, on PRO_CPU. Labels from the GUI are learnt first, with
+// the features of the window they name, and passed on to the store and
+// save stages, as on the device. A window never labelled is saved when a
+// newer one takes its slot.
+static void *classify_thread(void *arg) {
+    pin(PRO_CPU);
+    online_model_t *model = arg;
+    static float held[HISTORY_LEN][FEATURE_DIM];
+    uint32_t held_id[HISTORY_LEN] = {0};
+    bool held_unsaved[HISTORY_LEN] = {false};
+    bool held_learned[HISTORY_LEN] = {false};
+    uint32_t next_window_id = 1;
+
+    for (;;) {
+        record_t request;
+        window_msg_t window;
+        uint64_t start_ns, queued_ns;
+        if (spsc_queue_pop(&learn_queue, &request)) {
+            start_ns = measure_now_ns();
+            queued_ns = request.queued_ns;
+            const uint32_t slot = request.window_id % HISTORY_LEN;
+            if (held_id[slot] == request.window_id && !held_learned[slot]) {
+                held_learned[slot] = true;
+                online_model_update(model, request.label, held[slot], NULL);
+                request.queued_ns = measure_now_ns();
+                spsc_queue_push(&store_queue, &request);
+                if (held_unsaved[slot]) {
+                    spsc_queue_push(&save_queue, &request);
+                    held_unsaved[slot] = false;
+                }
+            } else if (held_id[slot] != request.window_id) {
+                atomic_fetch_add(&labels_not_held, 1);
+            }
+        } else if (spsc_queue_pop(&window_queue, &window)) {
+            start_ns = measure_now_ns();
+            queued_ns = window.queued_ns;
+            classifier_result_t result;
+            event_t event = {.truth = window.class_index, .window_id = next_window_id++, .sensed_ns = window.sensed_ns};
+            if (online_model_classify(model, window.features, &result) == 0) {
+                event.label = result.label;
+            }
+            const uint32_t slot = event.window_id % HISTORY_LEN;
+            if (held_unsaved[slot]) {
+                record_t record = {.window_id = held_id[slot], .queued_ns = measure_now_ns()};
+                spsc_queue_push(&save_queue, &record);
+            }
+            held_id[slot] = event.window_id;
+            held_unsaved[slot] = true;
+            held_learned[slot] = false;
+            memcpy(held[slot], window.features, sizeof(held[0]));
+            if (spsc_queue_push(&event_queue, &event)) {
+                atomic_fetch_add(&events_pushed, 1);
+            }
+            atomic_fetch_add(&windows_classified, 1);
+        } else if (atomic_load(&gui_done)) {
+            break;
+        } else {
+            sleep_ns(IDLE_NS);
+            continue;
+        }
+        pipeline_stage_record(&classify_stage, us_between(queued_ns, start_ns),
+                              us_between(start_ns, measure_now_ns()));
+    }
+    atomic_store(&classify_done, true);
+    return NULL;
+}
+
+// Adding to the fingerprint collection, on APP_CPU below the GUI:
+// --store-us stands in for fp_store_add(), spent asleep as a task
+// waiting on a flash write would be
+static void *store_thread(void *arg) {
+    pin(APP_CPU);
+    for (;;) {
+        record_t record;
+        if (!spsc_queue_pop(&store_queue, &record)) {
+            if (atomic_load(&classify_done) && spsc_queue_depth(&store_queue) == 0) {
+                break;
+            }
+            sleep_ns(IDLE_NS);
+            continue;
+        }
+        const uint64_t start_ns = measure_now_ns();
+        if (options.store_us > 0) {
+            sleep_ns((uint64_t)options.store_us * 1000);
+        }
+        pipeline_stage_record(&store_stage, us_between(record.queued_ns, start_ns),
+                              us_between(start_ns, measure_now_ns()));
+    }
+    return NULL;
+}
+
+// Saving recordings, on APP_CPU below the GUI: --save-us stands in for
+// writing one to the SD card, spent asleep as a task waiting on the SPI
+// bus would be
+static void *save_thread(void *arg) {
+    pin(APP_CPU);
+    for (;;) {
+        record_t record;
+        if (!spsc_queue_pop(&save_queue, &record)) {
+            if (atomic_load(&classify_done) && spsc_queue_depth(&save_queue) == 0) {
+                break;
+            }
+            sleep_ns(IDLE_NS);
+            continue;
+        }
+        const uint64_t start_ns = measure_now_ns();
+        if (options.save_us > 0) {
+            sleep_ns((uint64_t)options.save_us * 1000);
+        }
+        pipeline_stage_record(&save_stage, us_between(record.queued_ns, start_ns),
+                              us_between(start_ns, measure_now_ns()));
+    }
+    return NULL;
+}
+
+// The GUI, on APP_CPU: wakes every --gui-period-us like the firmware's
+// guiTask, takes results off the pipeline and now and then labels one.
+// How late each tick runs is what the pipeline must never make worse.
+static void *gui_thread(void *arg) {
+    pin(APP_CPU);
+    const uint64_t period_ns = (uint64_t)options.gui_period_us * 1000;
+    uint64_t deadline = measure_now_ns() + period_ns;
+    const size_t late_capacity = *(size_t *)arg;
+    for (;;) {
+        // windows_classified first: events_pushed is raised before it
+        if (atomic_load(&features_done) && atomic_load(&windows_classified) == atomic_load(&windows_cut)
+            && results == atomic_load(&events_pushed)) {
+            break;
+        }
+        sleep_until(deadline);
+        const uint64_t now = measure_now_ns();
+        if (gui_ticks < late_capacity) {
+            gui_late_ns[gui_ticks] = now > deadline ? (uint32_t)(now - deadline < UINT32_MAX ? now - deadline : UINT32_MAX) : 0;
+        }
+        gui_ticks++;
+        deadline += period_ns;
+        if (deadline < now) {
+            deadline = now + period_ns;     // skipped ticks are not made up
+        }
+
+        event_t event;
+        while (spsc_queue_pop(&event_queue, &event)) {
+            const uint64_t ns = now - event.sensed_ns;
+            end_to_end_ns[results] = ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+            results++;
+            correct += event.label != NULL && strcmp(event.label, trace.labels[event.truth]) == 0;
+            if (options.learn_every > 0 && results % options.learn_every == 0) {
+                record_t request = {.window_id = event.window_id, .queued_ns = measure_now_ns()};
+                snprintf(request.label, sizeof(request.label), "%s", trace.labels[event.truth]);
+                spsc_queue_push(&learn_queue, &request);
+            }
+        }
+    }
+    atomic_store(&gui_done, true);
+    return NULL;
+}
+
+static int train_model(online_model_t *model) {
+    feature_plan_t plan;
+    float (*features)[FEATURE_DIM] = malloc((size_t)options.train * sizeof(*features));
+    uint16_t *classes = malloc((size_t)options.train * sizeof(uint16_t));
+    if (features == NULL || classes == NULL || feature_plan_init(&plan, TRACE_FRAME_LEN, TRACE_SAMPLE_PERIOD_S) != 0) {
+        free(features);
+        free(classes);
+        return -1;
+    }
+    float rows[TRACE_CHANNELS][TRACE_FRAME_LEN];
+    for (uint32_t n = 0; n < options.train; n++) {
+        // From the top of the index range, so never a window that is run
+        classes[n] = trace_window(&trace, 0x80000000u + n, rows);
+        for (int ch = 0; ch < TRACE_CHANNELS; ch++) {
+            feature_extract(&plan, rows[ch], &features[n][ch * FEATURE_PER_CHANNEL]);
+        }
+    }
+    feature_plan_free(&plan);
+
+    for (int i = 0; i < FEATURE_DIM; i++) {
+        double sum = 0.0, sum_sq = 0.0;
+        for (uint32_t n = 0; n < options.train; n++) {
+            sum += features[n][i];
+        }
+        const double mean = sum / options.train;
+        for (uint32_t n = 0; n < options.train; n++) {
+            sum_sq += (features[n][i] - mean) * (features[n][i] - mean);
+        }
+        standard_mean[i] = (float)mean;
+        standard_inv_std[i] = sum_sq > 1e-12 ? (float)(1.0 / sqrt(sum_sq / options.train)) : 0.0f;
+    }
+
+    int err = online_model_init(model, FEATURE_DIM, CLASSIFIER_MAX_CLASSES, standard_mean, standard_inv_std);
+    for (uint32_t n = 0; n < options.train && err == 0; n++) {
+        err = online_model_update(model, trace.labels[classes[n]], features[n], NULL);
+    }
+    free(features);
+    free(classes);
+    return err;
+}
+
+static void write_stage(FILE *out, const pipeline_stage_t *stage, int core, const char *sep) {
+    pipeline_stage_stats_t s;
+    pipeline_stage_read(stage, &s);
+    fprintf(stderr, "%-9s core %d %8u items  wait %6u/%7u us  busy %6u/%7u us  queue max %2u/%-2u  %u dropped\n",
+            s.name, core, s.items, s.wait_mean_us, s.wait_max_us, s.busy_mean_us, s.busy_max_us,
+            s.high_water, s.capacity, s.dropped);
+    fprintf(out, "%s    {\"name\": \"%s\", \"core\": %d, \"items\": %u, \"wait_mean_us\": %u, \"wait_max_us\": %u, "
+            "\"busy_mean_us\": %u, \"busy_max_us\": %u, \"queue_high_water\": %u, \"queue_capacity\": %u, "
+            "\"dropped\": %u}",
+            sep, s.name, core, s.items, s.wait_mean_us, s.wait_max_us, s.busy_mean_us, s.busy_max_us,
+            s.high_water, s.capacity, s.dropped);
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -n, --windows N        windows through the pipeline, default %u\n"
+            "  -c, --classes K        synthetic smells, default %u\n"
+            "  -t, --train N          training windows for the classifier, default %u\n"
+            "  -s, --seed S           synthetic trace seed, default %u\n"
+            "  -r, --trace FILE       replay a recorded CSV or binary trace instead\n"
+            "      --rate HZ          samples per second, 0 as fast as they are taken, default %u\n"
+            "      --store-us US      time each add to the collection takes, default %u\n"
+            "      --save-us US       time each recording takes to save, default %u\n"
+            "      --learn-every N    label every Nth result, 0 never, default %u\n"
+            "      --gui-period-us US GUI tick, default %u\n"
+            "  -l, --label TEXT       recorded in the report, such as a commit\n"
+            "  -o, --output FILE      write the report there instead of stdout\n",
+            argv0, options.windows, options.classes, options.train, options.seed, options.rate, options.store_us,
+            options.save_us, options.learn_every, options.gui_period_us);
+}
+
+int main(int argc, char **argv) {
+    static const struct option long_options[] = {
+        {"windows", required_argument, NULL, 'n'},
+        {"classes", required_argument, NULL, 'c'},
+        {"train", required_argument, NULL, 't'},
+        {"seed", required_argument, NULL, 's'},
+        {"trace", required_argument, NULL, 'r'},
+        {"rate", required_argument, NULL, 'R'},
+        {"store-us", required_argument, NULL, 'S'},
+        {"save-us", required_argument, NULL, 'W'},
+        {"learn-every", required_argument, NULL, 'L'},
+        {"gui-period-us", required_argument, NULL, 'G'},
+        {"label", required_argument, NULL, 'l'},
+        {"output", required_argument, NULL, 'o'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:c:t:s:r:l:o:h", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'n': options.windows = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'c': options.classes = (uint16_t)strtoul(optarg, NULL, 0); break;
+        case 't': options.train = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 's': options.seed = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'r': options.trace_path = optarg; break;
+        case 'R': options.rate = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'S': options.store_us = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'W': options.save_us = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'L': options.learn_every = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'G': options.gui_period_us = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'l': options.label = optarg; break;
+        case 'o': options.output = optarg; break;
+        default: usage(argv[0]); return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (options.windows == 0 || options.train == 0 || options.gui_period_us == 0) {
+        fprintf(stderr, "--windows, --train and --gui-period-us must be positive\n");
+        return 2;
+    }
+
+    if (options.trace_path != NULL ? trace_replay(&trace, options.trace_path) != 0
+                                   : trace_synthetic(&trace, options.classes, options.seed) != 0) {
+        fprintf(stderr, "no trace: %s\n", options.trace_path != NULL ? options.trace_path : "bad --classes");
+        return 1;
+    }
+    online_model_t model;
+    if (train_model(&model) != 0) {
+        fprintf(stderr, "training failed\n");
+        return 1;
+    }
+
+    spsc_queue_init(&sample_queue, sample_slots, sizeof(sample_t), SAMPLE_QUEUE_LEN);
+    spsc_queue_init(&window_queue, window_slots, sizeof(window_msg_t), QUEUE_LEN);
+    spsc_queue_init(&learn_queue, learn_slots, sizeof(record_t), QUEUE_LEN);
+    spsc_queue_init(&event_queue, event_slots, sizeof(event_t), QUEUE_LEN);
+    spsc_queue_init(&store_queue, store_slots, sizeof(record_t), QUEUE_LEN);
+    spsc_queue_init(&save_queue, save_slots, sizeof(record_t), QUEUE_LEN);
+    pipeline_stage_init(&feature_stage, "features", &sample_queue);
+    pipeline_stage_init(&classify_stage, "classify", &window_queue);
+    pipeline_stage_init(&store_stage, "store", &store_queue);
+    pipeline_stage_init(&save_stage, "save", &save_queue);
+
+    // Ticks the run should take, with room for it to run long
+    const double expected_s = options.rate > 0 ? (double)options.windows * TRACE_FRAME_LEN / options.rate : 0.0;
+    size_t late_capacity = (size_t)(expected_s * 1e6 / options.gui_period_us) * 2 + options.windows + 1024;
+    end_to_end_ns = calloc(options.windows, sizeof(uint32_t));
+    gui_late_ns = calloc(late_capacity, sizeof(uint32_t));
+    if (end_to_end_ns == NULL || gui_late_ns == NULL) {
+        fprintf(stderr, "no memory for %u windows\n", options.windows);
+        return 1;
+    }
+
+    alloc_count_reset();
+    const uint64_t start_ns = measure_now_ns();
+    pthread_t threads[6];
+    pthread_create(&threads[0], NULL, gui_thread, &late_capacity);
+    pthread_create(&threads[1], NULL, save_thread, NULL);
+    pthread_create(&threads[2], NULL, store_thread, NULL);
+    pthread_create(&threads[3], NULL, classify_thread, &model);
+    pthread_create(&threads[4], NULL, feature_thread, NULL);
+    pthread_create(&threads[5], NULL, sensing_thread, NULL);
+    for (int i = 5; i >= 0; i--) {
+        pthread_join(threads[i], NULL);
+    }
+    const double seconds = (measure_now_ns() - start_ns) / 1e9;
+    const alloc_count_t allocs = alloc_count_read();
+
+    const uint32_t ticks = gui_ticks < late_capacity ? gui_ticks : (uint32_t)late_capacity;
+    const double e2e_p50 = measure_percentile(end_to_end_ns, results, 50.0) / 1e3;
+    const double e2e_p99 = measure_percentile(end_to_end_ns, results, 99.0) / 1e3;
+    const double late_p50 = measure_percentile(gui_late_ns, ticks, 50.0) / 1e3;
+    const double late_p99 = measure_percentile(gui_late_ns, ticks, 99.0) / 1e3;
+    const double late_max = measure_percentile(gui_late_ns, ticks, 100.0) / 1e3;
+
+    FILE *out = options.output != NULL ? fopen(options.output, "w") : stdout;
+    if (out == NULL) {
+        fprintf(stderr, "cannot write %s\n", options.output);
+        return 1;
+    }
+    fprintf(out, "{\n");
+    fprintf(out, "  \"label\": \"%s\",\n", options.label != NULL ? options.label : "");
+    fprintf(out, "  \"windows\": %u,\n", options.windows);
+    fprintf(out, "  \"trace\": \"%s\",\n", options.trace_path != NULL ? options.trace_path : "synthetic");
+    fprintf(out, "  \"rate\": %u,\n", options.rate);
+    fprintf(out, "  \"cpus\": %ld,\n", sysconf(_SC_NPROCESSORS_ONLN));
+    fprintf(out, "  \"seconds\": %.6f,\n", seconds);
+    fprintf(out, "  \"windows_per_s\": %.1f,\n", atomic_load(&windows_classified) / seconds);
+    fprintf(out, "  \"results\": %u,\n", results);
+    fprintf(out, "  \"results_dropped\": %u,\n", spsc_queue_dropped(&event_queue));
+    fprintf(out, "  \"accuracy\": %.4f,\n", results > 0 ? (double)correct / results : 0.0);
+    fprintf(out, "  \"end_to_end_p50_us\": %.2f,\n", e2e_p50);
+    fprintf(out, "  \"end_to_end_p99_us\": %.2f,\n", e2e_p99);
+    fprintf(out, "  \"gui_ticks\": %u,\n", gui_ticks);
+    fprintf(out, "  \"gui_late_p50_us\": %.2f,\n", late_p50);
+    fprintf(out, "  \"gui_late_p99_us\": %.2f,\n", late_p99);
+    fprintf(out, "  \"gui_late_max_us\": %.2f,\n", late_max);
+    fprintf(out, "  \"labels_not_held\": %u,\n", atomic_load(&labels_not_held));
+    fprintf(out, "  \"allocs\": %llu,\n", (unsigned long long)allocs.calls);
+    fprintf(out, "  \"stages\": [");
+    write_stage(out, &feature_stage, PRO_CPU, "\n");
+    write_stage(out, &classify_stage, PRO_CPU, ",\n");
+    write_stage(out, &store_stage, APP_CPU, ",\n");
+    write_stage(out, &save_stage, APP_CPU, ",\n");
+    fprintf(out, "\n  ]\n}\n");
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    fprintf(stderr, "%u windows classified in %.2f s, %.0f/s; %u results to the GUI, %u dropped, accuracy %.3f\n",
+            atomic_load(&windows_classified), seconds, atomic_load(&windows_classified) / seconds, results,
+            spsc_queue_dropped(&event_queue), results > 0 ? (double)correct / results : 0.0);
+    fprintf(stderr, "sensed to GUI p50 %.1f us p99 %.1f us; GUI tick late p50 %.1f us p99 %.1f us max %.1f us\n",
+            e2e_p50, e2e_p99, late_p50, late_p99, late_max);
+
+    free(end_to_end_ns);
+    free(gui_late_ns);
+    online_model_free(&model);
+    trace_free(&trace);
+    return 0;
+}
@@ -0,0 +1,327 @@
+/*
+ * Host test of the job scheduler in components/core2forAWS/scheduler.
+ * The timer wheel alone runs a minute of the firmware's jobs on a fake
+ * clock. The scheduler task then runs on host threads with the real
+ * SGP30 and FT6336U jobs, against the sensor model and a register file
+ * on the mock bus: neither may hold the task while it waits for the
+ * sensor or the bus, which shows in a 10 ms job's jitter.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "esp_timer.h"
+
+#include "ft6336u.h"
+#include "i2c_async.h"
+#include "i2c_device.h"
+#include "scheduler.h"
+#include "sgp30.h"
+
+#include "host_test.h"
+#include "reg_model.h"
+#include "sgp30_model.h"
+
+#define TICK_US (portTICK_PERIOD_MS * 1000)
+#define TOUCH_ADDR 0x38
+#define TOUCH_INTR_PIN 39
+#define IMU_ADDR 0x68
+
+int64_t timekeeping_now_us(void) {
+    return esp_timer_get_time();
+}
+
+static void noop(sched_job_t *job, void *arg) {
+}
+
+/*
+    A minute of the firmware's jobs on the wheel alone, woken in whole
+    ticks as the task is. Jobs with room in their deadline share wakeups,
+    and none drifts off its phase.
+*/
+static void test_wheel_fake_clock(void) {
+    sched_job_t jobs[] = {
+        { .name = "button", .fn = noop, .period_us = 20000, .deadline_us = 10000 },
+        { .name = "touch", .fn = noop, .period_us = 20000, .deadline_us = 10000 },
+        { .name = "array", .fn = noop, .period_us = 100000, .deadline_us = 50000 },
+        { .name = "sgp30", .fn = noop, .period_us = 1000000, .deadline_us = 20000 },
+    };
+    const int count = sizeof(jobs) / sizeof(jobs[0]);
+    const int64_t start_us = 5000, end_us = start_us + 60000000;
+    sched_wheel_t wheel;
+    sched_wheel_init(&wheel, TICK_US, start_us);
+    for (int i = 0; i < count; i++) {
+        sched_wheel_add(&wheel, &jobs[i], start_us + jobs[i].period_us);
+    }
+
+    uint32_t wakeups = 0, runs = 0;
+    int64_t now_us = start_us;
+    while (now_us < end_us) {
+        int64_t wake_us = sched_wheel_next_wake(&wheel);
+        // The task sleeps in whole ticks, rounded down
+        now_us = wake_us - (wake_us - now_us) % TICK_US;
+        if (now_us <= start_us) {
+            now_us = wake_us;
+        }
+        sched_job_t *expired = sched_wheel_expire(&wheel, now_us);
+        if (expired == NULL) {
+            now_us = wake_us;
+            expired = sched_wheel_expire(&wheel, now_us);
+        }
+        wakeups++;
+        while (expired != NULL) {
+            sched_job_t *job = expired;
+            expired = job->next;
+            sched_wheel_complete(&wheel, job, now_us, now_us, true);
+            runs++;
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        CHECK_EQ(jobs[i].stats.overruns, 0);
+        CHECK_EQ(jobs[i].stats.skipped, 0);
+        CHECK(jobs[i].stats.runs >= 60000000 / jobs[i].period_us - 1);
+        CHECK_EQ((jobs[i].due_us - start_us) % jobs[i].period_us, 0);
+    }
+    CHECK(wakeups < runs * 3 / 4);
+    fprintf(stderr, "wheel: %u runs in %u wakeups over a minute\n", runs, wakeups);
+}
+
+// Three steps, each run 15 ms after the last one ended
+static int64_t step_us[4];
+static int steps;
+
+static void stepper(sched_job_t *job, void *arg) {
+    if (steps < 4) {
+        step_us[steps] = esp_timer_get_time();
+    }
+    steps++;
+    if (steps < 3) {
+        scheduler_rerun_current(15000);
+    }
+}
+
+static void test_rerun(void) {
+    static sched_job_t job = { .name = "stepper", .fn = stepper, .deadline_us = 5000 };
+    CHECK_EQ(scheduler_add(&job, 0), ESP_OK);
+    usleep(200000);
+    CHECK_EQ(steps, 3);
+    for (int i = 1; i < 3; i++) {
+        CHECK(step_us[i] - step_us[i - 1] >= 15000);
+    }
+    sched_job_stats_t stats;
+    scheduler_get_job_stats(&job, &stats);
+    CHECK_EQ(stats.runs, 3);
+
+    // Once it stops asking, a one-shot job is done until added again
+    CHECK_EQ(scheduler_add(&job, 0), ESP_OK);
+    usleep(100000);
+    CHECK_EQ(steps, 4);
+}
+
+// Runs every tick with a tight deadline, to see who holds the task.
+// Host delays end on a tick boundary, so up to a tick or so of its
+// jitter is the host's own.
+#define TICKER_JITTER_US (2 * TICK_US)
+
+static volatile bool ticker_on;
+
+static void tick(sched_job_t *job, void *arg) {
+    if (!ticker_on) {
+        scheduler_stop_current();
+    }
+}
+
+static sched_job_t ticker = { .name = "ticker", .fn = tick, .period_us = TICK_US, .deadline_us = TICK_US };
+
+static void ticker_run(sched_job_stats_t *stats, uint32_t ms) {
+    memset(&ticker.stats, 0, sizeof(ticker.stats));
+    ticker_on = true;
+    CHECK_EQ(scheduler_add(&ticker, TICK_US), ESP_OK);
+    usleep(ms * 1000);
+    scheduler_get_job_stats(&ticker, stats);
+    ticker_on = false;
+    usleep(3 * TICK_US);
+}
+
+// What the SGP30 job did before: the whole burst in one run, sleeping
+// through both conversions
+static volatile bool burst_on;
+
+static void blocking_burst(sched_job_t *job, void *arg) {
+    sgp30_sample_t sample;
+    SGP30_MeasureBurst(&sample);
+    if (!burst_on) {
+        scheduler_stop_current();
+    }
+}
+
+static bool env_source(float *temperature_c, float *humidity_rh) {
+    *temperature_c = 25.0f;
+    *humidity_rh = 50.0f;
+    return true;
+}
+
+static void test_sgp30_jobs(sgp30_model_t *model, I2CDevice_t device) {
+    sched_job_stats_t blocking, chained;
+    CHECK_EQ(SGP30_Init(device), ESP_OK);
+
+    static sched_job_t burst = { .name = "burst", .fn = blocking_burst, .period_us = 200000, .deadline_us = 20000 };
+    burst_on = true;
+    CHECK_EQ(scheduler_add(&burst, 0), ESP_OK);
+    ticker_run(&blocking, 1000);
+    burst_on = false;
+    usleep(250000);
+
+    SGP30_SetEnvSource(env_source);
+    sgp30_ring_t *ring = SGP30_GetRing();
+    uint32_t published = sgp30_ring_count(ring);
+    uint32_t early = model->early_reads, humidity_sets = model->humidity_sets;
+    CHECK_EQ(SGP30_Start(), ESP_OK);
+    ticker_run(&chained, 3500);
+
+    // A sample a second, each read only once its conversion is done,
+    // and the humidity sent after the first
+    CHECK_EQ(sgp30_ring_count(ring) - published, 3);
+    CHECK_EQ(model->early_reads, early);
+    CHECK_EQ(model->humidity_sets, humidity_sets + 1);
+    CHECK_EQ(model->humidity, (SGP30_AbsoluteHumidity(25.0f, 50.0f) * 256 + 500) / 1000);
+    sgp30_sample_t sample;
+    CHECK_EQ(sgp30_ring_latest(ring, &sample, 1), 1);
+    CHECK_EQ(sample.tvoc, model->tvoc);
+    CHECK_EQ(sample.eco2, model->eco2);
+    CHECK_EQ(sample.raw_h2, model->raw_h2);
+    CHECK_EQ(sample.raw_ethanol, model->raw_ethanol);
+
+    // measure_iaq and measure_raw are 12 and 25 ms of conversion, which
+    // the blocking burst holds the task for
+    CHECK(blocking.jitter_max_us >= 30000);
+    CHECK(chained.jitter_max_us < TICKER_JITTER_US);
+    fprintf(stderr, "sgp30: a 10 ms job's jitter max %5u us next to the chained reads, %5u us next to a blocking burst\n",
+            chained.jitter_max_us, blocking.jitter_max_us);
+}
+
+static reg_model_t touch_chip, imu_chip;
+static I2CDevice_t touch, imu;
+static volatile bool load_done;
+
+static void *load_task(void *arg) {
+    uint8_t data[16];
+    while (!load_done) {
+        i2c_read_bytes(imu, 0x00, data, sizeof(data));
+    }
+    return NULL;
+}
+
+// What the touch job did before: wait on the bus task for the read
+static volatile bool waiting_on;
+
+static void waiting_touch(sched_job_t *job, void *arg) {
+    static uint8_t buff[5];
+    static i2c_async_req_t req;
+    req = (i2c_async_req_t){
+        .device = touch,
+        .reg_addr = 0x02,
+        .data = buff,
+        .length = 5,
+        .is_read = true,
+        .priority = I2C_ASYNC_PRIO_HIGH,
+    };
+    i2c_async_transfer(&req, portMAX_DELAY);
+    if (!waiting_on) {
+        scheduler_stop_current();
+    }
+}
+
+/*
+    The bus is slowed to 1 ms a byte, so an IMU read in flight holds it
+    for 19 ms, and two tasks keep one in flight. A touch read queued
+    behind it must not hold the scheduler task.
+*/
+static void test_touch_job(void) {
+    sched_job_stats_t waiting, polled;
+    reg_model_init(&touch_chip, TOUCH_ADDR);
+    reg_model_init(&imu_chip, IMU_ADDR);
+    i2c_mock_attach(I2C_NUM_1, &touch_chip.device);
+    i2c_mock_attach(I2C_NUM_1, &imu_chip.device);
+    touch = i2c_malloc_device(I2C_NUM_1, GPIO_NUM_21, GPIO_NUM_22, 400000, TOUCH_ADDR);
+    imu = i2c_malloc_device(I2C_NUM_1, GPIO_NUM_21, GPIO_NUM_22, 400000, IMU_ADDR);
+    CHECK_EQ(i2c_async_init(6, 0), ESP_OK);
+    FT6336U_Init();
+    usleep(50000);
+    CHECK(!FT6336U_WasPressed());
+
+    pthread_t loaders[2];
+    i2c_mock_set_byte_time(I2C_NUM_1, 1000000);
+    load_done = false;
+    for (int i = 0; i < 2; i++) {
+        pthread_create(&loaders[i], NULL, load_task, NULL);
+    }
+
+    static sched_job_t waiter = { .name = "waiting_touch", .fn = waiting_touch, .period_us = 20000, .deadline_us = 10000 };
+    waiting_on = true;
+    CHECK_EQ(scheduler_add(&waiter, 0), ESP_OK);
+    ticker_run(&waiting, 1000);
+    waiting_on = false;
+    usleep(100000);
+
+    // A finger down at (300, 200)
+    uint32_t reads = touch_chip.reads[0x02];
+    touch_chip.regs[0x02] = 1;
+    touch_chip.regs[0x03] = 300 >> 8;
+    touch_chip.regs[0x04] = 300 & 0xff;
+    touch_chip.regs[0x05] = 200 >> 8;
+    touch_chip.regs[0x06] = 200 & 0xff;
+    host_gpio_interrupt(TOUCH_INTR_PIN);
+    ticker_run(&polled, 1000);
+
+    uint16_t x, y;
+    bool pressed;
+    FT6336U_GetTouch(&x, &y, &pressed);
+    CHECK(pressed);
+    CHECK_EQ(x, 300);
+    CHECK_EQ(y, 200);
+    // One read at a time, each waiting out the IMU read in flight
+    uint32_t touch_reads = touch_chip.reads[0x02] - reads;
+    CHECK(touch_reads >= 20);
+
+    load_done = true;
+    for (int i = 0; i < 2; i++) {
+        pthread_join(loaders[i], NULL);
+    }
+    i2c_mock_set_byte_time(I2C_NUM_1, 0);
+
+    // Lifted: read once more, then the job stops until the next interrupt
+    touch_chip.regs[0x02] = 0;
+    usleep(100000);
+    CHECK(!FT6336U_WasPressed());
+    reads = touch_chip.reads[0x02];
+    usleep(100000);
+    CHECK_EQ(touch_chip.reads[0x02], reads);
+
+    CHECK(waiting.jitter_max_us >= 25000);
+    CHECK(polled.jitter_max_us < TICKER_JITTER_US);
+    fprintf(stderr, "touch: a 10 ms job's jitter max %5u us next to the polled read, %5u us next to a waiting one; "
+            "%u reads a second behind a busy bus\n", polled.jitter_max_us, waiting.jitter_max_us, touch_reads);
+}
+
+int main(void) {
+    test_wheel_fake_clock();
+
+    CHECK_EQ(scheduler_start(5, 1), ESP_OK);
+    test_rerun();
+
+    sgp30_model_t model;
+    sgp30_model_init(&model);
+    i2c_mock_attach(I2C_NUM_0, &model.device);
+    I2CDevice_t sgp30 = i2c_malloc_device(I2C_NUM_0, GPIO_NUM_32, GPIO_NUM_33, 100000, SGP30_ADDR);
+    test_sgp30_jobs(&model, sgp30);
+    test_touch_job();
+
+    return host_test_result("scheduler_test");
+}
@@ -0,0 +1,313 @@
+/*
+ * Drift simulator for the SGP30's humidity compensation and baseline
+ * persistence. The driver runs unchanged against host/sgp30_model.c with
+ * its IAQ algorithm on, one measure_iaq per simulated second, on a
+ * simulated clock so days of air take seconds. Each run reports how long
+ * TVOC took to settle within --tolerance of what is in the air for good:
+ * from a cold start and after a power cycle that restores the baseline
+ * from NVS, each with and without compensation.
+ *
+ * A drift trace is a CSV of `seconds,temperature_c,humidity_rh,tvoc_ppb`
+ * lines, interpolated between them. Without --trace one is synthesised:
+ * a day's swing of temperature and humidity with a few smells in it.
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+#include "i2c_device.h"
+#include "sgp30.h"
+#include "timekeeping.h"
+
+#include "host_test.h"
+#include "sgp30_model.h"
+
+#define SYNTH_STEP_S 60
+#define MAX_POINTS 100000
+// Readings count as stable once they stay in tolerance this long
+#define STABLE_FOR_S 3600
+// The errors are summed up over the end of each run
+#define TAIL_S (12 * 3600)
+
+typedef struct {
+    int64_t t_s;
+    float temperature_c;
+    float humidity_rh;
+    float tvoc_ppb;
+} drift_point_t;
+
+typedef struct {
+    drift_point_t *points;
+    size_t count;
+} drift_trace_t;
+
+typedef struct {
+    int64_t stable_s;       // from boot, -1 if off within the last STABLE_FOR_S
+    float mean_error_ppb;   // over the last TAIL_S
+    float off_pct;          // of the readings in the last TAIL_S
+    uint32_t saves;
+} run_result_t;
+
+static struct {
+    const char *trace;
+    uint32_t hours;
+    float tolerance_ppb;
+} options = {
+    .hours = 48,
+    .tolerance_ppb = 15.0f,
+};
+
+static sgp30_model_t model;
+
+// sgp30.c stamps samples with the RTC-disciplined clock
+int64_t timekeeping_now_us(void) {
+    return esp_timer_get_time();
+}
+
+static void synthesise(drift_trace_t *trace, uint32_t hours) {
+    trace->count = hours * 3600 / SYNTH_STEP_S + 1;
+    trace->points = calloc(trace->count, sizeof(drift_point_t));
+    for (size_t i = 0; i < trace->count; i++) {
+        drift_point_t *p = &trace->points[i];
+        p->t_s = (int64_t)i * SYNTH_STEP_S;
+        // Warmest and driest mid-afternoon
+        float day = sinf(2.0f * (float)M_PI * (p->t_s - 9 * 3600) / 86400.0f);
+        p->temperature_c = 22.0f + 3.0f * day;
+        p->humidity_rh = 50.0f - 15.0f * day;
+        // Cooking every 11 hours, 40 minutes of it
+        p->tvoc_ppb = (p->t_s % (11 * 3600)) >= 5 * 3600 && (p->t_s % (11 * 3600)) < 5 * 3600 + 2400 ? 250.0f : 0.0f;
+    }
+}
+
+static int load(drift_trace_t *trace, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    trace->points = calloc(MAX_POINTS, sizeof(drift_point_t));
+    trace->count = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), f) != NULL && trace->count < MAX_POINTS) {
+        drift_point_t *p = &trace->points[trace->count];
+        double t;
+        // Headers and comments do not parse
+        if (sscanf(line, "%lf,%f,%f,%f", &t, &p->temperature_c, &p->humidity_rh, &p->tvoc_ppb) != 4) {
+            continue;
+        }
+        p->t_s = (int64_t)t;
+        if (trace->count > 0 && p->t_s <= trace->points[trace->count - 1].t_s) {
+            fprintf(stderr, "%s: times must increase, line \"%s\"\n", path, line);
+            fclose(f);
+            return -1;
+        }
+        trace->count++;
+    }
+    fclose(f);
+    if (trace->count < 2) {
+        fprintf(stderr, "%s: no trace\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static drift_point_t at(const drift_trace_t *trace, int64_t t_s) {
+    size_t lo = 0, hi = trace->count - 1;
+    if (t_s <= trace->points[0].t_s) {
+        return trace->points[0];
+    }
+    if (t_s >= trace->points[hi].t_s) {
+        return trace->points[hi];
+    }
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (trace->points[mid].t_s <= t_s) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    const drift_point_t *a = &trace->points[lo], *b = &trace->points[hi];
+    float f = (float)(t_s - a->t_s) / (float)(b->t_s - a->t_s);
+    drift_point_t p = {
+        .t_s = t_s,
+        .temperature_c = a->temperature_c + f * (b->temperature_c - a->temperature_c),
+        .humidity_rh = a->humidity_rh + f * (b->humidity_rh - a->humidity_rh),
+        .tvoc_ppb = a->tvoc_ppb + f * (b->tvoc_ppb - a->tvoc_ppb),
+    };
+    return p;
+}
+
+/*
+    Powers the sensor up at from_s and measures once a second until to_s,
+    refreshing the compensation and saving the baseline as the driver's
+    measurement job does.
+*/
+static run_result_t run(I2CDevice_t device, const drift_trace_t *trace, int64_t from_s, int64_t to_s, bool compensate) {
+    run_result_t result = { .stable_s = 0 };
+    double error_sum = 0;
+    uint32_t tail_count = 0, tail_off = 0;
+
+    sgp30_model_power_cycle(&model);
+    uint32_t restores = model.baseline_sets;
+    CHECK_EQ(SGP30_Init(device), ESP_OK);
+    bool restored = model.baseline_sets != restores;
+    int64_t boot_us = esp_timer_get_time();
+
+    for (int64_t t_s = from_s; t_s < to_s; t_s++) {
+        int64_t since_boot_s = t_s - from_s;
+        drift_point_t air = at(trace, t_s);
+        uint32_t abs_humidity = SGP30_AbsoluteHumidity(air.temperature_c, air.humidity_rh);
+        model.air_tvoc_ppb = air.tvoc_ppb;
+        model.air_humidity_g_m3 = abs_humidity / 1000.0f;
+
+        if (compensate && since_boot_s % (SGP30_HUMIDITY_INTERVAL_MS / 1000) == 0) {
+            CHECK_EQ(SGP30_SetAbsoluteHumidity(abs_humidity), ESP_OK);
+        }
+        bool learnt = restored || since_boot_s >= SGP30_BASELINE_LEARN_S;
+        if (learnt && since_boot_s > 0 && since_boot_s % SGP30_BASELINE_SAVE_INTERVAL_S == 0) {
+            CHECK_EQ(SGP30_SaveBaseline(), ESP_OK);
+            result.saves++;
+        }
+
+        uint16_t tvoc, eco2;
+        CHECK_EQ(SGP30_MeasureIAQ(&tvoc, &eco2), ESP_OK);
+        float error = fabsf(tvoc - air.tvoc_ppb);
+        bool off = error > options.tolerance_ppb;
+        if (off) {
+            result.stable_s = since_boot_s + 1;
+        }
+        if (to_s - t_s <= TAIL_S) {
+            error_sum += error;
+            tail_off += off;
+            tail_count++;
+        }
+
+        // On to the next second
+        int64_t next_us = boot_us + (since_boot_s + 1) * 1000000;
+        int64_t now_us = esp_timer_get_time();
+        if (next_us > now_us) {
+            host_clock_advance_us(next_us - now_us);
+        }
+    }
+    if (to_s - from_s - result.stable_s < STABLE_FOR_S) {
+        result.stable_s = -1;
+    }
+    result.mean_error_ppb = error_sum / tail_count;
+    result.off_pct = 100.0f * tail_off / tail_count;
+    return result;
+}
+
+static void report(const char *name, const run_result_t *r) {
+    char stable[32] = "never stable";
+    if (r->stable_s >= 0) {
+        snprintf(stable, sizeof(stable), "stable after %5.2f h", r->stable_s / 3600.0);
+    }
+    fprintf(stderr, "%-26s %s; last %d h: %5.1f ppb mean error, %4.1f%% off; %u baseline saves\n",
+            name, stable, TAIL_S / 3600, r->mean_error_ppb, r->off_pct, r->saves);
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -t, --trace FILE       drift trace CSV: seconds,temperature_c,humidity_rh,tvoc_ppb\n"
+            "  -H, --hours N          length of the synthetic trace, default %u\n"
+            "  -e, --tolerance PPB    how far off TVOC may be once stable, default %.0f\n",
+            argv0, options.hours, options.tolerance_ppb);
+}
+
+int main(int argc, char **argv) {
+    static const struct option long_options[] = {
+        {"trace", required_argument, NULL, 't'},
+        {"hours", required_argument, NULL, 'H'},
+        {"tolerance", required_argument, NULL, 'e'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "t:H:e:h", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 't': options.trace = optarg; break;
+        case 'H': options.hours = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'e': options.tolerance_ppb = strtof(optarg, NULL); break;
+        default: usage(argv[0]); return opt == 'h' ? 0 : 2;
+        }
+    }
+
+    drift_trace_t trace;
+    if (options.trace != NULL) {
+        if (load(&trace, options.trace) != 0) {
+            return 2;
+        }
+    } else {
+        if (options.hours < 24) {
+            fprintf(stderr, "--hours must be at least 24\n");
+            return 2;
+        }
+        synthesise(&trace, options.hours);
+    }
+    int64_t start_s = trace.points[0].t_s;
+    int64_t end_s = trace.points[trace.count - 1].t_s;
+    // A cold start for three quarters of the trace, then a power cycle
+    int64_t cycle_s = start_s + (end_s - start_s) * 3 / 4;
+    if (cycle_s - start_s < SGP30_BASELINE_LEARN_S + 3600 || end_s - cycle_s < 2 * 3600) {
+        fprintf(stderr, "the trace must cover the %d h learning period and a few hours after it\n",
+                SGP30_BASELINE_LEARN_S / 3600);
+        return 2;
+    }
+    fprintf(stderr, "%.1f h of air, power cycle at %.1f h, tolerance %.0f ppb\n",
+            (end_s - start_s) / 3600.0, (cycle_s - start_s) / 3600.0, options.tolerance_ppb);
+
+    sgp30_model_init(&model);
+    model.algorithm = true;
+    i2c_mock_attach(I2C_NUM_0, &model.device);
+    I2CDevice_t device = i2c_malloc_device(I2C_NUM_0, GPIO_NUM_32, GPIO_NUM_33, 100000, SGP30_ADDR);
+    CHECK(device != NULL);
+    host_clock_simulate();
+
+    host_nvs_clear();
+    run_result_t cold_raw = run(device, &trace, start_s, cycle_s, false);
+    report("cold start, uncompensated", &cold_raw);
+    host_nvs_clear();
+    run_result_t cold = run(device, &trace, start_s, cycle_s, true);
+    report("cold start, compensated", &cold);
+
+    // Both restore a baseline learnt with compensation, the second the
+    // one the first saved
+    uint32_t restores = model.baseline_sets;
+    run_result_t warm = run(device, &trace, cycle_s, end_s, true);
+    report("restored, compensated", &warm);
+    run_result_t warm_raw = run(device, &trace, cycle_s, end_s, false);
+    report("restored, uncompensated", &warm_raw);
+    CHECK_EQ(model.baseline_sets - restores, 2);
+
+    CHECK(cold.saves > 0);
+    if (options.trace == NULL) {
+        // The factory baseline is 300 ppb off, which takes hours to learn
+        CHECK(cold.stable_s > 3600);
+        CHECK(cold.stable_s <= SGP30_BASELINE_LEARN_S);
+        // A restored baseline is right from the first reading
+        CHECK(warm.stable_s >= 0 && warm.stable_s < 60);
+        CHECK(cold.off_pct < 10.0f && warm.off_pct < 10.0f);
+        // A day's humidity swing is more than the baseline can follow,
+        // and a smell reads low while the air is dry
+        CHECK(cold_raw.off_pct > cold.off_pct + 10.0f);
+        CHECK(warm_raw.off_pct > warm.off_pct);
+        CHECK(warm_raw.stable_s < 0 || warm_raw.stable_s > warm.stable_s + 3600);
+    }
+    if (cold.stable_s >= 0 && warm.stable_s >= 0) {
+        fprintf(stderr, "time to stable: %.2f h from cold, %lld s with the restored baseline\n",
+                cold.stable_s / 3600.0, (long long)warm.stable_s);
+    }
+
+    i2c_free_device(device);
+    free(trace.points);
+    return host_test_result("sgp30_drift_sim");
+}
@@ -0,0 +1,298 @@
+/*
+ * Host test of components/sgp30: the driver through the real i2c_device
+ * code against a model of the sensor on the mock bus, and the sample
+ * ring under concurrent readers, with the cost of its operations.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+#include "i2c_device.h"
+#include "sgp30.h"
+#include "sgp30_ring.h"
+#include "timekeeping.h"
+
+#include "host_test.h"
+#include "measure.h"
+#include "sgp30_model.h"
+
+#define RING_SAMPLES 200000
+#define RING_READERS 3
+#define RING_READ_COUNT 32
+
+static sgp30_model_t model;
+
+// sgp30.c stamps samples with the RTC-disciplined clock
+int64_t timekeeping_now_us(void) {
+    return esp_timer_get_time();
+}
+
+static void test_crc(void) {
+    // The datasheet's example
+    const uint8_t word[2] = { 0xbe, 0xef };
+    CHECK_EQ(SGP30_CRC8(word, 2), 0x92);
+}
+
+static void test_absolute_humidity(void) {
+    // 25 C at 50 %RH is 11.5 g/m^3
+    uint32_t ah = SGP30_AbsoluteHumidity(25.0f, 50.0f);
+    CHECK(ah > 11400 && ah < 11600);
+    CHECK_EQ(SGP30_AbsoluteHumidity(25.0f, 0.0f), 0);
+
+    CHECK_EQ(SGP30_SetAbsoluteHumidity(11500), ESP_OK);
+    // 11.5 g/m^3 in 8.8 fixed point
+    CHECK_EQ(model.humidity, 0x0b80);
+    CHECK_EQ(SGP30_SetAbsoluteHumidity(300000), ESP_OK);
+    CHECK_EQ(model.humidity, 0xffff);
+    CHECK_EQ(model.bad_crcs, 0);
+}
+
+static void test_init(I2CDevice_t device) {
+    host_nvs_clear();
+    CHECK_EQ(SGP30_Init(NULL), ESP_ERR_INVALID_ARG);
+    CHECK_EQ(SGP30_Init(device), ESP_OK);
+    CHECK(model.iaq_started);
+    CHECK_EQ(model.iaq_inits, 1);
+    // Nothing saved yet, so nothing restored
+    CHECK_EQ(model.baseline_sets, 0);
+
+    uint64_t serial = 0;
+    CHECK_EQ(SGP30_GetSerial(&serial), ESP_OK);
+    CHECK_EQ(serial, model.serial);
+}
+
+static void test_measure(void) {
+    model.eco2 = 612;
+    model.tvoc = 87;
+    model.raw_h2 = 13210;
+    model.raw_ethanol = 18765;
+    sgp30_sample_t sample = { .timestamp_us = -1 };
+    CHECK_EQ(SGP30_MeasureBurst(&sample), ESP_OK);
+    CHECK_EQ(sample.eco2, 612);
+    CHECK_EQ(sample.tvoc, 87);
+    CHECK_EQ(sample.raw_h2, 13210);
+    CHECK_EQ(sample.raw_ethanol, 18765);
+    CHECK_EQ(sample.timestamp_us, -1);
+
+    // The driver waits out every command wherever in a tick it starts,
+    // so the sensor never has to NACK a read that came too early
+    for (int i = 0; i < 20; i++) {
+        usleep(i % 10 * 1000 + 300);
+        CHECK_EQ(SGP30_MeasureBurst(&sample), ESP_OK);
+    }
+    CHECK_EQ(model.early_reads, 0);
+}
+
+static void test_crc_error(void) {
+    uint16_t tvoc = 0, eco2 = 0;
+    model.corrupt_responses = 1;
+    CHECK_EQ(SGP30_MeasureIAQ(&tvoc, &eco2), ESP_ERR_INVALID_CRC);
+    CHECK_EQ(SGP30_MeasureIAQ(&tvoc, &eco2), ESP_OK);
+    CHECK_EQ(eco2, model.eco2);
+}
+
+static void test_baseline(I2CDevice_t device) {
+    model.baseline_eco2 = 0x8a3c;
+    model.baseline_tvoc = 0x91f2;
+    CHECK_EQ(SGP30_SaveBaseline(), ESP_OK);
+
+    uint16_t eco2 = 0, tvoc = 0;
+    CHECK_EQ(SGP30_GetBaseline(&eco2, &tvoc), ESP_OK);
+    CHECK_EQ(eco2, 0x8a3c);
+    CHECK_EQ(tvoc, 0x91f2);
+
+    // A power cycle forgets the baseline, the next init brings it back
+    model.baseline_eco2 = 0;
+    model.baseline_tvoc = 0;
+    CHECK_EQ(SGP30_Init(device), ESP_OK);
+    CHECK_EQ(model.baseline_sets, 1);
+    CHECK_EQ(model.baseline_eco2, 0x8a3c);
+    CHECK_EQ(model.baseline_tvoc, 0x91f2);
+    CHECK_EQ(model.bad_crcs, 0);
+}
+
+static void test_absent(I2CDevice_t device) {
+    model.absent = true;
+    uint16_t tvoc, eco2;
+    CHECK(SGP30_MeasureIAQ(&tvoc, &eco2) != ESP_OK);
+    CHECK(SGP30_Init(device) != ESP_OK);
+    model.absent = false;
+}
+
+static void make_sample(uint32_t pos, sgp30_sample_t *sample) {
+    sample->timestamp_us = pos;
+    sample->tvoc = pos & 0xffff;
+    sample->eco2 = ~pos & 0xffff;
+    sample->raw_h2 = pos >> 16;
+    sample->raw_ethanol = (pos * 7) & 0xffff;
+}
+
+static bool sample_intact(const sgp30_sample_t *sample) {
+    sgp30_sample_t expected;
+    make_sample((uint32_t)sample->timestamp_us, &expected);
+    return memcmp(&expected, sample, sizeof(sgp30_sample_t)) == 0;
+}
+
+static void test_ring_basics(void) {
+    static sgp30_ring_t ring;
+    sgp30_sample_t out[SGP30_RING_SIZE + 4], sample;
+
+    sgp30_ring_init(&ring);
+    CHECK_EQ(sgp30_ring_latest(&ring, out, 4), 0);
+    for (uint32_t pos = 0; pos < 3; pos++) {
+        make_sample(pos, &sample);
+        sgp30_ring_publish(&ring, &sample);
+    }
+    // Only what was published, newest first
+    CHECK_EQ(sgp30_ring_latest(&ring, out, 8), 3);
+    CHECK_EQ(out[0].timestamp_us, 2);
+    CHECK_EQ(out[2].timestamp_us, 0);
+
+    for (uint32_t pos = 3; pos < 3 * SGP30_RING_SIZE + 5; pos++) {
+        make_sample(pos, &sample);
+        sgp30_ring_publish(&ring, &sample);
+    }
+    // Wrapped, at most a ring's worth, every one intact and in order
+    size_t n = sgp30_ring_latest(&ring, out, SGP30_RING_SIZE + 4);
+    CHECK_EQ(n, SGP30_RING_SIZE);
+    CHECK_EQ(sgp30_ring_count(&ring), 3 * SGP30_RING_SIZE + 5);
+    for (size_t i = 0; i < n; i++) {
+        CHECK_EQ(out[i].timestamp_us, 3 * SGP30_RING_SIZE + 4 - (int64_t)i);
+        CHECK(sample_intact(&out[i]));
+    }
+}
+
+typedef struct {
+    sgp30_ring_t *ring;
+    volatile bool *done;
+    uint64_t reads;
+    uint64_t short_reads;
+    uint64_t torn;
+    uint64_t out_of_order;
+} reader_t;
+
+static void *ring_reader(void *arg) {
+    reader_t *reader = arg;
+    sgp30_sample_t out[RING_READ_COUNT];
+    while (!*reader->done) {
+        size_t n = sgp30_ring_latest(reader->ring, out, RING_READ_COUNT);
+        reader->reads++;
+        if (n < RING_READ_COUNT) {
+            reader->short_reads++;
+        }
+        for (size_t i = 0; i < n; i++) {
+            if (!sample_intact(&out[i])) {
+                reader->torn++;
+            } else if (out[i].timestamp_us != out[0].timestamp_us - (int64_t)i) {
+                reader->out_of_order++;
+            }
+        }
+    }
+    return NULL;
+}
+
+static void test_ring_concurrent(void) {
+    static sgp30_ring_t ring;
+    volatile bool done = false;
+    pthread_t threads[RING_READERS];
+    reader_t readers[RING_READERS];
+
+    sgp30_ring_init(&ring);
+    for (int i = 0; i < RING_READERS; i++) {
+        readers[i] = (reader_t){ .ring = &ring, .done = &done };
+        pthread_create(&threads[i], NULL, ring_reader, &readers[i]);
+    }
+    sgp30_sample_t sample;
+    for (uint32_t pos = 0; pos < RING_SAMPLES; pos++) {
+        make_sample(pos, &sample);
+        sgp30_ring_publish(&ring, &sample);
+        if ((pos & 1023) == 0) {
+            sched_yield();
+        }
+    }
+    done = true;
+
+    uint64_t reads = 0, short_reads = 0;
+    for (int i = 0; i < RING_READERS; i++) {
+        pthread_join(threads[i], NULL);
+        reads += readers[i].reads;
+        short_reads += readers[i].short_reads;
+        // A reader may come back short when the producer laps it, but
+        // never with a sample that is half old, half new, or out of order
+        CHECK_EQ(readers[i].torn, 0);
+        CHECK_EQ(readers[i].out_of_order, 0);
+    }
+    fprintf(stderr, "ring: %llu reads of %d alongside %d publishes, %llu cut short by the producer\n",
+            (unsigned long long)reads, RING_READ_COUNT, RING_SAMPLES, (unsigned long long)short_reads);
+}
+
+static void bench_ring(void) {
+    static sgp30_ring_t ring;
+    sgp30_sample_t sample, out[16];
+    const int iterations = 1000000;
+
+    sgp30_ring_init(&ring);
+    alloc_count_reset();
+    uint64_t start = measure_now_ns();
+    for (int i = 0; i < iterations; i++) {
+        make_sample(i, &sample);
+        sgp30_ring_publish(&ring, &sample);
+    }
+    uint64_t publish_ns = measure_now_ns() - start;
+
+    start = measure_now_ns();
+    size_t copied = 0;
+    for (int i = 0; i < iterations / 16; i++) {
+        copied += sgp30_ring_latest(&ring, out, 16);
+    }
+    uint64_t latest_ns = measure_now_ns() - start;
+    CHECK_EQ(copied, (size_t)iterations);
+    CHECK_EQ(alloc_count_read().calls, 0);
+
+    fprintf(stderr, "ring: publish %.1f ns, latest(16) %.1f ns\n",
+            (double)publish_ns / iterations, (double)latest_ns / (iterations / 16));
+}
+
+static void bench_driver(void) {
+    sgp30_sample_t sample;
+    const int bursts = 10;
+    alloc_count_reset();
+    uint64_t start = measure_now_ns();
+    for (int i = 0; i < bursts; i++) {
+        CHECK_EQ(SGP30_MeasureBurst(&sample), ESP_OK);
+    }
+    uint64_t elapsed = measure_now_ns() - start;
+    // Most of it is waiting for the sensor, in whole ticks
+    fprintf(stderr, "driver: measure burst %.1f ms, %.1f heap allocations\n",
+            elapsed / 1e6 / bursts, (double)alloc_count_read().calls / bursts);
+}
+
+int main(void) {
+    sgp30_model_init(&model);
+    i2c_mock_attach(I2C_NUM_0, &model.device);
+    I2CDevice_t device = i2c_malloc_device(I2C_NUM_0, GPIO_NUM_32, GPIO_NUM_33, 100000, SGP30_ADDR);
+    CHECK(device != NULL);
+
+    test_crc();
+    test_init(device);
+    test_absolute_humidity();
+    test_measure();
+    test_crc_error();
+    test_baseline(device);
+    test_absent(device);
+    test_ring_basics();
+    test_ring_concurrent();
+    bench_ring();
+    bench_driver();
+
+    i2c_free_device(device);
+    return host_test_result("sgp30_test");
+}
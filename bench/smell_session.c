@@ -0,0 +1,382 @@
+/*
+ * Converts the device's sensor recordings to CSV and back, through the
+ * encoder and decoder of components/recorder/recording.c that the
+ * firmware runs:
+ *
+ *   smell_session csv SMELL/0*.SMR -o session.csv
+ *   smell_session info SMELL/00000001.SMR
+ *   smell_session encode session.csv -o session.smr
+ *
+ * The CSV is the one the benchmarks' --trace and tools/smell_model.py
+ * read: one sample per line, a label and then the channel values. Blocks
+ * with a bad CRC are skipped with a warning, the rest of the recording
+ * still converts.
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "recording.h"
+
+#define LINE_MAX_LEN 1024
+
+typedef struct {
+    const char *output;
+    const char *label;          // csv: every sample's label instead of the recording's
+    int time;                   // csv: a last column with each sample's time
+    const char *resolution;     // encode: comma separated, one per channel
+    uint32_t period_us;
+    int64_t start_us;
+    const char *serial;
+    uint16_t block;
+} options_t;
+
+static options_t options = {
+    .period_us = 1000000,
+    .block = 32,
+};
+
+// What main/gas_array.c records
+static const recording_channel_t gas_channels[] = {
+    {"tvoc", 1.0f},
+    {"eco2", 1.0f},
+    {"raw_h2", 1.0f},
+    {"raw_ethanol", 1.0f},
+    {"port_b_adc", 0.1f},
+};
+
+static int load_file(const char *path, uint8_t **data, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    *data = length > 0 ? malloc((size_t)length) : NULL;
+    int ok = *data != NULL && fread(*data, 1, (size_t)length, f) == (size_t)length;
+    fclose(f);
+    if (!ok) {
+        free(*data);
+        *data = NULL;
+        return -1;
+    }
+    *size = (size_t)length;
+    return 0;
+}
+
+// Enough decimal places to show one code of the channel
+static int decimals(float resolution) {
+    int places = (int)ceil(-log10(resolution) - 1e-9);
+    return places > 0 ? places : 0;
+}
+
+static const char *or_dash(const char *text) {
+    return text[0] != '\0' ? text : "-";
+}
+
+static const char *clock_name(const recording_header_t *header) {
+    return header->flags & RECORDING_FLAG_WALL_CLOCK ? " UTC" : " since boot";
+}
+
+// Opens a recording; data is freed by the caller
+static int open_recording(const char *path, recording_decoder_t *decoder, uint8_t **data, size_t *size) {
+    if (load_file(path, data, size) != 0) {
+        fprintf(stderr, "%s: cannot read\n", path);
+        return -1;
+    }
+    if (recording_decoder_open(decoder, *data, *size) != 0) {
+        fprintf(stderr, "%s: not a version %d recording\n", path, RECORDING_VERSION);
+        free(*data);
+        return -1;
+    }
+    return 0;
+}
+
+static int to_csv(int count, char **paths) {
+    FILE *out = options.output != NULL ? fopen(options.output, "w") : stdout;
+    if (out == NULL) {
+        fprintf(stderr, "cannot write %s\n", options.output);
+        return 1;
+    }
+    int status = 0;
+    for (int n = 0; n < count && status == 0; n++) {
+        recording_decoder_t decoder;
+        uint8_t *data;
+        size_t size;
+        if (open_recording(paths[n], &decoder, &data, &size) != 0) {
+            status = 1;
+            break;
+        }
+        const recording_header_t *header = &decoder.header;
+        const char *label = options.label != NULL ? options.label : header->label;
+        if (n == 0) {
+            fprintf(out, "label");
+            for (int c = 0; c < header->channel_count; c++) {
+                fprintf(out, ",%s", decoder.channels[c].name);
+            }
+            fprintf(out, options.time ? ",time_us\n" : "\n");
+        }
+        // A first pass for the sample count in the comment
+        float values[RECORDING_MAX_CHANNELS];
+        uint32_t index;
+        while (recording_decoder_next(&decoder, values, NULL) == 1) {
+        }
+        fprintf(out, "# %s: serial %s, start %lld us%s, %u samples\n", paths[n], or_dash(header->serial),
+                (long long)header->start_time_us, clock_name(header), decoder.samples);
+        recording_decoder_open(&decoder, data, size);
+        int got;
+        while ((got = recording_decoder_next(&decoder, values, &index)) == 1) {
+            fprintf(out, "%s", label);
+            for (int c = 0; c < header->channel_count; c++) {
+                fprintf(out, ",%.*f", decimals(decoder.channels[c].resolution), values[c]);
+            }
+            if (options.time) {
+                fprintf(out, ",%lld", (long long)(header->start_time_us + (int64_t)index * header->sample_period_us));
+            }
+            fprintf(out, "\n");
+        }
+        if (decoder.bad_blocks > 0) {
+            fprintf(stderr, "%s: skipped %u damaged blocks\n", paths[n], decoder.bad_blocks);
+        }
+        if (got < 0) {
+            fprintf(stderr, "%s: cut short or malformed after %u samples\n", paths[n], decoder.samples);
+            status = 1;
+        }
+        free(data);
+    }
+    if (out != stdout) {
+        fclose(out);
+    }
+    return status;
+}
+
+static int info(int count, char **paths) {
+    int status = 0;
+    for (int n = 0; n < count; n++) {
+        recording_decoder_t decoder;
+        uint8_t *data;
+        size_t size;
+        if (open_recording(paths[n], &decoder, &data, &size) != 0) {
+            status = 1;
+            continue;
+        }
+        const recording_header_t *header = &decoder.header;
+        printf("%s: serial %s, label %s, start %lld us%s, period %u us\n", paths[n], or_dash(header->serial),
+               or_dash(header->label), (long long)header->start_time_us, clock_name(header),
+               header->sample_period_us);
+        printf("  channels:");
+        for (int c = 0; c < header->channel_count; c++) {
+            printf("%s %s (%g)", c > 0 ? "," : "", decoder.channels[c].name, decoder.channels[c].resolution);
+        }
+        printf("\n");
+
+        // What the same samples take as csv writes them
+        float values[RECORDING_MAX_CHANNELS];
+        size_t csv_bytes = 0;
+        int got;
+        while ((got = recording_decoder_next(&decoder, values, NULL)) == 1) {
+            csv_bytes += strlen(header->label) + 1;
+            for (int c = 0; c < header->channel_count; c++) {
+                csv_bytes += (size_t)snprintf(NULL, 0, ",%.*f", decimals(decoder.channels[c].resolution), values[c]);
+            }
+        }
+        printf("  %u samples, %zu bytes, %.2f bytes a sample, %zu as CSV, %u damaged blocks%s\n", decoder.samples,
+               size, (double)size / (decoder.samples > 0 ? decoder.samples : 1), csv_bytes, decoder.bad_blocks,
+               got < 0 ? ", cut short" : "");
+        status |= got < 0;
+        free(data);
+    }
+    return status;
+}
+
+static int encode(const char *csv_path) {
+    recording_channel_t channels[RECORDING_MAX_CHANNELS];
+    int channel_count = 0;
+    if (options.resolution == NULL) {
+        channel_count = (int)(sizeof(gas_channels) / sizeof(gas_channels[0]));
+        memcpy(channels, gas_channels, sizeof(gas_channels));
+    } else {
+        const char *text = options.resolution;
+        for (;;) {
+            char *end;
+            float resolution = strtof(text, &end);
+            if (end == text || !(resolution > 0.0f) || channel_count == RECORDING_MAX_CHANNELS) {
+                fprintf(stderr, "--resolution takes 1 to %d positive values\n", RECORDING_MAX_CHANNELS);
+                return 1;
+            }
+            snprintf(channels[channel_count].name, RECORDING_NAME_LEN, "ch%d", channel_count);
+            channels[channel_count++].resolution = resolution;
+            if (*end != ',') {
+                break;
+            }
+            text = end + 1;
+        }
+    }
+    if (options.block == 0 || (size_t)options.block * channel_count * RECORDING_MAX_VARINT > UINT16_MAX) {
+        fprintf(stderr, "--block must be 1 to %d for %d channels\n",
+                UINT16_MAX / (channel_count * RECORDING_MAX_VARINT), channel_count);
+        return 1;
+    }
+
+    FILE *in = fopen(csv_path, "r");
+    if (in == NULL) {
+        fprintf(stderr, "cannot read %s\n", csv_path);
+        return 1;
+    }
+    recording_header_t header = {
+        .channel_count = (uint8_t)channel_count,
+        .sample_period_us = options.period_us,
+        .start_time_us = options.start_us,
+    };
+    if (options.serial != NULL) {
+        snprintf(header.serial, sizeof(header.serial), "%s", options.serial);
+    }
+    float *values = NULL;
+    uint32_t samples = 0, capacity = 0;
+    char line[LINE_MAX_LEN];
+    while (fgets(line, sizeof(line), in) != NULL) {
+        if (line[0] == '#') {
+            continue;
+        }
+        char *field = strchr(line, ',');
+        if (field == NULL) {
+            continue;
+        }
+        float sample[RECORDING_MAX_CHANNELS];
+        int c = 0;
+        for (; c < channel_count && field != NULL && *field == ','; c++) {
+            char *end;
+            sample[c] = strtof(field + 1, &end);
+            if (end == field + 1) {
+                break;      // the header, or a short line
+            }
+            field = end;
+        }
+        if (c < channel_count) {
+            continue;
+        }
+        if (samples == 0) {
+            *strchr(line, ',') = '\0';
+            snprintf(header.label, sizeof(header.label), "%.*s", RECORDING_LABEL_LEN - 1, line);
+        }
+        if (samples == capacity) {
+            capacity = capacity > 0 ? capacity * 2 : 4096;
+            float *grown = realloc(values, (size_t)capacity * channel_count * sizeof(float));
+            if (grown == NULL) {
+                fprintf(stderr, "no memory for %u samples\n", capacity);
+                free(values);
+                fclose(in);
+                return 1;
+            }
+            values = grown;
+        }
+        memcpy(values + (size_t)samples * channel_count, sample, (size_t)channel_count * sizeof(float));
+        samples++;
+    }
+    fclose(in);
+    if (samples == 0) {
+        fprintf(stderr, "no samples in %s\n", csv_path);
+        return 1;
+    }
+
+    const size_t size = RECORDING_MAX_SIZE(channel_count, samples, options.block);
+    uint8_t *data = malloc(size);
+    recording_encoder_t encoder;
+    if (data == NULL || recording_encoder_begin(&encoder, &header, channels, options.block, data, size) != 0) {
+        fprintf(stderr, "cannot start a recording of %u samples\n", samples);
+        free(values);
+        free(data);
+        return 1;
+    }
+    for (uint32_t n = 0; n < samples; n++) {
+        recording_encoder_add(&encoder, values + (size_t)n * channel_count);
+    }
+    const size_t length = recording_encoder_finish(&encoder);
+    free(values);
+
+    const char *path = options.output != NULL ? options.output : "session.smr";
+    FILE *out = fopen(path, "wb");
+    int ok = out != NULL && fwrite(data, 1, length, out) == length;
+    if (out != NULL) {
+        ok &= fclose(out) == 0;
+    }
+    free(data);
+    if (!ok) {
+        fprintf(stderr, "cannot write %s\n", path);
+        return 1;
+    }
+    fprintf(stderr, "%u samples, %zu bytes, %.2f bytes a sample\n", samples, length, (double)length / samples);
+    return 0;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s csv [options] RECORDING...   decode recordings to one CSV\n"
+            "       %s info RECORDING...            print headers and sizes\n"
+            "       %s encode [options] FILE.csv    encode a CSV as a recording, labelled by its first line\n"
+            "\n"
+            "csv:\n"
+            "  -o, --output FILE         default stdout\n"
+            "  -l, --label LABEL         label every sample this instead of the recording's label\n"
+            "  -t, --time                add each sample's time as a last column\n"
+            "encode:\n"
+            "  -o, --output FILE         default session.smr\n"
+            "  -r, --resolution A,B,...  one per channel; default the gas array's channels\n"
+            "  -p, --period-us US        default %u\n"
+            "  -s, --start-us US         default 0\n"
+            "  -n, --serial SERIAL       default none\n"
+            "  -b, --block N             samples per block, default %u\n",
+            argv0, argv0, argv0, options.period_us, options.block);
+}
+
+int main(int argc, char **argv) {
+    static const struct option long_options[] = {
+        {"output", required_argument, NULL, 'o'},
+        {"label", required_argument, NULL, 'l'},
+        {"time", no_argument, NULL, 't'},
+        {"resolution", required_argument, NULL, 'r'},
+        {"period-us", required_argument, NULL, 'p'},
+        {"start-us", required_argument, NULL, 's'},
+        {"serial", required_argument, NULL, 'n'},
+        {"block", required_argument, NULL, 'b'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    if (argc < 2) {
+        usage(argv[0]);
+        return 2;
+    }
+    const char *command = argv[1];
+    // Options follow the command
+    optind = 2;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "o:l:tr:p:s:n:b:h", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'o': options.output = optarg; break;
+        case 'l': options.label = optarg; break;
+        case 't': options.time = 1; break;
+        case 'r': options.resolution = optarg; break;
+        case 'p': options.period_us = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 's': options.start_us = strtoll(optarg, NULL, 0); break;
+        case 'n': options.serial = optarg; break;
+        case 'b': options.block = (uint16_t)strtoul(optarg, NULL, 0); break;
+        default: usage(argv[0]); return opt == 'h' ? 0 : 2;
+        }
+    }
+    const int count = argc - optind;
+    if (strcmp(command, "csv") == 0 && count > 0) {
+        return to_csv(count, argv + optind);
+    }
+    if (strcmp(command, "info") == 0 && count > 0) {
+        return info(count, argv + optind);
+    }
+    if (strcmp(command, "encode") == 0 && count == 1) {
+        return encode(argv[optind]);
+    }
+    usage(argv[0]);
+    return 2;
+}
@@ -0,0 +1,324 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "recording.h"
+#include "trace.h"
+
+// Rest level and noise of each channel, roughly what an SGP30 and the
+// Port B ADC read in a room
+static const float baseline[TRACE_CHANNELS] = {20.0f, 400.0f, 13000.0f, 18000.0f, 1500.0f};
+static const float noise[TRACE_CHANNELS] = {2.0f, 5.0f, 8.0f, 10.0f, 4.0f};
+
+// A session: rests of 3 to 10 minutes, each smell presented for a
+// minute at 1/20 to 1.3 times its strength, and a baseline that wanders
+// by a hundredth of the noise a second. In clean air the SGP30 sits at
+// its lower limits, TVOC at a few ppb over 0 and eCO2 at 400 ppm.
+#define SESSION_REST_MIN 180
+#define SESSION_REST_MAX 600
+#define SESSION_PRESENTED 60
+#define SESSION_STRENGTH_MIN 0.05f
+#define SESSION_STRENGTH_MAX 1.3f
+#define SESSION_DRIFT 0.01f
+static const float session_baseline[TRACE_CHANNELS] = {2.0f, 400.0f, 13000.0f, 18000.0f, 1500.0f};
+static const float session_floor[TRACE_CHANNELS] = {0.0f, 400.0f, 0.0f, 0.0f, 0.0f};
+
+// splitmix64, so any window can be made without the ones before it
+static uint64_t mix(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+static float uniform(uint64_t *state) {
+    *state = mix(*state);
+    return (float)(*state >> 40) / (float)(1u << 24);
+}
+
+// Sum of four uniforms, near enough to normal for sensor noise
+static float gaussian(uint64_t *state) {
+    return (uniform(state) + uniform(state) + uniform(state) + uniform(state) - 2.0f) * 1.7320508f;
+}
+
+int trace_synthetic(trace_t *trace, uint16_t class_count, uint32_t seed) {
+    memset(trace, 0, sizeof(trace_t));
+    if (class_count == 0 || class_count > TRACE_MAX_CLASSES) {
+        return -1;
+    }
+    trace->seed = seed;
+    trace->class_count = class_count;
+    // Room for the classes a session adds as it is replayed
+    trace->labels = calloc(TRACE_MAX_CLASSES, TRACE_LABEL_LEN);
+    trace->amplitude = calloc((size_t)class_count * TRACE_CHANNELS, sizeof(float));
+    trace->rise_tau = calloc((size_t)class_count * TRACE_CHANNELS, sizeof(float));
+    trace->decay_tau = calloc((size_t)class_count * TRACE_CHANNELS, sizeof(float));
+    if (trace->labels == NULL || trace->amplitude == NULL || trace->rise_tau == NULL || trace->decay_tau == NULL) {
+        trace_free(trace);
+        return -1;
+    }
+
+    uint64_t state = seed;
+    for (uint16_t c = 0; c < class_count; c++) {
+        snprintf(trace->labels[c], TRACE_LABEL_LEN, "smell_%u", c);
+        for (int ch = 0; ch < TRACE_CHANNELS; ch++) {
+            size_t i = (size_t)c * TRACE_CHANNELS + ch;
+            // Raw H2 and ethanol fall when gas arrives, the rest rise
+            float sign = ch == 2 || ch == 3 ? -1.0f : 1.0f;
+            trace->amplitude[i] = sign * noise[ch] * (5.0f + 40.0f * uniform(&state));
+            trace->rise_tau[i] = 1.0f + 6.0f * uniform(&state);
+            trace->decay_tau[i] = 8.0f + 40.0f * uniform(&state);
+        }
+    }
+    return 0;
+}
+
+// The class of a label, added if it is new. Windows that start without
+// a label are put in a class of their own.
+static uint16_t find_class(trace_t *trace, const char *label) {
+    const char *name = label[0] != '\0' ? label : "unlabelled";
+    uint16_t c;
+    for (c = 0; c < trace->class_count; c++) {
+        if (strncmp(trace->labels[c], name, TRACE_LABEL_LEN - 1) == 0) {
+            return c;
+        }
+    }
+    if (trace->class_count == TRACE_MAX_CLASSES) {
+        return 0;
+    }
+    snprintf(trace->labels[c], TRACE_LABEL_LEN, "%.*s", TRACE_LABEL_LEN - 1, name);
+    return trace->class_count++;
+}
+
+// Appends one sample, starting a new window every TRACE_FRAME_LEN of
+// them. A window is labelled by its first sample.
+static int append_sample(trace_t *trace, size_t *capacity, uint32_t *sample_count, const char *label,
+                         const float *values) {
+    const size_t window_floats = TRACE_CHANNELS * TRACE_FRAME_LEN;
+    const uint32_t w = *sample_count / TRACE_FRAME_LEN;
+    const uint32_t t = *sample_count % TRACE_FRAME_LEN;
+    if ((size_t)w >= *capacity) {
+        *capacity = *capacity ? 2 * *capacity : 256;
+        float *samples = realloc(trace->samples, *capacity * window_floats * sizeof(float));
+        uint16_t *window_class = realloc(trace->window_class, *capacity * sizeof(uint16_t));
+        uint16_t *sample_class = realloc(trace->sample_class, *capacity * TRACE_FRAME_LEN * sizeof(uint16_t));
+        if (samples != NULL) {
+            trace->samples = samples;
+        }
+        if (window_class != NULL) {
+            trace->window_class = window_class;
+        }
+        if (sample_class != NULL) {
+            trace->sample_class = sample_class;
+        }
+        if (samples == NULL || window_class == NULL || sample_class == NULL) {
+            return -1;
+        }
+    }
+    const bool labelled = label[0] != '\0';
+    const uint16_t c = labelled || t == 0 ? find_class(trace, label) : TRACE_REST;
+    if (t == 0) {
+        trace->window_class[w] = c;
+    }
+    trace->sample_class[*sample_count] = labelled ? c : TRACE_REST;
+    for (int ch = 0; ch < TRACE_CHANNELS; ch++) {
+        trace->samples[(size_t)w * window_floats + (size_t)ch * TRACE_FRAME_LEN + t] = values[ch];
+    }
+    (*sample_count)++;
+    return 0;
+}
+
+static int read_csv(trace_t *trace, FILE *f, uint32_t *sample_count) {
+    size_t capacity = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char *comma = strchr(line, ',');
+        if (comma == NULL || line[0] == '#') {
+            continue;
+        }
+        *comma = '\0';
+        float values[TRACE_CHANNELS];
+        char *p = comma + 1;
+        int ch;
+        for (ch = 0; ch < TRACE_CHANNELS; ch++) {
+            char *end;
+            values[ch] = strtof(p, &end);
+            if (end == p) {
+                break;
+            }
+            p = *end == ',' ? end + 1 : end;
+        }
+        if (ch < TRACE_CHANNELS) {
+            continue;   // a header or a short line
+        }
+        if (append_sample(trace, &capacity, sample_count, line, values) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// A recording from components/recorder, as the device sends them. Its
+// first TRACE_CHANNELS channels are taken in order.
+static int read_recording(trace_t *trace, FILE *f, uint32_t *sample_count) {
+    size_t size = 0, capacity = 0;
+    uint8_t *data = NULL;
+    for (;;) {
+        uint8_t *grown = realloc(data, size + 65536);
+        if (grown == NULL) {
+            free(data);
+            return -1;
+        }
+        data = grown;
+        const size_t got = fread(data + size, 1, 65536, f);
+        size += got;
+        if (got < 65536) {
+            break;
+        }
+    }
+
+    recording_decoder_t decoder;
+    int ret = -1;
+    if (recording_decoder_open(&decoder, data, size) == 0 && decoder.header.channel_count >= TRACE_CHANNELS) {
+        float values[RECORDING_MAX_CHANNELS];
+        while ((ret = recording_decoder_next(&decoder, values, NULL)) == 1) {
+            if (append_sample(trace, &capacity, sample_count, decoder.header.label, values) != 0) {
+                break;
+            }
+        }
+        if (decoder.bad_blocks > 0) {
+            fprintf(stderr, "Skipped %u damaged blocks\n", decoder.bad_blocks);
+        }
+    }
+    free(data);
+    return ret;
+}
+
+int trace_replay(trace_t *trace, const char *path) {
+    memset(trace, 0, sizeof(trace_t));
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return -1;
+    }
+    trace->labels = calloc(TRACE_MAX_CLASSES, TRACE_LABEL_LEN);
+    if (trace->labels == NULL) {
+        fclose(f);
+        return -1;
+    }
+
+    uint32_t magic = 0;
+    const bool binary = fread(&magic, sizeof(magic), 1, f) == 1 && magic == RECORDING_MAGIC;
+    rewind(f);
+    uint32_t sample_count = 0;
+    int ret = binary ? read_recording(trace, f, &sample_count) : read_csv(trace, f, &sample_count);
+    fclose(f);
+
+    trace->window_count = sample_count / TRACE_FRAME_LEN;
+    if (ret != 0 || trace->window_count == 0) {
+        trace_free(trace);
+        return -1;
+    }
+    return 0;
+}
+
+int trace_synthetic_session(trace_t *trace, uint16_t class_count, uint32_t seed, uint32_t samples) {
+    if (trace_synthetic(trace, class_count, seed) != 0) {
+        return -1;
+    }
+    uint64_t state = mix(((uint64_t)seed << 32) | 0xFFFFFFFFu);
+    float level[TRACE_CHANNELS];
+    memcpy(level, session_baseline, sizeof(level));
+    size_t capacity = 0;
+    uint32_t sample_count = 0;
+    uint32_t onset = 0;
+    uint32_t next_onset = SESSION_REST_MIN + (uint32_t)((SESSION_REST_MAX - SESSION_REST_MIN) * uniform(&state));
+    int c = -1;
+    float strength = 0.0f;
+
+    for (uint32_t n = 0; n < samples; n++) {
+        if (n == next_onset) {
+            c = (int)(mix(state) % class_count);
+            onset = n;
+            strength = SESSION_STRENGTH_MIN * powf(SESSION_STRENGTH_MAX / SESSION_STRENGTH_MIN, uniform(&state));
+            next_onset = n + SESSION_PRESENTED + SESSION_REST_MIN
+                + (uint32_t)((SESSION_REST_MAX - SESSION_REST_MIN) * uniform(&state));
+        }
+        float values[TRACE_CHANNELS];
+        for (int ch = 0; ch < TRACE_CHANNELS; ch++) {
+            level[ch] += SESSION_DRIFT * noise[ch] * gaussian(&state);
+            float response = 0.0f;
+            if (c >= 0) {
+                const size_t i = (size_t)c * TRACE_CHANNELS + ch;
+                const float dt = (n - onset) * TRACE_SAMPLE_PERIOD_S;
+                response = strength * trace->amplitude[i] * (1.0f - expf(-dt / trace->rise_tau[i]))
+                    * expf(-dt / trace->decay_tau[i]);
+            }
+            values[ch] = level[ch] + response + noise[ch] * gaussian(&state);
+            // The SGP30 reports whole ppb, ppm and ticks, the ADC's
+            // recording a tenth of a mV
+            values[ch] = ch < 4 ? fmaxf(roundf(values[ch]), session_floor[ch]) : roundf(values[ch] * 10.0f) / 10.0f;
+        }
+        const bool presented = c >= 0 && n - onset < SESSION_PRESENTED;
+        if (append_sample(trace, &capacity, &sample_count, presented ? trace->labels[c] : "", values) != 0) {
+            trace_free(trace);
+            return -1;
+        }
+    }
+    trace->window_count = sample_count / TRACE_FRAME_LEN;
+    if (trace->window_count == 0) {
+        trace_free(trace);
+        return -1;
+    }
+    return 0;
+}
+
+void trace_free(trace_t *trace) {
+    free(trace->labels);
+    free(trace->amplitude);
+    free(trace->rise_tau);
+    free(trace->decay_tau);
+    free(trace->samples);
+    free(trace->window_class);
+    free(trace->sample_class);
+    memset(trace, 0, sizeof(trace_t));
+}
+
+uint16_t trace_sample(const trace_t *trace, uint32_t n, float values[TRACE_CHANNELS]) {
+    const uint32_t w = n / TRACE_FRAME_LEN, t = n % TRACE_FRAME_LEN;
+    for (int ch = 0; ch < TRACE_CHANNELS; ch++) {
+        values[ch] = trace->samples[((size_t)w * TRACE_CHANNELS + ch) * TRACE_FRAME_LEN + t];
+    }
+    return trace->sample_class[n];
+}
+
+uint16_t trace_window(const trace_t *trace, uint32_t index, float rows[TRACE_CHANNELS][TRACE_FRAME_LEN]) {
+    if (trace->samples != NULL) {
+        const uint32_t w = index % trace->window_count;
+        memcpy(rows, &trace->samples[(size_t)w * TRACE_CHANNELS * TRACE_FRAME_LEN],
+               sizeof(float) * TRACE_CHANNELS * TRACE_FRAME_LEN);
+        return trace->window_class[w];
+    }
+
+    uint64_t state = mix(((uint64_t)trace->seed << 32) | index);
+    const uint16_t c = (uint16_t)(mix(state) % trace->class_count);
+    // The capture opens an eighth of a frame before the onset, give or
+    // take the detector's delay
+    const float onset = TRACE_FRAME_LEN / 8 + 3.0f * uniform(&state);
+    const float strength = 0.7f + 0.6f * uniform(&state);
+    for (int ch = 0; ch < TRACE_CHANNELS; ch++) {
+        const size_t i = (size_t)c * TRACE_CHANNELS + ch;
+        const float drift = noise[ch] * gaussian(&state);
+        for (int t = 0; t < TRACE_FRAME_LEN; t++) {
+            const float dt = (t - onset) * TRACE_SAMPLE_PERIOD_S;
+            float response = 0.0f;
+            if (dt > 0.0f) {
+                response = (1.0f - expf(-dt / trace->rise_tau[i])) * expf(-dt / trace->decay_tau[i]);
+            }
+            rows[ch][t] = baseline[ch] + drift + strength * trace->amplitude[i] * response
+                + noise[ch] * gaussian(&state);
+        }
+    }
+    return c;
+}
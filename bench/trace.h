@@ -0,0 +1,63 @@
+/**
+ * @file trace.h
+ * @brief Windows of gas sensor samples for the host benchmark, either
+ * synthesised or replayed from a recording.
+ *
+ * A window is what main/gas_array.c captures: TRACE_CHANNELS rows of
+ * TRACE_FRAME_LEN samples, one per second, with the exposure starting
+ * a little after the start.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#define TRACE_CHANNELS 5
+#define TRACE_FRAME_LEN 32
+#define TRACE_SAMPLE_PERIOD_S 1.0f
+#define TRACE_MAX_CLASSES 32
+#define TRACE_LABEL_LEN 24
+// The class of a replayed sample without a label, the air between exposures
+#define TRACE_REST 0xFFFF
+
+typedef struct {
+    uint32_t seed;
+    uint16_t class_count;
+    char (*labels)[TRACE_LABEL_LEN];
+    // Synthetic: the response of each class on each channel
+    float *amplitude;       // [class_count][TRACE_CHANNELS]
+    float *rise_tau;
+    float *decay_tau;
+    // Replayed: whole windows, cycled through
+    float *samples;         // [window_count][TRACE_CHANNELS][TRACE_FRAME_LEN]
+    uint16_t *window_class;
+    uint16_t *sample_class; // [window_count * TRACE_FRAME_LEN], TRACE_REST where unlabelled
+    uint32_t window_count;
+} trace_t;
+
+// Sets up synthetic exposures of class_count smells.
+int trace_synthetic(trace_t *trace, uint16_t class_count, uint32_t seed);
+
+// Synthesises a session of `samples` seconds, as if it had been recorded:
+// room air that drifts, and now and then a smell presented for a minute,
+// its samples labelled. The SGP30 channels are whole numbers, as the
+// sensor reports them.
+int trace_synthetic_session(trace_t *trace, uint16_t class_count, uint32_t seed, uint32_t samples);
+
+// Loads a recording, either a CSV or a binary one from the device's
+// recorder (see smell_session.c). Each CSV line is one sample: a
+// label, which may be empty, then TRACE_CHANNELS values; a binary one is
+// labelled by its header. Every TRACE_FRAME_LEN samples make a window,
+// labelled by its first sample. Returns -1 if the file cannot be read,
+// is damaged, or holds no whole window.
+int trace_replay(trace_t *trace, const char *path);
+
+void trace_free(trace_t *trace);
+
+// Writes window `index` to rows and returns its class. The same index
+// always gives the same window.
+uint16_t trace_window(const trace_t *trace, uint32_t index, float rows[TRACE_CHANNELS][TRACE_FRAME_LEN]);
+
+// Writes sample `n` of a replayed trace or a session, n below
+// window_count * TRACE_FRAME_LEN, and returns its class or TRACE_REST.
+uint16_t trace_sample(const trace_t *trace, uint32_t n, float values[TRACE_CHANNELS]);
@@ -0,0 +1,198 @@
+#include <math.h>
+#include <string.h>
+
+#include "classifier.h"
+
+_Static_assert(sizeof(classifier_header_t) == 24, "classifier_header_t must match the blob layout");
+
+// Version 1 headers stop before the calibration
+#define HEADER_SIZE_V1 offsetof(classifier_header_t, temperature)
+
+// Keeps an exact match from dividing by zero
+#define DISTANCE_EPSILON 1e-6f
+
+#define ALIGN4(x) (((x) + 3) & ~(size_t)3)
+
+static size_t header_size(const classifier_header_t *header) {
+    if (header->magic != CLASSIFIER_MAGIC) {
+        return 0;
+    }
+    return header->version == CLASSIFIER_VERSION ? sizeof(classifier_header_t)
+        : header->version == 1 ? HEADER_SIZE_V1
+        : 0;
+}
+
+size_t classifier_blob_size(const classifier_header_t *header) {
+    const size_t size = header_size(header);
+    if (size == 0) {
+        return 0;
+    }
+    if (header->dim == 0 || header->dim > CLASSIFIER_MAX_DIM ||
+        header->class_count == 0 || header->class_count > CLASSIFIER_MAX_CLASSES ||
+        header->proto_count == 0) {
+        return 0;
+    }
+    if (header->kind == CLASSIFIER_CENTROID) {
+        if (header->proto_count != header->class_count) {
+            return 0;
+        }
+    } else if (header->kind == CLASSIFIER_KNN) {
+        if (header->k == 0 || header->k > CLASSIFIER_MAX_K) {
+            return 0;
+        }
+    } else {
+        return 0;
+    }
+
+    if (header->version == CLASSIFIER_VERSION &&
+        !(header->temperature > 0.0f && header->reject_distance >= 0.0f)) {
+        return 0;
+    }
+
+    return size
+        + (size_t)header->class_count * CLASSIFIER_LABEL_LEN
+        + 2 * (size_t)header->dim * sizeof(float)
+        + ALIGN4((size_t)header->proto_count * sizeof(uint16_t))
+        + (size_t)header->proto_count * header->dim * sizeof(float);
+}
+
+int classifier_load(classifier_model_t *model, const void *blob, size_t size) {
+    const uint8_t *base = (const uint8_t *)blob;
+    if (model == NULL || blob == NULL || ((uintptr_t)blob & 3) || size < HEADER_SIZE_V1) {
+        return -1;
+    }
+
+    const classifier_header_t *header = (const classifier_header_t *)base;
+    size_t blob_size = classifier_blob_size(header);
+    if (blob_size == 0 || blob_size > size) {
+        return -1;
+    }
+
+    const uint8_t *p = base + header_size(header);
+    model->header = header;
+    if (header->version == CLASSIFIER_VERSION) {
+        model->temperature = header->temperature;
+        model->reject_distance = header->reject_distance > 0.0f ? header->reject_distance : INFINITY;
+    } else {
+        model->temperature = 1.0f;
+        model->reject_distance = INFINITY;
+    }
+    model->labels = (const char (*)[CLASSIFIER_LABEL_LEN])p;
+    p += (size_t)header->class_count * CLASSIFIER_LABEL_LEN;
+    model->mean = (const float *)p;
+    p += header->dim * sizeof(float);
+    model->inv_std = (const float *)p;
+    p += header->dim * sizeof(float);
+    model->proto_class = (const uint16_t *)p;
+    p += ALIGN4((size_t)header->proto_count * sizeof(uint16_t));
+    model->protos = (const float *)p;
+
+    for (uint16_t c = 0; c < header->class_count; c++) {
+        if (memchr(model->labels[c], '\0', CLASSIFIER_LABEL_LEN) == NULL) {
+            return -1;
+        }
+    }
+    for (uint16_t i = 0; i < header->proto_count; i++) {
+        if (model->proto_class[i] >= header->class_count) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+float classifier_softmax(const float *distance, uint16_t count, uint16_t index, float temperature) {
+    // Shifting by the nearest distance keeps every exponent at or below 0
+    float nearest = INFINITY;
+    for (uint16_t c = 0; c < count; c++) {
+        if (distance[c] < nearest) {
+            nearest = distance[c];
+        }
+    }
+    if (!isfinite(nearest) || !isfinite(distance[index])) {
+        return 0.0f;
+    }
+    float total = 0.0f;
+    for (uint16_t c = 0; c < count; c++) {
+        if (isfinite(distance[c])) {
+            total += expf((nearest - distance[c]) / temperature);
+        }
+    }
+    return expf((nearest - distance[index]) / temperature) / total;
+}
+
+// Squared distance, giving up as soon as it passes `limit`
+static float distance_sq(const float *a, const float *b, uint16_t dim, float limit) {
+    float sum = 0.0f;
+    for (uint16_t i = 0; i < dim; i++) {
+        float d = a[i] - b[i];
+        sum += d * d;
+        if (sum > limit) {
+            break;
+        }
+    }
+    return sum;
+}
+
+int classifier_classify(const classifier_model_t *model, const float *features, classifier_result_t *result) {
+    const classifier_header_t *header = model->header;
+    if (header == NULL || header->proto_count == 0) {
+        return -1;
+    }
+    const uint16_t dim = header->dim;
+    const uint16_t k = header->kind == CLASSIFIER_KNN ? header->k : header->proto_count;
+
+    float x[CLASSIFIER_MAX_DIM];
+    for (uint16_t i = 0; i < dim; i++) {
+        x[i] = (features[i] - model->mean[i]) * model->inv_std[i];
+    }
+
+    // The k nearest prototypes, sorted by distance. A centroid model has
+    // one prototype per class, so keeping all of them ranks every class.
+    float near_dist[CLASSIFIER_MAX_CLASSES > CLASSIFIER_MAX_K ? CLASSIFIER_MAX_CLASSES : CLASSIFIER_MAX_K];
+    uint16_t near_class[sizeof(near_dist) / sizeof(near_dist[0])];
+    uint16_t near_count = 0;
+
+    for (uint16_t p = 0; p < header->proto_count; p++) {
+        float limit = near_count == k ? near_dist[k - 1] : INFINITY;
+        float d = distance_sq(x, &model->protos[(size_t)p * dim], dim, limit);
+        if (d >= limit) {
+            continue;
+        }
+        uint16_t j = near_count < k ? near_count++ : k - 1;
+        while (j > 0 && near_dist[j - 1] > d) {
+            near_dist[j] = near_dist[j - 1];
+            near_class[j] = near_class[j - 1];
+            j--;
+        }
+        near_dist[j] = d;
+        near_class[j] = model->proto_class[p];
+    }
+
+    float weight[CLASSIFIER_MAX_CLASSES] = { 0 };
+    float class_dist[CLASSIFIER_MAX_CLASSES];
+    for (uint16_t c = 0; c < header->class_count; c++) {
+        class_dist[c] = INFINITY;
+    }
+    for (uint16_t j = 0; j < near_count; j++) {
+        float d = sqrtf(near_dist[j]);
+        float w = 1.0f / (d + DISTANCE_EPSILON);
+        weight[near_class[j]] += w;
+        if (d < class_dist[near_class[j]]) {
+            class_dist[near_class[j]] = d;
+        }
+    }
+
+    uint16_t best = near_class[0];
+    for (uint16_t c = 0; c < header->class_count; c++) {
+        if (weight[c] > weight[best]) {
+            best = c;
+        }
+    }
+
+    result->class_index = best;
+    result->label = model->labels[best];
+    result->confidence = classifier_softmax(class_dist, header->class_count, best, model->temperature);
+    result->distance = class_dist[best];
+    result->known = result->distance <= model->reject_distance;
+    return 0;
+}
@@ -0,0 +1,186 @@
+/**
+ * @file classifier.h
+ * @brief Nearest-centroid and k-nearest-neighbour classification of
+ * feature vectors against a model blob that is used in place.
+ *
+ * classifier_partition.c maps the blob out of flash on the device, and
+ * bench/classifier_eval reads the same blob from a file.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief First word of a model blob, "SMCL" read as little endian.
+ */
+/* @[declare_classifier_magic] */
+#define CLASSIFIER_MAGIC 0x4C434D53
+/* @[declare_classifier_magic] */
+
+/**
+ * @brief Blob layout version this code reads.
+ */
+/* @[declare_classifier_version] */
+#define CLASSIFIER_VERSION 2
+/* @[declare_classifier_version] */
+
+/**
+ * @brief Bytes reserved per class name, including the terminator.
+ */
+/* @[declare_classifier_label_len] */
+#define CLASSIFIER_LABEL_LEN 24
+/* @[declare_classifier_label_len] */
+
+/**
+ * @brief Largest feature vector and neighbour count the classifier
+ * keeps scratch space for.
+ */
+/* @[declare_classifier_max_dim] */
+#define CLASSIFIER_MAX_DIM 128
+#define CLASSIFIER_MAX_K 16
+#define CLASSIFIER_MAX_CLASSES 32
+/* @[declare_classifier_max_dim] */
+
+/**
+ * @brief How the prototypes in a model are used.
+ */
+/* @[declare_classifier_kind_t] */
+typedef enum {
+    CLASSIFIER_CENTROID = 0,    /**< One prototype per class, nearest wins. */
+    CLASSIFIER_KNN = 1,         /**< Any number of prototypes, the k nearest vote. */
+} classifier_kind_t;
+/* @[declare_classifier_kind_t] */
+
+/**
+ * @brief Start of a model blob. All fields are little endian.
+ *
+ * Version 1 blobs end the header after `k`; they load uncalibrated,
+ * with a temperature of 1 and no rejection. The header is followed,
+ * each part 4-byte aligned, by:
+ * 1. `char labels[class_count][CLASSIFIER_LABEL_LEN]`
+ * 2. `float mean[dim]` and `float inv_std[dim]`, the standardisation
+ *    applied to a feature vector before comparing it
+ * 3. `uint16_t proto_class[proto_count]`, padded to 4 bytes
+ * 4. `float protos[proto_count][dim]`, already standardised
+ */
+/* @[declare_classifier_header_t] */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t kind;
+    uint16_t dim;
+    uint16_t class_count;
+    uint16_t proto_count;
+    uint16_t k;
+    float temperature;      // distance scale of the softmax that gives the confidence
+    float reject_distance;  // nearest-class distance past which a sample is unknown, 0 for never
+} classifier_header_t;
+/* @[declare_classifier_header_t] */
+
+/**
+ * @brief A loaded model. Every pointer points into the blob, nothing is
+ * copied, so the blob has to stay mapped while the model is in use.
+ */
+/* @[declare_classifier_model_t] */
+typedef struct {
+    const classifier_header_t *header;
+    const char (*labels)[CLASSIFIER_LABEL_LEN];
+    const float *mean;
+    const float *inv_std;
+    const uint16_t *proto_class;
+    const float *protos;
+    float temperature;
+    float reject_distance;  // INFINITY if the model never rejects
+} classifier_model_t;
+/* @[declare_classifier_model_t] */
+
+/**
+ * @brief Outcome of one classification.
+ */
+/* @[declare_classifier_result_t] */
+typedef struct {
+    /*@{*/
+    uint16_t class_index;   /**< @brief Index into the model's labels. */
+    const char *label;      /**< @brief Name of the class, in the blob. */
+    float confidence;       /**< @brief Calibrated probability of the class, 0 to 1. */
+    float distance;         /**< @brief Euclidean distance to the nearest prototype of the class. */
+    bool known;             /**< @brief false if `distance` is past the model's rejection threshold, so the sample is likely none of the classes. */
+    /*@}*/
+} classifier_result_t;
+/* @[declare_classifier_result_t] */
+
+/**
+ * @brief Probability of one class from the distances to every class.
+ *
+ * A softmax of `-distance / temperature`, so nearer classes get more
+ * weight. Classes at an infinite distance get none. The temperature is
+ * fitted offline by tools/smell_model.py, so the result is a calibrated
+ * probability rather than a bare ranking.
+ *
+ * @param[in] distance `count` distances, in standard deviations.
+ * @param[in] count Classes.
+ * @param[in] index The class to give the probability of.
+ * @param[in] temperature Positive.
+ * @return The probability, 0 to 1.
+ */
+/* @[declare_classifier_softmax] */
+float classifier_softmax(const float *distance, uint16_t count, uint16_t index, float temperature);
+/* @[declare_classifier_softmax] */
+
+/**
+ * @brief Size of a blob with the given header.
+ *
+ * @return Bytes, or 0 if the header is not one this code can read.
+ */
+/* @[declare_classifier_blob_size] */
+size_t classifier_blob_size(const classifier_header_t *header);
+/* @[declare_classifier_blob_size] */
+
+/**
+ * @brief Checks a blob and points a model at its sections.
+ *
+ * **Example:**
+ * @code{c}
+ *  classifier_model_t model;
+ *  classifier_result_t result;
+ *  if (classifier_load(&model, blob, blob_size) == 0 &&
+ *      classifier_classify(&model, features, &result) == 0) {
+ *      printf("%s (%.0f%%)\n", result.label, result.confidence * 100);
+ *  }
+ * @endcode
+ *
+ * @param[out] model The model.
+ * @param[in] blob The blob, 4-byte aligned.
+ * @param[in] size Bytes available at `blob`, may be more than the blob.
+ * @return 0 on success, -1 if the blob is malformed, truncated or of
+ * another version.
+ */
+/* @[declare_classifier_load] */
+int classifier_load(classifier_model_t *model, const void *blob, size_t size);
+/* @[declare_classifier_load] */
+
+/**
+ * @brief Classifies one feature vector.
+ *
+ * Does not allocate. Runs in time proportional to
+ * `proto_count * dim`.
+ *
+ * @param[in] model A loaded model.
+ * @param[in] features `dim` raw, unstandardised features.
+ * @param[out] result The winning class.
+ * @return 0 on success, -1 if the model is empty.
+ */
+/* @[declare_classifier_classify] */
+int classifier_classify(const classifier_model_t *model, const float *features, classifier_result_t *result);
+/* @[declare_classifier_classify] */
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,44 @@
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_partition.h"
+
+#include "classifier_partition.h"
+
+#define TAG "CLASSIFIER"
+
+esp_err_t classifier_map_partition(classifier_model_t *model, const char *label) {
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, CLASSIFIER_PARTITION_SUBTYPE, label);
+    if (partition == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    // Map just the header first so an erased partition does not cost a
+    // whole mapping
+    const void *ptr;
+    spi_flash_mmap_handle_t handle;
+    esp_err_t err = esp_partition_mmap(partition, 0, sizeof(classifier_header_t), SPI_FLASH_MMAP_DATA, &ptr, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    size_t size = classifier_blob_size((const classifier_header_t *)ptr);
+    spi_flash_munmap(handle);
+    if (size == 0 || size > partition->size) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    err = esp_partition_mmap(partition, 0, size, SPI_FLASH_MMAP_DATA, &ptr, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (classifier_load(model, ptr, size) != 0) {
+        spi_flash_munmap(handle);
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    const classifier_header_t *header = model->header;
+    ESP_LOGI(TAG, "Mapped %s model: %u classes, %u prototypes of %u features, %u bytes",
+             header->kind == CLASSIFIER_KNN ? "k-NN" : "centroid",
+             header->class_count, header->proto_count, header->dim, size);
+    ESP_LOGI(TAG, "Temperature %.2f, unknown past distance %.2f", model->temperature, model->reject_distance);
+    return ESP_OK;
+}
@@ -0,0 +1,50 @@
+/**
+ * @file classifier_partition.h
+ * @brief Maps a classifier model straight out of a flash partition.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "esp_err.h"
+
+#include "classifier.h"
+
+/**
+ * @brief Data partition subtype models are flashed to.
+ */
+/* @[declare_classifier_partition_subtype] */
+#define CLASSIFIER_PARTITION_SUBTYPE 0x40
+/* @[declare_classifier_partition_subtype] */
+
+/**
+ * @brief Maps the model partition into the data address space and
+ * loads the blob at its start.
+ *
+ * The model reads the flash through the cache, so it takes no RAM
+ * beyond the MMU pages. The mapping is kept for the life of the app.
+ *
+ * **Example:**
+ * @code{c}
+ *  static classifier_model_t model;
+ *  if (classifier_map_partition(&model, "model") != ESP_OK) {
+ *      ESP_LOGW(TAG, "No model flashed, identification disabled");
+ *  }
+ * @endcode
+ *
+ * @param[out] model The model.
+ * @param[in] label Name of the partition in the partition table.
+ * @return `ESP_OK`, `ESP_ERR_NOT_FOUND` if there is no such partition,
+ * or `ESP_ERR_INVALID_VERSION` if it does not hold a model this code
+ * can read.
+ */
+/* @[declare_classifier_map_partition] */
+esp_err_t classifier_map_partition(classifier_model_t *model, const char *label);
+/* @[declare_classifier_map_partition] */
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,197 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "online_model.h"
+
+int online_model_init(online_model_t *model, uint16_t dim, uint16_t capacity, const float *mean, const float *inv_std) {
+    memset(model, 0, sizeof(online_model_t));
+    if (dim == 0 || dim > CLASSIFIER_MAX_DIM || capacity == 0 || capacity > CLASSIFIER_MAX_CLASSES) {
+        return -1;
+    }
+
+    // One block for the classes and one for both copies of their statistics
+    model->classes = (online_class_t *)calloc(capacity, sizeof(online_class_t));
+    float *stats = (float *)calloc((size_t)capacity * 4 * dim, sizeof(float));
+    if (model->classes == NULL || stats == NULL) {
+        free(model->classes);
+        free(stats);
+        model->classes = NULL;
+        return -1;
+    }
+    for (uint16_t c = 0; c < capacity; c++) {
+        online_class_t *cls = &model->classes[c];
+        for (int copy = 0; copy < 2; copy++) {
+            cls->mean[copy] = stats;
+            cls->m2[copy] = stats + dim;
+            stats += 2 * dim;
+        }
+        atomic_init(&cls->seq, 0);
+    }
+    atomic_init(&model->class_count, 0);
+    model->dim = dim;
+    model->capacity = capacity;
+    model->mean = mean;
+    model->inv_std = inv_std;
+    model->temperature = 1.0f;
+    model->reject_distance = INFINITY;
+    return 0;
+}
+
+void online_model_calibrate(online_model_t *model, float temperature, float reject_distance) {
+    model->temperature = temperature;
+    model->reject_distance = reject_distance;
+}
+
+void online_model_free(online_model_t *model) {
+    if (model->classes != NULL) {
+        free(model->classes[0].mean[0]);
+        free(model->classes);
+    }
+    memset(model, 0, sizeof(online_model_t));
+}
+
+// Labels never change once a class is published, so the lookup needs no
+// retry
+static int find_class(online_model_t *model, const char *label) {
+    unsigned count = atomic_load_explicit(&model->class_count, memory_order_acquire);
+    for (unsigned c = 0; c < count; c++) {
+        if (strncmp(model->classes[c].label, label, CLASSIFIER_LABEL_LEN - 1) == 0) {
+            return (int)c;
+        }
+    }
+    return -1;
+}
+
+static void welford(online_class_t *cls, int copy, const float *x, uint16_t dim) {
+    uint32_t n = ++cls->count[copy];
+    float *mean = cls->mean[copy];
+    float *m2 = cls->m2[copy];
+    for (uint16_t i = 0; i < dim; i++) {
+        float delta = x[i] - mean[i];
+        mean[i] += delta / n;
+        m2[i] += delta * (x[i] - mean[i]);
+    }
+}
+
+int online_model_update(online_model_t *model, const char *label, const float *features, uint32_t *count) {
+    if (model->classes == NULL || label == NULL || label[0] == '\0') {
+        return -1;
+    }
+    float x[CLASSIFIER_MAX_DIM];
+    for (uint16_t i = 0; i < model->dim; i++) {
+        x[i] = (features[i] - model->mean[i]) * model->inv_std[i];
+    }
+
+    int c = find_class(model, label);
+    if (c < 0) {
+        // Nobody reads a class before it is published, so it gets its
+        // first sample in both copies before that
+        unsigned n = atomic_load_explicit(&model->class_count, memory_order_relaxed);
+        if (n == model->capacity) {
+            return -1;
+        }
+        online_class_t *cls = &model->classes[n];
+        strncpy(cls->label, label, CLASSIFIER_LABEL_LEN - 1);
+        welford(cls, 0, x, model->dim);
+        welford(cls, 1, x, model->dim);
+        atomic_store_explicit(&model->class_count, n + 1, memory_order_release);
+        if (count != NULL) {
+            *count = 1;
+        }
+        return 0;
+    }
+
+    // Move readers to the odd copy while the even one is updated, then
+    // back, then bring the odd copy up to date
+    online_class_t *cls = &model->classes[c];
+    unsigned seq = atomic_load_explicit(&cls->seq, memory_order_relaxed);
+    atomic_store_explicit(&cls->seq, seq + 1, memory_order_release);
+    atomic_thread_fence(memory_order_release);
+    welford(cls, 0, x, model->dim);
+    atomic_store_explicit(&cls->seq, seq + 2, memory_order_release);
+    welford(cls, 1, x, model->dim);
+
+    if (count != NULL) {
+        *count = cls->count[0];
+    }
+    return 0;
+}
+
+uint32_t online_model_count(online_model_t *model, const char *label) {
+    return online_model_stats(model, label, NULL, NULL);
+}
+
+uint32_t online_model_stats(online_model_t *model, const char *label, float *mean, float *var) {
+    if (model->classes == NULL || label == NULL) {
+        return 0;
+    }
+    int c = find_class(model, label);
+    if (c < 0) {
+        return 0;
+    }
+    online_class_t *cls = &model->classes[c];
+    uint32_t n;
+    unsigned seq;
+    do {
+        seq = atomic_load_explicit(&cls->seq, memory_order_acquire);
+        const int copy = seq & 1;
+        n = cls->count[copy];
+        for (uint16_t i = 0; i < model->dim; i++) {
+            if (mean != NULL) {
+                mean[i] = cls->mean[copy][i];
+            }
+            if (var != NULL) {
+                var[i] = n > 1 ? cls->m2[copy][i] / (n - 1) : 0.0f;
+            }
+        }
+        atomic_thread_fence(memory_order_acquire);
+    } while (atomic_load_explicit(&cls->seq, memory_order_relaxed) != seq);
+    return n;
+}
+
+int online_model_classify(online_model_t *model, const float *features, classifier_result_t *result) {
+    unsigned class_count = model->classes != NULL
+        ? atomic_load_explicit(&model->class_count, memory_order_acquire)
+        : 0;
+    if (class_count == 0) {
+        return -1;
+    }
+
+    float x[CLASSIFIER_MAX_DIM];
+    for (uint16_t i = 0; i < model->dim; i++) {
+        x[i] = (features[i] - model->mean[i]) * model->inv_std[i];
+    }
+
+    float dist[CLASSIFIER_MAX_CLASSES];
+    for (unsigned c = 0; c < class_count; c++) {
+        online_class_t *cls = &model->classes[c];
+        unsigned seq;
+        float sum;
+        do {
+            seq = atomic_load_explicit(&cls->seq, memory_order_acquire);
+            const float *mean = cls->mean[seq & 1];
+            sum = 0.0f;
+            for (uint16_t i = 0; i < model->dim; i++) {
+                float d = x[i] - mean[i];
+                sum += d * d;
+            }
+            atomic_thread_fence(memory_order_acquire);
+        } while (atomic_load_explicit(&cls->seq, memory_order_relaxed) != seq);
+        dist[c] = sqrtf(sum);
+    }
+
+    uint16_t best = 0;
+    for (unsigned c = 0; c < class_count; c++) {
+        if (dist[c] < dist[best]) {
+            best = c;
+        }
+    }
+
+    result->class_index = best;
+    result->label = model->classes[best].label;
+    result->confidence = classifier_softmax(dist, class_count, best, model->temperature);
+    result->distance = dist[best];
+    result->known = dist[best] <= model->reject_distance;
+    return 0;
+}
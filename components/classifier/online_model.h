@@ -0,0 +1,155 @@
+/**
+ * @file online_model.h
+ * @brief Per-class running statistics of feature vectors, learnt one
+ * labelled sample at a time, and nearest-mean classification against
+ * them.
+ *
+ * Each class keeps a Welford running mean and per-feature variance of
+ * the standardised features, so an update costs O(dim) and nothing is
+ * ever retrained. The variance is diagonal; a full covariance would make
+ * every update O(dim^2).
+ *
+ * One task may update the model while any number of others classify
+ * with it, on either core. Each class keeps two copies of its statistics
+ * and a sequence counter telling readers which copy is stable. The
+ * writer updates one copy while readers use the other, so a reader only
+ * retries if an update finished while it was reading, and never waits on
+ * a writer that has been preempted.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "classifier.h"
+
+/**
+ * @brief Running statistics of one class.
+ */
+/* @[declare_online_class_t] */
+typedef struct {
+    atomic_uint seq;        // readers use copy `seq & 1`
+    uint32_t count[2];
+    float *mean[2];         // standardised
+    float *m2[2];           // sums of squared deviations from the mean
+    char label[CLASSIFIER_LABEL_LEN];
+} online_class_t;
+/* @[declare_online_class_t] */
+
+/**
+ * @brief A model. The standardisation is borrowed, typically from the
+ * flash model, and has to outlive it.
+ */
+/* @[declare_online_model_t] */
+typedef struct {
+    uint16_t dim;
+    uint16_t capacity;
+    atomic_uint class_count;
+    online_class_t *classes;
+    const float *mean;
+    const float *inv_std;
+    float temperature;      // see online_model_calibrate()
+    float reject_distance;
+} online_model_t;
+/* @[declare_online_model_t] */
+
+/**
+ * @brief Allocates room for `capacity` classes of `dim` features.
+ *
+ * **Example:**
+ * @code{c}
+ *  static online_model_t learned;
+ *  online_model_init(&learned, dim, CLASSIFIER_MAX_CLASSES, model.mean, model.inv_std);
+ *  online_model_update(&learned, "coffee", features, &count);
+ *  online_model_classify(&learned, features, &result);
+ * @endcode
+ *
+ * @param[out] model The model.
+ * @param[in] dim Features per vector, at most CLASSIFIER_MAX_DIM.
+ * @param[in] capacity Most classes, at most CLASSIFIER_MAX_CLASSES.
+ * @param[in] mean Subtracted from each feature before learning.
+ * @param[in] inv_std Multiplies each feature after `mean`.
+ * @return 0 on success, -1 for a bad size or if allocation failed.
+ */
+/* @[declare_online_model_init] */
+int online_model_init(online_model_t *model, uint16_t dim, uint16_t capacity, const float *mean, const float *inv_std);
+/* @[declare_online_model_init] */
+
+/**
+ * @brief Frees what online_model_init() allocated.
+ */
+/* @[declare_online_model_free] */
+void online_model_free(online_model_t *model);
+/* @[declare_online_model_free] */
+
+/**
+ * @brief Sets how distances turn into a confidence and when a sample is
+ * unknown, as for classifier_classify().
+ *
+ * A new model uses a temperature of 1 and never rejects. Normally set
+ * from the flash model, whose features are standardised the same way.
+ *
+ * @param[in] temperature Positive.
+ * @param[in] reject_distance Distance to the nearest class past which a
+ * sample is unknown, INFINITY for never.
+ */
+/* @[declare_online_model_calibrate] */
+void online_model_calibrate(online_model_t *model, float temperature, float reject_distance);
+/* @[declare_online_model_calibrate] */
+
+/**
+ * @brief Folds one labelled sample into its class, adding the class if
+ * it is new.
+ *
+ * Only one task may update a model at a time.
+ *
+ * @param[in] label Class name, truncated to CLASSIFIER_LABEL_LEN - 1.
+ * @param[in] features `dim` raw features.
+ * @param[out] count Samples the class now has, may be NULL.
+ * @return 0 on success, -1 for an empty label or if the model is full.
+ */
+/* @[declare_online_model_update] */
+int online_model_update(online_model_t *model, const char *label, const float *features, uint32_t *count);
+/* @[declare_online_model_update] */
+
+/**
+ * @brief Samples learnt for a class, 0 for an unknown one.
+ */
+/* @[declare_online_model_count] */
+uint32_t online_model_count(online_model_t *model, const char *label);
+/* @[declare_online_model_count] */
+
+/**
+ * @brief Copies a consistent snapshot of a class's statistics.
+ *
+ * @param[out] mean `dim` standardised means, may be NULL.
+ * @param[out] var `dim` standardised variances, may be NULL. Zero until
+ * the class has two samples.
+ * @return The class's sample count, 0 for an unknown class.
+ */
+/* @[declare_online_model_stats] */
+uint32_t online_model_stats(online_model_t *model, const char *label, float *mean, float *var);
+/* @[declare_online_model_stats] */
+
+/**
+ * @brief Classifies a feature vector by the nearest class mean.
+ *
+ * The distance and confidence mean the same as for
+ * classifier_classify() with a centroid model, so the two results can
+ * be compared. Does not allocate.
+ *
+ * @return 0 on success, -1 if no class has been learnt yet.
+ */
+/* @[declare_online_model_classify] */
+int online_model_classify(online_model_t *model, const float *features, classifier_result_t *result);
+/* @[declare_online_model_classify] */
+
+#ifdef __cplusplus
+}
+#endif
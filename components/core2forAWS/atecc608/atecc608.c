@@ -6,6 +6,7 @@
 #include "esp_log.h"
 
 #include "i2c_device.h"
+#include "i2c_async.h"
 #include "atecc608.h"
 
 /* mbedTLS includes */
@@ -57,7 +58,8 @@ ATCA_STATUS Atecc608_GetSerialString(char * sn) {
     int ret;
     uint8_t serial[ATCA_SERIAL_NUM_SIZE];
     
-    i2c_take_port(ATECC608_I2C_PORT, portMAX_DELAY);    
+    // Low priority like the HAL's own transfers, a touch read goes first
+    i2c_take_port_at(ATECC608_I2C_PORT, I2C_ASYNC_PRIO_LOW, portMAX_DELAY);
     ret = atcab_read_serial_number(serial);
     i2c_free_port(ATECC608_I2C_PORT);
     
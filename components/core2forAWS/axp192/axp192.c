@@ -130,8 +130,15 @@ float Axp192_GetAcinCurrent() {
  
 float Axp192_GetBatCurrent() {
     float ADCLSB = 0.5;
-    uint16_t current_in = Axp192_Read13Bit(AXP192_BAT_ADC_CURRENT_IN_REG);
-    uint16_t current_out = Axp192_Read13Bit(AXP192_BAT_ADC_CURRENT_OUT_REG);
+    uint8_t in_buf[2], out_buf[2];
+    const uint8_t regs[2] = { AXP192_BAT_ADC_CURRENT_IN_REG, AXP192_BAT_ADC_CURRENT_OUT_REG };
+    uint8_t *bufs[2] = { in_buf, out_buf };
+    const uint16_t lengths[2] = { 2, 2 };
+    if (Axp192_ReadBatch(regs, bufs, lengths, 2) == false) {
+        return 0;
+    }
+    uint16_t current_in = (in_buf[0] << 5) | (in_buf[1] & 0x1F);
+    uint16_t current_out = (out_buf[0] << 5) | (out_buf[1] & 0x1F);
     return ADCLSB * (current_in - current_out);
 }
  
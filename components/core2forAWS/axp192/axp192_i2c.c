@@ -1,5 +1,6 @@
 #include "stdint.h"
 #include "i2c_device.h"
+#include "i2c_async.h"
 #include "esp_err.h"
 
 #define AXP192_ADDR (0x34)
@@ -8,6 +9,8 @@ static I2CDevice_t axp192_device;
 
 void Axp192_I2CInit() {
     axp192_device = i2c_malloc_device(I2C_NUM_1, 21, 22, 400000, AXP192_ADDR);
+    // Battery and power polls can wait for touch and sensor reads
+    i2c_device_set_priority(axp192_device, I2C_ASYNC_PRIO_LOW);
 }
 
 bool Axp192_WriteBytes(uint8_t reg_addr, uint8_t *data, uint16_t length) {
@@ -54,6 +57,17 @@ uint16_t Axp192_Read12Bit(uint8_t reg_addr) {
     }
 }
 
+bool Axp192_ReadBatch(const uint8_t *reg_addrs, uint8_t **data, const uint16_t *lengths, uint8_t count) {
+    i2c_batch_t batch;
+    i2c_batch_begin(&batch, axp192_device);
+    for (uint8_t i = 0; i < count; i++) {
+        if (i2c_batch_add_read(&batch, reg_addrs[i], data[i], lengths[i]) != ESP_OK) {
+            return false;
+        }
+    }
+    return i2c_batch_commit(&batch) == ESP_OK;
+}
+
 uint16_t Axp192_Read13Bit(uint8_t reg_addr) {
     uint8_t buf[2];
     if (Axp192_ReadBytes(reg_addr, buf, 2)) {
@@ -5,6 +5,7 @@ extern "C" {
 #endif
 
 #include "stdint.h"
+#include "stdbool.h"
 void Axp192_I2CInit();
 
 void Axp192_WriteBytes(uint8_t reg_addr, uint8_t *data, uint16_t length);
@@ -19,6 +20,12 @@ uint8_t Axp192_Read8Bit(uint8_t reg_addr);
 
 uint16_t Axp192_Read12Bit(uint8_t reg_addr);
 
+/*
+    Read several registers in one I2C transaction, data[i] receives
+    lengths[i] bytes starting at reg_addrs[i]
+*/
+bool Axp192_ReadBatch(const uint8_t *reg_addrs, uint8_t **data, const uint16_t *lengths, uint8_t count);
+
 uint16_t Axp192_Read13Bit(uint8_t reg_addr);
 
 uint16_t Axp192_Read16Bit(uint8_t reg_addr);
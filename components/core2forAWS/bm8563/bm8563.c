@@ -1,5 +1,6 @@
 #include "bm8563.h"
 #include "i2c_device.h"
+#include "i2c_async.h"
 #include "driver/i2c.h"
 
 #include <string.h>
@@ -10,6 +11,7 @@ static I2CDevice_t bm8563_device;
 
 static void I2CInit() {
     bm8563_device = i2c_malloc_device(I2C_NUM_1, 21, 22, 400000, BM8563_ADDR);
+    i2c_device_set_priority(bm8563_device, I2C_ASYNC_PRIO_LOW);
 }
 
 static void I2CWrite(uint8_t addr, uint8_t* buf, uint8_t len) {
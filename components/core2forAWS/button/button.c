@@ -5,14 +5,26 @@
 
 #include "ft6336u.h"
 #include "button.h"
+#include "scheduler.h"
+
+#define BUTTON_UPDATE_PERIOD_MS 20
 
 Button_t* button_ahead = NULL;
 static SemaphoreHandle_t button_lock = NULL;
-static void Button_UpdateTask(void *arg);
+static void Button_UpdateJob(sched_job_t *job, void *arg);
+
+// Polling latency only matters to a finger, so the deadline is loose
+// enough to share wakeups with the touch and sensor jobs
+static sched_job_t button_job = {
+    .name = "button",
+    .fn = Button_UpdateJob,
+    .period_us = BUTTON_UPDATE_PERIOD_MS * 1000,
+    .deadline_us = BUTTON_UPDATE_PERIOD_MS * 1000,
+};
 
 void Button_Init() {
     button_lock = xSemaphoreCreateMutex();
-    xTaskCreatePinnedToCore(Button_UpdateTask, "Button", 2 * 1024, NULL, 1, NULL, 0);
+    scheduler_add(&button_job, 0);
 }
 
 Button_t* Button_Attach(uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
@@ -99,20 +111,17 @@ void Button_Update(Button_t* button, uint8_t press, uint16_t x, uint16_t y) {
     button->value = value;
 }
 
-static void Button_UpdateTask(void *arg) {
+static void Button_UpdateJob(sched_job_t *job, void *arg) {
     Button_t* button;
     uint16_t x, y;
     bool press;
 
-    for (;;) {
-        FT6336U_GetTouch(&x, &y, &press);
-        xSemaphoreTake(button_lock, portMAX_DELAY);
-        button = button_ahead;
-        while (button != NULL) {
-            Button_Update(button, press, x, y);
-            button = button->next;
-        }
-        xSemaphoreGive(button_lock);
-        vTaskDelay(pdMS_TO_TICKS(20));
+    FT6336U_GetTouch(&x, &y, &press);
+    xSemaphoreTake(button_lock, portMAX_DELAY);
+    button = button_ahead;
+    while (button != NULL) {
+        Button_Update(button, press, x, y);
+        button = button->next;
     }
+    xSemaphoreGive(button_lock);
 }
\ No newline at end of file
@@ -11,10 +11,12 @@
 #include "esp_log.h"
 
 #include "core2forAWS.h"
+#include "i2c_async.h"
 
 #if CONFIG_SOFTWARE_EXPPORTS_SUPPORT
 #include <driver/adc.h>
 #include <driver/dac.h>
+#include <driver/i2s.h>
 #include "esp_adc_cal.h"
 #include "soc/dac_channel.h"
 
@@ -24,6 +26,12 @@ static esp_adc_cal_characteristics_t *adc_characterization;
 #define ADC_WIDTH               ADC_WIDTH_BIT_12
 #define ADC_ATTENUATION         ADC_ATTEN_DB_11
 #define DAC_CHANNEL             DAC_GPIO26_CHANNEL
+// The built-in ADC can only be DMA'd through I2S0
+#define ADC_STREAM_I2S_NUM      I2S_NUM_0
+#define ADC_STREAM_DMA_BUF_LEN  256
+#define ADC_STREAM_DMA_BUF_CNT  4
+
+static bool adc_streaming = false;
 
 #endif
 
@@ -50,6 +58,11 @@ void Core2ForAWS_Init(void) {
     Core2ForAWS_PMU_Init(0, 0, 0, 0);
 #endif
 
+    // Above the priority of every I2C client so queued requests never starve
+    i2c_async_init(6, 0);
+    // Touch, buttons and sensor sampling all run as jobs on this task
+    scheduler_start(5, 1);
+
 #if CONFIG_SOFTWARE_FT6336U_SUPPORT
     FT6336U_Init();
 #endif
@@ -537,6 +550,74 @@ uint32_t Core2ForAWS_Port_B_ADC_ReadMilliVolts(void){
     return voltage;
 }
 
+uint32_t Core2ForAWS_Port_B_ADC_RawToMilliVolts(uint32_t raw){
+    return esp_adc_cal_raw_to_voltage(raw, adc_characterization);
+}
+
+esp_err_t Core2ForAWS_Port_B_ADC_StreamBegin(uint32_t sample_rate){
+    if (adc_characterization == NULL || adc_streaming){
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    i2s_config_t i2s_config = {
+        .mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX | I2S_MODE_ADC_BUILT_IN),
+        .sample_rate = sample_rate,
+        .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
+        .channel_format = I2S_CHANNEL_FMT_ONLY_LEFT,
+#if ESP_IDF_VERSION > ESP_IDF_VERSION_VAL(4, 1, 0)
+        .communication_format = I2S_COMM_FORMAT_STAND_I2S,
+#else
+        .communication_format = I2S_COMM_FORMAT_I2S,
+#endif
+        .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
+        .dma_buf_count = ADC_STREAM_DMA_BUF_CNT,
+        .dma_buf_len = ADC_STREAM_DMA_BUF_LEN,
+        .use_apll = false,
+    };
+
+    esp_err_t err = i2s_driver_install(ADC_STREAM_I2S_NUM, &i2s_config, 0, NULL);
+    if(err != ESP_OK){
+        ESP_LOGE(TAG, "I2S driver installation failed for ADC streaming. Error code: %d", err);
+        return err;
+    }
+    err = i2s_set_adc_mode(ADC_UNIT_1, ADC_CHANNEL);
+    if(err == ESP_OK){
+        err = i2s_adc_enable(ADC_STREAM_I2S_NUM);
+    }
+    if(err != ESP_OK){
+        ESP_LOGE(TAG, "Enabling ADC over I2S failed. Error code: %d", err);
+        i2s_driver_uninstall(ADC_STREAM_I2S_NUM);
+        return err;
+    }
+    adc_streaming = true;
+    return ESP_OK;
+}
+
+size_t Core2ForAWS_Port_B_ADC_StreamRead(uint16_t *raw, size_t count, TickType_t timeout){
+    if (!adc_streaming){
+        return 0;
+    }
+    size_t bytes_read = 0;
+    i2s_read(ADC_STREAM_I2S_NUM, raw, count * sizeof(uint16_t), &bytes_read, timeout);
+
+    // The top four bits of each DMA word carry the channel number
+    size_t samples = bytes_read / sizeof(uint16_t);
+    for (size_t i = 0; i < samples; i++){
+        raw[i] &= 0x0FFF;
+    }
+    return samples;
+}
+
+esp_err_t Core2ForAWS_Port_B_ADC_StreamEnd(void){
+    if (!adc_streaming){
+        return ESP_ERR_INVALID_STATE;
+    }
+    i2s_adc_disable(ADC_STREAM_I2S_NUM);
+    esp_err_t err = i2s_driver_uninstall(ADC_STREAM_I2S_NUM);
+    adc_streaming = false;
+    return err;
+}
+
 esp_err_t Core2ForAWS_Port_B_DAC_WriteMilliVolts(uint16_t mvolts){
     esp_err_t err = dac_output_voltage(DAC_CHANNEL, mvolts);
     return err;
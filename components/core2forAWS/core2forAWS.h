@@ -6,6 +6,7 @@
 #pragma once
 #include "axp192.h"
 #include "freertos/FreeRTOS.h"
+#include "scheduler.h"
 
 #if CONFIG_SOFTWARE_ILI9342C_SUPPORT || CONFIG_SOFTWARE_SDCARD_SUPPORT
 #include "freertos/semphr.h"
@@ -255,7 +256,9 @@ typedef enum {
  *
  * At minimum, this helper function initializes the AXP192 power
  * management unit (PMU) with the green LED and vibration motor
- * off, as well as initializing the following features (if enabled):
+ * off, and starting the I2C request queue and the job scheduler (see
+ * scheduler.h) that polls touch, buttons and sensors, as well as
+ * initializing the following features (if enabled):
  * 1. Display — initializes the SPI bus, also powers the controller and
  * backlight to ~50% brightness.
  * 2. The touch controller via the FT6336U.
@@ -1239,6 +1242,84 @@ uint32_t Core2ForAWS_Port_B_ADC_ReadRaw(void);
 uint32_t Core2ForAWS_Port_B_ADC_ReadMilliVolts(void);
 /* @[declare_core2foraws_port_b_adc_readmillivolts] */
 
+/**
+ * @brief Converts a raw Port B ADC reading to millivolts.
+ *
+ * @note Uses the etched eFuse VRef calibration.
+ * @note pin_mode_t for PORT_B_ADC_PIN must be set to ADC before using
+ * Core2ForAWS_Port_B_ADC_RawToMilliVolts.
+ *
+ * Useful when averaging several Core2ForAWS_Port_B_ADC_ReadRaw() readings,
+ * since the average only needs converting once.
+ *
+ * @param[in] raw A reading from Core2ForAWS_Port_B_ADC_ReadRaw(), or an
+ * average of several.
+ * @return The calibrated voltage in millivolts.
+ */
+/* @[declare_core2foraws_port_b_adc_rawtomillivolts] */
+uint32_t Core2ForAWS_Port_B_ADC_RawToMilliVolts(uint32_t raw);
+/* @[declare_core2foraws_port_b_adc_rawtomillivolts] */
+
+/**
+ * @brief Starts continuous sampling of the Port B ADC into DMA buffers.
+ *
+ * @note pin_mode_t for PORT_B_ADC_PIN must be set to ADC before using
+ * Core2ForAWS_Port_B_ADC_StreamBegin.
+ * @note The ESP32 can only DMA the built-in ADC through I2S0, which the
+ * speaker and microphone also use. Call Core2ForAWS_Port_B_ADC_StreamEnd()
+ * before Microphone_Init() or Speaker_Init(), and do not start a stream
+ * while either is initialized. Core2ForAWS_Port_B_ADC_ReadRaw() must not
+ * be called while streaming.
+ *
+ * The hardware fills the DMA buffers at `sample_rate` without CPU
+ * involvement. Drain them with Core2ForAWS_Port_B_ADC_StreamRead() often
+ * enough that they do not overflow (1024 samples of buffering).
+ *
+ * **Example:**
+ *
+ * Read 8 kHz samples in blocks of 512 and average each block.
+ * @code{c}
+ *  uint16_t block[512];
+ *  Core2ForAWS_Port_PinMode(PORT_B_ADC_PIN, ADC);
+ *  Core2ForAWS_Port_B_ADC_StreamBegin(8000);
+ *  for (;;) {
+ *      size_t n = Core2ForAWS_Port_B_ADC_StreamRead(block, 512, portMAX_DELAY);
+ *      uint32_t sum = 0;
+ *      for (size_t i = 0; i < n; i++) {
+ *          sum += block[i];
+ *      }
+ *      ESP_LOGI(TAG, "%u mV", Core2ForAWS_Port_B_ADC_RawToMilliVolts(sum / n));
+ *  }
+ * @endcode
+ *
+ * @param[in] sample_rate Samples per second.
+ * @return [esp_err_t](https://docs.espressif.com/projects/esp-idf/en/release-v4.2/esp32/api-reference/system/esp_err.html#macros). 0 or `ESP_OK` if successful.
+ */
+/* @[declare_core2foraws_port_b_adc_streambegin] */
+esp_err_t Core2ForAWS_Port_B_ADC_StreamBegin(uint32_t sample_rate);
+/* @[declare_core2foraws_port_b_adc_streambegin] */
+
+/**
+ * @brief Copies raw 12-bit samples out of the ADC stream.
+ *
+ * @param[out] raw Buffer for the samples.
+ * @param[in] count Maximum number of samples to copy.
+ * @param[in] timeout Ticks to wait for the DMA to fill the buffer.
+ * @return Number of samples copied, 0 if no stream is running.
+ */
+/* @[declare_core2foraws_port_b_adc_streamread] */
+size_t Core2ForAWS_Port_B_ADC_StreamRead(uint16_t *raw, size_t count, TickType_t timeout);
+/* @[declare_core2foraws_port_b_adc_streamread] */
+
+/**
+ * @brief Stops the ADC stream and releases I2S0.
+ *
+ * @return [esp_err_t](https://docs.espressif.com/projects/esp-idf/en/release-v4.2/esp32/api-reference/system/esp_err.html#macros). 0 or `ESP_OK` if successful.
+ */
+/* @[declare_core2foraws_port_b_adc_streamend] */
+esp_err_t Core2ForAWS_Port_B_ADC_StreamEnd(void);
+/* @[declare_core2foraws_port_b_adc_streamend] */
+
 /**
  * @brief Outputs the specified voltage (millivolts) to the DAC.
  *
@@ -7,21 +7,38 @@
 
 #include "ft6336u.h"
 #include "i2c_device.h"
+#include "i2c_async.h"
+#include "scheduler.h"
 
 #define FT6336U_I2C_ADDR 0x38
 #define FT6336U_INTR_PIN 39
+#define FT6336U_POLL_PERIOD_MS 20
 
 static uint16_t _x, _y;
 static bool _pressed;
 static I2CDevice_t ft6336u_i2c;
-static xTaskHandle ft6336_task_handle;
 static SemaphoreHandle_t thread_mutex;
 
+// The read in flight, owned by the bus task until ft6336u_read_done is set
+static i2c_async_req_t ft6336u_req;
+static uint8_t ft6336u_buff[5];
+static bool ft6336u_in_flight;
+static volatile bool ft6336u_read_done;
+
 static void IRAM_ATTR FT6336U_ISRHandler(void* arg);
-static void FT6336U_UpdateTask(void *arg);
+static void FT6336U_UpdateJob(sched_job_t *job, void *arg);
+
+// Polls while a finger is down, otherwise sleeps until the interrupt
+static sched_job_t ft6336u_job = {
+    .name = "ft6336u",
+    .fn = FT6336U_UpdateJob,
+    .period_us = FT6336U_POLL_PERIOD_MS * 1000,
+    .deadline_us = FT6336U_POLL_PERIOD_MS * 1000 / 2,
+};
 
 void FT6336U_Init() {
     ft6336u_i2c = i2c_malloc_device(I2C_NUM_1, 21, 22, 400000, FT6336U_I2C_ADDR);
+    i2c_device_set_priority(ft6336u_i2c, I2C_ASYNC_PRIO_HIGH);
     i2c_write_byte(ft6336u_i2c, 0xa4, 0x00);
     
     thread_mutex = xSemaphoreCreateMutex();
@@ -32,35 +49,77 @@ void FT6336U_Init() {
     io_conf.mode = GPIO_MODE_INPUT;
     io_conf.pull_up_en = 1;
     gpio_config(&io_conf);
-    xTaskCreatePinnedToCore(FT6336U_UpdateTask, "FT6336Task", 2 * 1024, NULL, 1, &ft6336_task_handle, 0);
+    scheduler_add(&ft6336u_job, 0);
     gpio_install_isr_service(0);
-    gpio_isr_handler_add(FT6336U_INTR_PIN, FT6336U_ISRHandler, &ft6336_task_handle);
+    gpio_isr_handler_add(FT6336U_INTR_PIN, FT6336U_ISRHandler, &ft6336u_job);
 }
 
 static void IRAM_ATTR FT6336U_ISRHandler(void* arg) {
-    xTaskHandle task_handle = *(xTaskHandle *)arg;
-    xTaskResumeFromISR(task_handle);
+    BaseType_t task_woken = pdFALSE;
+    scheduler_kick_from_isr((sched_job_t *)arg, &task_woken);
+    if (task_woken) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+static void FT6336U_ReadDone(i2c_async_req_t *req) {
+    __atomic_store_n(&ft6336u_read_done, true, __ATOMIC_RELEASE);
 }
 
-static void FT6336U_UpdateTask(void *arg) {
-    uint8_t buff[5] = {0x00, 0x00, 0x00, 0x00, 0x00};
+static void FT6336U_Publish(const uint8_t *buff) {
     bool press_stash;
-    for (;;) {
-        i2c_read_bytes(ft6336u_i2c, 0x02, buff, 5);
-        
-        xSemaphoreTake(thread_mutex, portMAX_DELAY);
-        _pressed = buff[0] ? true : false;
-        _x = ((buff[1] & 0x0f) << 8) | buff[2];
-        _y = ((buff[3] & 0x0f) << 8) | buff[4];
-        press_stash = _pressed;
-        xSemaphoreGive(thread_mutex);
-
-        if (press_stash == false) {
-            vTaskSuspend(NULL);
-        } else {
-            vTaskDelay(pdMS_TO_TICKS(20));
+
+    xSemaphoreTake(thread_mutex, portMAX_DELAY);
+    _pressed = buff[0] ? true : false;
+    _x = ((buff[1] & 0x0f) << 8) | buff[2];
+    _y = ((buff[3] & 0x0f) << 8) | buff[4];
+    press_stash = _pressed;
+    xSemaphoreGive(thread_mutex);
+
+    if (press_stash == false) {
+        scheduler_stop_current();
+    }
+}
+
+// Hands the read to the bus task and comes back a tick later for the
+// result, rather than holding the scheduler task while other transfers
+// finish ahead of it
+static void FT6336U_UpdateJob(sched_job_t *job, void *arg) {
+    static const uint8_t released[5] = {0x00, 0x00, 0x00, 0x00, 0x00};
+
+    if (ft6336u_in_flight) {
+        if (!__atomic_load_n(&ft6336u_read_done, __ATOMIC_ACQUIRE)) {
+            scheduler_rerun_current(portTICK_PERIOD_MS * 1000);
+            return;
         }
+        ft6336u_in_flight = false;
+        FT6336U_Publish(ft6336u_req.err == ESP_OK ? ft6336u_buff : released);
+        return;
+    }
+
+    // Touch reads go ahead of everything else queued on the bus
+    ft6336u_req = (i2c_async_req_t){
+        .device = ft6336u_i2c,
+        .reg_addr = 0x02,
+        .data = ft6336u_buff,
+        .length = 5,
+        .is_read = true,
+        .priority = I2C_ASYNC_PRIO_HIGH,
+        .callback = FT6336U_ReadDone,
+    };
+    ft6336u_read_done = false;
+    esp_err_t err = i2c_async_submit(&ft6336u_req);
+    if (err == ESP_OK || err == ESP_ERR_NO_MEM) {
+        // A full queue gets another go next tick
+        ft6336u_in_flight = (err == ESP_OK);
+        scheduler_rerun_current(portTICK_PERIOD_MS * 1000);
+        return;
+    }
+    if (err == ESP_ERR_INVALID_STATE) {
+        // Bus task not running
+        err = i2c_read_bytes(ft6336u_i2c, 0x02, ft6336u_buff, 5);
     }
+    FT6336U_Publish(err == ESP_OK ? ft6336u_buff : released);
 }
 
 void FT6336U_GetTouch(uint16_t* x, uint16_t* y, bool* press_down) {
@@ -10,17 +10,17 @@
  * 
  * @note The Core2ForAWS_Init() calls this function
  * when the hardware feature is enabled.
- * @note It creates a FreeRTOS task with the task name `FT6336Task` and installs
+ * @note It adds a job to the scheduler (see scheduler.h) and installs
  * an ISR on the interrupt pin FT6336U_INTR_PIN.
  *
  * The most recent button press state is stored within the library and can
  * be queried using the functions provided by this library.
  *
- * The FreeRTOS task remains suspended and only resumes when the screen is
- * pressed (which is informed by the FT6336U using the interrupt on the
- * FT6336U_INTR_PIN). If multiple press events are stashed by the hardware, the
- * FreeRTOS task keeps retrieving them one by one at an interval of 20 ticks.
- * Once all the events are retrieved, the task suspends itself.
+ * The job stays off the scheduler until the screen is pressed (which is
+ * informed by the FT6336U using the interrupt on the FT6336U_INTR_PIN).
+ * While a finger is down it reads the panel every 20 ms through the I2C
+ * bus task, collecting each read a tick after it was queued. Once the
+ * finger lifts, the job stops again.
  */
 /* @[declare_ft6336_init] */
 void FT6336U_Init();
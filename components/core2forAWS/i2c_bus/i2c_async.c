@@ -0,0 +1,382 @@
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+
+#include "i2c_device.h"
+#include "i2c_async.h"
+
+#define TAG "I2C-ASYNC"
+
+// Tasks that can wait for the bus in i2c_async_acquire at once
+#define I2C_ASYNC_LEASES 8
+
+_Static_assert(I2C_ASYNC_PRIO_NORMAL == I2C_DEVICE_PRIORITY_DEFAULT, "devices default to normal priority");
+
+typedef enum {
+    LEASE_FREE,
+    LEASE_WAITING,
+    LEASE_GRANTED,
+    LEASE_ABANDONED,    // its task timed out, the bus task frees it
+} lease_state_t;
+
+/*
+    A synchronous caller's place in the queues. Kept here rather than on
+    the caller's stack, so a caller that times out can leave it queued.
+*/
+typedef struct {
+    i2c_async_req_t req;    // first, the queues hold its address
+    StaticSemaphore_t granted_buf;
+    SemaphoreHandle_t granted;
+    lease_state_t state;
+} i2c_async_lease_t;
+
+static QueueHandle_t async_queue[I2C_ASYNC_PRIO_MAX];
+static TaskHandle_t async_task_handle;
+// Given by a task that is done with the bus it was granted
+static SemaphoreHandle_t async_release;
+static i2c_async_lease_t async_leases[I2C_ASYNC_LEASES];
+static SemaphoreHandle_t async_leases_free;
+static portMUX_TYPE async_lease_lock = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t async_stats_mutex;
+static i2c_async_stats_t async_stats[I2C_ASYNC_PRIO_MAX];
+
+static esp_err_t i2c_async_hw_execute(i2c_async_req_t *req, void *ctx) {
+    if (req->is_read) {
+        return i2c_read_bytes(req->device, req->reg_addr, req->data, req->length);
+    }
+    return i2c_write_bytes(req->device, req->reg_addr, req->data, req->length);
+}
+
+static i2c_async_backend_t async_backend = {
+    .execute = i2c_async_hw_execute,
+    .ctx = NULL,
+};
+
+static void i2c_async_sim_done(void *arg) {
+    xSemaphoreGive((SemaphoreHandle_t)arg);
+}
+
+static esp_err_t i2c_async_sim_execute(i2c_async_req_t *req, void *ctx) {
+    i2c_async_sim_t *sim = (i2c_async_sim_t *)ctx;
+    uint64_t duration_us = sim->base_us + (uint64_t)req->length * sim->byte_us;
+    // Block on a timer like the driver blocks on its ISR, so the bus task
+    // leaves the core to lower priority tasks for the whole transfer
+    if (duration_us > 0) {
+        esp_timer_start_once(sim->timer, duration_us);
+        xSemaphoreTake(sim->done, portMAX_DELAY);
+    }
+    if (req->is_read && req->length > 0) {
+        memset(req->data, 0, req->length);
+    }
+    return ESP_OK;
+}
+
+static void i2c_async_account(i2c_async_req_t *req) {
+    int64_t latency_us = esp_timer_get_time() - req->submit_us;
+
+    xSemaphoreTake(async_stats_mutex, portMAX_DELAY);
+    i2c_async_stats_t *stats = &async_stats[req->priority];
+    stats->completed++;
+    if (req->err != ESP_OK) {
+        stats->errors++;
+    }
+    stats->latency_sum_us += latency_us;
+    if (latency_us > stats->latency_max_us) {
+        stats->latency_max_us = latency_us;
+    }
+    xSemaphoreGive(async_stats_mutex);
+}
+
+static void i2c_async_complete(i2c_async_req_t *req) {
+    i2c_async_account(req);
+
+    // Read notify_task first, the callback may hand the descriptor back to its owner
+    TaskHandle_t notify_task = req->notify_task;
+    if (req->callback != NULL) {
+        req->callback(req);
+    }
+    if (notify_task != NULL) {
+        xTaskNotify(notify_task, (uint32_t)req->err, eSetValueWithOverwrite);
+    }
+}
+
+// Highest priority first, so a waiting touch read jumps ahead of queued slow polls
+static i2c_async_req_t *i2c_async_next(void) {
+    i2c_async_req_t *req = NULL;
+    for (int prio = I2C_ASYNC_PRIO_MAX - 1; prio >= 0; prio--) {
+        if (xQueueReceive(async_queue[prio], &req, 0) == pdTRUE) {
+            return req;
+        }
+    }
+    return NULL;
+}
+
+// What is left of timeout since start
+static TickType_t i2c_async_ticks_left(TickType_t timeout, TickType_t start) {
+    if (timeout == portMAX_DELAY) {
+        return portMAX_DELAY;
+    }
+    TickType_t elapsed = xTaskGetTickCount() - start;
+    return elapsed < timeout ? timeout - elapsed : 0;
+}
+
+static void i2c_async_lease_free(i2c_async_lease_t *lease) {
+    portENTER_CRITICAL(&async_lease_lock);
+    lease->state = LEASE_FREE;
+    portEXIT_CRITICAL(&async_lease_lock);
+    xSemaphoreGive(async_leases_free);
+}
+
+/*
+    Hands the bus to a task waiting in i2c_async_acquire and blocks until
+    it is given back, or frees the lease of a task that gave up waiting.
+    The waiter frees its lease once granted, so it is accounted before
+    the grant and not touched after.
+*/
+static void i2c_async_grant(i2c_async_req_t *req) {
+    i2c_async_lease_t *lease = (i2c_async_lease_t *)req;
+    portENTER_CRITICAL(&async_lease_lock);
+    bool abandoned = (lease->state == LEASE_ABANDONED);
+    if (!abandoned) {
+        lease->state = LEASE_GRANTED;
+    }
+    portEXIT_CRITICAL(&async_lease_lock);
+
+    req->err = abandoned ? ESP_ERR_TIMEOUT : ESP_OK;
+    i2c_async_account(req);
+    if (abandoned) {
+        i2c_async_lease_free(lease);
+        return;
+    }
+    xSemaphoreGive(lease->granted);
+    xSemaphoreTake(async_release, portMAX_DELAY);
+}
+
+static void i2c_async_task(void *arg) {
+    for (;;) {
+        // One notification per submit, the count is drained request by request
+        ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+
+        i2c_async_req_t *req = i2c_async_next();
+        if (req == NULL) {
+            continue;
+        }
+        // Submitted requests always have a device, leases do not
+        if (req->device == NULL) {
+            i2c_async_grant(req);
+            continue;
+        }
+        req->err = async_backend.execute(req, async_backend.ctx);
+        i2c_async_complete(req);
+    }
+}
+
+/*
+    Arbiter for i2c_device. A task that wants the bus queues a lease at
+    its device's priority, so synchronous transfers wait in the same order
+    as submitted ones. The bus task's own transfers, and any made before
+    it runs, need no lease. A lease is for the whole bus task, whatever
+    the port, so i2c_device asks for one only when its task has none.
+*/
+static esp_err_t i2c_async_acquire(i2c_port_t port, uint8_t priority, TickType_t timeout, void *ctx) {
+    if (async_task_handle == NULL || xTaskGetCurrentTaskHandle() == async_task_handle) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    TickType_t start = xTaskGetTickCount();
+    if (xSemaphoreTake(async_leases_free, timeout) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    i2c_async_lease_t *lease = NULL;
+    portENTER_CRITICAL(&async_lease_lock);
+    for (int i = 0; i < I2C_ASYNC_LEASES; i++) {
+        if (async_leases[i].state == LEASE_FREE) {
+            lease = &async_leases[i];
+            lease->state = LEASE_WAITING;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&async_lease_lock);
+
+    i2c_async_req_t *req = &lease->req;
+    memset(req, 0, sizeof(*req));
+    req->priority = (priority < I2C_ASYNC_PRIO_MAX) ? priority : I2C_ASYNC_PRIO_HIGH;
+    req->submit_us = esp_timer_get_time();
+
+    // Unlike a submit, a full queue only makes the lease wait for room
+    if (xQueueSend(async_queue[req->priority], &req, i2c_async_ticks_left(timeout, start)) != pdTRUE) {
+        i2c_async_lease_free(lease);
+        return ESP_ERR_TIMEOUT;
+    }
+    xSemaphoreTake(async_stats_mutex, portMAX_DELAY);
+    async_stats[req->priority].submitted++;
+    xSemaphoreGive(async_stats_mutex);
+    xTaskNotifyGive(async_task_handle);
+
+    if (xSemaphoreTake(lease->granted, i2c_async_ticks_left(timeout, start)) != pdTRUE) {
+        // Unless the bus task granted it meanwhile, it frees the lease
+        // when it reaches it
+        portENTER_CRITICAL(&async_lease_lock);
+        bool granted = (lease->state == LEASE_GRANTED);
+        if (!granted) {
+            lease->state = LEASE_ABANDONED;
+        }
+        portEXIT_CRITICAL(&async_lease_lock);
+        if (!granted) {
+            return ESP_ERR_TIMEOUT;
+        }
+        xSemaphoreTake(lease->granted, portMAX_DELAY);
+    }
+    i2c_async_lease_free(lease);
+    return ESP_OK;
+}
+
+static void i2c_async_release(i2c_port_t port, void *ctx) {
+    xSemaphoreGive(async_release);
+}
+
+esp_err_t i2c_async_init(UBaseType_t task_priority, BaseType_t core) {
+    if (async_task_handle != NULL) {
+        return ESP_OK;
+    }
+
+    async_stats_mutex = xSemaphoreCreateMutex();
+    async_release = xSemaphoreCreateBinary();
+    async_leases_free = xSemaphoreCreateCounting(I2C_ASYNC_LEASES, I2C_ASYNC_LEASES);
+    if (async_stats_mutex == NULL || async_release == NULL || async_leases_free == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < I2C_ASYNC_LEASES; i++) {
+        async_leases[i].granted = xSemaphoreCreateBinaryStatic(&async_leases[i].granted_buf);
+    }
+    for (int prio = 0; prio < I2C_ASYNC_PRIO_MAX; prio++) {
+        async_queue[prio] = xQueueCreate(I2C_ASYNC_QUEUE_LEN, sizeof(i2c_async_req_t *));
+        if (async_queue[prio] == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    BaseType_t ret = xTaskCreatePinnedToCore(i2c_async_task, "I2CAsyncTask", 3 * 1024, NULL, task_priority, &async_task_handle, core);
+    if (ret != pdPASS) {
+        async_task_handle = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    // From here on every transfer on every port waits its turn in the queues
+    i2c_bus_arbiter_t arbiter = {
+        .acquire = i2c_async_acquire,
+        .release = i2c_async_release,
+    };
+    i2c_set_arbiter(&arbiter);
+    return ESP_OK;
+}
+
+esp_err_t i2c_async_submit(i2c_async_req_t *req) {
+    if (req == NULL || req->device == NULL || req->priority >= I2C_ASYNC_PRIO_MAX ||
+        (req->length > 0 && req->data == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (async_task_handle == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    req->err = ESP_ERR_INVALID_STATE;
+    req->submit_us = esp_timer_get_time();
+
+    BaseType_t queued = xQueueSend(async_queue[req->priority], &req, 0);
+    xSemaphoreTake(async_stats_mutex, portMAX_DELAY);
+    if (queued == pdTRUE) {
+        async_stats[req->priority].submitted++;
+    } else {
+        async_stats[req->priority].rejected++;
+    }
+    xSemaphoreGive(async_stats_mutex);
+
+    if (queued != pdTRUE) {
+        return ESP_ERR_NO_MEM;
+    }
+    xTaskNotifyGive(async_task_handle);
+    return ESP_OK;
+}
+
+esp_err_t i2c_async_transfer(i2c_async_req_t *req, TickType_t timeout) {
+    if (req == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    req->notify_task = xTaskGetCurrentTaskHandle();
+
+    // Drop a stale notification left by an earlier timed out transfer
+    xTaskNotifyWait(0, 0xffffffff, NULL, 0);
+
+    esp_err_t err = i2c_async_submit(req);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    uint32_t result = 0;
+    if (xTaskNotifyWait(0, 0xffffffff, &result, timeout) != pdTRUE) {
+        ESP_LOGW(TAG, "Transfer timed out, reg: 0x%02x", req->reg_addr);
+        return ESP_ERR_TIMEOUT;
+    }
+    return (esp_err_t)result;
+}
+
+void i2c_async_set_backend(const i2c_async_backend_t *backend) {
+    if (backend == NULL) {
+        async_backend.execute = i2c_async_hw_execute;
+        async_backend.ctx = NULL;
+        return ;
+    }
+    async_backend = *backend;
+}
+
+esp_err_t i2c_async_sim_backend(i2c_async_backend_t *backend, i2c_async_sim_t *sim) {
+    if (backend == NULL || sim == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (sim->done == NULL) {
+        sim->done = xSemaphoreCreateBinary();
+        if (sim->done == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        esp_timer_create_args_t timer_args = {
+            .callback = i2c_async_sim_done,
+            .arg = sim->done,
+            .name = "i2c_async_sim",
+        };
+        esp_err_t err = esp_timer_create(&timer_args, &sim->timer);
+        if (err != ESP_OK) {
+            vSemaphoreDelete(sim->done);
+            sim->done = NULL;
+            return err;
+        }
+    }
+    backend->execute = i2c_async_sim_execute;
+    backend->ctx = sim;
+    return ESP_OK;
+}
+
+esp_err_t i2c_async_get_stats(i2c_async_priority_t priority, i2c_async_stats_t *stats) {
+    if (priority >= I2C_ASYNC_PRIO_MAX || stats == NULL || async_stats_mutex == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreTake(async_stats_mutex, portMAX_DELAY);
+    *stats = async_stats[priority];
+    xSemaphoreGive(async_stats_mutex);
+    return ESP_OK;
+}
+
+void i2c_async_reset_stats(void) {
+    if (async_stats_mutex == NULL) {
+        return ;
+    }
+    xSemaphoreTake(async_stats_mutex, portMAX_DELAY);
+    memset(async_stats, 0, sizeof(async_stats));
+    xSemaphoreGive(async_stats_mutex);
+}
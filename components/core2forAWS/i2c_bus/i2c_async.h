@@ -0,0 +1,156 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+
+#include "i2c_device.h"
+
+/**
+ * @brief Request priorities, highest is served first.
+ */
+/* @[declare_i2c_async_priority_t] */
+typedef enum {
+    I2C_ASYNC_PRIO_LOW = 0,
+    I2C_ASYNC_PRIO_NORMAL,
+    I2C_ASYNC_PRIO_HIGH,
+    I2C_ASYNC_PRIO_MAX,
+} i2c_async_priority_t;
+/* @[declare_i2c_async_priority_t] */
+
+/**
+ * @brief Number of requests that can wait at each priority.
+ */
+/* @[declare_i2c_async_queue_len] */
+#define I2C_ASYNC_QUEUE_LEN 8
+/* @[declare_i2c_async_queue_len] */
+
+typedef struct i2c_async_req i2c_async_req_t;
+
+typedef void (*i2c_async_cb_t)(i2c_async_req_t *req);
+
+/**
+ * @brief One register read or write handed to the bus task.
+ *
+ * The descriptor and its data buffer belong to the bus task from
+ * i2c_async_submit() until completion is signalled, so neither may live
+ * on a stack frame that returns before then.
+ *
+ * Completion is signalled by calling `callback` on the bus task, then by
+ * notifying `notify_task` with the result as the notification value.
+ * Either or both may be NULL. Callbacks must not block.
+ */
+/* @[declare_i2c_async_req_t] */
+struct i2c_async_req {
+    I2CDevice_t device;
+    uint32_t reg_addr;
+    uint8_t *data;
+    uint16_t length;
+    bool is_read;
+    i2c_async_priority_t priority;
+    i2c_async_cb_t callback;
+    void *arg;
+    TaskHandle_t notify_task;
+    esp_err_t err;          // set before completion is signalled
+    int64_t submit_us;      // set by i2c_async_submit
+};
+/* @[declare_i2c_async_req_t] */
+
+/**
+ * @brief Executes one request on the bus. The default backend uses
+ * i2c_read_bytes() / i2c_write_bytes().
+ */
+/* @[declare_i2c_async_backend_t] */
+typedef struct {
+    esp_err_t (*execute)(i2c_async_req_t *req, void *ctx);
+    void *ctx;
+} i2c_async_backend_t;
+/* @[declare_i2c_async_backend_t] */
+
+/**
+ * @brief Counters for one priority level. Latency runs from submit to
+ * the end of the transfer, so it includes the time spent queued. For a
+ * synchronous transfer it runs until the caller was given the bus.
+ */
+/* @[declare_i2c_async_stats_t] */
+typedef struct {
+    uint32_t submitted;
+    uint32_t completed;
+    uint32_t rejected;      // queue was full
+    uint32_t errors;
+    uint64_t latency_sum_us;
+    uint32_t latency_max_us;
+} i2c_async_stats_t;
+/* @[declare_i2c_async_stats_t] */
+
+/*
+    Creates the per-priority queues and the bus-owner task, and makes it
+    the arbiter of i2c_device. From then on every synchronous transfer,
+    i2c_apply_bus() and i2c_take_port() also waits in the queue of its
+    device's priority (i2c_device_set_priority()), and its task gets the
+    bus when the bus task reaches it. A task must not wait for a
+    submitted request while it holds a port. Safe to call more than once.
+*/
+esp_err_t i2c_async_init(UBaseType_t task_priority, BaseType_t core);
+
+/*
+    Queues a request and returns immediately. ESP_ERR_NO_MEM when its
+    priority queue is full.
+*/
+esp_err_t i2c_async_submit(i2c_async_req_t *req);
+
+/*
+    Submits and blocks the calling task on a task notification until the
+    request completes. Overwrites req->notify_task. Returns the transfer
+    result, or ESP_ERR_TIMEOUT if it did not complete in time, in which
+    case the request is still owned by the bus task.
+*/
+esp_err_t i2c_async_transfer(i2c_async_req_t *req, TickType_t timeout);
+
+/*
+    Swaps the backend the bus task executes requests with. Pass NULL to
+    restore the hardware backend. Only call while no requests are queued.
+*/
+void i2c_async_set_backend(const i2c_async_backend_t *backend);
+
+/**
+ * @brief Latency model for the simulated backend.
+ */
+/* @[declare_i2c_async_sim_t] */
+typedef struct {
+    uint32_t base_us;   // per request, covers START, address and STOP
+    uint32_t byte_us;   // per data byte
+    esp_timer_handle_t timer;   // set up by i2c_async_sim_backend
+    SemaphoreHandle_t done;
+} i2c_async_sim_t;
+/* @[declare_i2c_async_sim_t] */
+
+/*
+    Fills in a backend that touches no hardware: each request blocks the
+    bus task on an esp_timer for base_us + length * byte_us, as the driver
+    blocks on its interrupt, and reads return zeros. Lets queueing
+    throughput and tail latency be measured without a device attached.
+    The sim struct must outlive its use as a backend.
+
+    i2c_async_sim_t sim = { .base_us = 100, .byte_us = 25 };
+    i2c_async_backend_t backend;
+    i2c_async_sim_backend(&backend, &sim);
+    i2c_async_set_backend(&backend);
+*/
+esp_err_t i2c_async_sim_backend(i2c_async_backend_t *backend, i2c_async_sim_t *sim);
+
+esp_err_t i2c_async_get_stats(i2c_async_priority_t priority, i2c_async_stats_t *stats);
+
+void i2c_async_reset_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,9 +1,13 @@
+#include <string.h>
+
 #include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "freertos/semphr.h"
 
 #include "driver/i2c.h"
 #include "esp_log.h"
 #include "esp_err.h"
+#include "esp_idf_version.h"
 
 #include "i2c_device.h"
 
@@ -29,24 +33,253 @@
 
 #define I2C_TIMEOUT_MS (100)
 
+// Distinct pin/frequency combinations that can be in use on one port
+#define I2C_PORT_CONFIGS_MAX (6)
+
 typedef struct _i2c_port_obj_t {
     i2c_port_t port;
     gpio_num_t scl;
     gpio_num_t sda;
     uint32_t freq;
+    uint8_t refs;
 } i2c_port_obj_t;
 
 typedef struct _i2c_device_t {
     i2c_port_obj_t* i2c_port;
     uint8_t addr;
+    uint8_t priority;
 } i2c_device_t;
 
 static SemaphoreHandle_t i2c_mutex[I2C_NUM_MAX];
-static i2c_port_obj_t *i2c_port_used[2] = { NULL, NULL };
+static i2c_bus_arbiter_t i2c_arbiter;
+// Who holds each port through i2c_port_lock, and how often
+static TaskHandle_t i2c_holder[I2C_NUM_MAX];
+static uint32_t i2c_hold_depth[I2C_NUM_MAX];
+static bool i2c_hold_arbitrated[I2C_NUM_MAX];
+// The task the arbiter gave the bus to, for all ports, and its
+// outermost port holds under that lease
+static TaskHandle_t i2c_lease_holder;
+static uint32_t i2c_lease_holds;
+// Devices with the same configuration share one interned entry
+static i2c_port_obj_t i2c_port_registry[I2C_NUM_MAX][I2C_PORT_CONFIGS_MAX];
+// What the controller is currently set up for, freq 0 until installed
+static i2c_port_obj_t i2c_port_active[I2C_NUM_MAX];
+static i2c_bus_stats_t i2c_stats[I2C_NUM_MAX];
+
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 4, 0)
+#define I2C_STATIC_LINK
+#endif
+
+/*
+    The command link of one transfer. It is built before the bus is taken
+    and deleted after it is given back, so the port mutex only covers the
+    transaction. ESP-IDF 4.4 and later can build a single transfer in the
+    caller's frame; the 4.2 driver this project pins has no static links,
+    so there every transfer allocates a descriptor and one node per
+    command, as does every batch.
+*/
+typedef struct {
+    i2c_cmd_handle_t cmd;
+    bool heap;
+#ifdef I2C_STATIC_LINK
+    // One register read or write: two STARTs, two address bytes, register,
+    // data, STOP
+    uint8_t buf[I2C_LINK_RECOMMENDED_SIZE(2)];
+#endif
+} i2c_link_t;
+
+static esp_err_t i2c_link_create(i2c_link_t* link, bool single) {
+#ifdef I2C_STATIC_LINK
+    if (single) {
+        link->cmd = i2c_cmd_link_create_static(link->buf, sizeof(link->buf));
+        link->heap = false;
+        if (link->cmd != NULL) {
+            return ESP_OK;
+        }
+    }
+#endif
+    link->cmd = i2c_cmd_link_create();
+    link->heap = true;
+    return (link->cmd != NULL) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+static void i2c_link_delete(i2c_link_t* link) {
+#ifdef I2C_STATIC_LINK
+    if (!link->heap) {
+        i2c_cmd_link_delete_static(link->cmd);
+        return ;
+    }
+#endif
+    i2c_cmd_link_delete(link->cmd);
+}
+
+static void i2c_cmd_add_read(i2c_cmd_handle_t cmd, uint8_t addr, uint32_t reg_addr, uint8_t *data, uint16_t length) {
+    if(!(reg_addr & I2C_NO_REG)){
+        i2c_master_start(cmd);
+        i2c_master_write_byte(cmd, (addr << 1) | I2C_MASTER_WRITE, 1);
+        i2c_master_write_byte(cmd, reg_addr, 1);
+    }
+
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (addr << 1) | I2C_MASTER_READ, 1);
+    if (length > 1) {
+        i2c_master_read(cmd, data, length - 1, I2C_MASTER_ACK);
+    }
+    if (length > 0) {
+        i2c_master_read_byte(cmd, &data[length-1], I2C_MASTER_NACK);
+    }
+}
+
+static void i2c_cmd_add_write(i2c_cmd_handle_t cmd, uint8_t addr, uint32_t reg_addr, uint8_t *data, uint16_t length) {
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (addr << 1) | I2C_MASTER_WRITE, 1);
+    if(!(reg_addr & I2C_NO_REG)){
+        i2c_master_write_byte(cmd, reg_addr, 1);
+    }
+    if (length > 0) {
+        i2c_master_write(cmd, data, length, 1);
+    }
+}
+
+// Address and register bytes the controller clocks out for one operation
+static uint32_t i2c_op_overhead(uint32_t reg_addr, bool is_read) {
+    if (reg_addr & I2C_NO_REG) {
+        return 1;
+    }
+    return is_read ? 3 : 2;
+}
+
+// Caller must hold the bus
+static esp_err_t i2c_cmd_execute(i2c_device_t* device, i2c_link_t* link, uint32_t bytes_written, uint32_t bytes_read) {
+    i2c_bus_stats_t* stats = &i2c_stats[device->i2c_port->port];
+    esp_err_t err = i2c_master_cmd_begin(device->i2c_port->port, link->cmd, pdMS_TO_TICKS(I2C_TIMEOUT_MS));
+    if (link->heap) {
+        stats->link_allocs++;
+    } else {
+        stats->static_links++;
+    }
+    stats->transactions++;
+    stats->bytes_written += bytes_written;
+    stats->bytes_read += bytes_read;
+    if (err != ESP_OK) {
+        stats->errors++;
+    }
+    return err;
+}
+
+/*
+    Takes the port for the calling task. Only a task's first hold on any
+    port waits for the arbiter, so a task can nest transfers inside
+    i2c_take_port(), or take a second port, without queueing behind its
+    own lease. The wait for the arbiter counts towards timeout.
+*/
+static BaseType_t i2c_port_lock(i2c_port_t i2c_num, uint8_t priority, TickType_t timeout) {
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    bool outermost = (i2c_holder[i2c_num] != self);
+    bool leased = (i2c_lease_holder == self);
+    bool acquired = false;
+    if (outermost && !leased && i2c_arbiter.acquire != NULL) {
+        TickType_t start = xTaskGetTickCount();
+        esp_err_t err = i2c_arbiter.acquire(i2c_num, priority, timeout, i2c_arbiter.ctx);
+        if (err == ESP_ERR_TIMEOUT) {
+            return pdFAIL;
+        }
+        acquired = (err == ESP_OK);
+        if (timeout != portMAX_DELAY) {
+            TickType_t elapsed = xTaskGetTickCount() - start;
+            timeout = elapsed < timeout ? timeout - elapsed : 0;
+        }
+    }
+    if (xSemaphoreTakeRecursive(i2c_mutex[i2c_num], timeout) != pdTRUE) {
+        if (acquired) {
+            i2c_arbiter.release(i2c_num, i2c_arbiter.ctx);
+        }
+        return pdFAIL;
+    }
+    if (outermost) {
+        i2c_holder[i2c_num] = self;
+        i2c_hold_arbitrated[i2c_num] = acquired || leased;
+        if (acquired || leased) {
+            i2c_lease_holder = self;
+            i2c_lease_holds++;
+        }
+    }
+    i2c_hold_depth[i2c_num]++;
+    return pdTRUE;
+}
+
+static BaseType_t i2c_port_unlock(i2c_port_t i2c_num) {
+    if (i2c_holder[i2c_num] != xTaskGetCurrentTaskHandle()) {
+        return pdFAIL;
+    }
+    if (--i2c_hold_depth[i2c_num] > 0) {
+        return xSemaphoreGiveRecursive(i2c_mutex[i2c_num]);
+    }
+    bool arbitrated = i2c_hold_arbitrated[i2c_num];
+    i2c_holder[i2c_num] = NULL;
+    BaseType_t ret = xSemaphoreGiveRecursive(i2c_mutex[i2c_num]);
+    // The lease goes back with the task's last port, in whatever order
+    // it freed them
+    if (arbitrated && --i2c_lease_holds == 0) {
+        i2c_lease_holder = NULL;
+        i2c_arbiter.release(i2c_num, i2c_arbiter.ctx);
+    }
+    return ret;
+}
+
+// Caller must hold the port mutex
+static i2c_port_obj_t* i2c_port_intern(i2c_port_t i2c_num, gpio_num_t sda, gpio_num_t scl, uint32_t freq) {
+    i2c_port_obj_t* free_slot = NULL;
+    for (uint8_t i = 0; i < I2C_PORT_CONFIGS_MAX; i++) {
+        i2c_port_obj_t* port_obj = &i2c_port_registry[i2c_num][i];
+        if (port_obj->refs == 0) {
+            if (free_slot == NULL) {
+                free_slot = port_obj;
+            }
+            continue;
+        }
+        if ((port_obj->sda == sda) && (port_obj->scl == scl) && (port_obj->freq == freq)) {
+            port_obj->refs++;
+            return port_obj;
+        }
+    }
+
+    if (free_slot == NULL) {
+        log_e("I2C port %d config registry full", i2c_num);
+        return NULL;
+    }
+    free_slot->port = i2c_num;
+    free_slot->sda = sda;
+    free_slot->scl = scl;
+    free_slot->freq = freq;
+    free_slot->refs = 1;
+    return free_slot;
+}
+
+// Caller must hold the port mutex
+static void i2c_port_release(i2c_port_obj_t* port_obj) {
+    if (port_obj->refs > 0) {
+        port_obj->refs--;
+    }
+}
+
+/*
+    Retimes the installed driver with the values i2c_param_config derives
+    from clk_speed. Much cheaper than a driver delete/install and leaves
+    the pins alone. Caller must hold the port mutex.
+*/
+static void i2c_port_set_clock(i2c_port_t i2c_num, uint32_t freq) {
+    int half_cycle = I2C_APB_CLK_FREQ / freq / 2;
+    i2c_set_period(i2c_num, half_cycle, half_cycle);
+    i2c_set_start_timing(i2c_num, half_cycle, half_cycle);
+    i2c_set_stop_timing(i2c_num, half_cycle, half_cycle);
+    i2c_set_data_timing(i2c_num, half_cycle / 2, half_cycle / 2);
+    i2c_set_timeout(i2c_num, half_cycle * 20);
+}
 
 I2CDevice_t i2c_malloc_device(i2c_port_t i2c_num, gpio_num_t sda, gpio_num_t scl, uint32_t freq, uint8_t device_addr) {
-    if (i2c_num > I2C_NUM_MAX) {
-        i2c_num = I2C_NUM_MAX;
+    if (i2c_num >= I2C_NUM_MAX || freq == 0) {
+        return NULL;
     }
 
     if (i2c_mutex[0] == NULL) {
@@ -57,23 +290,22 @@ I2CDevice_t i2c_malloc_device(i2c_port_t i2c_num, gpio_num_t sda, gpio_num_t scl
         i2c_mutex[1] = xSemaphoreCreateRecursiveMutex(); 
     }
 
-    i2c_port_obj_t* new_device_port = (i2c_port_obj_t *)malloc(sizeof(i2c_port_obj_t));
-    if (new_device_port == NULL) {
+    i2c_device_t* device = (i2c_device_t *)malloc(sizeof(i2c_device_t));
+    if (device == NULL) {
         return NULL;
     }
 
-    new_device_port->sda = sda;
-    new_device_port->scl = scl;
-    new_device_port->freq = freq;
-    new_device_port->port = i2c_num;
-
-    i2c_device_t* device = (i2c_device_t *)malloc(sizeof(i2c_device_t));
-    if (device == NULL) {
+    xSemaphoreTakeRecursive(i2c_mutex[i2c_num], portMAX_DELAY);
+    i2c_port_obj_t* device_port = i2c_port_intern(i2c_num, sda, scl, freq);
+    xSemaphoreGiveRecursive(i2c_mutex[i2c_num]);
+    if (device_port == NULL) {
+        free(device);
         return NULL;
     }
 
-    device->i2c_port = new_device_port;
+    device->i2c_port = device_port;
     device->addr = device_addr;
+    device->priority = I2C_DEVICE_PRIORITY_DEFAULT;
     log_i("New device malloc, scl: %d, sda: %d, freq: %d HZ",
         device->i2c_port->scl, device->i2c_port->sda, device->i2c_port->freq);
 
@@ -84,16 +316,24 @@ void i2c_free_device(I2CDevice_t i2c_device) {
     if (i2c_device == NULL) {
         return ;
     }
-    free(((i2c_device_t *)i2c_device)->i2c_port);
-    free(i2c_device);
+    i2c_device_t* device = (i2c_device_t *)i2c_device;
+    i2c_port_t i2c_num = device->i2c_port->port;
+    xSemaphoreTakeRecursive(i2c_mutex[i2c_num], portMAX_DELAY);
+    i2c_port_release(device->i2c_port);
+    xSemaphoreGiveRecursive(i2c_mutex[i2c_num]);
+    free(device);
 }
 
 BaseType_t i2c_take_port(i2c_port_t i2c_num, uint32_t timeout) {
+    return i2c_take_port_at(i2c_num, I2C_DEVICE_PRIORITY_DEFAULT, timeout);
+}
+
+BaseType_t i2c_take_port_at(i2c_port_t i2c_num, uint8_t priority, uint32_t timeout) {
     if (i2c_mutex[i2c_num] == NULL) {
         return pdFAIL;
     }
 
-    return xSemaphoreTakeRecursive(i2c_mutex[i2c_num], timeout);
+    return i2c_port_lock(i2c_num, priority, timeout);
 }
 
 BaseType_t i2c_free_port(i2c_port_t i2c_num) {
@@ -101,7 +341,23 @@ BaseType_t i2c_free_port(i2c_port_t i2c_num) {
         return pdFAIL;
     }
 
-    return xSemaphoreGiveRecursive(i2c_mutex[i2c_num]);
+    return i2c_port_unlock(i2c_num);
+}
+
+esp_err_t i2c_device_set_priority(I2CDevice_t i2c_device, uint8_t priority) {
+    if (i2c_device == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    ((i2c_device_t *)i2c_device)->priority = priority;
+    return ESP_OK;
+}
+
+void i2c_set_arbiter(const i2c_bus_arbiter_t *arbiter) {
+    if (arbiter == NULL) {
+        memset(&i2c_arbiter, 0, sizeof(i2c_arbiter));
+        return ;
+    }
+    i2c_arbiter = *arbiter;
 }
 
 esp_err_t i2c_apply_bus(I2CDevice_t i2c_device) {
@@ -110,27 +366,28 @@ esp_err_t i2c_apply_bus(I2CDevice_t i2c_device) {
     }
 
     i2c_device_t* device = (i2c_device_t *)i2c_device;
-    xSemaphoreTakeRecursive(i2c_mutex[device->i2c_port->port], portMAX_DELAY);
-    i2c_port_obj_t* used_port = i2c_port_used[device->i2c_port->port];
-    
-    if (used_port == device->i2c_port) {
+    i2c_port_t i2c_num = device->i2c_port->port;
+    i2c_port_lock(i2c_num, device->priority, portMAX_DELAY);
+    i2c_stats[i2c_num].bus_acquisitions++;
+    i2c_port_obj_t* active = &i2c_port_active[i2c_num];
+
+    if ((active->freq != 0) &&
+        (device->i2c_port->sda == active->sda) &&
+        (device->i2c_port->scl == active->scl)) {
+        if (active->freq != device->i2c_port->freq) {
+            i2c_port_set_clock(i2c_num, device->i2c_port->freq);
+            active->freq = device->i2c_port->freq;
+            i2c_stats[i2c_num].clock_changes++;
+            log_i("I2C clock update, port: %d, freq: %d HZ", i2c_num, active->freq);
+        }
         return ESP_OK;
     }
 
-    if ((used_port != NULL) && 
-        (device->i2c_port->sda == used_port->sda) && 
-        (device->i2c_port->scl == used_port->scl) && 
-        ((device->i2c_port->freq == used_port->freq))) {
-            i2c_port_used[device->i2c_port->port] = device->i2c_port;
-            return ESP_OK;    
-    }
-
-    if (used_port != NULL) {
-        i2c_driver_delete(device->i2c_port->port);
-        if ((device->i2c_port->sda != used_port->sda) || (device->i2c_port->scl != used_port->scl)) {
-            gpio_reset_pin(used_port->sda);
-            gpio_reset_pin(used_port->scl);
-        }
+    // Only a pin change needs the driver reinstalled
+    if (active->freq != 0) {
+        i2c_driver_delete(i2c_num);
+        gpio_reset_pin(active->sda);
+        gpio_reset_pin(active->scl);
     }
 
     i2c_config_t conf = {
@@ -142,10 +399,11 @@ esp_err_t i2c_apply_bus(I2CDevice_t i2c_device) {
         .master.clk_speed = device->i2c_port->freq,
     };
 
-    i2c_param_config(device->i2c_port->port, &conf);
-    i2c_driver_install(device->i2c_port->port, I2C_MODE_MASTER, 0, 0, 0);
+    i2c_param_config(i2c_num, &conf);
+    i2c_driver_install(i2c_num, I2C_MODE_MASTER, 0, 0, 0);
 
-    i2c_port_used[device->i2c_port->port] = device->i2c_port;
+    *active = *device->i2c_port;
+    i2c_stats[i2c_num].driver_installs++;
     log_i("I2C config update, scl: %d, sda: %d, freq: %d HZ",
             device->i2c_port->scl, device->i2c_port->sda, device->i2c_port->freq);
     return ESP_OK;
@@ -156,7 +414,7 @@ esp_err_t i2c_free_bus(I2CDevice_t i2c_device) {
         return ESP_ERR_INVALID_ARG;
     }
     i2c_device_t* device = (i2c_device_t *)i2c_device;
-    return (xSemaphoreGiveRecursive(i2c_mutex[device->i2c_port->port]) == pdTRUE) ? ESP_OK : ESP_FAIL;
+    return (i2c_port_unlock(device->i2c_port->port) == pdTRUE) ? ESP_OK : ESP_FAIL;
 }
 
 esp_err_t i2c_read_bytes(I2CDevice_t i2c_device, uint32_t reg_addr, uint8_t *data, uint16_t length) {
@@ -165,31 +423,19 @@ esp_err_t i2c_read_bytes(I2CDevice_t i2c_device, uint32_t reg_addr, uint8_t *dat
     }
 
     i2c_device_t* device = (i2c_device_t *)i2c_device;
-
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-
-    if(!(reg_addr & I2C_NO_REG)){
-        i2c_master_start(cmd);
-        i2c_master_write_byte(cmd, (device->addr << 1) | I2C_MASTER_WRITE, 1);
-        i2c_master_write_byte(cmd, reg_addr, 1);
-    }
- 
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (device->addr << 1) | I2C_MASTER_READ, 1);
-    if (length > 1) {
-        i2c_master_read(cmd, data, length - 1, I2C_MASTER_ACK);
-    }
-    if (length > 0) {
-        i2c_master_read_byte(cmd, &data[length-1], I2C_MASTER_NACK);
+    i2c_link_t link;
+    if (i2c_link_create(&link, true) != ESP_OK) {
+        return ESP_ERR_NO_MEM;
     }
-    i2c_master_stop(cmd);
+    i2c_cmd_add_read(link.cmd, device->addr, reg_addr, data, length);
+    i2c_master_stop(link.cmd);
     i2c_apply_bus(i2c_device);
     
     esp_err_t err = ESP_FAIL;
 
-    err = i2c_master_cmd_begin(device->i2c_port->port, cmd, pdMS_TO_TICKS(I2C_TIMEOUT_MS));
+    err = i2c_cmd_execute(device, &link, i2c_op_overhead(reg_addr, true), length);
     i2c_free_bus(i2c_device);
-    i2c_cmd_link_delete(cmd);
+    i2c_link_delete(&link);
 
     if (err != ESP_OK) {
         log_e("I2C Read Error: 0x%02x, reg: 0x%02x, length: %d, Code: 0x%x", device->addr, reg_addr, length, err);
@@ -207,31 +453,19 @@ esp_err_t i2c_read_bytes_no_stop(I2CDevice_t i2c_device, uint32_t reg_addr, uint
     }
 
     i2c_device_t* device = (i2c_device_t *)i2c_device;
-
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    
-    if(!(reg_addr & I2C_NO_REG)){
-        i2c_master_start(cmd);
-        i2c_master_write_byte(cmd, (device->addr << 1) | I2C_MASTER_WRITE, 1);
-        i2c_master_write_byte(cmd, reg_addr, 1);
-    }
-
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (device->addr << 1) | I2C_MASTER_READ, 1);
-    if (length > 1) {
-        i2c_master_read(cmd, data, length - 1, I2C_MASTER_ACK);
+    i2c_link_t link;
+    if (i2c_link_create(&link, true) != ESP_OK) {
+        return ESP_ERR_NO_MEM;
     }
-    if (length > 0) {
-        i2c_master_read_byte(cmd, &data[length-1], I2C_MASTER_NACK);
-    }
-    i2c_master_stop(cmd);
+    i2c_cmd_add_read(link.cmd, device->addr, reg_addr, data, length);
+    i2c_master_stop(link.cmd);
     i2c_apply_bus(i2c_device);
 
     esp_err_t err = ESP_FAIL;
     
-    err = i2c_master_cmd_begin(device->i2c_port->port, cmd, pdMS_TO_TICKS(I2C_TIMEOUT_MS));
+    err = i2c_cmd_execute(device, &link, i2c_op_overhead(reg_addr, true), length);
     i2c_free_bus(i2c_device);
-    i2c_cmd_link_delete(cmd);
+    i2c_link_delete(&link);
 
     if (err != ESP_OK) {
         log_e("I2C Read Error: 0x%02x, reg: 0x%02x, length: %d, Code: 0x%x", device->addr, reg_addr, length, err);
@@ -287,25 +521,19 @@ esp_err_t i2c_write_bytes(I2CDevice_t i2c_device, uint32_t reg_addr, uint8_t *da
     }
 
     i2c_device_t* device = (i2c_device_t *)i2c_device;
-
-    i2c_cmd_handle_t write_cmd = i2c_cmd_link_create();
-    i2c_master_start(write_cmd);
-    i2c_master_write_byte(write_cmd, (device->addr << 1) | I2C_MASTER_WRITE, 1);
-    if(!(reg_addr & I2C_NO_REG)){
-        i2c_master_write_byte(write_cmd, reg_addr, 1);
+    i2c_link_t link;
+    if (i2c_link_create(&link, true) != ESP_OK) {
+        return ESP_ERR_NO_MEM;
     }
-    if (length > 0) {
-        i2c_master_write(write_cmd, data, length, 1);
-    }
-    i2c_master_stop(write_cmd);
+    i2c_cmd_add_write(link.cmd, device->addr, reg_addr, data, length);
+    i2c_master_stop(link.cmd);
+    i2c_apply_bus(i2c_device);
 
     esp_err_t err = ESP_FAIL;
 
-    i2c_apply_bus(i2c_device);
-    err = i2c_master_cmd_begin(device->i2c_port->port, write_cmd, pdMS_TO_TICKS(I2C_TIMEOUT_MS));
+    err = i2c_cmd_execute(device, &link, i2c_op_overhead(reg_addr, false) + length, 0);
     i2c_free_bus(i2c_device);
-
-    i2c_cmd_link_delete(write_cmd);
+    i2c_link_delete(&link);
 
     if (err != ESP_OK) {
         log_e("I2C Write Error, addr: 0x%02x, reg: 0x%02x, length: %d, Code: 0x%x", device->addr, reg_addr, length, err);
@@ -357,18 +585,27 @@ esp_err_t i2c_device_change_freq(I2CDevice_t i2c_device, uint32_t freq) {
     if (i2c_device == NULL) {
         return ESP_FAIL;
     }
+    if (freq == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
     i2c_device_t* device = (i2c_device_t *)i2c_device;
-    xSemaphoreTakeRecursive(i2c_mutex[device->i2c_port->port], portMAX_DELAY);
+    i2c_port_t i2c_num = device->i2c_port->port;
+    xSemaphoreTakeRecursive(i2c_mutex[i2c_num], portMAX_DELAY);
     if (device->i2c_port->freq == freq) {
-        xSemaphoreGiveRecursive(i2c_mutex[device->i2c_port->port]);
+        xSemaphoreGiveRecursive(i2c_mutex[i2c_num]);
         return ESP_OK;
     }
 
-    device->i2c_port->freq = freq;
-    if (i2c_port_used[device->i2c_port->port] == device->i2c_port) {
-        i2c_port_used[device->i2c_port->port] = NULL;
+    // The old entry may be shared, so move the device to another one.
+    // The controller is retimed on the next i2c_apply_bus.
+    i2c_port_obj_t* new_port = i2c_port_intern(i2c_num, device->i2c_port->sda, device->i2c_port->scl, freq);
+    if (new_port == NULL) {
+        xSemaphoreGiveRecursive(i2c_mutex[i2c_num]);
+        return ESP_ERR_NO_MEM;
     }
-    xSemaphoreGiveRecursive(i2c_mutex[device->i2c_port->port]);
+    i2c_port_release(device->i2c_port);
+    device->i2c_port = new_port;
+    xSemaphoreGiveRecursive(i2c_mutex[i2c_num]);
     return ESP_OK;
 }
 
@@ -378,18 +615,169 @@ esp_err_t i2c_device_valid(I2CDevice_t i2c_device) {
     }
 
     i2c_device_t* device = (i2c_device_t *)i2c_device;
-
-    i2c_cmd_handle_t write_cmd = i2c_cmd_link_create();
-    i2c_master_start(write_cmd);
-    i2c_master_write_byte(write_cmd, (device->addr << 1) | I2C_MASTER_WRITE, 1);
-    i2c_master_stop(write_cmd);
+    i2c_link_t link;
+    if (i2c_link_create(&link, true) != ESP_OK) {
+        return ESP_ERR_NO_MEM;
+    }
+    i2c_master_start(link.cmd);
+    i2c_master_write_byte(link.cmd, (device->addr << 1) | I2C_MASTER_WRITE, 1);
+    i2c_master_stop(link.cmd);
+    i2c_apply_bus(i2c_device);
 
     esp_err_t err = ESP_FAIL;
 
-    i2c_apply_bus(i2c_device);
-    err = i2c_master_cmd_begin(device->i2c_port->port, write_cmd, pdMS_TO_TICKS(I2C_TIMEOUT_MS));
+    err = i2c_cmd_execute(device, &link, 1, 0);
     i2c_free_bus(i2c_device);
+    i2c_link_delete(&link);
+    return err;
+}
+
+esp_err_t i2c_batch_begin(i2c_batch_t *batch, I2CDevice_t i2c_device) {
+    if (batch == NULL || i2c_device == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    batch->device = i2c_device;
+    batch->count = 0;
+    batch->write_used = 0;
+    return ESP_OK;
+}
+
+static esp_err_t i2c_batch_add(i2c_batch_t *batch, uint32_t reg_addr, uint8_t *data, uint16_t length, bool is_read) {
+    if (batch == NULL || (length > 0 && data == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (batch->count >= I2C_BATCH_MAX_OPS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    i2c_batch_op_t *op = &batch->ops[batch->count];
+    op->reg_addr = reg_addr;
+    op->length = length;
+    op->is_read = is_read;
+    op->err = ESP_ERR_INVALID_STATE;
+
+    if (is_read) {
+        op->data = data;
+    } else {
+        // Writes are copied so callers can pass temporaries
+        if (batch->write_used + length > I2C_BATCH_WRITE_BUF_SIZE) {
+            return ESP_ERR_NO_MEM;
+        }
+        op->data = &batch->write_buf[batch->write_used];
+        memcpy(op->data, data, length);
+        batch->write_used += length;
+    }
+    batch->count++;
+    return ESP_OK;
+}
+
+esp_err_t i2c_batch_add_read(i2c_batch_t *batch, uint32_t reg_addr, uint8_t *data, uint16_t length) {
+    return i2c_batch_add(batch, reg_addr, data, length, true);
+}
+
+esp_err_t i2c_batch_add_write(i2c_batch_t *batch, uint32_t reg_addr, const uint8_t *data, uint16_t length) {
+    return i2c_batch_add(batch, reg_addr, (uint8_t *)data, length, false);
+}
+
+esp_err_t i2c_batch_add_write_byte(i2c_batch_t *batch, uint32_t reg_addr, uint8_t data) {
+    return i2c_batch_add(batch, reg_addr, &data, 1, false);
+}
+
+static void i2c_batch_cmd_add_op(i2c_cmd_handle_t cmd, uint8_t addr, i2c_batch_op_t *op) {
+    if (op->is_read) {
+        i2c_cmd_add_read(cmd, addr, op->reg_addr, op->data, op->length);
+    } else {
+        i2c_cmd_add_write(cmd, addr, op->reg_addr, op->data, op->length);
+    }
+}
+
+static uint32_t i2c_batch_op_written(i2c_batch_op_t *op) {
+    return i2c_op_overhead(op->reg_addr, op->is_read) + (op->is_read ? 0 : op->length);
+}
+
+esp_err_t i2c_batch_commit(i2c_batch_t *batch) {
+    if (batch == NULL || batch->device == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (batch->count == 0) {
+        return ESP_OK;
+    }
 
-    i2c_cmd_link_delete(write_cmd);
+    i2c_device_t* device = (i2c_device_t *)batch->device;
+    uint32_t bytes_written = 0;
+    uint32_t bytes_read = 0;
+
+    // Every operation starts with a repeated START, one STOP ends the chain
+    i2c_link_t link;
+    if (i2c_link_create(&link, false) != ESP_OK) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (uint8_t i = 0; i < batch->count; i++) {
+        i2c_batch_cmd_add_op(link.cmd, device->addr, &batch->ops[i]);
+        bytes_written += i2c_batch_op_written(&batch->ops[i]);
+        bytes_read += batch->ops[i].is_read ? batch->ops[i].length : 0;
+    }
+    i2c_master_stop(link.cmd);
+
+    i2c_apply_bus(batch->device);
+    esp_err_t err = i2c_cmd_execute(device, &link, bytes_written, bytes_read);
+
+    if (err == ESP_OK) {
+        for (uint8_t i = 0; i < batch->count; i++) {
+            batch->ops[i].err = ESP_OK;
+        }
+    } else {
+        // The controller aborts the whole link on a NACK without saying
+        // where, so replay the operations one by one to find the failure.
+        // Operations after it are left as ESP_ERR_INVALID_STATE.
+        log_e("I2C Batch Error: 0x%02x, ops: %d, Code: 0x%x, replaying", device->addr, batch->count, err);
+        for (uint8_t i = 0; i < batch->count; i++) {
+            i2c_batch_op_t *op = &batch->ops[i];
+            i2c_link_t op_link;
+            if (i2c_link_create(&op_link, true) != ESP_OK) {
+                err = ESP_ERR_NO_MEM;
+                break;
+            }
+            i2c_batch_cmd_add_op(op_link.cmd, device->addr, op);
+            i2c_master_stop(op_link.cmd);
+            op->err = i2c_cmd_execute(device, &op_link, i2c_batch_op_written(op), op->is_read ? op->length : 0);
+            i2c_link_delete(&op_link);
+            if (op->err != ESP_OK) {
+                err = op->err;
+                break;
+            }
+            err = ESP_OK;
+        }
+    }
+    i2c_free_bus(batch->device);
+    i2c_link_delete(&link);
+
+    log_i("I2C Batch: 0x%02x, ops: %d, Code: 0x%x", device->addr, batch->count, err);
     return err;
-}
\ No newline at end of file
+}
+
+esp_err_t i2c_batch_op_status(i2c_batch_t *batch, uint8_t index) {
+    if (batch == NULL || index >= batch->count) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return batch->ops[index].err;
+}
+
+esp_err_t i2c_get_stats(i2c_port_t i2c_num, i2c_bus_stats_t *stats) {
+    if (i2c_num >= I2C_NUM_MAX || stats == NULL || i2c_mutex[i2c_num] == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreTakeRecursive(i2c_mutex[i2c_num], portMAX_DELAY);
+    *stats = i2c_stats[i2c_num];
+    xSemaphoreGiveRecursive(i2c_mutex[i2c_num]);
+    return ESP_OK;
+}
+
+void i2c_reset_stats(i2c_port_t i2c_num) {
+    if (i2c_num >= I2C_NUM_MAX || i2c_mutex[i2c_num] == NULL) {
+        return ;
+    }
+    xSemaphoreTakeRecursive(i2c_mutex[i2c_num], portMAX_DELAY);
+    memset(&i2c_stats[i2c_num], 0, sizeof(i2c_bus_stats_t));
+    xSemaphoreGiveRecursive(i2c_mutex[i2c_num]);
+}
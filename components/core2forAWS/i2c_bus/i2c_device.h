@@ -4,6 +4,8 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
+
 #include "esp_log.h"
 #include "driver/gpio.h"
 #include "driver/i2c.h"
@@ -89,8 +91,162 @@ esp_err_t i2c_device_valid(I2CDevice_t i2c_device);
 
 BaseType_t i2c_take_port(i2c_port_t i2c_num, uint32_t timeout);
 
+/*
+    i2c_take_port() that waits for the arbiter at priority rather than the
+    default, for a caller whose transfers are not a device's.
+*/
+BaseType_t i2c_take_port_at(i2c_port_t i2c_num, uint8_t priority, uint32_t timeout);
+
 BaseType_t i2c_free_port(i2c_port_t i2c_num);
 
+/**
+ * @brief Priority a device's transfers wait for the bus at, unless
+ * i2c_device_set_priority() says otherwise. Matches I2C_ASYNC_PRIO_NORMAL.
+ */
+/* @[declare_i2c_device_priority_default] */
+#define I2C_DEVICE_PRIORITY_DEFAULT 1
+/* @[declare_i2c_device_priority_default] */
+
+/*
+    Sets the priority an arbiter serves the device's transfers at. Higher
+    goes first. i2c_take_port() waits at the default, i2c_take_port_at()
+    at the priority it is given.
+*/
+esp_err_t i2c_device_set_priority(I2CDevice_t i2c_device, uint8_t priority);
+
+/**
+ * @brief Decides the order in which tasks get the bus.
+ *
+ * While one is set, the first i2c_apply_bus() or i2c_take_port() of a
+ * task that holds no port calls acquire() before taking the port mutex,
+ * and acquire() returns ESP_OK once the task's turn has come, or
+ * ESP_ERR_TIMEOUT if it has not within timeout, which fails the take.
+ * Any other error means the arbiter does not order this task, which
+ * goes straight to the mutex. After ESP_OK the task holds the lease for
+ * every port: its holds on other ports, and nested holds, go straight
+ * to their mutex, and release() is called once it has freed them all.
+ * Without an arbiter the port mutex alone decides.
+ */
+/* @[declare_i2c_bus_arbiter_t] */
+typedef struct {
+    esp_err_t (*acquire)(i2c_port_t port, uint8_t priority, TickType_t timeout, void *ctx);
+    void (*release)(i2c_port_t port, void *ctx);
+    void *ctx;
+} i2c_bus_arbiter_t;
+/* @[declare_i2c_bus_arbiter_t] */
+
+/*
+    Installs an arbiter for every port, NULL removes it. Only call while
+    no task holds a port.
+*/
+void i2c_set_arbiter(const i2c_bus_arbiter_t *arbiter);
+
+/**
+ * @brief Maximum number of register operations in one batch.
+ */
+/* @[declare_i2c_batch_max_ops] */
+#define I2C_BATCH_MAX_OPS 16
+/* @[declare_i2c_batch_max_ops] */
+
+/**
+ * @brief Bytes reserved in a batch for copies of queued write data.
+ */
+/* @[declare_i2c_batch_write_buf_size] */
+#define I2C_BATCH_WRITE_BUF_SIZE 64
+/* @[declare_i2c_batch_write_buf_size] */
+
+typedef struct {
+    uint32_t reg_addr;
+    uint8_t *data;
+    uint16_t length;
+    bool is_read;
+    esp_err_t err;
+} i2c_batch_op_t;
+
+/**
+ * @brief Several register operations on one device that are sent as a
+ * single command link under a single bus acquisition.
+ *
+ * Allocate it on the stack, then call i2c_batch_begin(), any number of
+ * i2c_batch_add_read() / i2c_batch_add_write() and finally
+ * i2c_batch_commit(). Write data is copied when queued. Read buffers
+ * must stay valid until the commit returns.
+ *
+ * If the chained transfer fails, the operations are replayed one at a
+ * time to find the one that failed, so writes queued before it may reach
+ * the device twice. Do not batch writes that are not idempotent (FIFOs,
+ * write-to-clear registers) with operations that may fail.
+ *
+ * Example, reading two registers in one round-trip:
+ *
+ *  uint8_t in[2], out[2];
+ *  i2c_batch_t batch;
+ *  i2c_batch_begin(&batch, device);
+ *  i2c_batch_add_read(&batch, 0x7A, in, 2);
+ *  i2c_batch_add_read(&batch, 0x7C, out, 2);
+ *  esp_err_t err = i2c_batch_commit(&batch);
+ */
+/* @[declare_i2c_batch_t] */
+typedef struct {
+    I2CDevice_t device;
+    uint8_t count;
+    uint16_t write_used;
+    i2c_batch_op_t ops[I2C_BATCH_MAX_OPS];
+    uint8_t write_buf[I2C_BATCH_WRITE_BUF_SIZE];
+} i2c_batch_t;
+/* @[declare_i2c_batch_t] */
+
+esp_err_t i2c_batch_begin(i2c_batch_t *batch, I2CDevice_t i2c_device);
+
+esp_err_t i2c_batch_add_read(i2c_batch_t *batch, uint32_t reg_addr, uint8_t *data, uint16_t length);
+
+esp_err_t i2c_batch_add_write(i2c_batch_t *batch, uint32_t reg_addr, const uint8_t *data, uint16_t length);
+
+esp_err_t i2c_batch_add_write_byte(i2c_batch_t *batch, uint32_t reg_addr, uint8_t data);
+
+/*
+    Returns ESP_OK when every operation succeeded, otherwise the error of
+    the first failing operation. Per-operation results are available from
+    i2c_batch_op_status().
+*/
+esp_err_t i2c_batch_commit(i2c_batch_t *batch);
+
+esp_err_t i2c_batch_op_status(i2c_batch_t *batch, uint8_t index);
+
+/**
+ * @brief Running bus counters for one I2C port.
+ *
+ * bytes_written includes the address and register bytes of every
+ * operation, so the saving from batching shows up in transactions and
+ * bus_acquisitions rather than in the byte counts.
+ *
+ * On ESP-IDF 4.4 and later single transfers build their command link in
+ * the caller's stack frame and only batches touch the heap. The 4.2
+ * driver this project builds with has no static links, so there every
+ * transfer still allocates and counts in link_allocs.
+ *
+ * Devices on one port that only differ in frequency share the installed
+ * driver and retime it on switch (clock_changes). driver_installs only
+ * grows when the port's pins change.
+ */
+/* @[declare_i2c_bus_stats_t] */
+typedef struct {
+    uint32_t bus_acquisitions;  // i2c_apply_bus calls
+    uint32_t transactions;      // i2c_master_cmd_begin calls
+    uint32_t bytes_written;
+    uint32_t bytes_read;
+    uint32_t errors;
+    uint32_t link_allocs;       // transfers run from a heap command link
+    uint32_t static_links;      // transfers run from a static command link
+    uint32_t driver_installs;   // i2c_driver_install calls
+    uint32_t clock_changes;     // frequency switches without a reinstall
+} i2c_bus_stats_t;
+/* @[declare_i2c_bus_stats_t] */
+
+esp_err_t i2c_get_stats(i2c_port_t i2c_num, i2c_bus_stats_t *stats);
+
+void i2c_reset_stats(i2c_port_t i2c_num);
+
 
 #ifdef __cplusplus
 }
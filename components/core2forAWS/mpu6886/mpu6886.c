@@ -1,4 +1,5 @@
 #include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "i2c_device.h"
 #include "mpu6886.h"
 
@@ -42,44 +43,20 @@ int MPU6886_Init(void) {
     MPU6886_I2CWriteBytes(MPU6886_PWR_MGMT_1, 1, &regdata);
     vTaskDelay(10);
 
-    regdata = 0x10;
-    MPU6886_I2CWriteBytes(MPU6886_ACCEL_CONFIG, 1, &regdata);
-    vTaskDelay(1);
-
-    regdata = 0x18;
-    MPU6886_I2CWriteBytes(MPU6886_GYRO_CONFIG, 1, &regdata);
-    vTaskDelay(1);
-
-    regdata = 0x01;
-    MPU6886_I2CWriteBytes(MPU6886_CONFIG, 1, &regdata);
-    vTaskDelay(1);
-
-    regdata = 0x05;
-    MPU6886_I2CWriteBytes(MPU6886_SMPLRT_DIV, 1, &regdata);
-    vTaskDelay(1);
-
-    regdata = 0x00;
-    MPU6886_I2CWriteBytes(MPU6886_INT_ENABLE, 1, &regdata);
-    vTaskDelay(1);
-
-    regdata = 0x00;
-    MPU6886_I2CWriteBytes(MPU6886_ACCEL_CONFIG2, 1, &regdata);
-    vTaskDelay(1);
-
-    regdata = 0x00;
-    MPU6886_I2CWriteBytes(MPU6886_USER_CTRL, 1, &regdata);
-    vTaskDelay(1);
-
-    regdata = 0x00;
-    MPU6886_I2CWriteBytes(MPU6886_FIFO_EN, 1, &regdata);
-    vTaskDelay(1);
-
-    regdata = 0x22;
-    MPU6886_I2CWriteBytes(MPU6886_INT_PIN_CFG, 1, &regdata);
-    vTaskDelay(1);
-
-    regdata = 0x01;
-    MPU6886_I2CWriteBytes(MPU6886_INT_ENABLE, 1, &regdata);
+    // The remaining configuration has no settle time, send it in one transaction
+    i2c_batch_t batch;
+    i2c_batch_begin(&batch, mpu6886_device);
+    i2c_batch_add_write_byte(&batch, MPU6886_ACCEL_CONFIG, 0x10);
+    i2c_batch_add_write_byte(&batch, MPU6886_GYRO_CONFIG, 0x18);
+    i2c_batch_add_write_byte(&batch, MPU6886_CONFIG, 0x01);
+    i2c_batch_add_write_byte(&batch, MPU6886_SMPLRT_DIV, 0x05);
+    i2c_batch_add_write_byte(&batch, MPU6886_INT_ENABLE, 0x00);
+    i2c_batch_add_write_byte(&batch, MPU6886_ACCEL_CONFIG2, 0x00);
+    i2c_batch_add_write_byte(&batch, MPU6886_USER_CTRL, 0x00);
+    i2c_batch_add_write_byte(&batch, MPU6886_FIFO_EN, 0x00);
+    i2c_batch_add_write_byte(&batch, MPU6886_INT_PIN_CFG, 0x22);
+    i2c_batch_add_write_byte(&batch, MPU6886_INT_ENABLE, 0x01);
+    i2c_batch_commit(&batch);
     vTaskDelay(100);
 
     gyro_res = MPU6886_GetGyroRes(gyro_scale);
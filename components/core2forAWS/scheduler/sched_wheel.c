@@ -0,0 +1,138 @@
+#include <string.h>
+
+#include "sched_wheel.h"
+
+_Static_assert((SCHED_WHEEL_SLOTS & (SCHED_WHEEL_SLOTS - 1)) == 0, "SCHED_WHEEL_SLOTS must be a power of two");
+
+static int64_t slot_start(const sched_wheel_t *wheel, int64_t time_us) {
+    return time_us - time_us % wheel->resolution_us;
+}
+
+static uint16_t slot_of(const sched_wheel_t *wheel, int64_t time_us) {
+    return (uint16_t)((time_us / wheel->resolution_us) & (SCHED_WHEEL_SLOTS - 1));
+}
+
+void sched_wheel_init(sched_wheel_t *wheel, uint32_t resolution_us, int64_t now_us) {
+    memset(wheel, 0, sizeof(sched_wheel_t));
+    wheel->resolution_us = resolution_us ? resolution_us : 1;
+    wheel->cursor_us = now_us;
+}
+
+bool sched_wheel_add(sched_wheel_t *wheel, sched_job_t *job, int64_t due_us) {
+    if (job->queued) {
+        return false;
+    }
+
+    // Overdue jobs go in the first slot not yet expired, but keep their
+    // real due time so the lateness shows up as jitter
+    int64_t key_us = due_us > wheel->cursor_us ? due_us : wheel->cursor_us + 1;
+    job->due_us = due_us;
+    job->slot = slot_of(wheel, key_us);
+    job->queued = true;
+
+    // Each slot is kept in due order so expiry can stop at the first job
+    // that is not due yet
+    sched_job_t **link = &wheel->slots[job->slot];
+    while (*link != NULL && (*link)->due_us <= due_us) {
+        link = &(*link)->next;
+    }
+    job->next = *link;
+    *link = job;
+    wheel->count++;
+    return true;
+}
+
+void sched_wheel_remove(sched_wheel_t *wheel, sched_job_t *job) {
+    if (!job->queued) {
+        return;
+    }
+    for (sched_job_t **link = &wheel->slots[job->slot]; *link != NULL; link = &(*link)->next) {
+        if (*link == job) {
+            *link = job->next;
+            break;
+        }
+    }
+    job->next = NULL;
+    job->queued = false;
+    wheel->count--;
+}
+
+int64_t sched_wheel_next_wake(const sched_wheel_t *wheel) {
+    int64_t best_us = INT64_MAX;
+    if (wheel->count == 0) {
+        return best_us;
+    }
+
+    int64_t start_us = slot_start(wheel, wheel->cursor_us + 1);
+    for (int i = 0; i < SCHED_WHEEL_SLOTS; i++) {
+        int64_t begin_us = start_us + (int64_t)i * wheel->resolution_us;
+        // Everything from here on is due after the best deadline so far
+        if (begin_us > best_us) {
+            break;
+        }
+        for (sched_job_t *job = wheel->slots[slot_of(wheel, begin_us)]; job != NULL; job = job->next) {
+            int64_t latest_us = job->due_us + job->deadline_us;
+            if (latest_us < best_us) {
+                best_us = latest_us;
+            }
+        }
+    }
+    return best_us;
+}
+
+sched_job_t *sched_wheel_expire(sched_wheel_t *wheel, int64_t now_us) {
+    sched_job_t *head = NULL;
+    sched_job_t **tail = &head;
+    if (now_us <= wheel->cursor_us) {
+        return NULL;
+    }
+
+    int64_t start_us = slot_start(wheel, wheel->cursor_us + 1);
+    int64_t spanned = (slot_start(wheel, now_us) - start_us) / wheel->resolution_us + 1;
+    if (spanned > SCHED_WHEEL_SLOTS) {
+        spanned = SCHED_WHEEL_SLOTS;
+    }
+
+    for (int64_t i = 0; i < spanned; i++) {
+        sched_job_t **slot = &wheel->slots[slot_of(wheel, start_us + i * wheel->resolution_us)];
+        while (*slot != NULL && (*slot)->due_us <= now_us) {
+            sched_job_t *job = *slot;
+            *slot = job->next;
+            job->next = NULL;
+            job->queued = false;
+            wheel->count--;
+            *tail = job;
+            tail = &job->next;
+        }
+    }
+    wheel->cursor_us = now_us;
+    return head;
+}
+
+void sched_wheel_complete(sched_wheel_t *wheel, sched_job_t *job, int64_t start_us, int64_t end_us, bool requeue) {
+    sched_job_stats_t *stats = &job->stats;
+    int64_t jitter_us = start_us > job->due_us ? start_us - job->due_us : 0;
+    int64_t run_us = end_us > start_us ? end_us - start_us : 0;
+
+    stats->runs++;
+    stats->jitter_sum_us += (uint64_t)jitter_us;
+    if (jitter_us > stats->jitter_max_us) {
+        stats->jitter_max_us = jitter_us > UINT32_MAX ? UINT32_MAX : (uint32_t)jitter_us;
+    }
+    if (run_us > stats->run_max_us) {
+        stats->run_max_us = run_us > UINT32_MAX ? UINT32_MAX : (uint32_t)run_us;
+    }
+    if (jitter_us > job->deadline_us) {
+        stats->overruns++;
+    }
+
+    if (!requeue || job->period_us == 0) {
+        return;
+    }
+
+    // Stay on the original phase, dropping periods that ended while this
+    // run was late or still going
+    int64_t missed = end_us > job->due_us ? (end_us - job->due_us) / job->period_us : 0;
+    stats->skipped += (uint32_t)missed;
+    sched_wheel_add(wheel, job, job->due_us + (missed + 1) * job->period_us);
+}
@@ -0,0 +1,161 @@
+/**
+ * @file sched_wheel.h
+ * @brief Hashed timer wheel of periodic jobs with coalesced wakeups.
+ *
+ * Time is passed in by the caller in microseconds, so the wheel can be
+ * driven by a fake clock on a host.
+ * The wheel does not lock, the caller serialises access.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Number of wheel slots, a power of two. Jobs due further out
+ * than `SCHED_WHEEL_SLOTS` resolutions share slots with nearer ones and
+ * are skipped over until their turn.
+ */
+/* @[declare_sched_wheel_slots] */
+#define SCHED_WHEEL_SLOTS 64
+/* @[declare_sched_wheel_slots] */
+
+typedef struct sched_job sched_job_t;
+
+typedef void (*sched_job_fn_t)(sched_job_t *job, void *arg);
+
+/**
+ * @brief Per-job timing counters.
+ *
+ * Jitter is how late a run started relative to when it was due. A run
+ * that starts later than the job's deadline is an overrun. Periods that
+ * had already gone by when a run finished are skipped, not run late.
+ */
+/* @[declare_sched_job_stats_t] */
+typedef struct {
+    uint32_t runs;
+    uint32_t overruns;
+    uint32_t skipped;
+    uint32_t jitter_max_us;
+    uint32_t run_max_us;
+    uint64_t jitter_sum_us;
+} sched_job_stats_t;
+/* @[declare_sched_job_stats_t] */
+
+/**
+ * @brief A periodic job. The caller owns the storage, which has to stay
+ * valid while the job is on a wheel.
+ *
+ * Set `name`, `fn`, `arg`, `period_us` and `deadline_us`, the rest is
+ * managed by the wheel. `deadline_us` is how late after its due time
+ * the job may start. The wheel sleeps until the earliest deadline and
+ * then runs everything already due, so a generous deadline lets a job
+ * ride along with its neighbours' wakeups. A `period_us` of 0 runs the
+ * job once.
+ */
+/* @[declare_sched_job_t] */
+struct sched_job {
+    const char *name;
+    sched_job_fn_t fn;
+    void *arg;
+    uint32_t period_us;
+    uint32_t deadline_us;
+
+    int64_t due_us;
+    uint16_t slot;
+    bool queued;
+    sched_job_t *next;
+    sched_job_stats_t stats;
+};
+/* @[declare_sched_job_t] */
+
+/**
+ * @brief Wheel state. Treat as opaque.
+ */
+/* @[declare_sched_wheel_t] */
+typedef struct {
+    sched_job_t *slots[SCHED_WHEEL_SLOTS];
+    uint32_t resolution_us;
+    int64_t cursor_us;      // everything due at or before this has been expired
+    uint32_t count;
+} sched_wheel_t;
+/* @[declare_sched_wheel_t] */
+
+/**
+ * @brief Sets up an empty wheel.
+ *
+ * @param[in] wheel The wheel.
+ * @param[in] resolution_us Width of one slot, normally the sleep
+ * granularity of whoever drives the wheel.
+ * @param[in] now_us Current time.
+ */
+/* @[declare_sched_wheel_init] */
+void sched_wheel_init(sched_wheel_t *wheel, uint32_t resolution_us, int64_t now_us);
+/* @[declare_sched_wheel_init] */
+
+/**
+ * @brief Queues a job to run at `due_us`, or right away if that has
+ * passed. Its counters are left alone.
+ *
+ * @return false if the job is already queued.
+ */
+/* @[declare_sched_wheel_add] */
+bool sched_wheel_add(sched_wheel_t *wheel, sched_job_t *job, int64_t due_us);
+/* @[declare_sched_wheel_add] */
+
+/**
+ * @brief Takes a job off the wheel if it is queued.
+ */
+/* @[declare_sched_wheel_remove] */
+void sched_wheel_remove(sched_wheel_t *wheel, sched_job_t *job);
+/* @[declare_sched_wheel_remove] */
+
+/**
+ * @brief When the wheel next has to be serviced.
+ *
+ * Walks forward from the cursor only until no later slot can hold an
+ * earlier deadline, so the cost depends on how close the next deadline
+ * is, not on how many jobs there are.
+ *
+ * @return The earliest `due_us + deadline_us` of any queued job, or
+ * INT64_MAX if the wheel is empty.
+ */
+/* @[declare_sched_wheel_next_wake] */
+int64_t sched_wheel_next_wake(const sched_wheel_t *wheel);
+/* @[declare_sched_wheel_next_wake] */
+
+/**
+ * @brief Takes every job due at or before `now_us` off the wheel.
+ *
+ * @return The expired jobs linked through `next`, in due order within
+ * each slot, or NULL.
+ */
+/* @[declare_sched_wheel_expire] */
+sched_job_t *sched_wheel_expire(sched_wheel_t *wheel, int64_t now_us);
+/* @[declare_sched_wheel_expire] */
+
+/**
+ * @brief Records a finished run and queues the next period.
+ *
+ * The next run stays on the job's original phase. Periods that already
+ * ended by `end_us` are counted as skipped instead of being run back to
+ * back. One-shot jobs are not queued again.
+ *
+ * @param[in] wheel The wheel.
+ * @param[in] job A job returned by sched_wheel_expire().
+ * @param[in] start_us When the run started.
+ * @param[in] end_us When the run finished.
+ * @param[in] requeue false to leave the job off the wheel.
+ */
+/* @[declare_sched_wheel_complete] */
+void sched_wheel_complete(sched_wheel_t *wheel, sched_job_t *job, int64_t start_us, int64_t end_us, bool requeue);
+/* @[declare_sched_wheel_complete] */
+
+#ifdef __cplusplus
+}
+#endif
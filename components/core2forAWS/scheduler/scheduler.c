@@ -0,0 +1,204 @@
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+
+#include "scheduler.h"
+
+#define TAG "SCHEDULER"
+
+#define TICK_US (portTICK_PERIOD_MS * 1000)
+
+static sched_wheel_t wheel;
+static SemaphoreHandle_t wheel_lock;
+static QueueHandle_t kick_queue;
+static TaskHandle_t scheduler_task_handle;
+static scheduler_stats_t scheduler_stats;
+
+static sched_job_t *jobs[SCHEDULER_MAX_JOBS];
+static uint8_t job_count;
+
+// Only touched by the scheduler task
+static bool current_requeue;
+static int64_t current_rerun_us;     // -1 to follow the period
+
+static void scheduler_accept_kick(sched_job_t *job) {
+    xSemaphoreTake(wheel_lock, portMAX_DELAY);
+    scheduler_stats.kicks++;
+    // A queued or in-flight job is going to run anyway
+    sched_wheel_add(&wheel, job, esp_timer_get_time());
+    xSemaphoreGive(wheel_lock);
+}
+
+static void scheduler_run_batch(sched_job_t *expired) {
+    sched_job_t *batch[SCHEDULER_MAX_JOBS];
+    uint8_t batch_len = 0;
+
+    // Copy the batch out and keep the jobs marked as queued while they
+    // wait their turn, so a kick or an add from another task cannot put
+    // them back on the wheel behind the runner's back
+    while (expired != NULL && batch_len < SCHEDULER_MAX_JOBS) {
+        batch[batch_len++] = expired;
+        expired->queued = true;
+        expired = expired->next;
+    }
+
+    for (uint8_t i = 0; i < batch_len; i++) {
+        sched_job_t *job = batch[i];
+        current_requeue = true;
+        current_rerun_us = -1;
+
+        int64_t start_us = esp_timer_get_time();
+        job->fn(job, job->arg);
+        int64_t end_us = esp_timer_get_time();
+
+        xSemaphoreTake(wheel_lock, portMAX_DELAY);
+        job->queued = false;
+        job->next = NULL;
+        bool rerun = current_requeue && current_rerun_us >= 0;
+        sched_wheel_complete(&wheel, job, start_us, end_us, current_requeue && !rerun);
+        if (rerun) {
+            sched_wheel_add(&wheel, job, end_us + current_rerun_us);
+        }
+        scheduler_stats.runs++;
+        xSemaphoreGive(wheel_lock);
+    }
+}
+
+static void scheduler_task(void *arg) {
+    sched_job_t *kicked;
+
+    for (;;) {
+        xSemaphoreTake(wheel_lock, portMAX_DELAY);
+        int64_t wake_us = sched_wheel_next_wake(&wheel);
+        xSemaphoreGive(wheel_lock);
+
+        int64_t now_us = esp_timer_get_time();
+        if (wake_us > now_us) {
+            TickType_t ticks = portMAX_DELAY;
+            if (wake_us != INT64_MAX) {
+                // Round down so the tick lands before the deadline, not after
+                ticks = (TickType_t)((wake_us - now_us) / TICK_US);
+                ticks = ticks ? ticks : 1;
+            }
+            if (xQueueReceive(kick_queue, &kicked, ticks) == pdTRUE) {
+                if (kicked != NULL) {
+                    scheduler_accept_kick(kicked);
+                }
+                continue;
+            }
+            now_us = esp_timer_get_time();
+        }
+
+        xSemaphoreTake(wheel_lock, portMAX_DELAY);
+        scheduler_stats.wakeups++;
+        sched_job_t *expired = sched_wheel_expire(&wheel, now_us);
+        xSemaphoreGive(wheel_lock);
+
+        scheduler_run_batch(expired);
+    }
+}
+
+esp_err_t scheduler_start(UBaseType_t task_priority, BaseType_t core) {
+    if (scheduler_task_handle != NULL) {
+        return ESP_OK;
+    }
+
+    wheel_lock = xSemaphoreCreateMutex();
+    kick_queue = xQueueCreate(SCHEDULER_KICK_QUEUE_LEN, sizeof(sched_job_t *));
+    if (wheel_lock == NULL || kick_queue == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    // One slot per tick, the finest the task can sleep to anyway
+    sched_wheel_init(&wheel, TICK_US, esp_timer_get_time());
+
+    BaseType_t ret = xTaskCreatePinnedToCore(scheduler_task, "SchedulerTask", 4 * 1024, NULL, task_priority, &scheduler_task_handle, core);
+    if (ret != pdPASS) {
+        scheduler_task_handle = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t scheduler_add(sched_job_t *job, uint32_t delay_us) {
+    if (job == NULL || job->fn == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (scheduler_task_handle == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t err = ESP_OK;
+    xSemaphoreTake(wheel_lock, portMAX_DELAY);
+    uint8_t i = 0;
+    while (i < job_count && jobs[i] != job) {
+        i++;
+    }
+    if (i == job_count) {
+        if (job_count >= SCHEDULER_MAX_JOBS) {
+            err = ESP_ERR_NO_MEM;
+        } else {
+            jobs[job_count++] = job;
+            job->queued = false;
+            memset(&job->stats, 0, sizeof(sched_job_stats_t));
+        }
+    }
+    if (err == ESP_OK && !sched_wheel_add(&wheel, job, esp_timer_get_time() + delay_us)) {
+        err = ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreGive(wheel_lock);
+
+    if (err == ESP_OK) {
+        // Wake the task so it can sleep again with the new deadline in view
+        sched_job_t *none = NULL;
+        xQueueSend(kick_queue, &none, 0);
+    }
+    return err;
+}
+
+void scheduler_stop_current(void) {
+    current_requeue = false;
+}
+
+void scheduler_rerun_current(uint32_t delay_us) {
+    current_rerun_us = delay_us;
+}
+
+void IRAM_ATTR scheduler_kick_from_isr(sched_job_t *job, BaseType_t *task_woken) {
+    if (kick_queue != NULL) {
+        xQueueSendFromISR(kick_queue, &job, task_woken);
+    }
+}
+
+void scheduler_get_job_stats(const sched_job_t *job, sched_job_stats_t *stats) {
+    xSemaphoreTake(wheel_lock, portMAX_DELAY);
+    *stats = job->stats;
+    xSemaphoreGive(wheel_lock);
+}
+
+void scheduler_get_stats(scheduler_stats_t *stats) {
+    xSemaphoreTake(wheel_lock, portMAX_DELAY);
+    *stats = scheduler_stats;
+    xSemaphoreGive(wheel_lock);
+}
+
+void scheduler_log_stats(void) {
+    scheduler_stats_t totals;
+    scheduler_get_stats(&totals);
+    ESP_LOGI(TAG, "%u runs in %u wakeups, %u kicks", totals.runs, totals.wakeups, totals.kicks);
+
+    for (uint8_t i = 0; i < job_count; i++) {
+        sched_job_stats_t stats;
+        scheduler_get_job_stats(jobs[i], &stats);
+        uint32_t jitter_avg_us = stats.runs ? (uint32_t)(stats.jitter_sum_us / stats.runs) : 0;
+        ESP_LOGI(TAG, "%s: %u runs, jitter avg %u max %u us, run max %u us, %u overruns, %u skipped",
+                 jobs[i]->name ? jobs[i]->name : "?", stats.runs, jitter_avg_us, stats.jitter_max_us,
+                 stats.run_max_us, stats.overruns, stats.skipped);
+    }
+}
@@ -0,0 +1,167 @@
+/**
+ * @file scheduler.h
+ * @brief One task that runs the periodic sensor and input jobs.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_err.h"
+
+#include "sched_wheel.h"
+
+/**
+ * @brief Number of distinct jobs that can be added.
+ */
+/* @[declare_scheduler_max_jobs] */
+#define SCHEDULER_MAX_JOBS 16
+/* @[declare_scheduler_max_jobs] */
+
+/**
+ * @brief Number of wakeups from interrupts that can be pending at once.
+ */
+/* @[declare_scheduler_kick_queue_len] */
+#define SCHEDULER_KICK_QUEUE_LEN 8
+/* @[declare_scheduler_kick_queue_len] */
+
+/**
+ * @brief Counters for the scheduler task as a whole. `runs / wakeups`
+ * is how many jobs shared each wakeup on average.
+ */
+/* @[declare_scheduler_stats_t] */
+typedef struct {
+    uint32_t wakeups;
+    uint32_t runs;
+    uint32_t kicks;
+} scheduler_stats_t;
+/* @[declare_scheduler_stats_t] */
+
+/**
+ * @brief Starts the scheduler task.
+ *
+ * Jobs run one after another on this task, so they must not block for
+ * longer than the tightest deadline they share the task with. A short
+ * I2C transfer is fine and shows up in the other jobs' jitter. Anything
+ * that has to wait, a sensor conversion or a queued transfer, starts it
+ * and returns, and uses scheduler_rerun_current() to come back for the
+ * result.
+ *
+ * @note Core2ForAWS_Init() calls this.
+ *
+ * @param[in] task_priority Priority of the scheduler task.
+ * @param[in] core The core to pin the task to.
+ * @return `ESP_OK` if the task is running.
+ */
+/* @[declare_scheduler_start] */
+esp_err_t scheduler_start(UBaseType_t task_priority, BaseType_t core);
+/* @[declare_scheduler_start] */
+
+/**
+ * @brief Adds a job, first due `delay_us` from now.
+ *
+ * The job descriptor is used in place and must stay valid for as long
+ * as the job can run, in practice a static. Its counters are cleared
+ * the first time it is added.
+ *
+ * **Example:**
+ * @code{c}
+ *  static void poll(sched_job_t *job, void *arg) { ... }
+ *
+ *  static sched_job_t poll_job = {
+ *      .name = "poll",
+ *      .fn = poll,
+ *      .period_us = 100 * 1000,
+ *      .deadline_us = 20 * 1000,
+ *  };
+ *  scheduler_add(&poll_job, 0);
+ * @endcode
+ *
+ * @param[in] job The job.
+ * @param[in] delay_us Time until the first run.
+ * @return `ESP_OK` if the job was added, `ESP_ERR_INVALID_STATE` if the
+ * scheduler is not running or the job is already queued,
+ * `ESP_ERR_NO_MEM` if SCHEDULER_MAX_JOBS jobs have been added already.
+ */
+/* @[declare_scheduler_add] */
+esp_err_t scheduler_add(sched_job_t *job, uint32_t delay_us);
+/* @[declare_scheduler_add] */
+
+/**
+ * @brief Called from inside a job, keeps the current run from being
+ * followed by another. The job sleeps until scheduler_kick_from_isr()
+ * or scheduler_add() brings it back.
+ */
+/* @[declare_scheduler_stop_current] */
+void scheduler_stop_current(void);
+/* @[declare_scheduler_stop_current] */
+
+/**
+ * @brief Called from inside a job, runs it again `delay_us` after the
+ * current run ends instead of at its next period. The period picks up
+ * from that run. A one-shot job can chain steps this way.
+ *
+ * **Example:**
+ * @code{c}
+ *  static void convert(sched_job_t *job, void *arg) {
+ *      if (!converting) {
+ *          start_conversion();
+ *          converting = true;
+ *          scheduler_rerun_current(CONVERSION_US);
+ *          return;
+ *      }
+ *      converting = false;
+ *      read_result();
+ *  }
+ * @endcode
+ *
+ * @param[in] delay_us Time from the end of this run to the next, at
+ * least a tick in practice as the task sleeps in whole ticks.
+ */
+/* @[declare_scheduler_rerun_current] */
+void scheduler_rerun_current(uint32_t delay_us);
+/* @[declare_scheduler_rerun_current] */
+
+/**
+ * @brief Runs a stopped job as soon as possible. Does nothing if the job
+ * is already queued or running.
+ *
+ * @param[in] job The job.
+ * @param[out] task_woken Set to pdTRUE if a context switch is needed.
+ */
+/* @[declare_scheduler_kick_from_isr] */
+void scheduler_kick_from_isr(sched_job_t *job, BaseType_t *task_woken);
+/* @[declare_scheduler_kick_from_isr] */
+
+/**
+ * @brief Copies the counters of one job.
+ */
+/* @[declare_scheduler_get_job_stats] */
+void scheduler_get_job_stats(const sched_job_t *job, sched_job_stats_t *stats);
+/* @[declare_scheduler_get_job_stats] */
+
+/**
+ * @brief Copies the scheduler task counters.
+ */
+/* @[declare_scheduler_get_stats] */
+void scheduler_get_stats(scheduler_stats_t *stats);
+/* @[declare_scheduler_get_stats] */
+
+/**
+ * @brief Logs one line per job with its run count, jitter and overruns.
+ */
+/* @[declare_scheduler_log_stats] */
+void scheduler_log_stats(void);
+/* @[declare_scheduler_log_stats] */
+
+#ifdef __cplusplus
+}
+#endif
@@ -20,6 +20,7 @@
 #include "esp_err.h"
 #include "esp_log.h"
 #include "i2c_device.h"
+#include "i2c_async.h"
 
 #define SDA_PIN                            21 
 #define SCL_PIN                            22
@@ -50,9 +51,11 @@ ATCA_STATUS hal_i2c_init(void *hal, ATCAIfaceCfg *cfg)
 
     if (i2c_device_bus == NULL) {
         return ATCA_COMM_FAIL;
-    } else {
-        return ATCA_SUCCESS;
     }
+    // A crypto command holds the bus from wake to idle, so let touch and
+    // sensor reads that are waiting go first
+    i2c_device_set_priority(i2c_device_bus, I2C_ASYNC_PRIO_LOW);
+    return ATCA_SUCCESS;
 }
 
 ATCA_STATUS hal_i2c_post_init(ATCAIface iface)
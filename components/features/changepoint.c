@@ -0,0 +1,79 @@
+#include <math.h>
+#include <string.h>
+
+#include "changepoint.h"
+
+void changepoint_init(changepoint_t *detector, const changepoint_config_t *config) {
+    memset(detector, 0, sizeof(changepoint_t));
+    detector->config = *config;
+}
+
+static void rest(changepoint_t *detector) {
+    detector->exposed = 0;
+    detector->sum_up = 0.0f;
+    detector->sum_down = 0.0f;
+    detector->up_since = detector->samples;
+    detector->down_since = detector->samples;
+    detector->in_band = 0;
+}
+
+changepoint_event_t changepoint_update(changepoint_t *detector, float x) {
+    const changepoint_config_t *config = &detector->config;
+    const uint32_t n = detector->samples++;
+
+    // Plain running averages until the baseline is known
+    if (n < config->warmup) {
+        detector->baseline += (x - detector->baseline) / (n + 1);
+        detector->noise += (fabsf(x - detector->baseline) - detector->noise) / (n + 1);
+        rest(detector);
+        return CHANGEPOINT_NONE;
+    }
+
+    const float noise = detector->noise > config->noise_floor ? detector->noise : config->noise_floor;
+    const float z = (x - detector->baseline) / noise;
+
+    if (detector->exposed) {
+        detector->in_band = fabsf(z) < config->return_band ? detector->in_band + 1 : 0;
+        if (detector->in_band >= config->hold) {
+            rest(detector);
+            return CHANGEPOINT_END;
+        }
+        if (detector->samples - detector->onset >= config->max_exposure) {
+            // Whatever the signal settled at is the new rest level
+            detector->baseline = x;
+            rest(detector);
+            return CHANGEPOINT_END;
+        }
+        return CHANGEPOINT_NONE;
+    }
+
+    detector->sum_up += z - config->allowance;
+    if (detector->sum_up <= 0.0f) {
+        detector->sum_up = 0.0f;
+        detector->up_since = detector->samples;
+    }
+    detector->sum_down += -z - config->allowance;
+    if (detector->sum_down <= 0.0f) {
+        detector->sum_down = 0.0f;
+        detector->down_since = detector->samples;
+    }
+
+    if (detector->sum_up > config->threshold || detector->sum_down > config->threshold) {
+        detector->exposed = 1;
+        detector->in_band = 0;
+        detector->onset = detector->sum_up > config->threshold ? detector->up_since : detector->down_since;
+        return CHANGEPOINT_ONSET;
+    }
+
+    // Only samples inside the band move the baseline, so the start of a
+    // slow rise does not drag it along and hide itself. The noise sees
+    // every sample but clipped to the band; dropping the outliers instead
+    // would shrink it a little every time until everything triggers.
+    const float deviation = fabsf(x - detector->baseline);
+    const float band = config->return_band * noise;
+    if (deviation < band) {
+        detector->baseline += config->baseline_rate * (x - detector->baseline);
+    }
+    detector->noise += config->baseline_rate * ((deviation < band ? deviation : band) - detector->noise);
+    return CHANGEPOINT_NONE;
+}
@@ -0,0 +1,116 @@
+/**
+ * @file changepoint.h
+ * @brief Streaming detection of the start and end of an exposure in one
+ * sensor signal, with a two-sided CUSUM against a learnt baseline.
+ *
+ * Each sample costs O(1) and a detector is a fixed-size struct.
+ *
+ * While the signal is at rest the detector tracks its baseline and noise
+ * level with exponential averages. Deviations, in units of that noise,
+ * are accumulated upwards and downwards less an allowance; when either
+ * sum passes the threshold an exposure has started, at the last sample
+ * where that sum was zero. The exposure ends once the signal has stayed
+ * within a band around the baseline for a number of samples, or when it
+ * has lasted too long and the baseline is taken to have moved.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * @brief Tuning of a detector. Levels are in units of the signal's
+ * noise, which is the mean absolute deviation from the baseline.
+ */
+/* @[declare_changepoint_config_t] */
+typedef struct {
+    /*@{*/
+    float allowance;        /**< @brief Deviation per sample that is not accumulated. */
+    float threshold;        /**< @brief Accumulated deviation that starts an exposure. */
+    float return_band;      /**< @brief Deviation under which the signal counts as back. */
+    float baseline_rate;    /**< @brief Weight of each resting sample in the baseline and noise averages. */
+    float noise_floor;      /**< @brief Smallest noise level, in signal units, so a flat signal does not trigger on one count. */
+    uint16_t warmup;        /**< @brief Samples averaged for the first baseline before detecting. */
+    uint16_t hold;          /**< @brief Samples inside the band that end an exposure. */
+    uint32_t max_exposure;  /**< @brief Samples after which an exposure ends anyway. */
+    /*@}*/
+} changepoint_config_t;
+/* @[declare_changepoint_config_t] */
+
+/**
+ * @brief Defaults for a slow gas sensor sampled about once a second.
+ */
+/* @[declare_changepoint_config_default] */
+#define CHANGEPOINT_CONFIG_DEFAULT(floor) { \
+    .allowance = 1.0f,                      \
+    .threshold = 10.0f,                     \
+    .return_band = 3.0f,                    \
+    .baseline_rate = 0.02f,                 \
+    .noise_floor = (floor),                 \
+    .warmup = 16,                           \
+    .hold = 8,                              \
+    .max_exposure = 600,                    \
+}
+/* @[declare_changepoint_config_default] */
+
+/* @[declare_changepoint_event_t] */
+typedef enum {
+    CHANGEPOINT_NONE = 0,
+    CHANGEPOINT_ONSET,      /**< An exposure started, see changepoint_t::onset. */
+    CHANGEPOINT_END,        /**< The exposure ended with this sample. */
+} changepoint_event_t;
+/* @[declare_changepoint_event_t] */
+
+/**
+ * @brief A detector. Treat the fields as read-only.
+ */
+/* @[declare_changepoint_t] */
+typedef struct {
+    changepoint_config_t config;
+    uint32_t samples;       // fed so far
+    float baseline;
+    float noise;
+    float sum_up;
+    float sum_down;
+    uint32_t up_since;      // sample after which sum_up was last zero
+    uint32_t down_since;
+    uint8_t exposed;
+    uint32_t onset;         // sample index the current or last exposure started at
+    uint32_t in_band;       // consecutive samples back at the baseline
+} changepoint_t;
+/* @[declare_changepoint_t] */
+
+/**
+ * @brief Resets a detector.
+ *
+ * **Example:**
+ * @code{c}
+ *  static changepoint_t detector;
+ *  changepoint_config_t config = CHANGEPOINT_CONFIG_DEFAULT(5.0f);
+ *  changepoint_init(&detector, &config);
+ *  ...
+ *  if (changepoint_update(&detector, tvoc) == CHANGEPOINT_ONSET) {
+ *      ESP_LOGI(TAG, "Smell from sample %u", detector.onset);
+ *  }
+ * @endcode
+ */
+/* @[declare_changepoint_init] */
+void changepoint_init(changepoint_t *detector, const changepoint_config_t *config);
+/* @[declare_changepoint_init] */
+
+/**
+ * @brief Feeds one sample.
+ *
+ * @return What this sample completed, if anything.
+ */
+/* @[declare_changepoint_update] */
+changepoint_event_t changepoint_update(changepoint_t *detector, float x);
+/* @[declare_changepoint_update] */
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,209 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "feature_extract.h"
+
+#define TWO_PI 6.28318530718f
+
+// Floor for the band energies so silence gives a finite log
+#define ENERGY_FLOOR 1e-12f
+// Points closer than this fraction of the peak to the asymptote are
+// left out of the exponential fits, they are mostly noise
+#define FIT_THRESHOLD 0.05f
+// Time constants beyond this many windows mean there was no decay to fit
+#define TAU_MAX_WINDOWS 10.0f
+
+int feature_plan_init(feature_plan_t *plan, uint16_t length, float sample_period_s) {
+    memset(plan, 0, sizeof(feature_plan_t));
+    if (length < 2 * FEATURE_BANDS || sample_period_s <= 0.0f) {
+        return -1;
+    }
+
+    // Bands are log spaced over bins 1 to length / 2, each at least one bin wide
+    const uint16_t bins = length / 2 + 1;
+    plan->band_edge[0] = 1;
+    for (int b = 1; b < FEATURE_BANDS; b++) {
+        uint16_t edge = (uint16_t)lroundf(powf(bins, (float)b / FEATURE_BANDS));
+        plan->band_edge[b] = edge > plan->band_edge[b - 1] ? edge : plan->band_edge[b - 1] + 1;
+    }
+    plan->band_edge[FEATURE_BANDS] = bins;
+    if (plan->band_edge[FEATURE_BANDS - 1] >= bins) {
+        return -1;
+    }
+
+    plan->window = (float *)malloc(3 * length * sizeof(float));
+    if (plan->window == NULL) {
+        return -1;
+    }
+    plan->fft_in = plan->window + length;
+    plan->fft_out = plan->fft_in + length;
+
+    plan->fft = fft_init(length, FFT_REAL, FFT_FORWARD, plan->fft_in, plan->fft_out);
+    if (plan->fft == NULL) {
+        free(plan->window);
+        plan->window = NULL;
+        return -1;
+    }
+
+    for (uint16_t i = 0; i < length; i++) {
+        plan->window[i] = 0.5f - 0.5f * cosf(TWO_PI * i / length);
+    }
+    plan->length = length;
+    plan->sample_period_s = sample_period_s;
+    return 0;
+}
+
+void feature_plan_free(feature_plan_t *plan) {
+    if (plan->fft != NULL) {
+        fft_destroy(plan->fft);
+    }
+    free(plan->window);
+    memset(plan, 0, sizeof(feature_plan_t));
+}
+
+// Least-squares fit of ln(u) = c - t / tau over the points where u is
+// above `min_level`. Returns tau, or 0 if there are too few points or u
+// is not decaying.
+static float fit_tau(const float *u, uint16_t first, uint16_t last, float min_level, float dt, float tau_max) {
+    float n = 0.0f, st = 0.0f, sy = 0.0f, stt = 0.0f, sty = 0.0f;
+    for (uint16_t i = first; i < last; i++) {
+        if (u[i] <= min_level) {
+            continue;
+        }
+        float t = i * dt;
+        float y = logf(u[i]);
+        n += 1.0f;
+        st += t;
+        sy += y;
+        stt += t * t;
+        sty += t * y;
+    }
+    if (n < 3.0f) {
+        return 0.0f;
+    }
+    float denom = n * stt - st * st;
+    if (denom <= 0.0f) {
+        return 0.0f;
+    }
+    float slope = (n * sty - st * sy) / denom;
+    if (slope >= 0.0f) {
+        return 0.0f;
+    }
+    float tau = -1.0f / slope;
+    return tau < tau_max ? tau : 0.0f;
+}
+
+void feature_extract(feature_plan_t *plan, const float *x, float *f) {
+    const uint16_t n = plan->length;
+    const float dt = plan->sample_period_s;
+    float *scratch = plan->fft_out;     // free until the FFT runs
+
+    // Moments and extremes
+    float sum = 0.0f, lo = x[0], hi = x[0];
+    uint16_t lo_idx = 0, hi_idx = 0;
+    for (uint16_t i = 0; i < n; i++) {
+        sum += x[i];
+        if (x[i] < lo) {
+            lo = x[i];
+            lo_idx = i;
+        }
+        if (x[i] > hi) {
+            hi = x[i];
+            hi_idx = i;
+        }
+    }
+    const float mean = sum / n;
+    float var = 0.0f;
+    for (uint16_t i = 0; i < n; i++) {
+        var += (x[i] - mean) * (x[i] - mean);
+    }
+
+    const uint16_t head = n / 8 ? n / 8 : 1;
+    float baseline = 0.0f;
+    for (uint16_t i = 0; i < head; i++) {
+        baseline += x[i];
+    }
+    baseline /= head;
+
+    // The peak is whichever excursion is larger, so a sensor whose
+    // reading drops on exposure is handled the same way as one that rises
+    const bool rising = hi - baseline >= baseline - lo;
+    const float sign = rising ? 1.0f : -1.0f;
+    const uint16_t peak_idx = rising ? hi_idx : lo_idx;
+    const float peak = x[peak_idx] - baseline;
+    const float amplitude = fabsf(peak);
+
+    f[FEATURE_MEAN] = mean;
+    f[FEATURE_STD] = sqrtf(var / n);
+    f[FEATURE_MIN] = lo;
+    f[FEATURE_MAX] = hi;
+    f[FEATURE_BASELINE] = baseline;
+    f[FEATURE_PEAK] = peak;
+    f[FEATURE_PEAK_TIME] = peak_idx * dt;
+
+    // Rise time between the first crossings of 10 % and 90 % of the peak
+    int32_t i10 = -1, i90 = -1;
+    for (uint16_t i = 0; i <= peak_idx && amplitude > 0.0f; i++) {
+        float level = sign * (x[i] - baseline);
+        if (i10 < 0 && level >= 0.1f * amplitude) {
+            i10 = i;
+        }
+        if (level >= 0.9f * amplitude) {
+            i90 = i;
+            break;
+        }
+    }
+    f[FEATURE_RISE_TIME] = i10 >= 0 && i90 >= i10 ? (i90 - i10) * dt : 0.0f;
+
+    // Central differences inside the window, one-sided at the ends
+    float max_slope = -INFINITY, min_slope = INFINITY, area = 0.0f;
+    for (uint16_t i = 0; i < n; i++) {
+        uint16_t a = i > 0 ? i - 1 : i;
+        uint16_t b = i + 1 < n ? i + 1 : i;
+        float slope = (x[b] - x[a]) / ((b - a) * dt);
+        max_slope = slope > max_slope ? slope : max_slope;
+        min_slope = slope < min_slope ? slope : min_slope;
+        area += (x[i] - baseline) * dt;
+    }
+    f[FEATURE_MAX_SLOPE] = max_slope;
+    f[FEATURE_MIN_SLOPE] = min_slope;
+    f[FEATURE_AREA] = area;
+
+    // Exponential fits: the gap to the peak shrinks on the way up, the
+    // excursion from the baseline shrinks on the way down
+    const float tau_max = TAU_MAX_WINDOWS * n * dt;
+    const float min_level = FIT_THRESHOLD * amplitude;
+    for (uint16_t i = 0; i < n; i++) {
+        scratch[i] = sign * (x[peak_idx] - x[i]);
+    }
+    f[FEATURE_RISE_TAU] = i10 >= 0 ? fit_tau(scratch, (uint16_t)i10, peak_idx, min_level, dt, tau_max) : 0.0f;
+    for (uint16_t i = 0; i < n; i++) {
+        scratch[i] = sign * (x[i] - baseline);
+    }
+    f[FEATURE_DECAY_TAU] = fit_tau(scratch, peak_idx + 1, n, min_level, dt, tau_max);
+
+    // Spectrum of the mean-removed, Hann-windowed response
+    for (uint16_t i = 0; i < n; i++) {
+        plan->fft_in[i] = (x[i] - mean) * plan->window[i];
+    }
+    fft_execute(plan->fft);
+
+    // rfft packs DC and Nyquist into the first two floats; an odd length
+    // has no Nyquist bin and keeps the last bin's imaginary part there
+    const float *y = plan->fft_out;
+    for (int band = 0; band < FEATURE_BANDS; band++) {
+        float energy = 0.0f;
+        for (uint16_t k = plan->band_edge[band]; k < plan->band_edge[band + 1]; k++) {
+            if (k == n / 2 && n % 2 == 0) {
+                energy += y[1] * y[1];
+            } else if (k == n / 2) {
+                energy += y[n - 1] * y[n - 1] + y[1] * y[1];
+            } else {
+                energy += y[2 * k] * y[2 * k] + y[2 * k + 1] * y[2 * k + 1];
+            }
+        }
+        f[FEATURE_BAND_0 + band] = log10f(energy / n + ENERGY_FLOOR);
+    }
+}
@@ -0,0 +1,115 @@
+/**
+ * @file feature_extract.h
+ * @brief Fixed-length feature vectors describing the transient response
+ * of a gas sensor over a window of samples.
+ *
+ * All buffers, including the components/fft plan, are allocated once by
+ * feature_plan_init(). Extracting a window does not allocate.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "fft.h"
+
+/**
+ * @brief Number of log-spaced spectral bands.
+ */
+/* @[declare_feature_bands] */
+#define FEATURE_BANDS 8
+/* @[declare_feature_bands] */
+
+/**
+ * @brief Position of each feature in the vector for one channel.
+ *
+ * Times are in seconds and slopes in units per second, where units are
+ * those of the input samples. The baseline is the average of the first
+ * eighth of the window, and peak and area are measured from it.
+ */
+/* @[declare_feature_index_t] */
+typedef enum {
+    FEATURE_MEAN = 0,
+    FEATURE_STD,
+    FEATURE_MIN,
+    FEATURE_MAX,
+    FEATURE_BASELINE,
+    FEATURE_PEAK,           /**< Largest excursion from the baseline, signed. */
+    FEATURE_PEAK_TIME,      /**< When the peak was reached. */
+    FEATURE_RISE_TIME,      /**< From 10 % to 90 % of the peak. */
+    FEATURE_MAX_SLOPE,
+    FEATURE_MIN_SLOPE,
+    FEATURE_RISE_TAU,       /**< Time constant of an exponential approach to the peak, 0 if it does not fit. */
+    FEATURE_DECAY_TAU,      /**< Time constant of an exponential decay after the peak, 0 if it does not fit. */
+    FEATURE_AREA,           /**< Integral of the excursion from the baseline. */
+    FEATURE_BAND_0,         /**< log10 energy of the lowest band, the rest follow. */
+    FEATURE_PER_CHANNEL = FEATURE_BAND_0 + FEATURE_BANDS
+} feature_index_t;
+/* @[declare_feature_index_t] */
+
+/**
+ * @brief A reusable extraction plan for one window length.
+ */
+/* @[declare_feature_plan_t] */
+typedef struct {
+    uint16_t length;
+    float sample_period_s;
+    fft_config_t *fft;
+    float *window;          // Hann coefficients
+    float *fft_in;
+    float *fft_out;
+    uint16_t band_edge[FEATURE_BANDS + 1];  // first bin of each band, then one past the last
+} feature_plan_t;
+/* @[declare_feature_plan_t] */
+
+/**
+ * @brief Allocates the FFT plan and scratch buffers for windows of
+ * `length` samples.
+ *
+ * **Example:**
+ * @code{c}
+ *  static feature_plan_t plan;
+ *  feature_plan_init(&plan, 32, 1.0f);
+ *  ...
+ *  float features[FEATURE_PER_CHANNEL];
+ *  feature_extract(&plan, samples, features);
+ * @endcode
+ *
+ * @param[out] plan The plan.
+ * @param[in] length Samples per window, at least 2 * FEATURE_BANDS. Any
+ * length works, powers of two run fastest.
+ * @param[in] sample_period_s Time between samples.
+ * @return 0 on success, -1 for a bad length or if allocation failed.
+ */
+/* @[declare_feature_plan_init] */
+int feature_plan_init(feature_plan_t *plan, uint16_t length, float sample_period_s);
+/* @[declare_feature_plan_init] */
+
+/**
+ * @brief Frees everything feature_plan_init() allocated.
+ */
+/* @[declare_feature_plan_free] */
+void feature_plan_free(feature_plan_t *plan);
+/* @[declare_feature_plan_free] */
+
+/**
+ * @brief Computes the features of one window.
+ *
+ * Not reentrant for a given plan, since the plan holds the scratch
+ * buffers. Use one plan per task.
+ *
+ * @param[in] plan The plan.
+ * @param[in] samples `length` samples, oldest first.
+ * @param[out] features FEATURE_PER_CHANNEL values, see feature_index_t.
+ */
+/* @[declare_feature_extract] */
+void feature_extract(feature_plan_t *plan, const float *samples, float *features);
+/* @[declare_feature_extract] */
+
+#ifdef __cplusplus
+}
+#endif
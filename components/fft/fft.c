@@ -45,19 +45,136 @@
 #define USE_SPLIT_RADIX 1
 #define LARGE_BASE_CASE 1
 
+static void rfft_post(float *y, float *twiddle_factors, int n);
+static void irfft_pre(float *x, float *twiddle_factors, int n);
+static void reverse_and_scale(float *output, int n, int stride);
+
+static int is_power_of_four(int n)
+{
+  // Powers of two with the set bit at an even position
+  return (n & 0x55555555) != 0;
+}
+
+static int first_span(int n)
+{
+  /*
+   * Size of the transforms the iterative engine's first pass makes: an
+   * unrolled radix-4 or radix-8 one, so that the radix-4 stages after it
+   * reach n exactly
+   */
+  if (is_power_of_four(n))
+    return n >= 4 ? 4 : 1;
+  return n >= 8 ? 8 : 2;
+}
+
+static int stage_twiddle_count(int n)
+{
+  /*
+   * Floats of twiddle factors the iterative engine needs for size n:
+   * three complex factors for every butterfly position of every radix-4
+   * stage
+   */
+  int m, count = 0;
+
+  for (m = first_span(n) ; 4 * m <= n ; m *= 4)
+    count += 6 * m;
+
+  return count;
+}
+
+static void plan_iterative(int n, int *bit_reverse, float *stage_twiddles, int split)
+{
+  /*
+   * Fills the tables of fft_iterative, or of fft_split if split is set,
+   * for a complex FFT of size n. fft_iterative takes the three factors of
+   * a butterfly together, fft_split takes each stage's as six arrays of m
+   * floats, the real and imaginary parts of each factor, so a vector of
+   * butterflies loads them directly.
+   */
+  int i, k, m, bits = 0;
+
+  while ((1 << bits) < n)
+    bits++;
+
+  for (i = 0 ; i < n ; i++)
+  {
+    int r = 0, b;
+    for (b = 0 ; b < bits ; b++)
+      r |= ((i >> b) & 1) << (bits - 1 - b);
+    bit_reverse[i] = r;
+  }
+
+  // W_4m^k, W_4m^2k and W_4m^3k for each stage, in double so the larger
+  // sizes keep full float accuracy
+  for (m = first_span(n) ; 4 * m <= n ; m *= 4)
+  {
+    for (k = 0 ; k < m ; k++)
+    {
+      int j;
+      for (j = 1 ; j <= 3 ; j++)
+      {
+        double angle = -2.0 * M_PI * j * k / (4.0 * m);
+        if (split)
+        {
+          stage_twiddles[(2 * j - 2) * m + k] = (float)cos(angle);
+          stage_twiddles[(2 * j - 1) * m + k] = (float)sin(angle);
+        }
+        else
+        {
+          stage_twiddles[6 * k + 2 * j - 2] = (float)cos(angle);
+          stage_twiddles[6 * k + 2 * j - 1] = (float)sin(angle);
+        }
+      }
+    }
+    stage_twiddles += 6 * m;
+  }
+}
+
 fft_config_t *fft_init(int size, fft_type_t type, fft_direction_t direction, float *input, float *output)
 {
   /*
    * Prepare an FFT of correct size and types.
    *
    * If no input or output buffers are provided, they will be allocated.
+   *
+   * Powers of two run the iterative engine, any other size the one of
+   * fft_mixed.c. Returns NULL, with everything it allocated freed, if
+   * size is below 1, if an FFT_COMPLEX_SPLIT size is not a power of two,
+   * or if memory runs out.
+   */
+  return fft_init_many(size, 1, type, direction, input, output);
+}
+
+fft_config_t *fft_init_many(int size, int count, fft_type_t type, fft_direction_t direction, float *input, float *output)
+{
+  /*
+   * Prepare count FFTs of the same size and types, which fft_execute
+   * runs in one call.
+   *
+   * Parameters
+   * ----------
+   *  count (int)
+   *    The number of signals. The buffers hold them interleaved: float j
+   *    of signal c, where a single FFT of the type keeps float j, is at
+   *    [j * count + c], so count sensor channels sampled together are
+   *    stored as they arrive.
+   *
+   * Powers of two transform all the signals together, in fft_many.c,
+   * which is what makes a batch faster than a plan per signal. Other
+   * sizes are only a convenience: each signal is gathered out of the
+   * interleaved buffer, transformed alone and scattered back, which is
+   * slower than separate plans on separate buffers. FFT_COMPLEX_SPLIT
+   * takes a count of 1 only. Returns NULL as fft_init does, and if count
+   * is below 1.
    */
   int k,m;
+  int power_of_two = size > 0 && (size & (size-1)) == 0;
 
-  fft_config_t *config = (fft_config_t *)malloc(sizeof(fft_config_t));
+  if (size < 1 || count < 1 || (type == FFT_COMPLEX_SPLIT && (!power_of_two || count > 1)))
+    return NULL;
 
-  // Check if the size is a power of two
-  if ((size & (size-1)) != 0)  // tests if size is a power of two
+  fft_config_t *config = (fft_config_t *)calloc(1, sizeof(fft_config_t));
+  if (config == NULL)
     return NULL;
 
   // start configuration
@@ -65,9 +182,12 @@ fft_config_t *fft_init(int size, fft_type_t type, fft_direction_t direction, flo
   config->type = type;
   config->direction = direction;
   config->size = size;
+  config->count = count;
 
   // Allocate and precompute twiddle factors
   config->twiddle_factors = (float *)malloc(2 * config->size * sizeof(float));
+  if (config->twiddle_factors == NULL)
+    goto fail;
 
   float two_pi_by_n = TWO_PI / config->size;
 
@@ -77,21 +197,52 @@ fft_config_t *fft_init(int size, fft_type_t type, fft_direction_t direction, flo
     config->twiddle_factors[m+1] = sinf(two_pi_by_n * k);  // imag
   }
 
+  // Both engines run a complex FFT of half the size for an even real
+  // one, an odd real one, 1 included, goes through a complex FFT of its
+  // own size on the mixed-radix engine
+  int n_complex = (config->type == FFT_REAL && size % 2 == 0) ? config->size / 2 : config->size;
+  if (power_of_two && !(config->type == FFT_REAL && size == 1))
+  {
+    int stage_floats = stage_twiddle_count(n_complex);
+    config->bit_reverse = (int *)malloc(n_complex * sizeof(int));
+    config->stage_twiddles = (float *)malloc((stage_floats > 0 ? stage_floats : 1) * sizeof(float));
+    if (config->bit_reverse == NULL || config->stage_twiddles == NULL)
+      goto fail;
+    plan_iterative(n_complex, config->bit_reverse, config->stage_twiddles, config->type == FFT_COMPLEX_SPLIT);
+  }
+  else
+  {
+    config->mixed = fft_mixed_init(n_complex);
+    if (config->mixed == NULL)
+      goto fail;
+    // The odd real scratch, then for batches one signal in and out
+    int work_floats = (config->type == FFT_REAL && size % 2 != 0) ? 4 * config->size : 0;
+    if (count > 1)
+      work_floats += 4 * config->size;
+    if (work_floats > 0)
+    {
+      config->work = (float *)malloc(work_floats * sizeof(float));
+      if (config->work == NULL)
+        goto fail;
+    }
+  }
+  fft_set_isa(config, fft_best_isa());
+
   // Allocate input buffer
   if (input != NULL)
     config->input = input;
   else 
   {
     if (config->type == FFT_REAL)
-      config->input = (float *)malloc(config->size * sizeof(float));
-    else if (config->type == FFT_COMPLEX)
-      config->input = (float *)malloc(2 * config->size * sizeof(float));
+      config->input = (float *)malloc(config->size * count * sizeof(float));
+    else
+      config->input = (float *)malloc(2 * config->size * count * sizeof(float));
 
     config->flags |= FFT_OWN_INPUT_MEM;
   }
 
   if (config->input == NULL)
-    return NULL;
+    goto fail;
 
   // Allocate output buffer
   if (output != NULL)
@@ -99,17 +250,21 @@ fft_config_t *fft_init(int size, fft_type_t type, fft_direction_t direction, flo
   else
   {
     if (config->type == FFT_REAL)
-      config->output = (float *)malloc(config->size * sizeof(float));
-    else if (config->type == FFT_COMPLEX)
-      config->output = (float *)malloc(2 * config->size * sizeof(float));
+      config->output = (float *)malloc(config->size * count * sizeof(float));
+    else
+      config->output = (float *)malloc(2 * config->size * count * sizeof(float));
 
     config->flags |= FFT_OWN_OUTPUT_MEM;
   }
 
   if (config->output == NULL)
-    return NULL;
+    goto fail;
 
   return config;
+
+fail:
+  fft_destroy(config);
+  return NULL;
 }
 
 void fft_destroy(fft_config_t *config)
@@ -121,19 +276,152 @@ void fft_destroy(fft_config_t *config)
     free(config->output);
 
   free(config->twiddle_factors);
+  free(config->bit_reverse);
+  free(config->stage_twiddles);
+  fft_mixed_destroy(config->mixed);
+  free(config->work);
   free(config);
 }
 
+static void execute_mixed(fft_config_t *config, float *input, float *output)
+{
+  /*
+   * fft_execute for sizes other than powers of two. An even real FFT
+   * takes the same steps as on the iterative engine. An odd one has no
+   * N/2 bin, and stores the imaginary part of its last bin, (N-1)/2, in
+   * its place:
+   *
+   *   [ X[0], Im(X[(N-1)/2]), Re(X[1]), Im(X[1]), ..., Re(X[(N-1)/2]) ]
+   *
+   * input and output are the config's, or one signal of a batch.
+   */
+  int k, n = config->size, h = n / 2;
+  float *x = config->work, *y = config->work + 2 * n;
+
+  if (config->type != FFT_REAL)
+  {
+    fft_mixed(config->mixed, input, output);
+    if (config->direction == FFT_BACKWARD)
+      reverse_and_scale(output, n, 2);
+  }
+  else if (n % 2 == 0 && config->direction == FFT_FORWARD)
+  {
+    fft_mixed(config->mixed, input, output);
+    rfft_post(output, config->twiddle_factors, n);
+  }
+  else if (n % 2 == 0)
+  {
+    irfft_pre(input, config->twiddle_factors, n);
+    fft_mixed(config->mixed, input, output);
+    reverse_and_scale(output, n / 2, 2);
+  }
+  else if (config->direction == FFT_FORWARD)
+  {
+    for (k = 0 ; k < n ; k++)
+    {
+      x[2*k] = input[k];
+      x[2*k+1] = 0.0f;
+    }
+    fft_mixed(config->mixed, x, y);
+    output[0] = y[0];
+    for (k = 2 ; k < n - 1 ; k++)
+      output[k] = y[k];
+    if (h > 0)
+    {
+      output[n-1] = y[2*h];
+      output[1] = y[2*h+1];
+    }
+  }
+  else
+  {
+    // Rebuild the whole conjugate symmetric spectrum, transform it, and
+    // read the result backwards
+    x[0] = input[0];
+    x[1] = 0.0f;
+    for (k = 1 ; k <= h ; k++)
+    {
+      float re = k < h ? input[2*k] : input[n-1];
+      float im = k < h ? input[2*k+1] : input[1];
+      x[2*k] = re;
+      x[2*k+1] = im;
+      x[2*(n-k)] = re;
+      x[2*(n-k)+1] = -im;
+    }
+    fft_mixed(config->mixed, x, y);
+    float norm = 1. / n;
+    output[0] = y[0] * norm;
+    for (k = 1 ; k < n ; k++)
+      output[k] = y[2*(n-k)] * norm;
+  }
+}
+
+static void execute_mixed_many(fft_config_t *config)
+{
+  // A batch of a size other than a power of two, one signal at a time
+  int j, c, count = config->count;
+  int floats = config->type == FFT_REAL ? config->size : 2 * config->size;
+  float *in = config->work + (config->type == FFT_REAL && config->size % 2 != 0 ? 4 * config->size : 0);
+  float *out = in + floats;
+
+  for (c = 0 ; c < count ; c++)
+  {
+    for (j = 0 ; j < floats ; j++)
+      in[j] = config->input[j * count + c];
+    execute_mixed(config, in, out);
+    for (j = 0 ; j < floats ; j++)
+      config->output[j * count + c] = out[j];
+  }
+}
+
 void fft_execute(fft_config_t *config)
 {
-  if (config->type == FFT_REAL && config->direction == FFT_FORWARD)
-    rfft(config->input, config->output, config->twiddle_factors, config->size);
+  /*
+   * Runs the iterative engine, or the mixed-radix one for sizes other
+   * than powers of two, on every signal of a config of fft_init_many.
+   * fft(), rfft(), ifft() and irfft() still run the recursive
+   * split-radix one on a config of a power of two size.
+   */
+  int n = config->size;
+
+  if (config->count > 1 && config->mixed != NULL)
+    execute_mixed_many(config);
+  else if (config->count > 1)
+    fft_execute_many(config);
+  else if (config->mixed != NULL)
+    execute_mixed(config, config->input, config->output);
+  else if (config->type == FFT_REAL && config->direction == FFT_FORWARD)
+  {
+    fft_iterative(config->input, config->output, n / 2, config->bit_reverse, config->stage_twiddles);
+    rfft_post(config->output, config->twiddle_factors, n);
+  }
   else if (config->type == FFT_REAL && config->direction == FFT_BACKWARD)
-    irfft(config->input, config->output, config->twiddle_factors, config->size);
+  {
+    irfft_pre(config->input, config->twiddle_factors, n);
+    fft_iterative(config->input, config->output, n / 2, config->bit_reverse, config->stage_twiddles);
+    reverse_and_scale(config->output, n / 2, 2);
+  }
   else if (config->type == FFT_COMPLEX && config->direction == FFT_FORWARD)
-    fft(config->input, config->output, config->twiddle_factors, config->size);
+    fft_iterative(config->input, config->output, n, config->bit_reverse, config->stage_twiddles);
   else if (config->type == FFT_COMPLEX && config->direction == FFT_BACKWARD)
-    ifft(config->input, config->output, config->twiddle_factors, config->size);
+  {
+    fft_iterative(config->input, config->output, n, config->bit_reverse, config->stage_twiddles);
+    reverse_and_scale(config->output, n, 2);
+  }
+  else if (config->type == FFT_COMPLEX_SPLIT && config->direction == FFT_FORWARD)
+    fft_split(config->input, config->input + n, config->output, config->output + n, n,
+              config->bit_reverse, config->stage_twiddles, config->split_stage);
+  else if (config->type == FFT_COMPLEX_SPLIT && config->direction == FFT_BACKWARD)
+  {
+    // Swapping the real and imaginary parts conjugates and multiplies by
+    // j, so with them swapped both ways the forward transform runs the
+    // inverse one, and the swaps only exchange pointers
+    int k;
+    float norm = 1. / n;
+    fft_split(config->input + n, config->input, config->output + n, config->output, n,
+              config->bit_reverse, config->stage_twiddles, config->split_stage);
+    for (k = 0 ; k < 2 * n ; k++)
+      config->output[k] *= norm;
+  }
 }
 
 void fft(float *input, float *output, float *twiddle_factors, int n)
@@ -191,6 +479,11 @@ void rfft(float *x, float *y, float *twiddle_factors, int n)
   fft_primitive(x, y, n / 2, 2, twiddle_factors, 4);
 #endif
 
+  rfft_post(y, twiddle_factors, n);
+}
+
+static void rfft_post(float *y, float *twiddle_factors, int n)
+{
   // Now apply post processing to recover positive
   // frequencies of the real FFT
   float t = y[0];
@@ -199,7 +492,9 @@ void rfft(float *x, float *y, float *twiddle_factors, int n)
 
   // Apply post processing to quarter element
   // this boils down to taking complex conjugate
-  y[n/2+1] = -y[n/2+1];
+  // (there is none unless n is a multiple of 4)
+  if (n % 4 == 0)
+    y[n/2+1] = -y[n/2+1];
 
   // Now process all the other frequencies
   int k;
@@ -234,6 +529,12 @@ void irfft(float *x, float *y, float *twiddle_factors, int n)
   /*
    * Destroys content of input vector
    */
+  irfft_pre(x, twiddle_factors, n);
+  ifft_primitive(x, y, n / 2, 2, twiddle_factors, 4);
+}
+
+static void irfft_pre(float *x, float *twiddle_factors, int n)
+{
   int k;
 
   // Here we need to apply a pre-processing first
@@ -241,7 +542,8 @@ void irfft(float *x, float *y, float *twiddle_factors, int n)
   x[0] = 0.5 * (t + x[1]);
   x[1] = 0.5 * (t - x[1]);
 
-  x[n/2+1] = -x[n/2+1];
+  if (n % 4 == 0)
+    x[n/2+1] = -x[n/2+1];
 
   for (k = 2 ; k < n / 2 ; k += 2)
   {
@@ -265,8 +567,6 @@ void irfft(float *x, float *y, float *twiddle_factors, int n)
     x[n-k]   = xer + xoi;
     x[n-k+1] = xor_t - xei;
   }
-
-  ifft_primitive(x, y, n / 2, 2, twiddle_factors, 4);
 }
 
 void fft_primitive(float *x, float *y, int n, int stride, float *twiddle_factors, int tw_stride)
@@ -508,6 +808,15 @@ void ifft_primitive(float *input, float *output, int n, int stride, float *twidd
   fft_primitive(input, output, n, stride, twiddle_factors, tw_stride);
 #endif
 
+  reverse_and_scale(output, n, stride);
+}
+
+static void reverse_and_scale(float *output, int n, int stride)
+{
+  /*
+   * Turns a forward transform into the inverse one:
+   * x[k] = conj(DFT(conj(X)))[k] / n = DFT(X)[-k] / n
+   */
   int ks;
 
   int ns = n * stride;
@@ -691,3 +1000,126 @@ inline void fft4(float *input, int stride_in, float *output, int stride_out)
   output[stride_out+1] = t1 + t2;
   output[3*stride_out+1] = t1 - t2;
 }
+
+void fft_iterative(const float *x, float *y, int n, const int *bit_reverse, const float *stage_twiddles)
+{
+  /*
+   * Forward fast Fourier transform
+   * Iterative, radix-4 after a first radix-8 pass when n is not a power
+   * of 4
+   *
+   * The first pass reads the input in bit-reversed order, so it doubles
+   * as the bit-reversal pass, and writes its small transforms in order.
+   * Every later stage then runs in place in the output, walking the data
+   * and its own slice of the twiddle table front to back. Unlike the
+   * recursive transforms, no stage strides through memory by more than
+   * its butterfly span.
+   *
+   * Parameters
+   * ----------
+   *  x (float *)
+   *    The input array containing the complex samples with
+   *    real/imaginary parts interleaved [Re(x0), Im(x0), ..., Re(x_n-1), Im(x_n-1)]
+   *  y (float *)
+   *    The output array, not overlapping x, with the same layout
+   *  n (int)
+   *    The FFT size, should be a power of 2
+   *  bit_reverse (int *)
+   *    The input order, see fft_config_t
+   *  stage_twiddles (float *)
+   *    The stages' twiddle factors, see fft_config_t
+   */
+  int i, k, m, g;
+  const float *w = stage_twiddles;
+
+  m = first_span(n);
+  if (m == 8 || m == 4)
+  {
+    // In bit-reversed order, the m samples from position g on are those
+    // from bit_reverse[g] on with a stride of n / m, in their own
+    // bit-reversed order, so the unrolled transforms read them straight
+    // from the input
+    int stride = 2 * (n / m);
+    for (g = 0 ; g < n ; g += m)
+    {
+      if (m == 8)
+        fft8((float *)x + 2 * bit_reverse[g], stride, y + 2 * g, 2);
+      else
+        fft4((float *)x + 2 * bit_reverse[g], stride, y + 2 * g, 2);
+    }
+  }
+  else
+  {
+    // Sizes 1 and 2
+    for (i = 0 ; i < n ; i++)
+    {
+      y[2 * i] = x[2 * bit_reverse[i]];
+      y[2 * i + 1] = x[2 * bit_reverse[i] + 1];
+    }
+    if (n == 2)
+    {
+      float t;
+      t = y[0];
+      y[0] = t + y[2];
+      y[2] = t - y[2];
+      t = y[1];
+      y[1] = t + y[3];
+      y[3] = t - y[3];
+    }
+  }
+
+  // Each stage joins four transforms of size m into one of size 4m. In
+  // bit-reversed order the four are those of the samples at 0, 2, 1 and 3
+  // modulo 4, in that order.
+  for ( ; 4 * m <= n ; m *= 4)
+  {
+    for (g = 0 ; g < n ; g += 4 * m)
+    {
+      float *a = y + 2 * g;
+      for (k = 0 ; k < m ; k++)
+      {
+        float a0r, a0i, t1r, t1i, t2r, t2i, t3r, t3i, br, bi;
+        float s0r, s0i, s1r, s1i, s2r, s2i, s3r, s3i;
+        const float *wk = w + 6 * k;
+
+        a0r = a[2 * k];
+        a0i = a[2 * k + 1];
+
+        br = a[2 * (2 * m + k)];
+        bi = a[2 * (2 * m + k) + 1];
+        t1r = wk[0] * br - wk[1] * bi;
+        t1i = wk[0] * bi + wk[1] * br;
+
+        br = a[2 * (m + k)];
+        bi = a[2 * (m + k) + 1];
+        t2r = wk[2] * br - wk[3] * bi;
+        t2i = wk[2] * bi + wk[3] * br;
+
+        br = a[2 * (3 * m + k)];
+        bi = a[2 * (3 * m + k) + 1];
+        t3r = wk[4] * br - wk[5] * bi;
+        t3i = wk[4] * bi + wk[5] * br;
+
+        s0r = a0r + t2r;
+        s0i = a0i + t2i;
+        s1r = a0r - t2r;
+        s1i = a0i - t2i;
+        s2r = t1r + t3r;
+        s2i = t1i + t3i;
+        s3r = t1r - t3r;
+        s3i = t1i - t3i;
+
+        // X[k], X[k+m], X[k+2m] and X[k+3m], with -j * s3 and +j * s3
+        a[2 * k] = s0r + s2r;
+        a[2 * k + 1] = s0i + s2i;
+        a[2 * (m + k)] = s1r + s3i;
+        a[2 * (m + k) + 1] = s1i - s3r;
+        a[2 * (2 * m + k)] = s0r - s2r;
+        a[2 * (2 * m + k) + 1] = s0i - s2i;
+        a[2 * (3 * m + k)] = s1r - s3i;
+        a[2 * (3 * m + k) + 1] = s1i + s3r;
+      }
+    }
+    w += 6 * m;
+  }
+}
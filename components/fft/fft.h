@@ -40,7 +40,8 @@
 typedef enum
 {
   FFT_REAL,
-  FFT_COMPLEX
+  FFT_COMPLEX,
+  FFT_COMPLEX_SPLIT  // complex, all real parts then all imaginary parts
 } fft_type_t;
 
 typedef enum
@@ -49,6 +50,26 @@ typedef enum
   FFT_BACKWARD
 } fft_direction_t;
 
+// Kernels of the FFT_COMPLEX_SPLIT stages
+typedef enum
+{
+  FFT_ISA_SCALAR,
+  FFT_ISA_SSE2,
+  FFT_ISA_AVX2   // with FMA
+} fft_isa_t;
+
+typedef void (*fft_split_stage_t)(float *re, float *im, int n, int m, const float *twiddles);
+
+// Plan of a complex FFT of any size, see fft_mixed.c
+typedef struct fft_mixed fft_mixed_t;
+
+// Samples of a fixed-point FFT, see fft_fixed.c
+typedef enum
+{
+  FFT_Q15,  // int16_t
+  FFT_Q31   // int32_t
+} fft_format_t;
+
 #define FFT_OWN_INPUT_MEM 1
 #define FFT_OWN_OUTPUT_MEM 2
 
@@ -61,11 +82,39 @@ typedef struct
   fft_type_t type;   // real or complex
   fft_direction_t direction; // forward or backward
   unsigned int flags; // FFT flags
+  int *bit_reverse;  // input order of the iterative engine's complex transform
+  float *stage_twiddles;  // its twiddle factors, in the order the stages use them, split for FFT_COMPLEX_SPLIT
+  fft_isa_t isa;  // kernels the split stages run with, the best this CPU has unless set
+  fft_split_stage_t split_stage;
+  fft_mixed_t *mixed;  // engine of sizes other than powers of two, NULL for those
+  float *work;  // 4 * size floats for an odd FFT_REAL size, 4 * size more for a batch, NULL otherwise
+  int count;  // signals transformed together, see fft_init_many
 } fft_config_t;
 
+// The same for a fixed-point FFT of a power of two size, FFT_REAL or
+// FFT_COMPLEX; the buffers hold samples of the format
+typedef struct
+{
+  int size;
+  void *input;
+  void *output;
+  void *twiddle_factors;  // W_size^k for k below size / 2, interleaved
+  fft_type_t type;
+  fft_direction_t direction;
+  unsigned int flags;
+  int *bit_reverse;
+  fft_format_t format;
+  int exponent;  // set by fft_fixed_execute: the transform is output * 2^exponent
+} fft_fixed_config_t;
+
 fft_config_t *fft_init(int size, fft_type_t type, fft_direction_t direction, float *input, float *output);
+// count signals of one size, interleaved, in one config. Only powers of
+// two run them together and beat a plan per signal; for other sizes it
+// is a convenience wrapper around one signal at a time, and slower.
+fft_config_t *fft_init_many(int size, int count, fft_type_t type, fft_direction_t direction, float *input, float *output);
 void fft_destroy(fft_config_t *config);
 void fft_execute(fft_config_t *config);
+void fft_execute_many(fft_config_t *config);
 void fft(float *input, float *output, float *twiddle_factors, int n);
 void ifft(float *input, float *output, float *twiddle_factors, int n);
 void rfft(float *x, float *y, float *twiddle_factors, int n);
@@ -75,5 +124,18 @@ void split_radix_fft(float *x, float *y, int n, int stride, float *twiddle_facto
 void ifft_primitive(float *input, float *output, int n, int stride, float *twiddle_factors, int tw_stride);
 void fft8(float *input, int stride_in, float *output, int stride_out);
 void fft4(float *input, int stride_in, float *output, int stride_out);
+void fft_iterative(const float *x, float *y, int n, const int *bit_reverse, const float *stage_twiddles);
+void fft_split(const float *xr, const float *xi, float *yr, float *yi, int n, const int *bit_reverse,
+               const float *stage_twiddles, fft_split_stage_t stage);
+fft_isa_t fft_best_isa(void);
+int fft_set_isa(fft_config_t *config, fft_isa_t isa);
+const char *fft_isa_name(fft_isa_t isa);
+fft_mixed_t *fft_mixed_init(int n);
+void fft_mixed_destroy(fft_mixed_t *plan);
+void fft_mixed(fft_mixed_t *plan, const float *x, float *y);
+fft_fixed_config_t *fft_fixed_init(int size, fft_format_t format, fft_type_t type, fft_direction_t direction,
+                                   void *input, void *output);
+void fft_fixed_destroy(fft_fixed_config_t *config);
+void fft_fixed_execute(fft_fixed_config_t *config);
 
 #endif // __FFT_H__
@@ -0,0 +1,571 @@
+/*
+ * Fixed-point FFTs, on Q15 (int16_t) or Q31 (int32_t) samples, with
+ * block floating point scaling: the whole buffer shares one exponent.
+ *
+ * The transform is a radix-2 decimation in time on the input in
+ * bit-reversed order. Before each stage the largest part of the buffer,
+ * tracked as the stage before wrote it, says how far the stage must
+ * shift its inputs right to leave room for a butterfly's growth, at
+ * most 1 + sqrt(2) times; each shift adds to the exponent. A small
+ * input is shifted left first, so 12-bit ADC samples use the whole
+ * word. Real FFTs run a complex one of half the size and the same
+ * post-processing as rfft_post, with the same headroom. Nothing here
+ * touches the FPU once planned, so it may run in an ISR or in tasks
+ * that never save FPU registers.
+ *
+ * The Q15 stages multiply 16 by 16 bits into 32, the Q31 ones 32 by 32
+ * into 64.
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "fft.h"
+
+// Parts of at most these fit the growth of a butterfly with twiddle
+// factors, 2 / 5 of full scale, and of one by 1 or -j, a half
+#define Q15_LIMIT 13107
+#define Q15_HALF 16383
+#define Q31_LIMIT 858993459
+#define Q31_HALF 1073741823
+
+static int headroom_shift(int64_t max, int64_t limit)
+{
+  /*
+   * The right shift that leaves a block whose largest part is max at
+   * most limit once rounded, or, negative, the left shift that takes it
+   * closest to limit
+   */
+  int s = 0;
+
+  while ((max >> s) >= limit)
+    s++;
+  if (s == 0 && max > 0)
+    while ((max << (1 - s)) < limit)
+      s--;
+  return s;
+}
+
+static inline int64_t shift_round64(int64_t v, int s)
+{
+  // v / 2^s, rounded, or v * 2^-s
+  if (s > 0)
+    return (v + ((int64_t)1 << (s - 1))) >> s;
+  return v * ((int64_t)1 << -s);
+}
+
+static inline int32_t shift_round(int32_t v, int s)
+{
+  return (int32_t)shift_round64(v, s);
+}
+
+static int log2_size(int n)
+{
+  int bits = 0;
+
+  while ((1 << bits) < n)
+    bits++;
+  return bits;
+}
+
+/* Q15 */
+
+static int32_t q15_max(const int16_t *x, int floats)
+{
+  int32_t max = 0;
+  int k;
+
+  for (k = 0 ; k < floats ; k++)
+  {
+    int32_t a = x[k] < 0 ? -(int32_t)x[k] : x[k];
+    if (a > max)
+      max = a;
+  }
+  return max;
+}
+
+static int q15_transform(const int16_t *x, int16_t *y, int n, int size, const int *bit_reverse,
+                         const int16_t *twiddles)
+{
+  /*
+   * Complex FFT of n points from x to y, with W_size^k at twiddles[2k].
+   * Returns the exponent of y.
+   */
+  int g, k, m, s, exponent;
+  int32_t max = q15_max(x, 2 * n);
+
+  // The first stage, on the samples in bit-reversed order, adds and
+  // subtracts pairs before it shifts, so full scale input loses a bit
+  // only; a small one is shifted left
+  s = headroom_shift(n > 1 ? 2 * max : max, INT16_MAX);
+  exponent = s;
+  max = 0;
+  for (k = 0 ; k < n ; k += 2)
+  {
+    const int16_t *a = x + 2 * bit_reverse[k];
+    const int16_t *b = n > 1 ? x + 2 * bit_reverse[k+1] : NULL;
+    int32_t v[4] = { a[0], a[1], 0, 0 };
+    int j;
+
+    if (b != NULL)
+    {
+      v[0] = a[0] + b[0];
+      v[1] = a[1] + b[1];
+      v[2] = a[0] - b[0];
+      v[3] = a[1] - b[1];
+    }
+    for (j = 0 ; j < (b != NULL ? 4 : 2) ; j++)
+    {
+      v[j] = shift_round(v[j], s);
+      y[2 * k + j] = (int16_t)v[j];
+      max = abs(v[j]) > max ? abs(v[j]) : max;
+    }
+  }
+
+  for (m = 2 ; m < n ; m *= 2)
+  {
+    // W_2m^k = W_size^(k size / 2m); the second stage only takes 1 and
+    // -j, which add no more than a factor of two
+    int stride = 2 * (size / (2 * m));
+
+    s = headroom_shift(max, m <= 2 ? Q15_HALF : Q15_LIMIT);
+    if (s < 0)
+      s = 0;
+    exponent += s;
+    max = 0;
+
+    for (g = 0 ; g < n ; g += 2 * m)
+    {
+      for (k = 0 ; k < m ; k++)
+      {
+        int16_t *a = y + 2 * (g + k), *b = a + 2 * m;
+        int32_t wr = twiddles[k * stride], wi = twiddles[k * stride + 1];
+        int32_t round = 1 << (14 + s);
+        int32_t tr = (wr * b[0] - wi * b[1] + round) >> (15 + s);
+        int32_t ti = (wr * b[1] + wi * b[0] + round) >> (15 + s);
+        int32_t ar = shift_round(a[0], s), ai = shift_round(a[1], s);
+        int32_t v[4] = { ar + tr, ai + ti, ar - tr, ai - ti };
+        int j;
+
+        for (j = 0 ; j < 4 ; j++)
+          max = abs(v[j]) > max ? abs(v[j]) : max;
+        a[0] = (int16_t)v[0];
+        a[1] = (int16_t)v[1];
+        b[0] = (int16_t)v[2];
+        b[1] = (int16_t)v[3];
+      }
+    }
+  }
+  return exponent;
+}
+
+static int q15_rfft_post(int16_t *y, const int16_t *twiddles, int n)
+{
+  /*
+   * rfft_post on the n / 2 point transform in y, shifted right as the
+   * growth needs. Returns that shift.
+   */
+  int k, s = headroom_shift(q15_max(y, n), Q15_LIMIT);
+  int32_t t, u;
+
+  if (s < 0)
+    s = 0;
+  t = shift_round(y[0], s);
+  u = shift_round(y[1], s);
+  y[0] = (int16_t)(t + u);
+  y[1] = (int16_t)(t - u);
+  if (n % 4 == 0)
+  {
+    y[n/2] = (int16_t)shift_round(y[n/2], s);
+    y[n/2+1] = (int16_t)-shift_round(y[n/2+1], s);
+  }
+
+  for (k = 2 ; k < n / 2 ; k += 2)
+  {
+    // Twice the halves, and the result over 2^(15 + 1)
+    int32_t c = twiddles[k], sn = -twiddles[k+1];
+    int32_t ar = shift_round(y[k], s), ai = shift_round(y[k+1], s);
+    int32_t br = shift_round(y[n-k], s), bi = shift_round(y[n-k+1], s);
+    int64_t xer = (int64_t)(ar + br) * 32768, xei = (int64_t)(ai - bi) * 32768;
+    int32_t xor_t = ai + bi, xoi = br - ar;
+    int64_t tr = (int64_t)c * xor_t + (int64_t)sn * xoi;
+    int64_t ti = -(int64_t)sn * xor_t + (int64_t)c * xoi;
+    int64_t round = 1 << 15;
+
+    y[k] = (int16_t)((xer + tr + round) >> 16);
+    y[k+1] = (int16_t)((xei + ti + round) >> 16);
+    y[n-k] = (int16_t)((xer - tr + round) >> 16);
+    y[n-k+1] = (int16_t)((ti - xei + round) >> 16);
+  }
+  return s;
+}
+
+static int q15_irfft_pre(int16_t *x, const int16_t *twiddles, int n)
+{
+  // irfft_pre, the same way
+  int k, s = headroom_shift(q15_max(x, n), Q15_LIMIT);
+  int32_t t, u;
+
+  if (s < 0)
+    s = 0;
+  t = shift_round(x[0], s);
+  u = shift_round(x[1], s);
+  x[0] = (int16_t)((t + u + 1) >> 1);
+  x[1] = (int16_t)((t - u + 1) >> 1);
+  if (n % 4 == 0)
+  {
+    x[n/2] = (int16_t)shift_round(x[n/2], s);
+    x[n/2+1] = (int16_t)-shift_round(x[n/2+1], s);
+  }
+
+  for (k = 2 ; k < n / 2 ; k += 2)
+  {
+    int32_t c = twiddles[k], sn = -twiddles[k+1];
+    int32_t ar = shift_round(x[k], s), ai = shift_round(x[k+1], s);
+    int32_t br = shift_round(x[n-k], s), bi = shift_round(x[n-k+1], s);
+    int64_t xer = (int64_t)(ar + br) * 32768, xei = (int64_t)(ai - bi) * 32768;
+    int32_t tr = ar - br, ti = ai + bi;
+    int64_t xor_t = (int64_t)c * tr - (int64_t)sn * ti;
+    int64_t xoi = (int64_t)sn * tr + (int64_t)c * ti;
+    int64_t round = 1 << 15;
+
+    x[k] = (int16_t)((xer - xoi + round) >> 16);
+    x[k+1] = (int16_t)((xor_t + xei + round) >> 16);
+    x[n-k] = (int16_t)((xer + xoi + round) >> 16);
+    x[n-k+1] = (int16_t)((xor_t - xei + round) >> 16);
+  }
+  return s;
+}
+
+/* Q31 */
+
+static int64_t q31_max(const int32_t *x, int floats)
+{
+  int64_t max = 0;
+  int k;
+
+  for (k = 0 ; k < floats ; k++)
+  {
+    int64_t a = x[k] < 0 ? -(int64_t)x[k] : x[k];
+    if (a > max)
+      max = a;
+  }
+  return max;
+}
+
+static int q31_transform(const int32_t *x, int32_t *y, int n, int size, const int *bit_reverse,
+                         const int32_t *twiddles)
+{
+  // q15_transform, with 64-bit products
+  int g, k, m, s, exponent;
+  int64_t max = q31_max(x, 2 * n);
+
+  s = headroom_shift(n > 1 ? 2 * max : max, INT32_MAX);
+  exponent = s;
+  max = 0;
+  for (k = 0 ; k < n ; k += 2)
+  {
+    const int32_t *a = x + 2 * bit_reverse[k];
+    const int32_t *b = n > 1 ? x + 2 * bit_reverse[k+1] : NULL;
+    int64_t v[4] = { a[0], a[1], 0, 0 };
+    int j;
+
+    if (b != NULL)
+    {
+      v[0] = (int64_t)a[0] + b[0];
+      v[1] = (int64_t)a[1] + b[1];
+      v[2] = (int64_t)a[0] - b[0];
+      v[3] = (int64_t)a[1] - b[1];
+    }
+    for (j = 0 ; j < (b != NULL ? 4 : 2) ; j++)
+    {
+      v[j] = shift_round64(v[j], s);
+      y[2 * k + j] = (int32_t)v[j];
+      max = llabs(v[j]) > max ? llabs(v[j]) : max;
+    }
+  }
+
+  for (m = 2 ; m < n ; m *= 2)
+  {
+    int stride = 2 * (size / (2 * m));
+
+    s = headroom_shift(max, m <= 2 ? Q31_HALF : Q31_LIMIT);
+    if (s < 0)
+      s = 0;
+    exponent += s;
+    max = 0;
+
+    for (g = 0 ; g < n ; g += 2 * m)
+    {
+      for (k = 0 ; k < m ; k++)
+      {
+        int32_t *a = y + 2 * (g + k), *b = a + 2 * m;
+        int64_t wr = twiddles[k * stride], wi = twiddles[k * stride + 1];
+        int64_t round = (int64_t)1 << (30 + s);
+        int64_t tr = (wr * b[0] - wi * b[1] + round) >> (31 + s);
+        int64_t ti = (wr * b[1] + wi * b[0] + round) >> (31 + s);
+        int64_t ar = shift_round(a[0], s), ai = shift_round(a[1], s);
+        int64_t v[4] = { ar + tr, ai + ti, ar - tr, ai - ti };
+        int j;
+
+        for (j = 0 ; j < 4 ; j++)
+          max = llabs(v[j]) > max ? llabs(v[j]) : max;
+        a[0] = (int32_t)v[0];
+        a[1] = (int32_t)v[1];
+        b[0] = (int32_t)v[2];
+        b[1] = (int32_t)v[3];
+      }
+    }
+  }
+  return exponent;
+}
+
+static int q31_rfft_post(int32_t *y, const int32_t *twiddles, int n)
+{
+  // q15_rfft_post; the parts stay under 2 / 5 of 2^31, so the sums of
+  // products stay under 2^63
+  int k, s = headroom_shift(q31_max(y, n), Q31_LIMIT);
+  int64_t t, u;
+
+  if (s < 0)
+    s = 0;
+  t = shift_round(y[0], s);
+  u = shift_round(y[1], s);
+  y[0] = (int32_t)(t + u);
+  y[1] = (int32_t)(t - u);
+  if (n % 4 == 0)
+  {
+    y[n/2] = shift_round(y[n/2], s);
+    y[n/2+1] = -shift_round(y[n/2+1], s);
+  }
+
+  for (k = 2 ; k < n / 2 ; k += 2)
+  {
+    int64_t c = twiddles[k], sn = -(int64_t)twiddles[k+1];
+    int64_t ar = shift_round(y[k], s), ai = shift_round(y[k+1], s);
+    int64_t br = shift_round(y[n-k], s), bi = shift_round(y[n-k+1], s);
+    int64_t xer = (ar + br) * ((int64_t)1 << 31), xei = (ai - bi) * ((int64_t)1 << 31);
+    int64_t xor_t = ai + bi, xoi = br - ar;
+    int64_t tr = c * xor_t + sn * xoi;
+    int64_t ti = -sn * xor_t + c * xoi;
+    int64_t round = (int64_t)1 << 31;
+
+    y[k] = (int32_t)((xer + tr + round) >> 32);
+    y[k+1] = (int32_t)((xei + ti + round) >> 32);
+    y[n-k] = (int32_t)((xer - tr + round) >> 32);
+    y[n-k+1] = (int32_t)((ti - xei + round) >> 32);
+  }
+  return s;
+}
+
+static int q31_irfft_pre(int32_t *x, const int32_t *twiddles, int n)
+{
+  int k, s = headroom_shift(q31_max(x, n), Q31_LIMIT);
+  int64_t t, u;
+
+  if (s < 0)
+    s = 0;
+  t = shift_round(x[0], s);
+  u = shift_round(x[1], s);
+  x[0] = (int32_t)((t + u + 1) >> 1);
+  x[1] = (int32_t)((t - u + 1) >> 1);
+  if (n % 4 == 0)
+  {
+    x[n/2] = shift_round(x[n/2], s);
+    x[n/2+1] = -shift_round(x[n/2+1], s);
+  }
+
+  for (k = 2 ; k < n / 2 ; k += 2)
+  {
+    int64_t c = twiddles[k], sn = -(int64_t)twiddles[k+1];
+    int64_t ar = shift_round(x[k], s), ai = shift_round(x[k+1], s);
+    int64_t br = shift_round(x[n-k], s), bi = shift_round(x[n-k+1], s);
+    int64_t xer = (ar + br) * ((int64_t)1 << 31), xei = (ai - bi) * ((int64_t)1 << 31);
+    int64_t tr = ar - br, ti = ai + bi;
+    int64_t xor_t = c * tr - sn * ti;
+    int64_t xoi = sn * tr + c * ti;
+    int64_t round = (int64_t)1 << 31;
+
+    x[k] = (int32_t)((xer - xoi + round) >> 32);
+    x[k+1] = (int32_t)((xor_t + xei + round) >> 32);
+    x[n-k] = (int32_t)((xer + xoi + round) >> 32);
+    x[n-k+1] = (int32_t)((xor_t - xei + round) >> 32);
+  }
+  return s;
+}
+
+static void reverse(void *output, int n, fft_format_t format)
+{
+  // reverse_and_scale without the scaling, which goes in the exponent
+  int k;
+
+  for (k = 1 ; k < n / 2 ; k++)
+  {
+    if (format == FFT_Q15)
+    {
+      int16_t *y = output, t;
+      t = y[2*k]; y[2*k] = y[2*(n-k)]; y[2*(n-k)] = t;
+      t = y[2*k+1]; y[2*k+1] = y[2*(n-k)+1]; y[2*(n-k)+1] = t;
+    }
+    else
+    {
+      int32_t *y = output, t;
+      t = y[2*k]; y[2*k] = y[2*(n-k)]; y[2*(n-k)] = t;
+      t = y[2*k+1]; y[2*k+1] = y[2*(n-k)+1]; y[2*(n-k)+1] = t;
+    }
+  }
+}
+
+fft_fixed_config_t *fft_fixed_init(int size, fft_format_t format, fft_type_t type, fft_direction_t direction,
+                                   void *input, void *output)
+{
+  /*
+   * Prepare a fixed-point FFT, as fft_init does a float one.
+   *
+   * Parameters
+   * ----------
+   *  size (int)
+   *    The FFT size, a power of two, at least 2 for FFT_REAL
+   *  format (fft_format_t)
+   *    FFT_Q15 for int16_t buffers, FFT_Q31 for int32_t ones
+   *  type (fft_type_t)
+   *    FFT_REAL or FFT_COMPLEX, with the buffers laid out as for fft_init
+   *  input, output (void *)
+   *    Buffers of size (FFT_REAL) or 2 * size (FFT_COMPLEX) samples of
+   *    the format, or NULL to have them allocated
+   *
+   * Returns NULL, with everything it allocated freed, for any other size
+   * or type, or if memory runs out.
+   */
+  int k, n, bytes = format == FFT_Q15 ? sizeof(int16_t) : sizeof(int32_t);
+  int32_t limit = format == FFT_Q15 ? INT16_MAX : INT32_MAX;
+
+  if (size < 1 || (size & (size - 1)) != 0 || (type == FFT_REAL && size < 2) || type == FFT_COMPLEX_SPLIT)
+    return NULL;
+
+  fft_fixed_config_t *config = (fft_fixed_config_t *)calloc(1, sizeof(fft_fixed_config_t));
+  if (config == NULL)
+    return NULL;
+
+  config->size = size;
+  config->format = format;
+  config->type = type;
+  config->direction = direction;
+
+  // W_size^k for k below size / 2, full scale clamped to the largest
+  // part the format holds; doubles, so the Q31 ones are exact
+  config->twiddle_factors = malloc((size > 1 ? size : 2) * bytes);
+  if (config->twiddle_factors == NULL)
+    goto fail;
+  for (k = 0 ; k < size / 2 ; k++)
+  {
+    double angle = -2.0 * M_PI * k / size;
+    double re = cos(angle) * ((double)limit + 1.0), im = sin(angle) * ((double)limit + 1.0);
+    re = re > limit ? limit : re < -limit ? -limit : re;
+    im = im > limit ? limit : im < -limit ? -limit : im;
+    if (format == FFT_Q15)
+    {
+      ((int16_t *)config->twiddle_factors)[2*k] = (int16_t)lrint(re);
+      ((int16_t *)config->twiddle_factors)[2*k+1] = (int16_t)lrint(im);
+    }
+    else
+    {
+      ((int32_t *)config->twiddle_factors)[2*k] = (int32_t)llrint(re);
+      ((int32_t *)config->twiddle_factors)[2*k+1] = (int32_t)llrint(im);
+    }
+  }
+
+  n = type == FFT_REAL ? size / 2 : size;
+  config->bit_reverse = (int *)malloc(n * sizeof(int));
+  if (config->bit_reverse == NULL)
+    goto fail;
+  for (k = 0 ; k < n ; k++)
+  {
+    int r = 0, b, bits = log2_size(n);
+    for (b = 0 ; b < bits ; b++)
+      r |= ((k >> b) & 1) << (bits - 1 - b);
+    config->bit_reverse[k] = r;
+  }
+
+  if (input != NULL)
+    config->input = input;
+  else
+  {
+    config->input = malloc((type == FFT_REAL ? 1 : 2) * size * bytes);
+    config->flags |= FFT_OWN_INPUT_MEM;
+  }
+  if (config->input == NULL)
+    goto fail;
+
+  if (output != NULL)
+    config->output = output;
+  else
+  {
+    config->output = malloc((type == FFT_REAL ? 1 : 2) * size * bytes);
+    config->flags |= FFT_OWN_OUTPUT_MEM;
+  }
+  if (config->output == NULL)
+    goto fail;
+
+  return config;
+
+fail:
+  fft_fixed_destroy(config);
+  return NULL;
+}
+
+void fft_fixed_destroy(fft_fixed_config_t *config)
+{
+  if (config->flags & FFT_OWN_INPUT_MEM)
+    free(config->input);
+
+  if (config->flags & FFT_OWN_OUTPUT_MEM)
+    free(config->output);
+
+  free(config->twiddle_factors);
+  free(config->bit_reverse);
+  free(config);
+}
+
+void fft_fixed_execute(fft_fixed_config_t *config)
+{
+  /*
+   * Runs the FFT and sets config->exponent: the transform of the input,
+   * taken as integers, is output * 2^exponent. The backward transforms
+   * are scaled by 1 / size as fft_execute's are, in the exponent alone.
+   * An FFT_REAL backward one destroys its input, as fft_execute's does.
+   */
+  int size = config->size;
+  int n = config->type == FFT_REAL ? size / 2 : size;
+  int exponent = 0;
+
+  if (config->format == FFT_Q15)
+  {
+    int16_t *x = config->input, *y = config->output;
+    const int16_t *w = config->twiddle_factors;
+
+    if (config->type == FFT_REAL && config->direction == FFT_BACKWARD)
+      exponent += q15_irfft_pre(x, w, size);
+    exponent += q15_transform(x, y, n, size, config->bit_reverse, w);
+    if (config->type == FFT_REAL && config->direction == FFT_FORWARD)
+      exponent += q15_rfft_post(y, w, size);
+  }
+  else
+  {
+    int32_t *x = config->input, *y = config->output;
+    const int32_t *w = config->twiddle_factors;
+
+    if (config->type == FFT_REAL && config->direction == FFT_BACKWARD)
+      exponent += q31_irfft_pre(x, w, size);
+    exponent += q31_transform(x, y, n, size, config->bit_reverse, w);
+    if (config->type == FFT_REAL && config->direction == FFT_FORWARD)
+      exponent += q31_rfft_post(y, w, size);
+  }
+
+  if (config->direction == FFT_BACKWARD)
+  {
+    reverse(config->output, n, config->format);
+    exponent -= log2_size(n);
+  }
+  config->exponent = exponent;
+}
@@ -0,0 +1,363 @@
+/*
+ * Batched FFTs: count signals of the same power of two size in one call.
+ *
+ * The signals are interleaved float by float: float j of signal c, in
+ * the layout a single FFT of the type would use, is at [j * count + c].
+ * The transform is fft_iterative's, a first radix-8 or radix-4 pass that
+ * reads in bit-reversed order and then radix-4 stages, with the same
+ * tables, but every butterfly loads its twiddle factors once and runs
+ * on all the signals before the next one. The loops over signals are
+ * innermost and walk consecutive floats, so the compiler turns them
+ * into vector code with a signal in every lane; on x86 hosts an AVX2
+ * build of the same code runs when fft_best_isa finds it. GCC cannot
+ * tell that the real and imaginary rows, count floats apart, never
+ * overlap, hence the ivdep pragmas. The ESP32 has no vector unit, and
+ * only gains the shared twiddle factors and loop overhead.
+ */
+#include <stdlib.h>
+
+#include "fft.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86 1
+#endif
+
+#define INLINE static inline __attribute__((always_inline))
+
+INLINE void dft4_lanes(float *r, float *i)
+{
+  // 4 points in place, natural order
+  float s0r = r[0] + r[2], s0i = i[0] + i[2];
+  float s1r = r[0] - r[2], s1i = i[0] - i[2];
+  float s2r = r[1] + r[3], s2i = i[1] + i[3];
+  float s3r = r[1] - r[3], s3i = i[1] - i[3];
+
+  r[0] = s0r + s2r;
+  i[0] = s0i + s2i;
+  r[2] = s0r - s2r;
+  i[2] = s0i - s2i;
+  // -j times s3, and j times s3
+  r[1] = s1r + s3i;
+  i[1] = s1i - s3r;
+  r[3] = s1r - s3i;
+  i[3] = s1i + s3r;
+}
+
+INLINE void first_pass8(const float *x, float *y, int n, int count, const int *bit_reverse)
+{
+  /*
+   * The transforms of size 8 of the samples n / 8 apart from
+   * bit_reverse[g] on, written in order from sample g on: two of size 4
+   * on the even and odd samples, joined by W_8^k
+   */
+  const float sin_pi_4 = 0.7071067811865475;
+  int g, q, c;
+  int two = 2 * count, stride = two * (n / 8);
+
+  for (g = 0 ; g < n ; g += 8)
+  {
+    const float *a = x + two * bit_reverse[g];
+    float *b = y + two * g;
+
+    #pragma GCC ivdep
+    for (c = 0 ; c < count ; c++)
+    {
+      float er[4], ei[4], or_[4], oi[4], t;
+
+      for (q = 0 ; q < 4 ; q++)
+      {
+        er[q] = a[2 * q * stride + c];
+        ei[q] = a[2 * q * stride + count + c];
+        or_[q] = a[(2 * q + 1) * stride + c];
+        oi[q] = a[(2 * q + 1) * stride + count + c];
+      }
+      dft4_lanes(er, ei);
+      dft4_lanes(or_, oi);
+
+      // W_8^1 = (1 - j) / sqrt(2), W_8^2 = -j, W_8^3 = -(1 + j) / sqrt(2)
+      t = (or_[1] + oi[1]) * sin_pi_4;
+      oi[1] = (oi[1] - or_[1]) * sin_pi_4;
+      or_[1] = t;
+      t = oi[2];
+      oi[2] = -or_[2];
+      or_[2] = t;
+      t = (oi[3] - or_[3]) * sin_pi_4;
+      oi[3] = -(or_[3] + oi[3]) * sin_pi_4;
+      or_[3] = t;
+
+      for (q = 0 ; q < 4 ; q++)
+      {
+        b[q * two + c] = er[q] + or_[q];
+        b[q * two + count + c] = ei[q] + oi[q];
+        b[(q + 4) * two + c] = er[q] - or_[q];
+        b[(q + 4) * two + count + c] = ei[q] - oi[q];
+      }
+    }
+  }
+}
+
+INLINE void first_pass4(const float *x, float *y, int n, int count, const int *bit_reverse)
+{
+  // The same with transforms of size 4, if n is a power of 4
+  int g, q, c;
+  int two = 2 * count, stride = two * (n / 4);
+
+  for (g = 0 ; g < n ; g += 4)
+  {
+    const float *a = x + two * bit_reverse[g];
+    float *b = y + two * g;
+
+    #pragma GCC ivdep
+    for (c = 0 ; c < count ; c++)
+    {
+      float r[4], i[4];
+
+      for (q = 0 ; q < 4 ; q++)
+      {
+        r[q] = a[q * stride + c];
+        i[q] = a[q * stride + count + c];
+      }
+      dft4_lanes(r, i);
+      for (q = 0 ; q < 4 ; q++)
+      {
+        b[q * two + c] = r[q];
+        b[q * two + count + c] = i[q];
+      }
+    }
+  }
+}
+
+INLINE void radix4_stages(float *y, int n, int count, int m, const float *w)
+{
+  /*
+   * fft_iterative's stages: each joins four transforms of size m, in
+   * the order of the samples at 0, 2, 1 and 3 modulo 4, into one of
+   * size 4m
+   */
+  int g, k, c;
+  int two = 2 * count;
+
+  for ( ; 4 * m <= n ; m *= 4)
+  {
+    for (g = 0 ; g < n ; g += 4 * m)
+    {
+      for (k = 0 ; k < m ; k++)
+      {
+        const float *wk = w + 6 * k;
+        float w1r = wk[0], w1i = wk[1], w2r = wk[2], w2i = wk[3], w3r = wk[4], w3i = wk[5];
+        float *a0 = y + two * (g + k);
+        float *a1 = a0 + two * m;
+        float *a2 = a1 + two * m;
+        float *a3 = a2 + two * m;
+
+        #pragma GCC ivdep
+        for (c = 0 ; c < count ; c++)
+        {
+          float t1r = w1r * a2[c] - w1i * a2[count + c];
+          float t1i = w1r * a2[count + c] + w1i * a2[c];
+          float t2r = w2r * a1[c] - w2i * a1[count + c];
+          float t2i = w2r * a1[count + c] + w2i * a1[c];
+          float t3r = w3r * a3[c] - w3i * a3[count + c];
+          float t3i = w3r * a3[count + c] + w3i * a3[c];
+          float s0r = a0[c] + t2r, s0i = a0[count + c] + t2i;
+          float s1r = a0[c] - t2r, s1i = a0[count + c] - t2i;
+          float s2r = t1r + t3r, s2i = t1i + t3i;
+          float s3r = t1r - t3r, s3i = t1i - t3i;
+
+          a0[c] = s0r + s2r;
+          a0[count + c] = s0i + s2i;
+          a1[c] = s1r + s3i;
+          a1[count + c] = s1i - s3r;
+          a2[c] = s0r - s2r;
+          a2[count + c] = s0i - s2i;
+          a3[c] = s1r - s3i;
+          a3[count + c] = s1i + s3r;
+        }
+      }
+    }
+    w += 6 * m;
+  }
+}
+
+INLINE void transform(const float *x, float *y, int n, int count, const int *bit_reverse, const float *w)
+{
+  /*
+   * fft_iterative on every signal: the same first pass, of size 8 or 4,
+   * then the radix-4 stages
+   */
+  int c;
+
+  if ((n & 0x55555555) != 0 && n >= 4)
+  {
+    first_pass4(x, y, n, count, bit_reverse);
+    radix4_stages(y, n, count, 4, w);
+  }
+  else if (n >= 8)
+  {
+    first_pass8(x, y, n, count, bit_reverse);
+    radix4_stages(y, n, count, 8, w);
+  }
+  else
+  {
+    // Sizes 1 and 2
+    for (c = 0 ; c < 2 * count * n ; c++)
+      y[c] = x[c];
+    for (c = 0 ; n == 2 && c < 2 * count ; c++)
+    {
+      float t = y[c];
+      y[c] = t + y[2 * count + c];
+      y[2 * count + c] = t - y[2 * count + c];
+    }
+  }
+}
+
+INLINE void rfft_post_lanes(float *y, const float *twiddle_factors, int n, int count)
+{
+  /*
+   * rfft_post on every signal: the spectrum of the real signal from
+   * that of its even and odd samples
+   */
+  int k, c;
+
+  #pragma GCC ivdep
+  for (c = 0 ; c < count ; c++)
+  {
+    float t = y[c];
+    y[c] = t + y[count + c];
+    y[count + c] = t - y[count + c];
+    if (n % 4 == 0)
+      y[(n/2+1) * count + c] = -y[(n/2+1) * count + c];
+  }
+
+  for (k = 2 ; k < n / 2 ; k += 2)
+  {
+    float cs = twiddle_factors[k], sn = twiddle_factors[k+1];
+    float *a = y + k * count, *b = y + (n - k) * count;
+
+    #pragma GCC ivdep
+    for (c = 0 ; c < count ; c++)
+    {
+      float xer = 0.5f * (a[c] + b[c]);
+      float xei = 0.5f * (a[count + c] - b[count + c]);
+      float xor_t = 0.5f * (a[count + c] + b[count + c]);
+      float xoi = -0.5f * (a[c] - b[c]);
+      float tr = cs * xor_t + sn * xoi;
+      float ti = -sn * xor_t + cs * xoi;
+
+      a[c] = xer + tr;
+      a[count + c] = xei + ti;
+      b[c] = xer - tr;
+      b[count + c] = -(xei - ti);
+    }
+  }
+}
+
+INLINE void irfft_pre_lanes(float *x, const float *twiddle_factors, int n, int count)
+{
+  int k, c;
+
+  #pragma GCC ivdep
+  for (c = 0 ; c < count ; c++)
+  {
+    float t = x[c];
+    x[c] = 0.5f * (t + x[count + c]);
+    x[count + c] = 0.5f * (t - x[count + c]);
+    if (n % 4 == 0)
+      x[(n/2+1) * count + c] = -x[(n/2+1) * count + c];
+  }
+
+  for (k = 2 ; k < n / 2 ; k += 2)
+  {
+    float cs = twiddle_factors[k], sn = twiddle_factors[k+1];
+    float *a = x + k * count, *b = x + (n - k) * count;
+
+    #pragma GCC ivdep
+    for (c = 0 ; c < count ; c++)
+    {
+      float xer = 0.5f * (a[c] + b[c]);
+      float tr = 0.5f * (a[c] - b[c]);
+      float xei = 0.5f * (a[count + c] - b[count + c]);
+      float ti = 0.5f * (a[count + c] + b[count + c]);
+      float xor_t = cs * tr - sn * ti;
+      float xoi = sn * tr + cs * ti;
+
+      a[c] = xer - xoi;
+      a[count + c] = xor_t + xei;
+      b[c] = xer + xoi;
+      b[count + c] = xor_t - xei;
+    }
+  }
+}
+
+INLINE void reverse_and_scale_lanes(float *y, int n, int count)
+{
+  // reverse_and_scale on every signal of n complex samples
+  int k, c;
+  int two = 2 * count;
+  float norm = 1. / n;
+
+  for (k = 1 ; k < (n + 1) / 2 ; k++)
+  {
+    float *a = y + two * k, *b = y + two * (n - k);
+    for (c = 0 ; c < two ; c++)
+    {
+      float t = a[c];
+      a[c] = b[c];
+      b[c] = t;
+    }
+  }
+  for (k = 0 ; k < two * n ; k++)
+    y[k] *= norm;
+}
+
+INLINE void execute(fft_config_t *config)
+{
+  int n = config->size, count = config->count;
+
+  if (config->type == FFT_REAL && config->direction == FFT_FORWARD)
+  {
+    transform(config->input, config->output, n / 2, count, config->bit_reverse, config->stage_twiddles);
+    rfft_post_lanes(config->output, config->twiddle_factors, n, count);
+  }
+  else if (config->type == FFT_REAL)
+  {
+    irfft_pre_lanes(config->input, config->twiddle_factors, n, count);
+    transform(config->input, config->output, n / 2, count, config->bit_reverse, config->stage_twiddles);
+    reverse_and_scale_lanes(config->output, n / 2, count);
+  }
+  else
+  {
+    transform(config->input, config->output, n, count, config->bit_reverse, config->stage_twiddles);
+    if (config->direction == FFT_BACKWARD)
+      reverse_and_scale_lanes(config->output, n, count);
+  }
+}
+
+static void execute_generic(fft_config_t *config)
+{
+  execute(config);
+}
+
+#if HAVE_X86
+__attribute__((target("avx2,fma")))
+static void execute_avx2(fft_config_t *config)
+{
+  execute(config);
+}
+#endif
+
+void fft_execute_many(fft_config_t *config)
+{
+  /*
+   * fft_execute for a config of fft_init_many with a power of two size
+   * and more than one signal
+   */
+#if HAVE_X86
+  if (config->isa == FFT_ISA_AVX2)
+  {
+    execute_avx2(config);
+    return;
+  }
+#endif
+  execute_generic(config);
+}
@@ -0,0 +1,429 @@
+/*
+ * Complex FFT of any size, for the sizes fft_iterative cannot take.
+ *
+ * A size whose only prime factors are 2, 3 and 5, like the 60, 120 or
+ * 300 samples of a sensor window, runs a mixed-radix decimation in time:
+ * the size is split into radix 4, 2, 3 and 5 stages, each recursing on
+ * every p-th input before its butterflies join the results. Each stage
+ * has its own twiddle factors, p - 1 for every butterfly, next to each
+ * other in the order the butterflies take them.
+ *
+ * Any other size runs Bluestein's algorithm: with the chirp
+ * w[k] = exp(-pi j k^2 / n), X[k] = w[k] sum_t (x[t] w[t]) conj(w[k-t]),
+ * a circular convolution that zero padding to a power of two M >= 2n - 1
+ * keeps exact. It takes two transforms of size M on an inner
+ * power-of-two plan, whose buffers are the work space, so it allocates
+ * nothing once planned.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "fft.h"
+
+// Enough for any int size
+#define MAX_FACTORS 32
+
+typedef struct
+{
+  float r;
+  float i;
+} cpx;
+
+typedef struct
+{
+  int radix;
+  int span;  // size of the transforms its butterflies join
+  int twiddles;  // where its twiddle factors start
+  cpx roots[2];  // exp(-2 pi j / radix), exp(-4 pi j / radix)
+} stage_t;
+
+struct fft_mixed
+{
+  int n;
+  stage_t stages[MAX_FACTORS];  // outermost first
+  cpx *twiddles;
+  // Bluestein's algorithm, if n has other prime factors
+  fft_config_t *inner;  // forward, of a power of two size
+  cpx *chirp;  // exp(-pi j k^2 / n)
+  cpx *chirp_spectrum;  // DFT of the conjugate chirp, divided by the inner size
+};
+
+static int factorize(int n, stage_t *stages)
+{
+  /*
+   * Splits n into radix 4 stages first, then 2, 3 and 5. Returns how
+   * many, or 0 if n has another prime factor.
+   */
+  int p = 4, count = 0;
+
+  while (n > 1)
+  {
+    while (n % p != 0)
+    {
+      if (p == 4)
+        p = 2;
+      else if (p == 2)
+        p = 3;
+      else if (p == 3)
+        p = 5;
+      else
+        return 0;
+    }
+    n /= p;
+    stages[count].radix = p;
+    stages[count].span = n;
+    count++;
+  }
+  return count;
+}
+
+static inline cpx cmul(cpx a, cpx b)
+{
+  cpx c = { a.r * b.r - a.i * b.i, a.r * b.i + a.i * b.r };
+  return c;
+}
+
+/*
+ * DFTs of 2, 3, 4 and 5 points in place. w holds exp(-2 pi j / p), and
+ * exp(-4 pi j / p) after it.
+ */
+static inline void dft2(cpx *v)
+{
+  cpx t = v[1];
+  v[1].r = v[0].r - t.r;
+  v[1].i = v[0].i - t.i;
+  v[0].r += t.r;
+  v[0].i += t.i;
+}
+
+static inline void dft3(cpx *v, const cpx *w)
+{
+  cpx sum = { v[1].r + v[2].r, v[1].i + v[2].i };
+  cpx diff = { (v[1].r - v[2].r) * w[0].i, (v[1].i - v[2].i) * w[0].i };
+  cpx mid = { v[0].r - 0.5f * sum.r, v[0].i - 0.5f * sum.i };
+
+  v[0].r += sum.r;
+  v[0].i += sum.i;
+  v[1].r = mid.r - diff.i;
+  v[1].i = mid.i + diff.r;
+  v[2].r = mid.r + diff.i;
+  v[2].i = mid.i - diff.r;
+}
+
+static inline void dft4(cpx *v)
+{
+  cpx s0 = { v[0].r + v[2].r, v[0].i + v[2].i };
+  cpx s1 = { v[0].r - v[2].r, v[0].i - v[2].i };
+  cpx s2 = { v[1].r + v[3].r, v[1].i + v[3].i };
+  cpx s3 = { v[1].r - v[3].r, v[1].i - v[3].i };
+
+  v[0].r = s0.r + s2.r;
+  v[0].i = s0.i + s2.i;
+  v[2].r = s0.r - s2.r;
+  v[2].i = s0.i - s2.i;
+  // -j times s3, and j times s3
+  v[1].r = s1.r + s3.i;
+  v[1].i = s1.i - s3.r;
+  v[3].r = s1.r - s3.i;
+  v[3].i = s1.i + s3.r;
+}
+
+static inline void dft5(cpx *v, const cpx *w)
+{
+  cpx ya = w[0], yb = w[1];
+  cpx s0 = v[0];
+  cpx s7 = { v[1].r + v[4].r, v[1].i + v[4].i };
+  cpx s10 = { v[1].r - v[4].r, v[1].i - v[4].i };
+  cpx s8 = { v[2].r + v[3].r, v[2].i + v[3].i };
+  cpx s9 = { v[2].r - v[3].r, v[2].i - v[3].i };
+  cpx s5 = { s0.r + s7.r * ya.r + s8.r * yb.r, s0.i + s7.i * ya.r + s8.i * yb.r };
+  cpx s6 = { s10.i * ya.i + s9.i * yb.i, -s10.r * ya.i - s9.r * yb.i };
+  cpx s11 = { s0.r + s7.r * yb.r + s8.r * ya.r, s0.i + s7.i * yb.r + s8.i * ya.r };
+  cpx s12 = { -s10.i * yb.i + s9.i * ya.i, s10.r * yb.i - s9.r * ya.i };
+
+  v[0].r = s0.r + s7.r + s8.r;
+  v[0].i = s0.i + s7.i + s8.i;
+  v[1].r = s5.r - s6.r;
+  v[1].i = s5.i - s6.i;
+  v[4].r = s5.r + s6.r;
+  v[4].i = s5.i + s6.i;
+  v[2].r = s11.r + s12.r;
+  v[2].i = s11.i + s12.i;
+  v[3].r = s11.r - s12.r;
+  v[3].i = s11.i - s12.i;
+}
+
+static void butterfly2(cpx *y, const cpx *tw, int m)
+{
+  int k;
+
+  for (k = 0 ; k < m ; k++)
+  {
+    cpx v[2] = { y[k], cmul(y[m + k], tw[k]) };
+    dft2(v);
+    y[k] = v[0];
+    y[m + k] = v[1];
+  }
+}
+
+static void butterfly3(cpx *y, const cpx *tw, int m, const cpx *w)
+{
+  int k;
+
+  for (k = 0 ; k < m ; k++)
+  {
+    const cpx *t = tw + 2 * k;
+    cpx v[3] = { y[k], cmul(y[m + k], t[0]), cmul(y[2 * m + k], t[1]) };
+    dft3(v, w);
+    y[k] = v[0];
+    y[m + k] = v[1];
+    y[2 * m + k] = v[2];
+  }
+}
+
+static void butterfly4(cpx *y, const cpx *tw, int m)
+{
+  int k;
+
+  for (k = 0 ; k < m ; k++)
+  {
+    const cpx *t = tw + 3 * k;
+    cpx v[4] = { y[k], cmul(y[m + k], t[0]), cmul(y[2 * m + k], t[1]), cmul(y[3 * m + k], t[2]) };
+    dft4(v);
+    y[k] = v[0];
+    y[m + k] = v[1];
+    y[2 * m + k] = v[2];
+    y[3 * m + k] = v[3];
+  }
+}
+
+static void butterfly5(cpx *y, const cpx *tw, int m, const cpx *w)
+{
+  int k;
+
+  for (k = 0 ; k < m ; k++)
+  {
+    const cpx *t = tw + 4 * k;
+    cpx v[5] = { y[k], cmul(y[m + k], t[0]), cmul(y[2 * m + k], t[1]), cmul(y[3 * m + k], t[2]),
+                 cmul(y[4 * m + k], t[3]) };
+    dft5(v, w);
+    y[k] = v[0];
+    y[m + k] = v[1];
+    y[2 * m + k] = v[2];
+    y[3 * m + k] = v[3];
+    y[4 * m + k] = v[4];
+  }
+}
+
+static void leaves(cpx *y, const cpx *x, int fstride, int p, const cpx *w)
+{
+  /*
+   * The last stage: a DFT of p inputs fstride apart, straight from the
+   * input, as its twiddle factors are all 1
+   */
+  if (p == 2)
+  {
+    cpx v[2] = { x[0], x[fstride] };
+    dft2(v);
+    memcpy(y, v, sizeof(v));
+  }
+  else if (p == 3)
+  {
+    cpx v[3] = { x[0], x[fstride], x[2 * fstride] };
+    dft3(v, w);
+    memcpy(y, v, sizeof(v));
+  }
+  else if (p == 4)
+  {
+    cpx v[4] = { x[0], x[fstride], x[2 * fstride], x[3 * fstride] };
+    dft4(v);
+    memcpy(y, v, sizeof(v));
+  }
+  else
+  {
+    cpx v[5] = { x[0], x[fstride], x[2 * fstride], x[3 * fstride], x[4 * fstride] };
+    dft5(v, w);
+    memcpy(y, v, sizeof(v));
+  }
+}
+
+static void mixed_radix(const fft_mixed_t *plan, cpx *y, const cpx *x, int fstride, const stage_t *stage)
+{
+  /*
+   * Transforms of size p * m of the inputs fstride apart: p of size m
+   * on every p-th of them, then m butterflies of radix p
+   */
+  int p = stage->radix, m = stage->span, q;
+  const cpx *tw = plan->twiddles + stage->twiddles;
+
+  if (m == 1)
+  {
+    leaves(y, x, fstride, p, stage->roots);
+    return;
+  }
+  for (q = 0 ; q < p ; q++)
+    mixed_radix(plan, y + q * m, x + q * fstride, fstride * p, stage + 1);
+
+  if (p == 2)
+    butterfly2(y, tw, m);
+  else if (p == 3)
+    butterfly3(y, tw, m, stage->roots);
+  else if (p == 4)
+    butterfly4(y, tw, m);
+  else
+    butterfly5(y, tw, m, stage->roots);
+}
+
+static void bluestein(fft_mixed_t *plan, const cpx *x, cpx *y)
+{
+  int k, n = plan->n, size = plan->inner->size;
+  cpx *a = (cpx *)plan->inner->input;
+  cpx *b = (cpx *)plan->inner->output;
+
+  for (k = 0 ; k < n ; k++)
+    a[k] = cmul(x[k], plan->chirp[k]);
+  memset(a + n, 0, (size - n) * sizeof(cpx));
+  fft_execute(plan->inner);
+
+  // The inverse transform of the product, as the conjugate of the
+  // forward one of its conjugate; the chirp spectrum holds the 1 / size
+  for (k = 0 ; k < size ; k++)
+  {
+    cpx t = cmul(b[k], plan->chirp_spectrum[k]);
+    a[k].r = t.r;
+    a[k].i = -t.i;
+  }
+  fft_execute(plan->inner);
+
+  for (k = 0 ; k < n ; k++)
+  {
+    cpx t = { b[k].r, -b[k].i };
+    y[k] = cmul(t, plan->chirp[k]);
+  }
+}
+
+fft_mixed_t *fft_mixed_init(int n)
+{
+  /*
+   * Plans a forward complex FFT of size n, returns NULL if out of memory
+   */
+  int k, q, size, count, total = 0;
+  fft_mixed_t *plan;
+
+  if (n < 1 || n > (1 << 29))
+    return NULL;
+  plan = (fft_mixed_t *)calloc(1, sizeof(fft_mixed_t));
+  if (plan == NULL)
+    return NULL;
+  plan->n = n;
+
+  count = factorize(n, plan->stages);
+  if (count > 0 || n == 1)
+  {
+    for (k = 0 ; k < count ; k++)
+    {
+      plan->stages[k].twiddles = total;
+      total += (plan->stages[k].radix - 1) * plan->stages[k].span;
+    }
+    plan->twiddles = (cpx *)malloc((total > 0 ? total : 1) * sizeof(cpx));
+    if (plan->twiddles == NULL)
+    {
+      fft_mixed_destroy(plan);
+      return NULL;
+    }
+    for (k = 0 ; k < count ; k++)
+    {
+      stage_t *stage = &plan->stages[k];
+      int p = stage->radix, m = stage->span, j;
+      cpx *tw = plan->twiddles + stage->twiddles;
+      for (q = 1 ; q <= 2 ; q++)
+      {
+        stage->roots[q - 1].r = (float)cos(-2.0 * M_PI * q / p);
+        stage->roots[q - 1].i = (float)sin(-2.0 * M_PI * q / p);
+      }
+      for (j = 0 ; j < m ; j++)
+      {
+        for (q = 1 ; q < p ; q++)
+        {
+          double angle = -2.0 * M_PI * q * j / (p * m);
+          tw[(p - 1) * j + q - 1].r = (float)cos(angle);
+          tw[(p - 1) * j + q - 1].i = (float)sin(angle);
+        }
+      }
+    }
+    return plan;
+  }
+
+  for (size = 1 ; size < 2 * n - 1 ; size *= 2)
+    ;
+  plan->inner = fft_init(size, FFT_COMPLEX, FFT_FORWARD, NULL, NULL);
+  plan->chirp = (cpx *)malloc(n * sizeof(cpx));
+  plan->chirp_spectrum = (cpx *)malloc(size * sizeof(cpx));
+  if (plan->inner == NULL || plan->chirp == NULL || plan->chirp_spectrum == NULL)
+  {
+    fft_mixed_destroy(plan);
+    return NULL;
+  }
+
+  // k^2 is taken modulo 2n first, the angle would lose every digit
+  // to a float otherwise
+  for (k = 0 ; k < n ; k++)
+  {
+    double angle = -M_PI * (double)((long long)k * k % (2LL * n)) / n;
+    plan->chirp[k].r = (float)cos(angle);
+    plan->chirp[k].i = (float)sin(angle);
+  }
+
+  // The conjugate chirp, at indices -n < k < n taken modulo size
+  cpx *a = (cpx *)plan->inner->input;
+  memset(a, 0, size * sizeof(cpx));
+  for (k = 0 ; k < n ; k++)
+  {
+    a[k].r = plan->chirp[k].r;
+    a[k].i = -plan->chirp[k].i;
+    if (k > 0)
+      a[size - k] = a[k];
+  }
+  fft_execute(plan->inner);
+  for (k = 0 ; k < size ; k++)
+  {
+    plan->chirp_spectrum[k].r = plan->inner->output[2 * k] / size;
+    plan->chirp_spectrum[k].i = plan->inner->output[2 * k + 1] / size;
+  }
+  return plan;
+}
+
+void fft_mixed_destroy(fft_mixed_t *plan)
+{
+  if (plan == NULL)
+    return;
+  if (plan->inner != NULL)
+    fft_destroy(plan->inner);
+  free(plan->twiddles);
+  free(plan->chirp);
+  free(plan->chirp_spectrum);
+  free(plan);
+}
+
+void fft_mixed(fft_mixed_t *plan, const float *x, float *y)
+{
+  /*
+   * Forward complex FFT, interleaved, out-of-place
+   *
+   * Parameters
+   * ----------
+   *  plan (fft_mixed_t *)
+   *    From fft_mixed_init
+   *  x (const float *)
+   *    plan's n complex samples [Re(x0), Im(x0), ..., Re(x_n-1), Im(x_n-1)]
+   *  y (float *)
+   *    Their transform, in the same layout. Must not overlap x.
+   */
+  if (plan->inner != NULL)
+    bluestein(plan, (const cpx *)x, (cpx *)y);
+  else if (plan->n == 1)
+    memcpy(y, x, 2 * sizeof(float));
+  else
+    mixed_radix(plan, (cpx *)y, (const cpx *)x, 1, plan->stages);
+}
@@ -0,0 +1,466 @@
+/*
+ * Complex FFT in split format: all real parts, then all imaginary parts.
+ *
+ * It runs like fft_iterative: a first unrolled pass that reads the input
+ * in bit-reversed order, then radix-4 stages. In split format the k-th
+ * butterflies of a stage, k = 0 .. m-1, load and store consecutive
+ * floats, as do their twiddle factors, so a stage runs as many
+ * butterflies at once as the vector unit has lanes. Each instruction set
+ * has its own stage kernel, picked at run time through fft_config_t:
+ * SSE2 and AVX2 with FMA on x86 hosts, and otherwise the scalar one,
+ * which is what the ESP32 runs.
+ */
+#include <stdlib.h>
+
+#include "fft.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86 1
+#endif
+
+static int is_power_of_four(int n)
+{
+  return (n & 0x55555555) != 0;
+}
+
+static void split_fft8(const float *xr, const float *xi, int stride_in, float *yr, float *yi)
+{
+  float a0r, a1r, a2r, a3r, a4r, a5r, a6r, a7r;
+  float a0i, a1i, a2i, a3i, a4i, a5i, a6i, a7i;
+  float b0r, b1r, b2r, b3r, b4r, b5r, b6r, b7r;
+  float b0i, b1i, b2i, b3i, b4i, b5i, b6i, b7i;
+  float t;
+  float sin_pi_4 = 0.7071067812;
+
+  a0r = xr[0];
+  a0i = xi[0];
+  a1r = xr[stride_in];
+  a1i = xi[stride_in];
+  a2r = xr[2*stride_in];
+  a2i = xi[2*stride_in];
+  a3r = xr[3*stride_in];
+  a3i = xi[3*stride_in];
+  a4r = xr[4*stride_in];
+  a4i = xi[4*stride_in];
+  a5r = xr[5*stride_in];
+  a5i = xi[5*stride_in];
+  a6r = xr[6*stride_in];
+  a6i = xi[6*stride_in];
+  a7r = xr[7*stride_in];
+  a7i = xi[7*stride_in];
+
+  // Stage 1
+
+  b0r = a0r + a4r;
+  b0i = a0i + a4i;
+
+  b1r = a1r + a5r;
+  b1i = a1i + a5i;
+
+  b2r = a2r + a6r;
+  b2i = a2i + a6i;
+
+  b3r = a3r + a7r;
+  b3i = a3i + a7i;
+
+  b4r = a0r - a4r;
+  b4i = a0i - a4i;
+
+  b5r = a1r - a5r;
+  b5i = a1i - a5i;
+  // W_8^1 = 1/sqrt(2) - j / sqrt(2)
+  t = b5r + b5i;
+  b5i = (b5i - b5r) * sin_pi_4;
+  b5r = t * sin_pi_4;
+
+  // W_8^2 = -j
+  b6r = a2i - a6i;
+  b6i = a6r - a2r;
+
+  b7r = a3r - a7r;
+  b7i = a3i - a7i;
+  // W_8^3 = -1 / sqrt(2) + j / sqrt(2)
+  t = sin_pi_4 * (b7i - b7r);
+  b7i = - (b7r + b7i) * sin_pi_4;
+  b7r = t;
+
+  // Stage 2
+
+  a0r = b0r + b2r;
+  a0i = b0i + b2i;
+
+  a1r = b1r + b3r;
+  a1i = b1i + b3i;
+
+  a2r = b0r - b2r;
+  a2i = b0i - b2i;
+
+  // * j
+  a3r = b1i - b3i;
+  a3i = b3r - b1r;
+
+  a4r = b4r + b6r;
+  a4i = b4i + b6i;
+
+  a5r = b5r + b7r;
+  a5i = b5i + b7i;
+
+  a6r = b4r - b6r;
+  a6i = b4i - b6i;
+
+  // * j
+  a7r = b5i - b7i;
+  a7i = b7r - b5r;
+
+  // Stage 3
+
+  // X[0]
+  yr[0] = a0r + a1r;
+  yi[0] = a0i + a1i;
+
+  // X[4]
+  yr[4] = a0r - a1r;
+  yi[4] = a0i - a1i;
+
+  // X[2]
+  yr[2] = a2r + a3r;
+  yi[2] = a2i + a3i;
+
+  // X[6]
+  yr[6] = a2r - a3r;
+  yi[6] = a2i - a3i;
+
+  // X[1]
+  yr[1] = a4r + a5r;
+  yi[1] = a4i + a5i;
+
+  // X[5]
+  yr[5] = a4r - a5r;
+  yi[5] = a4i - a5i;
+
+  // X[3]
+  yr[3] = a6r + a7r;
+  yi[3] = a6i + a7i;
+
+  // X[7]
+  yr[7] = a6r - a7r;
+  yi[7] = a6i - a7i;
+
+}
+
+static void split_fft4(const float *xr, const float *xi, int stride_in, float *yr, float *yi)
+{
+  float t1, t2;
+
+  t1 = xr[0] + xr[2*stride_in];
+  t2 = xr[stride_in] + xr[3*stride_in];
+  yr[0] = t1 + t2;
+  yr[2] = t1 - t2;
+
+  t1 = xi[0] + xi[2*stride_in];
+  t2 = xi[stride_in] + xi[3*stride_in];
+  yi[0] = t1 + t2;
+  yi[2] = t1 - t2;
+
+  t1 = xr[0] - xr[2*stride_in];
+  t2 = xi[stride_in] - xi[3*stride_in];
+  yr[1] = t1 + t2;
+  yr[3] = t1 - t2;
+
+  t1 = xi[0] - xi[2*stride_in];
+  t2 = xr[3*stride_in] - xr[stride_in];
+  yi[1] = t1 + t2;
+  yi[3] = t1 - t2;
+}
+
+/*
+ * Each stage joins four transforms of size m into one of size 4m. In
+ * bit-reversed order the four are those of the samples at 0, 2, 1 and 3
+ * modulo 4, in that order. twiddles holds the real and imaginary parts of
+ * W_4m^k, W_4m^2k and W_4m^3k, m floats each.
+ */
+
+static void stage_scalar(float *re, float *im, int n, int m, const float *twiddles)
+{
+  const float *w1r = twiddles, *w1i = w1r + m, *w2r = w1i + m, *w2i = w2r + m, *w3r = w2i + m, *w3i = w3r + m;
+  int g, k;
+
+  for (g = 0 ; g < n ; g += 4 * m)
+  {
+    float *r0 = re + g, *r1 = r0 + m, *r2 = r1 + m, *r3 = r2 + m;
+    float *i0 = im + g, *i1 = i0 + m, *i2 = i1 + m, *i3 = i2 + m;
+    for (k = 0 ; k < m ; k++)
+    {
+      float t1r, t1i, t2r, t2i, t3r, t3i, s0r, s0i, s1r, s1i, s2r, s2i, s3r, s3i;
+
+      t1r = w1r[k] * r2[k] - w1i[k] * i2[k];
+      t1i = w1r[k] * i2[k] + w1i[k] * r2[k];
+      t2r = w2r[k] * r1[k] - w2i[k] * i1[k];
+      t2i = w2r[k] * i1[k] + w2i[k] * r1[k];
+      t3r = w3r[k] * r3[k] - w3i[k] * i3[k];
+      t3i = w3r[k] * i3[k] + w3i[k] * r3[k];
+
+      s0r = r0[k] + t2r;
+      s0i = i0[k] + t2i;
+      s1r = r0[k] - t2r;
+      s1i = i0[k] - t2i;
+      s2r = t1r + t3r;
+      s2i = t1i + t3i;
+      s3r = t1r - t3r;
+      s3i = t1i - t3i;
+
+      r0[k] = s0r + s2r;
+      i0[k] = s0i + s2i;
+      r1[k] = s1r + s3i;
+      i1[k] = s1i - s3r;
+      r2[k] = s0r - s2r;
+      i2[k] = s0i - s2i;
+      r3[k] = s1r - s3i;
+      i3[k] = s1i + s3r;
+    }
+  }
+}
+
+#if HAVE_X86
+// m is at least 4 in every stage, so there is no remainder
+__attribute__((target("sse2")))
+static void stage_sse2(float *re, float *im, int n, int m, const float *twiddles)
+{
+  const float *w1r = twiddles, *w1i = w1r + m, *w2r = w1i + m, *w2i = w2r + m, *w3r = w2i + m, *w3i = w3r + m;
+  int g, k;
+
+  for (g = 0 ; g < n ; g += 4 * m)
+  {
+    float *r0 = re + g, *r1 = r0 + m, *r2 = r1 + m, *r3 = r2 + m;
+    float *i0 = im + g, *i1 = i0 + m, *i2 = i1 + m, *i3 = i2 + m;
+    for (k = 0 ; k < m ; k += 4)
+    {
+      __m128 ar, ai, br, bi, wr, wi;
+      __m128 t1r, t1i, t2r, t2i, t3r, t3i, s0r, s0i, s1r, s1i, s2r, s2i, s3r, s3i;
+
+      br = _mm_loadu_ps(r2 + k);
+      bi = _mm_loadu_ps(i2 + k);
+      wr = _mm_loadu_ps(w1r + k);
+      wi = _mm_loadu_ps(w1i + k);
+      t1r = _mm_sub_ps(_mm_mul_ps(wr, br), _mm_mul_ps(wi, bi));
+      t1i = _mm_add_ps(_mm_mul_ps(wr, bi), _mm_mul_ps(wi, br));
+
+      br = _mm_loadu_ps(r1 + k);
+      bi = _mm_loadu_ps(i1 + k);
+      wr = _mm_loadu_ps(w2r + k);
+      wi = _mm_loadu_ps(w2i + k);
+      t2r = _mm_sub_ps(_mm_mul_ps(wr, br), _mm_mul_ps(wi, bi));
+      t2i = _mm_add_ps(_mm_mul_ps(wr, bi), _mm_mul_ps(wi, br));
+
+      br = _mm_loadu_ps(r3 + k);
+      bi = _mm_loadu_ps(i3 + k);
+      wr = _mm_loadu_ps(w3r + k);
+      wi = _mm_loadu_ps(w3i + k);
+      t3r = _mm_sub_ps(_mm_mul_ps(wr, br), _mm_mul_ps(wi, bi));
+      t3i = _mm_add_ps(_mm_mul_ps(wr, bi), _mm_mul_ps(wi, br));
+
+      ar = _mm_loadu_ps(r0 + k);
+      ai = _mm_loadu_ps(i0 + k);
+      s0r = _mm_add_ps(ar, t2r);
+      s0i = _mm_add_ps(ai, t2i);
+      s1r = _mm_sub_ps(ar, t2r);
+      s1i = _mm_sub_ps(ai, t2i);
+      s2r = _mm_add_ps(t1r, t3r);
+      s2i = _mm_add_ps(t1i, t3i);
+      s3r = _mm_sub_ps(t1r, t3r);
+      s3i = _mm_sub_ps(t1i, t3i);
+
+      _mm_storeu_ps(r0 + k, _mm_add_ps(s0r, s2r));
+      _mm_storeu_ps(i0 + k, _mm_add_ps(s0i, s2i));
+      _mm_storeu_ps(r1 + k, _mm_add_ps(s1r, s3i));
+      _mm_storeu_ps(i1 + k, _mm_sub_ps(s1i, s3r));
+      _mm_storeu_ps(r2 + k, _mm_sub_ps(s0r, s2r));
+      _mm_storeu_ps(i2 + k, _mm_sub_ps(s0i, s2i));
+      _mm_storeu_ps(r3 + k, _mm_sub_ps(s1r, s3i));
+      _mm_storeu_ps(i3 + k, _mm_add_ps(s1i, s3r));
+    }
+  }
+}
+
+__attribute__((target("avx2,fma")))
+static void stage_avx2(float *re, float *im, int n, int m, const float *twiddles)
+{
+  const float *w1r = twiddles, *w1i = w1r + m, *w2r = w1i + m, *w2i = w2r + m, *w3r = w2i + m, *w3i = w3r + m;
+  int g, k;
+
+  // Too narrow for eight lanes
+  if (m < 8)
+  {
+    stage_sse2(re, im, n, m, twiddles);
+    return;
+  }
+
+  for (g = 0 ; g < n ; g += 4 * m)
+  {
+    float *r0 = re + g, *r1 = r0 + m, *r2 = r1 + m, *r3 = r2 + m;
+    float *i0 = im + g, *i1 = i0 + m, *i2 = i1 + m, *i3 = i2 + m;
+    for (k = 0 ; k < m ; k += 8)
+    {
+      __m256 ar, ai, br, bi, wr, wi;
+      __m256 t1r, t1i, t2r, t2i, t3r, t3i, s0r, s0i, s1r, s1i, s2r, s2i, s3r, s3i;
+
+      br = _mm256_loadu_ps(r2 + k);
+      bi = _mm256_loadu_ps(i2 + k);
+      wr = _mm256_loadu_ps(w1r + k);
+      wi = _mm256_loadu_ps(w1i + k);
+      t1r = _mm256_fmsub_ps(wr, br, _mm256_mul_ps(wi, bi));
+      t1i = _mm256_fmadd_ps(wr, bi, _mm256_mul_ps(wi, br));
+
+      br = _mm256_loadu_ps(r1 + k);
+      bi = _mm256_loadu_ps(i1 + k);
+      wr = _mm256_loadu_ps(w2r + k);
+      wi = _mm256_loadu_ps(w2i + k);
+      t2r = _mm256_fmsub_ps(wr, br, _mm256_mul_ps(wi, bi));
+      t2i = _mm256_fmadd_ps(wr, bi, _mm256_mul_ps(wi, br));
+
+      br = _mm256_loadu_ps(r3 + k);
+      bi = _mm256_loadu_ps(i3 + k);
+      wr = _mm256_loadu_ps(w3r + k);
+      wi = _mm256_loadu_ps(w3i + k);
+      t3r = _mm256_fmsub_ps(wr, br, _mm256_mul_ps(wi, bi));
+      t3i = _mm256_fmadd_ps(wr, bi, _mm256_mul_ps(wi, br));
+
+      ar = _mm256_loadu_ps(r0 + k);
+      ai = _mm256_loadu_ps(i0 + k);
+      s0r = _mm256_add_ps(ar, t2r);
+      s0i = _mm256_add_ps(ai, t2i);
+      s1r = _mm256_sub_ps(ar, t2r);
+      s1i = _mm256_sub_ps(ai, t2i);
+      s2r = _mm256_add_ps(t1r, t3r);
+      s2i = _mm256_add_ps(t1i, t3i);
+      s3r = _mm256_sub_ps(t1r, t3r);
+      s3i = _mm256_sub_ps(t1i, t3i);
+
+      _mm256_storeu_ps(r0 + k, _mm256_add_ps(s0r, s2r));
+      _mm256_storeu_ps(i0 + k, _mm256_add_ps(s0i, s2i));
+      _mm256_storeu_ps(r1 + k, _mm256_add_ps(s1r, s3i));
+      _mm256_storeu_ps(i1 + k, _mm256_sub_ps(s1i, s3r));
+      _mm256_storeu_ps(r2 + k, _mm256_sub_ps(s0r, s2r));
+      _mm256_storeu_ps(i2 + k, _mm256_sub_ps(s0i, s2i));
+      _mm256_storeu_ps(r3 + k, _mm256_sub_ps(s1r, s3i));
+      _mm256_storeu_ps(i3 + k, _mm256_add_ps(s1i, s3r));
+    }
+  }
+}
+#endif
+
+void fft_split(const float *xr, const float *xi, float *yr, float *yi, int n, const int *bit_reverse,
+               const float *stage_twiddles, fft_split_stage_t stage)
+{
+  /*
+   * Forward fast Fourier transform, split format
+   *
+   * Parameters
+   * ----------
+   *  xr, xi (float *)
+   *    The real and imaginary parts of the n input samples
+   *  yr, yi (float *)
+   *    The real and imaginary parts of the output, not overlapping the input
+   *  n (int)
+   *    The FFT size, should be a power of 2
+   *  bit_reverse (int *)
+   *    The input order, see fft_config_t
+   *  stage_twiddles (float *)
+   *    The stages' twiddle factors, planned for FFT_COMPLEX_SPLIT
+   *  stage (fft_split_stage_t)
+   *    The stage kernel, see fft_set_isa
+   */
+  int g, m;
+
+  if (n >= 4)
+  {
+    // As in fft_iterative, the first pass doubles as the bit reversal
+    m = is_power_of_four(n) ? 4 : 8;
+    for (g = 0 ; g < n ; g += m)
+    {
+      if (m == 8)
+        split_fft8(xr + bit_reverse[g], xi + bit_reverse[g], n / 8, yr + g, yi + g);
+      else
+        split_fft4(xr + bit_reverse[g], xi + bit_reverse[g], n / 4, yr + g, yi + g);
+    }
+  }
+  else
+  {
+    // Sizes 1 and 2
+    for (g = 0 ; g < n ; g++)
+    {
+      yr[g] = xr[g];
+      yi[g] = xi[g];
+    }
+    if (n == 2)
+    {
+      float t;
+      t = yr[0];
+      yr[0] = t + yr[1];
+      yr[1] = t - yr[1];
+      t = yi[0];
+      yi[0] = t + yi[1];
+      yi[1] = t - yi[1];
+    }
+    return;
+  }
+
+  for ( ; 4 * m <= n ; m *= 4)
+  {
+    stage(yr, yi, n, m, stage_twiddles);
+    stage_twiddles += 6 * m;
+  }
+}
+
+fft_isa_t fft_best_isa(void)
+{
+#if HAVE_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return FFT_ISA_AVX2;
+  if (__builtin_cpu_supports("sse2"))
+    return FFT_ISA_SSE2;
+#endif
+  return FFT_ISA_SCALAR;
+}
+
+int fft_set_isa(fft_config_t *config, fft_isa_t isa)
+{
+  /*
+   * Picks the kernels of the split stages. Returns -1, leaving them as
+   * they were, if this build or CPU does not have them.
+   */
+  fft_split_stage_t stage = NULL;
+#if HAVE_X86
+  fft_isa_t best = fft_best_isa();
+#endif
+
+  if (isa == FFT_ISA_SCALAR)
+    stage = stage_scalar;
+#if HAVE_X86
+  else if (isa == FFT_ISA_SSE2 && best >= FFT_ISA_SSE2)
+    stage = stage_sse2;
+  else if (isa == FFT_ISA_AVX2 && best == FFT_ISA_AVX2)
+    stage = stage_avx2;
+#endif
+
+  if (stage == NULL)
+    return -1;
+  config->isa = isa;
+  config->split_stage = stage;
+  return 0;
+}
+
+const char *fft_isa_name(fft_isa_t isa)
+{
+  switch (isa)
+  {
+    case FFT_ISA_SSE2:
+      return "sse2";
+    case FFT_ISA_AVX2:
+      return "avx2";
+    default:
+      return "scalar";
+  }
+}
@@ -0,0 +1,338 @@
+#include <math.h>
+#include <string.h>
+
+#include "fp_index.h"
+
+_Static_assert(sizeof(fp_header_t) == 24, "fp_header_t must match the image layout");
+_Static_assert(sizeof(fp_label_record_t) == 4 + FP_INDEX_LABEL_LEN, "fp_label_record_t must match the image layout");
+
+#define ALIGN4(x) (((x) + 3) & ~(size_t)3)
+
+#define ERASED16 0xFFFF
+#define BUCKETS_OFFSET (FP_INDEX_HEADER_SIZE + FP_INDEX_LABEL_LOG_SIZE)
+
+static size_t header_bytes(uint16_t dim, uint16_t list_count) {
+    return sizeof(fp_header_t) + 2 * (size_t)dim * sizeof(float)
+        + (list_count + 2) * sizeof(uint32_t) + (size_t)list_count * ALIGN4(dim);
+}
+
+size_t fp_index_image_size(uint16_t dim, uint16_t list_count, uint32_t record_count) {
+    if (dim == 0 || dim > FP_INDEX_MAX_DIM || list_count == 0 || list_count > FP_INDEX_MAX_LISTS ||
+        record_count == 0 || header_bytes(dim, list_count) > FP_INDEX_HEADER_SIZE) {
+        return 0;
+    }
+    size_t record_size = sizeof(fp_record_t) + ALIGN4(dim);
+    return FP_INDEX_HEADER_SIZE + FP_INDEX_LABEL_LOG_SIZE + (size_t)record_count * record_size;
+}
+
+const fp_record_t *fp_index_record(const fp_index_t *index, uint16_t bucket, uint32_t slot) {
+    size_t offset = ((size_t)index->bucket_start[bucket] + slot) * index->header->record_size;
+    return (const fp_record_t *)(index->buckets + offset);
+}
+
+uint32_t fp_index_bucket_size(const fp_index_t *index, uint16_t bucket) {
+    return index->bucket_start[bucket + 1] - index->bucket_start[bucket];
+}
+
+// Records are appended in order, so the erased ones are all at the end
+static uint32_t bucket_fill(const fp_index_t *index, uint16_t bucket) {
+    uint32_t lo = 0, hi = fp_index_bucket_size(index, bucket);
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (fp_index_record(index, bucket, mid)->label == ERASED16) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
+
+int fp_index_open(fp_index_t *index, const void *image, size_t size) {
+    const uint8_t *base = (const uint8_t *)image;
+    if (index == NULL || image == NULL || ((uintptr_t)image & 3) || size < sizeof(fp_header_t)) {
+        return -1;
+    }
+    memset(index, 0, sizeof(fp_index_t));
+
+    const fp_header_t *header = (const fp_header_t *)base;
+    if (header->magic != FP_INDEX_MAGIC || header->version != FP_INDEX_VERSION ||
+        header->dim_pad != ALIGN4(header->dim) ||
+        header->record_size != sizeof(fp_record_t) + header->dim_pad) {
+        return -1;
+    }
+    size_t image_size = fp_index_image_size(header->dim, header->list_count, header->record_count);
+    if (image_size == 0 || image_size != header->image_size || image_size > size) {
+        return -1;
+    }
+
+    const uint8_t *p = base + sizeof(fp_header_t);
+    index->header = header;
+    index->mean = (const float *)p;
+    p += header->dim * sizeof(float);
+    index->inv_std = (const float *)p;
+    p += header->dim * sizeof(float);
+    index->bucket_start = (const uint32_t *)p;
+    p += (header->list_count + 2) * sizeof(uint32_t);
+    index->centroids = (const int8_t *)p;
+    index->label_log = (const fp_label_record_t *)(base + FP_INDEX_HEADER_SIZE);
+    index->buckets = base + FP_INDEX_HEADER_SIZE + FP_INDEX_LABEL_LOG_SIZE;
+
+    if (index->bucket_start[0] != 0 || index->bucket_start[header->list_count + 1] != header->record_count) {
+        return -1;
+    }
+    for (uint16_t b = 0; b <= header->list_count; b++) {
+        if (index->bucket_start[b + 1] < index->bucket_start[b]) {
+            return -1;
+        }
+    }
+    for (uint16_t b = 0; b <= header->list_count; b++) {
+        index->fill[b] = bucket_fill(index, b);
+    }
+    return 0;
+}
+
+void fp_index_quantize(const fp_index_t *index, const float *features, int8_t *q) {
+    const fp_header_t *header = index->header;
+    for (uint16_t i = 0; i < header->dim; i++) {
+        float z = (features[i] - index->mean[i]) * index->inv_std[i] * FP_INDEX_QUANT_SCALE;
+        z = z > 127.0f ? 127.0f : z < -127.0f ? -127.0f : z;
+        q[i] = (int8_t)lrintf(z);
+    }
+    memset(q + header->dim, 0, header->dim_pad - header->dim);
+}
+
+// Squared distance, giving up as soon as it passes `limit`. Four lanes at
+// a time, which is as far as the padding is guaranteed to go.
+static uint32_t distance_sq(const int8_t *a, const int8_t *b, uint16_t dim_pad, uint32_t limit) {
+    uint32_t sum = 0;
+    for (uint16_t i = 0; i < dim_pad; i += 4) {
+        int32_t d0 = a[i] - b[i];
+        int32_t d1 = a[i + 1] - b[i + 1];
+        int32_t d2 = a[i + 2] - b[i + 2];
+        int32_t d3 = a[i + 3] - b[i + 3];
+        sum += (uint32_t)(d0 * d0 + d1 * d1 + d2 * d2 + d3 * d3);
+        if (sum > limit) {
+            break;
+        }
+    }
+    return sum;
+}
+
+uint16_t fp_index_nearest_centroid(const int8_t *centroids, uint16_t count, uint16_t dim_pad, const int8_t *q) {
+    uint16_t best = 0;
+    uint32_t best_dist = UINT32_MAX;
+    for (uint16_t l = 0; l < count; l++) {
+        uint32_t d = distance_sq(q, &centroids[(size_t)l * dim_pad], dim_pad, best_dist);
+        if (d < best_dist) {
+            best_dist = d;
+            best = l;
+        }
+    }
+    return best;
+}
+
+uint16_t fp_index_nearest_list(const fp_index_t *index, const int8_t *q) {
+    return fp_index_nearest_centroid(index->centroids, index->header->list_count, index->header->dim_pad, q);
+}
+
+typedef struct {
+    uint16_t bucket;
+    uint32_t slot;
+} cursor_t;
+
+// The committed record after the cursor in image order, or NULL
+static const fp_record_t *next_committed(const fp_index_t *index, cursor_t *cursor) {
+    while (cursor->bucket <= index->header->list_count) {
+        if (cursor->slot == index->fill[cursor->bucket]) {
+            cursor->bucket++;
+            cursor->slot = 0;
+            continue;
+        }
+        const fp_record_t *record = fp_index_record(index, cursor->bucket, cursor->slot++);
+        if (record->commit == 0) {
+            return record;
+        }
+    }
+    return NULL;
+}
+
+uint32_t fp_index_committed(const fp_index_t *index) {
+    cursor_t cursor = { 0 };
+    uint32_t count = 0;
+    while (next_committed(index, &cursor) != NULL) {
+        count++;
+    }
+    return count;
+}
+
+uint16_t fp_index_list_count_for(uint32_t records) {
+    if (records < 1000) {
+        return 1;
+    }
+    long lists = lroundf(sqrtf((float)records));
+    return lists < FP_INDEX_MAX_LISTS ? (uint16_t)lists : FP_INDEX_MAX_LISTS;
+}
+
+int fp_index_train_lists(const fp_index_t *index, uint16_t list_count, int8_t *centroids, int32_t *scratch) {
+    const uint16_t dim_pad = index->header->dim_pad;
+    const uint32_t total = fp_index_committed(index);
+    if (list_count == 0 || list_count > FP_INDEX_MAX_LISTS || total < list_count) {
+        return -1;
+    }
+    // Every stride-th record is a sample, and the seeds are spread
+    // evenly through the samples
+    const uint32_t stride = (total + FP_INDEX_TRAIN_SAMPLES - 1) / FP_INDEX_TRAIN_SAMPLES;
+    const uint32_t samples = (total + stride - 1) / stride;
+    cursor_t cursor = { 0 };
+    uint16_t seeded = 0;
+    for (uint32_t n = 0; seeded < list_count; n++) {
+        const fp_record_t *record = next_committed(index, &cursor);
+        if (n % stride == 0 && n / stride == (uint64_t)seeded * samples / list_count) {
+            memcpy(&centroids[(size_t)seeded++ * dim_pad], record + 1, dim_pad);
+        }
+    }
+
+    for (int round = 0; round < FP_INDEX_TRAIN_ROUNDS; round++) {
+        memset(scratch, 0, FP_INDEX_TRAIN_SCRATCH(list_count, dim_pad) * sizeof(int32_t));
+        cursor = (cursor_t){ 0 };
+        const fp_record_t *record;
+        for (uint32_t n = 0; (record = next_committed(index, &cursor)) != NULL; n++) {
+            if (n % stride != 0) {
+                continue;
+            }
+            const int8_t *v = (const int8_t *)(record + 1);
+            int32_t *sum = &scratch[(size_t)fp_index_nearest_centroid(centroids, list_count, dim_pad, v) * (dim_pad + 1)];
+            for (uint16_t i = 0; i < dim_pad; i++) {
+                sum[i] += v[i];
+            }
+            sum[dim_pad]++;
+        }
+        // A list nothing was nearest to keeps its centroid
+        for (uint16_t l = 0; l < list_count; l++) {
+            const int32_t *sum = &scratch[(size_t)l * (dim_pad + 1)];
+            for (uint16_t i = 0; i < dim_pad && sum[dim_pad] > 0; i++) {
+                centroids[(size_t)l * dim_pad + i] = (int8_t)lroundf((float)sum[i] / sum[dim_pad]);
+            }
+        }
+    }
+    return 0;
+}
+
+int fp_index_layout(fp_header_t *header, uint32_t *bucket_start, uint16_t dim, uint16_t list_count,
+                    const uint32_t *members, size_t size) {
+    const uint16_t dim_pad = ALIGN4(dim);
+    const uint16_t record_size = sizeof(fp_record_t) + dim_pad;
+    if (size <= BUCKETS_OFFSET) {
+        return -1;
+    }
+    const uint32_t record_count = (size - BUCKETS_OFFSET) / record_size;
+    const size_t image_size = fp_index_image_size(dim, list_count, record_count);
+    if (image_size == 0) {
+        return -1;
+    }
+    uint64_t used = 0;
+    for (uint16_t l = 0; l <= list_count; l++) {
+        used += members[l];
+    }
+    if (used > record_count) {
+        return -1;
+    }
+
+    const uint32_t spare = (uint32_t)(record_count - used) / (list_count + 1);
+    bucket_start[0] = 0;
+    for (uint16_t l = 0; l < list_count; l++) {
+        bucket_start[l + 1] = bucket_start[l] + members[l] + spare;
+    }
+    bucket_start[list_count + 1] = record_count;
+
+    *header = (fp_header_t){
+        .magic = FP_INDEX_MAGIC,
+        .version = FP_INDEX_VERSION,
+        .dim = dim,
+        .dim_pad = dim_pad,
+        .list_count = list_count,
+        .record_size = record_size,
+        .record_count = record_count,
+        .image_size = (uint32_t)image_size,
+    };
+    return 0;
+}
+
+size_t fp_index_pack_header(void *out, const fp_header_t *header, const float *mean, const float *inv_std,
+                            const uint32_t *bucket_start, const int8_t *centroids) {
+    uint8_t *p = (uint8_t *)out;
+    memcpy(p, header, sizeof(fp_header_t));
+    p += sizeof(fp_header_t);
+    memcpy(p, mean, header->dim * sizeof(float));
+    p += header->dim * sizeof(float);
+    memcpy(p, inv_std, header->dim * sizeof(float));
+    p += header->dim * sizeof(float);
+    memcpy(p, bucket_start, (header->list_count + 2) * sizeof(uint32_t));
+    p += (header->list_count + 2) * sizeof(uint32_t);
+    memcpy(p, centroids, (size_t)header->list_count * header->dim_pad);
+    p += (size_t)header->list_count * header->dim_pad;
+    return p - (uint8_t *)out;
+}
+
+// Merges the committed records of one bucket into the sorted matches
+static void scan_bucket(const fp_index_t *index, uint16_t bucket, const int8_t *q,
+                        fp_match_t *matches, int k, int *count) {
+    const fp_header_t *header = index->header;
+    const uint8_t *record = (const uint8_t *)fp_index_record(index, bucket, 0);
+    for (uint32_t slot = 0; slot < index->fill[bucket]; slot++, record += header->record_size) {
+        const fp_record_t *r = (const fp_record_t *)record;
+        if (r->commit != 0) {
+            continue;
+        }
+        uint32_t limit = *count == k ? matches[k - 1].distance : UINT32_MAX;
+        uint32_t d = distance_sq(q, (const int8_t *)(r + 1), header->dim_pad, limit);
+        if (d >= limit) {
+            continue;
+        }
+        int j = *count < k ? (*count)++ : k - 1;
+        while (j > 0 && matches[j - 1].distance > d) {
+            matches[j] = matches[j - 1];
+            j--;
+        }
+        matches[j].label = r->label;
+        matches[j].distance = d;
+    }
+}
+
+int fp_index_search(const fp_index_t *index, const int8_t *q, uint16_t nprobe, fp_match_t *matches, int k) {
+    const fp_header_t *header = index->header;
+    if (header == NULL || k <= 0) {
+        return 0;
+    }
+    k = k > FP_INDEX_MAX_K ? FP_INDEX_MAX_K : k;
+    nprobe = nprobe == 0 ? 1 : nprobe > header->list_count ? header->list_count : nprobe;
+
+    // Rank the lists by centroid distance, only as far as nprobe
+    uint16_t order[FP_INDEX_MAX_LISTS];
+    uint32_t dist[FP_INDEX_MAX_LISTS];
+    for (uint16_t l = 0; l < header->list_count; l++) {
+        order[l] = l;
+        dist[l] = nprobe < header->list_count
+            ? distance_sq(q, &index->centroids[(size_t)l * header->dim_pad], header->dim_pad, UINT32_MAX)
+            : 0;
+    }
+    for (uint16_t i = 0; i < nprobe && nprobe < header->list_count; i++) {
+        uint16_t min = i;
+        for (uint16_t j = i + 1; j < header->list_count; j++) {
+            if (dist[order[j]] < dist[order[min]]) {
+                min = j;
+            }
+        }
+        uint16_t t = order[i];
+        order[i] = order[min];
+        order[min] = t;
+    }
+
+    int count = 0;
+    for (uint16_t i = 0; i < nprobe; i++) {
+        scan_bucket(index, order[i], q, matches, k, &count);
+    }
+    scan_bucket(index, header->list_count, q, matches, k, &count);
+    return count;
+}
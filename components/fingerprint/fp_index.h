@@ -0,0 +1,289 @@
+/**
+ * @file fp_index.h
+ * @brief Nearest-neighbour search over a flash image of int8 smell
+ * fingerprints, partitioned into inverted lists.
+ *
+ * fp_store.c maps the image out of flash and appends to it on the device.
+ *
+ * Image layout, all little endian:
+ * 1. fp_header_t followed by `float mean[dim]`, `float inv_std[dim]`,
+ *    `uint32_t bucket_start[list_count + 2]` and
+ *    `int8_t centroids[list_count][dim_pad]`, padded to
+ *    FP_INDEX_HEADER_SIZE
+ * 2. a label log of FP_INDEX_LABEL_LOG_SIZE holding fp_label_record_t
+ * 3. `record_count` records in `list_count + 1` buckets, one per list and
+ *    a last one for overflow. Bucket b holds records `bucket_start[b]` up
+ *    to `bucket_start[b + 1]`. A record is fp_record_t followed by
+ *    `int8_t vector[dim_pad]`.
+ *
+ * Records are only ever appended, into the bucket of the nearest list
+ * centroid. Erased flash reads 0xFF, so a bucket is filled up to its
+ * first record whose label is 0xFFFF, and a record only counts once its
+ * commit word has been cleared. A single list is a plain brute-force
+ * scan, which is what a new, empty collection starts with. Growing
+ * collections are rebuilt into more lists with fp_index_train_lists(),
+ * fp_index_layout() and fp_index_pack_header().
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* @[declare_fp_index_magic] */
+#define FP_INDEX_MAGIC 0x58495046   // "FPIX"
+#define FP_INDEX_VERSION 1
+/* @[declare_fp_index_magic] */
+
+/**
+ * @brief Fixed sizes of the image sections, in bytes.
+ */
+/* @[declare_fp_index_header_size] */
+#define FP_INDEX_HEADER_SIZE (16 * 1024)
+#define FP_INDEX_LABEL_LOG_SIZE (4 * 1024)
+/* @[declare_fp_index_header_size] */
+
+/**
+ * @brief Limits of the format.
+ */
+/* @[declare_fp_index_max_dim] */
+#define FP_INDEX_MAX_DIM 128
+#define FP_INDEX_MAX_LISTS 64
+#define FP_INDEX_MAX_LABELS 32
+#define FP_INDEX_LABEL_LEN 24
+#define FP_INDEX_MAX_K 16
+/* @[declare_fp_index_max_dim] */
+
+/**
+ * @brief Standardised features are multiplied by this before rounding
+ * to int8, so the int8 range covers about +-4 standard deviations.
+ */
+/* @[declare_fp_index_quant_scale] */
+#define FP_INDEX_QUANT_SCALE 32.0f
+/* @[declare_fp_index_quant_scale] */
+
+/**
+ * @brief k-means for the inverted lists runs on at most this many
+ * records, for this many rounds, as tools/smell_index.py does.
+ */
+/* @[declare_fp_index_train_samples] */
+#define FP_INDEX_TRAIN_SAMPLES 2000
+#define FP_INDEX_TRAIN_ROUNDS 8
+/* @[declare_fp_index_train_samples] */
+
+/**
+ * @brief int32 values of scratch fp_index_train_lists() needs.
+ */
+/* @[declare_fp_index_train_scratch] */
+#define FP_INDEX_TRAIN_SCRATCH(list_count, dim_pad) ((size_t)(list_count) * ((dim_pad) + 1))
+/* @[declare_fp_index_train_scratch] */
+
+/* @[declare_fp_header_t] */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t dim;
+    uint16_t dim_pad;       // dim rounded up to 4
+    uint16_t list_count;
+    uint16_t record_size;   // sizeof(fp_record_t) + dim_pad
+    uint16_t generation;    // bumped by each rebuild, the newest image wins
+    uint32_t record_count;
+    uint32_t image_size;
+} fp_header_t;
+/* @[declare_fp_header_t] */
+
+/* @[declare_fp_record_t] */
+typedef struct {
+    uint16_t label;         // 0xFFFF while erased
+    uint16_t commit;        // cleared to 0 once the vector is written
+} fp_record_t;
+/* @[declare_fp_record_t] */
+
+/* @[declare_fp_label_record_t] */
+typedef struct {
+    uint16_t id;            // 0xFFFF while erased
+    uint16_t commit;
+    char name[FP_INDEX_LABEL_LEN];
+} fp_label_record_t;
+/* @[declare_fp_label_record_t] */
+
+/**
+ * @brief A parsed image. The pointers point into the image; the fill
+ * counts are found by fp_index_open() and advanced by whoever appends.
+ */
+/* @[declare_fp_index_t] */
+typedef struct {
+    const fp_header_t *header;
+    const float *mean;
+    const float *inv_std;
+    const uint32_t *bucket_start;
+    const int8_t *centroids;
+    const fp_label_record_t *label_log;
+    const uint8_t *buckets;
+    uint32_t fill[FP_INDEX_MAX_LISTS + 1];
+} fp_index_t;
+/* @[declare_fp_index_t] */
+
+/**
+ * @brief One search hit.
+ */
+/* @[declare_fp_match_t] */
+typedef struct {
+    uint16_t label;
+    uint32_t distance;      // squared, in quantised units
+} fp_match_t;
+/* @[declare_fp_match_t] */
+
+/**
+ * @brief Bytes of image needed for the given shape, or 0 if it is out of
+ * the format's limits.
+ */
+/* @[declare_fp_index_image_size] */
+size_t fp_index_image_size(uint16_t dim, uint16_t list_count, uint32_t record_count);
+/* @[declare_fp_index_image_size] */
+
+/**
+ * @brief Checks an image and finds how full each bucket is.
+ *
+ * @param[out] index The parsed image.
+ * @param[in] image The image, 4-byte aligned.
+ * @param[in] size Bytes available at `image`.
+ * @return 0 on success, -1 if there is no valid image.
+ */
+/* @[declare_fp_index_open] */
+int fp_index_open(fp_index_t *index, const void *image, size_t size);
+/* @[declare_fp_index_open] */
+
+/**
+ * @brief Standardises and quantises a feature vector the way the records
+ * were. The padding is zeroed.
+ *
+ * @param[out] q `dim_pad` values.
+ */
+/* @[declare_fp_index_quantize] */
+void fp_index_quantize(const fp_index_t *index, const float *features, int8_t *q);
+/* @[declare_fp_index_quantize] */
+
+/**
+ * @brief Bucket a new record belongs in, ignoring whether it is full.
+ */
+/* @[declare_fp_index_nearest_list] */
+uint16_t fp_index_nearest_list(const fp_index_t *index, const int8_t *q);
+/* @[declare_fp_index_nearest_list] */
+
+/**
+ * @brief Nearest of `count` centroids of `dim_pad` values each.
+ */
+/* @[declare_fp_index_nearest_centroid] */
+uint16_t fp_index_nearest_centroid(const int8_t *centroids, uint16_t count, uint16_t dim_pad, const int8_t *q);
+/* @[declare_fp_index_nearest_centroid] */
+
+/**
+ * @brief Number of committed records, which is what a search can find.
+ */
+/* @[declare_fp_index_committed] */
+uint32_t fp_index_committed(const fp_index_t *index);
+/* @[declare_fp_index_committed] */
+
+/**
+ * @brief Inverted lists for a collection of `records` fingerprints: one
+ * below 1000, then the square root, up to FP_INDEX_MAX_LISTS. The same
+ * rule as tools/smell_index.py.
+ */
+/* @[declare_fp_index_list_count_for] */
+uint16_t fp_index_list_count_for(uint32_t records);
+/* @[declare_fp_index_list_count_for] */
+
+/**
+ * @brief Picks `list_count` centroids for the committed records of an
+ * image by k-means.
+ *
+ * Seeds from records evenly spaced through the image and runs
+ * FP_INDEX_TRAIN_ROUNDS rounds over at most FP_INDEX_TRAIN_SAMPLES of
+ * them, so the cost does not grow with the collection. Deterministic.
+ * Does not allocate.
+ *
+ * @param[in] index The image.
+ * @param[in] list_count Centroids to find, 1 to FP_INDEX_MAX_LISTS.
+ * @param[out] centroids `list_count` rows of `dim_pad` values.
+ * @param[in] scratch FP_INDEX_TRAIN_SCRATCH(list_count, dim_pad) values.
+ * @return 0, or -1 if there are fewer committed records than lists.
+ */
+/* @[declare_fp_index_train_lists] */
+int fp_index_train_lists(const fp_index_t *index, uint16_t list_count, int8_t *centroids, int32_t *scratch);
+/* @[declare_fp_index_train_lists] */
+
+/**
+ * @brief Lays out an image of `size` bytes whose lists start with
+ * `members[list]` records each.
+ *
+ * Every list gets an even share of the free records on top of its
+ * members, and the overflow bucket the rest, as tools/smell_index.py
+ * sizes them. The generation is left at 0.
+ *
+ * @param[out] header The image header.
+ * @param[out] bucket_start `list_count + 2` values.
+ * @param[in] members Records going into each list, `list_count + 1`
+ * values with the overflow bucket's last.
+ * @return 0, or -1 if the shape is out of the format's limits or the
+ * records do not fit in `size`.
+ */
+/* @[declare_fp_index_layout] */
+int fp_index_layout(fp_header_t *header, uint32_t *bucket_start, uint16_t dim, uint16_t list_count,
+                    const uint32_t *members, size_t size);
+/* @[declare_fp_index_layout] */
+
+/**
+ * @brief Serialises the header section: the header, the standardisation,
+ * the bucket starts and the centroids.
+ *
+ * @param[out] out Room for up to FP_INDEX_HEADER_SIZE bytes.
+ * @return Bytes written. Whatever follows up to FP_INDEX_HEADER_SIZE is
+ * left erased.
+ */
+/* @[declare_fp_index_pack_header] */
+size_t fp_index_pack_header(void *out, const fp_header_t *header, const float *mean, const float *inv_std,
+                            const uint32_t *bucket_start, const int8_t *centroids);
+/* @[declare_fp_index_pack_header] */
+
+/**
+ * @brief Record `slot` of `bucket`, and the number of slots a bucket has.
+ */
+/* @[declare_fp_index_record] */
+const fp_record_t *fp_index_record(const fp_index_t *index, uint16_t bucket, uint32_t slot);
+uint32_t fp_index_bucket_size(const fp_index_t *index, uint16_t bucket);
+/* @[declare_fp_index_record] */
+
+/**
+ * @brief Finds the k nearest committed records.
+ *
+ * Scans the `nprobe` lists whose centroids are nearest to the query,
+ * and the overflow bucket. An `nprobe` of at least `list_count` is an
+ * exact search. Does not allocate.
+ *
+ * **Example:**
+ * @code{c}
+ *  int8_t q[FP_INDEX_MAX_DIM];
+ *  fp_match_t matches[5];
+ *  fp_index_quantize(&index, features, q);
+ *  int found = fp_index_search(&index, q, 8, matches, 5);
+ * @endcode
+ *
+ * @param[in] index The image.
+ * @param[in] q Quantised query from fp_index_quantize().
+ * @param[in] nprobe Lists to scan.
+ * @param[out] matches Nearest first.
+ * @param[in] k Room in `matches`, at most FP_INDEX_MAX_K.
+ * @return Number of matches written.
+ */
+/* @[declare_fp_index_search] */
+int fp_index_search(const fp_index_t *index, const int8_t *q, uint16_t nprobe, fp_match_t *matches, int k);
+/* @[declare_fp_index_search] */
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,586 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_spiffs.h"
+
+#include "fp_store.h"
+
+#define TAG "FP_STORE"
+
+#define ALIGN4(x) (((x) + 3) & ~(size_t)3)
+
+#define SECTOR_SIZE 4096
+#define ALIGN_SECTOR(x) (((x) + SECTOR_SIZE - 1) & ~(size_t)(SECTOR_SIZE - 1))
+#define BUCKETS_OFFSET (FP_INDEX_HEADER_SIZE + FP_INDEX_LABEL_LOG_SIZE)
+#define LABEL_LOG_RECORDS (FP_INDEX_LABEL_LOG_SIZE / sizeof(fp_label_record_t))
+// Where a file system found in the partition is mounted to check for it
+#define PROBE_PATH "/fp_probe"
+
+static bool sector_erased(const uint8_t *sector) {
+    const uint32_t *word = (const uint32_t *)sector;
+    for (size_t i = 0; i < SECTOR_SIZE / sizeof(uint32_t); i++) {
+        if (word[i] != UINT32_MAX) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Finds whether `size` bytes from `offset` are all erased. Read through
+// `buf`, a sector long, since the range need not be mapped.
+static esp_err_t range_erased(const fp_store_t *store, size_t offset, size_t size, uint8_t *buf, bool *erased) {
+    *erased = true;
+    for (size_t at = 0; at < size && *erased; at += SECTOR_SIZE) {
+        esp_err_t err = esp_partition_read(store->partition, offset + at, buf, SECTOR_SIZE);
+        if (err != ESP_OK) {
+            return err;
+        }
+        *erased = sector_erased(buf);
+    }
+    return ESP_OK;
+}
+
+// Erases the sectors of the range that are not erased already, which
+// on a fresh partition is none of them
+static esp_err_t erase_range(const fp_store_t *store, size_t offset, size_t size, uint8_t *buf) {
+    for (size_t at = 0; at < size; at += SECTOR_SIZE) {
+        bool erased;
+        esp_err_t err = range_erased(store, offset + at, SECTOR_SIZE, buf, &erased);
+        if (err == ESP_OK && !erased) {
+            err = esp_partition_erase_range(store->partition, offset + at, SECTOR_SIZE);
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+// The partition has SPIFFS's subtype, so a mount that works means
+// someone keeps files in it
+static bool holds_spiffs(const esp_partition_t *partition) {
+    if (esp_spiffs_mounted(partition->label)) {
+        return true;
+    }
+    esp_vfs_spiffs_conf_t conf = {
+        .base_path = PROBE_PATH,
+        .partition_label = partition->label,
+        .max_files = 1,
+        .format_if_mount_failed = false,
+    };
+    if (esp_vfs_spiffs_register(&conf) != ESP_OK) {
+        return false;
+    }
+    esp_vfs_spiffs_unregister(partition->label);
+    return true;
+}
+
+// Writes the header section of an image whose records are in place. The
+// header itself goes in last, so an interrupted write leaves no image.
+static esp_err_t write_header(fp_store_t *store, size_t offset, const fp_header_t *header, const float *mean,
+                              const float *inv_std, const uint32_t *bucket_start, const int8_t *centroids) {
+    uint8_t *section = (uint8_t *)malloc(FP_INDEX_HEADER_SIZE);
+    if (section == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    size_t size = fp_index_pack_header(section, header, mean, inv_std, bucket_start, centroids);
+    esp_err_t err = esp_partition_write(store->partition, offset + sizeof(fp_header_t),
+                                        section + sizeof(fp_header_t), size - sizeof(fp_header_t));
+    if (err == ESP_OK) {
+        err = esp_partition_write(store->partition, offset, section, sizeof(fp_header_t));
+    }
+    free(section);
+    return err;
+}
+
+// Starts an empty single-list collection in the first slot. Flash that
+// is neither erased nor a collection is only erased if it does not
+// hold a file system.
+static esp_err_t format(fp_store_t *store, uint16_t dim, const float *mean, const float *inv_std) {
+    const uint32_t members[2] = { 0, 0 };
+    fp_header_t header;
+    uint32_t bucket_start[3];
+    if (fp_index_layout(&header, bucket_start, dim, 1, members, store->map_size) != 0) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    uint8_t *buf = (uint8_t *)malloc(SECTOR_SIZE);
+    if (buf == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    const size_t size = ALIGN_SECTOR(header.image_size);
+    bool erased;
+    esp_err_t err = range_erased(store, 0, size, buf, &erased);
+    if (err == ESP_OK && !erased && holds_spiffs(store->partition)) {
+        ESP_LOGE(TAG, "Partition %s holds a SPIFFS file system, not erasing it", store->partition->label);
+        err = ESP_ERR_INVALID_STATE;
+    }
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Starting an empty collection of %u records", header.record_count);
+        err = erase_range(store, 0, size, buf);
+    }
+    free(buf);
+
+    // The one centroid is the origin; the list and the overflow bucket
+    // are both scanned by every search
+    const int8_t centroid[FP_INDEX_MAX_DIM] = { 0 };
+    if (err == ESP_OK) {
+        err = write_header(store, 0, &header, mean, inv_std, bucket_start, centroid);
+    }
+    return err;
+}
+
+// Reads back the labels and accumulates each one's count and centroid
+static esp_err_t load(fp_store_t *store) {
+    const fp_index_t *index = &store->index;
+    const uint16_t dim_pad = index->header->dim_pad;
+
+    store->label_count = 0;
+    for (store->label_log_fill = 0; store->label_log_fill < LABEL_LOG_RECORDS; store->label_log_fill++) {
+        const fp_label_record_t *record = &index->label_log[store->label_log_fill];
+        if (record->id == 0xFFFF) {
+            break;
+        }
+        if (record->commit == 0 && record->id == store->label_count &&
+            store->label_count < FP_INDEX_MAX_LABELS &&
+            memchr(record->name, '\0', FP_INDEX_LABEL_LEN) != NULL) {
+            store->labels[store->label_count++] = record->name;
+        }
+    }
+
+    // A rebuild keeps the dimension, so the sums are reused
+    if (store->sums == NULL) {
+        store->sums = (int32_t *)calloc((size_t)FP_INDEX_MAX_LABELS * dim_pad, sizeof(int32_t));
+        if (store->sums == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    } else {
+        memset(store->sums, 0, (size_t)FP_INDEX_MAX_LABELS * dim_pad * sizeof(int32_t));
+    }
+    memset(store->counts, 0, sizeof(store->counts));
+
+    store->total = 0;
+    for (uint16_t b = 0; b <= index->header->list_count; b++) {
+        for (uint32_t slot = 0; slot < index->fill[b]; slot++) {
+            const fp_record_t *record = fp_index_record(index, b, slot);
+            if (record->commit != 0 || record->label >= store->label_count) {
+                continue;
+            }
+            const int8_t *v = (const int8_t *)(record + 1);
+            int32_t *sum = &store->sums[(size_t)record->label * dim_pad];
+            for (uint16_t i = 0; i < dim_pad; i++) {
+                sum[i] += v[i];
+            }
+            store->counts[record->label]++;
+            store->total++;
+        }
+    }
+    ESP_LOGI(TAG, "%u fingerprints of %u labels in %u lists, generation %u", store->total, store->label_count,
+             index->header->list_count, index->header->generation);
+    return ESP_OK;
+}
+
+static bool read_slot_header(const fp_store_t *store, size_t offset, fp_header_t *header) {
+    return offset + store->map_size <= store->partition->size &&
+        esp_partition_read(store->partition, offset, header, sizeof(fp_header_t)) == ESP_OK &&
+        header->magic == FP_INDEX_MAGIC && header->version == FP_INDEX_VERSION;
+}
+
+// Maps the image in a slot. ESP_ERR_NOT_FOUND if it does not hold one,
+// and nothing is left mapped on failure.
+static esp_err_t map_slot(fp_store_t *store, size_t offset) {
+    const void *ptr;
+    esp_err_t err = esp_partition_mmap(store->partition, offset, store->map_size, SPI_FLASH_MMAP_DATA, &ptr, &store->handle);
+    if (err == ESP_OK && fp_index_open(&store->index, ptr, store->map_size) != 0) {
+        spi_flash_munmap(store->handle);
+        err = ESP_ERR_NOT_FOUND;
+    }
+    if (err != ESP_OK) {
+        memset(&store->index, 0, sizeof(fp_index_t));
+        return err;
+    }
+    store->slot_offset = offset;
+    return ESP_OK;
+}
+
+esp_err_t fp_store_open(fp_store_t *store, const char *partition_label, uint16_t dim, const float *mean, const float *inv_std) {
+    memset(store, 0, sizeof(fp_store_t));
+    store->partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partition_label);
+    if (store->partition == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    store->map_size = store->partition->size < FP_STORE_MAP_SIZE ? store->partition->size : FP_STORE_MAP_SIZE;
+    store->can_rebuild = store->partition->size >= FP_STORE_SECOND_SLOT + store->map_size;
+
+    // The newer image if both slots hold one, which only a reset during
+    // a rebuild leaves behind; the other if the newer one is damaged
+    fp_header_t first, second;
+    const bool has_first = read_slot_header(store, 0, &first);
+    const bool has_second = store->can_rebuild && read_slot_header(store, FP_STORE_SECOND_SLOT, &second);
+    const bool second_newer = has_second && (!has_first || (int16_t)(second.generation - first.generation) > 0);
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    if (has_first || has_second) {
+        err = map_slot(store, second_newer ? FP_STORE_SECOND_SLOT : 0);
+        if (err == ESP_ERR_NOT_FOUND && has_first && has_second) {
+            err = map_slot(store, second_newer ? 0 : FP_STORE_SECOND_SLOT);
+        }
+    }
+
+    if (err == ESP_ERR_NOT_FOUND) {
+        err = mean != NULL && inv_std != NULL ? format(store, dim, mean, inv_std) : ESP_ERR_NOT_FOUND;
+        if (err == ESP_OK) {
+            err = map_slot(store, 0);
+            err = err == ESP_ERR_NOT_FOUND ? ESP_ERR_INVALID_STATE : err;
+        }
+    } else if (err == ESP_OK && store->index.header->dim != dim) {
+        err = ESP_ERR_INVALID_SIZE;
+    }
+    if (err == ESP_OK) {
+        err = load(store);
+    }
+    if (err == ESP_OK) {
+        store->lock = xSemaphoreCreateMutex();
+        store->writer = xSemaphoreCreateMutex();
+        err = store->lock != NULL && store->writer != NULL ? ESP_OK : ESP_ERR_NO_MEM;
+    }
+    if (err != ESP_OK) {
+        if (store->lock != NULL) {
+            vSemaphoreDelete(store->lock);
+        }
+        if (store->writer != NULL) {
+            vSemaphoreDelete(store->writer);
+        }
+        if (store->index.header != NULL) {
+            spi_flash_munmap(store->handle);
+        }
+        free(store->sums);
+        memset(store, 0, sizeof(fp_store_t));
+    }
+    return err;
+}
+
+static int find_label(const fp_store_t *store, const char *label) {
+    for (uint16_t i = 0; i < store->label_count; i++) {
+        if (strncmp(store->labels[i], label, FP_INDEX_LABEL_LEN - 1) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static esp_err_t add_label(fp_store_t *store, const char *label, uint16_t *id) {
+    if (store->label_count == FP_INDEX_MAX_LABELS || store->label_log_fill == LABEL_LOG_RECORDS) {
+        return ESP_ERR_NO_MEM;
+    }
+    fp_label_record_t record = {
+        .id = store->label_count,
+        .commit = 0xFFFF,
+    };
+    strncpy(record.name, label, FP_INDEX_LABEL_LEN - 1);
+
+    const size_t offset = store->slot_offset + FP_INDEX_HEADER_SIZE + store->label_log_fill * sizeof(fp_label_record_t);
+    const uint16_t commit = 0;
+    store->label_log_fill++;
+    esp_err_t err = esp_partition_write(store->partition, offset, &record, sizeof(record));
+    if (err == ESP_OK) {
+        err = esp_partition_write(store->partition, offset + offsetof(fp_label_record_t, commit), &commit, sizeof(commit));
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+    *id = store->label_count;
+    store->labels[store->label_count++] = store->index.label_log[store->label_log_fill - 1].name;
+    return ESP_OK;
+}
+
+// Unmaps the current image and maps the one just built at `offset`,
+// then erases the old image's header. Until that erase both are
+// complete, and opening picks the new one by its generation.
+static esp_err_t switch_slot(fp_store_t *store, size_t offset) {
+    const size_t old = store->slot_offset;
+    xSemaphoreTake(store->lock, portMAX_DELAY);
+    spi_flash_munmap(store->handle);
+    esp_err_t err = map_slot(store, offset);
+    if (err != ESP_OK && map_slot(store, old) != ESP_OK) {
+        ESP_LOGE(TAG, "Could not map the collection back");
+    }
+    if (err == ESP_OK) {
+        err = load(store);
+    }
+    if (err == ESP_OK) {
+        err = esp_partition_erase_range(store->partition, old, SECTOR_SIZE);
+    }
+    xSemaphoreGive(store->lock);
+    return err;
+}
+
+/*
+    Copies the committed records into the other slot, split into
+    `list_count` lists by k-means, and switches to it. Only the writer
+    runs this, so the image does not change under it, and readers go on
+    using the old image until the switch. ESP_ERR_INVALID_SIZE if the
+    records already fill an image.
+*/
+static esp_err_t rebuild(fp_store_t *store, uint16_t list_count) {
+    const fp_index_t *index = &store->index;
+    const fp_header_t *header = index->header;
+    const uint16_t dim_pad = header->dim_pad;
+    const uint16_t record_size = header->record_size;
+    const size_t target = store->slot_offset == 0 ? FP_STORE_SECOND_SLOT : 0;
+    const uint32_t total = fp_index_committed(index);
+    if (total >= header->record_count) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    list_count = total < list_count ? 1 : list_count;
+    const TickType_t start = xTaskGetTickCount();
+
+    int8_t *centroids = (int8_t *)calloc(list_count, dim_pad);
+    int32_t *scratch = (int32_t *)malloc(FP_INDEX_TRAIN_SCRATCH(list_count, dim_pad) * sizeof(int32_t));
+    uint16_t *assign = (uint16_t *)malloc((total ? total : 1) * sizeof(uint16_t));
+    uint8_t *buf = (uint8_t *)malloc(SECTOR_SIZE);
+    esp_err_t err = centroids && scratch && assign && buf ? ESP_OK : ESP_ERR_NO_MEM;
+    if (err == ESP_OK && list_count > 1 && fp_index_train_lists(index, list_count, centroids, scratch) != 0) {
+        err = ESP_ERR_INVALID_STATE;
+    }
+
+    uint32_t members[FP_INDEX_MAX_LISTS + 1] = { 0 };
+    uint32_t n = 0;
+    for (uint16_t b = 0; err == ESP_OK && b <= header->list_count; b++) {
+        for (uint32_t slot = 0; slot < index->fill[b]; slot++) {
+            const fp_record_t *record = fp_index_record(index, b, slot);
+            if (record->commit == 0) {
+                assign[n] = fp_index_nearest_centroid(centroids, list_count, dim_pad, (const int8_t *)(record + 1));
+                members[assign[n++]]++;
+            }
+        }
+    }
+
+    fp_header_t new_header;
+    uint32_t bucket_start[FP_INDEX_MAX_LISTS + 2];
+    if (err == ESP_OK && fp_index_layout(&new_header, bucket_start, header->dim, list_count, members, store->map_size) != 0) {
+        err = ESP_ERR_INVALID_SIZE;
+    }
+    new_header.generation = header->generation + 1;
+    if (err == ESP_OK) {
+        err = erase_range(store, target, ALIGN_SECTOR(new_header.image_size), buf);
+    }
+
+    // The label log as it is, so the records keep their label ids. Flash
+    // is written from RAM, never from the mapping.
+    for (size_t at = 0; err == ESP_OK && at < FP_INDEX_LABEL_LOG_SIZE; at += SECTOR_SIZE) {
+        memcpy(buf, (const uint8_t *)index->label_log + at, SECTOR_SIZE);
+        err = esp_partition_write(store->partition, target + FP_INDEX_HEADER_SIZE + at, buf, SECTOR_SIZE);
+    }
+
+    // Each list's records are contiguous, so they go a sector at a time
+    for (uint16_t l = 0; err == ESP_OK && l < list_count; l++) {
+        size_t offset = target + BUCKETS_OFFSET + (size_t)bucket_start[l] * record_size;
+        size_t fill = 0;
+        n = 0;
+        for (uint16_t b = 0; err == ESP_OK && b <= header->list_count; b++) {
+            for (uint32_t slot = 0; err == ESP_OK && slot < index->fill[b]; slot++) {
+                const fp_record_t *record = fp_index_record(index, b, slot);
+                if (record->commit != 0 || assign[n++] != l) {
+                    continue;
+                }
+                memcpy(buf + fill, record, record_size);
+                fill += record_size;
+                if (fill + record_size > SECTOR_SIZE) {
+                    err = esp_partition_write(store->partition, offset, buf, fill);
+                    offset += fill;
+                    fill = 0;
+                }
+            }
+        }
+        if (err == ESP_OK && fill > 0) {
+            err = esp_partition_write(store->partition, offset, buf, fill);
+        }
+    }
+
+    if (err == ESP_OK) {
+        err = write_header(store, target, &new_header, index->mean, index->inv_std, bucket_start, centroids);
+    }
+    free(centroids);
+    free(scratch);
+    free(assign);
+    free(buf);
+
+    if (err == ESP_OK) {
+        err = switch_slot(store, target);
+    }
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Rebuilt %u fingerprints into %u lists in %u ms", total, list_count,
+                 (xTaskGetTickCount() - start) * portTICK_PERIOD_MS);
+    }
+    return err;
+}
+
+// Bucket with room for a record, the overflow one if its list is full,
+// or -1 if that is full too
+static int place(const fp_index_t *index, const int8_t *q) {
+    int bucket = fp_index_nearest_list(index, q);
+    if (index->fill[bucket] == fp_index_bucket_size(index, bucket)) {
+        bucket = index->header->list_count;
+    }
+    return index->fill[bucket] < fp_index_bucket_size(index, bucket) ? bucket : -1;
+}
+
+esp_err_t fp_store_add(fp_store_t *store, const char *label, const float *features) {
+    if (label == NULL || label[0] == '\0') {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (store->lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    fp_index_t *index = &store->index;
+
+    struct {
+        fp_record_t head;
+        int8_t vector[FP_INDEX_MAX_DIM];
+    } record;
+
+    xSemaphoreTake(store->writer, portMAX_DELAY);
+    esp_err_t err = index->header != NULL ? ESP_OK : ESP_ERR_INVALID_STATE;
+    int bucket = -1;
+    if (err == ESP_OK) {
+        // A rebuild copies the standardisation, so the vector stays valid
+        fp_index_quantize(index, features, record.vector);
+        bucket = place(index, record.vector);
+        const uint16_t wanted = fp_index_list_count_for(store->total + 1);
+        const uint16_t lists = index->header->list_count;
+        if (store->can_rebuild && (bucket < 0 || wanted >= 2 * lists)) {
+            esp_err_t rebuilt = rebuild(store, wanted > lists ? wanted : lists);
+            if (rebuilt != ESP_OK && rebuilt != ESP_ERR_INVALID_SIZE) {
+                // Not tried again until the store is reopened
+                ESP_LOGW(TAG, "Could not rebuild the collection: %s", esp_err_to_name(rebuilt));
+                store->can_rebuild = false;
+            }
+            bucket = index->header != NULL ? place(index, record.vector) : -1;
+        }
+        if (bucket < 0) {
+            err = index->header != NULL ? ESP_ERR_NO_MEM : ESP_ERR_INVALID_STATE;
+        }
+    }
+
+    xSemaphoreTake(store->lock, portMAX_DELAY);
+    const fp_header_t *header = index->header;
+    int found = err == ESP_OK ? find_label(store, label) : -1;
+    uint16_t id = found;
+    if (err == ESP_OK && found < 0) {
+        err = add_label(store, label, &id);
+    }
+
+    if (err == ESP_OK) {
+        // The record only counts once its commit word is cleared, so a
+        // write cut short by a reset is skipped rather than misread. The
+        // slot is used up either way.
+        const size_t offset = store->slot_offset + BUCKETS_OFFSET
+            + ((size_t)index->bucket_start[bucket] + index->fill[bucket]) * header->record_size;
+        const uint16_t commit = 0;
+        record.head.label = id;
+        record.head.commit = 0xFFFF;
+        index->fill[bucket]++;
+        err = esp_partition_write(store->partition, offset, &record, header->record_size);
+        if (err == ESP_OK) {
+            err = esp_partition_write(store->partition, offset + offsetof(fp_record_t, commit), &commit, sizeof(commit));
+        }
+    }
+
+    if (err == ESP_OK) {
+        int32_t *sum = &store->sums[(size_t)id * header->dim_pad];
+        for (uint16_t i = 0; i < header->dim_pad; i++) {
+            sum[i] += record.vector[i];
+        }
+        store->counts[id]++;
+        store->total++;
+    }
+    xSemaphoreGive(store->lock);
+    xSemaphoreGive(store->writer);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Could not add a fingerprint of %s: %s", label, esp_err_to_name(err));
+    }
+    return err;
+}
+
+int fp_store_search(fp_store_t *store, const float *features, uint16_t nprobe, fp_store_match_t *matches, int k) {
+    if (store->lock == NULL) {
+        return 0;
+    }
+    int8_t q[FP_INDEX_MAX_DIM];
+    fp_match_t found[FP_INDEX_MAX_K];
+
+    xSemaphoreTake(store->lock, portMAX_DELAY);
+    int count = 0;
+    if (store->index.header != NULL) {
+        fp_index_quantize(&store->index, features, q);
+        count = fp_index_search(&store->index, q, nprobe, found, k);
+    }
+    for (int i = 0; i < count; i++) {
+        matches[i].label = found[i].label < store->label_count ? store->labels[found[i].label] : "?";
+        matches[i].distance = sqrtf((float)found[i].distance) / FP_INDEX_QUANT_SCALE;
+    }
+    xSemaphoreGive(store->lock);
+    return count;
+}
+
+uint32_t fp_store_label_count(fp_store_t *store, const char *label) {
+    if (store->lock == NULL || label == NULL) {
+        return 0;
+    }
+    xSemaphoreTake(store->lock, portMAX_DELAY);
+    int id = find_label(store, label);
+    uint32_t count = id >= 0 ? store->counts[id] : 0;
+    xSemaphoreGive(store->lock);
+    return count;
+}
+
+bool fp_store_label_centroid(fp_store_t *store, const char *label, float *centroid) {
+    if (store->lock == NULL || label == NULL) {
+        return false;
+    }
+    const fp_index_t *index = &store->index;
+    xSemaphoreTake(store->lock, portMAX_DELAY);
+    int id = find_label(store, label);
+    bool found = index->header != NULL && id >= 0 && store->counts[id] > 0;
+    if (found) {
+        const int32_t *sum = &store->sums[(size_t)id * index->header->dim_pad];
+        for (uint16_t i = 0; i < index->header->dim; i++) {
+            float z = (float)sum[i] / store->counts[id] / FP_INDEX_QUANT_SCALE;
+            centroid[i] = index->inv_std[i] > 0.0f ? index->mean[i] + z / index->inv_std[i] : index->mean[i];
+        }
+    }
+    xSemaphoreGive(store->lock);
+    return found;
+}
+
+void fp_store_for_each(fp_store_t *store, void (*fn)(const char *label, const float *features, void *arg), void *arg) {
+    if (store->lock == NULL) {
+        return;
+    }
+    const fp_index_t *index = &store->index;
+    float features[FP_INDEX_MAX_DIM];
+
+    xSemaphoreTake(store->lock, portMAX_DELAY);
+    const fp_header_t *header = index->header;
+    for (uint16_t b = 0; header != NULL && b <= header->list_count; b++) {
+        for (uint32_t slot = 0; slot < index->fill[b]; slot++) {
+            const fp_record_t *record = fp_index_record(index, b, slot);
+            if (record->commit != 0 || record->label >= store->label_count) {
+                continue;
+            }
+            const int8_t *v = (const int8_t *)(record + 1);
+            for (uint16_t i = 0; i < header->dim; i++) {
+                float z = v[i] / FP_INDEX_QUANT_SCALE;
+                features[i] = index->inv_std[i] > 0.0f ? index->mean[i] + z / index->inv_std[i] : index->mean[i];
+            }
+            fn(store->labels[record->label], features, arg);
+        }
+    }
+    xSemaphoreGive(store->lock);
+}
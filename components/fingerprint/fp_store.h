@@ -0,0 +1,185 @@
+/**
+ * @file fp_store.h
+ * @brief The fingerprint collection, kept in a flash partition that is
+ * memory mapped and appended to in place.
+ *
+ * The partition is used raw, without a file system, so the records can
+ * be searched straight through the flash cache. See fp_index.h for the
+ * layout.
+ *
+ * The image lives in one of two slots of FP_STORE_MAP_SIZE: at the start
+ * of the partition, or at FP_STORE_SECOND_SLOT. As the collection grows
+ * it is rebuilt into more inverted lists in the other slot, and the one
+ * with the higher generation is used, so a reset part way through a
+ * rebuild leaves the old image as it was. Without room for the second
+ * slot the collection stays as it started.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "fp_index.h"
+
+/**
+ * @brief Most of a partition that is mapped. The ESP32 maps at most
+ * 4 MB of flash for data at a time, shared with the app's constants
+ * and the classifier model.
+ */
+/* @[declare_fp_store_map_size] */
+#define FP_STORE_MAP_SIZE (2 * 1024 * 1024)
+/* @[declare_fp_store_map_size] */
+
+/**
+ * @brief Where the second slot starts in the partition. The 512 KB
+ * between the slots is left for other data, such as a network model.
+ */
+/* @[declare_fp_store_second_slot] */
+#define FP_STORE_SECOND_SLOT (FP_STORE_MAP_SIZE + 512 * 1024)
+/* @[declare_fp_store_second_slot] */
+
+/**
+ * @brief An open collection.
+ */
+/* @[declare_fp_store_t] */
+typedef struct {
+    const esp_partition_t *partition;
+    size_t slot_offset;     // of the mapped image
+    size_t map_size;
+    bool can_rebuild;       // the partition has room for the second slot
+    spi_flash_mmap_handle_t handle;
+    fp_index_t index;
+    SemaphoreHandle_t lock;     // taken by readers and to change the mapping
+    SemaphoreHandle_t writer;   // taken through each add, rebuilds included
+    uint32_t total;
+    uint16_t label_count;
+    uint16_t label_log_fill;
+    const char *labels[FP_INDEX_MAX_LABELS];    // into the label log
+    uint32_t counts[FP_INDEX_MAX_LABELS];
+    int32_t *sums;          // [FP_INDEX_MAX_LABELS][dim_pad] sums of the quantised vectors
+} fp_store_t;
+/* @[declare_fp_store_t] */
+
+/**
+ * @brief A search hit with its label resolved.
+ */
+/* @[declare_fp_store_match_t] */
+typedef struct {
+    const char *label;
+    float distance;         // Euclidean, in standard deviations
+} fp_store_match_t;
+/* @[declare_fp_store_match_t] */
+
+/**
+ * @brief Maps the collection in a partition, starting an empty one if
+ * the partition does not hold one yet.
+ *
+ * A new collection is a single list searched by brute force, using
+ * `mean` and `inv_std` to standardise features before quantising them.
+ * Those are normally the classifier model's. fp_store_add() splits it
+ * into inverted lists once it holds 1000 fingerprints, or a larger set
+ * can be built on a host by tools/smell_index.py.
+ *
+ * A partition that holds neither a collection nor erased flash is only
+ * erased for a new one if it is not a SPIFFS file system.
+ *
+ * Opening scans every record once to count the labels and sum their
+ * centroids.
+ *
+ * **Example:**
+ * @code{c}
+ *  static fp_store_t store;
+ *  fp_store_open(&store, "spiffs", GAS_FEATURE_DIM, model.mean, model.inv_std);
+ *  fp_store_add(&store, "coffee", features);
+ *  ESP_LOGI(TAG, "%u coffees", fp_store_label_count(&store, "coffee"));
+ * @endcode
+ *
+ * @param[out] store The collection.
+ * @param[in] partition_label Name of the data partition.
+ * @param[in] dim Features per fingerprint.
+ * @param[in] mean Standardisation for a new collection, may be NULL to
+ * only open an existing one.
+ * @param[in] inv_std As `mean`.
+ * @return `ESP_OK`, `ESP_ERR_NOT_FOUND` if there is no such partition or
+ * no collection and no standardisation to start one,
+ * `ESP_ERR_INVALID_SIZE` if the collection is for another `dim`, or
+ * `ESP_ERR_INVALID_STATE` if the partition holds a file system.
+ */
+/* @[declare_fp_store_open] */
+esp_err_t fp_store_open(fp_store_t *store, const char *partition_label, uint16_t dim, const float *mean, const float *inv_std);
+/* @[declare_fp_store_open] */
+
+/**
+ * @brief Appends a labelled fingerprint.
+ *
+ * Writes one record to flash and updates the label's count and
+ * centroid. Takes a few milliseconds, a new label a few more.
+ *
+ * When the collection has grown enough to want twice the inverted lists
+ * it has (see fp_index_list_count_for()), or the record's list and the
+ * overflow bucket are full, the add first rebuilds it into the other
+ * slot. That copies every record and takes seconds; searches go on in
+ * the old image meanwhile and only wait for the switch to the new one.
+ * Call from a task that can wait that long, not the GUI's.
+ *
+ * @return `ESP_OK`, `ESP_ERR_INVALID_ARG` for an empty label,
+ * `ESP_ERR_NO_MEM` if the label table or the record's bucket and the
+ * overflow bucket are full, or a flash error.
+ */
+/* @[declare_fp_store_add] */
+esp_err_t fp_store_add(fp_store_t *store, const char *label, const float *features);
+/* @[declare_fp_store_add] */
+
+/**
+ * @brief Finds the fingerprints nearest to a feature vector.
+ *
+ * @param[in] nprobe Inverted lists to scan, see fp_index_search().
+ * @param[out] matches Nearest first.
+ * @param[in] k Room in `matches`.
+ * @return Number of matches written.
+ */
+/* @[declare_fp_store_search] */
+int fp_store_search(fp_store_t *store, const float *features, uint16_t nprobe, fp_store_match_t *matches, int k);
+/* @[declare_fp_store_search] */
+
+/**
+ * @brief Number of fingerprints with a label, 0 for an unknown one.
+ */
+/* @[declare_fp_store_label_count] */
+uint32_t fp_store_label_count(fp_store_t *store, const char *label);
+/* @[declare_fp_store_label_count] */
+
+/**
+ * @brief Mean of a label's fingerprints in raw feature units.
+ *
+ * @param[out] centroid `dim` values.
+ * @return true, or false for an unknown or empty label.
+ */
+/* @[declare_fp_store_label_centroid] */
+bool fp_store_label_centroid(fp_store_t *store, const char *label, float *centroid);
+/* @[declare_fp_store_label_centroid] */
+
+/**
+ * @brief Calls `fn` with every committed fingerprint, in flash order.
+ *
+ * The features are dequantised back to raw units, so they are within
+ * half a quantisation step of what was added. Used to rebuild models
+ * that live in RAM after a restart. `fn` must not add to the store.
+ */
+/* @[declare_fp_store_for_each] */
+void fp_store_for_each(fp_store_t *store, void (*fn)(const char *label, const float *features, void *arg), void *arg);
+/* @[declare_fp_store_for_each] */
+
+#ifdef __cplusplus
+}
+#endif
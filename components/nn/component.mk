@@ -0,0 +1,4 @@
+COMPONENT_ADD_INCLUDEDIRS := .
+
+# See CMakeLists.txt
+CFLAGS += -O2
@@ -0,0 +1,234 @@
+#include <math.h>
+#include <string.h>
+
+#include "nn_model.h"
+
+_Static_assert(sizeof(nn_header_t) == 24, "nn_header_t must match the blob layout");
+_Static_assert(sizeof(nn_layer_t) == 36, "nn_layer_t must match the blob layout");
+
+#define ALIGN4(x) (((x) + 3) & ~(size_t)3)
+
+static size_t layer_size(const nn_layer_t *layer) {
+    const size_t n = layer->out_channels;
+    return sizeof(nn_layer_t)
+        + 3 * n * sizeof(int32_t)
+        + ALIGN4(n)
+        + ALIGN4(n * layer->kernel * layer->in_channels);
+}
+
+static int check_layer(const nn_layer_t *layer, uint16_t in_len, uint16_t in_channels) {
+    if (layer->in_len != in_len || layer->in_channels != in_channels || layer->out_channels == 0 ||
+        layer->activation > NN_ACT_RELU || layer->in_scale <= 0.0f || layer->out_scale <= 0.0f ||
+        layer->in_zero < -128 || layer->in_zero > 127 || layer->out_zero < -128 || layer->out_zero > 127) {
+        return -1;
+    }
+    if (layer->type == NN_DENSE) {
+        return layer->kernel == in_len && layer->out_len == 1 ? 0 : -1;
+    }
+    if (layer->type == NN_CONV1D) {
+        if (layer->kernel == 0 || layer->kernel > in_len || layer->stride == 0) {
+            return -1;
+        }
+        return layer->out_len == (in_len - layer->kernel) / layer->stride + 1 ? 0 : -1;
+    }
+    return -1;
+}
+
+// Points the model at the blob's sections, checking that each layer
+// takes what the one before it makes
+static int parse(nn_model_t *model, const void *blob, size_t size) {
+    const uint8_t *base = (const uint8_t *)blob;
+    if (model == NULL || blob == NULL || ((uintptr_t)blob & 3) || size < sizeof(nn_header_t)) {
+        return -1;
+    }
+    const nn_header_t *header = (const nn_header_t *)base;
+    if (header->magic != NN_MAGIC || header->version != NN_VERSION ||
+        header->layer_count == 0 || header->layer_count > NN_MAX_LAYERS ||
+        header->class_count == 0 || header->class_count > NN_MAX_CLASSES ||
+        header->input_len == 0 || header->input_channels == 0 ||
+        header->size > size || (header->size & 3) || !(header->temperature > 0.0f)) {
+        return -1;
+    }
+    const uint8_t *end = base + header->size;
+    const size_t input_size = (size_t)header->input_len * header->input_channels;
+
+    const uint8_t *p = base + sizeof(nn_header_t);
+    model->header = header;
+    model->labels = (const char (*)[NN_LABEL_LEN])p;
+    p += (size_t)header->class_count * NN_LABEL_LEN;
+    model->mean = (const float *)p;
+    p += input_size * sizeof(float);
+    model->inv_std = (const float *)p;
+    p += input_size * sizeof(float);
+    if (p > end) {
+        return -1;
+    }
+    for (uint16_t c = 0; c < header->class_count; c++) {
+        if (memchr(model->labels[c], '\0', NN_LABEL_LEN) == NULL) {
+            return -1;
+        }
+    }
+
+    uint16_t len = header->input_len;
+    uint16_t channels = header->input_channels;
+    for (uint16_t i = 0; i < header->layer_count; i++) {
+        const nn_layer_t *layer = (const nn_layer_t *)p;
+        if (p + sizeof(nn_layer_t) > end || check_layer(layer, len, channels) != 0 ||
+            layer->size != layer_size(layer) || p + layer->size > end) {
+            return -1;
+        }
+        // Consecutive layers have to agree on how the tensor between them
+        // is quantised
+        if (i > 0 && (layer->in_scale != model->layers[i - 1].layer->out_scale ||
+                      layer->in_zero != model->layers[i - 1].layer->out_zero)) {
+            return -1;
+        }
+
+        const size_t n = layer->out_channels;
+        nn_layer_view_t *view = &model->layers[i];
+        view->layer = layer;
+        p += sizeof(nn_layer_t);
+        view->bias = (const int32_t *)p;
+        p += n * sizeof(int32_t);
+        view->multiplier = (const int32_t *)p;
+        p += n * sizeof(int32_t);
+        view->weight_scale = (const float *)p;
+        p += n * sizeof(float);
+        view->shift = (const int8_t *)p;
+        p += ALIGN4(n);
+        view->weights = (const int8_t *)p;
+        p += ALIGN4(n * layer->kernel * layer->in_channels);
+
+        for (size_t c = 0; c < n; c++) {
+            if (view->shift[c] < 1 || view->shift[c] > 62 || view->multiplier[c] < 0) {
+                return -1;
+            }
+        }
+        len = layer->out_len;
+        channels = layer->out_channels;
+    }
+    if ((size_t)len * channels != header->class_count || p != end) {
+        return -1;
+    }
+    return 0;
+}
+
+// Even tensors go at the start of the arena and odd ones after the
+// largest even one, so a layer's input and output never overlap
+static size_t plan(nn_model_t *model) {
+    const nn_header_t *header = model->header;
+    size_t largest[2] = {(size_t)header->input_len * header->input_channels, 0};
+    for (uint16_t i = 0; i < header->layer_count; i++) {
+        const nn_layer_t *layer = model->layers[i].layer;
+        const size_t size = (size_t)layer->out_len * layer->out_channels;
+        const int slot = (i + 1) & 1;
+        if (size > largest[slot]) {
+            largest[slot] = size;
+        }
+    }
+    for (uint16_t i = 0; i <= header->layer_count; i++) {
+        model->tensor_offset[i] = (i & 1) ? ALIGN4(largest[0]) : 0;
+    }
+    return ALIGN4(largest[0]) + ALIGN4(largest[1]);
+}
+
+size_t nn_arena_size(const void *blob, size_t size) {
+    nn_model_t model;
+    if (parse(&model, blob, size) != 0) {
+        return 0;
+    }
+    return plan(&model);
+}
+
+int nn_model_load(nn_model_t *model, const void *blob, size_t size, int8_t *arena, size_t arena_size) {
+    if (parse(model, blob, size) != 0 || arena == NULL || plan(model) > arena_size) {
+        return -1;
+    }
+    model->arena = arena;
+    return 0;
+}
+
+// Kept branch-free over plain int8 arrays so the compiler can vectorise
+// it where the target has SIMD, and pipeline it where it does not
+static inline int32_t dot(const int8_t *restrict a, const int8_t *restrict b, size_t n) {
+    int32_t acc = 0;
+    for (size_t i = 0; i < n; i++) {
+        acc += (int32_t)a[i] * (int32_t)b[i];
+    }
+    return acc;
+}
+
+// acc * multiplier * 2^-shift, rounded half up
+static inline int32_t requantize(int32_t acc, int32_t multiplier, int shift) {
+    return (int32_t)(((int64_t)acc * multiplier + ((int64_t)1 << (shift - 1))) >> shift);
+}
+
+static void run_layer(const nn_layer_view_t *view, const int8_t *restrict in, int8_t *restrict out) {
+    const nn_layer_t *layer = view->layer;
+    const size_t row = (size_t)layer->kernel * layer->in_channels;
+    const size_t step = (size_t)layer->stride * layer->in_channels;
+    const int32_t low = layer->activation == NN_ACT_RELU ? layer->out_zero : -128;
+
+    for (uint16_t t = 0; t < layer->out_len; t++) {
+        // Steps first means the window of every output step is contiguous
+        const int8_t *window = in + t * step;
+        int8_t *o = out + (size_t)t * layer->out_channels;
+        for (uint16_t c = 0; c < layer->out_channels; c++) {
+            int32_t acc = view->bias[c] + dot(window, view->weights + c * row, row);
+            int32_t q = requantize(acc, view->multiplier[c], view->shift[c]) + layer->out_zero;
+            q = q < low ? low : q;
+            o[c] = (int8_t)(q > 127 ? 127 : q);
+        }
+    }
+}
+
+int nn_model_run(const nn_model_t *model, const float *input, float *scores) {
+    const nn_header_t *header = model->header;
+    const nn_layer_t *first = model->layers[0].layer;
+    const size_t input_size = (size_t)header->input_len * header->input_channels;
+
+    int8_t *x = model->arena + model->tensor_offset[0];
+    const float inv_scale = 1.0f / first->in_scale;
+    for (size_t i = 0; i < input_size; i++) {
+        // Clamped before rounding: lroundf() of a value out of range of
+        // a long, an infinity or a NaN is undefined. A NaN goes to -128.
+        float q = (input[i] - model->mean[i]) * model->inv_std[i] * inv_scale + (float)first->in_zero;
+        q = q > -128.0f ? q : -128.0f;
+        q = q < 127.0f ? q : 127.0f;
+        x[i] = (int8_t)lroundf(q);
+    }
+
+    for (uint16_t i = 0; i < header->layer_count; i++) {
+        run_layer(&model->layers[i], model->arena + model->tensor_offset[i], model->arena + model->tensor_offset[i + 1]);
+    }
+
+    const nn_layer_t *last = model->layers[header->layer_count - 1].layer;
+    const int8_t *out = model->arena + model->tensor_offset[header->layer_count];
+    int best = 0;
+    for (uint16_t c = 0; c < header->class_count; c++) {
+        if (scores != NULL) {
+            scores[c] = last->out_scale * (float)(out[c] - last->out_zero);
+        }
+        if (out[c] > out[best]) {
+            best = c;
+        }
+    }
+    return best;
+}
+
+float nn_model_confidence(const nn_model_t *model, const float *scores, uint16_t index) {
+    const uint16_t count = model->header->class_count;
+    // Shifting by the largest logit keeps every exponent at or below 0
+    float largest = scores[0];
+    for (uint16_t c = 1; c < count; c++) {
+        if (scores[c] > largest) {
+            largest = scores[c];
+        }
+    }
+    const float inv_temperature = 1.0f / model->header->temperature;
+    float total = 0.0f;
+    for (uint16_t c = 0; c < count; c++) {
+        total += expf((scores[c] - largest) * inv_temperature);
+    }
+    return expf((scores[index] - largest) * inv_temperature) / total;
+}
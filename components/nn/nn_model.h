@@ -0,0 +1,241 @@
+/**
+ * @file nn_model.h
+ * @brief Int8 inference of small dense and 1-D convolutional networks
+ * from a model blob that is used in place.
+ *
+ * nn_partition.c maps the blob out of flash on the device.
+ *
+ * Weights are int8 with one scale per output channel, activations are
+ * int8 with one scale and zero point per tensor, and every layer
+ * accumulates in int32 and rescales with a fixed-point multiplier, so
+ * inference does no floating point between the input and the output.
+ * Activations live in an arena the caller provides. Its layout is
+ * planned when the model is loaded, so running a model never allocates.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief First word of a model blob, "SMNN" read as little endian.
+ */
+/* @[declare_nn_magic] */
+#define NN_MAGIC 0x4E4E4D53
+/* @[declare_nn_magic] */
+
+/**
+ * @brief Blob layout version this code reads.
+ */
+/* @[declare_nn_version] */
+#define NN_VERSION 2
+/* @[declare_nn_version] */
+
+/**
+ * @brief Bytes reserved per class name, including the terminator.
+ */
+/* @[declare_nn_label_len] */
+#define NN_LABEL_LEN 24
+/* @[declare_nn_label_len] */
+
+/**
+ * @brief Largest network the runtime keeps room for.
+ */
+/* @[declare_nn_max_layers] */
+#define NN_MAX_LAYERS 16
+#define NN_MAX_CLASSES 32
+/* @[declare_nn_max_layers] */
+
+/**
+ * @brief What a layer computes.
+ *
+ * Tensors are laid out steps first, channels last, `[len][channels]`.
+ * A dense layer is a convolution whose kernel spans the whole input, so
+ * both run the same kernel.
+ */
+/* @[declare_nn_layer_type_t] */
+typedef enum {
+    NN_DENSE = 0,       /**< Every output sees the whole input, flattened. */
+    NN_CONV1D = 1,      /**< Valid convolution along the steps. */
+} nn_layer_type_t;
+/* @[declare_nn_layer_type_t] */
+
+/**
+ * @brief Activation fused into a layer's output.
+ */
+/* @[declare_nn_activation_t] */
+typedef enum {
+    NN_ACT_NONE = 0,
+    NN_ACT_RELU = 1,
+} nn_activation_t;
+/* @[declare_nn_activation_t] */
+
+/**
+ * @brief Start of a model blob. All fields are little endian.
+ *
+ * The header is followed, each part 4-byte aligned, by:
+ * 1. `char labels[class_count][NN_LABEL_LEN]`
+ * 2. `float mean[input_len * input_channels]` and `float inv_std[...]`,
+ *    the standardisation applied to the input before quantising it
+ * 3. `layer_count` layers, each an nn_layer_t and its parameters
+ */
+/* @[declare_nn_header_t] */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t layer_count;
+    uint16_t input_len;
+    uint16_t input_channels;
+    uint16_t class_count;
+    uint16_t reserved;
+    uint32_t size;          // of the whole blob
+    float temperature;      // divides the logits in nn_model_confidence()
+} nn_header_t;
+/* @[declare_nn_header_t] */
+
+/**
+ * @brief Start of one layer in a blob.
+ *
+ * A real value is `scale * (q - zero)`. The header is followed, each
+ * part 4-byte aligned, by:
+ * 1. `int32_t bias[out_channels]`, in units of `in_scale * weight_scale`
+ *    and with `-in_zero * sum(weights)` folded in, so the kernel never
+ *    subtracts the input zero point
+ * 2. `int32_t multiplier[out_channels]`
+ * 3. `float weight_scale[out_channels]`, only used by nn_reference.h
+ * 4. `int8_t shift[out_channels]`, so that `multiplier * 2^-shift` is
+ *    `in_scale * weight_scale / out_scale`
+ * 5. `int8_t weights[out_channels][kernel][in_channels]`
+ */
+/* @[declare_nn_layer_t] */
+typedef struct {
+    uint16_t type;
+    uint16_t activation;
+    uint16_t in_len;
+    uint16_t in_channels;
+    uint16_t out_len;
+    uint16_t out_channels;
+    uint16_t kernel;        // steps, in_len for a dense layer
+    uint16_t stride;
+    float in_scale;
+    int32_t in_zero;
+    float out_scale;
+    int32_t out_zero;
+    uint32_t size;          // of the layer and its parameters
+} nn_layer_t;
+/* @[declare_nn_layer_t] */
+
+/**
+ * @brief A layer's parameters, pointing into the blob.
+ */
+/* @[declare_nn_layer_view_t] */
+typedef struct {
+    const nn_layer_t *layer;
+    const int32_t *bias;
+    const int32_t *multiplier;
+    const int8_t *shift;
+    const float *weight_scale;
+    const int8_t *weights;
+} nn_layer_view_t;
+/* @[declare_nn_layer_view_t] */
+
+/**
+ * @brief A loaded model. The parameters point into the blob, nothing is
+ * copied, so the blob has to stay mapped while the model is in use. The
+ * activations go in the arena given to nn_model_load().
+ */
+/* @[declare_nn_model_t] */
+typedef struct {
+    const nn_header_t *header;
+    const char (*labels)[NN_LABEL_LEN];
+    const float *mean;
+    const float *inv_std;
+    nn_layer_view_t layers[NN_MAX_LAYERS];
+    int8_t *arena;
+    uint32_t tensor_offset[NN_MAX_LAYERS + 1];     // input, then each layer's output
+} nn_model_t;
+/* @[declare_nn_model_t] */
+
+/**
+ * @brief Arena a blob needs to run.
+ *
+ * Each layer only reads its input and writes its output, so tensors
+ * alternate between two regions, each as large as the largest tensor
+ * that lands in it.
+ *
+ * @param[in] blob The blob, 4-byte aligned.
+ * @param[in] size Bytes available at `blob`.
+ * @return Bytes, or 0 if the blob is malformed, truncated or of another
+ * version.
+ */
+/* @[declare_nn_arena_size] */
+size_t nn_arena_size(const void *blob, size_t size);
+/* @[declare_nn_arena_size] */
+
+/**
+ * @brief Checks a blob, points a model at its layers and plans the
+ * activations in an arena.
+ *
+ * **Example:**
+ * @code{c}
+ *  static nn_model_t model;
+ *  static int8_t arena[8192];
+ *  float scores[NN_MAX_CLASSES];
+ *  if (nn_model_load(&model, blob, blob_size, arena, sizeof(arena)) == 0) {
+ *      int best = nn_model_run(&model, features, scores);
+ *      printf("%s\n", model.labels[best]);
+ *  }
+ * @endcode
+ *
+ * @param[out] model The model.
+ * @param[in] blob The blob, 4-byte aligned.
+ * @param[in] size Bytes available at `blob`, may be more than the blob.
+ * @param[in] arena Room for the activations, kept by the model.
+ * @param[in] arena_size Bytes at `arena`, at least nn_arena_size().
+ * @return 0 on success, -1 if the blob is malformed, truncated or of
+ * another version, or the arena is too small.
+ */
+/* @[declare_nn_model_load] */
+int nn_model_load(nn_model_t *model, const void *blob, size_t size, int8_t *arena, size_t arena_size);
+/* @[declare_nn_model_load] */
+
+/**
+ * @brief Runs the network on one input.
+ *
+ * Does not allocate. Only one task may run a model at a time, as they
+ * share the arena.
+ *
+ * @param[in] model A loaded model.
+ * @param[in] input `input_len * input_channels` raw, unstandardised
+ * values, steps first. Values beyond the input's int8 range saturate;
+ * a NaN reads as the lowest.
+ * @param[out] scores `class_count` logits, dequantised. May be NULL.
+ * @return Index of the highest scoring class.
+ */
+/* @[declare_nn_model_run] */
+int nn_model_run(const nn_model_t *model, const float *input, float *scores);
+/* @[declare_nn_model_run] */
+
+/**
+ * @brief Calibrated probability of one class from the logits.
+ *
+ * A softmax of the logits divided by the model's temperature, which
+ * tools/smell_nn.py fits to the corpus.
+ *
+ * @param[in] model A loaded model.
+ * @param[in] scores Logits from nn_model_run().
+ * @param[in] index The class to give the probability of.
+ * @return The probability, 0 to 1.
+ */
+/* @[declare_nn_model_confidence] */
+float nn_model_confidence(const nn_model_t *model, const float *scores, uint16_t index);
+/* @[declare_nn_model_confidence] */
+
+#ifdef __cplusplus
+}
+#endif
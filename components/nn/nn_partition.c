@@ -0,0 +1,54 @@
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_partition.h"
+
+#include "nn_partition.h"
+
+#define TAG "NN"
+
+esp_err_t nn_map_partition(nn_model_t *model, const char *label, size_t offset, int8_t *arena, size_t arena_size) {
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (partition == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (offset + sizeof(nn_header_t) > partition->size) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    // Map just the header first so erased flash does not cost a whole
+    // mapping
+    const void *ptr;
+    spi_flash_mmap_handle_t handle;
+    esp_err_t err = esp_partition_mmap(partition, offset, sizeof(nn_header_t), SPI_FLASH_MMAP_DATA, &ptr, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    const nn_header_t *header = (const nn_header_t *)ptr;
+    size_t size = header->magic == NN_MAGIC && header->version == NN_VERSION ? header->size : 0;
+    spi_flash_munmap(handle);
+    if (size < sizeof(nn_header_t) || size > partition->size - offset) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    err = esp_partition_mmap(partition, offset, size, SPI_FLASH_MMAP_DATA, &ptr, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    size_t needed = nn_arena_size(ptr, size);
+    if (needed == 0 || needed > arena_size) {
+        spi_flash_munmap(handle);
+        if (needed != 0) {
+            ESP_LOGW(TAG, "Model needs a %u byte arena, %u given", needed, arena_size);
+        }
+        return needed == 0 ? ESP_ERR_INVALID_VERSION : ESP_ERR_NO_MEM;
+    }
+    if (nn_model_load(model, ptr, size, arena, arena_size) != 0) {
+        spi_flash_munmap(handle);
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    ESP_LOGI(TAG, "Mapped network: %u layers, %u x %u inputs, %u classes, %u bytes, %u byte arena",
+             model->header->layer_count, model->header->input_len, model->header->input_channels,
+             model->header->class_count, size, needed);
+    return ESP_OK;
+}
@@ -0,0 +1,52 @@
+/**
+ * @file nn_partition.h
+ * @brief Maps a network model straight out of a flash partition.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include "esp_err.h"
+
+#include "nn_model.h"
+
+/**
+ * @brief Maps a model blob stored at an offset into a data partition
+ * and loads it.
+ *
+ * The weights are read through the flash cache, so the model takes no
+ * RAM beyond the MMU pages and the arena. The mapping is kept for the
+ * life of the app. Any data partition will do, whatever its subtype, so
+ * the blob can share one with other data.
+ *
+ * **Example:**
+ * @code{c}
+ *  static nn_model_t model;
+ *  static int8_t arena[8192];
+ *  if (nn_map_partition(&model, "spiffs", 0x200000, arena, sizeof(arena)) != ESP_OK) {
+ *      ESP_LOGW(TAG, "No network flashed");
+ *  }
+ * @endcode
+ *
+ * @param[out] model The model.
+ * @param[in] label Name of the partition in the partition table.
+ * @param[in] offset Start of the blob in the partition, a multiple of
+ * the 64 KB MMU page so the mapping wastes none.
+ * @param[in] arena Room for the activations, see nn_model_load().
+ * @param[in] arena_size Bytes at `arena`.
+ * @return `ESP_OK`, `ESP_ERR_NOT_FOUND` if there is no such partition,
+ * `ESP_ERR_INVALID_VERSION` if it does not hold a model this code can
+ * read, or `ESP_ERR_NO_MEM` if the arena is too small for it.
+ */
+/* @[declare_nn_map_partition] */
+esp_err_t nn_map_partition(nn_model_t *model, const char *label, size_t offset, int8_t *arena, size_t arena_size);
+/* @[declare_nn_map_partition] */
+
+#ifdef __cplusplus
+}
+#endif
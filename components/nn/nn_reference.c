@@ -0,0 +1,103 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "nn_reference.h"
+
+int nn_reference_init(nn_reference_t *reference, const nn_model_t *model) {
+    memset(reference, 0, sizeof(nn_reference_t));
+    reference->model = model;
+
+    const nn_header_t *header = model->header;
+    size_t largest = (size_t)header->input_len * header->input_channels;
+    for (uint16_t i = 0; i < header->layer_count; i++) {
+        const nn_layer_view_t *view = &model->layers[i];
+        const nn_layer_t *layer = view->layer;
+        const size_t row = (size_t)layer->kernel * layer->in_channels;
+        const size_t out_size = (size_t)layer->out_len * layer->out_channels;
+        if (out_size > largest) {
+            largest = out_size;
+        }
+
+        reference->weights[i] = (float *)malloc(layer->out_channels * row * sizeof(float));
+        reference->bias[i] = (float *)malloc(layer->out_channels * sizeof(float));
+        if (reference->weights[i] == NULL || reference->bias[i] == NULL) {
+            nn_reference_free(reference);
+            return -1;
+        }
+        for (uint16_t c = 0; c < layer->out_channels; c++) {
+            const float scale = view->weight_scale[c];
+            const int8_t *w = view->weights + c * row;
+            // Unfold the input zero point the converter folded into the bias
+            int32_t sum = 0;
+            for (size_t j = 0; j < row; j++) {
+                reference->weights[i][c * row + j] = scale * w[j];
+                sum += w[j];
+            }
+            reference->bias[i][c] = (float)(view->bias[c] + (int64_t)layer->in_zero * sum) * layer->in_scale * scale;
+        }
+    }
+
+    for (int b = 0; b < 2; b++) {
+        reference->buffers[b] = (float *)malloc(largest * sizeof(float));
+        if (reference->buffers[b] == NULL) {
+            nn_reference_free(reference);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void nn_reference_free(nn_reference_t *reference) {
+    for (int i = 0; i < NN_MAX_LAYERS; i++) {
+        free(reference->weights[i]);
+        free(reference->bias[i]);
+    }
+    free(reference->buffers[0]);
+    free(reference->buffers[1]);
+    memset(reference, 0, sizeof(nn_reference_t));
+}
+
+static void run_layer(const nn_layer_t *layer, const float *restrict weights, const float *restrict bias,
+                      const float *restrict in, float *restrict out) {
+    const size_t row = (size_t)layer->kernel * layer->in_channels;
+    const size_t step = (size_t)layer->stride * layer->in_channels;
+    for (uint16_t t = 0; t < layer->out_len; t++) {
+        const float *window = in + t * step;
+        float *o = out + (size_t)t * layer->out_channels;
+        for (uint16_t c = 0; c < layer->out_channels; c++) {
+            const float *w = weights + c * row;
+            float acc = bias[c];
+            for (size_t j = 0; j < row; j++) {
+                acc += w[j] * window[j];
+            }
+            o[c] = layer->activation == NN_ACT_RELU && acc < 0.0f ? 0.0f : acc;
+        }
+    }
+}
+
+int nn_reference_run(const nn_reference_t *reference, const float *input, float *scores) {
+    const nn_model_t *model = reference->model;
+    const nn_header_t *header = model->header;
+    const size_t input_size = (size_t)header->input_len * header->input_channels;
+
+    float *x = reference->buffers[0];
+    for (size_t i = 0; i < input_size; i++) {
+        x[i] = (input[i] - model->mean[i]) * model->inv_std[i];
+    }
+    for (uint16_t i = 0; i < header->layer_count; i++) {
+        run_layer(model->layers[i].layer, reference->weights[i], reference->bias[i],
+                  reference->buffers[i & 1], reference->buffers[(i + 1) & 1]);
+    }
+
+    const float *out = reference->buffers[header->layer_count & 1];
+    int best = 0;
+    for (uint16_t c = 0; c < header->class_count; c++) {
+        if (scores != NULL) {
+            scores[c] = out[c];
+        }
+        if (out[c] > out[best]) {
+            best = c;
+        }
+    }
+    return best;
+}
@@ -0,0 +1,68 @@
+/**
+ * @file nn_reference.h
+ * @brief The same network as an nn_model_t, run in float.
+ *
+ * The weights are dequantised once into the heap, and the activations
+ * are never quantised, so the only difference from the float network
+ * that was trained is the rounding of the weights. Comparing the two
+ * runtimes on the same inputs measures what int8 activations cost in
+ * accuracy and gain in speed.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "nn_model.h"
+
+/**
+ * @brief A float copy of a loaded model.
+ */
+/* @[declare_nn_reference_t] */
+typedef struct {
+    const nn_model_t *model;
+    float *weights[NN_MAX_LAYERS];
+    float *bias[NN_MAX_LAYERS];
+    float *buffers[2];      // ping-pong activations
+} nn_reference_t;
+/* @[declare_nn_reference_t] */
+
+/**
+ * @brief Dequantises a loaded model.
+ *
+ * **Example:**
+ * @code{c}
+ *  nn_reference_t reference;
+ *  if (nn_reference_init(&reference, &model) == 0) {
+ *      int best = nn_reference_run(&reference, features, scores);
+ *      nn_reference_free(&reference);
+ *  }
+ * @endcode
+ *
+ * @param[out] reference The float model.
+ * @param[in] model A loaded model, which has to outlive `reference`.
+ * @return 0 on success, -1 if allocation failed.
+ */
+/* @[declare_nn_reference_init] */
+int nn_reference_init(nn_reference_t *reference, const nn_model_t *model);
+/* @[declare_nn_reference_init] */
+
+/**
+ * @brief Frees what nn_reference_init() allocated.
+ */
+/* @[declare_nn_reference_free] */
+void nn_reference_free(nn_reference_t *reference);
+/* @[declare_nn_reference_free] */
+
+/**
+ * @brief Runs the network in float, as nn_model_run().
+ */
+/* @[declare_nn_reference_run] */
+int nn_reference_run(const nn_reference_t *reference, const float *input, float *scores);
+/* @[declare_nn_reference_run] */
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,59 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "pipeline_stage.h"
+
+void pipeline_stage_init(pipeline_stage_t *stage, const char *name, const spsc_queue_t *input) {
+    memset(stage, 0, sizeof(pipeline_stage_t));
+    stage->name = name;
+    stage->input = input;
+    atomic_init(&stage->items, 0);
+    atomic_init(&stage->wait_max_us, 0);
+    atomic_init(&stage->busy_last_us, 0);
+    atomic_init(&stage->busy_max_us, 0);
+    atomic_init(&stage->wait_avg_x16, 0);
+    atomic_init(&stage->busy_avg_x16, 0);
+}
+
+// The stage's task is the only writer, so a relaxed load and store are
+// enough and no read-modify-write is needed
+static void raise_max(_Atomic uint32_t *max, uint32_t value) {
+    if (value > atomic_load_explicit(max, memory_order_relaxed)) {
+        atomic_store_explicit(max, value, memory_order_relaxed);
+    }
+}
+
+// avg += (value - avg) / 16, in 1/16 us so small latencies keep their
+// fraction. The first item starts the average.
+static void average(_Atomic uint32_t *avg_x16, uint32_t value, uint32_t items) {
+    const int64_t value_x16 = (int64_t)(value > UINT32_MAX / 16 ? UINT32_MAX / 16 : value) * 16;
+    const int64_t avg = items == 0 ? value_x16 : atomic_load_explicit(avg_x16, memory_order_relaxed);
+    atomic_store_explicit(avg_x16, (uint32_t)(avg + (value_x16 - avg) / 16), memory_order_relaxed);
+}
+
+void pipeline_stage_record(pipeline_stage_t *stage, uint32_t wait_us, uint32_t busy_us) {
+    raise_max(&stage->wait_max_us, wait_us);
+    raise_max(&stage->busy_max_us, busy_us);
+    atomic_store_explicit(&stage->busy_last_us, busy_us, memory_order_relaxed);
+    const uint32_t items = atomic_load_explicit(&stage->items, memory_order_relaxed);
+    average(&stage->wait_avg_x16, wait_us, items);
+    average(&stage->busy_avg_x16, busy_us, items);
+    atomic_store_explicit(&stage->items, items + 1, memory_order_relaxed);
+}
+
+void pipeline_stage_read(const pipeline_stage_t *stage, pipeline_stage_stats_t *stats) {
+    memset(stats, 0, sizeof(pipeline_stage_stats_t));
+    stats->name = stage->name;
+    stats->items = atomic_load_explicit(&stage->items, memory_order_relaxed);
+    stats->wait_max_us = atomic_load_explicit(&stage->wait_max_us, memory_order_relaxed);
+    stats->busy_last_us = atomic_load_explicit(&stage->busy_last_us, memory_order_relaxed);
+    stats->busy_max_us = atomic_load_explicit(&stage->busy_max_us, memory_order_relaxed);
+    stats->wait_mean_us = (atomic_load_explicit(&stage->wait_avg_x16, memory_order_relaxed) + 8) / 16;
+    stats->busy_mean_us = (atomic_load_explicit(&stage->busy_avg_x16, memory_order_relaxed) + 8) / 16;
+    if (stage->input != NULL) {
+        stats->depth = spsc_queue_depth(stage->input);
+        stats->high_water = spsc_queue_high_water(stage->input);
+        stats->capacity = spsc_queue_capacity(stage->input);
+        stats->dropped = spsc_queue_dropped(stage->input);
+    }
+}
@@ -0,0 +1,96 @@
+/**
+ * @file pipeline_stage.h
+ * @brief Counters for one stage of a pipeline of tasks joined by
+ * spsc_queue_t, readable from any core while the stage runs.
+ *
+ * Times are in microseconds from whatever clock the caller uses.
+ *
+ * Each item a stage handles is timed twice: how long it waited in the
+ * stage's input queue, and how long the stage then spent on it. Means
+ * are moving averages with a weight of 1/16 per item, so they follow
+ * the recent load and never overflow however long the device runs. All
+ * counters are 32 bits, which every core loads and stores whole. Only the
+ * stage's own task records, so every counter has a single writer and
+ * needs no lock; a reader on another core may see one item's counters
+ * half updated, which is fine for monitoring.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "spsc_queue.h"
+
+/**
+ * @brief A stage. Treat the fields as private.
+ */
+/* @[declare_pipeline_stage_t] */
+typedef struct {
+    const char *name;
+    const spsc_queue_t *input;      // NULL for a stage fed by something else
+    _Atomic uint32_t items;
+    _Atomic uint32_t wait_max_us;
+    _Atomic uint32_t busy_last_us;
+    _Atomic uint32_t busy_max_us;
+    _Atomic uint32_t wait_avg_x16;  // moving averages, in 1/16 us
+    _Atomic uint32_t busy_avg_x16;
+} pipeline_stage_t;
+/* @[declare_pipeline_stage_t] */
+
+/**
+ * @brief A snapshot of a stage's counters and its input queue.
+ */
+/* @[declare_pipeline_stage_stats_t] */
+typedef struct {
+    /*@{*/
+    const char *name;
+    uint32_t items;             /**< @brief Items handled. */
+    uint32_t wait_mean_us;      /**< @brief Recent mean time an item sat in the input queue. */
+    uint32_t wait_max_us;
+    uint32_t busy_last_us;      /**< @brief Time spent on the latest item. */
+    uint32_t busy_mean_us;      /**< @brief Recent mean time spent on an item. */
+    uint32_t busy_max_us;
+    uint32_t depth;             /**< @brief Items in the input queue now, 0 without one. */
+    uint32_t high_water;        /**< @brief Deepest the input queue has been. */
+    uint32_t capacity;
+    uint32_t dropped;           /**< @brief Items lost because the input queue was full. */
+    /*@}*/
+} pipeline_stage_stats_t;
+/* @[declare_pipeline_stage_stats_t] */
+
+/**
+ * @brief Sets up a stage with zeroed counters.
+ *
+ * @param[out] stage The stage.
+ * @param[in] name Kept, not copied.
+ * @param[in] input The queue the stage consumes, or NULL.
+ */
+/* @[declare_pipeline_stage_init] */
+void pipeline_stage_init(pipeline_stage_t *stage, const char *name, const spsc_queue_t *input);
+/* @[declare_pipeline_stage_init] */
+
+/**
+ * @brief Counts one item. Only the stage's own task may call this.
+ *
+ * @param[in] wait_us Time from the push to the pop.
+ * @param[in] busy_us Time from the pop to the item being done.
+ */
+/* @[declare_pipeline_stage_record] */
+void pipeline_stage_record(pipeline_stage_t *stage, uint32_t wait_us, uint32_t busy_us);
+/* @[declare_pipeline_stage_record] */
+
+/**
+ * @brief Reads a stage's counters. Safe from any task or core.
+ */
+/* @[declare_pipeline_stage_read] */
+void pipeline_stage_read(const pipeline_stage_t *stage, pipeline_stage_stats_t *stats);
+/* @[declare_pipeline_stage_read] */
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,72 @@
+#include <string.h>
+
+#include "spsc_queue.h"
+
+int spsc_queue_init(spsc_queue_t *queue, void *storage, uint32_t item_size, uint32_t capacity) {
+    if (queue == NULL || storage == NULL || item_size == 0 || capacity == 0 || (capacity & (capacity - 1)) != 0) {
+        return -1;
+    }
+    memset(queue, 0, sizeof(spsc_queue_t));
+    queue->slots = storage;
+    queue->item_size = item_size;
+    queue->mask = capacity - 1;
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    atomic_init(&queue->high_water, 0);
+    atomic_init(&queue->dropped, 0);
+    return 0;
+}
+
+bool spsc_queue_push(spsc_queue_t *queue, const void *item) {
+    // Indices run freely and wrap at 2^32, which a power-of-two capacity
+    // divides, so head - tail is the depth even across the wrap
+    const uint32_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    // Acquire, so the consumer is done with a slot before it is reused
+    const uint32_t depth = head - atomic_load_explicit(&queue->tail, memory_order_acquire);
+    if (depth > queue->mask) {
+        atomic_fetch_add_explicit(&queue->dropped, 1, memory_order_relaxed);
+        return false;
+    }
+
+    memcpy(&queue->slots[(size_t)(head & queue->mask) * queue->item_size], item, queue->item_size);
+    // Publishes the slot's contents along with the new head
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+
+    // Only the producer raises it, so a plain load and store will do
+    if (depth + 1 > atomic_load_explicit(&queue->high_water, memory_order_relaxed)) {
+        atomic_store_explicit(&queue->high_water, depth + 1, memory_order_relaxed);
+    }
+    return true;
+}
+
+bool spsc_queue_pop(spsc_queue_t *queue, void *item) {
+    const uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    if (tail == atomic_load_explicit(&queue->head, memory_order_acquire)) {
+        return false;
+    }
+
+    memcpy(item, &queue->slots[(size_t)(tail & queue->mask) * queue->item_size], queue->item_size);
+    // Hands the slot back only once it has been copied out
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+uint32_t spsc_queue_depth(const spsc_queue_t *queue) {
+    // Tail first: it never passes head, so the difference can not go
+    // negative even when both move between the loads
+    const uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    const uint32_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    return head - tail;
+}
+
+uint32_t spsc_queue_high_water(const spsc_queue_t *queue) {
+    return atomic_load_explicit(&queue->high_water, memory_order_relaxed);
+}
+
+uint32_t spsc_queue_dropped(const spsc_queue_t *queue) {
+    return atomic_load_explicit(&queue->dropped, memory_order_relaxed);
+}
+
+uint32_t spsc_queue_capacity(const spsc_queue_t *queue) {
+    return queue->mask + 1;
+}
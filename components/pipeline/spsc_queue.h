@@ -0,0 +1,122 @@
+/**
+ * @file spsc_queue.h
+ * @brief Lock-free queue of fixed-size items between one producer and
+ * one consumer, which may run on different cores.
+ *
+ * Neither side ever blocks or takes a lock, only C11 atomics: a push
+ * into a full queue fails and is counted as a drop, a pop from an empty
+ * queue fails.
+ * How the consumer waits for work (a task notification on the device, a
+ * short sleep on the host) is up to the caller.
+ *
+ * The head is only written by the producer and the tail only by the
+ * consumer, each on its own cache line, so the two sides only ever read
+ * what the other writes.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Bytes between the producer's and the consumer's fields, so they
+ * do not share a cache line on a host.
+ */
+#define SPSC_QUEUE_LINE 64
+
+/**
+ * @brief Bytes of storage a queue of `capacity` items needs.
+ */
+/* @[declare_spsc_queue_storage_size] */
+#define SPSC_QUEUE_STORAGE_SIZE(item_size, capacity) ((item_size) * (capacity))
+/* @[declare_spsc_queue_storage_size] */
+
+/**
+ * @brief A queue. Treat the fields as private, and read the counters
+ * with the functions below from either side.
+ */
+/* @[declare_spsc_queue_t] */
+typedef struct {
+    uint8_t *slots;
+    uint32_t item_size;
+    uint32_t mask;              // capacity - 1
+
+    _Alignas(SPSC_QUEUE_LINE) _Atomic uint32_t head;   // next slot to write
+    _Atomic uint32_t high_water;
+    _Atomic uint32_t dropped;
+
+    _Alignas(SPSC_QUEUE_LINE) _Atomic uint32_t tail;   // next slot to read
+} spsc_queue_t;
+/* @[declare_spsc_queue_t] */
+
+/**
+ * @brief Sets up an empty queue over caller-owned storage.
+ *
+ * @param[out] queue The queue.
+ * @param[in] storage SPSC_QUEUE_STORAGE_SIZE(item_size, capacity) bytes,
+ * aligned for the item type. Must outlive the queue.
+ * @param[in] item_size Bytes per item.
+ * @param[in] capacity Items the queue holds, a power of two.
+ *
+ * @return 0 on success, -1 if an argument is invalid.
+ */
+/* @[declare_spsc_queue_init] */
+int spsc_queue_init(spsc_queue_t *queue, void *storage, uint32_t item_size, uint32_t capacity);
+/* @[declare_spsc_queue_init] */
+
+/**
+ * @brief Copies an item in. Producer side only.
+ *
+ * @return false, counting a drop, if the queue is full.
+ */
+/* @[declare_spsc_queue_push] */
+bool spsc_queue_push(spsc_queue_t *queue, const void *item);
+/* @[declare_spsc_queue_push] */
+
+/**
+ * @brief Copies the oldest item out. Consumer side only.
+ *
+ * @return false if the queue is empty.
+ */
+/* @[declare_spsc_queue_pop] */
+bool spsc_queue_pop(spsc_queue_t *queue, void *item);
+/* @[declare_spsc_queue_pop] */
+
+/**
+ * @brief Items waiting. Exact from either side, a snapshot from anywhere
+ * else.
+ */
+/* @[declare_spsc_queue_depth] */
+uint32_t spsc_queue_depth(const spsc_queue_t *queue);
+/* @[declare_spsc_queue_depth] */
+
+/**
+ * @brief Deepest the queue has been since it was set up.
+ */
+/* @[declare_spsc_queue_high_water] */
+uint32_t spsc_queue_high_water(const spsc_queue_t *queue);
+/* @[declare_spsc_queue_high_water] */
+
+/**
+ * @brief Pushes refused because the queue was full.
+ */
+/* @[declare_spsc_queue_dropped] */
+uint32_t spsc_queue_dropped(const spsc_queue_t *queue);
+/* @[declare_spsc_queue_dropped] */
+
+/**
+ * @brief Items the queue holds.
+ */
+/* @[declare_spsc_queue_capacity] */
+uint32_t spsc_queue_capacity(const spsc_queue_t *queue);
+/* @[declare_spsc_queue_capacity] */
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,248 @@
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "recording.h"
+
+_Static_assert(sizeof(recording_header_t) == 72, "recording_header_t must match the file layout");
+_Static_assert(sizeof(recording_channel_t) == 16, "recording_channel_t must match the file layout");
+_Static_assert(sizeof(recording_block_t) == 8, "recording_block_t must match the file layout");
+
+// CRC-32 (IEEE, reflected), a nibble at a time: a 64 byte table instead
+// of 1 KB, and blocks are short
+static uint32_t crc32(const uint8_t *data, size_t size) {
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+static int32_t quantise(float value, float scale) {
+    const float scaled = value * scale;
+    if (scaled != scaled) {
+        return 0;
+    }
+    if (scaled >= (float)RECORDING_CODE_LIMIT) {
+        return RECORDING_CODE_LIMIT;
+    }
+    if (scaled <= -(float)RECORDING_CODE_LIMIT) {
+        return -RECORDING_CODE_LIMIT;
+    }
+    return (int32_t)lrintf(scaled);
+}
+
+static size_t put_varint(uint8_t *out, int32_t delta) {
+    // Zig-zag: 0, -1, 1, -2, ... become 0, 1, 2, 3, ...
+    uint32_t value = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+static int get_varint(const uint8_t *data, size_t end, size_t *offset, int32_t *delta) {
+    uint32_t value = 0;
+    for (int shift = 0; shift < 7 * RECORDING_MAX_VARINT; shift += 7) {
+        if (*offset >= end) {
+            return -1;
+        }
+        const uint8_t byte = data[(*offset)++];
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            *delta = (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int recording_encoder_begin(recording_encoder_t *encoder, const recording_header_t *header,
+                            const recording_channel_t *channels, uint16_t block_samples,
+                            uint8_t *out, size_t capacity) {
+    if (encoder == NULL || header == NULL || channels == NULL || out == NULL || header->channel_count == 0 ||
+        header->channel_count > RECORDING_MAX_CHANNELS || block_samples == 0 ||
+        (size_t)block_samples * header->channel_count * RECORDING_MAX_VARINT > UINT16_MAX ||
+        capacity < RECORDING_HEADER_SIZE(header->channel_count)) {
+        return -1;
+    }
+    for (int c = 0; c < header->channel_count; c++) {
+        if (!(channels[c].resolution > 0.0f) || isinf(channels[c].resolution)) {
+            return -1;
+        }
+    }
+
+    memset(encoder, 0, sizeof(recording_encoder_t));
+    encoder->out = out;
+    encoder->capacity = capacity;
+    encoder->block_samples = block_samples;
+    encoder->channel_count = header->channel_count;
+    for (int c = 0; c < header->channel_count; c++) {
+        encoder->scale[c] = 1.0f / channels[c].resolution;
+    }
+
+    recording_header_t copy = *header;
+    copy.magic = RECORDING_MAGIC;
+    copy.version = RECORDING_VERSION;
+    copy.serial[RECORDING_SERIAL_LEN - 1] = '\0';
+    copy.label[RECORDING_LABEL_LEN - 1] = '\0';
+    memcpy(out, &copy, sizeof(recording_header_t));
+    memcpy(out + sizeof(recording_header_t), channels, header->channel_count * sizeof(recording_channel_t));
+    encoder->length = RECORDING_HEADER_SIZE(header->channel_count);
+    return 0;
+}
+
+// Fills in the open block's header now its payload is known
+static void close_block(recording_encoder_t *encoder) {
+    const size_t payload = encoder->length - encoder->block - sizeof(recording_block_t);
+    const recording_block_t block = {
+        .sample_count = encoder->in_block,
+        .payload_size = (uint16_t)payload,
+        .crc = crc32(encoder->out + encoder->block + sizeof(recording_block_t), payload),
+    };
+    memcpy(encoder->out + encoder->block, &block, sizeof(recording_block_t));
+    encoder->block = 0;
+    encoder->in_block = 0;
+}
+
+int recording_encoder_add(recording_encoder_t *encoder, const float *values) {
+    if (encoder->full) {
+        return -1;
+    }
+    // Checked against the longest the sample could take, so a sample is
+    // either stored whole or not at all
+    const size_t need = (encoder->in_block == 0 ? sizeof(recording_block_t) : 0)
+        + (size_t)encoder->channel_count * RECORDING_MAX_VARINT;
+    if (encoder->capacity - encoder->length < need) {
+        encoder->full = true;
+        return -1;
+    }
+
+    if (encoder->in_block == 0) {
+        encoder->block = encoder->length;
+        encoder->length += sizeof(recording_block_t);
+        memset(encoder->previous, 0, sizeof(encoder->previous));
+    }
+    for (int c = 0; c < encoder->channel_count; c++) {
+        const int32_t code = quantise(values[c], encoder->scale[c]);
+        encoder->length += put_varint(encoder->out + encoder->length, code - encoder->previous[c]);
+        encoder->previous[c] = code;
+    }
+    encoder->samples++;
+    if (++encoder->in_block == encoder->block_samples) {
+        close_block(encoder);
+    }
+    return 0;
+}
+
+size_t recording_encoder_finish(recording_encoder_t *encoder) {
+    if (encoder->in_block > 0) {
+        close_block(encoder);
+    }
+    return encoder->length;
+}
+
+int recording_set_label(uint8_t *data, size_t size, const char *label) {
+    uint32_t magic;
+    if (data == NULL || label == NULL || size < sizeof(recording_header_t)) {
+        return -1;
+    }
+    memcpy(&magic, data + offsetof(recording_header_t, magic), sizeof(magic));
+    if (magic != RECORDING_MAGIC) {
+        return -1;
+    }
+    char *field = (char *)data + offsetof(recording_header_t, label);
+    memset(field, 0, RECORDING_LABEL_LEN);
+    strncpy(field, label, RECORDING_LABEL_LEN - 1);
+    return 0;
+}
+
+int recording_decoder_open(recording_decoder_t *decoder, const uint8_t *data, size_t size) {
+    if (decoder == NULL || data == NULL || size < sizeof(recording_header_t)) {
+        return -1;
+    }
+    memset(decoder, 0, sizeof(recording_decoder_t));
+    memcpy(&decoder->header, data, sizeof(recording_header_t));
+    const recording_header_t *header = &decoder->header;
+    if (header->magic != RECORDING_MAGIC || header->version != RECORDING_VERSION || header->channel_count == 0 ||
+        header->channel_count > RECORDING_MAX_CHANNELS || size < RECORDING_HEADER_SIZE(header->channel_count)) {
+        return -1;
+    }
+    decoder->header.serial[RECORDING_SERIAL_LEN - 1] = '\0';
+    decoder->header.label[RECORDING_LABEL_LEN - 1] = '\0';
+    memcpy(decoder->channels, data + sizeof(recording_header_t), header->channel_count * sizeof(recording_channel_t));
+    for (int c = 0; c < header->channel_count; c++) {
+        decoder->channels[c].name[RECORDING_NAME_LEN - 1] = '\0';
+    }
+
+    decoder->data = data;
+    decoder->size = size;
+    decoder->offset = RECORDING_HEADER_SIZE(header->channel_count);
+    return 0;
+}
+
+// Moves to the next block with a good CRC and at least one sample
+static int open_block(recording_decoder_t *decoder) {
+    while (decoder->offset < decoder->size) {
+        recording_block_t block;
+        if (decoder->size - decoder->offset < sizeof(recording_block_t)) {
+            return -1;
+        }
+        memcpy(&block, decoder->data + decoder->offset, sizeof(recording_block_t));
+        const size_t payload = decoder->offset + sizeof(recording_block_t);
+        if (block.payload_size > decoder->size - payload) {
+            return -1;
+        }
+        decoder->offset = payload + block.payload_size;
+        if (crc32(decoder->data + payload, block.payload_size) != block.crc) {
+            decoder->bad_blocks++;
+            decoder->samples += block.sample_count;
+            continue;
+        }
+        if (block.sample_count > 0) {
+            decoder->block_end = decoder->offset;
+            decoder->offset = payload;
+            decoder->block_left = block.sample_count;
+            memset(decoder->previous, 0, sizeof(decoder->previous));
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int recording_decoder_next(recording_decoder_t *decoder, float *values, uint32_t *index) {
+    if (decoder->block_left == 0) {
+        const int opened = open_block(decoder);
+        if (opened <= 0) {
+            return opened;
+        }
+    }
+
+    for (int c = 0; c < decoder->header.channel_count; c++) {
+        int32_t delta;
+        if (get_varint(decoder->data, decoder->block_end, &decoder->offset, &delta) < 0) {
+            return -1;
+        }
+        // Unsigned, so a corrupt delta wraps instead of overflowing
+        decoder->previous[c] = (int32_t)((uint32_t)decoder->previous[c] + (uint32_t)delta);
+        values[c] = (float)decoder->previous[c] * decoder->channels[c].resolution;
+    }
+    if (--decoder->block_left == 0 && decoder->offset != decoder->block_end) {
+        return -1;
+    }
+
+    if (index != NULL) {
+        *index = decoder->samples;
+    }
+    decoder->samples++;
+    return 1;
+}
@@ -0,0 +1,239 @@
+/**
+ * @file recording.h
+ * @brief Compact binary recordings of raw sensor streams: an encoder that
+ * takes one sample of every channel at a time, and a decoder.
+ *
+ * Neither side allocates; the encoder costs O(channels) per sample, so it
+ * can run on the task that takes the samples.
+ *
+ * Each channel is quantised to integer codes of its own resolution, and
+ * each code is stored as its difference from the channel's previous one,
+ * zig-zag mapped so small negative steps stay small, in a LEB128 varint.
+ * A slow gas signal mostly moves a few codes per sample, so a sample of
+ * five channels usually takes five to ten bytes, against about forty as
+ * a CSV line.
+ *
+ * Layout, little-endian:
+ *
+ * 1. `recording_header_t`
+ * 2. `recording_channel_t channels[channel_count]`
+ * 3. Blocks, each a `recording_block_t` then its payload: for every
+ *    sample, one varint per channel. The codes restart from 0 in every
+ *    block, so a block decodes without the ones before it, and its CRC
+ *    tells a damaged block from a good one.
+ *
+ * Samples are evenly spaced: sample n was taken at
+ * start_time_us + n * sample_period_us.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** @brief "SMRS" read as a little-endian uint32_t. */
+#define RECORDING_MAGIC 0x53524D53u
+#define RECORDING_VERSION 1
+#define RECORDING_MAX_CHANNELS 16
+/** @brief Room for an ATECC608 serial string, 18 hex digits. */
+#define RECORDING_SERIAL_LEN 24
+#define RECORDING_LABEL_LEN 24
+#define RECORDING_NAME_LEN 12
+
+/** @brief start_time_us is microseconds since 1970-01-01 UTC, not since boot. */
+#define RECORDING_FLAG_WALL_CLOCK 0x01
+
+/** @brief Largest a code may be, so the difference of two always fits an int32_t. */
+#define RECORDING_CODE_LIMIT ((1 << 30) - 1)
+/** @brief Longest varint of a zig-zag mapped int32_t. */
+#define RECORDING_MAX_VARINT 5
+
+/* @[declare_recording_header_t] */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t channel_count;
+    uint8_t flags;                      // RECORDING_FLAG_*
+    uint32_t sample_period_us;
+    uint32_t reserved;
+    int64_t start_time_us;              // when the first sample was taken
+    char serial[RECORDING_SERIAL_LEN];  // device serial number
+    char label[RECORDING_LABEL_LEN];    // empty if never labelled
+} recording_header_t;
+/* @[declare_recording_header_t] */
+
+/**
+ * @brief One channel: its name and the value of one code.
+ */
+/* @[declare_recording_channel_t] */
+typedef struct {
+    char name[RECORDING_NAME_LEN];
+    float resolution;
+} recording_channel_t;
+/* @[declare_recording_channel_t] */
+
+/* @[declare_recording_block_t] */
+typedef struct {
+    uint16_t sample_count;
+    uint16_t payload_size;
+    uint32_t crc;               // CRC-32 (IEEE) of the payload
+} recording_block_t;
+/* @[declare_recording_block_t] */
+
+/**
+ * @brief Bytes before the first block.
+ */
+/* @[declare_recording_header_size] */
+#define RECORDING_HEADER_SIZE(channels) (sizeof(recording_header_t) + (channels) * sizeof(recording_channel_t))
+/* @[declare_recording_header_size] */
+
+/**
+ * @brief Most bytes a recording of `samples` samples can take, to size
+ * the encoder's buffer.
+ */
+/* @[declare_recording_max_size] */
+#define RECORDING_MAX_SIZE(channels, samples, block_samples)                            \
+    (RECORDING_HEADER_SIZE(channels)                                                    \
+     + (((samples) + (block_samples) - 1) / (block_samples)) * sizeof(recording_block_t) \
+     + (size_t)(samples) * (channels) * RECORDING_MAX_VARINT)
+/* @[declare_recording_max_size] */
+
+/**
+ * @brief An encoder. Treat the fields as private.
+ */
+/* @[declare_recording_encoder_t] */
+typedef struct {
+    uint8_t *out;
+    size_t capacity;
+    size_t length;
+    size_t block;               // offset of the open block's header, 0 if none
+    uint16_t block_samples;
+    uint16_t in_block;
+    uint8_t channel_count;
+    float scale[RECORDING_MAX_CHANNELS];        // 1 / resolution
+    int32_t previous[RECORDING_MAX_CHANNELS];
+    uint32_t samples;
+    bool full;
+} recording_encoder_t;
+/* @[declare_recording_encoder_t] */
+
+/**
+ * @brief A decoder. Treat the fields as private.
+ */
+/* @[declare_recording_decoder_t] */
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    size_t offset;              // next byte to read
+    size_t block_end;
+    uint16_t block_left;        // samples left in the open block
+    recording_header_t header;
+    recording_channel_t channels[RECORDING_MAX_CHANNELS];
+    int32_t previous[RECORDING_MAX_CHANNELS];
+    uint32_t samples;           // decoded so far
+    uint32_t bad_blocks;        // skipped for a bad CRC
+} recording_decoder_t;
+/* @[declare_recording_decoder_t] */
+
+/**
+ * @brief Starts a recording in `out`, writing its header.
+ *
+ * @param[out] encoder The encoder.
+ * @param[in] header Copied in. magic and version are filled in here.
+ * @param[in] channels header->channel_count channels, each with a
+ * positive resolution.
+ * @param[in] block_samples Samples per block, at least 1, and at most
+ * 65535 / (5 * channel_count) so a block's payload fits its uint16_t size.
+ * Shorter blocks lose less to damage and cost 8 bytes each.
+ * @param[out] out Buffer for the whole recording, see RECORDING_MAX_SIZE().
+ * @param[in] capacity Bytes in `out`.
+ *
+ * @return 0 on success, -1 if an argument is invalid or the header does
+ * not fit.
+ */
+/* @[declare_recording_encoder_begin] */
+int recording_encoder_begin(recording_encoder_t *encoder, const recording_header_t *header,
+                            const recording_channel_t *channels, uint16_t block_samples,
+                            uint8_t *out, size_t capacity);
+/* @[declare_recording_encoder_begin] */
+
+/**
+ * @brief Appends one sample of every channel.
+ *
+ * **Example:**
+ * @code{c}
+ * recording_encoder_t encoder;
+ * static uint8_t buffer[RECORDING_MAX_SIZE(5, 32, 32)];
+ * recording_encoder_begin(&encoder, &header, channels, 32, buffer, sizeof(buffer));
+ * for (int n = 0; n < 32; n++) {
+ *     recording_encoder_add(&encoder, values[n]);
+ * }
+ * size_t length = recording_encoder_finish(&encoder);
+ * @endcode
+ *
+ * @param[in] values channel_count values, in the channel's units.
+ * Values past RECORDING_CODE_LIMIT codes are clamped.
+ *
+ * @return 0 on success, -1 if the buffer is full, after which every
+ * later sample is refused too.
+ */
+/* @[declare_recording_encoder_add] */
+int recording_encoder_add(recording_encoder_t *encoder, const float *values);
+/* @[declare_recording_encoder_add] */
+
+/**
+ * @brief Closes the open block.
+ *
+ * @return Bytes of the finished recording in the encoder's buffer.
+ */
+/* @[declare_recording_encoder_finish] */
+size_t recording_encoder_finish(recording_encoder_t *encoder);
+/* @[declare_recording_encoder_finish] */
+
+/**
+ * @brief Sets the label of a finished recording in place.
+ *
+ * @return 0 on success, -1 if `data` is not a recording.
+ */
+/* @[declare_recording_set_label] */
+int recording_set_label(uint8_t *data, size_t size, const char *label);
+/* @[declare_recording_set_label] */
+
+/**
+ * @brief Reads a recording's header and channels.
+ *
+ * @param[out] decoder The decoder; its header and channels fields are
+ * valid on success.
+ * @param[in] data The recording. Must outlive the decoder.
+ *
+ * @return 0 on success, -1 if `data` is not a recording of this version.
+ */
+/* @[declare_recording_decoder_open] */
+int recording_decoder_open(recording_decoder_t *decoder, const uint8_t *data, size_t size);
+/* @[declare_recording_decoder_open] */
+
+/**
+ * @brief Decodes the next sample.
+ *
+ * A block with a bad CRC is skipped and counted in bad_blocks, and the
+ * decoder carries on with the next one.
+ *
+ * @param[out] values channel_count values, in the channel's units.
+ * @param[out] index The sample's number, counting the samples of
+ * skipped blocks, so its time is known. May be NULL.
+ *
+ * @return 1 for a sample, 0 at the end, -1 if the recording is cut short
+ * or a block is malformed.
+ */
+/* @[declare_recording_decoder_next] */
+int recording_decoder_next(recording_decoder_t *decoder, float *values, uint32_t *index);
+/* @[declare_recording_decoder_next] */
+
+#ifdef __cplusplus
+}
+#endif
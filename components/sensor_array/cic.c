@@ -0,0 +1,56 @@
+#include <string.h>
+
+#include "cic.h"
+
+// 16-bit input plus the bit growth must fit the 64-bit integrators
+#define CIC_MAX_GROWTH 48
+
+int cic_init(cic_t *cic, uint8_t order, uint8_t decimation_log2, uint8_t frac_bits) {
+    uint32_t growth = (uint32_t)order * decimation_log2;
+    if (cic == NULL || order == 0 || order > CIC_MAX_ORDER ||
+        decimation_log2 == 0 || decimation_log2 > 16 ||
+        growth > CIC_MAX_GROWTH || frac_bits > growth) {
+        return -1;
+    }
+
+    cic->order = order;
+    cic->decimation_log2 = decimation_log2;
+    cic->shift = growth - frac_bits;
+    cic_reset(cic);
+    return 0;
+}
+
+void cic_reset(cic_t *cic) {
+    cic->phase = 0;
+    memset(cic->integrator, 0, sizeof(cic->integrator));
+    memset(cic->comb_delay, 0, sizeof(cic->comb_delay));
+}
+
+size_t cic_process(cic_t *cic, const uint16_t *in, size_t count, int32_t *out) {
+    const uint32_t ratio_mask = (1UL << cic->decimation_log2) - 1;
+    const uint8_t order = cic->order;
+    size_t written = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        // Integrators run at the input rate, unsigned so wrapping is defined
+        uint64_t acc = in[i];
+        for (uint8_t s = 0; s < order; s++) {
+            cic->integrator[s] += acc;
+            acc = cic->integrator[s];
+        }
+
+        cic->phase = (cic->phase + 1) & ratio_mask;
+        if (cic->phase != 0) {
+            continue;
+        }
+
+        // Combs run at the output rate with a differential delay of one
+        for (uint8_t s = 0; s < order; s++) {
+            uint64_t delayed = cic->comb_delay[s];
+            cic->comb_delay[s] = acc;
+            acc -= delayed;
+        }
+        out[written++] = (int32_t)((int64_t)acc >> cic->shift);
+    }
+    return written;
+}
@@ -0,0 +1,94 @@
+/**
+ * @file cic.h
+ * @brief Fixed-point cascaded integrator-comb decimator.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Highest supported filter order.
+ */
+/* @[declare_cic_max_order] */
+#define CIC_MAX_ORDER 4
+/* @[declare_cic_max_order] */
+
+/**
+ * @brief Filter state. Treat as opaque.
+ *
+ * The integrators are 64 bits wide, which covers a 16-bit input with
+ * order * decimation_log2 up to 48 bits of growth. Overflow in between
+ * is harmless since a CIC only needs modular arithmetic.
+ */
+/* @[declare_cic_t] */
+typedef struct {
+    uint8_t order;
+    uint8_t decimation_log2;
+    uint8_t shift;
+    uint32_t phase;
+    uint64_t integrator[CIC_MAX_ORDER];
+    uint64_t comb_delay[CIC_MAX_ORDER];
+} cic_t;
+/* @[declare_cic_t] */
+
+/**
+ * @brief Sets up a decimator.
+ *
+ * The DC gain of (2^decimation_log2)^order is divided out, leaving
+ * `frac_bits` extra fractional bits on the output. Averaging R samples
+ * of white noise buys log2(R) / 2 bits, so frac_bits is usually about
+ * half of decimation_log2.
+ *
+ * **Example:**
+ *
+ * Turn 8 kHz ADC samples into 31.25 Hz with 4 fractional bits.
+ * @code{c}
+ *  cic_t cic;
+ *  cic_init(&cic, 3, 8, 4);
+ *  int32_t out[2];
+ *  size_t n = cic_process(&cic, raw, 512, out);  // n == 2
+ *  // out[i] / 16.0 is in raw ADC counts
+ * @endcode
+ *
+ * @param[out] cic The filter to initialize.
+ * @param[in] order Number of integrator/comb stages, 1 to CIC_MAX_ORDER.
+ * @param[in] decimation_log2 log2 of the decimation ratio.
+ * @param[in] frac_bits Fractional bits to keep on the output.
+ * @return 0 on success, -1 for an unsupported combination.
+ */
+/* @[declare_cic_init] */
+int cic_init(cic_t *cic, uint8_t order, uint8_t decimation_log2, uint8_t frac_bits);
+/* @[declare_cic_init] */
+
+/**
+ * @brief Clears the filter history without changing its settings.
+ */
+/* @[declare_cic_reset] */
+void cic_reset(cic_t *cic);
+/* @[declare_cic_reset] */
+
+/**
+ * @brief Filters a block of samples.
+ *
+ * Blocks do not need to be a multiple of the decimation ratio; the
+ * phase carries over to the next call.
+ *
+ * @param[in] cic The filter.
+ * @param[in] in Input samples.
+ * @param[in] count Number of input samples.
+ * @param[out] out Room for at least count / 2^decimation_log2 + 1 outputs.
+ * @return Number of outputs written.
+ */
+/* @[declare_cic_process] */
+size_t cic_process(cic_t *cic, const uint16_t *in, size_t count, int32_t *out);
+/* @[declare_cic_process] */
+
+#ifdef __cplusplus
+}
+#endif
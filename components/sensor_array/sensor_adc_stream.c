@@ -0,0 +1,137 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_err.h"
+
+#include "core2forAWS.h"
+#include "cic.h"
+#include "sensor_array.h"
+
+#define TAG "ADC_STREAM"
+
+#define ADC_STREAM_CIC_ORDER 3
+// The calibration is fitted as a line over base +/- FIT_SPAN counts,
+// every FIT_STEP counts
+#define ADC_STREAM_FIT_SPAN 16
+#define ADC_STREAM_FIT_STEP 4
+#define ADC_STREAM_RAW_MAX 4095
+
+#if CONFIG_SOFTWARE_EXPPORTS_SUPPORT
+static cic_t stream_cic;
+static uint8_t stream_frac_bits;
+static TaskHandle_t stream_task_handle;
+static SemaphoreHandle_t stream_mutex;
+static float stream_latest_mv;
+static uint32_t stream_count;
+
+// Calibration is not linear over the whole range, but a block of a slow
+// gas sensor spans a few counts, so one local gain/offset pair around the
+// block average is as accurate as running the curve for every sample.
+// The curve returns whole mV, about 0.8 counts apart, so neighbouring
+// counts give a gain of 0 or 1 mV; a least squares line over a wider span
+// recovers the fraction.
+static float adc_stream_calibrate(const int32_t *decimated, size_t count) {
+    int64_t sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        sum += decimated[i];
+    }
+    int32_t base = (int32_t)((sum / (int64_t)count) >> stream_frac_bits);
+    int32_t lo = base - ADC_STREAM_FIT_SPAN;
+    if (lo < 0) {
+        lo = 0;
+    } else if (lo > ADC_STREAM_RAW_MAX - 2 * ADC_STREAM_FIT_SPAN) {
+        lo = ADC_STREAM_RAW_MAX - 2 * ADC_STREAM_FIT_SPAN;
+    }
+
+    // Centred on base, so the intercept is the value at base
+    float sx = 0, sy = 0, sxx = 0, sxy = 0;
+    int points = 0;
+    for (int32_t raw = lo; raw <= lo + 2 * ADC_STREAM_FIT_SPAN; raw += ADC_STREAM_FIT_STEP) {
+        float x = (float)(raw - base);
+        float y = (float)Core2ForAWS_Port_B_ADC_RawToMilliVolts(raw);
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+        points++;
+    }
+    float gain_mv = (points * sxy - sx * sy) / (points * sxx - sx * sx);
+    float offset_mv = (sy - gain_mv * sx) / points;
+
+    float latest = (float)decimated[count - 1] / (1UL << stream_frac_bits);
+    return offset_mv + (latest - base) * gain_mv;
+}
+
+static void adc_stream_task(void *arg) {
+    static uint16_t raw[SENSOR_ADC_STREAM_BLOCK];
+    static int32_t decimated[SENSOR_ADC_STREAM_BLOCK / 2 + 1];
+
+    for (;;) {
+        size_t samples = Core2ForAWS_Port_B_ADC_StreamRead(raw, SENSOR_ADC_STREAM_BLOCK, portMAX_DELAY);
+        size_t outputs = cic_process(&stream_cic, raw, samples, decimated);
+        if (outputs == 0) {
+            continue;
+        }
+
+        float mv = adc_stream_calibrate(decimated, outputs);
+        xSemaphoreTake(stream_mutex, portMAX_DELAY);
+        stream_latest_mv = mv;
+        stream_count += outputs;
+        xSemaphoreGive(stream_mutex);
+    }
+}
+
+esp_err_t sensor_adc_stream_start(uint32_t sample_rate, uint8_t decimation_log2, UBaseType_t priority, BaseType_t core) {
+    if (stream_task_handle != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // Block buffers assume at least two inputs per output
+    if (decimation_log2 < 1) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // White noise averaged over R samples gains log2(R) / 2 bits
+    stream_frac_bits = decimation_log2 / 2;
+    if (cic_init(&stream_cic, ADC_STREAM_CIC_ORDER, decimation_log2, stream_frac_bits) != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    stream_mutex = xSemaphoreCreateMutex();
+    if (stream_mutex == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t err = Core2ForAWS_Port_B_ADC_StreamBegin(sample_rate);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    BaseType_t ret = xTaskCreatePinnedToCore(adc_stream_task, "ADCStreamTask", 2 * 1024, NULL, priority, &stream_task_handle, core);
+    if (ret != pdPASS) {
+        Core2ForAWS_Port_B_ADC_StreamEnd();
+        stream_task_handle = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Streaming at %u Hz, %u Hz out", sample_rate, sample_rate >> decimation_log2);
+    return ESP_OK;
+}
+
+static esp_err_t sensor_read_port_b_adc_stream(void *ctx, float *value) {
+    if (stream_mutex == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(stream_mutex, portMAX_DELAY);
+    uint32_t count = stream_count;
+    *value = stream_latest_mv;
+    xSemaphoreGive(stream_mutex);
+    return count > 0 ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+void sensor_channel_port_b_adc_stream(sensor_channel_t *channel, const char *name) {
+    channel->name = name;
+    channel->read = sensor_read_port_b_adc_stream;
+    channel->ctx = NULL;
+}
+#endif
@@ -0,0 +1,181 @@
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+
+#include "core2forAWS.h"
+#include "i2c_device.h"
+#include "scheduler.h"
+#include "sensor_array.h"
+#include "timekeeping.h"
+
+#define TAG "SENSOR_ARRAY"
+
+// Samples feed spectral features, so they have to stay evenly spaced
+#define SAMPLE_DEADLINE_US 10000
+
+_Static_assert(SENSOR_ARRAY_CHANNELS <= 32, "error_mask holds one bit per channel");
+
+static sensor_channel_t channels[SENSOR_ARRAY_CHANNELS];
+static uint8_t channel_count;
+static sensor_frame_t frame;
+static sched_job_t sensor_array_job;
+
+static sensor_frame_cb_t frame_callback;
+static void *frame_callback_arg;
+static sensor_sample_cb_t sample_callback;
+static void *sample_callback_arg;
+
+esp_err_t sensor_array_add(const sensor_channel_t *channel, uint8_t *index) {
+    if (channel == NULL || channel->read == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (sensor_array_job.fn != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (channel_count >= SENSOR_ARRAY_CHANNELS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    channels[channel_count] = *channel;
+    if (index != NULL) {
+        *index = channel_count;
+    }
+    channel_count++;
+    return ESP_OK;
+}
+
+esp_err_t sensor_array_set_sample_cb(sensor_sample_cb_t callback, void *arg) {
+    if (sensor_array_job.fn != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    sample_callback = callback;
+    sample_callback_arg = arg;
+    return ESP_OK;
+}
+
+uint8_t sensor_array_count(void) {
+    return channel_count;
+}
+
+static void sensor_array_sample(sched_job_t *job, void *arg) {
+    static float last_value[SENSOR_ARRAY_CHANNELS];
+    static uint16_t sample;
+
+    if (sample == 0) {
+        frame.start_us = timekeeping_now_us();
+        frame.error_mask = 0;
+    }
+
+    // All channels are read back to back so they share one time stamp
+    for (uint8_t c = 0; c < channel_count; c++) {
+        float value;
+        if (channels[c].read(channels[c].ctx, &value) == ESP_OK) {
+            last_value[c] = value;
+        } else {
+            frame.error_mask |= 1UL << c;
+        }
+        frame.values[c][sample] = last_value[c];
+    }
+    if (sample_callback != NULL) {
+        sample_callback(last_value, frame.start_us + (int64_t)sample * frame.period_us, sample_callback_arg);
+    }
+
+    if (++sample < SENSOR_ARRAY_FRAME_LEN) {
+        return;
+    }
+    sample = 0;
+
+    if (frame.error_mask) {
+        ESP_LOGD(TAG, "Frame %u read errors on channels 0x%08x", frame.sequence, frame.error_mask);
+    }
+    if (frame_callback != NULL) {
+        frame_callback(&frame, frame_callback_arg);
+    }
+    frame.sequence++;
+}
+
+esp_err_t sensor_array_start(uint32_t period_ms, sensor_frame_cb_t callback, void *arg) {
+    if (period_ms == 0 || channel_count == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (sensor_array_job.fn != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    frame_callback = callback;
+    frame_callback_arg = arg;
+    memset(&frame, 0, sizeof(frame));
+    frame.period_us = period_ms * 1000;
+    frame.channel_count = channel_count;
+
+    sensor_array_job.name = "sensor_array";
+    sensor_array_job.fn = sensor_array_sample;
+    sensor_array_job.period_us = period_ms * 1000;
+    sensor_array_job.deadline_us = SAMPLE_DEADLINE_US;
+    esp_err_t err = scheduler_add(&sensor_array_job, sensor_array_job.period_us);
+    if (err != ESP_OK) {
+        sensor_array_job.fn = NULL;
+    }
+    return err;
+}
+
+#if CONFIG_SOFTWARE_EXPPORTS_SUPPORT
+static esp_err_t sensor_read_port_b_adc(void *ctx, float *value) {
+    // Average in the raw domain and convert once, the calibration curve
+    // costs far more than the reads themselves
+    uint32_t sum = 0;
+    for (int i = 0; i < SENSOR_ARRAY_ADC_OVERSAMPLE; i++) {
+        sum += Core2ForAWS_Port_B_ADC_ReadRaw();
+    }
+    uint32_t raw = (sum + SENSOR_ARRAY_ADC_OVERSAMPLE / 2) / SENSOR_ARRAY_ADC_OVERSAMPLE;
+    *value = Core2ForAWS_Port_B_ADC_RawToMilliVolts(raw);
+    return ESP_OK;
+}
+
+void sensor_channel_port_b_adc(sensor_channel_t *channel, const char *name) {
+    channel->name = name;
+    channel->read = sensor_read_port_b_adc;
+    channel->ctx = NULL;
+}
+#endif
+
+static esp_err_t sensor_read_i2c_reg(void *ctx, float *value) {
+    sensor_i2c_reg_t *reg = (sensor_i2c_reg_t *)ctx;
+    uint8_t buf[4];
+    if (reg->length == 0 || reg->length > sizeof(buf)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    esp_err_t err = i2c_read_bytes(reg->device, reg->reg_addr, buf, reg->length);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    uint32_t raw = 0;
+    for (uint8_t i = 0; i < reg->length; i++) {
+        uint8_t byte = reg->big_endian ? buf[i] : buf[reg->length - 1 - i];
+        raw = (raw << 8) | byte;
+    }
+
+    if (reg->is_signed && reg->length < 4) {
+        // Sign-extend from the register width
+        uint32_t sign = 1UL << (reg->length * 8 - 1);
+        *value = (float)(int32_t)((raw ^ sign) - sign) * reg->scale;
+    } else if (reg->is_signed) {
+        *value = (float)(int32_t)raw * reg->scale;
+    } else {
+        *value = (float)raw * reg->scale;
+    }
+    return ESP_OK;
+}
+
+void sensor_channel_i2c_reg(sensor_channel_t *channel, const char *name, sensor_i2c_reg_t *reg) {
+    channel->name = name;
+    channel->read = sensor_read_i2c_reg;
+    channel->ctx = reg;
+}
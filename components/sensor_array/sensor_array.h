@@ -0,0 +1,274 @@
+/**
+ * @file sensor_array.h
+ * @brief Samples a set of sensor channels on a shared time base and
+ * emits fixed-size frames.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "i2c_device.h"
+
+#ifdef CONFIG_SENSOR_ARRAY_CHANNELS
+#define SENSOR_ARRAY_CHANNELS CONFIG_SENSOR_ARRAY_CHANNELS
+#else
+#define SENSOR_ARRAY_CHANNELS 8
+#endif
+
+#ifdef CONFIG_SENSOR_ARRAY_FRAME_LEN
+#define SENSOR_ARRAY_FRAME_LEN CONFIG_SENSOR_ARRAY_FRAME_LEN
+#else
+#define SENSOR_ARRAY_FRAME_LEN 32
+#endif
+
+#ifdef CONFIG_SENSOR_ARRAY_ADC_OVERSAMPLE
+#define SENSOR_ARRAY_ADC_OVERSAMPLE CONFIG_SENSOR_ARRAY_ADC_OVERSAMPLE
+#else
+#define SENSOR_ARRAY_ADC_OVERSAMPLE 16
+#endif
+
+/**
+ * @brief Reads one value from a channel.
+ *
+ * @param[in] ctx The channel's context pointer.
+ * @param[out] value The reading, in the channel's unit.
+ * @return `ESP_OK` if `value` was filled in.
+ */
+/* @[declare_sensor_read_fn_t] */
+typedef esp_err_t (*sensor_read_fn_t)(void *ctx, float *value);
+/* @[declare_sensor_read_fn_t] */
+
+/**
+ * @brief A source of one scalar per sample period.
+ */
+/* @[declare_sensor_channel_t] */
+typedef struct {
+    /*@{*/
+    const char *name;       /**< @brief Short label, used in logs. */
+    sensor_read_fn_t read;  /**< @brief Called once per sample period. */
+    void *ctx;              /**< @brief Passed to `read`. */
+    /*@}*/
+} sensor_channel_t;
+/* @[declare_sensor_channel_t] */
+
+/**
+ * @brief One frame of samples for every channel.
+ *
+ * Stored as a struct of arrays: `values[c]` holds SENSOR_ARRAY_FRAME_LEN
+ * consecutive samples of channel `c`, 16-byte aligned, so per-channel
+ * feature extraction walks contiguous memory.
+ *
+ * Sample `i` of every channel was read at
+ * `start_us + i * period_us`. A failed read repeats the channel's
+ * previous value and sets the channel's bit in `error_mask`.
+ */
+/* @[declare_sensor_frame_t] */
+typedef struct {
+    /*@{*/
+    int64_t start_us;       /**< @brief Time of the first sample, from timekeeping_now_us(). */
+    uint32_t period_us;     /**< @brief Time between samples. */
+    uint32_t sequence;      /**< @brief Frame counter since sensor_array_start(). */
+    uint8_t channel_count;  /**< @brief Number of rows of `values` in use. */
+    uint32_t error_mask;    /**< @brief Channels with at least one failed read. */
+    float values[SENSOR_ARRAY_CHANNELS][SENSOR_ARRAY_FRAME_LEN] __attribute__((aligned(16)));
+    /*@}*/
+} sensor_frame_t;
+/* @[declare_sensor_frame_t] */
+
+/**
+ * @brief Called on the scheduler task each time a frame fills up.
+ *
+ * The frame is only valid until the callback returns. Copy it out or
+ * hand the work to another task if processing takes longer than a
+ * sample period.
+ */
+/* @[declare_sensor_frame_cb_t] */
+typedef void (*sensor_frame_cb_t)(const sensor_frame_t *frame, void *arg);
+/* @[declare_sensor_frame_cb_t] */
+
+/**
+ * @brief Called on the scheduler task after every sample period, with
+ * the value of each channel, before the frame callback if the sample
+ * completed a frame.
+ *
+ * @param[in] values One value per channel, in channel order.
+ * @param[in] time_us When the values were read, from timekeeping_now_us().
+ * @param[in] arg As given to sensor_array_set_sample_cb().
+ */
+/* @[declare_sensor_sample_cb_t] */
+typedef void (*sensor_sample_cb_t)(const float *values, int64_t time_us, void *arg);
+/* @[declare_sensor_sample_cb_t] */
+
+/**
+ * @brief Register layout for sensor_channel_i2c_reg().
+ */
+/* @[declare_sensor_i2c_reg_t] */
+typedef struct {
+    /*@{*/
+    I2CDevice_t device;     /**< @brief Device to read from. */
+    uint32_t reg_addr;      /**< @brief Register, or I2C_NO_REG. */
+    uint8_t length;         /**< @brief 1, 2 or 4 bytes. */
+    bool big_endian;        /**< @brief Byte order of the register. */
+    bool is_signed;         /**< @brief Two's complement value. */
+    float scale;            /**< @brief Multiplied with the raw value. */
+    /*@}*/
+} sensor_i2c_reg_t;
+/* @[declare_sensor_i2c_reg_t] */
+
+/**
+ * @brief Adds a channel. The channel struct is copied, its context is not.
+ *
+ * @note Channels can only be added before sensor_array_start().
+ *
+ * @param[in] channel The channel to add.
+ * @param[out] index Row of the frame the channel fills. May be NULL.
+ * @return `ESP_OK`, `ESP_ERR_NO_MEM` if SENSOR_ARRAY_CHANNELS are already
+ * in use, or `ESP_ERR_INVALID_STATE` once sampling has started.
+ */
+/* @[declare_sensor_array_add] */
+esp_err_t sensor_array_add(const sensor_channel_t *channel, uint8_t *index);
+/* @[declare_sensor_array_add] */
+
+/**
+ * @brief Adds a scheduler job that reads every channel once per
+ * `period_ms` and calls `callback` with each full frame.
+ *
+ * The callback runs on the scheduler task and delays every other job
+ * while it does, so hand heavy work off to another task.
+ *
+ * **Example:**
+ *
+ * Sample the Port B ADC at 10 Hz.
+ * @code{c}
+ *  static void on_frame(const sensor_frame_t *frame, void *arg) {
+ *      ESP_LOGI(TAG, "Frame %u, first sample %.0f mV", frame->sequence, frame->values[0][0]);
+ *  }
+ *
+ *  sensor_channel_t adc;
+ *  Core2ForAWS_Port_PinMode(PORT_B_ADC_PIN, ADC);
+ *  sensor_channel_port_b_adc(&adc, "mq3");
+ *  sensor_array_add(&adc, NULL);
+ *  sensor_array_start(100, on_frame, NULL);
+ * @endcode
+ *
+ * @param[in] period_ms Sample period.
+ * @param[in] callback Receives each full frame.
+ * @param[in] arg Passed to `callback`.
+ * @return `ESP_OK` if the job was added.
+ */
+/* @[declare_sensor_array_start] */
+esp_err_t sensor_array_start(uint32_t period_ms, sensor_frame_cb_t callback, void *arg);
+/* @[declare_sensor_array_start] */
+
+/**
+ * @brief Sets a callback that sees every sample as it is read, for
+ * streaming work that cannot wait for a whole frame.
+ *
+ * The callback runs as part of the sampling job, so it has to be quick.
+ *
+ * @note Set it before sensor_array_start().
+ *
+ * @param[in] callback Receives each sample, or NULL for none.
+ * @param[in] arg Passed to `callback`.
+ * @return `ESP_OK`, or `ESP_ERR_INVALID_STATE` once sampling has started.
+ */
+/* @[declare_sensor_array_set_sample_cb] */
+esp_err_t sensor_array_set_sample_cb(sensor_sample_cb_t callback, void *arg);
+/* @[declare_sensor_array_set_sample_cb] */
+
+/**
+ * @brief Number of channels added so far.
+ */
+/* @[declare_sensor_array_count] */
+uint8_t sensor_array_count(void);
+/* @[declare_sensor_array_count] */
+
+/**
+ * @brief Fills in a channel that reads an integer register over I2C.
+ *
+ * @param[out] channel The channel to fill in.
+ * @param[in] name Label for the channel.
+ * @param[in] reg Register layout. Must outlive the channel.
+ */
+/* @[declare_sensor_channel_i2c_reg] */
+void sensor_channel_i2c_reg(sensor_channel_t *channel, const char *name, sensor_i2c_reg_t *reg);
+/* @[declare_sensor_channel_i2c_reg] */
+
+#if CONFIG_SOFTWARE_EXPPORTS_SUPPORT
+/**
+ * @brief Fills in a channel for the Port B ADC on GPIO 36, in millivolts.
+ *
+ * Each sample averages SENSOR_ARRAY_ADC_OVERSAMPLE back-to-back raw reads
+ * and converts the average once with the eFuse calibration.
+ *
+ * @note PORT_B_ADC_PIN must be set to ADC with Core2ForAWS_Port_PinMode().
+ *
+ * @param[out] channel The channel to fill in.
+ * @param[in] name Label for the channel.
+ */
+/* @[declare_sensor_channel_port_b_adc] */
+void sensor_channel_port_b_adc(sensor_channel_t *channel, const char *name);
+/* @[declare_sensor_channel_port_b_adc] */
+
+/**
+ * @brief Raw ADC samples pulled from DMA and filtered per block.
+ */
+/* @[declare_sensor_adc_stream_block] */
+#define SENSOR_ADC_STREAM_BLOCK 512
+/* @[declare_sensor_adc_stream_block] */
+
+/**
+ * @brief Starts streaming the Port B ADC at `sample_rate` and decimating
+ * it with a third order CIC filter to a low-rate, higher resolution value.
+ *
+ * Once per block, the calibration curve is evaluated at nine points
+ * within 16 counts of the block average. A line fitted through them is
+ * applied to the decimated samples as a local gain and offset.
+ *
+ * @note PORT_B_ADC_PIN must be set to ADC first. See
+ * Core2ForAWS_Port_B_ADC_StreamBegin() for the I2S0 restrictions.
+ *
+ * **Example:**
+ *
+ * 8 kHz decimated by 256 gives a 31.25 Hz stream.
+ * @code{c}
+ *  sensor_channel_t adc;
+ *  Core2ForAWS_Port_PinMode(PORT_B_ADC_PIN, ADC);
+ *  sensor_adc_stream_start(8000, 8, 6, 1);
+ *  sensor_channel_port_b_adc_stream(&adc, "mq3");
+ *  sensor_array_add(&adc, NULL);
+ * @endcode
+ *
+ * @param[in] sample_rate ADC rate in samples per second.
+ * @param[in] decimation_log2 log2 of the decimation ratio.
+ * @param[in] priority Priority of the filter task.
+ * @param[in] core The core to pin the task to.
+ * @return `ESP_OK` if the stream and task were started.
+ */
+/* @[declare_sensor_adc_stream_start] */
+esp_err_t sensor_adc_stream_start(uint32_t sample_rate, uint8_t decimation_log2, UBaseType_t priority, BaseType_t core);
+/* @[declare_sensor_adc_stream_start] */
+
+/**
+ * @brief Fills in a channel that returns the latest decimated value of
+ * the ADC stream, in millivolts.
+ *
+ * @param[out] channel The channel to fill in.
+ * @param[in] name Label for the channel.
+ */
+/* @[declare_sensor_channel_port_b_adc_stream] */
+void sensor_channel_port_b_adc_stream(sensor_channel_t *channel, const char *name);
+/* @[declare_sensor_channel_port_b_adc_stream] */
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,510 @@
+#include <string.h>
+#include <math.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+#include "i2c_device.h"
+#include "i2c_async.h"
+#include "scheduler.h"
+#include "sgp30.h"
+#include "timekeeping.h"
+
+#define TAG "SGP30"
+
+#define SGP30_CRC_POLY 0x31
+#define SGP30_CRC_INIT 0xFF
+#define SGP30_WORD_LEN 3
+
+// Maximum command durations from the datasheet
+#define SGP30_IAQ_INIT_MS       10
+#define SGP30_MEASURE_IAQ_MS    12
+#define SGP30_MEASURE_RAW_MS    25
+#define SGP30_GET_BASELINE_MS   10
+#define SGP30_FEATURE_SET_MS    10
+#define SGP30_SERIAL_ID_MS      1
+#define SGP30_SET_HUMIDITY_MS   10
+#define SGP30_SET_BASELINE_MS   10
+
+#define SGP30_NVS_NAMESPACE     "sgp30"
+#define SGP30_NVS_BASELINE_KEY  "baseline"
+
+// Checks on a transfer handed to the bus task once a tick
+#define SGP30_POLL_US (portTICK_PERIOD_MS * 1000)
+
+// The measurement job only hands a command to the bus task and returns.
+// The read job comes back for it, waits out the conversion from when
+// the command reached the sensor, reads the result the same way and
+// sends the next command, so the scheduler task never waits on the
+// sensor or the bus.
+typedef enum {
+    SGP30_STEP_IDLE,
+    SGP30_STEP_IAQ,
+    SGP30_STEP_RAW,
+    SGP30_STEP_HUMIDITY,
+    SGP30_STEP_BASELINE,
+} sgp30_step_t;
+
+static I2CDevice_t sgp30_device;
+static sgp30_ring_t sgp30_ring;
+static sched_job_t sgp30_job;
+static sched_job_t sgp30_read_job;
+static sgp30_env_source_t sgp30_env_source;
+static int64_t sgp30_iaq_start_us;
+static bool sgp30_baseline_restored;
+
+// Only touched by the scheduler task, and the transfer by the bus task
+// until sgp30_req_done is set
+static sgp30_step_t sgp30_step;
+static uint32_t sgp30_step_ms;
+static uint8_t sgp30_step_words;
+static i2c_async_req_t sgp30_req;
+static uint8_t sgp30_buf[2 + 2 * SGP30_WORD_LEN];
+static volatile bool sgp30_req_done;
+static volatile int64_t sgp30_req_done_us;
+static sgp30_sample_t sgp30_pending;
+static int64_t sgp30_last_humidity_us;
+static int64_t sgp30_last_save_us;
+
+uint8_t SGP30_CRC8(const uint8_t *data, uint8_t length) {
+    uint8_t crc = SGP30_CRC_INIT;
+    for (uint8_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (crc << 1) ^ SGP30_CRC_POLY : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+static uint8_t SGP30_EncodeCommand(uint8_t *buf, uint16_t command, const uint16_t *words, uint8_t word_count) {
+    buf[0] = command >> 8;
+    buf[1] = command & 0xFF;
+    for (uint8_t i = 0; i < word_count; i++) {
+        uint8_t *word = &buf[2 + i * SGP30_WORD_LEN];
+        word[0] = words[i] >> 8;
+        word[1] = words[i] & 0xFF;
+        word[2] = SGP30_CRC8(word, 2);
+    }
+    return 2 + word_count * SGP30_WORD_LEN;
+}
+
+static esp_err_t SGP30_DecodeWords(const uint8_t *buf, uint16_t *words, uint8_t word_count) {
+    for (uint8_t i = 0; i < word_count; i++) {
+        const uint8_t *word = &buf[i * SGP30_WORD_LEN];
+        if (SGP30_CRC8(word, 2) != word[2]) {
+            ESP_LOGW(TAG, "CRC mismatch on word %d", i);
+            return ESP_ERR_INVALID_CRC;
+        }
+        words[i] = (word[0] << 8) | word[1];
+    }
+    return ESP_OK;
+}
+
+static esp_err_t SGP30_WriteCommand(uint16_t command, const uint16_t *words, uint8_t word_count) {
+    uint8_t buf[2 + 2 * SGP30_WORD_LEN];
+    uint8_t length = SGP30_EncodeCommand(buf, command, words, word_count);
+    return i2c_write_bytes(sgp30_device, I2C_NO_REG, buf, length);
+}
+
+static esp_err_t SGP30_ReadWords(uint16_t *words, uint8_t word_count) {
+    uint8_t buf[3 * SGP30_WORD_LEN];
+    esp_err_t err = i2c_read_bytes(sgp30_device, I2C_NO_REG, buf, word_count * SGP30_WORD_LEN);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return SGP30_DecodeWords(buf, words, word_count);
+}
+
+// vTaskDelay(n) returns after n tick interrupts, the first of which may
+// come right away, so round the duration up and add one tick
+static TickType_t SGP30_WaitTicks(uint32_t duration_ms) {
+    return (duration_ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS + 1;
+}
+
+static esp_err_t SGP30_Command(uint16_t command, uint32_t duration_ms, uint16_t *words, uint8_t word_count) {
+    esp_err_t err = SGP30_WriteCommand(command, NULL, 0);
+    if (err != ESP_OK) {
+        return err;
+    }
+    vTaskDelay(SGP30_WaitTicks(duration_ms));
+    if (word_count == 0) {
+        return ESP_OK;
+    }
+    return SGP30_ReadWords(words, word_count);
+}
+
+static esp_err_t SGP30_CommandWrite(uint16_t command, uint32_t duration_ms, const uint16_t *words, uint8_t word_count) {
+    esp_err_t err = SGP30_WriteCommand(command, words, word_count);
+    if (err != ESP_OK) {
+        return err;
+    }
+    vTaskDelay(SGP30_WaitTicks(duration_ms));
+    return ESP_OK;
+}
+
+esp_err_t SGP30_Init(I2CDevice_t device) {
+    if (device == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    sgp30_device = device;
+    sgp30_ring_init(&sgp30_ring);
+
+    uint64_t serial = 0;
+    esp_err_t err = SGP30_GetSerial(&serial);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "No response reading the serial id: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    uint16_t feature_set = 0;
+    err = SGP30_Command(SGP30_CMD_GET_FEATURE_SET, SGP30_FEATURE_SET_MS, &feature_set, 1);
+    if (err != ESP_OK) {
+        return err;
+    }
+    ESP_LOGI(TAG, "Serial %04x%08x, feature set 0x%04x",
+        (uint16_t)(serial >> 32), (uint32_t)serial, feature_set);
+
+    err = SGP30_Command(SGP30_CMD_IAQ_INIT, SGP30_IAQ_INIT_MS, NULL, 0);
+    if (err != ESP_OK) {
+        return err;
+    }
+    sgp30_iaq_start_us = esp_timer_get_time();
+
+    err = SGP30_RestoreBaseline();
+    sgp30_baseline_restored = (err == ESP_OK);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGW(TAG, "Baseline restore failed: %s", esp_err_to_name(err));
+    }
+    return ESP_OK;
+}
+
+esp_err_t SGP30_GetSerial(uint64_t *serial) {
+    uint16_t words[3];
+    esp_err_t err = SGP30_Command(SGP30_CMD_GET_SERIAL_ID, SGP30_SERIAL_ID_MS, words, 3);
+    if (err != ESP_OK) {
+        return err;
+    }
+    *serial = ((uint64_t)words[0] << 32) | ((uint64_t)words[1] << 16) | words[2];
+    return ESP_OK;
+}
+
+esp_err_t SGP30_MeasureIAQ(uint16_t *tvoc, uint16_t *eco2) {
+    uint16_t words[2];
+    esp_err_t err = SGP30_Command(SGP30_CMD_MEASURE_IAQ, SGP30_MEASURE_IAQ_MS, words, 2);
+    if (err != ESP_OK) {
+        return err;
+    }
+    *eco2 = words[0];
+    *tvoc = words[1];
+    return ESP_OK;
+}
+
+esp_err_t SGP30_MeasureRaw(uint16_t *raw_h2, uint16_t *raw_ethanol) {
+    uint16_t words[2];
+    esp_err_t err = SGP30_Command(SGP30_CMD_MEASURE_RAW, SGP30_MEASURE_RAW_MS, words, 2);
+    if (err != ESP_OK) {
+        return err;
+    }
+    *raw_h2 = words[0];
+    *raw_ethanol = words[1];
+    return ESP_OK;
+}
+
+esp_err_t SGP30_MeasureBurst(sgp30_sample_t *sample) {
+    esp_err_t err = SGP30_MeasureIAQ(&sample->tvoc, &sample->eco2);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return SGP30_MeasureRaw(&sample->raw_h2, &sample->raw_ethanol);
+}
+
+uint32_t SGP30_AbsoluteHumidity(float temperature_c, float humidity_rh) {
+    float saturation_hpa = 6.112f * expf((17.62f * temperature_c) / (243.12f + temperature_c));
+    float abs_humidity_g_m3 = 216.7f * ((humidity_rh / 100.0f) * saturation_hpa) / (273.15f + temperature_c);
+    if (abs_humidity_g_m3 <= 0.0f) {
+        return 0;
+    }
+    return (uint32_t)(abs_humidity_g_m3 * 1000.0f);
+}
+
+static uint16_t SGP30_HumidityWord(uint32_t abs_humidity_mg_m3) {
+    // The sensor takes g/m^3 as 8.8 fixed point
+    uint32_t fixed = ((uint64_t)abs_humidity_mg_m3 * 256 + 500) / 1000;
+    return fixed > 0xFFFF ? 0xFFFF : fixed;
+}
+
+esp_err_t SGP30_SetAbsoluteHumidity(uint32_t abs_humidity_mg_m3) {
+    uint16_t word = SGP30_HumidityWord(abs_humidity_mg_m3);
+    return SGP30_CommandWrite(SGP30_CMD_SET_ABSOLUTE_HUMIDITY, SGP30_SET_HUMIDITY_MS, &word, 1);
+}
+
+esp_err_t SGP30_GetBaseline(uint16_t *eco2, uint16_t *tvoc) {
+    uint16_t words[2];
+    esp_err_t err = SGP30_Command(SGP30_CMD_GET_IAQ_BASELINE, SGP30_GET_BASELINE_MS, words, 2);
+    if (err != ESP_OK) {
+        return err;
+    }
+    *eco2 = words[0];
+    *tvoc = words[1];
+    return ESP_OK;
+}
+
+esp_err_t SGP30_SetBaseline(uint16_t eco2, uint16_t tvoc) {
+    // Written in the opposite order to how get_iaq_baseline returns them
+    uint16_t words[2] = { tvoc, eco2 };
+    return SGP30_CommandWrite(SGP30_CMD_SET_IAQ_BASELINE, SGP30_SET_BASELINE_MS, words, 2);
+}
+
+static esp_err_t SGP30_StoreBaseline(uint16_t eco2, uint16_t tvoc) {
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(SGP30_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_set_u32(handle, SGP30_NVS_BASELINE_KEY, ((uint32_t)eco2 << 16) | tvoc);
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Saved baseline eCO2 0x%04x, TVOC 0x%04x", eco2, tvoc);
+    }
+    return err;
+}
+
+esp_err_t SGP30_SaveBaseline(void) {
+    uint16_t eco2, tvoc;
+    esp_err_t err = SGP30_GetBaseline(&eco2, &tvoc);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return SGP30_StoreBaseline(eco2, tvoc);
+}
+
+esp_err_t SGP30_RestoreBaseline(void) {
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(SGP30_NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    uint32_t baseline = 0;
+    err = nvs_get_u32(handle, SGP30_NVS_BASELINE_KEY, &baseline);
+    nvs_close(handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    err = SGP30_SetBaseline(baseline >> 16, baseline & 0xFFFF);
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Restored baseline eCO2 0x%04x, TVOC 0x%04x", baseline >> 16, baseline & 0xFFFF);
+    }
+    return err;
+}
+
+void SGP30_SetEnvSource(sgp30_env_source_t source) {
+    sgp30_env_source = source;
+}
+
+sgp30_ring_t *SGP30_GetRing(void) {
+    return &sgp30_ring;
+}
+
+static void SGP30_TransferDone(i2c_async_req_t *req) {
+    sgp30_req_done_us = esp_timer_get_time();
+    __atomic_store_n(&sgp30_req_done, true, __ATOMIC_RELEASE);
+}
+
+// Hands a transfer of sgp30_buf to the bus task, or makes it here when
+// there is none
+static esp_err_t SGP30_Submit(bool is_read, uint16_t length) {
+    sgp30_req = (i2c_async_req_t){
+        .device = sgp30_device,
+        .reg_addr = I2C_NO_REG,
+        .data = sgp30_buf,
+        .length = length,
+        .is_read = is_read,
+        .priority = I2C_ASYNC_PRIO_NORMAL,
+        .callback = SGP30_TransferDone,
+    };
+    sgp30_req_done = false;
+    esp_err_t err = i2c_async_submit(&sgp30_req);
+    if (err == ESP_ERR_INVALID_STATE) {
+        sgp30_req.err = is_read ? i2c_read_bytes(sgp30_device, I2C_NO_REG, sgp30_buf, length)
+                                : i2c_write_bytes(sgp30_device, I2C_NO_REG, sgp30_buf, length);
+        SGP30_TransferDone(&sgp30_req);
+        err = ESP_OK;
+    }
+    return err;
+}
+
+/*
+    Starts the next step of the chain: sends its command, whose result of
+    `result_words` is read `duration_ms` after the sensor got it. The
+    caller brings the read job back to follow it up.
+*/
+static esp_err_t SGP30_Send(sgp30_step_t step, uint16_t command, const uint16_t *words, uint8_t word_count,
+                            uint8_t result_words, uint32_t duration_ms) {
+    sgp30_step = step;
+    sgp30_step_ms = duration_ms;
+    sgp30_step_words = result_words;
+    esp_err_t err = SGP30_Submit(false, SGP30_EncodeCommand(sgp30_buf, command, words, word_count));
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Command 0x%04x not sent: %s", command, esp_err_to_name(err));
+        sgp30_step = SGP30_STEP_IDLE;
+    }
+    return err;
+}
+
+// Once the sample is in, at most one command more before the next
+// measurement
+static void SGP30_Housekeeping(void) {
+    int64_t now_us = esp_timer_get_time();
+    sgp30_env_source_t source = sgp30_env_source;
+    float temperature_c, humidity_rh;
+
+    if (now_us - sgp30_last_humidity_us >= (int64_t)SGP30_HUMIDITY_INTERVAL_MS * 1000 &&
+        source != NULL && source(&temperature_c, &humidity_rh)) {
+        sgp30_last_humidity_us = now_us;
+        uint16_t word = SGP30_HumidityWord(SGP30_AbsoluteHumidity(temperature_c, humidity_rh));
+        if (SGP30_Send(SGP30_STEP_HUMIDITY, SGP30_CMD_SET_ABSOLUTE_HUMIDITY, &word, 1, 0, SGP30_SET_HUMIDITY_MS) == ESP_OK) {
+            scheduler_rerun_current(SGP30_POLL_US);
+        }
+        return;
+    }
+
+    // A fresh sensor reports a meaningless baseline until it has learnt one
+    int64_t learn_us = sgp30_baseline_restored ? 0 : (int64_t)SGP30_BASELINE_LEARN_S * 1000000;
+    if (now_us - sgp30_iaq_start_us >= learn_us &&
+        now_us - sgp30_last_save_us >= (int64_t)SGP30_BASELINE_SAVE_INTERVAL_S * 1000000) {
+        sgp30_last_save_us = now_us;
+        if (SGP30_Send(SGP30_STEP_BASELINE, SGP30_CMD_GET_IAQ_BASELINE, NULL, 0, 2, SGP30_GET_BASELINE_MS) == ESP_OK) {
+            scheduler_rerun_current(SGP30_POLL_US);
+        }
+    }
+}
+
+static void SGP30_ReadJob(sched_job_t *job, void *arg) {
+    if (sgp30_step == SGP30_STEP_IDLE) {
+        return;
+    }
+    if (!__atomic_load_n(&sgp30_req_done, __ATOMIC_ACQUIRE)) {
+        scheduler_rerun_current(SGP30_POLL_US);
+        return;
+    }
+    if (sgp30_req.err != ESP_OK) {
+        ESP_LOGW(TAG, "Transfer failed: %s", esp_err_to_name(sgp30_req.err));
+        sgp30_step = SGP30_STEP_IDLE;
+        return;
+    }
+
+    if (!sgp30_req.is_read) {
+        // The command is with the sensor, the result comes after its
+        // conversion; one that returns nothing only needs the time
+        int64_t wait_us = sgp30_req_done_us + (int64_t)sgp30_step_ms * 1000 - esp_timer_get_time();
+        if (wait_us > 0) {
+            scheduler_rerun_current(wait_us);
+            return;
+        }
+        if (sgp30_step_words == 0) {
+            sgp30_step = SGP30_STEP_IDLE;
+            return;
+        }
+        esp_err_t err = SGP30_Submit(true, sgp30_step_words * SGP30_WORD_LEN);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Read not queued: %s", esp_err_to_name(err));
+            sgp30_step = SGP30_STEP_IDLE;
+            return;
+        }
+        scheduler_rerun_current(SGP30_POLL_US);
+        return;
+    }
+
+    uint16_t words[2];
+    sgp30_step_t step = sgp30_step;
+    sgp30_step = SGP30_STEP_IDLE;
+    if (SGP30_DecodeWords(sgp30_buf, words, 2) != ESP_OK) {
+        return;
+    }
+
+    switch (step) {
+    case SGP30_STEP_IAQ:
+        sgp30_pending.eco2 = words[0];
+        sgp30_pending.tvoc = words[1];
+        if (SGP30_Send(SGP30_STEP_RAW, SGP30_CMD_MEASURE_RAW, NULL, 0, 2, SGP30_MEASURE_RAW_MS) == ESP_OK) {
+            scheduler_rerun_current(SGP30_POLL_US);
+        }
+        break;
+    case SGP30_STEP_RAW:
+        sgp30_pending.raw_h2 = words[0];
+        sgp30_pending.raw_ethanol = words[1];
+        sgp30_ring_publish(&sgp30_ring, &sgp30_pending);
+        SGP30_Housekeeping();
+        break;
+    case SGP30_STEP_BASELINE: {
+        esp_err_t err = SGP30_StoreBaseline(words[0], words[1]);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Baseline save failed: %s", esp_err_to_name(err));
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static void SGP30_MeasureJob(sched_job_t *job, void *arg) {
+    if (sgp30_step != SGP30_STEP_IDLE) {
+        // The sensor ignores commands while it is still busy
+        ESP_LOGW(TAG, "Previous measurement still being read, skipping one");
+        return;
+    }
+    sgp30_pending.timestamp_us = timekeeping_now_us();
+    if (SGP30_Send(SGP30_STEP_IAQ, SGP30_CMD_MEASURE_IAQ, NULL, 0, 2, SGP30_MEASURE_IAQ_MS) != ESP_OK) {
+        return;
+    }
+    // SGP30_Start() added the read job once, so it has its slot and is
+    // idle whenever the chain is
+    scheduler_add(&sgp30_read_job, SGP30_POLL_US);
+}
+
+esp_err_t SGP30_Start(void) {
+    if (sgp30_device == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (sgp30_job.fn != NULL) {
+        return ESP_OK;
+    }
+    // measure_iaq has to run on a steady 1 Hz cadence, so the job gets a
+    // tight deadline and stays on its phase
+    sgp30_job.name = "sgp30";
+    sgp30_job.fn = SGP30_MeasureJob;
+    sgp30_job.period_us = SGP30_MEASURE_INTERVAL_MS * 1000;
+    sgp30_job.deadline_us = SGP30_MEASURE_DEADLINE_MS * 1000;
+    // A result waits in the sensor until it is read, so reading late
+    // costs nothing but latency
+    sgp30_read_job.name = "sgp30_read";
+    sgp30_read_job.fn = SGP30_ReadJob;
+    sgp30_read_job.period_us = 0;
+    sgp30_read_job.deadline_us = SGP30_MEASURE_DEADLINE_MS * 1000;
+    // Humidity goes in with the first sample, the first save waits a
+    // whole interval
+    sgp30_last_humidity_us = INT64_MIN / 2;
+    sgp30_last_save_us = esp_timer_get_time();
+    // Added here to take its slot, it runs once and finds nothing to do
+    sgp30_step = SGP30_STEP_IDLE;
+    esp_err_t err = scheduler_add(&sgp30_read_job, 0);
+    if (err == ESP_OK) {
+        err = scheduler_add(&sgp30_job, sgp30_job.period_us);
+    }
+    if (err != ESP_OK) {
+        sgp30_job.fn = NULL;
+    }
+    return err;
+}
@@ -0,0 +1,292 @@
+/**
+ * @file sgp30.h
+ * @brief Functions for the Sensirion SGP30 indoor air quality sensor.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+#include "i2c_device.h"
+#include "sgp30_ring.h"
+
+/**
+ * @brief The 7-bit I2C address of the SGP30.
+ */
+/* @[declare_sgp30_addr] */
+#define SGP30_ADDR 0x58
+/* @[declare_sgp30_addr] */
+
+#define SGP30_CMD_IAQ_INIT              0x2003
+#define SGP30_CMD_MEASURE_IAQ           0x2008
+#define SGP30_CMD_GET_IAQ_BASELINE      0x2015
+#define SGP30_CMD_SET_IAQ_BASELINE      0x201e
+#define SGP30_CMD_SET_ABSOLUTE_HUMIDITY 0x2061
+#define SGP30_CMD_GET_FEATURE_SET       0x202f
+#define SGP30_CMD_MEASURE_RAW           0x2050
+#define SGP30_CMD_GET_SERIAL_ID         0x3682
+
+/**
+ * @brief Interval at which sgp30_measure_iaq must be issued for the
+ * on-chip baseline compensation to work.
+ */
+/* @[declare_sgp30_measure_interval_ms] */
+#define SGP30_MEASURE_INTERVAL_MS 1000
+/* @[declare_sgp30_measure_interval_ms] */
+
+/**
+ * @brief How late a measurement may start before the scheduler counts
+ * it as an overrun.
+ */
+/* @[declare_sgp30_measure_deadline_ms] */
+#define SGP30_MEASURE_DEADLINE_MS 20
+/* @[declare_sgp30_measure_deadline_ms] */
+
+/**
+ * @brief How often the measurement job refreshes the humidity
+ * compensation from the environment source.
+ */
+/* @[declare_sgp30_humidity_interval_ms] */
+#define SGP30_HUMIDITY_INTERVAL_MS 60000
+/* @[declare_sgp30_humidity_interval_ms] */
+
+/**
+ * @brief How often the IAQ baseline is saved to NVS once it is valid.
+ */
+/* @[declare_sgp30_baseline_save_interval_s] */
+#define SGP30_BASELINE_SAVE_INTERVAL_S 3600
+/* @[declare_sgp30_baseline_save_interval_s] */
+
+/**
+ * @brief Time the algorithm needs to learn a baseline from scratch. A
+ * baseline is only saved before this if one was restored at boot.
+ */
+/* @[declare_sgp30_baseline_learn_s] */
+#define SGP30_BASELINE_LEARN_S (12 * 3600)
+/* @[declare_sgp30_baseline_learn_s] */
+
+/**
+ * @brief Supplies ambient conditions for humidity compensation.
+ *
+ * @param[out] temperature_c Temperature in degrees Celsius.
+ * @param[out] humidity_rh Relative humidity in percent.
+ * @return true if both values were filled in.
+ */
+/* @[declare_sgp30_env_source_t] */
+typedef bool (*sgp30_env_source_t)(float *temperature_c, float *humidity_rh);
+/* @[declare_sgp30_env_source_t] */
+
+/**
+ * @brief Initializes the SGP30 and starts its IAQ algorithm.
+ *
+ * Reads the serial number and feature set to verify the sensor responds,
+ * then sends `sgp30_iaq_init`. For the first 15 seconds after this call
+ * the sensor returns fixed values of 400 ppm eCO2 and 0 ppb TVOC.
+ *
+ * **Example:**
+ * @code{c}
+ *  Core2ForAWS_Port_PinMode(PORT_A_SDA_PIN, I2C);
+ *  Core2ForAWS_Port_PinMode(PORT_A_SCL_PIN, I2C);
+ *  I2CDevice_t port_a = Core2ForAWS_Port_A_I2C_Begin(SGP30_ADDR, PORT_A_I2C_STANDARD_BAUD);
+ *  SGP30_Init(port_a);
+ * @endcode
+ *
+ * @param[in] device The I2C device the SGP30 is attached to.
+ * @return [esp_err_t](https://docs.espressif.com/projects/esp-idf/en/release-v4.2/esp32/api-reference/system/esp_err.html#macros). 0 or `ESP_OK` if successful.
+ */
+/* @[declare_sgp30_init] */
+esp_err_t SGP30_Init(I2CDevice_t device);
+/* @[declare_sgp30_init] */
+
+/**
+ * @brief Runs `sgp30_measure_iaq`.
+ *
+ * @param[out] tvoc TVOC concentration in ppb.
+ * @param[out] eco2 CO2 equivalent concentration in ppm.
+ * @return `ESP_OK` if successful, `ESP_ERR_INVALID_CRC` if a word failed
+ * its CRC check, or the I2C error.
+ */
+/* @[declare_sgp30_measureiaq] */
+esp_err_t SGP30_MeasureIAQ(uint16_t *tvoc, uint16_t *eco2);
+/* @[declare_sgp30_measureiaq] */
+
+/**
+ * @brief Runs `sgp30_measure_raw`.
+ *
+ * @param[out] raw_h2 Raw H2 signal.
+ * @param[out] raw_ethanol Raw ethanol signal.
+ * @return `ESP_OK` if successful, `ESP_ERR_INVALID_CRC` if a word failed
+ * its CRC check, or the I2C error.
+ */
+/* @[declare_sgp30_measureraw] */
+esp_err_t SGP30_MeasureRaw(uint16_t *raw_h2, uint16_t *raw_ethanol);
+/* @[declare_sgp30_measureraw] */
+
+/**
+ * @brief Runs a burst of `sgp30_measure_iaq` and `sgp30_measure_raw`
+ * and fills in a complete sample.
+ *
+ * @note The timestamp field is left untouched.
+ *
+ * @param[out] sample The measured values.
+ * @return `ESP_OK` if successful, otherwise the first error encountered.
+ */
+/* @[declare_sgp30_measureburst] */
+esp_err_t SGP30_MeasureBurst(sgp30_sample_t *sample);
+/* @[declare_sgp30_measureburst] */
+
+/**
+ * @brief Retrieves the 48-bit serial number of the SGP30.
+ *
+ * @param[out] serial The serial number.
+ * @return `ESP_OK` if successful.
+ */
+/* @[declare_sgp30_getserial] */
+esp_err_t SGP30_GetSerial(uint64_t *serial);
+/* @[declare_sgp30_getserial] */
+
+/**
+ * @brief Converts temperature and relative humidity to absolute humidity
+ * using the Magnus formula from the SGP30 datasheet.
+ *
+ * @param[in] temperature_c Temperature in degrees Celsius.
+ * @param[in] humidity_rh Relative humidity in percent.
+ * @return Absolute humidity in mg/m^3.
+ */
+/* @[declare_sgp30_absolutehumidity] */
+uint32_t SGP30_AbsoluteHumidity(float temperature_c, float humidity_rh);
+/* @[declare_sgp30_absolutehumidity] */
+
+/**
+ * @brief Runs `sgp30_set_absolute_humidity` so the IAQ algorithm
+ * compensates for the current humidity.
+ *
+ * @param[in] abs_humidity_mg_m3 Absolute humidity in mg/m^3, 0 turns
+ * compensation off. Values above 255999 are clamped.
+ * @return `ESP_OK` if successful.
+ */
+/* @[declare_sgp30_setabsolutehumidity] */
+esp_err_t SGP30_SetAbsoluteHumidity(uint32_t abs_humidity_mg_m3);
+/* @[declare_sgp30_setabsolutehumidity] */
+
+/**
+ * @brief Runs `sgp30_get_iaq_baseline`.
+ *
+ * @param[out] eco2 eCO2 baseline.
+ * @param[out] tvoc TVOC baseline.
+ * @return `ESP_OK` if successful.
+ */
+/* @[declare_sgp30_getbaseline] */
+esp_err_t SGP30_GetBaseline(uint16_t *eco2, uint16_t *tvoc);
+/* @[declare_sgp30_getbaseline] */
+
+/**
+ * @brief Runs `sgp30_set_iaq_baseline`. Must follow `sgp30_iaq_init`.
+ *
+ * @param[in] eco2 eCO2 baseline.
+ * @param[in] tvoc TVOC baseline.
+ * @return `ESP_OK` if successful.
+ */
+/* @[declare_sgp30_setbaseline] */
+esp_err_t SGP30_SetBaseline(uint16_t eco2, uint16_t tvoc);
+/* @[declare_sgp30_setbaseline] */
+
+/**
+ * @brief Reads the current IAQ baseline and stores it in NVS.
+ *
+ * @note NVS must have been initialized with nvs_flash_init().
+ *
+ * @return `ESP_OK` if successful.
+ */
+/* @[declare_sgp30_savebaseline] */
+esp_err_t SGP30_SaveBaseline(void);
+/* @[declare_sgp30_savebaseline] */
+
+/**
+ * @brief Writes the baseline stored in NVS back to the sensor.
+ *
+ * SGP30_Init() calls this, so a sensor that ran long enough before the
+ * last power cycle gives comparable readings right away instead of
+ * re-learning for 12 hours.
+ *
+ * @return `ESP_OK` if restored, `ESP_ERR_NVS_NOT_FOUND` if nothing was
+ * saved yet.
+ */
+/* @[declare_sgp30_restorebaseline] */
+esp_err_t SGP30_RestoreBaseline(void);
+/* @[declare_sgp30_restorebaseline] */
+
+/**
+ * @brief Sets where the measurement task gets temperature and humidity
+ * for compensation. Called every SGP30_HUMIDITY_INTERVAL_MS.
+ *
+ * **Example:**
+ * @code{c}
+ *  static bool room_env(float *temperature_c, float *humidity_rh) {
+ *      return SHT30_Read(temperature_c, humidity_rh) == ESP_OK;
+ *  }
+ *
+ *  SGP30_SetEnvSource(room_env);
+ * @endcode
+ *
+ * @param[in] source The source, or NULL to stop compensating.
+ */
+/* @[declare_sgp30_setenvsource] */
+void SGP30_SetEnvSource(sgp30_env_source_t source);
+/* @[declare_sgp30_setenvsource] */
+
+/**
+ * @brief Calculates the Sensirion CRC-8 (polynomial 0x31, init 0xFF)
+ * of a data word.
+ *
+ * @param[in] data Bytes to checksum.
+ * @param[in] length Number of bytes.
+ * @return The CRC.
+ */
+/* @[declare_sgp30_crc8] */
+uint8_t SGP30_CRC8(const uint8_t *data, uint8_t length);
+/* @[declare_sgp30_crc8] */
+
+/**
+ * @brief Adds a scheduler job that measures at SGP30_MEASURE_INTERVAL_MS
+ * and publishes timestamped samples to the ring returned by SGP30_GetRing().
+ *
+ * The job also refreshes the humidity compensation from the source set
+ * with SGP30_SetEnvSource() and saves the baseline to NVS every
+ * SGP30_BASELINE_SAVE_INTERVAL_S once it is valid.
+ *
+ * Each command and each read is handed to the I2C bus task and picked
+ * up by a later run, so the scheduler task never waits for the sensor's
+ * conversion time or for the bus. The blocking calls above are for use
+ * outside the scheduler task.
+ *
+ * @note SGP30_Init() must have succeeded first, and the scheduler must
+ * be running, Core2ForAWS_Init() starts it.
+ *
+ * @return `ESP_OK` if the job was added.
+ */
+/* @[declare_sgp30_start] */
+esp_err_t SGP30_Start(void);
+/* @[declare_sgp30_start] */
+
+/**
+ * @brief The ring the measurement task publishes to.
+ *
+ * Readers may call sgp30_ring_latest() on it from any task without
+ * taking a lock.
+ *
+ * @return The sample ring.
+ */
+/* @[declare_sgp30_getring] */
+sgp30_ring_t *SGP30_GetRing(void);
+/* @[declare_sgp30_getring] */
+
+#ifdef __cplusplus
+}
+#endif
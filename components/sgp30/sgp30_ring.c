@@ -0,0 +1,79 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "sgp30_ring.h"
+
+#define RING_MASK (SGP30_RING_SIZE - 1)
+#define READ_RETRIES 4
+
+_Static_assert((SGP30_RING_SIZE & RING_MASK) == 0, "SGP30_RING_SIZE must be a power of two");
+
+void sgp30_ring_init(sgp30_ring_t *ring) {
+    memset(ring, 0, sizeof(sgp30_ring_t));
+    atomic_init(&ring->head, 0);
+    for (int i = 0; i < SGP30_RING_SIZE; i++) {
+        atomic_init(&ring->slots[i].seq, 0);
+    }
+}
+
+void sgp30_ring_publish(sgp30_ring_t *ring, const sgp30_sample_t *sample) {
+    uint32_t pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    sgp30_ring_slot_t *slot = &ring->slots[pos & RING_MASK];
+    uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+
+    // Odd sequence marks the slot as being written
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    slot->pos = pos;
+    slot->sample = *sample;
+
+    atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+    atomic_store_explicit(&ring->head, pos + 1, memory_order_release);
+}
+
+static bool read_slot(sgp30_ring_t *ring, uint32_t pos, sgp30_sample_t *out) {
+    sgp30_ring_slot_t *slot = &ring->slots[pos & RING_MASK];
+    // Bounded so a high priority reader never spins on a preempted producer
+    for (int attempt = 0; attempt < READ_RETRIES; attempt++) {
+        uint32_t seq_before = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq_before & 1) {
+            continue;
+        }
+
+        uint32_t slot_pos = slot->pos;
+        *out = slot->sample;
+
+        atomic_thread_fence(memory_order_acquire);
+        uint32_t seq_after = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+        if (seq_before == seq_after) {
+            // A different position means the producer has lapped this reader
+            return slot_pos == pos;
+        }
+    }
+    return false;
+}
+
+size_t sgp30_ring_latest(sgp30_ring_t *ring, sgp30_sample_t *out, size_t count) {
+    if (ring == NULL || out == NULL) {
+        return 0;
+    }
+
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t available = head < SGP30_RING_SIZE ? head : SGP30_RING_SIZE;
+    if (count > available) {
+        count = available;
+    }
+
+    size_t copied = 0;
+    for (; copied < count; copied++) {
+        if (!read_slot(ring, head - 1 - copied, &out[copied])) {
+            break;
+        }
+    }
+    return copied;
+}
+
+uint32_t sgp30_ring_count(sgp30_ring_t *ring) {
+    return atomic_load_explicit(&ring->head, memory_order_acquire);
+}
@@ -0,0 +1,121 @@
+/**
+ * @file sgp30_ring.h
+ * @brief Lock-free single-producer/multi-consumer ring of SGP30 samples.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+/**
+ * @brief Number of samples kept in the ring. Must be a power of two.
+ *
+ * At the SGP30's 1 Hz cadence this holds a little over four minutes
+ * of history.
+ */
+/* @[declare_sgp30_ring_size] */
+#define SGP30_RING_SIZE 256
+/* @[declare_sgp30_ring_size] */
+
+/**
+ * @brief A single timestamped SGP30 measurement.
+ */
+/* @[declare_sgp30_sample_t] */
+typedef struct {
+    /*@{*/
+    int64_t timestamp_us;   /**< @brief Time of the measurement, from timekeeping_now_us(). */
+    uint16_t tvoc;          /**< @brief Total volatile organic compounds in ppb. */
+    uint16_t eco2;          /**< @brief CO2 equivalent in ppm. */
+    uint16_t raw_h2;        /**< @brief Raw H2 signal. */
+    uint16_t raw_ethanol;   /**< @brief Raw ethanol signal. */
+    /*@}*/
+} sgp30_sample_t;
+/* @[declare_sgp30_sample_t] */
+
+typedef struct {
+    atomic_uint_least32_t seq;
+    uint32_t pos;
+    sgp30_sample_t sample;
+} sgp30_ring_slot_t;
+
+/**
+ * @brief The sample ring.
+ *
+ * Exactly one task may call sgp30_ring_publish() on a ring. Any number of
+ * tasks, on either core, may read from it at the same time without taking
+ * a lock. Each slot is guarded by a sequence counter, so a reader that
+ * races with the producer simply retries that slot.
+ */
+/* @[declare_sgp30_ring_t] */
+typedef struct {
+    atomic_uint_least32_t head;
+    sgp30_ring_slot_t slots[SGP30_RING_SIZE];
+} sgp30_ring_t;
+/* @[declare_sgp30_ring_t] */
+
+/**
+ * @brief Clears the ring. Must not race with readers or the producer.
+ *
+ * @param[in] ring The ring to reset.
+ */
+/* @[declare_sgp30_ring_init] */
+void sgp30_ring_init(sgp30_ring_t *ring);
+/* @[declare_sgp30_ring_init] */
+
+/**
+ * @brief Appends a sample, overwriting the oldest one when the ring is full.
+ *
+ * @note Only one task may publish to a given ring.
+ *
+ * @param[in] ring The ring to write to.
+ * @param[in] sample The sample to append.
+ */
+/* @[declare_sgp30_ring_publish] */
+void sgp30_ring_publish(sgp30_ring_t *ring, const sgp30_sample_t *sample);
+/* @[declare_sgp30_ring_publish] */
+
+/**
+ * @brief Copies up to the latest `count` samples, newest first.
+ *
+ * **Example:**
+ *
+ * Print the five most recent TVOC readings.
+ * @code{c}
+ *  sgp30_sample_t samples[5];
+ *  size_t n = sgp30_ring_latest(SGP30_GetRing(), samples, 5);
+ *  for (size_t i = 0; i < n; i++) {
+ *      printf("%lld: %u ppb\n", samples[i].timestamp_us, samples[i].tvoc);
+ *  }
+ * @endcode
+ *
+ * @param[in] ring The ring to read from.
+ * @param[out] out Buffer for at least `count` samples.
+ * @param[in] count Maximum number of samples to copy.
+ * @return The number of samples copied.
+ */
+/* @[declare_sgp30_ring_latest] */
+size_t sgp30_ring_latest(sgp30_ring_t *ring, sgp30_sample_t *out, size_t count);
+/* @[declare_sgp30_ring_latest] */
+
+/**
+ * @brief Total number of samples published since sgp30_ring_init().
+ *
+ * Readers can compare this against a previously seen value to detect
+ * new samples without copying any.
+ *
+ * @param[in] ring The ring to query.
+ * @return The number of samples published (wraps at 2^32).
+ */
+/* @[declare_sgp30_ring_count] */
+uint32_t sgp30_ring_count(sgp30_ring_t *ring);
+/* @[declare_sgp30_ring_count] */
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,73 @@
+#include <string.h>
+
+#include "clock_discipline.h"
+
+static int32_t clamp_ppb(int64_t ppb) {
+    if (ppb > CLOCK_DISCIPLINE_MAX_PPB) {
+        return CLOCK_DISCIPLINE_MAX_PPB;
+    }
+    if (ppb < -CLOCK_DISCIPLINE_MAX_PPB) {
+        return -CLOCK_DISCIPLINE_MAX_PPB;
+    }
+    return (int32_t)ppb;
+}
+
+void clock_discipline_init(clock_discipline_t *cd) {
+    memset(cd, 0, sizeof(clock_discipline_t));
+}
+
+int64_t clock_discipline_now(const clock_discipline_t *cd, int64_t mono_us) {
+    if (!cd->synced) {
+        return mono_us;
+    }
+    int64_t elapsed = mono_us - cd->base_mono_us;
+    return cd->base_wall_us + elapsed + elapsed * cd->rate_ppb / 1000000000LL;
+}
+
+int64_t clock_discipline_update(clock_discipline_t *cd, int64_t mono_us, int64_t ref_wall_us, int64_t slew_us) {
+    cd->updates++;
+
+    if (!cd->synced) {
+        cd->synced = true;
+        cd->base_mono_us = mono_us;
+        cd->base_wall_us = ref_wall_us;
+        cd->last_ref_mono_us = mono_us;
+        cd->rate_ppb = 0;
+        cd->freq_ppb = 0;
+        cd->last_error_us = 0;
+        return 0;
+    }
+
+    int64_t estimate = clock_discipline_now(cd, mono_us);
+    int64_t error = ref_wall_us - estimate;
+    cd->last_error_us = error;
+
+    if (error > CLOCK_DISCIPLINE_STEP_US || error < -CLOCK_DISCIPLINE_STEP_US) {
+        // Too far off to be drift, someone set the reference clock
+        cd->steps++;
+        cd->base_mono_us = mono_us;
+        cd->base_wall_us = ref_wall_us;
+        cd->last_ref_mono_us = mono_us;
+        cd->rate_ppb = cd->freq_ppb;
+        return error;
+    }
+
+    // Whatever error built up since the last reference, minus what the
+    // slew was meant to remove, is frequency error. Take half of it so a
+    // single noisy reading (the RTC only resolves whole seconds) can not
+    // swing the estimate too far.
+    int64_t since_ref = mono_us - cd->last_ref_mono_us;
+    if (since_ref > 0) {
+        int64_t implied_ppb = error * 1000000000LL / since_ref;
+        cd->freq_ppb = clamp_ppb(cd->freq_ppb + implied_ppb / 2);
+    }
+
+    // Rebase at the current estimate so the output stays continuous, then
+    // run fast or slow until the offset is gone
+    int64_t slew_ppb = slew_us > 0 ? error * 1000000000LL / slew_us : 0;
+    cd->base_mono_us = mono_us;
+    cd->base_wall_us = estimate;
+    cd->rate_ppb = clamp_ppb(cd->freq_ppb + slew_ppb);
+    cd->last_ref_mono_us = mono_us;
+    return error;
+}
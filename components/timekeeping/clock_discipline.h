@@ -0,0 +1,107 @@
+/**
+ * @file clock_discipline.h
+ * @brief Extrapolates wall-clock time from a monotonic counter and
+ * steers it towards occasional reference readings.
+ *
+ * All times are passed in, so the logic can be driven by a fake clock on
+ * a host.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Errors larger than this are stepped instead of slewed, which
+ * is the only case where the output can go backwards.
+ */
+/* @[declare_clock_discipline_step_us] */
+#define CLOCK_DISCIPLINE_STEP_US 2000000
+/* @[declare_clock_discipline_step_us] */
+
+/**
+ * @brief Limit on the frequency estimate and on the total rate
+ * adjustment, in parts per billion.
+ */
+/* @[declare_clock_discipline_max_ppb] */
+#define CLOCK_DISCIPLINE_MAX_PPB 500000
+/* @[declare_clock_discipline_max_ppb] */
+
+/**
+ * @brief Discipline state. Treat as opaque.
+ *
+ * Between updates the output is
+ * `base_wall_us + elapsed + elapsed * rate_ppb / 1e9`, where `elapsed`
+ * is the monotonic time since `base_mono_us`.
+ */
+/* @[declare_clock_discipline_t] */
+typedef struct {
+    bool synced;
+    int64_t base_mono_us;
+    int64_t base_wall_us;
+    int32_t rate_ppb;       // freq_ppb plus the current slew
+    int32_t freq_ppb;       // estimated frequency error of the monotonic clock
+    int64_t last_ref_mono_us;
+    uint32_t updates;
+    uint32_t steps;
+    int64_t last_error_us;
+} clock_discipline_t;
+/* @[declare_clock_discipline_t] */
+
+/**
+ * @brief Resets to unsynced. Until the first update the output equals
+ * the monotonic input.
+ */
+/* @[declare_clock_discipline_init] */
+void clock_discipline_init(clock_discipline_t *cd);
+/* @[declare_clock_discipline_init] */
+
+/**
+ * @brief Wall-clock time at a monotonic instant.
+ *
+ * @param[in] cd The discipline state.
+ * @param[in] mono_us Monotonic time, not earlier than the last update.
+ * @return Microseconds since the epoch once synced.
+ */
+/* @[declare_clock_discipline_now] */
+int64_t clock_discipline_now(const clock_discipline_t *cd, int64_t mono_us);
+/* @[declare_clock_discipline_now] */
+
+/**
+ * @brief Feeds in a reference reading.
+ *
+ * The first update sets the time. Later ones compare the reference with
+ * the extrapolated time, fold half of the implied frequency error into
+ * the frequency estimate, and slew the remaining offset out over
+ * `slew_us` without the output ever going backwards. Offsets beyond
+ * CLOCK_DISCIPLINE_STEP_US are stepped.
+ *
+ * **Example:**
+ * @code{c}
+ *  clock_discipline_t cd;
+ *  clock_discipline_init(&cd);
+ *  clock_discipline_update(&cd, mono_us(), rtc_us(), 3600000000LL);
+ *  ...
+ *  int64_t wall_us = clock_discipline_now(&cd, mono_us());
+ * @endcode
+ *
+ * @param[in] cd The discipline state.
+ * @param[in] mono_us Monotonic time the reference was taken at.
+ * @param[in] ref_wall_us The reference wall-clock time.
+ * @param[in] slew_us Time to spread an offset correction over, normally
+ * the interval until the next update.
+ * @return The offset between the reference and the extrapolated time
+ * before the update, positive if the clock was behind.
+ */
+/* @[declare_clock_discipline_update] */
+int64_t clock_discipline_update(clock_discipline_t *cd, int64_t mono_us, int64_t ref_wall_us, int64_t slew_us);
+/* @[declare_clock_discipline_update] */
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,135 @@
+#include <stdatomic.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+
+#include "core2forAWS.h"
+#include "clock_discipline.h"
+#include "timekeeping.h"
+
+#define TAG "TIMEKEEPING"
+
+#define EDGE_POLL_MS 5
+#define EDGE_TIMEOUT_MS 1200
+
+// Double buffered: the sync task prepares the copy readers are not using
+// and then bumps the generation, so readers never wait on the writer
+static clock_discipline_t discipline[2];
+static atomic_uint_least32_t discipline_gen;
+static TaskHandle_t timekeeping_task_handle;
+
+#if CONFIG_SOFTWARE_RTC_SUPPORT
+// Days since 1970-01-01 for a proleptic Gregorian date
+static int64_t days_from_civil(int32_t y, uint32_t m, uint32_t d) {
+    y -= m <= 2;
+    int32_t era = (y >= 0 ? y : y - 399) / 400;
+    uint32_t yoe = (uint32_t)(y - era * 400);
+    uint32_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return (int64_t)era * 146097 + doe - 719468;
+}
+
+static int64_t rtc_to_epoch_us(const rtc_date_t *date) {
+    int64_t days = days_from_civil(date->year, date->month, date->day);
+    int64_t seconds = days * 86400 + date->hour * 3600 + date->minute * 60 + date->second;
+    return seconds * 1000000;
+}
+
+// The RTC only counts whole seconds. Wait for the next tick so the
+// reading lines up with esp_timer to within a poll interval.
+static esp_err_t read_rtc_edge(int64_t *mono_us, int64_t *wall_us) {
+    rtc_date_t first, now;
+    BM8563_GetTime(&first);
+    int64_t deadline_us = esp_timer_get_time() + EDGE_TIMEOUT_MS * 1000;
+
+    do {
+        vTaskDelay(pdMS_TO_TICKS(EDGE_POLL_MS));
+        BM8563_GetTime(&now);
+        if (now.second != first.second) {
+            *mono_us = esp_timer_get_time();
+            *wall_us = rtc_to_epoch_us(&now);
+            return ESP_OK;
+        }
+    } while (esp_timer_get_time() < deadline_us);
+
+    return ESP_ERR_TIMEOUT;
+}
+
+static void timekeeping_sync(void) {
+    int64_t mono_us, wall_us;
+    esp_err_t err = read_rtc_edge(&mono_us, &wall_us);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "RTC seconds did not advance, skipping sync");
+        return;
+    }
+
+    uint32_t gen = atomic_load_explicit(&discipline_gen, memory_order_relaxed);
+    clock_discipline_t *next = &discipline[(gen + 1) & 1];
+    *next = discipline[gen & 1];
+
+    int64_t error = clock_discipline_update(next, mono_us, wall_us, (int64_t)TIMEKEEPING_RESYNC_INTERVAL_S * 1000000);
+
+    atomic_store_explicit(&discipline_gen, gen + 1, memory_order_release);
+
+    ESP_LOGI(TAG, "Synced to RTC, offset %lld us, frequency %d ppb", error, next->freq_ppb);
+}
+
+static void timekeeping_task(void *arg) {
+    for (;;) {
+        timekeeping_sync();
+        vTaskDelay(pdMS_TO_TICKS(TIMEKEEPING_RESYNC_INTERVAL_S * 1000));
+    }
+}
+
+esp_err_t timekeeping_start(void) {
+    if (timekeeping_task_handle != NULL) {
+        return ESP_OK;
+    }
+    clock_discipline_init(&discipline[0]);
+    clock_discipline_init(&discipline[1]);
+    atomic_init(&discipline_gen, 0);
+
+    BaseType_t ret = xTaskCreatePinnedToCore(timekeeping_task, "TimekeepingTask", 2 * 1024, NULL, 2, &timekeeping_task_handle, 1);
+    return ret == pdPASS ? ESP_OK : ESP_ERR_NO_MEM;
+}
+#else
+esp_err_t timekeeping_start(void) {
+    // Without the RTC there is nothing to sync to, timestamps stay on esp_timer
+    return ESP_ERR_NOT_SUPPORTED;
+}
+#endif
+
+static void discipline_snapshot(clock_discipline_t *snapshot) {
+    uint32_t gen;
+    do {
+        gen = atomic_load_explicit(&discipline_gen, memory_order_acquire);
+        *snapshot = discipline[gen & 1];
+        atomic_thread_fence(memory_order_acquire);
+        // Only a completed sync in between can change the generation
+    } while (atomic_load_explicit(&discipline_gen, memory_order_relaxed) != gen);
+}
+
+int64_t timekeeping_now_us(void) {
+    clock_discipline_t snapshot;
+    discipline_snapshot(&snapshot);
+    return clock_discipline_now(&snapshot, esp_timer_get_time());
+}
+
+bool timekeeping_is_synced(void) {
+    clock_discipline_t snapshot;
+    discipline_snapshot(&snapshot);
+    return snapshot.synced;
+}
+
+void timekeeping_get_stats(timekeeping_stats_t *stats) {
+    clock_discipline_t snapshot;
+    discipline_snapshot(&snapshot);
+    stats->syncs = snapshot.updates;
+    stats->steps = snapshot.steps;
+    stats->last_error_us = snapshot.last_error_us;
+    stats->freq_ppb = snapshot.freq_ppb;
+}
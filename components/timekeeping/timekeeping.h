@@ -0,0 +1,89 @@
+/**
+ * @file timekeeping.h
+ * @brief Cheap wall-clock timestamps disciplined against the BM8563 RTC.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+/**
+ * @brief How often the RTC is read again to correct drift.
+ */
+/* @[declare_timekeeping_resync_interval_s] */
+#define TIMEKEEPING_RESYNC_INTERVAL_S 3600
+/* @[declare_timekeeping_resync_interval_s] */
+
+/**
+ * @brief Counters describing how well the clock is tracking the RTC.
+ */
+/* @[declare_timekeeping_stats_t] */
+typedef struct {
+    /*@{*/
+    uint32_t syncs;         /**< @brief RTC reads folded into the clock. */
+    uint32_t steps;         /**< @brief Corrections too large to slew. */
+    int64_t last_error_us;  /**< @brief Offset found at the last sync. */
+    int32_t freq_ppb;       /**< @brief Estimated esp_timer frequency error. */
+    /*@}*/
+} timekeeping_stats_t;
+/* @[declare_timekeeping_stats_t] */
+
+/**
+ * @brief Starts a FreeRTOS task that reads the RTC right away and then
+ * every TIMEKEEPING_RESYNC_INTERVAL_S.
+ *
+ * Each sync polls the RTC until its seconds register ticks over, to pin
+ * the reading to the second boundary, so it takes up to a second of
+ * I2C traffic. Nothing else reads the RTC on the sampling path.
+ *
+ * @note BM8563_Init() must have run, Core2ForAWS_Init() does that.
+ * @note The RTC is assumed to hold UTC.
+ *
+ * @return `ESP_OK` if the task was created, `ESP_ERR_NOT_SUPPORTED` if
+ * RTC support is disabled in menuconfig.
+ */
+/* @[declare_timekeeping_start] */
+esp_err_t timekeeping_start(void);
+/* @[declare_timekeeping_start] */
+
+/**
+ * @brief Current wall-clock time.
+ *
+ * Costs one esp_timer_get_time() and a few multiplies, and takes no
+ * lock, so it is safe to call per sample from any task on either core.
+ * Never goes backwards unless the RTC is set to a time more than two
+ * seconds away.
+ *
+ * @return Microseconds since 1970-01-01 UTC once synced, microseconds
+ * since boot before that.
+ */
+/* @[declare_timekeeping_now_us] */
+int64_t timekeeping_now_us(void);
+/* @[declare_timekeeping_now_us] */
+
+/**
+ * @brief Whether timekeeping_now_us() returns wall-clock time yet.
+ */
+/* @[declare_timekeeping_is_synced] */
+bool timekeeping_is_synced(void);
+/* @[declare_timekeeping_is_synced] */
+
+/**
+ * @brief Copies the current tracking counters.
+ *
+ * @param[out] stats The counters.
+ */
+/* @[declare_timekeeping_get_stats] */
+void timekeeping_get_stats(timekeeping_stats_t *stats);
+/* @[declare_timekeeping_get_stats] */
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,322 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "core2forAWS.h"
+#include "changepoint.h"
+#include "sgp30.h"
+#include "sensor_array.h"
+#include "spsc_queue.h"
+#include "recording.h"
+#include "timekeeping.h"
+#include "gas_array.h"
+
+#define TAG "GAS_ARRAY"
+
+_Static_assert(GAS_CH_COUNT <= SENSOR_ARRAY_CHANNELS, "CONFIG_SENSOR_ARRAY_CHANNELS too small for the gas array");
+_Static_assert(SENSOR_ARRAY_FRAME_LEN >= 2 * FEATURE_BANDS,
+               "CONFIG_SENSOR_ARRAY_FRAME_LEN must be at least 16 for feature extraction");
+
+// Samples kept from before an onset, so the first eighth of the window
+// is baseline the way feature_extract() expects
+#define CAPTURE_LEAD (SENSOR_ARRAY_FRAME_LEN / 8)
+
+// One sample of every channel, on its way from the scheduler task to the
+// feature stage
+typedef struct {
+    float values[GAS_CH_COUNT];
+    int64_t time_us;        // when it was read, from timekeeping_now_us()
+    int64_t queued_us;
+} gas_sample_t;
+
+static feature_plan_t feature_plan;
+// Written by the feature stage, read by the GUI
+static atomic_uint captures;
+static atomic_bool exposed;
+
+// Sensing (scheduler task) -> features (feature task) -> windows
+// (whoever set the consumer)
+static gas_sample_t sample_slots[GAS_SAMPLE_QUEUE_LEN];
+static spsc_queue_t sample_queue;
+static pipeline_stage_t feature_stage;
+static TaskHandle_t feature_task_handle;
+static spsc_queue_t *window_queue;
+static TaskHandle_t window_consumer;
+
+// Smallest change per channel worth noticing, in the channel's units.
+// eCO2 sits on its 400 ppm clamp in clean air and steps by a few ppm when
+// the baseline moves, so it needs more than the rest; bench/
+// changepoint_replay measures the trade-off over a session
+static const float noise_floor[GAS_CH_COUNT] = {
+    [GAS_CH_TVOC] = 2.0f,        // ppb
+    [GAS_CH_ECO2] = 3.0f,        // ppm
+    [GAS_CH_RAW_H2] = 2.0f,      // raw ticks
+    [GAS_CH_RAW_ETHANOL] = 2.0f, // raw ticks
+    [GAS_CH_PORT_B_ADC] = 1.0f,  // mV
+};
+
+// Units of one code in a recording: the SGP30 reports whole ppb, ppm and
+// ticks, the decimated ADC has a fraction of a mV to spare
+static const recording_channel_t recording_channels[GAS_CH_COUNT] = {
+    [GAS_CH_TVOC] = {"tvoc", 1.0f},
+    [GAS_CH_ECO2] = {"eco2", 1.0f},
+    [GAS_CH_RAW_H2] = {"raw_h2", 1.0f},
+    [GAS_CH_RAW_ETHANOL] = {"raw_ethanol", 1.0f},
+    [GAS_CH_PORT_B_ADC] = {"port_b_adc", 0.1f},
+};
+// Read from the secure element once at start, empty without one
+static char device_serial[RECORDING_SERIAL_LEN];
+
+// Only touched on the feature task
+static changepoint_t detectors[GAS_CH_COUNT];
+static float history[GAS_CH_COUNT][SENSOR_ARRAY_FRAME_LEN];     // ring, sample n at n % FRAME_LEN
+static float window[GAS_CH_COUNT][SENSOR_ARRAY_FRAME_LEN] __attribute__((aligned(16)));
+static uint32_t sample_count;
+static bool armed = true;       // every channel has rested since the last capture
+static bool capturing;
+static uint32_t capture_start;
+static recording_encoder_t recorder;
+static bool recording;
+static gas_window_t captured;
+
+// The SGP30 job owns the sensor, the array only picks up its latest sample
+static esp_err_t gas_read_sgp30(void *ctx, float *value) {
+    sgp30_sample_t sample;
+    if (sgp30_ring_latest(SGP30_GetRing(), &sample, 1) != 1) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    switch ((gas_channel_t)(intptr_t)ctx) {
+    case GAS_CH_TVOC: *value = sample.tvoc; break;
+    case GAS_CH_ECO2: *value = sample.eco2; break;
+    case GAS_CH_RAW_H2: *value = sample.raw_h2; break;
+    case GAS_CH_RAW_ETHANOL: *value = sample.raw_ethanol; break;
+    default: return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+static void gas_add_sgp30(gas_channel_t row) {
+    sensor_channel_t channel = {
+        .name = recording_channels[row].name,
+        .read = gas_read_sgp30,
+        .ctx = (void *)(intptr_t)row,
+    };
+    ESP_ERROR_CHECK(sensor_array_add(&channel, NULL));
+}
+
+#if !CONFIG_SOFTWARE_EXPPORTS_SUPPORT
+// Without the expansion ports there is no Port B. Its row stays in the
+// frame at 0, flagged in error_mask, so the features keep their layout.
+static esp_err_t gas_read_absent(void *ctx, float *value) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+#endif
+
+static void gas_extract_features(const float (*rows)[SENSOR_ARRAY_FRAME_LEN], float *features) {
+    // The plan is only used on the feature task, so it needs no lock
+    for (int c = 0; c < GAS_CH_COUNT; c++) {
+        feature_extract(&feature_plan, rows[c], &features[c * FEATURE_PER_CHANNEL]);
+    }
+}
+
+void gas_array_set_window_consumer(spsc_queue_t *queue, TaskHandle_t task) {
+    window_queue = queue;
+    window_consumer = task;
+}
+
+bool gas_array_capture_status(uint32_t *count) {
+    *count = atomic_load(&captures);
+    return atomic_load(&exposed);
+}
+
+void gas_array_stage_stats(pipeline_stage_stats_t *stats) {
+    pipeline_stage_read(&feature_stage, stats);
+}
+
+// Starts the window's recording at capture_start, which is sample n or
+// before it, and catches it up from the history to sample n
+static void gas_record_begin(uint32_t n, int64_t time_us) {
+    recording_header_t header = {
+        .channel_count = GAS_CH_COUNT,
+        .flags = timekeeping_is_synced() ? RECORDING_FLAG_WALL_CLOCK : 0,
+        .sample_period_us = GAS_ARRAY_PERIOD_MS * 1000,
+        .start_time_us = time_us - (int64_t)(n - capture_start) * GAS_ARRAY_PERIOD_MS * 1000,
+    };
+    memcpy(header.serial, device_serial, sizeof(header.serial));
+    recording = recording_encoder_begin(&recorder, &header, recording_channels, GAS_RECORDING_BLOCK,
+                                        captured.recording, sizeof(captured.recording)) == 0;
+    for (uint32_t i = capture_start; recording && i <= n; i++) {
+        float values[GAS_CH_COUNT];
+        for (int c = 0; c < GAS_CH_COUNT; c++) {
+            values[c] = history[c][i % SENSOR_ARRAY_FRAME_LEN];
+        }
+        recording = recording_encoder_add(&recorder, values) == 0;
+    }
+}
+
+// Cuts the window out of the history and queues its features and
+// recording
+static void gas_capture(void) {
+    for (int c = 0; c < GAS_CH_COUNT; c++) {
+        for (int i = 0; i < SENSOR_ARRAY_FRAME_LEN; i++) {
+            window[c][i] = history[c][(capture_start + i) % SENSOR_ARRAY_FRAME_LEN];
+        }
+    }
+    captured.first_sample = capture_start;
+    captured.recording_len = recording ? recording_encoder_finish(&recorder) : 0;
+    gas_extract_features(window, captured.features);
+    captured.queued_us = esp_timer_get_time();
+    if (window_queue == NULL) {
+        ESP_LOGD(TAG, "Nothing consumes windows");
+    } else if (!spsc_queue_push(window_queue, &captured)) {
+        ESP_LOGW(TAG, "Window queue full, dropped the window from sample %u", capture_start);
+    } else {
+        xTaskNotifyGive(window_consumer);
+    }
+    atomic_fetch_add(&captures, 1);
+    ESP_LOGI(TAG, "Captured samples %u to %u", capture_start, capture_start + SENSOR_ARRAY_FRAME_LEN - 1);
+}
+
+// Runs the change-point detectors, O(1) per sample. An onset on any
+// channel opens a window starting a little before it; the window is cut
+// once it is full, and the next one can only open after every channel
+// is back at rest.
+static void gas_process_sample(const float *values, int64_t time_us) {
+    const uint32_t n = sample_count++;
+    bool onset = false, resting = true;
+    uint32_t onset_at = n;
+    for (int c = 0; c < GAS_CH_COUNT; c++) {
+        history[c][n % SENSOR_ARRAY_FRAME_LEN] = values[c];
+        if (changepoint_update(&detectors[c], values[c]) == CHANGEPOINT_ONSET) {
+            onset = true;
+            onset_at = detectors[c].onset < onset_at ? detectors[c].onset : onset_at;
+        }
+        resting = resting && !detectors[c].exposed;
+    }
+
+    if (onset && armed && !capturing) {
+        // The history only reaches back one window
+        uint32_t oldest = n + 1 >= SENSOR_ARRAY_FRAME_LEN ? n + 1 - SENSOR_ARRAY_FRAME_LEN : 0;
+        uint32_t start = onset_at >= CAPTURE_LEAD ? onset_at - CAPTURE_LEAD : 0;
+        capture_start = start > oldest ? start : oldest;
+        capturing = true;
+        armed = false;
+        ESP_LOGI(TAG, "Exposure from sample %u, seen at %u", onset_at, n);
+        gas_record_begin(n, time_us);
+    } else if (capturing && recording) {
+        // The encoder only takes a few operations per channel, so the
+        // window is ready to send as soon as it is cut
+        recording = recording_encoder_add(&recorder, values) == 0;
+    }
+    if (capturing && n + 1 - capture_start >= SENSOR_ARRAY_FRAME_LEN) {
+        capturing = false;
+        gas_capture();
+    }
+    if (resting && !armed && !capturing) {
+        armed = true;
+        ESP_LOGI(TAG, "Back at baseline at sample %u", n);
+    }
+    atomic_store(&exposed, !resting);
+}
+
+// The feature stage, on its own core so capturing a window never holds
+// up the scheduler's touch and sensor jobs or the GUI
+static void gas_feature_task(void *param) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        gas_sample_t sample;
+        while (spsc_queue_pop(&sample_queue, &sample)) {
+            int64_t start_us = esp_timer_get_time();
+            gas_process_sample(sample.values, sample.time_us);
+            pipeline_stage_record(&feature_stage, (uint32_t)(start_us - sample.queued_us),
+                                  (uint32_t)(esp_timer_get_time() - start_us));
+        }
+    }
+}
+
+// The sensing stage, on the scheduler task: hand the sample over and
+// return. A full queue means the feature stage has fallen a whole queue
+// behind; the sample is dropped and counted rather than waited on.
+static void gas_sample_cb(const float *values, int64_t time_us, void *arg) {
+    gas_sample_t sample;
+    memcpy(sample.values, values, sizeof(sample.values));
+    sample.time_us = time_us;
+    sample.queued_us = esp_timer_get_time();
+    if (spsc_queue_push(&sample_queue, &sample)) {
+        xTaskNotifyGive(feature_task_handle);
+    }
+}
+
+static void gas_frame_cb(const sensor_frame_t *frame, void *arg) {
+    ESP_LOGD(TAG, "Frame %u: TVOC %.0f ppb, eCO2 %.0f ppm, ADC %.0f mV", frame->sequence,
+        frame->values[GAS_CH_TVOC][SENSOR_ARRAY_FRAME_LEN - 1],
+        frame->values[GAS_CH_ECO2][SENSOR_ARRAY_FRAME_LEN - 1],
+        frame->values[GAS_CH_PORT_B_ADC][SENSOR_ARRAY_FRAME_LEN - 1]);
+}
+
+esp_err_t gas_array_start(void) {
+#if CONFIG_SOFTWARE_ATECC608_SUPPORT
+    char serial[ATCA_SERIAL_NUM_SIZE * 2 + 1];
+    if (Atecc608_GetSerialString(serial) == ATCA_SUCCESS) {
+        snprintf(device_serial, sizeof(device_serial), "%s", serial);
+    } else {
+        ESP_LOGW(TAG, "No serial number for recordings");
+    }
+#endif
+    spsc_queue_init(&sample_queue, sample_slots, sizeof(gas_sample_t), GAS_SAMPLE_QUEUE_LEN);
+    pipeline_stage_init(&feature_stage, "features", &sample_queue);
+    // Allocated once here, extracting a frame does not touch the heap
+    if (feature_plan_init(&feature_plan, SENSOR_ARRAY_FRAME_LEN, GAS_ARRAY_PERIOD_MS / 1000.0f) != 0) {
+        ESP_LOGE(TAG, "Feature plan for %d samples failed", SENSOR_ARRAY_FRAME_LEN);
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (gas_channel_t row = GAS_CH_TVOC; row <= GAS_CH_RAW_ETHANOL; row++) {
+        gas_add_sgp30(row);
+    }
+
+#if CONFIG_SOFTWARE_EXPPORTS_SUPPORT
+    // MQ-series sensor on port B
+    esp_err_t err = Core2ForAWS_Port_PinMode(PORT_B_ADC_PIN, ADC);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Port B ADC setup failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    // Sound is not used, so I2S0 is free to DMA the ADC
+    err = sensor_adc_stream_start(GAS_ADC_STREAM_RATE, GAS_ADC_DECIMATION_LOG2, 6, 1);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Port B ADC stream failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    sensor_channel_t adc;
+    sensor_channel_port_b_adc_stream(&adc, "port_b_adc");
+#else
+    sensor_channel_t adc = {
+        .name = "port_b_adc",
+        .read = gas_read_absent,
+    };
+#endif
+    ESP_ERROR_CHECK(sensor_array_add(&adc, NULL));
+
+    for (int c = 0; c < GAS_CH_COUNT; c++) {
+        changepoint_config_t config = CHANGEPOINT_CONFIG_DEFAULT(noise_floor[c]);
+        changepoint_init(&detectors[c], &config);
+    }
+    BaseType_t ret = xTaskCreatePinnedToCore(gas_feature_task, "GasFeatureTask", 4 * 1024, NULL,
+                                             GAS_FEATURE_PRIORITY, &feature_task_handle, GAS_FEATURE_CORE);
+    if (ret != pdPASS) {
+        ESP_LOGE(TAG, "Feature task failed to start");
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_ERROR_CHECK(sensor_array_set_sample_cb(gas_sample_cb, NULL));
+
+    return sensor_array_start(GAS_ARRAY_PERIOD_MS, gas_frame_cb, NULL);
+}
@@ -34,15 +34,21 @@
 #include "esp_log.h"
 
 #include "core2forAWS.h"
+#include "gas_array.h"
 #include "global.h"
 #include "home.h"
+#include "identify.h"
 
 
 static const char* TAG = HOME_TAB_NAME;
 static void start_smell_event_handler(lv_obj_t* slider, lv_event_t event);
+static void capture_poll_task(lv_task_t* task);
 lv_obj_t* tabview;
 lv_obj_t* startOver_btn;
 lv_obj_t* startSmelling_label;
+static lv_obj_t* body_label;
+
+#define HOME_BODY_TEXT "I can help identify a smell or you can help me build a collection of smells for other to use as  a reference. \n\n Tap to start smelling"
 
 void display_home_tab(lv_obj_t* tv){
     xSemaphoreTake(xGuiSemaphore, portMAX_DELAY);   // Takes (blocks) the xGuiSemaphore mutex from being read/written by another task.
@@ -62,9 +68,9 @@ void display_home_tab(lv_obj_t* tv){
     lv_label_set_align(tab_title_label, LV_LABEL_ALIGN_CENTER);
     lv_obj_align(tab_title_label, home_tab, LV_ALIGN_IN_TOP_MID, 0, 50);
 
-    lv_obj_t* body_label = lv_label_create(home_tab, NULL);
+    body_label = lv_label_create(home_tab, NULL);
     lv_label_set_long_mode(body_label, LV_LABEL_LONG_BREAK);
-    lv_label_set_static_text(body_label, "I can help identify a smell or you can help me build a collection of smells for other to use as  a reference. \n\n Tap to start smelling");
+    lv_label_set_static_text(body_label, HOME_BODY_TEXT);
     lv_obj_set_width(body_label, 280);
     lv_obj_align(body_label, home_tab, LV_ALIGN_CENTER, 0 , 10);
 
@@ -84,7 +90,9 @@ void display_home_tab(lv_obj_t* tv){
 
     startSmelling_label = lv_label_create(startOver_btn, NULL);
     lv_label_set_static_text(startSmelling_label, "Start");
-    
+
+    // Runs in the GUI task with the semaphore held, like the event handlers
+    lv_task_create(capture_poll_task, 250, LV_TASK_PRIO_LOW, NULL);
 
     xSemaphoreGive(xGuiSemaphore);
     
@@ -96,4 +104,28 @@ static void start_smell_event_handler(lv_obj_t* obj, lv_event_t event){
 
     // Move to user selection screen
     lv_tabview_set_tab_act(tabview, 1, LV_ANIM_OFF); 
-}
\ No newline at end of file
+}
+
+// Follows the gas array's change-point detection: the home screen says so
+// while a smell is coming in, and moves on by itself once it is captured
+static void capture_poll_task(lv_task_t* task){
+    static uint32_t seen_captures;
+    static bool was_exposed;
+    // Keeps the newest classification ready for the Identify button
+    identify_poll();
+    uint32_t captures;
+    bool exposed = gas_array_capture_status(&captures);
+    bool at_home = lv_tabview_get_tab_act(tabview) == 0;
+
+    if (exposed != was_exposed) {
+        was_exposed = exposed;
+        lv_label_set_static_text(body_label, exposed ? "I smell something! Hold it there while I take it in..." : HOME_BODY_TEXT);
+    }
+    if (captures != seen_captures) {
+        seen_captures = captures;
+        if (at_home) {
+            ESP_LOGI(TAG, "Sample %u captured", captures);
+            lv_tabview_set_tab_act(tabview, 1, LV_ANIM_OFF);
+        }
+    }
+}
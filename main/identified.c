@@ -45,6 +45,7 @@ static const char* TAG = IDENTIFIED_TAB_NAME;
 
 lv_obj_t* identified_tab;
 lv_obj_t* tabview;
+static lv_obj_t* result_label;
 
 void display_identified_tab(lv_obj_t* tv, lv_obj_t* core2forAWS_screen_obj){
     xSemaphoreTake(xGuiSemaphore, portMAX_DELAY);
@@ -63,16 +64,16 @@ void display_identified_tab(lv_obj_t* tv, lv_obj_t* core2forAWS_screen_obj){
 
    
     /* Create the sensor information label object */
-    lv_obj_t* body_label = lv_label_create(identified_bg, NULL);
-    lv_label_set_long_mode(body_label, LV_LABEL_LONG_BREAK);
-    lv_label_set_static_text(body_label, "Sample has been identified as :   \n\n with % confidence");
-    lv_obj_set_width(body_label, 252);
-    lv_obj_align(body_label, identified_bg, LV_ALIGN_IN_TOP_LEFT, 0, 10);
+    result_label = lv_label_create(identified_bg, NULL);
+    lv_label_set_long_mode(result_label, LV_LABEL_LONG_BREAK);
+    lv_label_set_static_text(result_label, "Sample has been identified as :   \n\n with % confidence");
+    lv_obj_set_width(result_label, 252);
+    lv_obj_align(result_label, identified_bg, LV_ALIGN_IN_TOP_LEFT, 0, 10);
 
     static lv_style_t body_style;
     lv_style_init(&body_style);
     lv_style_set_text_color(&body_style, LV_STATE_DEFAULT, LV_COLOR_BLACK);
-    lv_obj_add_style(body_label, LV_OBJ_PART_MAIN, &body_style);
+    lv_obj_add_style(result_label, LV_OBJ_PART_MAIN, &body_style);
 
     /* Create the sensor information label object */
     static lv_style_t btn_style;
@@ -103,6 +104,15 @@ static void start_over_event_handler(lv_obj_t* obj, lv_event_t event){
 }
 
 
+// Called from LVGL event handlers, which already hold xGuiSemaphore
+void identified_show_result(const char* label, float confidence){
+    lv_label_set_text_fmt(result_label, "Sample has been identified as :   %s\n\n with %.0f%% confidence", label, confidence * 100.0f);
+}
+
+void identified_show_message(const char* message){
+    lv_label_set_text(result_label, message);
+}
+
 void identified_task(void* pvParameters){
     
 }
\ No newline at end of file
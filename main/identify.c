@@ -0,0 +1,451 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "classifier.h"
+#include "classifier_partition.h"
+#include "fp_store.h"
+#include "gas_array.h"
+#include "identify.h"
+#include "nn_partition.h"
+#include "online_model.h"
+#include "recording.h"
+#include "recording_store.h"
+#include "spsc_queue.h"
+
+#define TAG "IDENTIFY"
+
+// A label the user gave for the window they were shown
+typedef struct {
+    char label[CLASSIFIER_LABEL_LEN];
+    int64_t queued_us;
+    uint32_t window_id;
+} learn_request_t;
+
+// A learnt sample for the collection
+typedef struct {
+    char label[CLASSIFIER_LABEL_LEN];
+    int64_t queued_us;
+    float features[GAS_FEATURE_DIM];
+} store_request_t;
+
+// A classified window, for the GUI
+typedef struct {
+    classifier_result_t result;
+    uint32_t busy_us;
+    uint32_t window_id;
+} identify_event_t;
+
+// A captured window's recording to save on the SD card, labelled if the
+// user gave it a label
+typedef struct {
+    char label[CLASSIFIER_LABEL_LEN];
+    int64_t queued_us;
+    uint32_t recording_len;
+    uint8_t recording[GAS_RECORDING_SIZE];
+} save_request_t;
+
+// A window the classification task still holds, so a label for it finds
+// its features however many windows came after it, up to
+// IDENTIFY_HISTORY_LEN. Its recording is passed on when it is labelled,
+// or unlabelled when the slot is taken by a newer window.
+typedef struct {
+    uint32_t window_id;     // 0 for a slot never used
+    bool learned;           // a label already went into the model
+    bool record_pending;
+    float features[GAS_FEATURE_DIM];
+    save_request_t record;
+} held_window_t;
+
+_Static_assert(IDENTIFY_NN_OFFSET >= FP_STORE_MAP_SIZE && IDENTIFY_NN_OFFSET < FP_STORE_SECOND_SLOT,
+               "the network must sit between the fingerprint collection's slots");
+
+static classifier_model_t model;
+static bool model_ready;
+// Without a model, features are learnt and collected as they come
+static float identity_mean[GAS_FEATURE_DIM];
+static float identity_inv_std[GAS_FEATURE_DIM];
+static fp_store_t collection;
+// Classes learnt from labels the user gave, rebuilt from the collection
+// on start
+static online_model_t learned;
+// Optional, run alongside the classifier when one is flashed. Its answer
+// is only logged, for comparing it with the classifier on the device; it
+// never goes into the result.
+static nn_model_t network;
+static bool network_ready;
+static int8_t network_arena[IDENTIFY_NN_ARENA_SIZE];
+
+// Everything above is only used on the classification task, except the
+// learnt model, which the GUI may read while it is updated.
+// Feature stage -> classification -> GUI and save, GUI ->
+// classification for labels, and classification -> store for the
+// samples learnt. The GUI only ever pushes and pops. Windows and saves
+// carry recordings, so their slots go in PSRAM.
+EXT_RAM_ATTR static gas_window_t window_slots[IDENTIFY_QUEUE_LEN];
+static spsc_queue_t window_queue;
+static learn_request_t learn_slots[IDENTIFY_QUEUE_LEN];
+static spsc_queue_t learn_queue;
+static identify_event_t event_slots[IDENTIFY_QUEUE_LEN];
+static spsc_queue_t event_queue;
+static store_request_t store_slots[IDENTIFY_QUEUE_LEN];
+static spsc_queue_t store_queue;
+EXT_RAM_ATTR static save_request_t save_slots[IDENTIFY_QUEUE_LEN];
+static spsc_queue_t save_queue;
+static pipeline_stage_t classify_stage;
+static pipeline_stage_t store_stage;
+static pipeline_stage_t save_stage;
+static TaskHandle_t classify_task_handle;
+static TaskHandle_t store_task_handle;
+static TaskHandle_t save_task_handle;
+static bool pipeline_started;
+
+// The classification task's newest windows, in slot window_id %
+// IDENTIFY_HISTORY_LEN. Ids start at 1.
+EXT_RAM_ATTR static held_window_t held[IDENTIFY_HISTORY_LEN];
+static uint32_t next_window_id = 1;
+
+// The GUI's copy of the newest result
+static identify_event_t latest;
+static bool latest_valid;
+
+static void replay(const char *label, const float *features, void *arg) {
+    online_model_update(&learned, label, features, NULL);
+}
+
+static esp_err_t identify_pipeline_start(void);
+
+esp_err_t identify_init(void) {
+    esp_err_t model_err = classifier_map_partition(&model, IDENTIFY_MODEL_PARTITION);
+    if (model_err != ESP_OK) {
+        ESP_LOGW(TAG, "No usable model in the %s partition: %s", IDENTIFY_MODEL_PARTITION, esp_err_to_name(model_err));
+    } else if (model.header->dim != GAS_FEATURE_DIM) {
+        ESP_LOGW(TAG, "Model expects %u features, the gas array makes %u", model.header->dim, GAS_FEATURE_DIM);
+        model_err = ESP_ERR_INVALID_SIZE;
+    }
+    model_ready = model_err == ESP_OK;
+
+    // The learnt classes and a new collection are standardised like the
+    // model, so its calibration carries over to them. Without one they
+    // take the features as they are, and never reject.
+    const float *mean = identity_mean, *inv_std = identity_inv_std;
+    for (int i = 0; i < GAS_FEATURE_DIM; i++) {
+        identity_inv_std[i] = 1.0f;
+    }
+    if (model_ready) {
+        mean = model.mean;
+        inv_std = model.inv_std;
+    }
+    if (online_model_init(&learned, GAS_FEATURE_DIM, CLASSIFIER_MAX_CLASSES, mean, inv_std) != 0) {
+        ESP_LOGW(TAG, "No memory to learn new samples");
+    }
+    if (model_ready) {
+        online_model_calibrate(&learned, model.temperature, model.reject_distance);
+    }
+
+    esp_err_t err = fp_store_open(&collection, IDENTIFY_COLLECTION_PARTITION, GAS_FEATURE_DIM, mean, inv_std);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "No fingerprint collection in the %s partition: %s", IDENTIFY_COLLECTION_PARTITION, esp_err_to_name(err));
+    } else {
+        fp_store_for_each(&collection, replay, NULL);
+    }
+
+    err = nn_map_partition(&network, IDENTIFY_NN_PARTITION, IDENTIFY_NN_OFFSET, network_arena, sizeof(network_arena));
+    if (err != ESP_OK) {
+        ESP_LOGI(TAG, "No network in the %s partition: %s", IDENTIFY_NN_PARTITION, esp_err_to_name(err));
+    } else if (network.header->input_len * network.header->input_channels != GAS_FEATURE_DIM) {
+        ESP_LOGW(TAG, "Network expects %u x %u inputs, the gas array makes %u",
+                 network.header->input_len, network.header->input_channels, GAS_FEATURE_DIM);
+    } else {
+        network_ready = true;
+    }
+    // Without a model the learnt classes are all there is to classify by
+    return identify_pipeline_start();
+}
+
+
+// Passes a held window's recording on, with the label if it has one
+static void forward_recording(held_window_t *window, const char *label) {
+    if (!window->record_pending) {
+        return;
+    }
+    window->record_pending = false;
+    save_request_t *record = &window->record;
+    snprintf(record->label, sizeof(record->label), "%s", label);
+    recording_set_label(record->recording, record->recording_len, record->label);
+    record->queued_us = esp_timer_get_time();
+    if (spsc_queue_push(&save_queue, record)) {
+        xTaskNotifyGive(save_task_handle);
+    }
+}
+
+static void classify_window(const gas_window_t *window) {
+    const float *features = window->features;
+    // Nothing known yet: the GUI asks for a label
+    classifier_result_t result = {
+        .label = "",
+        .distance = INFINITY,
+    };
+    int64_t start_us = esp_timer_get_time();
+    if (model_ready && classifier_classify(&model, features, &result) != 0) {
+        return;
+    }
+    // Samples the user labelled win where they are nearer than the model
+    classifier_result_t learned_result;
+    if (online_model_classify(&learned, features, &learned_result) == 0 &&
+        learned_result.distance < result.distance) {
+        result = learned_result;
+    }
+    identify_event_t event = {
+        .result = result,
+        .busy_us = (uint32_t)(esp_timer_get_time() - start_us),
+        .window_id = next_window_id++,
+    };
+    held_window_t *slot = &held[event.window_id % IDENTIFY_HISTORY_LEN];
+    // The user never labelled the window this one replaces
+    forward_recording(slot, "");
+    slot->window_id = event.window_id;
+    slot->learned = false;
+    memcpy(slot->features, features, sizeof(slot->features));
+    slot->record.recording_len = window->recording_len;
+    memcpy(slot->record.recording, window->recording, window->recording_len);
+    slot->record_pending = window->recording_len > 0;
+    // Before the logging and the extra searches, so the GUI has it sooner
+    if (!spsc_queue_push(&event_queue, &event)) {
+        ESP_LOGW(TAG, "GUI is not taking results, dropped one");
+    }
+
+    ESP_LOGI(TAG, "%s%s, %.0f%% confidence, distance %.2f, %u us", result.known ? "" : "Unknown, nearest ",
+             result.label, result.confidence * 100.0f, result.distance, event.busy_us);
+
+    if (network_ready) {
+        float scores[NN_MAX_CLASSES];
+        start_us = esp_timer_get_time();
+        int best = nn_model_run(&network, features, scores);
+        uint32_t elapsed_us = (uint32_t)(esp_timer_get_time() - start_us);
+        ESP_LOGI(TAG, "Network: %s, %.0f%% confidence, %u us", network.labels[best],
+                 nn_model_confidence(&network, scores, best) * 100.0f, elapsed_us);
+    }
+
+    fp_store_match_t matches[IDENTIFY_NEIGHBOURS];
+    start_us = esp_timer_get_time();
+    int found = fp_store_search(&collection, features, IDENTIFY_NPROBE, matches, IDENTIFY_NEIGHBOURS);
+    uint32_t elapsed_us = (uint32_t)(esp_timer_get_time() - start_us);
+    for (int i = 0; i < found; i++) {
+        ESP_LOGI(TAG, "Fingerprint %d: %s, distance %.2f", i + 1, matches[i].label, matches[i].distance);
+    }
+    if (found > 0) {
+        ESP_LOGI(TAG, "Searched the collection in %u us", elapsed_us);
+    }
+}
+
+static void learn_window(const learn_request_t *request) {
+    held_window_t *window = &held[request->window_id % IDENTIFY_HISTORY_LEN];
+    if (window->window_id != request->window_id) {
+        ESP_LOGW(TAG, "Window %u is no longer held, %s not learnt", request->window_id, request->label);
+        return;
+    }
+    // Such as "Tell Me" twice before a new result, which would count the
+    // same features twice
+    if (window->learned) {
+        ESP_LOGW(TAG, "Window %u is already learnt, %s not learnt again", request->window_id, request->label);
+        return;
+    }
+    uint32_t learned_count;
+    if (online_model_update(&learned, request->label, window->features, &learned_count) != 0) {
+        ESP_LOGW(TAG, "No room to learn %s", request->label);
+        return;
+    }
+    window->learned = true;
+    ESP_LOGI(TAG, "Learnt sample %u of %s", learned_count, request->label);
+
+    // The model in RAM already has the sample, the collection is what
+    // brings it back after a restart. Adding to it can take seconds when
+    // it is rebuilt, so the store stage does that.
+    store_request_t store = {
+        .queued_us = esp_timer_get_time(),
+    };
+    snprintf(store.label, sizeof(store.label), "%s", request->label);
+    memcpy(store.features, window->features, sizeof(store.features));
+    if (spsc_queue_push(&store_queue, &store)) {
+        xTaskNotifyGive(store_task_handle);
+    } else {
+        ESP_LOGW(TAG, "Collection is not keeping up, %s not kept past a restart", request->label);
+    }
+
+    forward_recording(window, request->label);
+}
+
+// The classification stage. Labels are handled before new windows, so a
+// label goes with the window the user was shown.
+static void identify_classify_task(void *param) {
+    // Too big for the stack with its recording
+    static gas_window_t window;
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        for (;;) {
+            learn_request_t request;
+            int64_t start_us, queued_us;
+            if (spsc_queue_pop(&learn_queue, &request)) {
+                start_us = esp_timer_get_time();
+                queued_us = request.queued_us;
+                learn_window(&request);
+            } else if (spsc_queue_pop(&window_queue, &window)) {
+                start_us = esp_timer_get_time();
+                queued_us = window.queued_us;
+                classify_window(&window);
+            } else {
+                break;
+            }
+            pipeline_stage_record(&classify_stage, (uint32_t)(start_us - queued_us),
+                                  (uint32_t)(esp_timer_get_time() - start_us));
+        }
+    }
+}
+
+// The store stage, below the GUI's priority on its core, so a rebuild
+// of the collection holds up nothing but the samples after it
+static void identify_store_task(void *param) {
+    static store_request_t request;
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        while (spsc_queue_pop(&store_queue, &request)) {
+            int64_t start_us = esp_timer_get_time();
+            fp_store_add(&collection, request.label, request.features);
+            pipeline_stage_record(&store_stage, (uint32_t)(start_us - request.queued_us),
+                                  (uint32_t)(esp_timer_get_time() - start_us));
+        }
+    }
+}
+
+static void log_stage(const pipeline_stage_stats_t *stats) {
+    ESP_LOGI(TAG, "%-8s %6u items, queue %u/%u (max %u, %u dropped), wait %u/%u us, busy %u/%u us (mean/max)",
+             stats->name != NULL ? stats->name : "-", stats->items, stats->depth, stats->capacity,
+             stats->high_water, stats->dropped, stats->wait_mean_us, stats->wait_max_us,
+             stats->busy_mean_us, stats->busy_max_us);
+}
+
+// The save stage, below the GUI's priority on its core, so writing to
+// the SD card can wait for the display's SPI bus. Logs the pipeline's
+// counters when there has been nothing to save for a while.
+static void identify_save_task(void *param) {
+    static save_request_t record;
+    // The card is mounted by the first save, and again after it was
+    // missing or failed, so a card put in later is still used
+    for (;;) {
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(IDENTIFY_STATS_PERIOD_MS)) == 0) {
+            pipeline_stage_stats_t stats[IDENTIFY_STAGE_COUNT];
+            identify_stage_stats(stats);
+            for (int i = 0; i < IDENTIFY_STAGE_COUNT; i++) {
+                log_stage(&stats[i]);
+            }
+            continue;
+        }
+        while (spsc_queue_pop(&save_queue, &record)) {
+            int64_t start_us = esp_timer_get_time();
+            uint32_t number;
+            esp_err_t err = recording_store_save(record.recording, record.recording_len, &number);
+            if (err == ESP_OK) {
+                ESP_LOGI(TAG, "Saved recording %u, %u bytes, %s", number, record.recording_len,
+                         record.label[0] != '\0' ? record.label : "unlabelled");
+            } else if (err != ESP_ERR_INVALID_STATE) {
+                ESP_LOGW(TAG, "Could not save a recording: %s", esp_err_to_name(err));
+            }
+            pipeline_stage_record(&save_stage, (uint32_t)(start_us - record.queued_us),
+                                  (uint32_t)(esp_timer_get_time() - start_us));
+        }
+    }
+}
+
+static esp_err_t identify_pipeline_start(void) {
+    spsc_queue_init(&window_queue, window_slots, sizeof(gas_window_t), IDENTIFY_QUEUE_LEN);
+    spsc_queue_init(&learn_queue, learn_slots, sizeof(learn_request_t), IDENTIFY_QUEUE_LEN);
+    spsc_queue_init(&event_queue, event_slots, sizeof(identify_event_t), IDENTIFY_QUEUE_LEN);
+    spsc_queue_init(&store_queue, store_slots, sizeof(store_request_t), IDENTIFY_QUEUE_LEN);
+    spsc_queue_init(&save_queue, save_slots, sizeof(save_request_t), IDENTIFY_QUEUE_LEN);
+    pipeline_stage_init(&classify_stage, "classify", &window_queue);
+    pipeline_stage_init(&store_stage, "store", &store_queue);
+    pipeline_stage_init(&save_stage, "save", &save_queue);
+
+    BaseType_t ret = xTaskCreatePinnedToCore(identify_save_task, "SaveTask", 3 * 1024, NULL,
+                                             IDENTIFY_SAVE_PRIORITY, &save_task_handle, IDENTIFY_SAVE_CORE);
+    if (ret != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    ret = xTaskCreatePinnedToCore(identify_store_task, "StoreTask", 3 * 1024, NULL,
+                                  IDENTIFY_STORE_PRIORITY, &store_task_handle, IDENTIFY_STORE_CORE);
+    if (ret != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    ret = xTaskCreatePinnedToCore(identify_classify_task, "ClassifyTask", 6 * 1024, NULL,
+                                  IDENTIFY_PRIORITY, &classify_task_handle, IDENTIFY_CORE);
+    if (ret != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    gas_array_set_window_consumer(&window_queue, classify_task_handle);
+    pipeline_started = true;
+    return ESP_OK;
+}
+
+void identify_poll(void) {
+    identify_event_t event;
+    while (spsc_queue_pop(&event_queue, &event)) {
+        latest = event;
+        latest_valid = true;
+    }
+}
+
+esp_err_t identify_sample(classifier_result_t *result, uint32_t *latency_us) {
+    if (!pipeline_started) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    identify_poll();
+    if (!latest_valid) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    *result = latest.result;
+    if (latency_us != NULL) {
+        *latency_us = latest.busy_us;
+    }
+    return ESP_OK;
+}
+
+esp_err_t identify_learn(const char *label) {
+    if (!pipeline_started) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    identify_poll();
+    if (!latest_valid) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    learn_request_t request = {
+        .queued_us = esp_timer_get_time(),
+        .window_id = latest.window_id,
+    };
+    snprintf(request.label, sizeof(request.label), "%s", label);
+    if (!spsc_queue_push(&learn_queue, &request)) {
+        return ESP_ERR_NO_MEM;
+    }
+    xTaskNotifyGive(classify_task_handle);
+    return ESP_OK;
+}
+
+uint32_t identify_label_count(const char *label) {
+    // The learnt model takes readers on any task while it is updated
+    return online_model_count(&learned, label);
+}
+
+void identify_stage_stats(pipeline_stage_stats_t stats[IDENTIFY_STAGE_COUNT]) {
+    gas_array_stage_stats(&stats[0]);
+    pipeline_stage_read(&classify_stage, &stats[1]);
+    pipeline_stage_read(&store_stage, &stats[2]);
+    pipeline_stage_read(&save_stage, &stats[3]);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "sensor_array.h"
+#include "feature_extract.h"
+#include "pipeline_stage.h"
+#include "recording.h"
+#include "spsc_queue.h"
+
+// Rows of the sensor frame, in the order the channels are added
+typedef enum {
+    GAS_CH_TVOC = 0,
+    GAS_CH_ECO2,
+    GAS_CH_RAW_H2,
+    GAS_CH_RAW_ETHANOL,
+    GAS_CH_PORT_B_ADC,
+    GAS_CH_COUNT
+} gas_channel_t;
+
+#define GAS_ARRAY_PERIOD_MS 1000
+// 8 kHz decimated by 256 to 31.25 Hz with 4 extra bits
+#define GAS_ADC_STREAM_RATE 8000
+#define GAS_ADC_DECIMATION_LOG2 8
+
+// A feature window is one frame long. Channel c's features are stored at
+// c * FEATURE_PER_CHANNEL + feature_index_t.
+#define GAS_FEATURE_DIM (GAS_CH_COUNT * FEATURE_PER_CHANNEL)
+
+// Sensing runs as a scheduler job on APP_CPU, next to touch and the GUI,
+// and only queues each sample. The feature stage runs change-point
+// detection and feature extraction on PRO_CPU. Both queues are lock-free
+// and drop, counting it, rather than block when full.
+#define GAS_FEATURE_CORE 0
+#define GAS_FEATURE_PRIORITY 4
+#define GAS_SAMPLE_QUEUE_LEN 32
+
+// Every window also carries the raw samples it was cut from, as a
+// recording the feature stage encodes while the window fills. Recordings
+// come to about 6 bytes a sample; GAS_RECORDING_SIZE is the worst case.
+#define GAS_RECORDING_BLOCK 32
+#define GAS_RECORDING_SIZE RECORDING_MAX_SIZE(GAS_CH_COUNT, SENSOR_ARRAY_FRAME_LEN, GAS_RECORDING_BLOCK)
+
+// Features of one captured exposure. A change-point detector on every
+// channel opens the window just before a smell arrives and cuts it one
+// frame later.
+typedef struct {
+    float features[GAS_FEATURE_DIM];
+    uint32_t first_sample;
+    int64_t queued_us;      // esp_timer time it was queued
+    uint32_t recording_len; // 0 if the recording did not fit
+    uint8_t recording[GAS_RECORDING_SIZE];
+} gas_window_t;
+
+esp_err_t gas_array_start(void);
+
+// Sets where captured windows go: pushed to queue, a queue of
+// gas_window_t, after which task is notified with xTaskNotifyGive().
+// Windows are dropped until this is called. Call before
+// gas_array_start().
+void gas_array_set_window_consumer(spsc_queue_t *queue, TaskHandle_t task);
+
+// Returns whether a smell is being sensed right now. count gets the
+// number of windows captured so far.
+bool gas_array_capture_status(uint32_t *count);
+
+// Counters of the feature stage and the sample queue feeding it.
+void gas_array_stage_stats(pipeline_stage_stats_t *stats);
@@ -9,10 +9,6 @@
 //  User input 
 const char * userInputStr;
 
-// Sensor input
-const  char * tvoc;
-const  char * eCO2;
-
 // Received label
 lv_obj_t* received_label;
 lv_obj_t* received_bg;
\ No newline at end of file
@@ -30,4 +30,7 @@ extern lv_obj_t* identified_tab;
 TaskHandle_t identify_handle;
 
 void display_identified_tab();
-void identified_task(void* pvParameters);
\ No newline at end of file
+void identified_task(void* pvParameters);
+// Both must be called with xGuiSemaphore held, as LVGL event handlers are
+void identified_show_result(const char* label, float confidence);
+void identified_show_message(const char* message);
\ No newline at end of file
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "esp_err.h"
+#include "classifier.h"
+#include "pipeline_stage.h"
+
+// Label of the flash partition holding the classifier model
+#define IDENTIFY_MODEL_PARTITION "model"
+// Label of the flash partition holding the fingerprint collection
+#define IDENTIFY_COLLECTION_PARTITION "spiffs"
+// Nearest fingerprints logged after each identification, and the
+// inverted lists scanned to find them
+#define IDENTIFY_NEIGHBOURS 5
+#define IDENTIFY_NPROBE 8
+// Where the neural network model is flashed: in the collection's
+// partition, in the gap between the collection's two slots
+#define IDENTIFY_NN_PARTITION "spiffs"
+#define IDENTIFY_NN_OFFSET (2 * 1024 * 1024)
+// Activation arena for the network, planned when it is loaded
+#define IDENTIFY_NN_ARENA_SIZE 8192
+
+// Every captured window is classified on PRO_CPU as soon as the feature
+// stage queues it, and labelled samples are learnt there too. Results go
+// to the GUI, learnt samples to the store stage that adds them to the
+// fingerprint collection, and each window's recording, with its label if
+// the user gave one, on to the save stage that writes it to the SD card,
+// through lock-free queues, so the GUI never waits on any of them.
+// Storing and saving run on APP_CPU below the GUI's priority.
+#define IDENTIFY_CORE 0
+#define IDENTIFY_PRIORITY 3
+#define IDENTIFY_STORE_CORE 1
+#define IDENTIFY_STORE_PRIORITY 1
+#define IDENTIFY_SAVE_CORE 1
+#define IDENTIFY_SAVE_PRIORITY 1
+#define IDENTIFY_QUEUE_LEN 4
+// Newest windows the classification stage holds for a label to find
+#define IDENTIFY_HISTORY_LEN 4
+// The save stage logs the pipeline's counters after this long idle
+#define IDENTIFY_STATS_PERIOD_MS 60000
+// Features, classification, store and save
+#define IDENTIFY_STAGE_COUNT 4
+
+// Maps the models and the fingerprint collection out of flash and starts
+// the classification, store and save stages. Call before
+// gas_array_start(). Without a model, windows are classified by the
+// learnt classes alone, and those and the collection take the features
+// unstandardised. Fails only if the stages could not be started;
+// identification reports ESP_ERR_INVALID_STATE until this has succeeded.
+esp_err_t identify_init(void);
+
+// The functions below are for the GUI task only. None of them blocks.
+
+// Takes finished results off the classification stage. Call regularly
+// so the newest one is never held up behind older ones.
+void identify_poll(void);
+
+// Copies the result of the latest captured window, which was classified
+// when it was captured. latency_us, which may be NULL, gets the time the
+// classification took. A sample too far from every class comes back
+// with result->known false; result->label is then only the nearest
+// guess, or "" before any class is known. ESP_ERR_NOT_FOUND until a
+// window has been classified.
+esp_err_t identify_sample(classifier_result_t *result, uint32_t *latency_us);
+
+// Queues the window of the latest result identify_poll() took to be
+// learnt as a sample of label and appended to the fingerprint
+// collection, and its recording to be saved with the label. Windows
+// captured after it do not change which one is learnt, unless
+// IDENTIFY_HISTORY_LEN of them have pushed it out first, in which case
+// it is not learnt. A window is learnt once; a second label for it is
+// dropped. identify_label_count() counts it once it has been learnt.
+esp_err_t identify_learn(const char *label);
+
+// Samples learnt of label, 0 for a label never given.
+uint32_t identify_label_count(const char *label);
+
+// Counters of the feature, classification, store and save stages and
+// their input queues. Safe from any task.
+void identify_stage_stats(pipeline_stage_stats_t stats[IDENTIFY_STAGE_COUNT]);
@@ -30,6 +30,9 @@ extern lv_obj_t* keyboard_tab;
 TaskHandle_t keyboard_handle;
 void display_keyboard_tab();
 void keyboard_task(void* pvParameters);
+// Sets the title above the text area. Must be called with xGuiSemaphore
+// held, as LVGL event handlers are. prompt has to outlive the tab.
+void keyboard_show_prompt(const char* prompt);
 
 static void kb_create(void);
 static void kb_event_cb(lv_obj_t * keyboard, lv_event_t e);
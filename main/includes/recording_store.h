@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Where captured windows' recordings are kept on the SD card, one file
+// each, numbered on from the highest already there. FAT is built without
+// long names here, so the names are 8.3.
+#define RECORDING_STORE_MOUNT "/sdcard"
+#define RECORDING_STORE_DIR RECORDING_STORE_MOUNT "/SMELL"
+#define RECORDING_STORE_EXT ".SMR"
+
+// The card shares the display's SPI bus. Each access takes it for one
+// bounded step, a chunk of a file at most, so the display can flush
+// between them; the mount is the longest step.
+#define RECORDING_STORE_CHUNK 512
+
+// A card that is missing or failed is mounted again by the next save
+// this long after the last try, rather than at every save
+#define RECORDING_STORE_RETRY_MS 60000
+
+// Mounts the SD card if it is not already, and finds the next file
+// number. Fails with ESP_ERR_NOT_SUPPORTED when the firmware is built
+// without CONFIG_SOFTWARE_SDCARD_SUPPORT.
+esp_err_t recording_store_mount(void);
+
+// Writes a recording, as components/recorder made it, to a new file and
+// gives back its number, which may be NULL. Mounts the card first if
+// there is none and the last try was RECORDING_STORE_RETRY_MS ago;
+// ESP_ERR_INVALID_STATE if there is still none. A file that could not
+// be written whole is removed and the card unmounted, to be mounted
+// again by a later save.
+esp_err_t recording_store_save(const uint8_t *data, size_t size, uint32_t *number);
@@ -34,6 +34,7 @@
 
 #include "core2forAWS.h"
 #include "global.h"
+#include "identify.h"
 #include "keyboard.h"
 #include "received.h"
 #include "core_http_config.h"
@@ -42,7 +43,10 @@ lv_obj_t* tabview;
 lv_obj_t* keyboard_tab;
 static lv_obj_t * kb;
 static lv_obj_t * ta;
+static lv_obj_t* title_label;
 static const char* TAG = KEYBOARD_TAB_NAME;
+// The text area's own buffer is reset as soon as the label is applied
+static char user_label[32];
 
 void display_keyboard_tab(lv_obj_t* tv, lv_obj_t* core2forAWS_screen_obj){
     xSemaphoreTake(xGuiSemaphore, portMAX_DELAY);
@@ -64,10 +68,10 @@ void display_keyboard_tab(lv_obj_t* tv, lv_obj_t* core2forAWS_screen_obj){
     lv_style_init(&title_style);
     lv_style_set_text_font(&title_style, LV_STATE_DEFAULT, LV_THEME_DEFAULT_FONT_TITLE);
     lv_style_set_text_color(&title_style, LV_STATE_DEFAULT, LV_COLOR_BLACK);
-    lv_obj_t* tab_title_label = lv_label_create(keyb_bg, NULL);
-    lv_obj_add_style(tab_title_label, LV_OBJ_PART_MAIN, &title_style);
-    lv_label_set_static_text(tab_title_label, "");
-    lv_obj_align(tab_title_label, keyb_bg, LV_ALIGN_IN_TOP_MID, 0, 10);
+    title_label = lv_label_create(keyb_bg, NULL);
+    lv_obj_add_style(title_label, LV_OBJ_PART_MAIN, &title_style);
+    lv_label_set_static_text(title_label, "");
+    lv_obj_align(title_label, keyb_bg, LV_ALIGN_IN_TOP_MID, 0, 10);
 
     /* Add Keyoard */
 
@@ -76,7 +80,7 @@ void display_keyboard_tab(lv_obj_t* tv, lv_obj_t* core2forAWS_screen_obj){
     ta  = lv_textarea_create(keyboard_tab, NULL);
     lv_textarea_set_one_line(ta, true);
     lv_textarea_set_max_length(ta, 20);
-    lv_obj_align(ta, tab_title_label, LV_ALIGN_CENTER, 0 , 10);
+    lv_obj_align(ta, title_label, LV_ALIGN_CENTER, 0 , 10);
     lv_obj_set_event_cb(ta, ta_event_cb);
     lv_textarea_set_text(ta, "");
    
@@ -90,6 +94,12 @@ void display_keyboard_tab(lv_obj_t* tv, lv_obj_t* core2forAWS_screen_obj){
 
 
 
+// Called from LVGL event handlers, which already hold xGuiSemaphore
+void keyboard_show_prompt(const char* prompt){
+    lv_label_set_static_text(title_label, prompt);
+    lv_obj_align(title_label, NULL, LV_ALIGN_IN_TOP_MID, 0, 10);
+}
+
 static void kb_event_cb(lv_obj_t * keyboard, lv_event_t e)
 {
     lv_keyboard_def_event_cb(kb, e);
@@ -99,28 +109,19 @@ static void kb_event_cb(lv_obj_t * keyboard, lv_event_t e)
         lv_tabview_set_tab_act(tabview, 0, LV_ANIM_OFF);
     }
     if(e == LV_EVENT_APPLY) {
-        // Call back end server and then display received  
-        userInputStr = lv_textarea_get_text(ta);        
+        // Learn the sample and then display received
+        snprintf(user_label, sizeof(user_label), "%s", lv_textarea_get_text(ta));
+        userInputStr = user_label;
         lv_textarea_set_text(ta, "");
-        if(userInputStr != NULL){           
+        if(userInputStr[0] != '\0'){
             ESP_LOGI(TAG, "\n\n Read %s: ", userInputStr); 
-            lv_tabview_set_tab_act(tabview, 4, LV_ANIM_OFF);
-            /// TODO verify http client
-            /* 
-            const char* path = "/submitSample/";
-            strcat(path,userInputStr );
-            strcat(path, "/");
-            if (tvoc != NULL)
-                strcat(path, tvoc);
-            if (eCO2 != NULL){                
-               strcat(path, "/");
-               strcat(path, eCO2);
+            // Learnt and sent by the pipeline, the keyboard does not wait
+            esp_err_t err = identify_learn(userInputStr);
+            if (err != ESP_OK) {
+                ESP_LOGW(TAG, "Could not learn the sample: %s", esp_err_to_name(err));
             }
-            
-            ESP_LOGI(TAG, "\n\n Sending sample to  %s: ", path); 
-            sendReceiveEllieSample("POST",path);
-            */
-
+            update_received_label();
+            lv_tabview_set_tab_act(tabview, 4, LV_ANIM_OFF);
          }
     }
 }
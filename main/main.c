@@ -47,6 +47,7 @@
 #include "nvs_flash.h"
 
 #include "core2forAWS.h"
+#include "timekeeping.h"
 
 #include "sound.h"
 #include "home.h"
@@ -57,6 +58,7 @@
 #include "global.h"
 #include "received.h"
 #include "identified.h"
+#include "identify.h"
 #include "keyboard.h"
 #include "selection.h"
 
@@ -85,11 +87,18 @@ void app_main(void)
     esp_log_level_set("ILI9341", ESP_LOG_NONE);
 
     Core2ForAWS_Init();
+#if CONFIG_SOFTWARE_RTC_SUPPORT
+    // Sample timestamps come from here, start it before any sensor task
+    ESP_ERROR_CHECK(timekeeping_start());
+#endif
+    // Identifies by the learnt classes alone without a model, and reports
+    // that it is not running if this fails
+    identify_init();
     Core2ForAWS_Display_SetBrightness(80); // Last since the display first needs time to finish initializing.
     
     ui_start();
 
-    xTaskCreatePinnedToCore(&aws_sgp30_task, "aws_sgp30_task", 4096*2, NULL, 5, NULL, 1);
+    xTaskCreatePinnedToCore(&aws_sgp30_task, "aws_sgp30_task", 4096, NULL, 5, NULL, 1);
 
 }
 
@@ -36,9 +36,11 @@
 
 #include "core2forAWS.h"
 #include "global.h"
+#include "identify.h"
 #include "received.h"
 
 static void start_over_event_handler(lv_obj_t* slider, lv_event_t event);
+static void learn_poll_task(lv_task_t* task);
 
 static const char* TAG = SAMPLE_RECEIVED_TAB_NAME;
 
@@ -89,26 +91,43 @@ void display_received_tab(lv_obj_t* tv, lv_obj_t* core2forAWS_screen_obj){
     lv_obj_t* startOver_label = lv_label_create(startOver_btn, NULL);
     lv_label_set_static_text(startOver_label, "Start Over");
 
+    // Runs in the GUI task with the semaphore held, like the event handlers
+    lv_task_create(learn_poll_task, 250, LV_TASK_PRIO_LOW, NULL);
+
     xSemaphoreGive(xGuiSemaphore);
 
    // xTaskCreatePinnedToCore(received_task, "receivedTask", configMINIMAL_STACK_SIZE * 2, (void*) core2forAWS_screen_obj, 0, &received_handle, 1);
 }
 
+// Samples are learnt on the pipeline after the label is given, so the
+// count shown is refreshed once the new one has gone in
+static void learn_poll_task(lv_task_t* task){
+    static uint32_t shown_count;
+    if (userInputStr == NULL) {
+        return;
+    }
+    uint32_t count = identify_label_count(userInputStr);
+    if (count != shown_count) {
+        shown_count = count;
+        update_received_label();
+    }
+}
+
 void update_received_label(){
     ESP_LOGI(TAG, "updating label");
-    const char* receivedMessage = "Sample received!\n\n I have now # of samples of the same kind. \nThe more I have the better matches I can make";  
-    if (userInputStr != NULL){
-        ESP_LOGI(TAG, "Input : %s",userInputStr);
-        char tempMessage[200];
-        sprintf(tempMessage, 
-         "Sample received!\n\n I have now # of samples of %s. \nThe more I have the better matches I can make",
-         userInputStr);
-         char *p = tempMessage;
-         receivedMessage = p;
+    if (userInputStr == NULL){
+        lv_label_set_static_text(received_label, "Sample received!\n\nThe more samples I have the better matches I can make");
+        return;
     }
-    ESP_LOGI(TAG, "Combined: %s", receivedMessage);
-    lv_label_set_static_text(received_label, receivedMessage);
-   
+    ESP_LOGI(TAG, "Input : %s",userInputStr);
+    uint32_t count = identify_label_count(userInputStr);
+    // lv_label_set_text keeps its own copy of the message
+    char message[200];
+    snprintf(message, sizeof(message),
+        "Sample received!\n\n I have now %u sample%s of %s. \nThe more I have the better matches I can make",
+        count, count == 1 ? "" : "s", userInputStr);
+    ESP_LOGI(TAG, "Combined: %s", message);
+    lv_label_set_text(received_label, message);
 }
 static void start_over_event_handler(lv_obj_t* obj, lv_event_t event){
     
@@ -0,0 +1,147 @@
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "core2forAWS.h"
+#include "recording_store.h"
+
+#define TAG "RECORDINGS"
+
+#if CONFIG_SOFTWARE_SDCARD_SUPPORT
+
+static sdmmc_card_t *card;
+static uint32_t next_number = 1;
+static int64_t last_mount_us;
+static bool mount_tried;
+
+// The card and the display share an SPI bus. It is taken for one
+// bounded step at a time, so the display can flush in between.
+static void bus_take(void) {
+    xSemaphoreTake(spi_mutex, portMAX_DELAY);
+    spi_poll();
+}
+
+static void bus_give(void) {
+    xSemaphoreGive(spi_mutex);
+}
+
+// Next after the highest numbered recording in the directory
+static void find_next_number(void) {
+    bus_take();
+    // Fails if it is already there, which is fine
+    mkdir(RECORDING_STORE_DIR, 0777);
+    DIR *dir = opendir(RECORDING_STORE_DIR);
+    bus_give();
+    if (dir == NULL) {
+        return;
+    }
+    for (;;) {
+        bus_take();
+        struct dirent *entry = readdir(dir);
+        bus_give();
+        if (entry == NULL) {
+            break;
+        }
+        char *end;
+        unsigned long number = strtoul(entry->d_name, &end, 10);
+        if (end != entry->d_name && strcasecmp(end, RECORDING_STORE_EXT) == 0 && number >= next_number) {
+            next_number = (uint32_t)number + 1;
+        }
+    }
+    bus_take();
+    closedir(dir);
+    bus_give();
+}
+
+esp_err_t recording_store_mount(void) {
+    if (card != NULL) {
+        return ESP_OK;
+    }
+    bool first = !mount_tried;
+    mount_tried = true;
+    last_mount_us = esp_timer_get_time();
+    bus_take();
+    esp_err_t err = Core2ForAWS_SDcard_Mount(RECORDING_STORE_MOUNT, &card);
+    bus_give();
+    if (err != ESP_OK) {
+        card = NULL;
+        if (first) {
+            ESP_LOGW(TAG, "No SD card: %s, trying again every %d s", esp_err_to_name(err),
+                     RECORDING_STORE_RETRY_MS / 1000);
+        }
+        return err;
+    }
+    find_next_number();
+    ESP_LOGI(TAG, "%s mounted, next recording %u", card->cid.name, next_number);
+    return ESP_OK;
+}
+
+// After a failed write the card may have been pulled, so the next save
+// mounts it again
+static void forget_card(void) {
+    bus_take();
+    Core2ForAWS_SDcard_Unmount(RECORDING_STORE_MOUNT, card);
+    bus_give();
+    card = NULL;
+    mount_tried = false;
+}
+
+esp_err_t recording_store_save(const uint8_t *data, size_t size, uint32_t *number) {
+    if (card == NULL) {
+        bool due = !mount_tried || esp_timer_get_time() - last_mount_us >= RECORDING_STORE_RETRY_MS * 1000ll;
+        if (!due || recording_store_mount() != ESP_OK) {
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+    char path[40];
+    snprintf(path, sizeof(path), RECORDING_STORE_DIR "/%08u" RECORDING_STORE_EXT, next_number);
+    bus_take();
+    FILE *f = fopen(path, "wb");
+    bus_give();
+    bool ok = f != NULL;
+    for (size_t done = 0; ok && done < size; done += RECORDING_STORE_CHUNK) {
+        size_t chunk = size - done < RECORDING_STORE_CHUNK ? size - done : RECORDING_STORE_CHUNK;
+        bus_take();
+        ok = fwrite(data + done, 1, chunk, f) == chunk && fflush(f) == 0;
+        bus_give();
+    }
+    if (f != NULL) {
+        bus_take();
+        ok &= fclose(f) == 0;
+        bus_give();
+    }
+    if (!ok) {
+        bus_take();
+        remove(path);
+        bus_give();
+        ESP_LOGW(TAG, "Could not write %s", path);
+        forget_card();
+        return ESP_FAIL;
+    }
+    if (number != NULL) {
+        *number = next_number;
+    }
+    next_number++;
+    return ESP_OK;
+}
+
+#else
+
+esp_err_t recording_store_mount(void) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t recording_store_save(const uint8_t *data, size_t size, uint32_t *number) {
+    return ESP_ERR_INVALID_STATE;
+}
+
+#endif
@@ -35,6 +35,9 @@
 #include "core2forAWS.h"
 #include "global.h"
 #include "selection.h"
+#include "identified.h"
+#include "identify.h"
+#include "keyboard.h"
 
 static void identify_event_handler(lv_obj_t* obj, lv_event_t event);
 static void tell_me_event_handler(lv_obj_t* obj, lv_event_t event);
@@ -121,16 +124,35 @@ static void start_over_event_handler(lv_obj_t* obj, lv_event_t event){
 }
 
 static void identify_event_handler(lv_obj_t* obj, lv_event_t event){
+    // Classifying on every press/release event would be wasted work
+    if (event != LV_EVENT_CLICKED) {
+        return;
+    }
       ESP_LOGI(TAG, "Identify over selected");
-    // send sample to cloud
+    // Classified on the device, no network round trip
+    classifier_result_t result;
+    esp_err_t err = identify_sample(&result, NULL);
+    if (err == ESP_OK && !result.known) {
+        // Nothing learnt is close enough, so ask instead of guessing
+        keyboard_show_prompt("New smell! What is it?");
+        lv_tabview_set_tab_act(tabview, 2, LV_ANIM_OFF);
+        return;
+    }
+    if (err == ESP_OK) {
+        identified_show_result(result.label, result.confidence);
+    } else if (err == ESP_ERR_NOT_FOUND) {
+        identified_show_message("I have not smelled anything yet. Hold the sample close and I will pick it up by myself.");
+    } else {
+        identified_show_message("Smell identification did not start, so I can not identify samples.");
+    }
 
-    // wait for result
     // Call identify window screen has index of 3, hardcoded :(  because how it was added in main
     lv_tabview_set_tab_act(tabview, 3, LV_ANIM_OFF);
 }
 
 static void tell_me_event_handler(lv_obj_t* obj, lv_event_t event){
      ESP_LOGI(TAG, "Tell me selected");
+    keyboard_show_prompt("What smell is it?");
     // display keyboard
     // Call tell me window screen has index of 2, hardcoded :(  because how it was added in main
     lv_tabview_set_tab_act(tabview, 2, LV_ANIM_OFF);
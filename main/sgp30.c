@@ -9,17 +9,27 @@
 
 #include "core2forAWS.h"
 #include "global.h"
-#include "keyboard.h"
-#include "received.h"
-#include "core_http_config.h"
 #include "i2c_device.h"
+#include "sgp30.h"
+#include "gas_array.h"
 #include "cta.h"
 
-I2CDevice_t i2c_device;
-
-#define DEVICE_ADDRESS 0xA0 >> 1
+#define SGP30_INIT_RETRY_MS 5000
+// No humidity sensor on the board, assume a typical indoor value
+#define SGP30_FALLBACK_RH 50.0f
 
 static const char* TAG = CTA_TAB_NAME;
+
+#if CONFIG_SOFTWARE_MPU6886_SUPPORT
+// The die runs a few degrees above ambient, but is close enough to keep
+// compensation in the right range when nothing better is attached
+static bool sgp30_env_from_imu(float *temperature_c, float *humidity_rh) {
+    MPU6886_GetTempData(temperature_c);
+    *humidity_rh = SGP30_FALLBACK_RH;
+    return true;
+}
+#endif
+
 void aws_sgp30_task(void *param) {
 
     //PORT_A_SDA_PIN (same as GPIO 32) for the I2C data pin and
@@ -32,22 +42,20 @@ void aws_sgp30_task(void *param) {
     esp_err_t err_scl = Core2ForAWS_Port_PinMode(PORT_A_SCL_PIN, I2C);
     ESP_LOGI(TAG, "Status of setting the sda pin: %d", err_sda);
     ESP_LOGI(TAG, "Status of setting the scl pin: %d", err_scl);
-     I2CDevice_t port_A_peripheral = Core2ForAWS_Port_A_I2C_Begin(DEVICE_ADDRESS, PORT_A_I2C_STANDARD_BAUD);
-    
-    vTaskDelay(pdMS_TO_TICKS(10000));
-    for(;;){
-        uint8_t data = 255;
-        esp_err_t err = Core2ForAWS_Port_A_I2C_Read(port_A_peripheral, I2C_NO_REG, &data, 1);
-        if(!err){
-            ESP_LOGI(TAG, "data — %ubpm", data);
-            tvoc = (const char *) &data;
-            eCO2 = (const char *)&data;
-            
-        }
-        vTaskDelay(pdMS_TO_TICKS(10000));
+    I2CDevice_t port_A_peripheral = Core2ForAWS_Port_A_I2C_Begin(SGP30_ADDR, PORT_A_I2C_STANDARD_BAUD);
+
+    // Keep trying until the sensor is plugged in
+    while (SGP30_Init(port_A_peripheral) != ESP_OK) {
+        ESP_LOGW(TAG, "SGP30 not responding on port A, retrying");
+        vTaskDelay(pdMS_TO_TICKS(SGP30_INIT_RETRY_MS));
     }
-    Core2ForAWS_Port_A_I2C_Close(port_A_peripheral);
-    vTaskDelete(NULL);
 
-   
-}
\ No newline at end of file
+#if CONFIG_SOFTWARE_MPU6886_SUPPORT
+    SGP30_SetEnvSource(sgp30_env_from_imu);
+#endif
+
+    // Measurements are published to SGP30_GetRing(), readers do not need this task
+    ESP_ERROR_CHECK_WITHOUT_ABORT(SGP30_Start());
+    ESP_ERROR_CHECK_WITHOUT_ABORT(gas_array_start());
+    vTaskDelete(NULL);
+}
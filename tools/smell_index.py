@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+"""Builds a fingerprint collection image from a labelled feature CSV.
+
+The CSV is the same as for tools/smell_model.py. Fingerprints are
+standardised, quantised to int8 and split into inverted lists by k-means,
+so the device only scans the lists nearest to a query:
+
+    tools/smell_index.py corpus.csv -o index.bin --lists 64
+    parttool.py write_partition --partition-name spiffs --input index.bin
+
+The layout matches components/fingerprint/fp_index.h. Every list keeps
+free room, so the device goes on appending to the same image, and
+rebuilds it into its second slot as it outgrows the lists. write_partition
+erases the whole partition first, which clears that slot but also the
+network blob, so flash tools/smell_nn.py's output after this one.
+"""
+
+import argparse
+import math
+import random
+import struct
+import sys
+
+from smell_model import read_corpus, standardise
+
+MAGIC = 0x58495046
+VERSION = 1
+HEADER_SIZE = 16 * 1024
+LABEL_LOG_SIZE = 4 * 1024
+LABEL_LEN = 24
+MAX_LISTS = 64
+MAX_LABELS = 32
+QUANT_SCALE = 32.0
+MAP_SIZE = 2 * 1024 * 1024
+# k-means runs on at most this many fingerprints, all of them are assigned
+TRAIN_SAMPLES = 2000
+TRAIN_ROUNDS = 8
+
+
+def quantise(row, mean, inv_std, dim_pad):
+    q = [max(-127, min(127, round((v - m) * s * QUANT_SCALE))) for v, m, s in zip(row, mean, inv_std)]
+    return q + [0] * (dim_pad - len(q))
+
+
+def nearest(x, centroids):
+    return min(range(len(centroids)), key=lambda c: math.dist(x, centroids[c]))
+
+
+def kmeans(points, count, seed):
+    rng = random.Random(seed)
+    sample = rng.sample(points, min(len(points), TRAIN_SAMPLES))
+    centroids = [list(p) for p in rng.sample(sample, count)]
+    for _ in range(TRAIN_ROUNDS):
+        members = [[] for _ in centroids]
+        for p in sample:
+            members[nearest(p, centroids)].append(p)
+        for c, m in enumerate(members):
+            if m:
+                centroids[c] = [sum(col) / len(m) for col in zip(*m)]
+    return [[max(-127, min(127, round(v))) for v in c] for c in centroids]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("corpus", help="labelled feature CSV")
+    parser.add_argument("-o", "--output", default="index.bin")
+    parser.add_argument("--lists", type=int, default=0,
+                        help="inverted lists, default 1 below 1000 fingerprints and sqrt(n) above")
+    parser.add_argument("--size", type=lambda v: int(v, 0), default=MAP_SIZE,
+                        help="image size, at most what the device maps")
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    labels, rows = read_corpus(args.corpus)
+    names = sorted(set(labels))
+    if len(names) > MAX_LABELS:
+        sys.exit("%d labels, the collection takes up to %d" % (len(names), MAX_LABELS))
+    lists = args.lists or (1 if len(rows) < 1000 else min(MAX_LISTS, round(math.sqrt(len(rows)))))
+    if not 1 <= lists <= MAX_LISTS or lists > len(rows):
+        sys.exit("--lists must be 1 to %d and at most the number of fingerprints" % MAX_LISTS)
+
+    dim = len(rows[0])
+    dim_pad = (dim + 3) & ~3
+    record_size = 4 + dim_pad
+    mean, inv_std = standardise(rows)
+    vectors = [quantise(r, mean, inv_std, dim_pad) for r in rows]
+    centroids = kmeans(vectors, lists, args.seed) if lists > 1 else [[0] * dim_pad]
+
+    record_count = (args.size - HEADER_SIZE - LABEL_LOG_SIZE) // record_size
+    if record_count < len(rows):
+        sys.exit("%d fingerprints do not fit in %d bytes" % (len(rows), args.size))
+    buckets = [[] for _ in range(lists + 1)]
+    for v, label in zip(vectors, labels):
+        buckets[nearest(v, centroids) if lists > 1 else 0].append((names.index(label), v))
+
+    # Each list keeps what it has plus an even share of the free records,
+    # the overflow bucket takes the rounding
+    spare = (record_count - len(rows)) // (lists + 1)
+    start = [0]
+    for bucket in buckets[:lists]:
+        start.append(start[-1] + len(bucket) + spare)
+    start.append(record_count)
+
+    header = struct.pack("<IHHHHHHII", MAGIC, VERSION, dim, dim_pad, lists, record_size, 0,
+                         record_count, HEADER_SIZE + LABEL_LOG_SIZE + record_count * record_size)
+    header += struct.pack("<%df" % dim, *mean) + struct.pack("<%df" % dim, *inv_std)
+    header += struct.pack("<%dI" % len(start), *start)
+    for c in centroids:
+        header += struct.pack("<%db" % dim_pad, *c)
+    if len(header) > HEADER_SIZE:
+        sys.exit("header does not fit, use fewer lists")
+    image = header + b"\xff" * (HEADER_SIZE - len(header))
+
+    log = b""
+    for i, name in enumerate(names):
+        encoded = name.encode("utf-8")[:LABEL_LEN - 1]
+        log += struct.pack("<HH", i, 0) + encoded + b"\0" * (LABEL_LEN - len(encoded))
+    image += log + b"\xff" * (LABEL_LOG_SIZE - len(log))
+
+    for b, bucket in enumerate(buckets):
+        records = b"".join(struct.pack("<HH%db" % dim_pad, label, 0, *v) for label, v in bucket)
+        image += records + b"\xff" * ((start[b + 1] - start[b]) * record_size - len(records))
+
+    with open(args.output, "wb") as f:
+        f.write(image)
+
+    sizes = [len(b) for b in buckets[:lists]]
+    print("%s: %d fingerprints of %d labels, %d features, %d bytes"
+          % (args.output, len(rows), len(names), dim, len(image)))
+    print("%d lists of %d to %d fingerprints, room for %d more in each"
+          % (lists, min(sizes), max(sizes), spare))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,236 @@
+#!/usr/bin/env python3
+"""Builds a classifier model blob from a labelled feature CSV.
+
+Each CSV row is a class name followed by the feature vector of one
+sample, in the order main/gas_array.c produces it (GAS_FEATURE_DIM
+values). A header row is skipped if its feature columns are not numbers.
+
+    tools/smell_model.py corpus.csv -o model.bin --kind knn --k 5
+    parttool.py write_partition --partition-name model --input model.bin
+
+The layout matches components/classifier/classifier.h. The script also
+prints the leave-one-out accuracy of the model it builds, as a sanity
+check on the corpus.
+
+The same leave-one-out pass calibrates the model. The confidence the
+device shows is a softmax of the class distances, with a temperature
+fitted to those held-out samples. A sample farther from its nearest
+class than all but a few of the held-out samples were from theirs is
+reported as unknown; --reject-quantile sets how few. Holding out whole
+classes in turn shows how often a smell the model was never taught is
+caught by that threshold.
+"""
+
+import argparse
+import csv
+import math
+import struct
+import sys
+
+MAGIC = 0x4C434D53
+VERSION = 2
+LABEL_LEN = 24
+MAX_DIM = 128
+MAX_K = 16
+MAX_CLASSES = 32
+KIND_CENTROID = 0
+KIND_KNN = 1
+
+
+def read_corpus(path):
+    labels, rows = [], []
+    with open(path, newline="") as f:
+        for record in csv.reader(f):
+            if not record or record[0].startswith("#"):
+                continue
+            try:
+                features = [float(v) for v in record[1:]]
+            except ValueError:
+                continue
+            labels.append(record[0].strip())
+            rows.append(features)
+    if not rows:
+        sys.exit("no samples in %s" % path)
+    dim = len(rows[0])
+    if any(len(r) != dim for r in rows):
+        sys.exit("rows have different numbers of features")
+    if dim == 0 or dim > MAX_DIM:
+        sys.exit("%d features, the classifier takes 1 to %d" % (dim, MAX_DIM))
+    return labels, rows
+
+
+def standardise(rows):
+    dim = len(rows[0])
+    mean = [sum(r[i] for r in rows) / len(rows) for i in range(dim)]
+    inv_std = []
+    for i in range(dim):
+        var = sum((r[i] - mean[i]) ** 2 for r in rows) / len(rows)
+        # A constant feature carries no information, keep it from dominating
+        inv_std.append(1.0 / math.sqrt(var) if var > 1e-12 else 0.0)
+    return mean, inv_std
+
+
+def build(labels, rows, kind, k):
+    classes = sorted(set(labels))
+    if len(classes) > MAX_CLASSES:
+        sys.exit("%d classes, the classifier takes up to %d" % (len(classes), MAX_CLASSES))
+    mean, inv_std = standardise(rows)
+    scaled = [[(v - m) * s for v, m, s in zip(r, mean, inv_std)] for r in rows]
+    index = [classes.index(l) for l in labels]
+
+    if kind == KIND_CENTROID:
+        protos, proto_class = [], []
+        for c in range(len(classes)):
+            members = [s for s, i in zip(scaled, index) if i == c]
+            protos.append([sum(col) / len(members) for col in zip(*members)])
+            proto_class.append(c)
+    else:
+        protos, proto_class = scaled, index
+    if len(protos) > 0xFFFF:
+        sys.exit("too many prototypes")
+    return classes, mean, inv_std, protos, proto_class
+
+
+def classify(x, protos, proto_class, class_count, k):
+    """Returns the winning class and the distance to each class, as
+    classifier_classify() does; classes with no prototype among the k
+    nearest are infinitely far."""
+    dists = sorted((math.dist(x, p), c) for p, c in zip(protos, proto_class))[:k]
+    weight = [0.0] * class_count
+    class_dist = [math.inf] * class_count
+    for d, c in dists:
+        weight[c] += 1.0 / (d + 1e-6)
+        class_dist[c] = min(class_dist[c], d)
+    return max(range(class_count), key=lambda c: weight[c]), class_dist
+
+
+def held_out(labels, rows, kind, k, skip):
+    """Classifies each sample with a model built without the samples
+    `skip` picks for it, yielding (sample, classes, best, distances)."""
+    for i in range(len(rows)):
+        keep = [j for j in range(len(rows)) if not skip(i, j)]
+        rest_labels = [labels[j] for j in keep]
+        if not rest_labels:
+            continue
+        classes, mean, inv_std, protos, proto_class = build(rest_labels, [rows[j] for j in keep], kind, k)
+        x = [(v - m) * s for v, m, s in zip(rows[i], mean, inv_std)]
+        n = k if kind == KIND_KNN else len(protos)
+        best, class_dist = classify(x, protos, proto_class, len(classes), n)
+        yield i, classes, best, class_dist
+
+
+def leave_one_out(labels, rows, kind, k):
+    """Returns the accuracy, and for each held-out sample whose class is
+    still in the model the distances to every class and the index of the
+    right one."""
+    correct, scored = 0, []
+    for i, classes, best, class_dist in held_out(labels, rows, kind, k, lambda i, j: i == j):
+        if labels[i] not in classes:
+            continue
+        correct += classes[best] == labels[i]
+        scored.append((class_dist, classes.index(labels[i]), class_dist[best]))
+    return correct / len(rows), scored
+
+
+def softmax_nll(scored, temperature):
+    """Mean negative log likelihood of the right classes under a softmax
+    of -distance / temperature, as classifier_softmax() computes it."""
+    total = 0.0
+    for class_dist, truth, _ in scored:
+        nearest = min(class_dist)
+        weights = [math.exp((nearest - d) / temperature) for d in class_dist if d < math.inf]
+        p = math.exp((nearest - class_dist[truth]) / temperature) / sum(weights) if class_dist[truth] < math.inf else 0.0
+        total -= math.log(max(p, 1e-6))
+    return total / len(scored)
+
+
+def fit_temperature(scored):
+    """Golden-section search of the log temperature. Held-out samples
+    whose neighbours are all of one class say nothing about it, and if
+    that is all of them the temperature stays at 1."""
+    lo, hi = math.log(0.01), math.log(100.0)
+    if softmax_nll(scored, math.exp(lo)) == softmax_nll(scored, math.exp(hi)):
+        return 1.0
+    ratio = (math.sqrt(5) - 1) / 2
+    for _ in range(60):
+        a, b = hi - ratio * (hi - lo), lo + ratio * (hi - lo)
+        if softmax_nll(scored, math.exp(a)) < softmax_nll(scored, math.exp(b)):
+            hi = b
+        else:
+            lo = a
+    return math.exp((lo + hi) / 2)
+
+
+def reject_distance(scored, quantile):
+    """Distance to the nearest class that all but `1 - quantile` of the
+    held-out samples are within, 0 to never reject."""
+    if quantile >= 1.0 or not scored:
+        return 0.0
+    nearest = sorted(d for _, _, d in scored)
+    return nearest[min(len(nearest) - 1, int(quantile * len(nearest)))]
+
+
+def unknown_caught(labels, rows, kind, k, threshold):
+    """Share of samples reported as unknown when their whole class is
+    left out of the model."""
+    if threshold <= 0.0 or len(set(labels)) < 2:
+        return 0.0
+    caught = total = 0
+    for i, classes, best, class_dist in held_out(labels, rows, kind, k, lambda i, j: labels[j] == labels[i]):
+        caught += class_dist[best] > threshold
+        total += 1
+    return caught / total if total else 0.0
+
+
+def pack(classes, mean, inv_std, protos, proto_class, kind, k, temperature, reject):
+    dim = len(mean)
+    blob = struct.pack("<IHHHHHHff", MAGIC, VERSION, kind, dim, len(classes), len(protos), k, temperature, reject)
+    for name in classes:
+        encoded = name.encode("utf-8")[:LABEL_LEN - 1]
+        blob += encoded + b"\0" * (LABEL_LEN - len(encoded))
+    blob += struct.pack("<%df" % dim, *mean)
+    blob += struct.pack("<%df" % dim, *inv_std)
+    blob += struct.pack("<%dH" % len(proto_class), *proto_class)
+    blob += b"\0" * (-len(blob) % 4)
+    for p in protos:
+        blob += struct.pack("<%df" % dim, *p)
+    return blob
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("corpus", help="labelled feature CSV")
+    parser.add_argument("-o", "--output", default="model.bin")
+    parser.add_argument("--kind", choices=("centroid", "knn"), default="knn")
+    parser.add_argument("--k", type=int, default=5, help="neighbours that vote, k-NN only")
+    parser.add_argument("--reject-quantile", type=float, default=0.99,
+                        help="share of known samples to accept, 1 to never report unknown")
+    args = parser.parse_args()
+
+    kind = KIND_KNN if args.kind == "knn" else KIND_CENTROID
+    k = args.k if kind == KIND_KNN else 0
+    if kind == KIND_KNN and not 1 <= k <= MAX_K:
+        sys.exit("--k must be 1 to %d" % MAX_K)
+
+    labels, rows = read_corpus(args.corpus)
+    model = build(labels, rows, kind, k)
+    accuracy, scored = leave_one_out(labels, rows, kind, k)
+    temperature = fit_temperature(scored) if scored else 1.0
+    reject = reject_distance(scored, args.reject_quantile)
+    blob = pack(*model, kind, k, temperature, reject)
+    with open(args.output, "wb") as f:
+        f.write(blob)
+
+    print("%s: %d classes, %d prototypes of %d features, %d bytes"
+          % (args.output, len(model[0]), len(model[3]), len(model[1]), len(blob)))
+    print("leave-one-out accuracy: %.1f%%" % (100.0 * accuracy))
+    if scored:
+        print("temperature %.3f, log loss %.3f (%.3f uncalibrated)"
+              % (temperature, softmax_nll(scored, temperature), softmax_nll(scored, 1.0)))
+    if reject > 0.0:
+        print("unknown past distance %.2f: %.1f%% of unseen classes caught"
+              % (reject, 100.0 * unknown_caught(labels, rows, kind, k, reject)))
+
+
+if __name__ == "__main__":
+    main()
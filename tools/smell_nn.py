@@ -0,0 +1,253 @@
+#!/usr/bin/env python3
+"""Quantises a small trained network into an int8 model blob.
+
+The network is trained offline with any framework and exported as JSON:
+
+    {
+      "labels": ["coffee", "banana", ...],
+      "input": [len, channels],
+      "layers": [
+        {"type": "conv1d", "kernel": 3, "stride": 1, "activation": "relu",
+         "weights": [out][kernel][channels], "bias": [out]},
+        {"type": "dense", "activation": "none",
+         "weights": [out][len * channels], "bias": [out]}
+      ]
+    }
+
+Tensors are steps first, so a dense layer's inputs are flattened as
+`step * channels + channel`. A plain MLP on the feature vector has input
+[1, GAS_FEATURE_DIM]. The network is expected to take standardised
+inputs; the statistics are the corpus's, as for tools/smell_model.py,
+unless the JSON carries its own "mean" and "inv_std".
+
+The corpus CSV, the same as for tools/smell_model.py, also calibrates the
+range of every activation. Weights get one scale per output channel.
+
+    tools/smell_nn.py net.json corpus.csv -o nn.bin
+    esptool.py write_flash 0xC60000 nn.bin
+
+The device reads the blob 2 MB into the spiffs partition, in the 512 KB
+between the fingerprint collection's two slots; with partitions.csv as
+it is that is 0xC60000.
+The layout matches components/nn/nn_model.h. The script prints how
+often the int8 network agrees with the float one on the corpus, and
+fits the temperature the device divides the int8 logits by before the
+softmax that gives its confidence.
+"""
+
+import argparse
+import json
+import math
+import struct
+import sys
+
+from smell_model import fit_temperature, read_corpus, softmax_nll, standardise
+
+MAGIC = 0x4E4E4D53
+VERSION = 2
+LABEL_LEN = 24
+MAX_LAYERS = 16
+MAX_CLASSES = 32
+DENSE = 0
+CONV1D = 1
+ACTIVATIONS = {"none": 0, "relu": 1}
+
+
+def pad4(blob):
+    return blob + b"\0" * (-len(blob) % 4)
+
+
+def layer_shapes(spec):
+    """Checks the layers against each other and fills in their shapes."""
+    length, channels = spec["input"]
+    layers = []
+    for i, s in enumerate(spec["layers"]):
+        weights, bias = s["weights"], s["bias"]
+        out_channels = len(weights)
+        if s["type"] == "dense":
+            kind, kernel, stride, out_len = DENSE, length, 1, 1
+            rows = [list(w) for w in weights]
+        elif s["type"] == "conv1d":
+            kind, kernel, stride = CONV1D, s["kernel"], s.get("stride", 1)
+            if not 1 <= kernel <= length or stride < 1:
+                sys.exit("layer %d: kernel %d, stride %d on %d steps" % (i, kernel, stride, length))
+            out_len = (length - kernel) // stride + 1
+            rows = [[v for tap in w for v in tap] for w in weights]
+        else:
+            sys.exit("layer %d: unknown type %s" % (i, s["type"]))
+        if len(bias) != out_channels or any(len(r) != kernel * channels for r in rows):
+            sys.exit("layer %d: weights are not [%d][%d x %d]" % (i, out_channels, kernel, channels))
+        layers.append({
+            "type": kind, "activation": ACTIVATIONS[s.get("activation", "none")],
+            "in_len": length, "in_channels": channels, "out_len": out_len, "out_channels": out_channels,
+            "kernel": kernel, "stride": stride, "rows": rows, "bias": list(bias),
+        })
+        length, channels = out_len, out_channels
+    return layers
+
+
+def run_float(layers, x):
+    """Returns every tensor, the input first."""
+    tensors = [x]
+    for l in layers:
+        row, step = l["kernel"] * l["in_channels"], l["stride"] * l["in_channels"]
+        out = []
+        for t in range(l["out_len"]):
+            window = x[t * step:t * step + row]
+            for w, b in zip(l["rows"], l["bias"]):
+                acc = b + sum(wi * xi for wi, xi in zip(w, window))
+                out.append(max(acc, 0.0) if l["activation"] else acc)
+        tensors.append(out)
+        x = out
+    return tensors
+
+
+def activation_params(lo, hi):
+    # The range has to hold zero exactly, for ReLU and zero padding
+    lo, hi = min(lo, 0.0), max(hi, 0.0)
+    scale = (hi - lo) / 255.0 if hi > lo else 1.0
+    zero = max(-128, min(127, round(-128 - lo / scale)))
+    return scale, zero
+
+
+def fixed_point(real):
+    mantissa, exponent = math.frexp(real)
+    multiplier = round(mantissa * (1 << 31))
+    if multiplier == 1 << 31:
+        multiplier //= 2
+        exponent += 1
+    shift = 31 - exponent
+    if not 1 <= shift <= 62:
+        sys.exit("rescale %g is out of range, check the calibration" % real)
+    return multiplier, shift
+
+
+def round_away(v):
+    return int(math.floor(abs(v) + 0.5)) * (1 if v >= 0 else -1)
+
+
+def quantise(layers, ranges):
+    scales = [activation_params(*r) for r in ranges]
+    for i, l in enumerate(layers):
+        (in_scale, in_zero), (out_scale, out_zero) = scales[i], scales[i + 1]
+        l.update(in_scale=in_scale, in_zero=in_zero, out_scale=out_scale, out_zero=out_zero)
+        l["q_rows"], l["weight_scale"], l["q_bias"], l["multiplier"], l["shift"] = [], [], [], [], []
+        for w, b in zip(l["rows"], l["bias"]):
+            peak = max(abs(v) for v in w)
+            w_scale = peak / 127.0 if peak > 0 else 1.0
+            q = [max(-127, min(127, round(v / w_scale))) for v in w]
+            m, s = fixed_point(in_scale * w_scale / out_scale)
+            l["q_rows"].append(q)
+            l["weight_scale"].append(w_scale)
+            l["q_bias"].append(round(b / (in_scale * w_scale)) - in_zero * sum(q))
+            l["multiplier"].append(m)
+            l["shift"].append(s)
+
+
+def run_int8(layers, x):
+    """Mirrors nn_model_run(), returning the dequantised output."""
+    first = layers[0]
+    q = [max(-128, min(127, round_away(v / first["in_scale"]) + first["in_zero"])) for v in x]
+    for l in layers:
+        row, step = l["kernel"] * l["in_channels"], l["stride"] * l["in_channels"]
+        low = l["out_zero"] if l["activation"] else -128
+        out = []
+        for t in range(l["out_len"]):
+            window = q[t * step:t * step + row]
+            for w, b, m, s in zip(l["q_rows"], l["q_bias"], l["multiplier"], l["shift"]):
+                acc = b + sum(wi * xi for wi, xi in zip(w, window))
+                v = ((acc * m + (1 << (s - 1))) >> s) + l["out_zero"]
+                out.append(max(low, min(127, v)))
+        q = out
+    last = layers[-1]
+    return [last["out_scale"] * (v - last["out_zero"]) for v in q]
+
+
+def pack(labels, mean, inv_std, layers, input_shape, temperature):
+    body = b""
+    for name in labels:
+        encoded = name.encode("utf-8")[:LABEL_LEN - 1]
+        body += encoded + b"\0" * (LABEL_LEN - len(encoded))
+    body += struct.pack("<%df" % len(mean), *mean)
+    body += struct.pack("<%df" % len(inv_std), *inv_std)
+    for l in layers:
+        n = l["out_channels"]
+        params = struct.pack("<%di" % n, *l["q_bias"])
+        params += struct.pack("<%di" % n, *l["multiplier"])
+        params += struct.pack("<%df" % n, *l["weight_scale"])
+        params += pad4(struct.pack("<%db" % n, *l["shift"]))
+        params += pad4(struct.pack("<%db" % (n * len(l["q_rows"][0])), *[v for r in l["q_rows"] for v in r]))
+        size = 36 + len(params)
+        body += struct.pack("<8HfifiI", l["type"], l["activation"], l["in_len"], l["in_channels"],
+                            l["out_len"], l["out_channels"], l["kernel"], l["stride"],
+                            l["in_scale"], l["in_zero"], l["out_scale"], l["out_zero"], size)
+        body += params
+    size = 24 + len(body)
+    return struct.pack("<IHHHHHHIf", MAGIC, VERSION, len(layers), input_shape[0], input_shape[1],
+                       len(labels), 0, size, temperature) + body
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("network", help="trained network as JSON")
+    parser.add_argument("corpus", help="labelled feature CSV, for calibration")
+    parser.add_argument("-o", "--output", default="nn.bin")
+    args = parser.parse_args()
+
+    with open(args.network) as f:
+        spec = json.load(f)
+    names = spec["labels"]
+    if not 1 <= len(names) <= MAX_CLASSES:
+        sys.exit("%d classes, the runtime takes 1 to %d" % (len(names), MAX_CLASSES))
+    layers = layer_shapes(spec)
+    if not 1 <= len(layers) <= MAX_LAYERS:
+        sys.exit("%d layers, the runtime takes 1 to %d" % (len(layers), MAX_LAYERS))
+    if layers[-1]["out_len"] * layers[-1]["out_channels"] != len(names):
+        sys.exit("the last layer makes %d outputs for %d labels"
+                 % (layers[-1]["out_len"] * layers[-1]["out_channels"], len(names)))
+
+    labels, rows = read_corpus(args.corpus)
+    input_size = spec["input"][0] * spec["input"][1]
+    if len(rows[0]) != input_size:
+        sys.exit("the corpus has %d features, the network takes %d" % (len(rows[0]), input_size))
+    mean, inv_std = standardise(rows)
+    mean, inv_std = spec.get("mean", mean), spec.get("inv_std", inv_std)
+    scaled = [[(v - m) * s for v, m, s in zip(r, mean, inv_std)] for r in rows]
+
+    ranges = [[math.inf, -math.inf] for _ in range(len(layers) + 1)]
+    float_best = []
+    for x in scaled:
+        tensors = run_float(layers, x)
+        for r, t in zip(ranges, tensors):
+            r[0], r[1] = min(r[0], min(t)), max(r[1], max(t))
+        float_best.append(max(range(len(names)), key=tensors[-1].__getitem__))
+    quantise(layers, ranges)
+
+    agree = float_correct = int8_correct = 0
+    scored = []
+    for x, label, best in zip(scaled, labels, float_best):
+        out = run_int8(layers, x)
+        int8_best = max(range(len(names)), key=out.__getitem__)
+        agree += int8_best == best
+        float_correct += names[best] == label
+        int8_correct += names[int8_best] == label
+        # Logits are negated distances as far as the softmax is concerned
+        if label in names:
+            scored.append(([-v for v in out], names.index(label), None))
+    temperature = fit_temperature(scored) if scored else 1.0
+
+    blob = pack(names, mean, inv_std, layers, spec["input"], temperature)
+    with open(args.output, "wb") as f:
+        f.write(blob)
+
+    print("%s: %d layers, %d classes, %d bytes" % (args.output, len(layers), len(names), len(blob)))
+    print("int8 agrees with float on %.1f%% of the corpus" % (100.0 * agree / len(rows)))
+    print("accuracy: float %.1f%%, int8 %.1f%%"
+          % (100.0 * float_correct / len(rows), 100.0 * int8_correct / len(rows)))
+    if scored:
+        print("temperature %.3f, log loss %.3f (%.3f uncalibrated)"
+              % (temperature, softmax_nll(scored, temperature), softmax_nll(scored, 1.0)))
+
+
+if __name__ == "__main__":
+    main()